@@ -12,20 +12,17 @@
 -- performance improvements especially on multi-master clusters, perhaps even
 -- by an order of magnitude or more.
 --
--- To use this stored procedure the corresponding queries.conf statements must
--- be configured as follows:
+-- To use this stored procedure set the following in queries.conf, which
+-- replaces all of the other alloc_* queries:
 --
--- allocate_begin = ""
--- allocate_find = "\
+-- alloc_atomic = "\
 --	SELECT fr_ippool_allocate_previous_or_new_address( \
---		'%{control.${pool_name}}', \
+--		'%{${pool_name}}', \
 --		'${gateway}', \
 --		'${owner}', \
 --		${offer_duration}, \
 --		'%{${requested_address} || 0.0.0.0}' \
 --	)"
--- allocate_update = ""
--- allocate_commit = ""
 --
 
 CREATE OR REPLACE FUNCTION fr_ippool_allocate_previous_or_new_address (
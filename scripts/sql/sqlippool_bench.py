@@ -0,0 +1,140 @@
+#!/usr/bin/env python3
+#
+#  $Id$
+#
+#  Compare the rlm_sqlippool allocation paths against the bundled SQLite schema.
+#
+#  The queries are read from raddb/mods-config/sql/ippool/sqlite/queries.conf
+#  and run in the same order as rlm_sqlippool runs them:
+#
+#    steps   alloc_begin, alloc_existing, alloc_requested, alloc_find,
+#            alloc_update, alloc_commit
+#    atomic  alloc_atomic
+#
+#  This measures the cost of the SQL alone.  SQLite has no network round trips,
+#  so the difference will be larger with a client/server database.
+#
+#  Usage:
+#
+#    sqlippool_bench.py [-a addresses] [-n allocations] [raddb]
+#
+import argparse
+import os
+import re
+import sqlite3
+import time
+
+POOL = 'bench'
+GATEWAY = '192.0.2.1'
+OFFER_DURATION = 10
+
+
+def queries_load(path):
+    """Return the queries in a queries.conf, including commented out ones"""
+    queries = {}
+    name = None
+    value = ''
+
+    with open(path) as f:
+        for line in f:
+            line = line.strip()
+            if line.startswith('#'):
+                line = line[1:].strip()
+
+            if name is None:
+                m = re.match(r'^(\w+)\s*=\s*"(.*)$', line)
+                if not m:
+                    continue
+                name, line = m.group(1), m.group(2)
+                value = ''
+
+            if line.endswith('\\'):
+                value += line[:-1] + ' '
+                continue
+
+            value += line.rstrip('"')
+            queries.setdefault(name, value)
+            name = None
+
+    return queries
+
+
+def query_expand(query, owner):
+    """Substitute the configuration items and expansions the module would"""
+    query = query.replace('${ippool_table}', 'fr_ippool')
+    query = query.replace('%{${pool_name}}', POOL)
+    query = query.replace('%{${requested_address} || 0.0.0.0}', '0.0.0.0')
+    query = query.replace('${owner}', owner)
+    query = query.replace('${gateway}', GATEWAY)
+    query = query.replace('${offer_duration}', str(OFFER_DURATION))
+    return query.replace('%%', '%')
+
+
+def db_create(schema, addresses):
+    db = sqlite3.connect(':memory:', isolation_level=None)
+    with open(schema) as f:
+        db.executescript(f.read())
+    db.executemany('INSERT INTO fr_ippool (pool_name, address) VALUES (?, ?)',
+                   ((POOL, '10.%d.%d.%d' % (i >> 16 & 0xff, i >> 8 & 0xff, i & 0xff))
+                    for i in range(addresses)))
+    db.execute("UPDATE fr_ippool SET expiry_time = datetime('now', '-1 hour')")
+    return db
+
+
+def first(db, query):
+    row = db.execute(query).fetchone()
+    return row[0] if row else None
+
+
+def alloc_steps(db, queries, owner):
+    db.execute(queries['alloc_begin'])
+    address = first(db, query_expand(queries['alloc_existing'], owner))
+    if not address:
+        address = first(db, query_expand(queries['alloc_requested'], owner))
+    if not address:
+        address = first(db, query_expand(queries['alloc_find'], owner))
+    if address:
+        db.execute(query_expand(queries['alloc_update'], owner)
+                   .replace('%{${allocated_address_attr}}', address))
+    db.execute(queries['alloc_commit'])
+    return address
+
+
+def alloc_atomic(db, queries, owner):
+    return first(db, query_expand(queries['alloc_atomic'], owner))
+
+
+def run(name, func, schema, queries, addresses, allocations):
+    db = db_create(schema, addresses)
+
+    start = time.perf_counter()
+    for i in range(allocations):
+        if not func(db, queries, 'owner-%d' % i):
+            raise SystemExit('%s: allocation %d failed' % (name, i))
+    elapsed = time.perf_counter() - start
+
+    print('%-8s %8d allocations in %7.3fs, %10.0f allocations/s' %
+          (name, allocations, elapsed, allocations / elapsed))
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Benchmark rlm_sqlippool allocation queries with SQLite')
+    parser.add_argument('-a', dest='addresses', type=int, default=20000, help='addresses in the pool')
+    parser.add_argument('-n', dest='allocations', type=int, default=5000, help='allocations to make')
+    parser.add_argument('raddb', nargs='?',
+                        default=os.path.join(os.path.dirname(__file__), '..', '..', 'raddb'))
+    args = parser.parse_args()
+
+    if args.allocations > args.addresses:
+        parser.error('more allocations than addresses')
+
+    base = os.path.join(args.raddb, 'mods-config', 'sql', 'ippool', 'sqlite')
+    schema = os.path.join(base, 'schema.sql')
+    queries = queries_load(os.path.join(base, 'queries.conf'))
+
+    run('steps', alloc_steps, schema, queries, args.addresses, args.allocations)
+    run('atomic', alloc_atomic, schema, queries, args.addresses, args.allocations)
+
+
+if __name__ == '__main__':
+    main()
@@ -138,6 +138,8 @@ static int thread_instantiate(TALLOC_CTX *ctx, fr_event_list_t *el, UNUSED void
 #ifdef WITH_TLS
 	if (fr_openssl_thread_init(main_config->openssl_async_pool_init,
 				   main_config->openssl_async_pool_max) < 0) return -1;
+
+	if (fr_tls_pkey_thread_init(ctx, el) < 0) return -1;
 #endif
 	return 0;
 }
@@ -792,6 +794,15 @@ int main(int argc, char *argv[])
 	 */
 	if (unlang_global_init() < 0) EXIT_WITH_FAILURE;
 
+#ifdef WITH_TLS
+	/*
+	 *  Start the private key offload threads.  This must be
+	 *  done after forking, and before any TLS contexts are
+	 *  created.
+	 */
+	if (fr_tls_pkey_pool_start(config->openssl_pkey_threads) < 0) EXIT_WITH_FAILURE;
+#endif
+
 	if (server_init(config->root_cs) < 0) EXIT_WITH_FAILURE;
 
 	/*
@@ -833,6 +844,7 @@ int main(int argc, char *argv[])
 		schedule->max_workers = config->max_workers;
 		schedule->max_networks = config->max_networks;
 		schedule->stats_interval = config->stats_interval;
+		schedule->timer_resolution = config->timer_resolution;
 
 		schedule->network.max_outstanding = config->max_requests;
 
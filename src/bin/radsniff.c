@@ -29,6 +29,7 @@ RCSID("$Id$")
 #include <fcntl.h>
 #include <time.h>
 #include <math.h>
+#include <pthread.h>
 
 #include <freeradius-devel/autoconf.h>
 #include <freeradius-devel/radius/list.h>
@@ -41,23 +42,85 @@ RCSID("$Id$")
 #include <freeradius-devel/util/base16.h>
 #include <freeradius-devel/util/pcap.h>
 #include <freeradius-devel/util/timeval.h>
+#include <freeradius-devel/util/hash.h>
+
+#ifdef HAVE_STDATOMIC_H
+#  include <stdatomic.h>
+#else
+#  include <freeradius-devel/util/stdatomic.h>
+#endif
 
 #ifdef HAVE_COLLECTDC_H
 #  include <collectd/client.h>
 #endif
 
+#ifdef HAVE_LINUX_IF_PACKET_H
+#  include <linux/if_packet.h>
+#  include <linux/if_ether.h>
+#  include <linux/filter.h>
+#  include <net/if.h>
+#  include <net/if_arp.h>
+#  include <sys/ioctl.h>
+#  include <sys/mman.h>
+#  include <poll.h>
+#endif
+
 #include "radsniff.h"
 
 #define RS_ASSERT(_x) if (!(_x) && !fr_cond_assert(_x)) exit(1)
 
 static rs_t *conf;
 static struct timeval start_pcap = {0, 0};
-static char timestr[50];
+static _Thread_local char timestr[50];
 
-static fr_rb_tree_t *request_tree = NULL;
-static fr_rb_tree_t *link_tree = NULL;
+/*
+ *	Each capture thread has its own trees.
+ */
+static _Thread_local fr_rb_tree_t *request_tree = NULL;
+static _Thread_local fr_rb_tree_t *link_tree = NULL;
 static fr_event_list_t *events;
 static bool cleanup;
+
+static atomic_uint_fast64_t captured;		//!< Packets processed, for the capture limit.
+
+static rs_thread_t *threads;			//!< Capture threads, if there are any.
+static atomic_bool threads_exit;		//!< Tell the capture threads to exit.
+static pthread_mutex_t output_mutex = PTHREAD_MUTEX_INITIALIZER;	//!< Serialises output from capture threads.
+
+/** A capture thread
+ *
+ * Each thread processes a share of the packets, and has its own request and
+ * link trees.  Packets are shared out by a hash of their addresses and ports,
+ * which is the same for a request and its response, so each thread can link
+ * the requests and responses it sees on its own.
+ */
+struct rs_thread {
+	unsigned int		id;			//!< Index of this thread.
+	pthread_t		pthread;
+	bool			started;		//!< Whether pthread is valid.
+
+	pthread_mutex_t		mutex;			//!< Held while processing packets, so that the
+							///< main thread can merge the stats.
+	TALLOC_CTX		*ctx;			//!< Everything the thread allocates.  Not a child
+							///< of conf, as talloc isn't thread safe.
+	rs_event_t		*event;			//!< Packets are processed as if they were read
+							///< from this.
+	rs_stats_t		*stats;			//!< Merged into the main stats every interval.
+	fr_rb_tree_t		*request_tree;		//!< This thread's request tree.
+	fr_rb_tree_t		*link_tree;		//!< This thread's link tree.
+	uint64_t		count;			//!< Packets this thread has processed.
+
+	rs_capture_t		*packets;		//!< Packets to process, when benchmarking.
+	size_t			num_packets;		//!< How many packets there are.
+
+#ifdef HAVE_LINUX_IF_PACKET_H
+	int			fd;			//!< Packet socket, in the fanout group.
+	uint8_t			*ring;			//!< Blocks of packets, shared with the kernel.
+	size_t			block_size;		//!< Size of each block.
+	unsigned int		num_blocks;		//!< Number of blocks in the ring.
+	unsigned int		block;			//!< Next block to read.
+#endif
+};
 static int packets_count = 1; // Used in '$PATH/${packet}.txt.${count}'
 
 static int self_pipe[2] = {-1, -1};		//!< Signals from sig handlers
@@ -109,6 +172,7 @@ fr_dict_attr_autoload_t radsniff_dict_attr[] = {
 };
 
 static NEVER_RETURNS void usage(int status);
+static void rs_signal_self(int sig);
 
 /** Fork and kill the parent process, writing out our PID
  *
@@ -534,7 +598,10 @@ static inline void rs_packet_print(rs_request_t *request, uint64_t count, rs_sta
 	if (!conf->logger) return;
 
 	if (request) request->logged = true;
+
+	if (threads) pthread_mutex_lock(&output_mutex);
 	conf->logger(count, status, handle, packet, list, elapsed, latency, response, body);
+	if (threads) pthread_mutex_unlock(&output_mutex);
 }
 
 /** Query libpcap to see if it dropped any packets
@@ -838,6 +905,78 @@ static void rs_stats_print_csv(rs_update_t *this, rs_stats_t *stats, UNUSED stru
 	fprintf(stdout , "%s\n", buffer);
 }
 
+/** Merge the stats from the capture threads into the main stats
+ *
+ * The capture threads' interval counters are reset, as the main ones are
+ * once they've been processed.
+ *
+ * @param[in] stats	to merge into.
+ * @return
+ *	- 0 on success.
+ *	- -1 if a capture thread dropped packets, or we couldn't check.
+ */
+static int rs_threads_stats_merge(rs_stats_t *stats)
+{
+	unsigned int	i;
+	size_t		j, k;
+	int		ret = 0;
+
+	for (i = 0; i < conf->threads; i++) {
+		rs_thread_t	*thread = &threads[i];
+
+		pthread_mutex_lock(&thread->mutex);
+		for (j = 0; j < NUM_ELEMENTS(rs_useful_codes); j++) {
+			rs_latency_t	*out = &stats->exchange[rs_useful_codes[j]];
+			rs_latency_t	*in = &thread->stats->exchange[rs_useful_codes[j]];
+
+			out->interval.received_total += in->interval.received_total;
+			out->interval.linked_total += in->interval.linked_total;
+			out->interval.unlinked_total += in->interval.unlinked_total;
+			out->interval.reused_total += in->interval.reused_total;
+			out->interval.lost_total += in->interval.lost_total;
+			for (k = 0; k < NUM_ELEMENTS(out->interval.rt_total); k++) {
+				out->interval.rt_total[k] += in->interval.rt_total[k];
+			}
+
+			out->interval.latency_total += in->interval.latency_total;
+			if (in->interval.latency_high > out->interval.latency_high) {
+				out->interval.latency_high = in->interval.latency_high;
+			}
+			if (in->interval.latency_low &&
+			    (!out->interval.latency_low || (in->interval.latency_low < out->interval.latency_low))) {
+				out->interval.latency_low = in->interval.latency_low;
+			}
+
+			memset(&in->interval, 0, sizeof(in->interval));
+		}
+
+		if (timercmp(&thread->stats->quiet, &stats->quiet, >)) stats->quiet = thread->stats->quiet;
+		pthread_mutex_unlock(&thread->mutex);
+
+#ifdef HAVE_LINUX_IF_PACKET_H
+		/*
+		 *	Reading the stats resets them.
+		 */
+		if (thread->fd >= 0) {
+			struct tpacket_stats_v3	tp_stats;
+			socklen_t		len = sizeof(tp_stats);
+
+			if (getsockopt(thread->fd, SOL_PACKET, PACKET_STATISTICS, &tp_stats, &len) < 0) {
+				ERROR("Capture thread %u failed retrieving packet stats: %s",
+				      thread->id, fr_syserror(errno));
+				ret = -1;
+			} else if (tp_stats.tp_drops > 0) {
+				ERROR("Capture thread %u dropped %u packets: Buffer exhaustion",
+				      thread->id, tp_stats.tp_drops);
+				ret = -1;
+			}
+		}
+#endif
+	}
+
+	return ret;
+}
+
 /** Process stats for a single interval
  *
  */
@@ -859,6 +998,17 @@ static void rs_stats_process(fr_event_list_t *el, fr_time_t now_t, void *ctx)
 
 	stats->intervals++;
 
+	/*
+	 *	Capture threads keep their own stats, and check
+	 *	for drops themselves.
+	 */
+	if (threads && (rs_threads_stats_merge(stats) < 0)) {
+		ERROR("Muting stats for the next %i milliseconds", conf->stats.timeout);
+
+		rs_tv_add_ms(&now, conf->stats.timeout, &stats->quiet);
+		goto clear;
+	}
+
 	for (in_p = this->in;
 	     in_p;
 	     in_p = in_p->next) {
@@ -1153,6 +1303,8 @@ static inline int rs_response_to_pcap(rs_event_t *event, rs_request_t *request,
 {
 	if (!event->out) return 0;
 
+	if (threads) pthread_mutex_lock(&output_mutex);
+
 	/*
 	 *	If we're filtering by response then the requests then the capture buffer
 	 *	associated with the request should contain buffered request packets.
@@ -1195,6 +1347,8 @@ static inline int rs_response_to_pcap(rs_event_t *event, rs_request_t *request,
 	 */
 	pcap_dump((void *)event->out->dumper, header, data);
 
+	if (threads) pthread_mutex_unlock(&output_mutex);
+
 	return 0;
 }
 
@@ -1230,7 +1384,9 @@ static inline int rs_request_to_pcap(rs_event_t *event, rs_request_t *request, s
 		return 0;
 	}
 
+	if (threads) pthread_mutex_lock(&output_mutex);
 	pcap_dump((void *)event->out->dumper, header, data);
+	if (threads) pthread_mutex_unlock(&output_mutex);
 
 	return 0;
 }
@@ -1260,6 +1416,42 @@ static rs_request_t *rs_request_alloc(TALLOC_CTX *ctx)
 
 static const uint8_t zeros[RADIUS_AUTH_VECTOR_LENGTH] = {};
 
+/** Stop the protocol library logging while we verify or decode a packet
+ *
+ * fr_log_fp is shared, so it's left alone if there are capture threads.
+ */
+static inline FILE *rs_log_mute(void)
+{
+	FILE *log_fp = fr_log_fp;
+
+	if (!threads) fr_log_fp = NULL;
+
+	return log_fp;
+}
+
+static inline void rs_log_unmute(FILE *log_fp)
+{
+	if (!threads) fr_log_fp = log_fp;
+}
+
+/** Stop capturing, once we've seen enough packets
+ *
+ */
+static void rs_exit(rs_event_t *event)
+{
+	if (!event->thread) {
+		fr_event_loop_exit(events, 1);
+		return;
+	}
+
+	/*
+	 *	Capture threads can't touch the main event list,
+	 *	so they tell the main thread, as a signal would.
+	 */
+	atomic_store(&threads_exit, true);
+	if (self_pipe[1] >= 0) rs_signal_self(SIGTERM);
+}
+
 static void rs_packet_process(uint64_t count, rs_event_t *event, struct pcap_pkthdr const *header, uint8_t const *data)
 {
 	rs_stats_t		*stats = event->stats;
@@ -1279,7 +1471,6 @@ static void rs_packet_process(uint64_t count, rs_event_t *event, struct pcap_pkt
 	bool			response;		/* Was it a response code */
 
 	decode_fail_t		reason;			/* Why we failed decoding the packet */
-	static uint64_t		captured = 0;
 
 	rs_status_t		status = RS_NORMAL;	/* Any special conditions (RTX, Unlinked, ID-Reused) */
 	fr_packet_t	*packet;		/* Current packet were processing */
@@ -1295,7 +1486,11 @@ static void rs_packet_process(uint64_t count, rs_event_t *event, struct pcap_pkt
 	fr_pair_list_init(&search.expect_vps);
 	fr_pair_list_init(&search.link_vps);
 
-	if (!start_pcap.tv_sec) {
+	/*
+	 *	Capture threads only read start_pcap.  It's set
+	 *	before they start.
+	 */
+	if (!threads && !start_pcap.tv_sec) {
 		start_pcap = header->ts;
 	}
 
@@ -1390,7 +1585,7 @@ static void rs_packet_process(uint64_t count, rs_event_t *event, struct pcap_pkt
 	 *	recover once some requests timeout, so make an effort to deal
 	 *	with allocation failures gracefully.
 	 */
-	packet = fr_packet_alloc(conf, false);
+	packet = fr_packet_alloc(event->ctx, false);
 	if (!packet) {
 		REDEBUG("Failed allocating memory to hold decoded packet");
 		rs_tv_add_ms(&header->ts, conf->stats.timeout, &stats->quiet);
@@ -1467,11 +1662,10 @@ static void rs_packet_process(uint64_t count, rs_event_t *event, struct pcap_pkt
 
 		if (conf->verify_radius_authenticator && original) {
 			int ret;
-			FILE *log_fp = fr_log_fp;
+			FILE *log_fp = rs_log_mute();
 
-			fr_log_fp = NULL;
 			ret = fr_packet_verify(packet, original->expect, conf->radius_secret);
-			fr_log_fp = log_fp;
+			rs_log_unmute(log_fp);
 			if (ret != 0) {
 				fr_perror("Failed verifying packet ID %d", packet->id);
 				fr_packet_free(&packet);
@@ -1604,11 +1798,10 @@ static void rs_packet_process(uint64_t count, rs_event_t *event, struct pcap_pkt
 			case FR_RADIUS_CODE_DISCONNECT_REQUEST:
 			{
 				int ret;
-				FILE *log_fp = fr_log_fp;
+				FILE *log_fp = rs_log_mute();
 
-				fr_log_fp = NULL;
 				ret = fr_packet_verify(packet, NULL, conf->radius_secret);
-				fr_log_fp = log_fp;
+				rs_log_unmute(log_fp);
 				if (ret != 0) {
 					fr_perror("Failed verifying packet ID %d", packet->id);
 					fr_packet_free(&packet);
@@ -1628,13 +1821,12 @@ static void rs_packet_process(uint64_t count, rs_event_t *event, struct pcap_pkt
 		 */
 		if (conf->decode_attrs) {
 			int ret;
-			FILE *log_fp = fr_log_fp;
+			FILE *log_fp = rs_log_mute();
 
-			fr_log_fp = NULL;
 			ret = fr_radius_decode_simple(packet, &decoded,
 						      packet->data, packet->data_len, NULL,
 						      conf->radius_secret);
-			fr_log_fp = log_fp;
+			rs_log_unmute(log_fp);
 
 			if (ret < 0) {
 				fr_packet_free(&packet);	/* Also frees vps */
@@ -1757,7 +1949,7 @@ static void rs_packet_process(uint64_t count, rs_event_t *event, struct pcap_pkt
 		 *	...nope it's a new request.
 		 */
 		} else {
-			original = rs_request_alloc(conf);
+			original = rs_request_alloc(event->ctx);
 			original->id = count;
 			original->in = event->in;
 			original->stats_req = &stats->exchange[packet->code];
@@ -1913,13 +2105,13 @@ static void rs_packet_process(uint64_t count, rs_event_t *event, struct pcap_pkt
 		fr_packet_free(&packet);	/* Also frees decoded */
 	}
 
-	captured++;
 	/*
 	 *	We've hit our capture limit, break out of the event loop
 	 */
-	if ((conf->limit > 0) && (captured >= conf->limit)) {
-		INFO("Captured %" PRIu64 " packets, exiting...", captured);
-		fr_event_loop_exit(events, 1);
+	if ((conf->limit > 0) &&
+	    ((atomic_fetch_add_explicit(&captured, 1, memory_order_relaxed) + 1) == conf->limit)) {
+		INFO("Captured %" PRIu64 " packets, exiting...", conf->limit);
+		rs_exit(event);
 	}
 }
 
@@ -2177,6 +2369,580 @@ static void timeout_event(fr_event_list_t *el, UNUSED fr_time_t now_t, UNUSED vo
 	fr_event_loop_exit(el, 1);
 }
 
+/** Process a packet in a capture thread
+ *
+ */
+static inline void rs_thread_packet(rs_thread_t *thread, struct pcap_pkthdr const *header, uint8_t const *data)
+{
+	fr_time_t now;
+
+	do {
+		now = fr_time_from_timeval(&header->ts);
+	} while (fr_event_timer_run(thread->event->list, &now) == 1);
+
+	/*
+	 *	Counts are per-thread, so interleave them to keep
+	 *	them unique.
+	 */
+	rs_packet_process((thread->count++ * conf->threads) + thread->id + 1, thread->event, header, data);
+}
+
+/** Process packets which were read from files, when benchmarking
+ *
+ */
+static void *rs_thread_file(void *arg)
+{
+	rs_thread_t	*thread = arg;
+	size_t		i;
+
+	request_tree = thread->request_tree;
+	link_tree = thread->link_tree;
+
+	pthread_mutex_lock(&thread->mutex);
+	for (i = 0; (i < thread->num_packets) && !atomic_load(&threads_exit); i++) {
+		rs_thread_packet(thread, thread->packets[i].header, thread->packets[i].data);
+	}
+	pthread_mutex_unlock(&thread->mutex);
+
+	TALLOC_FREE(thread->ctx);
+
+	return NULL;
+}
+
+#ifdef HAVE_LINUX_IF_PACKET_H
+/** Check we can capture from an interface with a packet socket
+ *
+ * The ring gives us the frame as it was received, so we need to know the
+ * link layer without libpcap's help.
+ */
+static int rs_ring_link_layer(fr_pcap_t *in)
+{
+	struct ifreq	ifr;
+	int		fd;
+
+	fd = socket(AF_INET, SOCK_DGRAM, 0);
+	if (fd < 0) {
+		ERROR("Failed opening socket: %s", fr_syserror(errno));
+		return -1;
+	}
+
+	memset(&ifr, 0, sizeof(ifr));
+	strlcpy(ifr.ifr_name, in->name, sizeof(ifr.ifr_name));
+	if (ioctl(fd, SIOCGIFHWADDR, &ifr) < 0) {
+		ERROR("Failed getting hardware type of %s: %s", in->name, fr_syserror(errno));
+		close(fd);
+		return -1;
+	}
+	close(fd);
+
+	if (ifr.ifr_hwaddr.sa_family != ARPHRD_ETHER) {
+		ERROR("Capture threads can only capture from Ethernet interfaces");
+		return -1;
+	}
+
+	in->ifindex = if_nametoindex(in->name);
+	if (in->ifindex == 0) {
+		ERROR("Failed getting index of %s: %s", in->name, fr_syserror(errno));
+		return -1;
+	}
+	in->link_layer = DLT_EN10MB;
+
+	return 0;
+}
+
+/** Compile a pcap filter, and attach it to a packet socket
+ *
+ */
+static int rs_ring_filter(int fd, char const *expression)
+{
+	pcap_t			*dead;
+	struct bpf_program	prog;
+	struct sock_fprog	fprog;
+	int			ret;
+
+	dead = pcap_open_dead(DLT_EN10MB, SNAPLEN);
+	if (!dead) {
+		fr_strerror_const("Failed allocating pcap handle");
+		return -1;
+	}
+
+	if (pcap_compile(dead, &prog, expression, 1, PCAP_NETMASK_UNKNOWN) < 0) {
+		fr_strerror_printf("%s", pcap_geterr(dead));
+		pcap_close(dead);
+		return -1;
+	}
+
+	fprog.len = prog.bf_len;
+	fprog.filter = (struct sock_filter *)prog.bf_insns;
+
+	ret = setsockopt(fd, SOL_SOCKET, SO_ATTACH_FILTER, &fprog, sizeof(fprog));
+	if (ret < 0) fr_strerror_printf("%s", fr_syserror(errno));
+
+	pcap_freecode(&prog);
+	pcap_close(dead);
+
+	return (ret < 0) ? -1 : 0;
+}
+
+/** Open a packet socket with a TPACKET_V3 ring, and add it to the fanout group
+ *
+ * The kernel shares packets between the sockets in the group, and writes
+ * them directly into each socket's ring.
+ */
+static int rs_ring_open(rs_thread_t *thread, fr_pcap_t *in, int fanout_id)
+{
+	int			version = TPACKET_V3;
+	int			fanout;
+	size_t			ring_size;
+	struct tpacket_req3	req;
+	struct sockaddr_ll	sll;
+
+	thread->fd = socket(AF_PACKET, SOCK_RAW, htons(ETH_P_ALL));
+	if (thread->fd < 0) {
+		ERROR("Failed opening packet socket: %s", fr_syserror(errno));
+		return -1;
+	}
+
+	/*
+	 *	Filter before binding, so nothing we don't want
+	 *	gets into the ring.
+	 */
+	if (conf->pcap_filter &&
+	    (!conf->pcap_filter_vlan || (rs_ring_filter(thread->fd, conf->pcap_filter_vlan) < 0)) &&
+	    (rs_ring_filter(thread->fd, conf->pcap_filter) < 0)) {
+		fr_perror("Failed applying filter");
+		return -1;
+	}
+
+	if (setsockopt(thread->fd, SOL_PACKET, PACKET_VERSION, &version, sizeof(version)) < 0) {
+		ERROR("Failed setting packet socket version: %s", fr_syserror(errno));
+		return -1;
+	}
+
+	/*
+	 *	-b gives the size of the ring in packets.
+	 */
+	ring_size = conf->buffer_pkts ? (size_t)conf->buffer_pkts * RS_RING_FRAME_SIZE : RS_RING_SIZE;
+
+	memset(&req, 0, sizeof(req));
+	req.tp_block_size = RS_RING_BLOCK_SIZE;
+	req.tp_block_nr = ring_size / RS_RING_BLOCK_SIZE;
+	if (req.tp_block_nr < 2) req.tp_block_nr = 2;
+	req.tp_frame_size = RS_RING_FRAME_SIZE;
+	req.tp_frame_nr = (req.tp_block_size / req.tp_frame_size) * req.tp_block_nr;
+	req.tp_retire_blk_tov = RS_RING_BLOCK_TIMEOUT;
+
+	if (setsockopt(thread->fd, SOL_PACKET, PACKET_RX_RING, &req, sizeof(req)) < 0) {
+		ERROR("Failed allocating packet ring: %s", fr_syserror(errno));
+		return -1;
+	}
+
+	thread->ring = mmap(NULL, (size_t)req.tp_block_size * req.tp_block_nr,
+			    PROT_READ | PROT_WRITE, MAP_SHARED, thread->fd, 0);
+	if (thread->ring == MAP_FAILED) {
+		thread->ring = NULL;
+		ERROR("Failed mapping packet ring: %s", fr_syserror(errno));
+		return -1;
+	}
+	thread->block_size = req.tp_block_size;
+	thread->num_blocks = req.tp_block_nr;
+
+	memset(&sll, 0, sizeof(sll));
+	sll.sll_family = AF_PACKET;
+	sll.sll_protocol = htons(ETH_P_ALL);
+	sll.sll_ifindex = in->ifindex;
+
+	if (bind(thread->fd, (struct sockaddr *)&sll, sizeof(sll)) < 0) {
+		ERROR("Failed binding packet socket to %s: %s", in->name, fr_syserror(errno));
+		return -1;
+	}
+
+	if (conf->promiscuous) {
+		struct packet_mreq mreq = {
+			.mr_ifindex = in->ifindex,
+			.mr_type = PACKET_MR_PROMISC
+		};
+
+		if (setsockopt(thread->fd, SOL_PACKET, PACKET_ADD_MEMBERSHIP, &mreq, sizeof(mreq)) < 0) {
+			ERROR("Failed putting %s into promiscuous mode: %s", in->name, fr_syserror(errno));
+			return -1;
+		}
+	}
+
+	/*
+	 *	The fanout hash is symmetric, so a request and its
+	 *	response arrive on the same socket.  Fragments are
+	 *	reassembled first, so they're not split up.
+	 */
+	fanout = fanout_id | ((PACKET_FANOUT_HASH | PACKET_FANOUT_FLAG_DEFRAG) << 16);
+	if (setsockopt(thread->fd, SOL_PACKET, PACKET_FANOUT, &fanout, sizeof(fanout)) < 0) {
+		ERROR("Failed joining fanout group: %s", fr_syserror(errno));
+		return -1;
+	}
+
+	return 0;
+}
+
+/** Process packets from a capture thread's ring
+ *
+ */
+static void *rs_thread_ring(void *arg)
+{
+	rs_thread_t	*thread = arg;
+
+	request_tree = thread->request_tree;
+	link_tree = thread->link_tree;
+
+	while (!atomic_load(&threads_exit)) {
+		struct tpacket_block_desc	*block;
+		struct tpacket3_hdr		*hdr;
+		uint32_t			i;
+		fr_time_t			now;
+
+		block = (struct tpacket_block_desc *)(thread->ring + (thread->block * thread->block_size));
+
+		/*
+		 *	Nothing yet, wait for the kernel to retire a block.
+		 *	The timeout means we notice when we're asked to exit,
+		 *	and can expire requests when there's no traffic.
+		 */
+		if (!(*(volatile uint32_t *)&block->hdr.bh1.block_status & TP_STATUS_USER)) {
+			struct pollfd pfd = { .fd = thread->fd, .events = POLLIN | POLLERR };
+
+			if ((poll(&pfd, 1, 100) < 0) && (errno != EINTR)) {
+				ERROR("Capture thread %u failed polling: %s", thread->id, fr_syserror(errno));
+				break;
+			}
+
+			pthread_mutex_lock(&thread->mutex);
+			do {
+				now = fr_time();
+			} while (fr_event_timer_run(thread->event->list, &now) == 1);
+			pthread_mutex_unlock(&thread->mutex);
+			continue;
+		}
+
+		atomic_thread_fence(memory_order_acquire);
+
+		pthread_mutex_lock(&thread->mutex);
+		hdr = (struct tpacket3_hdr *)((uint8_t *)block + block->hdr.bh1.offset_to_first_pkt);
+		for (i = 0; i < block->hdr.bh1.num_pkts; i++) {
+			struct pcap_pkthdr header = {
+				.ts = {
+					.tv_sec = hdr->tp_sec,
+					.tv_usec = hdr->tp_nsec / 1000
+				},
+				.caplen = hdr->tp_snaplen,
+				.len = hdr->tp_len
+			};
+
+			rs_thread_packet(thread, &header, (uint8_t *)hdr + hdr->tp_mac);
+			hdr = (struct tpacket3_hdr *)((uint8_t *)hdr + hdr->tp_next_offset);
+		}
+		pthread_mutex_unlock(&thread->mutex);
+
+		/*
+		 *	Give the block back to the kernel
+		 */
+		atomic_thread_fence(memory_order_release);
+		*(volatile uint32_t *)&block->hdr.bh1.block_status = TP_STATUS_KERNEL;
+		thread->block = (thread->block + 1) % thread->num_blocks;
+	}
+
+	TALLOC_FREE(thread->ctx);
+
+	return NULL;
+}
+#endif
+
+/** Allocate the capture threads
+ *
+ * The threads are started separately, by rs_threads_start().
+ */
+static int rs_threads_alloc(fr_pcap_t *in, fr_pcap_t *out)
+{
+	unsigned int i;
+
+	threads = talloc_zero_array(conf, rs_thread_t, conf->threads);
+	if (!threads) {
+	oom:
+		ERROR("Failed allocating capture threads");
+		return -1;
+	}
+
+	for (i = 0; i < conf->threads; i++) {
+		rs_thread_t *thread = &threads[i];
+
+		thread->id = i;
+#ifdef HAVE_LINUX_IF_PACKET_H
+		thread->fd = -1;
+#endif
+		pthread_mutex_init(&thread->mutex, NULL);
+
+		thread->stats = talloc_zero(threads, rs_stats_t);
+		if (!thread->stats) goto oom;
+
+		thread->ctx = talloc_new(NULL);
+		if (!thread->ctx) goto oom;
+
+		thread->event = talloc_zero(thread->ctx, rs_event_t);
+		if (!thread->event) goto oom;
+
+		thread->event->list = fr_event_list_alloc(thread->ctx, NULL, NULL);
+		if (!thread->event->list) {
+			fr_perror("Failed allocating capture thread event list");
+			return -1;
+		}
+		thread->event->in = in;
+		thread->event->out = out;
+		thread->event->stats = thread->stats;
+		thread->event->ctx = thread->ctx;
+		thread->event->thread = thread;
+
+		thread->request_tree = fr_rb_inline_talloc_alloc(thread->ctx, rs_request_t, request_node,
+								 rs_packet_cmp, _unmark_request);
+		if (!thread->request_tree) goto oom;
+
+		if (conf->link_da_num > 0) {
+			thread->link_tree = fr_rb_inline_talloc_alloc(thread->ctx, rs_request_t, link_node,
+								      rs_rtx_cmp, _unmark_link);
+			if (!thread->link_tree) goto oom;
+		}
+	}
+
+	return 0;
+}
+
+/** Start the capture threads
+ *
+ */
+static int rs_threads_start(void *(*func)(void *))
+{
+	unsigned int i;
+
+	/*
+	 *	The threads use start_pcap to print times relative to
+	 *	the start of the capture, and must not write it.
+	 */
+	if (!start_pcap.tv_sec) start_pcap = fr_time_to_timeval(fr_time());
+
+	for (i = 0; i < conf->threads; i++) {
+		int ret;
+
+		ret = pthread_create(&threads[i].pthread, NULL, func, &threads[i]);
+		if (ret != 0) {
+			ERROR("Failed creating capture thread: %s", fr_syserror(ret));
+			return -1;
+		}
+		threads[i].started = true;
+	}
+
+	return 0;
+}
+
+/** Wait for the capture threads to exit, and free them
+ *
+ * Live capture threads only exit once threads_exit is set.
+ */
+static void rs_threads_join(void)
+{
+	unsigned int i;
+
+	if (!threads) return;
+
+	for (i = 0; i < conf->threads; i++) {
+		rs_thread_t *thread = &threads[i];
+
+		if (thread->started) pthread_join(thread->pthread, NULL);
+
+		/*
+		 *	Threads which never started can't free their own
+		 */
+		TALLOC_FREE(thread->ctx);
+		pthread_mutex_destroy(&thread->mutex);
+
+#ifdef HAVE_LINUX_IF_PACKET_H
+		if (thread->ring) munmap(thread->ring, thread->block_size * thread->num_blocks);
+		if (thread->fd >= 0) close(thread->fd);
+#endif
+	}
+
+	TALLOC_FREE(threads);
+}
+
+#ifdef HAVE_LINUX_IF_PACKET_H
+/** Allocate the capture threads for a live capture, and their rings
+ *
+ */
+static int rs_threads_ring_alloc(fr_pcap_t *in, fr_pcap_t *out)
+{
+	unsigned int	i;
+	int		fanout_id = getpid() & 0xffff;
+
+	if (in->next) {
+		ERROR("Capture threads can only capture from one interface (-i)");
+		return -1;
+	}
+
+	if (rs_threads_alloc(in, out) < 0) return -1;
+
+	for (i = 0; i < conf->threads; i++) {
+		if (rs_ring_open(&threads[i], in, fanout_id) < 0) return -1;
+	}
+
+	return 0;
+}
+#endif
+
+/** Hash the addresses and ports of a packet, the same way for a request and its response
+ *
+ * This shares packets between threads when benchmarking, as PACKET_FANOUT_HASH
+ * does for a live capture.
+ */
+static uint32_t rs_packet_flow_hash(uint8_t const *data, size_t len, int link_layer)
+{
+	uint8_t const		*p, *end = data + len;
+	void const		*src, *dst;
+	size_t			addr_len;
+	ssize_t			offset;
+	udp_header_t const	*udp;
+
+	offset = fr_pcap_link_layer_offset(data, len, link_layer);
+	if ((offset < 0) || ((size_t)offset >= len)) return 0;
+	p = data + offset;
+
+	switch (p[0] >> 4) {
+	case 4:
+	{
+		ip_header_t const *ip = (ip_header_t const *)p;
+
+		if ((size_t)(end - p) < sizeof(*ip)) return 0;
+
+		src = &ip->ip_src;
+		dst = &ip->ip_dst;
+		addr_len = sizeof(ip->ip_src);
+		p += IP_HL(ip);
+	}
+		break;
+
+	case 6:
+	{
+		ip_header6_t const *ip6 = (ip_header6_t const *)p;
+
+		if ((size_t)(end - p) < sizeof(*ip6)) return 0;
+
+		src = &ip6->ip_src;
+		dst = &ip6->ip_dst;
+		addr_len = sizeof(ip6->ip_src);
+		p += sizeof(*ip6);
+	}
+		break;
+
+	default:
+		return 0;
+	}
+
+	if ((p > end) || ((size_t)(end - p) < sizeof(*udp))) return 0;
+	udp = (udp_header_t const *)p;
+
+	/*
+	 *	XOR doesn't care which way the packet was going
+	 */
+	return fr_hash_update(&udp->src, sizeof(udp->src), fr_hash(src, addr_len)) ^
+	       fr_hash_update(&udp->dst, sizeof(udp->dst), fr_hash(dst, addr_len));
+}
+
+/** Process the packets in the input files with capture threads, and print the throughput
+ *
+ * The packets are read into memory and shared between the threads before
+ * the clock starts, so only processing them is timed.
+ */
+static int rs_benchmark(fr_pcap_t *in, fr_pcap_t *out)
+{
+	fr_pcap_t	*in_p;
+	uint64_t	total = 0, received = 0, linked = 0, unlinked = 0;
+	fr_time_t	start, end;
+	double		elapsed;
+	unsigned int	i;
+	size_t		j;
+	int		ret = 0;
+
+	for (in_p = in; in_p; in_p = in_p->next) {
+		if (in_p->link_layer != in->link_layer) {
+			ERROR("Benchmarking requires all inputs to have the same link type");
+			return -1;
+		}
+	}
+
+	if (rs_threads_alloc(in, out) < 0) return -1;
+
+	for (in_p = in; in_p; in_p = in_p->next) {
+		struct pcap_pkthdr	*header;
+		uint8_t const		*data;
+
+		while (pcap_next_ex(in_p->handle, &header, &data) == 1) {
+			rs_thread_t	*thread;
+			rs_capture_t	*capture;
+
+			thread = &threads[rs_packet_flow_hash(data, header->caplen, in_p->link_layer) % conf->threads];
+			if ((thread->num_packets % 1024) == 0) {
+				rs_capture_t *packets;
+
+				packets = talloc_realloc(threads, thread->packets, rs_capture_t, thread->num_packets + 1024);
+				if (!packets) {
+				oom:
+					ERROR("Failed allocating memory for packets");
+					return -1;
+				}
+				thread->packets = packets;
+			}
+
+			capture = &thread->packets[thread->num_packets++];
+			capture->header = talloc_memdup(thread->packets, header, sizeof(*header));
+			capture->data = talloc_memdup(thread->packets, data, header->caplen);
+			if (!capture->header || !capture->data) goto oom;
+
+			if (!start_pcap.tv_sec) start_pcap = header->ts;
+			total++;
+		}
+	}
+
+	INFO("Read %" PRIu64 " packets, processing with %u thread(s)", total, conf->threads);
+
+	start = fr_time();
+	if (rs_threads_start(rs_thread_file) < 0) {
+		atomic_store(&threads_exit, true);
+		ret = -1;
+	}
+
+	/*
+	 *	The stats are only safe to read once the threads have exited
+	 */
+	for (i = 0; i < conf->threads; i++) {
+		if (threads[i].started) pthread_join(threads[i].pthread, NULL);
+		threads[i].started = false;
+	}
+	end = fr_time();
+
+	if (ret < 0) return ret;
+
+	for (i = 0; i < conf->threads; i++) {
+		for (j = 0; j < NUM_ELEMENTS(rs_useful_codes); j++) {
+			rs_latency_t *latency = &threads[i].stats->exchange[rs_useful_codes[j]];
+
+			received += latency->interval.received_total;
+			linked += latency->interval.linked_total;
+			unlinked += latency->interval.unlinked_total;
+		}
+	}
+
+	elapsed = fr_time_delta_unwrap(fr_time_sub(end, start)) / (double)NSEC;
+	INFO("Processed %" PRIu64 " packets in %.3f seconds, %.0f packets/s",
+	     total, elapsed, (elapsed > 0) ? (total / elapsed) : 0);
+	INFO("Received %" PRIu64 ", linked %" PRIu64 ", unlinked %" PRIu64, received, linked, unlinked);
+
+	return 0;
+}
 
 #ifdef HAVE_COLLECTDC_H
 /** Re-open the collectd socket
@@ -2266,6 +3032,7 @@ static NEVER_RETURNS void usage(int status)
 	fprintf(output, "Usage: radsniff [options][stats options] -- [pcap files]\n");
 	fprintf(output, "options:\n");
 	fprintf(output, "  -a                    List all interfaces available for capture.\n");
+	fprintf(output, "  -B                    Benchmark.  Process the packets in the pcap files, and print the throughput.\n");
 	fprintf(output, "  -c <count>            Number of packets to capture.\n");
 	fprintf(output, "  -C <checksum_type>    Enable checksum validation. (Specify 'udp' or 'radius')\n");
 	fprintf(output, "  -d <raddb>            Set configuration directory (defaults to " RADDBDIR ").\n");
@@ -2287,6 +3054,8 @@ static NEVER_RETURNS void usage(int status)
 	fprintf(output, "  -l <attr>[,<attr>]    Output packet sig and a list of attributes.\n");
 	fprintf(output, "  -L <attr>[,<attr>]    Detect retransmissions using these attributes to link requests.\n");
 	fprintf(output, "  -m                    Don't put interface(s) into promiscuous mode.\n");
+	fprintf(output, "  -n <threads>          Process packets in this many threads (live capture from one interface\n");
+	fprintf(output, "                        on Linux, or with -B).  Can't be more than 1 with -Z.\n");
 	fprintf(output, "  -p <port>             Filter packets by port (default is %i).\n", FR_AUTH_UDP_PORT);
 	fprintf(output, "  -P <pidfile>          Daemonize and write out <pidfile>.\n");
 	fprintf(output, "  -q                    Print less debugging information.\n");
@@ -2383,7 +3152,7 @@ int main(int argc, char *argv[])
 	/*
 	 *  Get options
 	 */
-	while ((c = getopt(argc, argv, "ab:c:C:d:D:e:Ef:hi:I:l:L:mp:P:qr:R:s:St:vw:xXW:T:P:N:O:Z:")) != -1) {
+	while ((c = getopt(argc, argv, "aBb:c:C:d:D:e:Ef:hi:I:l:L:mn:p:P:qr:R:s:St:vw:xXW:T:P:N:O:Z:")) != -1) {
 		switch (c) {
 		case 'a':
 		{
@@ -2416,6 +3185,11 @@ int main(int argc, char *argv[])
 			}
 			break;
 
+		case 'B':
+			conf->benchmark = true;
+			conf->print_packet = false;
+			break;
+
 		case 'c':
 			conf->limit = atoi(optarg);
 			if (conf->limit == 0) {
@@ -2490,6 +3264,14 @@ int main(int argc, char *argv[])
 			conf->promiscuous = false;
 			break;
 
+		case 'n':
+			conf->threads = atoi(optarg);
+			if ((conf->threads == 0) || (conf->threads > RS_MAX_THREADS)) {
+				ERROR("Number of threads must be between 1 and %i", RS_MAX_THREADS);
+				usage(64);
+			}
+			break;
+
 		case 'p':
 			port = atoi(optarg);
 			break;
@@ -2646,6 +3428,35 @@ int main(int argc, char *argv[])
 		conf->from_stdin = false;
 	}
 
+	if (conf->benchmark) {
+		if (!conf->from_file) {
+			ERROR("Benchmarking (-B) requires pcap files to read packets from");
+			usage(64);
+		}
+		if (!conf->threads) conf->threads = 1;
+
+	} else if (conf->threads) {
+#ifdef HAVE_LINUX_IF_PACKET_H
+		if (conf->from_file || conf->from_stdin) {
+			ERROR("Capture threads (-n) require a live capture, or benchmarking (-B)");
+			usage(64);
+		}
+
+		/*
+		 *	Requests and replies are paired up by the order
+		 *	they're logged in, which isn't fixed across
+		 *	threads.
+		 */
+		if (conf->to_output_dir && (conf->threads > 1)) {
+			ERROR("Saving packets (-Z) can't be used with more than one capture thread (-n)");
+			usage(64);
+		}
+#else
+		ERROR("Capture threads (-n) are only supported on Linux, except when benchmarking (-B)");
+		usage(64);
+#endif
+	}
+
 	/* Writing to file overrides stdout */
 	if (conf->to_file && conf->to_stdout) {
 		conf->to_stdout = false;
@@ -2691,6 +3502,11 @@ int main(int argc, char *argv[])
 		conf->logger = rs_packet_print_fancy;
 	}
 
+	/*
+	 *	Otherwise printing the packets is most of what we'd be timing
+	 */
+	if (conf->benchmark) conf->logger = NULL;
+
 #if !defined(HAVE_PCAP_FOPEN_OFFLINE) || !defined(HAVE_PCAP_DUMP_FOPEN)
 	if (conf->from_stdin || conf->to_stdout) {
 		ERROR("PCAP streams not supported");
@@ -2954,6 +3770,20 @@ int main(int argc, char *argv[])
 		     in_p = in_p->next) {
 			in_p->promiscuous = conf->promiscuous;
 			in_p->buffer_pkts = conf->buffer_pkts;
+
+#ifdef HAVE_LINUX_IF_PACKET_H
+			/*
+			 *	Capture threads open their own sockets
+			 */
+			if (conf->threads && (in_p->type == PCAP_INTERFACE_IN)) {
+				if (rs_ring_link_layer(in_p) < 0) goto finish;
+
+				*tmp_p = in_p;
+				tmp_p = &(in_p->next);
+				continue;
+			}
+#endif
+
 			if (fr_pcap_open(in_p) < 0) {
 				fr_perror("Failed opening pcap handle (%s)", in_p->name);
 				if (conf->from_auto || (in_p->type == PCAP_FILE_IN)) {
@@ -3032,6 +3862,11 @@ int main(int argc, char *argv[])
 	 */
 	fr_time_start();
 
+	if (conf->benchmark) {
+		if (rs_benchmark(in, out) < 0) ret = EXIT_FAILURE;
+		goto finish;
+	}
+
 	/*
 	 *	Setup and enter the main event loop. Who needs libev when you can roll your own...
 	 */
@@ -3071,7 +3906,18 @@ int main(int argc, char *argv[])
 		 */
 		if (conf->stats.interval && conf->from_dev) {
 			now = fr_time_to_timeval(fr_time());
-			rs_install_stats_processor(stats, events, in, &now, false);
+			rs_install_stats_processor(stats, events, conf->threads ? NULL : in, &now, false);
+		}
+
+		/*
+		 *  Capture threads read from their own sockets, and
+		 *  the main thread just processes stats and signals.
+		 */
+		if (conf->threads) {
+#ifdef HAVE_LINUX_IF_PACKET_H
+			if (rs_threads_ring_alloc(in, out) < 0) goto finish;
+#endif
+			in = NULL;
 		}
 
 		/*
@@ -3087,6 +3933,7 @@ int main(int argc, char *argv[])
 			event->in = in_p;
 			event->out = out;
 			event->stats = stats;
+			event->ctx = conf;
 
 			/*
 			 *	kevent() doesn't indicate that the
@@ -3122,7 +3969,7 @@ int main(int argc, char *argv[])
 	/*
 	 *	If we just have the pipe, then exit.
 	 */
-	if (fr_event_list_num_fds(events) == 1) goto finish;
+	if (!threads && (fr_event_list_num_fds(events) == 1)) goto finish;
 
 	/*
 	 *	Do this as late as possible so we can return an error code if something went wrong.
@@ -3141,6 +3988,16 @@ int main(int argc, char *argv[])
 #ifdef SIGQUIT
 	fr_set_signal(SIGQUIT, rs_signal_self);
 #endif
+
+#ifdef HAVE_LINUX_IF_PACKET_H
+	/*
+	 *	After daemonizing, as the threads wouldn't survive the fork
+	 */
+	if (threads) {
+		if (rs_threads_start(rs_thread_ring) < 0) goto finish;
+	}
+#endif
+
 	DEBUG2("Entering event loop");
 
 	fr_event_loop(events);	/* Enter the main event loop */
@@ -3150,6 +4007,12 @@ int main(int argc, char *argv[])
 finish:
 	cleanup = true;
 
+	/*
+	 *	The threads use conf, so they have to go first
+	 */
+	atomic_store(&threads_exit, true);
+	rs_threads_join();
+
 	if (conf->daemonize) unlink(conf->pidfile);
 
 	/*
@@ -44,6 +44,15 @@ RCSIDH(radsniff_h, "$Id$")
 #define RS_RETRANSMIT_MAX	5		//!< Maximum number of times we expect to see a packet retransmitted
 #define RS_MAX_ATTRS		50		//!< Maximum number of attributes we can filter on.
 #define RS_SOCKET_REOPEN_DELAY  5000		//!< How long we delay re-opening a collectd socket.
+#define RS_MAX_THREADS		64		//!< Maximum number of capture threads.
+#define RS_RING_BLOCK_SIZE	(1 << 20)	//!< Size of each block of packets in a capture thread's ring.
+#define RS_RING_FRAME_SIZE	2048		//!< Nominal size of a packet, for sizing the ring with -b.
+#define RS_RING_SIZE		(32 << 20)	//!< Default size of a capture thread's ring.
+#define RS_RING_BLOCK_TIMEOUT	10		//!< How long the kernel waits for a block to fill, in ms.
+#define RS_RING_BLOCK_SIZE	(1 << 20)	//!< Size of each block of packets in a capture thread's ring.
+#define RS_RING_FRAME_SIZE	2048		//!< Nominal size of a packet, for sizing the ring with -b.
+#define RS_RING_SIZE		(32 << 20)	//!< Default size of a capture thread's ring.
+#define RS_RING_BLOCK_TIMEOUT	10		//!< How long the kernel waits for a block to fill, in ms.
 
 /*
  *	Logging macros
@@ -87,6 +96,7 @@ typedef enum {
 } stats_out_t;
 
 typedef struct rs rs_t;
+typedef struct rs_thread rs_thread_t;
 
 #ifdef HAVE_COLLECTDC_H
 typedef struct rs_stats_tmpl rs_stats_tmpl_t;
@@ -228,6 +238,9 @@ typedef struct {
 	fr_pcap_t		*out;			//!< Where to write output.
 
 	rs_stats_t		*stats;			//!< Where to write stats.
+
+	TALLOC_CTX		*ctx;			//!< Where to allocate requests.
+	rs_thread_t		*thread;		//!< Capture thread the packets are processed in, if any.
 } rs_event_t;
 
 typedef struct rs_update rs_update_t;
@@ -305,6 +318,11 @@ struct rs {
 	int			buffer_pkts;		//!< Size of the ring buffer to setup for live capture.
 	uint64_t		limit;			//!< Maximum number of packets to capture
 
+	unsigned int		threads;		//!< Number of capture threads.  0 means capture
+							///< and process packets in the main thread.
+	bool			benchmark;		//!< Read packets from files into memory, and time
+							///< how long they take to process.
+
 	struct {
 		int			interval;		//!< Time between stats updates in seconds.
 		stats_out_t		out;			//!< Where to write stats.
@@ -72,3 +72,148 @@ char const *fr_app_io_socket_name(TALLOC_CTX *ctx, fr_app_io_t const *app_io,
 		return talloc_typed_asprintf(ctx, "%s from client %s port %u to server %s port %u on interface %s",
 					     app_io->common.name, src_buf, src_port, dst_buf, dst_port, interface);
 }
+
+/** Read data from a stream socket
+ *
+ */
+static ssize_t app_io_stream_recv_fd(void *uctx, uint8_t *buffer, size_t buffer_len)
+{
+	int	fd = *(int *) uctx;
+	ssize_t	data_size;
+
+	data_size = read(fd, buffer, buffer_len);
+	if (data_size < 0) {
+		switch (errno) {
+#if defined(EWOULDBLOCK) && (EWOULDBLOCK != EAGAIN)
+		case EWOULDBLOCK:
+#endif
+		case EAGAIN:
+			return 0;
+
+		default:
+			break;
+		}
+
+		fr_strerror_printf("Read error - %s", fr_syserror(errno));
+		return -1;
+	}
+
+	/*
+	 *	Stream read of zero means the socket is dead.
+	 */
+	if (!data_size) {
+		fr_strerror_const("Other side closed the socket");
+		return -2;
+	}
+
+	return data_size;
+}
+
+/** Read packets from a stream
+ *
+ * The stream is read in as large chunks as the buffer allows, so one
+ * read can return many packets.  Each call returns one packet from
+ * the start of the buffer, and anything after it is left for the
+ * next call, which doesn't need to read if there's already a
+ * complete packet.
+ *
+ * The caller passes the remaining data back to us in the same
+ * message set ring buffer, which leaves the data in place.  So
+ * splitting packets doesn't copy them.
+ *
+ * @param[in] stream_recv	callback to read data from the stream.
+ * @param[in] uctx		passed to stream_recv.
+ * @param[in] buffer		to read into, starting with *leftover bytes from the last call.
+ * @param[in] buffer_len	total size of the buffer.
+ * @param[in,out] leftover	bytes in the buffer which follow the returned packet.
+ * @param[in] hdr_len		how much data the length callback needs.
+ * @param[in] length		callback to get the packet length from its header.
+ * @return
+ *	- >0 the length of the packet at the start of the buffer.
+ *	- 0 there isn't a complete packet yet.
+ *	- -1 on error, or if the packet header is invalid.  The stream should be closed.
+ *	- -2 if the other end closed the connection.  The stream should be closed.
+ */
+ssize_t fr_app_io_stream_recv(fr_app_io_stream_recv_t stream_recv, void *uctx,
+			      uint8_t *buffer, size_t buffer_len, size_t *leftover,
+			      size_t hdr_len, fr_app_io_stream_length_t length)
+{
+	size_t	in_buffer = *leftover;
+	ssize_t	data_size, packet_len;
+
+	/*
+	 *	We may have read multiple packets in the previous read.  In which case the buffer may already
+	 *	have packets remaining.  In that case, we can return packets directly from the buffer, and
+	 *	skip the read.
+	 */
+	if (in_buffer >= hdr_len) {
+		packet_len = length(buffer, in_buffer);
+		if (packet_len < (ssize_t) hdr_len) goto invalid;
+
+		if ((size_t) packet_len <= in_buffer) goto have_packet;
+
+		/*
+		 *	Else we don't have a full packet, try to read more data from the network.
+		 */
+	}
+
+	if (in_buffer >= buffer_len) {
+		fr_strerror_printf("Packet is larger than the receive buffer (%zu bytes)", buffer_len);
+		return -1;
+	}
+
+	/*
+	 *      Read data into the buffer.
+	 *
+	 *	If we didn't read any data, leave the buffers alone.
+	 *
+	 *	i.e. if we had a partial packet in the buffer and we didn't read any data,
+	 *	then the partial packet is still left in the buffer.
+	 */
+	data_size = stream_recv(uctx, buffer + in_buffer, buffer_len - in_buffer);
+	if (data_size <= 0) return data_size;
+
+	in_buffer += data_size;
+
+	/*
+	 *	Not enough for one packet.  Tell the caller that we need to read more.
+	 */
+	if (in_buffer < hdr_len) {
+		*leftover = in_buffer;
+		return 0;
+	}
+
+	packet_len = length(buffer, in_buffer);
+	if (packet_len < (ssize_t) hdr_len) {
+	invalid:
+		fr_strerror_const_push("Invalid packet header");
+		return -1;
+	}
+
+	/*
+	 *	We don't have a complete packet.  Tell the caller
+	 *	that we need to read more.
+	 */
+	if ((size_t) packet_len > in_buffer) {
+		*leftover = in_buffer;
+		return 0;
+	}
+
+have_packet:
+	/*
+	 *	Tell the caller how much data follows the packet.
+	 */
+	*leftover = in_buffer - packet_len;
+
+	return packet_len;
+}
+
+/** Read packets from a stream socket
+ *
+ * @see fr_app_io_stream_recv
+ */
+ssize_t fr_app_io_stream_read(int fd, uint8_t *buffer, size_t buffer_len, size_t *leftover,
+			      size_t hdr_len, fr_app_io_stream_length_t length)
+{
+	return fr_app_io_stream_recv(app_io_stream_recv_fd, &fd, buffer, buffer_len, leftover, hdr_len, length);
+}
@@ -69,6 +69,8 @@ typedef struct {
 	fr_io_client_find_t		client_find;	//!< find radclient
 	fr_io_name_t			get_name;	//!< get the socket name
 
+	fr_io_reply_cached_t		reply_cached;	//!< answer a packet without sending it to a worker.
+
 	void				*private;	//!< any private APIs it needs to export.
 } fr_app_io_t;
 
@@ -79,3 +81,36 @@ char const *fr_app_io_socket_name(TALLOC_CTX *ctx, fr_app_io_t const *app_io,
 				  fr_ipaddr_t const *src_ipaddr, int src_port,
 				  fr_ipaddr_t const *dst_ipaddr, int dst_port,
 				  char const *interface);
+
+/** Find the length of a packet in a stream
+ *
+ * @param[in] buffer		start of the packet.
+ * @param[in] buffer_len	how much data there is.  Always at least the header length.
+ * @return
+ *	- >0 the length of the packet.  May be larger than buffer_len.
+ *	- <=0 the data isn't a valid packet.
+ */
+typedef ssize_t (*fr_app_io_stream_length_t)(uint8_t const *buffer, size_t buffer_len);
+
+/** Read data from a stream
+ *
+ * @param[in] uctx		passed to fr_app_io_stream_recv().
+ * @param[in] buffer		to read into.
+ * @param[in] buffer_len	how much space there is in the buffer.
+ * @return
+ *	- >0 the number of bytes read.
+ *	- 0 no data is available.
+ *	- -1 on error.
+ *	- -2 if the other end closed the connection.
+ */
+typedef ssize_t (*fr_app_io_stream_recv_t)(void *uctx, uint8_t *buffer, size_t buffer_len);
+
+/*
+ *	Common functions to split packets from a stream.
+ */
+ssize_t fr_app_io_stream_recv(fr_app_io_stream_recv_t stream_recv, void *uctx,
+			      uint8_t *buffer, size_t buffer_len, size_t *leftover,
+			      size_t hdr_len, fr_app_io_stream_length_t length);
+
+ssize_t fr_app_io_stream_read(int fd, uint8_t *buffer, size_t buffer_len, size_t *leftover,
+			      size_t hdr_len, fr_app_io_stream_length_t length);
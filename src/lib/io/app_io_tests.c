@@ -0,0 +1,290 @@
+#include <freeradius-devel/util/acutest.h>
+#include <freeradius-devel/util/acutest_helpers.h>
+
+#include <freeradius-devel/io/base.h>
+#include <freeradius-devel/io/application.h>
+#include <freeradius-devel/io/message.h>
+
+#include <fcntl.h>
+#include <sys/socket.h>
+
+/*
+ *	Packets are a 2 octet length (including the header),
+ *	followed by a sequence number, and then filler.
+ */
+#define HDR_LEN		(2)
+#define RESERVE_SIZE	(65536)
+
+static ssize_t test_length(uint8_t const *buffer, UNUSED size_t buffer_len)
+{
+	return (buffer[0] << 8) | buffer[1];
+}
+
+static void test_socketpair(int fd[2])
+{
+	TEST_ASSERT(socketpair(AF_UNIX, SOCK_STREAM, 0, fd) == 0);
+	TEST_ASSERT(fcntl(fd[0], F_SETFL, O_NONBLOCK) == 0);
+}
+
+/** Write packets of varying, mostly odd, lengths
+ *
+ */
+static size_t test_packets_write(int fd, uint8_t *buffer, unsigned int num_packets)
+{
+	uint8_t		*p = buffer;
+	unsigned int	i;
+
+	for (i = 0; i < num_packets; i++) {
+		size_t len = 5 + ((i * 7) % 40);
+
+		p[0] = len >> 8;
+		p[1] = len & 0xff;
+		p[2] = i & 0xff;
+		memset(p + 3, i & 0xff, len - 3);
+		p += len;
+	}
+
+	TEST_ASSERT(write(fd, buffer, p - buffer) == (p - buffer));
+
+	return p - buffer;
+}
+
+static bool test_packet_check(uint8_t const *packet, size_t len, unsigned int i)
+{
+	size_t j;
+
+	if (len != (size_t) (5 + ((i * 7) % 40))) return false;
+	if (packet[2] != (i & 0xff)) return false;
+
+	for (j = 3; j < len; j++) if (packet[j] != (i & 0xff)) return false;
+
+	return true;
+}
+
+/** Split many small packets from one read, as the network side does
+ *
+ *  Each packet is carved out of the message set ring buffer.  While
+ *  there is a lot of data left over, the next packet must stay where
+ *  it is, and not be copied.  Once there is only a little left, it is
+ *  moved down so that it's cache aligned.  Either way the packets
+ *  must come out intact.
+ */
+static void test_stream_many_packets(void)
+{
+	TALLOC_CTX		*ctx = talloc_init_const("app_io_test");
+	fr_message_set_t	*ms;
+	fr_message_t		*m, *next;
+	uint8_t			*out;
+	int			fd[2];
+	size_t			leftover = 0, written;
+	ssize_t			packet_len;
+	unsigned int		i = 0, in_place = 0, shifted = 0;
+
+	test_socketpair(fd);
+
+	ms = fr_message_set_create(ctx, 1024, sizeof(fr_message_t), RESERVE_SIZE * 8);
+	TEST_ASSERT(ms != NULL);
+
+	out = talloc_array(ctx, uint8_t, RESERVE_SIZE);
+	written = test_packets_write(fd[1], out, 500);
+	TEST_ASSERT(written < RESERVE_SIZE);
+
+	m = fr_message_reserve(ms, RESERVE_SIZE);
+	TEST_ASSERT(m != NULL);
+
+	TEST_CASE("Every packet is returned intact");
+	while ((packet_len = fr_app_io_stream_read(fd[0], m->data, m->rb_size, &leftover,
+						   HDR_LEN, test_length)) > 0) {
+		TEST_CHECK(test_packet_check(m->data, packet_len, i));
+		TEST_MSG("Packet %u is corrupt", i);
+
+		if (!m->data_size && !leftover) {
+			TEST_CHECK(fr_message_alloc(ms, m, packet_len) == m);
+			next = NULL;
+		} else {
+			bool shift = (leftover <= 256);
+
+			next = fr_message_alloc_reserve(ms, m, packet_len, leftover, RESERVE_SIZE);
+			TEST_ASSERT(next != NULL);
+
+			if (leftover) {
+				if (next->data == (m->data + packet_len)) {
+					in_place++;
+				} else {
+					shifted++;
+				}
+
+				TEST_CHECK(shift || (next->data == (m->data + packet_len)));
+				TEST_MSG("Packet %u with %zu bytes left over was copied", i, leftover);
+				TEST_CHECK(next->data_size == leftover);
+			}
+		}
+
+		fr_message_done(m);
+		i++;
+
+		if (!next) {
+			m = fr_message_reserve(ms, RESERVE_SIZE);
+			TEST_ASSERT(m != NULL);
+		} else {
+			m = next;
+		}
+	}
+
+	TEST_CHECK(packet_len == 0);
+	TEST_CHECK(i == 500);
+	TEST_MSG("Expected 500 packets, got %u", i);
+	TEST_CHECK(leftover == 0);
+
+	TEST_CASE("Large leftovers stay in place, small ones are aligned");
+	TEST_CHECK(in_place > 0);
+	TEST_CHECK(shifted > 0);
+	TEST_MSG("in place %u, shifted %u", in_place, shifted);
+
+	close(fd[0]);
+	close(fd[1]);
+	talloc_free(ctx);
+}
+
+static void test_stream_partial(void)
+{
+	uint8_t		buffer[256];
+	uint8_t		packet[] = { 0x00, 0x08, 1, 2, 3, 4, 5, 6 };
+	int		fd[2];
+	size_t		leftover = 0;
+
+	test_socketpair(fd);
+
+	TEST_CASE("Partial header needs more data");
+	TEST_ASSERT(write(fd[1], packet, 1) == 1);
+	TEST_CHECK(fr_app_io_stream_read(fd[0], buffer, sizeof(buffer), &leftover, HDR_LEN, test_length) == 0);
+	TEST_CHECK(leftover == 1);
+
+	TEST_CASE("Partial packet needs more data");
+	TEST_ASSERT(write(fd[1], packet + 1, 4) == 4);
+	TEST_CHECK(fr_app_io_stream_read(fd[0], buffer, sizeof(buffer), &leftover, HDR_LEN, test_length) == 0);
+	TEST_CHECK(leftover == 5);
+
+	TEST_CASE("Nothing to read leaves the partial packet alone");
+	TEST_CHECK(fr_app_io_stream_read(fd[0], buffer, sizeof(buffer), &leftover, HDR_LEN, test_length) == 0);
+	TEST_CHECK(leftover == 5);
+
+	TEST_CASE("Rest of the packet completes it");
+	TEST_ASSERT(write(fd[1], packet + 5, 3) == 3);
+	TEST_CHECK(fr_app_io_stream_read(fd[0], buffer, sizeof(buffer), &leftover, HDR_LEN, test_length) == 8);
+	TEST_CHECK(leftover == 0);
+	TEST_CHECK(memcmp(buffer, packet, sizeof(packet)) == 0);
+
+	close(fd[0]);
+	close(fd[1]);
+}
+
+static void test_stream_close(void)
+{
+	uint8_t		buffer[256];
+	uint8_t		invalid[] = { 0x00, 0x01, 0xff };
+	int		fd[2];
+	size_t		leftover = 0;
+
+	TEST_CASE("Invalid header is an error");
+	test_socketpair(fd);
+	TEST_ASSERT(write(fd[1], invalid, sizeof(invalid)) == sizeof(invalid));
+	TEST_CHECK(fr_app_io_stream_read(fd[0], buffer, sizeof(buffer), &leftover, HDR_LEN, test_length) == -1);
+	close(fd[0]);
+	close(fd[1]);
+
+	TEST_CASE("Packet larger than the buffer is an error");
+	test_socketpair(fd);
+	leftover = 0;
+	memset(buffer, 0, sizeof(buffer));
+	buffer[0] = 0x01;
+	buffer[1] = 0x00;
+	TEST_ASSERT(write(fd[1], buffer, 16) == 16);
+	TEST_CHECK(fr_app_io_stream_read(fd[0], buffer, 16, &leftover, HDR_LEN, test_length) == 0);
+	TEST_CHECK(leftover == 16);
+	TEST_CHECK(fr_app_io_stream_read(fd[0], buffer, 16, &leftover, HDR_LEN, test_length) == -1);
+	close(fd[0]);
+	close(fd[1]);
+
+	TEST_CASE("Other end closing is reported separately");
+	test_socketpair(fd);
+	leftover = 0;
+	close(fd[1]);
+	TEST_CHECK(fr_app_io_stream_read(fd[0], buffer, sizeof(buffer), &leftover, HDR_LEN, test_length) == -2);
+	close(fd[0]);
+}
+
+/*
+ *	Hands out data a few bytes at a time, as a TLS session
+ *	returns one record per read.
+ */
+typedef struct {
+	uint8_t const	*data;
+	size_t		len;
+	size_t		chunk;
+} test_recv_ctx_t;
+
+static ssize_t test_recv(void *uctx, uint8_t *buffer, size_t buffer_len)
+{
+	test_recv_ctx_t	*ctx = uctx;
+	size_t		len = ctx->chunk;
+
+	if (!ctx->len) return -2;
+
+	if (len > ctx->len) len = ctx->len;
+	if (len > buffer_len) len = buffer_len;
+
+	memcpy(buffer, ctx->data, len);
+	ctx->data += len;
+	ctx->len -= len;
+
+	return len;
+}
+
+static void test_stream_recv(void)
+{
+	uint8_t		data[4096], buffer[64];
+	test_recv_ctx_t	ctx;
+	size_t		len, leftover = 0;
+	ssize_t		packet_len;
+	unsigned int	i, num_packets = 100;
+	uint8_t		*p = data;
+
+	for (i = 0; i < num_packets; i++) {
+		len = 5 + ((i * 7) % 40);
+
+		p[0] = len >> 8;
+		p[1] = len & 0xff;
+		p[2] = i & 0xff;
+		memset(p + 3, i & 0xff, len - 3);
+		p += len;
+	}
+
+	ctx = (test_recv_ctx_t) { .data = data, .len = p - data, .chunk = 13 };
+
+	TEST_CASE("Packets split across reads from a callback are reassembled");
+	for (i = 0; i < num_packets; i++) {
+		while ((packet_len = fr_app_io_stream_recv(test_recv, &ctx, buffer, sizeof(buffer), &leftover,
+							   HDR_LEN, test_length)) == 0);
+		if (!TEST_CHECK(packet_len > 0)) break;
+
+		TEST_CHECK(test_packet_check(buffer, packet_len, i));
+		TEST_MSG("Packet %u is wrong", i);
+
+		memmove(buffer, buffer + packet_len, leftover);
+	}
+	TEST_CHECK(i == num_packets);
+
+	TEST_CASE("The callback reporting the end of the stream is passed back");
+	TEST_CHECK(fr_app_io_stream_recv(test_recv, &ctx, buffer, sizeof(buffer), &leftover,
+					 HDR_LEN, test_length) == -2);
+}
+
+TEST_LIST = {
+	{ "stream_many_packets",	test_stream_many_packets },
+	{ "stream_partial",		test_stream_partial },
+	{ "stream_close",		test_stream_close },
+	{ "stream_recv",		test_stream_recv },
+
+	{ NULL }
+};
@@ -0,0 +1,8 @@
+TARGET		:= app_io_tests$(E)
+SOURCES		:= app_io_tests.c
+
+TGT_LDLIBS	:= $(LIBS) $(GPERFTOOLS_LIBS)
+TGT_LDFLAGS	:= $(LDFLAGS) $(GPERFTOOLS_LDFLAGS)
+TGT_PREREQS	:= libfreeradius-io$(L) libfreeradius-util$(L) libfreeradius-server$(L)
+
+TGT_INSTALLDIR	:=
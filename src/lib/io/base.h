@@ -43,6 +43,7 @@ typedef struct {
 	uint64_t	out;
 	uint64_t	dup;
 	uint64_t	dropped;
+	uint64_t	cached;		//!< replies sent by the network thread, without a worker.
 } fr_io_stats_t;
 
 
@@ -355,6 +356,31 @@ typedef void (*fr_io_network_get_t)(int *ipproto, bool *dynamic_clients, fr_trie
 
 typedef char const *(*fr_io_name_t)(fr_listen_t *li);
 
+/** Answer a packet from the network thread
+ *
+ *  Called by the network thread after a packet has been read, and
+ *  before it is sent to a worker.  If the protocol has a reply which it
+ *  can re-use for this packet (e.g. a cached DNS answer), it sends the
+ *  reply, and the packet never goes to a worker.
+ *
+ *  The packet has by then been accepted by the master I/O handler, so
+ *  the client, and the allowed / denied networks, have been checked.
+ *  Transports MUST NOT answer packets from their read() routine, as
+ *  that would skip those checks.
+ *
+ * @param[in] li		the listener for this socket.
+ * @param[in] packet_ctx	as returned by fr_io_data_read_t.
+ * @param[in] packet		the packet which was read.
+ * @param[in] packet_len	length of the packet.
+ * @param[out] reply		the reply which was sent.
+ * @return
+ *	- >0 the length of the reply which was sent.
+ *	- 0 the packet has to be processed by a worker.
+ *	- <0 on error.  The packet is discarded.
+ */
+typedef ssize_t (*fr_io_reply_cached_t)(fr_listen_t *li, void *packet_ctx, uint8_t const *packet, size_t packet_len,
+					uint8_t const **reply);
+
 
 #ifdef __cplusplus
 }
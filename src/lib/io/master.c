@@ -2592,6 +2592,72 @@ reread:
 	return buffer_len;
 }
 
+/** Let the transport answer a packet without a worker.
+ *
+ *  The transport sends the reply itself.  We then clean up the
+ *  tracking entry, exactly as if the reply had come from a worker.
+ */
+static ssize_t mod_reply_cached(fr_listen_t *li, void *packet_ctx, uint8_t const *packet, size_t packet_len,
+				uint8_t const **reply)
+{
+	fr_io_instance_t const *inst;
+	fr_io_thread_t *thread;
+	fr_io_connection_t *connection;
+	fr_io_track_t *track = talloc_get_type_abort(packet_ctx, fr_io_track_t);
+	fr_listen_t *child;
+	fr_event_list_t *el;
+	ssize_t reply_len;
+
+	get_inst(li, &inst, &thread, &connection, &child);
+
+	if (!inst->app_io->reply_cached) return 0;
+
+	/*
+	 *	Only answer clients which mod_read() has accepted.
+	 *	Packets which are defining a dynamic client have to
+	 *	go through the virtual server.
+	 */
+	switch (track->client->state) {
+	case PR_CLIENT_STATIC:
+	case PR_CLIENT_DYNAMIC:
+	case PR_CLIENT_CONNECTED:
+		break;
+
+	default:
+		return 0;
+	}
+
+	if (fr_time_neq(track->dynamic, fr_time_wrap(0))) return 0;
+
+	reply_len = inst->app_io->reply_cached(child, track, packet, packet_len, reply);
+	if (reply_len == 0) return 0;
+
+	if (connection) {
+		el = connection->el;
+	} else {
+		el = thread->el;
+	}
+
+	track->finished = true;
+
+	if (reply_len < 0) {
+		track->discard = true;
+		packet_expiry_timer(el, fr_time_wrap(0), track);
+		return reply_len;
+	}
+
+	/*
+	 *	Cache the reply for duplicates, as mod_write() does.
+	 */
+	if (inst->app_io->track_duplicates && !track->reply) {
+		MEM(track->reply = talloc_memdup(track, *reply, reply_len));
+		track->reply_len = reply_len;
+	}
+
+	packet_expiry_timer(el, fr_time_wrap(0), track);
+	return reply_len;
+}
+
 /** Close the socket.
  *
  */
@@ -3143,6 +3209,7 @@ fr_app_io_t fr_master_app_io = {
 	.read			= mod_read,
 	.write			= mod_write,
 	.inject			= mod_inject,
+	.reply_cached		= mod_reply_cached,
 
 	.open			= mod_open,
 	.close			= mod_close,
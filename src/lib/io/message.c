@@ -42,6 +42,12 @@ RCSID("$Id$")
 
 #define CACHE_ALIGN(_x) do { _x += 63; _x &= ~(size_t) 63; } while (0)
 
+/*
+ *	Don't shift more than this much leftover data in order to
+ *	cache align the next packet.
+ */
+#define MSG_SHIFT_MAX (256)
+
 /** A Message set, composed of message headers and ring buffer data.
  *
  *  A message set is intended to send short-lived messages.  The
@@ -1065,6 +1071,10 @@ fr_message_t *fr_message_alloc(fr_message_set_t *ms, fr_message_t *m, size_t act
  *  The application could just always ecall this function with a large
  *  reserve_size, at the cost of substantially more memcpy()s.
  *
+ *  Small amounts of leftover data are moved so that the next packet
+ *  is cache aligned.  Larger amounts are left in place, so that
+ *  splitting a large read into packets doesn't copy the data.
+ *
  * @param[in] ms the message set
  * @param[in] m the message message to allocate packet data for
  * @param[in] actual_packet_size to use
@@ -1084,8 +1094,15 @@ fr_message_t *fr_message_alloc_reserve(fr_message_set_t *ms, fr_message_t *m, si
 
 	(void) talloc_get_type_abort(ms, fr_message_set_t);
 
+	/*
+	 *	Stream sockets can read many packets at once.  Shifting
+	 *	all of the remaining data down for each packet would
+	 *	make parsing them quadratic.  So if there's more than a
+	 *	little data left, the next packet stays where it is, and
+	 *	isn't cache aligned.
+	 */
 	align_size = actual_packet_size;
-	CACHE_ALIGN(align_size);
+	if (leftover <= MSG_SHIFT_MAX) CACHE_ALIGN(align_size);
 
 	/* m is NOT talloc'd */
 
@@ -1127,6 +1144,9 @@ fr_message_t *fr_message_alloc_reserve(fr_message_set_t *ms, fr_message_t *m, si
 	 *	packet, so that it's cache aligned.  Moving small
 	 *	amounts of memory is likely faster than having two
 	 *	CPUs fight over the same cache lines.
+	 *
+	 *	For large amounts of leftover data, align_size is the
+	 *	packet size, and nothing is moved.
 	 */
 	reserve_size += (align_size - actual_packet_size);
 	CACHE_ALIGN(reserve_size);
@@ -985,6 +985,32 @@ next_message:
 		cd->priority = priority;
 	}
 
+	/*
+	 *	The protocol may be able to answer the packet itself,
+	 *	in which case there's no need to wake up a worker.
+	 */
+	if (s->listen->app_io->reply_cached) {
+		uint8_t const	*reply;
+		ssize_t		reply_len;
+
+		reply_len = s->listen->app_io->reply_cached(s->listen, cd->packet_ctx, cd->m.data, data_size, &reply);
+		if (reply_len < 0) {
+			fr_message_done(&cd->m);
+			nr->stats.dropped++;
+			s->stats.dropped++;
+
+		} else if (reply_len > 0) {
+			DEBUG3("Sent cached reply of %zd byte(s) to FD %u", reply_len, sockfd);
+			fr_message_done(&cd->m);
+			nr->stats.out++;
+			s->stats.out++;
+			nr->stats.cached++;
+			s->stats.cached++;
+		}
+
+		if (reply_len != 0) goto check_next;
+	}
+
 	if (fr_network_send_request(nr, cd) < 0) {
 	discard:
 		talloc_free(cd->packet_ctx); /* not sure what else to do here */
@@ -999,6 +1025,7 @@ next_message:
 		s->outstanding++;
 	}
 
+check_next:
 	/*
 	 *	If there is a next message, go read it from the buffer.
 	 *
@@ -2001,10 +2028,11 @@ int fr_network_stats(fr_network_t const *nr, int num, uint64_t *stats)
 	if (num >= 3) stats[2] = nr->stats.dup;
 	if (num >= 4) stats[3] = nr->stats.dropped;
 	if (num >= 5) stats[4] = nr->num_workers;
+	if (num >= 6) stats[5] = nr->stats.cached;
 
-	if (num <= 5) return num;
+	if (num <= 6) return num;
 
-	return 5;
+	return 6;
 }
 
 void fr_network_stats_log(fr_network_t const *nr, fr_log_t const *log)
@@ -2029,6 +2057,7 @@ static int cmd_stats_self(FILE *fp, UNUSED FILE *fp_err, void *ctx, UNUSED fr_cm
 	fprintf(fp, "count.out\t%" PRIu64 "\n", nr->stats.out);
 	fprintf(fp, "count.dup\t%" PRIu64 "\n", nr->stats.dup);
 	fprintf(fp, "count.dropped\t%" PRIu64 "\n", nr->stats.dropped);
+	fprintf(fp, "count.cached\t%" PRIu64 "\n", nr->stats.cached);
 	fprintf(fp, "count.sockets\t%u\n", fr_rb_num_elements(nr->sockets));
 
 	return 0;
@@ -2069,6 +2098,7 @@ static int cmd_stats_socket(FILE *fp, FILE *fp_err, void *ctx, fr_cmd_info_t con
 	fprintf(fp, "count.out\t%" PRIu64 "\n", s->stats.out);
 	fprintf(fp, "count.dup\t%" PRIu64 "\n", s->stats.dup);
 	fprintf(fp, "count.dropped\t%" PRIu64 "\n", s->stats.dropped);
+	fprintf(fp, "count.cached\t%" PRIu64 "\n", s->stats.cached);
 
 	return 0;
 }
@@ -0,0 +1,247 @@
+/*
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+/**
+ * $Id$
+ *
+ * @file io/reply_cache.c
+ * @brief Replies which can be sent by the network thread, without a worker.
+ *
+ * Replies are stored as raw packets, keyed by whatever the protocol
+ * decides identifies a request (e.g. the question for DNS).  The
+ * protocol is responsible for patching a cached reply so that it
+ * matches the new request.
+ *
+ * The cache is not thread-safe.  Each listener has its own, which is
+ * only used by the network thread the listener is in.
+ *
+ * @copyright 2024 The FreeRADIUS server project
+ */
+RCSID("$Id$")
+
+#include <freeradius-devel/io/reply_cache.h>
+#include <freeradius-devel/util/dlist.h>
+#include <freeradius-devel/util/hash.h>
+
+typedef struct {
+	fr_dlist_t		entry;			//!< in the LRU list.
+
+	fr_time_t		created;		//!< when the reply was cached.
+	fr_time_t		expires;		//!< when the reply can no longer be used.
+	fr_time_t		prefetch;		//!< when to let a request through to refresh the entry.
+
+	uint32_t		hits;			//!< number of times the reply has been re-used.
+	bool			refreshing;		//!< a request has been passed through to refresh it.
+
+	uint8_t const		*key;
+	size_t			key_len;
+
+	uint8_t			*reply;
+	size_t			reply_len;
+} fr_io_reply_cache_entry_t;
+
+struct fr_io_reply_cache_s {
+	fr_io_reply_cache_conf_t	conf;
+
+	fr_hash_table_t			*ht;		//!< entries by key.
+	fr_dlist_head_t			lru;		//!< most recently used at the head.
+
+	fr_io_reply_cache_stats_t	stats;
+};
+
+static uint32_t reply_cache_entry_hash(void const *data)
+{
+	fr_io_reply_cache_entry_t const *entry = data;
+
+	return fr_hash(entry->key, entry->key_len);
+}
+
+static int8_t reply_cache_entry_cmp(void const *one, void const *two)
+{
+	fr_io_reply_cache_entry_t const *a = one, *b = two;
+	int ret;
+
+	ret = CMP(a->key_len, b->key_len);
+	if (ret != 0) return ret;
+
+	ret = memcmp(a->key, b->key, a->key_len);
+	return CMP(ret, 0);
+}
+
+static void reply_cache_evict(fr_io_reply_cache_t *cache, fr_io_reply_cache_entry_t *entry)
+{
+	(void) fr_hash_table_remove(cache->ht, entry);
+	fr_dlist_remove(&cache->lru, entry);
+	talloc_free(entry);
+
+	cache->stats.entries--;
+}
+
+/** Allocate a reply cache
+ *
+ * @param[in] ctx	to allocate the cache in.
+ * @param[in] conf	limits for the cache.  Copied.
+ * @return
+ *	- The new cache.
+ *	- NULL on error.
+ */
+fr_io_reply_cache_t *fr_io_reply_cache_alloc(TALLOC_CTX *ctx, fr_io_reply_cache_conf_t const *conf)
+{
+	fr_io_reply_cache_t *cache;
+
+	cache = talloc_zero(ctx, fr_io_reply_cache_t);
+	if (!cache) {
+	oom:
+		fr_strerror_const("Out of memory");
+		return NULL;
+	}
+
+	cache->conf = *conf;
+
+	cache->ht = fr_hash_table_alloc(cache, reply_cache_entry_hash, reply_cache_entry_cmp, NULL);
+	if (!cache->ht) {
+		talloc_free(cache);
+		goto oom;
+	}
+
+	fr_dlist_talloc_init(&cache->lru, fr_io_reply_cache_entry_t, entry);
+
+	return cache;
+}
+
+/** Find a cached reply
+ *
+ *  When the reply is about to expire, and is being used often, one
+ *  request is passed through (as a miss), so that its reply refreshes
+ *  the entry before it expires.
+ *
+ * @param[in] cache		to look in.
+ * @param[out] reply_len	length of the cached reply.
+ * @param[out] age		how long the reply has been in the cache.
+ * @param[in] key		as returned by the protocol for the request.
+ * @param[in] key_len		length of the key.
+ * @param[in] now		the current time.
+ * @return
+ *	- The cached reply.  It's only valid until the next call to
+ *	  fr_io_reply_cache_insert().
+ *	- NULL if the request has to be processed by a worker.
+ */
+uint8_t const *fr_io_reply_cache_find(fr_io_reply_cache_t *cache, size_t *reply_len, fr_time_delta_t *age,
+				      uint8_t const *key, size_t key_len, fr_time_t now)
+{
+	fr_io_reply_cache_entry_t *entry;
+
+	entry = fr_hash_table_find(cache->ht, &(fr_io_reply_cache_entry_t){ .key = key, .key_len = key_len });
+	if (!entry) {
+	miss:
+		cache->stats.misses++;
+		return NULL;
+	}
+
+	if (fr_time_gteq(now, entry->expires)) {
+		reply_cache_evict(cache, entry);
+		goto miss;
+	}
+
+	if (cache->conf.prefetch_hits && !entry->refreshing &&
+	    (entry->hits >= cache->conf.prefetch_hits) && fr_time_gteq(now, entry->prefetch)) {
+		entry->refreshing = true;
+		cache->stats.prefetches++;
+		goto miss;
+	}
+
+	entry->hits++;
+	cache->stats.hits++;
+
+	fr_dlist_remove(&cache->lru, entry);
+	fr_dlist_insert_head(&cache->lru, entry);
+
+	*reply_len = entry->reply_len;
+	*age = fr_time_sub(now, entry->created);
+
+	return entry->reply;
+}
+
+/** Cache a reply
+ *
+ *  Any existing reply for the same key is replaced.  When the cache is
+ *  full, the least recently used reply is removed.
+ *
+ * @param[in] cache		to insert the reply into.
+ * @param[in] key		as returned by the protocol for the request.
+ * @param[in] key_len		length of the key.
+ * @param[in] reply		to cache.
+ * @param[in] reply_len		length of the reply.
+ * @param[in] lifetime		how long the reply can be re-used for.
+ * @param[in] now		the current time.
+ * @return
+ *	- 0 on success.
+ *	- -1 on error.
+ */
+int fr_io_reply_cache_insert(fr_io_reply_cache_t *cache, uint8_t const *key, size_t key_len,
+			     uint8_t const *reply, size_t reply_len, fr_time_delta_t lifetime, fr_time_t now)
+{
+	fr_io_reply_cache_entry_t *entry, *old;
+
+	if (!cache->conf.max_entries || !fr_time_delta_ispos(lifetime)) return 0;
+
+	old = fr_hash_table_find(cache->ht, &(fr_io_reply_cache_entry_t){ .key = key, .key_len = key_len });
+	if (old) reply_cache_evict(cache, old);
+
+	while (cache->stats.entries >= cache->conf.max_entries) {
+		old = fr_dlist_tail(&cache->lru);
+		if (!old) break;
+
+		reply_cache_evict(cache, old);
+		cache->stats.evictions++;
+	}
+
+	entry = talloc_zero(cache, fr_io_reply_cache_entry_t);
+	if (!entry) {
+	oom:
+		fr_strerror_const("Out of memory");
+		talloc_free(entry);
+		return -1;
+	}
+
+	entry->created = now;
+	entry->expires = fr_time_add(now, lifetime);
+	entry->prefetch = fr_time_add(now, fr_time_delta_wrap((fr_time_delta_unwrap(lifetime) / 10) * 9));
+
+	entry->key = talloc_memdup(entry, key, key_len);
+	if (!entry->key) goto oom;
+	entry->key_len = key_len;
+
+	entry->reply = talloc_memdup(entry, reply, reply_len);
+	if (!entry->reply) goto oom;
+	entry->reply_len = reply_len;
+
+	if (!fr_hash_table_insert(cache->ht, entry)) goto oom;
+	fr_dlist_insert_head(&cache->lru, entry);
+
+	cache->stats.entries++;
+	cache->stats.inserts++;
+
+	return 0;
+}
+
+/** Return the cache statistics
+ *
+ */
+void fr_io_reply_cache_stats(fr_io_reply_cache_stats_t *stats, fr_io_reply_cache_t const *cache)
+{
+	*stats = cache->stats;
+}
@@ -0,0 +1,66 @@
+#pragma once
+/*
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+/**
+ * $Id$
+ *
+ * @file io/reply_cache.h
+ * @brief Replies which can be sent by the network thread, without a worker.
+ *
+ * @copyright 2024 The FreeRADIUS server project
+ */
+RCSIDH(reply_cache_h, "$Id$")
+
+#include <freeradius-devel/util/time.h>
+#include <freeradius-devel/util/talloc.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct fr_io_reply_cache_s fr_io_reply_cache_t;
+
+typedef struct {
+	uint32_t		max_entries;		//!< maximum number of cached replies.
+	uint32_t		prefetch_hits;		//!< refresh entries which have had this many hits
+							//!< before they expire.  0 disables prefetch.
+} fr_io_reply_cache_conf_t;
+
+typedef struct {
+	uint64_t		hits;
+	uint64_t		misses;
+	uint64_t		prefetches;
+	uint64_t		inserts;
+	uint64_t		evictions;
+	uint32_t		entries;
+} fr_io_reply_cache_stats_t;
+
+fr_io_reply_cache_t	*fr_io_reply_cache_alloc(TALLOC_CTX *ctx, fr_io_reply_cache_conf_t const *conf) CC_HINT(nonnull(2));
+
+uint8_t const		*fr_io_reply_cache_find(fr_io_reply_cache_t *cache, size_t *reply_len, fr_time_delta_t *age,
+						uint8_t const *key, size_t key_len, fr_time_t now) CC_HINT(nonnull);
+
+int			fr_io_reply_cache_insert(fr_io_reply_cache_t *cache, uint8_t const *key, size_t key_len,
+						 uint8_t const *reply, size_t reply_len,
+						 fr_time_delta_t lifetime, fr_time_t now) CC_HINT(nonnull);
+
+void			fr_io_reply_cache_stats(fr_io_reply_cache_stats_t *stats,
+						fr_io_reply_cache_t const *cache) CC_HINT(nonnull);
+
+#ifdef __cplusplus
+}
+#endif
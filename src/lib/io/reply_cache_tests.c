@@ -0,0 +1,186 @@
+#include <freeradius-devel/util/acutest.h>
+#include <freeradius-devel/util/acutest_helpers.h>
+
+#include <freeradius-devel/io/reply_cache.h>
+
+#define LIFETIME	fr_time_delta_from_sec(10)
+
+static uint8_t const	key_a[] = "a";
+static uint8_t const	key_b[] = "b";
+static uint8_t const	key_c[] = "c";
+
+static uint8_t const	reply_a[] = "reply a";
+static uint8_t const	reply_b[] = "reply b";
+static uint8_t const	reply_c[] = "reply c";
+
+/** The time "sec" seconds after the test started
+ *
+ */
+static fr_time_t test_time(double sec)
+{
+	return fr_time_add(fr_time_wrap(1), fr_time_delta_from_msec((int64_t) (sec * 1000)));
+}
+
+static fr_io_reply_cache_t *test_cache_alloc(TALLOC_CTX *ctx, uint32_t max_entries, uint32_t prefetch_hits)
+{
+	fr_io_reply_cache_t		*cache;
+	fr_io_reply_cache_conf_t	conf = {
+						.max_entries = max_entries,
+						.prefetch_hits = prefetch_hits
+					};
+
+	cache = fr_io_reply_cache_alloc(ctx, &conf);
+	TEST_ASSERT(cache != NULL);
+
+	return cache;
+}
+
+static bool test_find(fr_io_reply_cache_t *cache, uint8_t const *key, uint8_t const *reply, double sec)
+{
+	uint8_t const	*found;
+	size_t		found_len = 0;
+	fr_time_delta_t	age;
+
+	found = fr_io_reply_cache_find(cache, &found_len, &age, key, 1, test_time(sec));
+	if (!found) return false;
+
+	TEST_CHECK(found_len == sizeof(reply_a));
+	TEST_CHECK(memcmp(found, reply, found_len) == 0);
+
+	return true;
+}
+
+static void test_insert(fr_io_reply_cache_t *cache, uint8_t const *key, uint8_t const *reply, double sec)
+{
+	TEST_CHECK(fr_io_reply_cache_insert(cache, key, 1, reply, sizeof(reply_a), LIFETIME, test_time(sec)) == 0);
+}
+
+static void test_reply_cache_expiry(void)
+{
+	TALLOC_CTX			*ctx = talloc_init_const("reply_cache_test");
+	fr_io_reply_cache_t		*cache;
+	fr_io_reply_cache_stats_t	stats;
+	uint8_t const			*found;
+	size_t				found_len;
+	fr_time_delta_t			age;
+
+	cache = test_cache_alloc(ctx, 16, 0);
+
+	TEST_CASE("Unknown keys miss");
+	TEST_CHECK(!test_find(cache, key_a, reply_a, 0));
+
+	TEST_CASE("Cached replies are found, with their age");
+	test_insert(cache, key_a, reply_a, 0);
+	found = fr_io_reply_cache_find(cache, &found_len, &age, key_a, 1, test_time(4));
+	TEST_CHECK(found != NULL);
+	TEST_CHECK(fr_time_delta_eq(age, fr_time_delta_from_sec(4)));
+
+	TEST_CASE("Replies are used until just before they expire");
+	TEST_CHECK(test_find(cache, key_a, reply_a, 9.999));
+
+	TEST_CASE("Expired replies miss, and are removed");
+	TEST_CHECK(!test_find(cache, key_a, reply_a, 10));
+	fr_io_reply_cache_stats(&stats, cache);
+	TEST_CHECK(stats.entries == 0);
+
+	TEST_CASE("Replies which can't be re-used aren't cached");
+	TEST_CHECK(fr_io_reply_cache_insert(cache, key_b, 1, reply_b, sizeof(reply_b),
+					    fr_time_delta_wrap(0), test_time(20)) == 0);
+	TEST_CHECK(!test_find(cache, key_b, reply_b, 20));
+
+	TEST_CASE("A new reply replaces the old one, and restarts its lifetime");
+	test_insert(cache, key_a, reply_a, 20);
+	test_insert(cache, key_a, reply_b, 25);
+	TEST_CHECK(test_find(cache, key_a, reply_b, 32));
+	fr_io_reply_cache_stats(&stats, cache);
+	TEST_CHECK(stats.entries == 1);
+
+	talloc_free(ctx);
+}
+
+static void test_reply_cache_lru(void)
+{
+	TALLOC_CTX			*ctx = talloc_init_const("reply_cache_test");
+	fr_io_reply_cache_t		*cache;
+	fr_io_reply_cache_stats_t	stats;
+
+	cache = test_cache_alloc(ctx, 2, 0);
+
+	test_insert(cache, key_a, reply_a, 0);
+	test_insert(cache, key_b, reply_b, 1);
+
+	/*
+	 *	"a" was inserted first, but has been used since.
+	 */
+	TEST_CASE("The least recently used reply is evicted when the cache is full");
+	TEST_CHECK(test_find(cache, key_a, reply_a, 2));
+	test_insert(cache, key_c, reply_c, 3);
+
+	TEST_CHECK(test_find(cache, key_a, reply_a, 4));
+	TEST_CHECK(!test_find(cache, key_b, reply_b, 4));
+	TEST_CHECK(test_find(cache, key_c, reply_c, 4));
+
+	fr_io_reply_cache_stats(&stats, cache);
+	TEST_CHECK(stats.entries == 2);
+	TEST_CHECK(stats.evictions == 1);
+	TEST_MSG("Expected 1 eviction, got %" PRIu64, stats.evictions);
+
+	TEST_CASE("A disabled cache stores nothing");
+	cache = test_cache_alloc(ctx, 0, 0);
+	test_insert(cache, key_a, reply_a, 0);
+	TEST_CHECK(!test_find(cache, key_a, reply_a, 1));
+
+	talloc_free(ctx);
+}
+
+static void test_reply_cache_prefetch(void)
+{
+	TALLOC_CTX			*ctx = talloc_init_const("reply_cache_test");
+	fr_io_reply_cache_t		*cache;
+	fr_io_reply_cache_stats_t	stats;
+
+	cache = test_cache_alloc(ctx, 16, 2);
+
+	test_insert(cache, key_a, reply_a, 0);
+	test_insert(cache, key_b, reply_b, 0);
+
+	TEST_CASE("Entries aren't refreshed before the last 10% of their lifetime");
+	TEST_CHECK(test_find(cache, key_a, reply_a, 1));
+	TEST_CHECK(test_find(cache, key_a, reply_a, 8.9));
+
+	TEST_CASE("Entries which aren't used often enough aren't refreshed");
+	TEST_CHECK(test_find(cache, key_b, reply_b, 9.5));
+
+	TEST_CASE("A hot entry passes one request through in the last 10%");
+	TEST_CHECK(!test_find(cache, key_a, reply_a, 9.5));
+
+	TEST_CASE("Later requests are answered while the refresh is outstanding");
+	TEST_CHECK(test_find(cache, key_a, reply_a, 9.6));
+	TEST_CHECK(test_find(cache, key_a, reply_a, 9.7));
+
+	fr_io_reply_cache_stats(&stats, cache);
+	TEST_CHECK(stats.prefetches == 1);
+	TEST_MSG("Expected 1 prefetch, got %" PRIu64, stats.prefetches);
+
+	TEST_CASE("The reply to the passed request refreshes the entry");
+	test_insert(cache, key_a, reply_c, 9.8);
+	TEST_CHECK(test_find(cache, key_a, reply_c, 15));
+	TEST_CHECK(!test_find(cache, key_b, reply_b, 15));
+
+	TEST_CASE("Prefetch can be disabled");
+	cache = test_cache_alloc(ctx, 16, 0);
+	test_insert(cache, key_a, reply_a, 0);
+	TEST_CHECK(test_find(cache, key_a, reply_a, 1));
+	TEST_CHECK(test_find(cache, key_a, reply_a, 2));
+	TEST_CHECK(test_find(cache, key_a, reply_a, 9.5));
+
+	talloc_free(ctx);
+}
+
+TEST_LIST = {
+	{ "reply_cache_expiry",		test_reply_cache_expiry },
+	{ "reply_cache_lru",		test_reply_cache_lru },
+	{ "reply_cache_prefetch",	test_reply_cache_prefetch },
+
+	{ NULL }
+};
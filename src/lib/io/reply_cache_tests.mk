@@ -0,0 +1,8 @@
+TARGET		:= reply_cache_tests$(E)
+SOURCES		:= reply_cache_tests.c
+
+TGT_LDLIBS	:= $(LIBS) $(GPERFTOOLS_LIBS)
+TGT_LDFLAGS	:= $(LDFLAGS) $(GPERFTOOLS_LDFLAGS)
+TGT_PREREQS	:= libfreeradius-io$(L) libfreeradius-util$(L) libfreeradius-server$(L)
+
+TGT_INSTALLDIR	:=
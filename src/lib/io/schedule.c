@@ -218,6 +218,12 @@ static void *fr_schedule_worker_thread(void *arg)
 		goto fail;
 	}
 
+	if (fr_time_delta_ispos(sc->config->timer_resolution) &&
+	    (fr_event_list_set_timer_wheel(sw->el, sc->config->timer_resolution) < 0)) {
+		PERROR("%s - Failed creating timer wheel", worker_name);
+		goto fail;
+	}
+
 
 	sw->worker = fr_worker_create(ctx, sw->el, worker_name, sc->log, sc->lvl, &sc->config->worker);
 	if (!sw->worker) {
@@ -364,6 +370,12 @@ static void *fr_schedule_network_thread(void *arg)
 		goto fail;
 	}
 
+	if (fr_time_delta_ispos(sc->config->timer_resolution) &&
+	    (fr_event_list_set_timer_wheel(el, sc->config->timer_resolution) < 0)) {
+		PERROR("%s - Failed creating timer wheel", network_name);
+		goto fail;
+	}
+
 	sn->nr = fr_network_create(ctx, el, network_name, sc->log, sc->lvl, &sc->config->network);
 	if (!sn->nr) {
 		PERROR("%s - Failed creating network", network_name);
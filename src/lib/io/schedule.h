@@ -68,6 +68,7 @@ typedef struct {
 	fr_network_config_t network;		//!< configuration for each network;
 
 	fr_time_delta_t	stats_interval;		//!< print channel statistics
+	fr_time_delta_t	timer_resolution;	//!< if set, use a timer wheel in each thread.
 } fr_schedule_config_t;
 
 int			fr_schedule_worker_id(void);
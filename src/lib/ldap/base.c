@@ -624,11 +624,15 @@ static unlang_action_t ldap_trunk_query_results(rlm_rcode_t *p_result, UNUSED in
 		return UNLANG_ACTION_YIELD;
 
 	case LDAP_RESULT_SUCCESS:
+		fr_ldap_cache_insert(query);
 		if (DEBUG_ENABLED3 && query->type == LDAP_REQUEST_SEARCH) ldap_trunk_search_results_debug(request, query);
 		RETURN_MODULE_OK;
 
-	case LDAP_RESULT_BAD_DN:
 	case LDAP_RESULT_NO_RESULT:
+		fr_ldap_cache_insert(query);
+		RETURN_MODULE_NOTFOUND;
+
+	case LDAP_RESULT_BAD_DN:
 		RETURN_MODULE_NOTFOUND;
 
 	default:
@@ -715,6 +719,21 @@ unlang_action_t fr_ldap_trunk_search(TALLOC_CTX *ctx,
 
 	query = fr_ldap_search_alloc(ctx, base_dn, scope, filter, attrs, serverctrls, clientctrls);
 
+	/*
+	 *	Results are already available, so no need to
+	 *	involve the trunk.
+	 */
+	if (ttrunk->t->cache && (fr_ldap_cache_find(ttrunk->t->cache, query, ttrunk) == 1)) {
+		RDEBUG3("Using cached results for search in \"%s\"", base_dn);
+
+		if (unlang_function_push(request, NULL, ldap_trunk_query_results,
+					 NULL, 0, UNLANG_SUB_FRAME, query) == UNLANG_ACTION_FAIL) goto error;
+
+		*out = query;
+
+		return UNLANG_ACTION_PUSHED_CHILD;
+	}
+
 	switch (trunk_request_enqueue(&query->treq, ttrunk->trunk, request, query, NULL)) {
 	case TRUNK_ENQUEUE_OK:
 	case TRUNK_ENQUEUE_IN_BACKLOG:
@@ -947,7 +966,11 @@ static int _ldap_query_free(fr_ldap_query_t *query)
 	/*
 	 *	Free any results which were retrieved
 	 */
-	if (query->result) ldap_msgfree(query->result);
+	if (query->cache.entry) {
+		fr_ldap_cache_release(query);
+	} else if (query->result) {
+		ldap_msgfree(query->result);
+	}
 
 	/*
 	 *	Free any server and client controls that need freeing
@@ -325,6 +325,10 @@ extern global_lib_autoinst_t fr_libldap_global_config;
 
 typedef struct fr_ldap_thread_trunk_s fr_ldap_thread_trunk_t;
 
+typedef struct fr_ldap_cache_s fr_ldap_cache_t;
+
+typedef struct fr_ldap_cache_entry_s fr_ldap_cache_entry_t;
+
 /** Tracks the state of a libldap connection handle
  *
  */
@@ -385,6 +389,7 @@ typedef struct {
 	fr_event_list_t		*el;			//!< Thread event list for callbacks / timeouts
 	fr_ldap_thread_trunk_t	*bind_trunk;		//!< LDAP trunk used for bind auths
 	fr_rb_tree_t		*binds;			//!< Tree of outstanding bind auths
+	fr_ldap_cache_t		*cache;			//!< Search result cache.  NULL if disabled.
 } fr_ldap_thread_t;
 
 /** Thread LDAP trunk structure
@@ -467,6 +472,15 @@ struct fr_ldap_query_s {
 	LDAPMessage		*result;		//!< Head of LDAP results list.
 
 	fr_ldap_result_code_t	ret;			//!< Result code
+
+	struct {
+		fr_ldap_cache_t		*cache;		//!< Cache the results should be added to.
+		char			*key;		//!< Key the results should be added under.
+		uint32_t		bucket;		//!< Generation bucket of the base DN.
+		uint64_t		generation;	//!< Generation of the base DN when the search was sent.
+		uint64_t		epoch;		//!< Cache epoch when the search was sent.
+		fr_ldap_cache_entry_t	*entry;		//!< Cache entry holding the results.
+	} cache;
 };
 
 /** Parsed LDAP referral structure
@@ -798,6 +812,21 @@ int		fr_ldap_init(void);
 
 void		fr_ldap_free(void);
 
+/*
+ *	cache.c - Search result cache
+ */
+fr_ldap_cache_t	*fr_ldap_cache_alloc(TALLOC_CTX *ctx, uint32_t max_entries, fr_time_delta_t lifetime);
+
+int		fr_ldap_cache_find(fr_ldap_cache_t *cache, fr_ldap_query_t *query, fr_ldap_thread_trunk_t const *ttrunk);
+
+void		fr_ldap_cache_insert(fr_ldap_query_t *query);
+
+void		fr_ldap_cache_release(fr_ldap_query_t *query);
+
+void		fr_ldap_cache_invalidate_dn(char const *dn);
+
+void		fr_ldap_cache_invalidate_all(void);
+
 /*
  *	control.c - Connection based client/server controls
  */
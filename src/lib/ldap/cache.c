@@ -0,0 +1,422 @@
+/*
+ *   This program is is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or (at
+ *   your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+/**
+ * $Id$
+ * @file lib/ldap/cache.c
+ * @brief Per-thread cache of LDAP search results.
+ *
+ * Searches are keyed on the trunk they run on (server and bind identity), the
+ * base DN, scope, filter, and requested attributes.  Each thread holds its own
+ * cache, so no locking is needed for lookups or insertions.
+ *
+ * Entries are bounded both by count (oldest used entry is evicted first) and by
+ * lifetime.  They can also be invalidated early, e.g. by proto_ldap_sync, when
+ * the directory notifies us an object has changed.  Invalidation is process
+ * wide, and works by bumping a generation counter for the DN of the changed
+ * object and each of its ancestors.  A cached search is only used if the
+ * generation of its base DN hasn't changed since the search was sent.
+ *
+ * @copyright 2024 The FreeRADIUS Server Project.
+ */
+RCSID("$Id$")
+
+USES_APPLE_DEPRECATED_API
+
+#include <freeradius-devel/ldap/base.h>
+#include <freeradius-devel/util/hash.h>
+
+#ifdef HAVE_STDATOMIC_H
+#  include <stdatomic.h>
+#else
+#  include <freeradius-devel/util/stdatomic.h>
+#endif
+
+#define LDAP_CACHE_GENERATIONS	1024		//!< Number of DN generation buckets.  Must be a power of 2.
+
+/** Generation counters for DNs, indexed by the hash of the normalised DN
+ *
+ * Collisions only cause spurious invalidations, never stale results.
+ */
+static atomic_uint_fast64_t ldap_cache_generation[LDAP_CACHE_GENERATIONS];
+
+/** Bumped to invalidate every entry in every cache
+ *
+ */
+static atomic_uint_fast64_t ldap_cache_epoch;
+
+struct fr_ldap_cache_s {
+	fr_rb_tree_t		*tree;			//!< Entries keyed on search parameters.
+	fr_dlist_head_t		lru;			//!< Entries, least recently used at the head.
+	uint32_t		max_entries;		//!< Maximum number of entries.
+	fr_time_delta_t		lifetime;		//!< How long entries are valid for.
+};
+
+struct fr_ldap_cache_entry_s {
+	fr_rb_node_t		node;			//!< Entry in the tree of cached searches.
+	fr_dlist_t		entry;			//!< Entry in the LRU list.
+	fr_ldap_cache_t		*cache;			//!< Cache this entry belongs to.  NULL once evicted.
+
+	char const		*key;			//!< Search parameters this entry was cached under.
+	uint32_t		bucket;			//!< Generation bucket of the base DN.
+	uint64_t		generation;		//!< Generation of the bucket when the search was sent.
+	uint64_t		epoch;			//!< Invalidation epoch when the search was sent.
+	fr_time_t		expires;		//!< When this entry is no longer valid.
+
+	LDAPMessage		*result;		//!< Head of the cached results list.
+	fr_ldap_result_code_t	ret;			//!< Result code of the cached search.
+	fr_ldap_connection_t	*ldap_conn;		//!< Placeholder connection for queries answered
+							///< from the cache, provides a handle for
+							///< parsing the results.
+	unsigned int		refs;			//!< Number of queries using the result.
+};
+
+static int8_t ldap_cache_entry_cmp(void const *one, void const *two)
+{
+	fr_ldap_cache_entry_t const *a = one, *b = two;
+	int ret;
+
+	ret = strcmp(a->key, b->key);
+	return CMP(ret, 0);
+}
+
+/** Normalise a DN so equivalent DNs map to the same generation bucket
+ *
+ * Escape sequences are normalised, the DN is lowercased, and whitespace
+ * around RDN separators is removed.
+ *
+ * @param[out] out	Where to write the normalised DN.  Must be at least as long as in.
+ * @param[in] in	DN to normalise.
+ * @return The length of the normalised DN.
+ */
+static size_t ldap_cache_dn_normalise(char *out, char const *in)
+{
+	char	*p, *o;
+	size_t	len;
+
+	len = fr_ldap_util_normalise_dn(out, in);
+
+	for (p = o = out; p < (out + len); p++) {
+		if (*p == '\\') {
+			*o++ = *p++;
+			if (p < (out + len)) *o++ = *p;
+			continue;
+		}
+
+		if ((*p == ',') || (*p == '=') || (*p == '+')) {
+			while ((o > out) && (o[-1] == ' ') && ((o - 1 == out) || (o[-2] != '\\'))) o--;
+			*o++ = *p;
+			while ((p + 1 < (out + len)) && (p[1] == ' ')) p++;
+			continue;
+		}
+
+		*o++ = tolower((uint8_t)*p);
+	}
+	*o = '\0';
+
+	return o - out;
+}
+
+static inline uint32_t ldap_cache_bucket(char const *dn, size_t len)
+{
+	return fr_hash(dn, len) & (LDAP_CACHE_GENERATIONS - 1);
+}
+
+/** Invalidate cached searches which may include an object
+ *
+ * Bumps the generation of the DN and all its ancestors, so that any search based
+ * at or above the object, is no longer answered from the cache.
+ *
+ * May be called from any thread.
+ *
+ * @param[in] dn	of the object which changed.
+ */
+void fr_ldap_cache_invalidate_dn(char const *dn)
+{
+	char	buff[LDAP_MAX_DN_STR_LEN];
+	char	*p, *end;
+	size_t	len;
+
+	if (!dn || (strlen(dn) >= sizeof(buff))) {
+		fr_ldap_cache_invalidate_all();
+		return;
+	}
+
+	len = ldap_cache_dn_normalise(buff, dn);
+	end = buff + len;
+
+	atomic_fetch_add_explicit(&ldap_cache_generation[ldap_cache_bucket(buff, len)], 1, memory_order_release);
+
+	for (p = buff; p < end; p++) {
+		if (*p == '\\') {
+			p++;
+			continue;
+		}
+		if (*p != ',') continue;
+
+		atomic_fetch_add_explicit(&ldap_cache_generation[ldap_cache_bucket(p + 1, end - (p + 1))], 1,
+					  memory_order_release);
+	}
+}
+
+/** Invalidate every entry in every LDAP search cache
+ *
+ * May be called from any thread.
+ */
+void fr_ldap_cache_invalidate_all(void)
+{
+	atomic_fetch_add_explicit(&ldap_cache_epoch, 1, memory_order_release);
+}
+
+/** Remove an entry from its cache, freeing it if it's no longer referenced
+ *
+ */
+static void ldap_cache_entry_evict(fr_ldap_cache_entry_t *entry)
+{
+	fr_ldap_cache_t *cache = entry->cache;
+
+	if (cache) {
+		fr_rb_remove(cache->tree, entry);
+		fr_dlist_remove(&cache->lru, entry);
+		entry->cache = NULL;
+	}
+
+	/*
+	 *	Queries still using the result will free
+	 *	the entry when they're done with it.
+	 */
+	if (entry->refs > 0) {
+		talloc_steal(NULL, entry);
+		return;
+	}
+
+	talloc_free(entry);
+}
+
+static int _ldap_cache_entry_free(fr_ldap_cache_entry_t *entry)
+{
+	if (entry->result) ldap_msgfree(entry->result);
+
+	return 0;
+}
+
+static int _ldap_cache_free(fr_ldap_cache_t *cache)
+{
+	fr_ldap_cache_entry_t *entry;
+
+	while ((entry = fr_dlist_head(&cache->lru))) ldap_cache_entry_evict(entry);
+
+	return 0;
+}
+
+/** Allocate a new search result cache
+ *
+ * @param[in] ctx		to allocate the cache in.  Usually thread instance data.
+ * @param[in] max_entries	the cache can hold.
+ * @param[in] lifetime		of each entry.
+ * @return
+ *	- A new cache on success.
+ *	- NULL on failure.
+ */
+fr_ldap_cache_t *fr_ldap_cache_alloc(TALLOC_CTX *ctx, uint32_t max_entries, fr_time_delta_t lifetime)
+{
+	fr_ldap_cache_t *cache;
+
+	MEM(cache = talloc_zero(ctx, fr_ldap_cache_t));
+	MEM(cache->tree = fr_rb_inline_alloc(cache, fr_ldap_cache_entry_t, node, ldap_cache_entry_cmp, NULL));
+	fr_dlist_talloc_init(&cache->lru, fr_ldap_cache_entry_t, entry);
+	cache->max_entries = max_entries;
+	cache->lifetime = lifetime;
+
+	talloc_set_destructor(cache, _ldap_cache_free);
+
+	return cache;
+}
+
+/** Append a netstring to a cache key
+ *
+ */
+static inline char *ldap_cache_key_append(char *key, char const *in)
+{
+	if (!in) in = "";
+
+	return talloc_asprintf_append_buffer(key, "%zu:%s,", strlen(in), in);
+}
+
+/** Look for the results of a search in the cache
+ *
+ * On a hit, the query is populated with the cached results.
+ *
+ * On a miss, the query is marked so that its results are added to the cache
+ * by #fr_ldap_cache_insert when they arrive.
+ *
+ * Searches with server or client controls are never cached, as the controls
+ * may alter the results.
+ *
+ * @param[in] cache	to search in.
+ * @param[in] query	to populate.
+ * @param[in] ttrunk	the query would run on.
+ * @return
+ *	- 1 if the results were found in the cache.
+ *	- 0 if the results were not found.
+ */
+int fr_ldap_cache_find(fr_ldap_cache_t *cache, fr_ldap_query_t *query, fr_ldap_thread_trunk_t const *ttrunk)
+{
+	fr_ldap_cache_entry_t	*entry, find;
+	char			buff[LDAP_MAX_DN_STR_LEN];
+	char			*key;
+	char const * const	*attr;
+	size_t			len;
+
+	if (query->serverctrls[0].control || query->clientctrls[0].control) return 0;
+	if (!query->dn || (strlen(query->dn) >= sizeof(buff))) return 0;
+
+	MEM(key = talloc_typed_asprintf(query, "%i:", query->search.scope));
+	MEM(key = ldap_cache_key_append(key, ttrunk->uri));
+	MEM(key = ldap_cache_key_append(key, ttrunk->bind_dn));
+	MEM(key = ldap_cache_key_append(key, query->dn));
+	MEM(key = ldap_cache_key_append(key, query->search.filter));
+	if (query->search.attrs) for (attr = query->search.attrs; *attr; attr++) {
+		MEM(key = ldap_cache_key_append(key, *attr));
+	}
+
+	find.key = key;
+	entry = fr_rb_find(cache->tree, &find);
+	if (entry) {
+		if ((atomic_load_explicit(&ldap_cache_epoch, memory_order_acquire) != entry->epoch) ||
+		    (atomic_load_explicit(&ldap_cache_generation[entry->bucket],
+					  memory_order_acquire) != entry->generation) ||
+		    fr_time_gteq(fr_time(), entry->expires)) {
+			ldap_cache_entry_evict(entry);
+			goto miss;
+		}
+
+		talloc_free(key);
+
+		fr_dlist_remove(&cache->lru, entry);
+		fr_dlist_insert_tail(&cache->lru, entry);
+
+		entry->refs++;
+		query->cache.entry = entry;
+		query->result = entry->result;
+		query->ret = entry->ret;
+		query->ldap_conn = entry->ldap_conn;
+
+		return 1;
+	}
+
+miss:
+	/*
+	 *	Record the generation before the search is sent,
+	 *	so any change made while it's in flight means the
+	 *	result won't be used.
+	 */
+	len = ldap_cache_dn_normalise(buff, query->dn);
+	query->cache.cache = cache;
+	query->cache.key = key;
+	query->cache.bucket = ldap_cache_bucket(buff, len);
+	query->cache.epoch = atomic_load_explicit(&ldap_cache_epoch, memory_order_acquire);
+	query->cache.generation = atomic_load_explicit(&ldap_cache_generation[query->cache.bucket],
+						       memory_order_acquire);
+
+	return 0;
+}
+
+/** Add the results of a query to the cache
+ *
+ * The cache entry takes ownership of the results, which remain available to
+ * the query until it's freed.
+ *
+ * @param[in] query	which has completed.
+ */
+void fr_ldap_cache_insert(fr_ldap_query_t *query)
+{
+	fr_ldap_cache_t		*cache = query->cache.cache;
+	fr_ldap_cache_entry_t	*entry, *old;
+
+	if (!cache || query->cache.entry || !query->result) return;
+
+	switch (query->ret) {
+	case LDAP_RESULT_SUCCESS:
+	case LDAP_RESULT_NO_RESULT:
+		break;
+
+	default:
+		return;
+	}
+
+	/*
+	 *	Something changed while the search was in flight.
+	 */
+	if ((atomic_load_explicit(&ldap_cache_epoch, memory_order_acquire) != query->cache.epoch) ||
+	    (atomic_load_explicit(&ldap_cache_generation[query->cache.bucket],
+				  memory_order_acquire) != query->cache.generation)) return;
+
+	MEM(entry = talloc_zero(cache, fr_ldap_cache_entry_t));
+	entry->key = talloc_steal(entry, query->cache.key);
+	query->cache.key = NULL;
+
+	old = fr_rb_find(cache->tree, entry);
+	if (old) ldap_cache_entry_evict(old);
+
+	while ((fr_dlist_num_elements(&cache->lru) > 0) &&
+	       (fr_dlist_num_elements(&cache->lru) >= cache->max_entries)) {
+		ldap_cache_entry_evict(fr_dlist_head(&cache->lru));
+	}
+
+	entry->cache = cache;
+	entry->bucket = query->cache.bucket;
+	entry->generation = query->cache.generation;
+	entry->epoch = query->cache.epoch;
+	entry->expires = fr_time_add(fr_time(), cache->lifetime);
+	entry->result = query->result;
+	entry->ret = query->ret;
+	entry->refs = 1;
+
+	MEM(entry->ldap_conn = talloc_zero(entry, fr_ldap_connection_t));
+	entry->ldap_conn->handle = fr_ldap_handle_thread_local();
+
+	talloc_set_destructor(entry, _ldap_cache_entry_free);
+
+	fr_rb_insert(cache->tree, entry);
+	fr_dlist_insert_tail(&cache->lru, entry);
+
+	query->cache.entry = entry;
+}
+
+/** Release a query's reference to a cache entry
+ *
+ * Called when the query is freed.
+ *
+ * @param[in] query	being freed.
+ */
+void fr_ldap_cache_release(fr_ldap_query_t *query)
+{
+	fr_ldap_cache_entry_t *entry = query->cache.entry;
+
+	if (!entry) return;
+
+	/*
+	 *	The result and connection belong to the entry
+	 */
+	query->result = NULL;
+	if (query->ldap_conn == entry->ldap_conn) query->ldap_conn = NULL;
+	query->cache.entry = NULL;
+
+	if (--entry->refs > 0) return;
+
+	if (!entry->cache) talloc_free(entry);
+}
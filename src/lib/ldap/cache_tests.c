@@ -0,0 +1,234 @@
+#include <freeradius-devel/util/acutest.h>
+#include <freeradius-devel/util/acutest_helpers.h>
+
+#include <freeradius-devel/ldap/base.h>
+
+/*
+ *	There's no directory, so results are just markers.
+ *	Count them as the cache frees them, instead of handing
+ *	them to libldap.
+ */
+static unsigned int test_results_freed;
+
+static int test_msgfree(UNUSED LDAPMessage *msg)
+{
+	test_results_freed++;
+	return 0;
+}
+#define ldap_msgfree test_msgfree
+
+/*
+ *	Gives access to the cache entries, so they can be
+ *	expired without waiting for the clock.
+ */
+#include "cache.c"
+
+#define JANE_DN		"uid=jane,ou=people,dc=example,dc=com"
+#define PEOPLE_DN	"ou=people,dc=example,dc=com"
+#define GROUPS_DN	"ou=groups,dc=example,dc=com"
+
+static uint8_t			test_markers[8];
+
+static char const		*test_attrs[] = { "displayName", "description", NULL };
+
+static fr_ldap_thread_trunk_t	test_ttrunk = {
+					.uri = "ldap://ldap.example.com",
+					.bind_dn = "cn=admin,dc=example,dc=com"
+				};
+
+static LDAPMessage *test_result(unsigned int i)
+{
+	return (LDAPMessage *)&test_markers[i];
+}
+
+static fr_ldap_cache_t *test_cache_alloc(TALLOC_CTX *ctx, uint32_t max_entries)
+{
+	fr_ldap_cache_t *cache;
+
+	fr_time_start();
+
+	cache = fr_ldap_cache_alloc(ctx, max_entries, fr_time_delta_from_sec(30));
+	TEST_ASSERT(cache != NULL);
+
+	return cache;
+}
+
+static fr_ldap_query_t *test_query_alloc(TALLOC_CTX *ctx, char const *dn, char const *filter)
+{
+	fr_ldap_query_t *query;
+
+	MEM(query = talloc_zero(ctx, fr_ldap_query_t));
+	query->type = LDAP_REQUEST_SEARCH;
+	query->dn = dn;
+	query->search.scope = LDAP_SCOPE_BASE;
+	query->search.filter = filter;
+	query->search.attrs = test_attrs;
+	query->ret = LDAP_RESULT_PENDING;
+
+	return query;
+}
+
+/** Complete a query, as if the results had arrived from the directory
+ *
+ */
+static void test_query_complete(fr_ldap_query_t *query, LDAPMessage *result)
+{
+	query->result = result;
+	query->ret = LDAP_RESULT_SUCCESS;
+	fr_ldap_cache_insert(query);
+}
+
+static void test_query_free(fr_ldap_query_t *query)
+{
+	fr_ldap_cache_release(query);
+	talloc_free(query);
+}
+
+/** Run a search, returning the results from the cache if possible
+ *
+ * @return the results the search was answered with.
+ */
+static LDAPMessage *test_search(fr_ldap_cache_t *cache, char const *dn, char const *filter, LDAPMessage *result)
+{
+	fr_ldap_query_t *query = test_query_alloc(NULL, dn, filter);
+
+	if (fr_ldap_cache_find(cache, query, &test_ttrunk) == 0) test_query_complete(query, result);
+
+	result = query->result;
+	test_query_free(query);
+
+	return result;
+}
+
+static void test_ldap_cache_hit(void)
+{
+	TALLOC_CTX	*ctx = talloc_init_const("ldap_cache_test");
+	fr_ldap_cache_t	*cache;
+
+	cache = test_cache_alloc(ctx, 16);
+	test_results_freed = 0;
+
+	TEST_CASE("The first search goes to the directory");
+	TEST_CHECK(test_search(cache, JANE_DN, "(objectClass=*)", test_result(0)) == test_result(0));
+
+	TEST_CASE("The same search is answered from the cache");
+	TEST_CHECK(test_search(cache, JANE_DN, "(objectClass=*)", test_result(1)) == test_result(0));
+
+	TEST_CASE("Searches with different parameters aren't");
+	TEST_CHECK(test_search(cache, JANE_DN, "(uid=jane)", test_result(2)) == test_result(2));
+	TEST_CHECK(test_search(cache, PEOPLE_DN, "(objectClass=*)", test_result(3)) == test_result(3));
+
+	TEST_CHECK(test_results_freed == 0);
+
+	talloc_free(ctx);
+	TEST_CHECK(test_results_freed == 3);
+	TEST_MSG("Expected 3 results freed, got %u", test_results_freed);
+}
+
+static void test_ldap_cache_expiry(void)
+{
+	TALLOC_CTX	*ctx = talloc_init_const("ldap_cache_test");
+	fr_ldap_cache_t	*cache;
+	fr_ldap_query_t	*query;
+
+	cache = test_cache_alloc(ctx, 16);
+	test_results_freed = 0;
+
+	TEST_CHECK(test_search(cache, JANE_DN, "(objectClass=*)", test_result(0)) == test_result(0));
+
+	TEST_CASE("Searches are answered from the cache until they expire");
+	query = test_query_alloc(ctx, JANE_DN, "(objectClass=*)");
+	TEST_ASSERT(fr_ldap_cache_find(cache, query, &test_ttrunk) == 1);
+	query->cache.entry->expires = fr_time();
+
+	TEST_CASE("Expired entries go back to the directory");
+	TEST_CHECK(test_search(cache, JANE_DN, "(objectClass=*)", test_result(1)) == test_result(1));
+
+	TEST_CASE("Results being used by a query aren't freed when they expire");
+	TEST_CHECK(test_results_freed == 0);
+	TEST_CHECK(query->result == test_result(0));
+	test_query_free(query);
+	TEST_CHECK(test_results_freed == 1);
+
+	TEST_CASE("The new results are cached");
+	TEST_CHECK(test_search(cache, JANE_DN, "(objectClass=*)", test_result(2)) == test_result(1));
+
+	talloc_free(ctx);
+}
+
+static void test_ldap_cache_invalidate(void)
+{
+	TALLOC_CTX	*ctx = talloc_init_const("ldap_cache_test");
+	fr_ldap_cache_t	*cache;
+
+	cache = test_cache_alloc(ctx, 16);
+
+	test_search(cache, JANE_DN, "(objectClass=*)", test_result(0));
+	test_search(cache, PEOPLE_DN, "(objectClass=*)", test_result(1));
+	test_search(cache, GROUPS_DN, "(objectClass=*)", test_result(2));
+
+	/*
+	 *	As proto_ldap_sync does when the directory
+	 *	tells it jane has changed.
+	 */
+	TEST_CASE("A change invalidates searches of the object and its ancestors");
+	fr_ldap_cache_invalidate_dn("UID=Jane, OU=People,dc=example,dc=com");
+
+	TEST_CHECK(test_search(cache, JANE_DN, "(objectClass=*)", test_result(3)) == test_result(3));
+	TEST_CHECK(test_search(cache, PEOPLE_DN, "(objectClass=*)", test_result(4)) == test_result(4));
+
+	TEST_CASE("Searches of unrelated objects are still answered from the cache");
+	TEST_CHECK(test_search(cache, GROUPS_DN, "(objectClass=*)", test_result(5)) == test_result(2));
+
+	TEST_CASE("Invalidating everything invalidates unrelated objects too");
+	fr_ldap_cache_invalidate_all();
+	TEST_CHECK(test_search(cache, GROUPS_DN, "(objectClass=*)", test_result(6)) == test_result(6));
+
+	talloc_free(ctx);
+}
+
+static void test_ldap_cache_in_flight(void)
+{
+	TALLOC_CTX	*ctx = talloc_init_const("ldap_cache_test");
+	fr_ldap_cache_t	*cache;
+	fr_ldap_query_t	*jane, *groups;
+
+	cache = test_cache_alloc(ctx, 16);
+
+	jane = test_query_alloc(ctx, JANE_DN, "(objectClass=*)");
+	groups = test_query_alloc(ctx, GROUPS_DN, "(objectClass=*)");
+	TEST_CHECK(fr_ldap_cache_find(cache, jane, &test_ttrunk) == 0);
+	TEST_CHECK(fr_ldap_cache_find(cache, groups, &test_ttrunk) == 0);
+
+	/*
+	 *	The directory may have answered the searches
+	 *	before or after it applied the change, so
+	 *	the results can't be trusted.
+	 */
+	TEST_CASE("Results of a search which was in flight when its object changed aren't cached");
+	fr_ldap_cache_invalidate_dn(JANE_DN);
+	test_query_complete(jane, test_result(0));
+	test_query_complete(groups, test_result(1));
+
+	TEST_CHECK(jane->result == test_result(0));
+	TEST_CHECK(jane->cache.entry == NULL);
+	TEST_CHECK(test_search(cache, JANE_DN, "(objectClass=*)", test_result(2)) == test_result(2));
+
+	TEST_CASE("Results of unrelated searches are");
+	TEST_CHECK(groups->cache.entry != NULL);
+	TEST_CHECK(test_search(cache, GROUPS_DN, "(objectClass=*)", test_result(3)) == test_result(1));
+
+	test_query_free(jane);
+	test_query_free(groups);
+
+	talloc_free(ctx);
+}
+
+TEST_LIST = {
+	{ "ldap_cache_hit",		test_ldap_cache_hit },
+	{ "ldap_cache_expiry",		test_ldap_cache_expiry },
+	{ "ldap_cache_invalidate",	test_ldap_cache_invalidate },
+	{ "ldap_cache_in_flight",	test_ldap_cache_in_flight },
+
+	{ NULL }
+};
@@ -0,0 +1,9 @@
+TARGET		:= cache_tests$(E)
+SOURCES		:= cache_tests.c
+
+SRC_CFLAGS	:= $(ldap_CFLAGS)
+TGT_LDLIBS	:= $(LIBS) $(ldap_LDLIBS) $(GPERFTOOLS_LIBS)
+TGT_LDFLAGS	:= $(LDFLAGS) $(GPERFTOOLS_LDFLAGS)
+TGT_PREREQS	:= libfreeradius-ldap$(L) libfreeradius-util$(L) libfreeradius-server$(L)
+
+TGT_INSTALLDIR	:=
@@ -0,0 +1,148 @@
+#pragma once
+/*
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+/**
+ * $Id$
+ *
+ * @file lib/server/detail.h
+ * @brief Binary detail file record format, shared by rlm_detail and proto_detail.
+ *
+ * Each record is a fixed header, followed by the attributes encoded with
+ * the internal encoder.  All header fields are in network byte order.
+ *
+ @verbatim
+    0                   1                   2                   3
+    0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1
+   +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+   |                        Magic ("FRdb")                         |
+   +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+   |    Version    |     Flags     |      Protocol (dictionary)    |
+   +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+   |                          Packet code                          |
+   +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+   |                     Timestamp (seconds) ...                   |
+   +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+   |                  ... Timestamp (seconds)                      |
+   +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+   |                        Payload length                         |
+   +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+   |                       Payload checksum                        |
+   +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+   |  Payload (internal encoding) ...
+   +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-
+ @endverbatim
+ *
+ * The flags byte is written in place by the reader to mark records as
+ * processed, so it's not covered by the checksum.
+ *
+ * @copyright 2024 The FreeRADIUS server project
+ */
+RCSIDH(server_detail_h, "$Id$")
+
+#include <freeradius-devel/util/hash.h>
+#include <freeradius-devel/util/nbo.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum {
+	FR_DETAIL_FORMAT_TEXT = 0,				//!< "Attr = value" lines.
+	FR_DETAIL_FORMAT_BINARY					//!< Length prefixed records.
+} fr_detail_format_t;
+
+#define FR_DETAIL_BINARY_MAGIC		"FRdb"
+#define FR_DETAIL_BINARY_VERSION	1
+
+#define FR_DETAIL_BINARY_FLAGS_OFFSET	5		//!< So the reader can mark records as done.
+#define FR_DETAIL_BINARY_FLAG_DONE	0x01		//!< Record has been processed.
+
+#define FR_DETAIL_BINARY_HDR_LEN	28
+
+/** Decoded form of the record header
+ *
+ */
+typedef struct {
+	uint8_t		version;			//!< of the record format.
+	uint8_t		flags;				//!< FR_DETAIL_BINARY_FLAG_*
+	uint16_t	proto;				//!< protocol number of the dictionary the pairs were encoded with.
+	uint32_t	code;				//!< packet code.
+	uint64_t	timestamp;			//!< when the original packet was received, in seconds.
+	uint32_t	length;				//!< of the payload.
+	uint32_t	checksum;			//!< of the payload.
+} fr_detail_binary_hdr_t;
+
+/** Write a record header
+ *
+ * @param[out] out	Where to write the header.
+ * @param[in] hdr	to write.  The checksum is calculated here.
+ * @param[in] payload	which follows the header.
+ */
+static inline void fr_detail_binary_hdr_encode(uint8_t out[static FR_DETAIL_BINARY_HDR_LEN],
+					       fr_detail_binary_hdr_t const *hdr, uint8_t const *payload)
+{
+	memcpy(out, FR_DETAIL_BINARY_MAGIC, 4);
+	out[4] = FR_DETAIL_BINARY_VERSION;
+	out[5] = hdr->flags;
+	fr_nbo_from_uint16(out + 6, hdr->proto);
+	fr_nbo_from_uint32(out + 8, hdr->code);
+	fr_nbo_from_uint64(out + 12, hdr->timestamp);
+	fr_nbo_from_uint32(out + 20, hdr->length);
+	fr_nbo_from_uint32(out + 24, fr_hash(payload, hdr->length));
+}
+
+/** Read a record header
+ *
+ * @param[out] hdr	The decoded header.
+ * @param[in] in	Start of the record.
+ * @param[in] inlen	How much data is available.
+ * @return
+ *	- 0 if the header is valid.
+ *	- -1 if the data isn't a binary detail record.
+ */
+static inline int fr_detail_binary_hdr_decode(fr_detail_binary_hdr_t *hdr, uint8_t const *in, size_t inlen)
+{
+	if (inlen < FR_DETAIL_BINARY_HDR_LEN) return -1;
+
+	if (memcmp(in, FR_DETAIL_BINARY_MAGIC, 4) != 0) return -1;
+
+	hdr->version = in[4];
+	if (hdr->version != FR_DETAIL_BINARY_VERSION) return -1;
+
+	hdr->flags = in[5];
+	hdr->proto = fr_nbo_to_uint16(in + 6);
+	hdr->code = fr_nbo_to_uint32(in + 8);
+	hdr->timestamp = fr_nbo_to_uint64(in + 12);
+	hdr->length = fr_nbo_to_uint32(in + 20);
+	hdr->checksum = fr_nbo_to_uint32(in + 24);
+
+	return 0;
+}
+
+/** Check the payload matches the checksum in the header
+ *
+ * @param[in] hdr	as returned by fr_detail_binary_hdr_decode().
+ * @param[in] payload	which follows the header, hdr->length bytes long.
+ */
+static inline bool fr_detail_binary_payload_verify(fr_detail_binary_hdr_t const *hdr, uint8_t const *payload)
+{
+	return (fr_hash(payload, hdr->length) == hdr->checksum);
+}
+
+#ifdef __cplusplus
+}
+#endif
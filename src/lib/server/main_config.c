@@ -96,6 +96,7 @@ static int lib_dir_on_read(TALLOC_CTX *ctx, void *out, void *parent, CONF_ITEM *
 static int talloc_pool_size_parse(TALLOC_CTX *ctx, void *out, void *parent, CONF_ITEM *ci, conf_parser_t const *rule);
 
 static int max_request_time_parse(TALLOC_CTX *ctx, void *out, void *parent, CONF_ITEM *ci, conf_parser_t const *rule);
+static int timer_resolution_parse(TALLOC_CTX *ctx, void *out, void *parent, CONF_ITEM *ci, conf_parser_t const *rule);
 
 static int name_parse(TALLOC_CTX *ctx, void *out, void *parent, CONF_ITEM *ci, conf_parser_t const *rule);
 
@@ -175,10 +176,13 @@ static const conf_parser_t thread_config[] = {
 	  .func = num_workers_parse, .dflt_func = num_workers_dflt },
 
 	{ FR_CONF_OFFSET_TYPE_FLAGS("stats_interval", FR_TYPE_TIME_DELTA, CONF_FLAG_HIDDEN, main_config_t, stats_interval) },
+	{ FR_CONF_OFFSET("timer_resolution", main_config_t, timer_resolution), .dflt = "0",
+	  .func = timer_resolution_parse },
 
 #ifdef WITH_TLS
 	{ FR_CONF_OFFSET_TYPE_FLAGS("openssl_async_pool_init", FR_TYPE_SIZE, 0, main_config_t, openssl_async_pool_init), .dflt = "64" },
 	{ FR_CONF_OFFSET_TYPE_FLAGS("openssl_async_pool_max", FR_TYPE_SIZE, 0, main_config_t, openssl_async_pool_max), .dflt = "1024" },
+	{ FR_CONF_OFFSET("openssl_pkey_threads", main_config_t, openssl_pkey_threads), .dflt = "0" },
 #endif
 
 	CONF_PARSER_TERMINATOR
@@ -362,6 +366,30 @@ static int max_request_time_parse(TALLOC_CTX *ctx, void *out, void *parent,
 	return 0;
 }
 
+static int timer_resolution_parse(TALLOC_CTX *ctx, void *out, void *parent,
+				  CONF_ITEM *ci, conf_parser_t const *rule)
+{
+	int		ret;
+	fr_time_delta_t	value;
+
+	if ((ret = cf_pair_parse_value(ctx, out, parent, ci, rule)) < 0) return ret;
+
+	memcpy(&value, out, sizeof(value));
+
+	/*
+	 *	Zero means "no timer wheel".  Otherwise timers can
+	 *	fire up to this late, so don't let it be too coarse.
+	 */
+	if (fr_time_delta_eq(value, fr_time_delta_wrap(0))) return 0;
+
+	FR_TIME_DELTA_BOUND_CHECK("thread.timer_resolution", value, >=, fr_time_delta_from_usec(100));
+	FR_TIME_DELTA_BOUND_CHECK("thread.timer_resolution", value, <=, fr_time_delta_from_msec(100));
+
+	memcpy(out, &value, sizeof(value));
+
+	return 0;
+}
+
 static int lib_dir_on_read(UNUSED TALLOC_CTX *ctx, UNUSED void *out, UNUSED void *parent,
 			 CONF_ITEM *ci, UNUSED conf_parser_t const *rule)
 {
@@ -121,6 +121,9 @@ struct main_config_s {
 
 	size_t		openssl_async_pool_max;		//!< Tuning option to set the maximum number of requests
 							///< in the async ctx pool.
+
+	uint32_t	openssl_pkey_threads;		//!< Number of threads to perform private key
+							///< operations on.
 #endif
 
 	fr_dict_t	*dict;				//!< Main dictionary.
@@ -150,6 +153,7 @@ struct main_config_s {
 	uint32_t	max_networks;			//!< for the scheduler
 	uint32_t	max_workers;			//!< for the scheduler
 	fr_time_delta_t	stats_interval;			//!< for the scheduler
+	fr_time_delta_t	timer_resolution;		//!< for the scheduler
 
 #ifndef NDEBUG
 	uint32_t	ins_max;			//!< max instruction count
@@ -82,10 +82,14 @@ void regex_sub_to_request(request_t *request, regex_t **preg, fr_regmatch_t **re
 	MEM(new_rc = talloc(request, fr_regcapture_t));
 
 	/*
-	 *	Steal runtime pregs, leave precompiled ones
+	 *	Steal runtime pregs, leave precompiled ones.
+	 *	Cached ones may be evicted whilst we still
+	 *	need them, so hold a reference.
 	 */
 #if defined(HAVE_REGEX_PCRE) || defined(HAVE_REGEX_PCRE2)
-	if (!(*preg)->precompiled) {
+	if ((*preg)->cached) {
+		MEM(new_rc->preg = talloc_reference(new_rc, *preg));
+	} else if (!(*preg)->precompiled) {
 		new_rc->preg = talloc_steal(new_rc, *preg);
 		*preg = NULL;
 	} else {
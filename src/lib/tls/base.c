@@ -340,6 +340,8 @@ void fr_openssl_free(void)
 {
 	if (--openssl_instance_count > 0) return;
 
+	fr_tls_pkey_pool_stop();
+
 	fr_tls_log_free();
 
 	fr_tls_bio_free();
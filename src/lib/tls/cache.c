@@ -153,8 +153,8 @@ void _tls_cache_clear_state_reset(request_t *request, fr_tls_cache_t *cache, cha
 		if (ROPTIONAL_ENABLED(RDEBUG_ENABLED3, DEBUG_ENABLED3)) {
 			ROPTIONAL(RDEBUG3, DEBUG3, "Session ID %pV - Freeing session ID to clear in %s",
 				  fr_box_octets_buffer(cache->clear.id), func);
-			TALLOC_FREE(cache->clear.id);
 		}
+		TALLOC_FREE(cache->clear.id);
 	}
 	cache->clear.state = FR_TLS_CACHE_CLEAR_INIT;
 }
@@ -338,12 +338,96 @@ static void tls_cache_delete_request(SSL_SESSION *sess)
 	if (tls_session->can_pause) ASYNC_pause_job();
 }
 
+/** Calculate when a session can no longer be resumed
+ *
+ * SSL_SESSION times are wallclock, so convert to our monotonic time.
+ */
+static inline CC_HINT(always_inline)
+fr_time_t tls_cache_session_expires(SSL_SESSION *sess)
+{
+	fr_time_t	now = fr_time();
+	int64_t		remaining;
+
+	remaining = (int64_t)(SSL_SESSION_get_time(sess) + SSL_SESSION_get_timeout(sess)) -
+		    fr_unix_time_to_sec(fr_time_to_unix_time(now));
+
+	return fr_time_add(now, fr_time_delta_from_sec(remaining));
+}
+
+/** Add a serialised session to the in-memory store
+ *
+ * @param[in] request		The current request.
+ * @param[in] store		to add the session to.
+ * @param[in] sess		the session was serialised from.
+ * @param[in] data		DER encoded session.
+ * @param[in] data_len		Length of the encoded session.
+ */
+static void tls_cache_memory_insert(request_t *request, fr_tls_store_t *store, SSL_SESSION *sess,
+				    uint8_t const *data, size_t data_len)
+{
+	unsigned int	id_len;
+	uint8_t const	*id;
+
+	id = SSL_SESSION_get_id(sess, &id_len);
+	if (fr_tls_store_insert(store, id, id_len, data, data_len, tls_cache_session_expires(sess)) < 0) {
+		RPWDEBUG("Session ID %pV - Failed storing session in memory", fr_box_octets(id, id_len));
+		return;
+	}
+
+	RDEBUG3("Session ID %pV - Stored session in memory", fr_box_octets(id, id_len));
+}
+
+/** Retrieve a session from the in-memory store
+ *
+ * @param[in] request		The current request.
+ * @param[in] tls_session	The current TLS session.
+ * @param[in] store		to search in.
+ * @param[in] id		of the session to retrieve.
+ * @param[in] id_len		Length of the session ID.
+ * @return
+ *	- A deserialised session.
+ *	- NULL if the session wasn't found.
+ */
+static SSL_SESSION *tls_cache_memory_find(request_t *request, fr_tls_session_t *tls_session, fr_tls_store_t *store,
+					  uint8_t const *id, size_t id_len)
+{
+	uint8_t		*data;
+	uint8_t const	*q;
+	ssize_t		len;
+	SSL_SESSION	*sess;
+
+	len = fr_tls_store_find(request, &data, store, id, id_len);
+	if (len == 0) {
+		RDEBUG3("Session ID %pV - Not found in memory", fr_box_octets(id, id_len));
+		return NULL;
+	}
+
+	q = data;	/* openssl will mutate q */
+	sess = d2i_SSL_SESSION(NULL, &q, len);
+	talloc_free(data);
+	if (!sess) {
+		fr_tls_log(request, "Failed loading session from memory");
+		fr_tls_store_remove(store, id, id_len);
+		return NULL;
+	}
+
+	RDEBUG3("Session ID %pV - Found in memory", fr_box_octets(id, id_len));
+
+	/*
+	 *	So it can be retrieved in fr_tls_cache_delete.
+	 */
+	SSL_SESSION_set_ex_data(sess, FR_TLS_EX_INDEX_TLS_SESSION, tls_session);
+
+	return sess;
+}
+
 /** Process the result of `session load { ... }`
  */
 static unlang_action_t tls_cache_load_result(UNUSED rlm_rcode_t *p_result, UNUSED int *priority,
 					     request_t *request, void *uctx)
 {
 	fr_tls_session_t	*tls_session = talloc_get_type_abort(uctx, fr_tls_session_t);
+	fr_tls_conf_t		*conf = fr_tls_session_conf(tls_session->ssl);
 	fr_tls_cache_t		*tls_cache = tls_session->cache;
 	fr_pair_t		*vp;
 	uint8_t const		*q, **p;
@@ -391,6 +475,12 @@ static unlang_action_t tls_cache_load_result(UNUSED rlm_rcode_t *p_result, UNUSE
 	 */
 	SSL_SESSION_set_ex_data(sess, FR_TLS_EX_INDEX_TLS_SESSION, fr_tls_session(tls_session->ssl));
 
+	/*
+	 *	Subsequent resumptions can be served
+	 *	from memory.
+	 */
+	if (conf->cache.store) tls_cache_memory_insert(request, conf->cache.store, sess, vp->vp_octets, vp->vp_length);
+
 	tls_cache->load.state = FR_TLS_CACHE_LOAD_RETRIEVED;
 	tls_cache->load.sess = sess;	/* This is consumed in tls_cache_load_cb */
 
@@ -492,7 +582,7 @@ unlang_action_t tls_cache_store_push(request_t *request, fr_tls_conf_t *conf, fr
 	fr_pair_t		*vp;
 	SSL_SESSION		*sess = tls_session->cache->store.sess;
 	unlang_action_t		ua;
-	fr_time_t		expires = fr_time_from_sec((time_t)(SSL_SESSION_get_time(sess) + SSL_get_timeout(sess)));
+	fr_time_t		expires = tls_cache_session_expires(sess);
 	fr_time_t		now = fr_time();
 
 	fr_assert(tls_cache->store.sess);
@@ -512,29 +602,6 @@ unlang_action_t tls_cache_store_push(request_t *request, fr_tls_conf_t *conf, fr
 	 */
 	if (tls_cache_app_data_set(request, sess) < 0) return UNLANG_ACTION_FAIL;
 
-	MEM(child = unlang_subrequest_alloc(request, dict_tls));
-	request = child;
-
-	/*
-	 *	Setup the child request for storing
-	 *	session resumption data.
-	 */
-	MEM(pair_prepend_request(&vp, attr_tls_packet_type) >= 0);
-	vp->vp_uint32 = enum_tls_packet_type_store_session->vb_uint32;
-
-	/*
-	 *	Add the session identifier we're trying
-	 *	to store.
-	 */
-	MEM(pair_update_request(&vp, attr_tls_session_id) >= 0);
-	fr_pair_value_memdup_buffer_shallow(vp, fr_tls_cache_id(vp, sess), true);
-
-	/*
-	 *	How long the session has to live
-	 */
-	MEM(pair_update_request(&vp, attr_tls_session_ttl) >= 0);
-	vp->vp_time_delta = fr_time_sub(expires, now);
-
 	/*
 	 *	Serialize the session
 	 */
@@ -549,12 +616,10 @@ unlang_action_t tls_cache_store_push(request_t *request, fr_tls_conf_t *conf, fr
 			 "required buffer length", &id);
 	error:
 		tls_cache_store_state_reset(request, tls_cache);
-		talloc_free(child);
 		return UNLANG_ACTION_FAIL;
 	}
 
-	MEM(pair_update_request(&vp, attr_tls_session_data) >= 0);
-	MEM(data = talloc_array(vp, uint8_t, len));
+	MEM(data = talloc_array(request, uint8_t, len));
 
 	/* openssl mutates &p */
 	p = data;
@@ -568,14 +633,55 @@ unlang_action_t tls_cache_store_push(request_t *request, fr_tls_conf_t *conf, fr
 		talloc_free(data);
 		goto error;
 	}
-	fr_pair_value_memdup_buffer_shallow(vp, data, true);
+
+	if (conf->cache.store) tls_cache_memory_insert(request, conf->cache.store, sess, data, len);
+
+	/*
+	 *	Sessions are only held in memory.
+	 */
+	if (!conf->virtual_server) {
+		talloc_free(data);
+		tls_cache_store_state_reset(request, tls_cache);
+		tls_cache->store.state = FR_TLS_CACHE_STORE_PERSISTED;	/* Avoid spurious clear calls */
+		return UNLANG_ACTION_CALCULATE_RESULT;
+	}
+
+	MEM(child = unlang_subrequest_alloc(request, dict_tls));
+	request = child;
+
+	/*
+	 *	Setup the child request for storing
+	 *	session resumption data.
+	 */
+	MEM(pair_prepend_request(&vp, attr_tls_packet_type) >= 0);
+	vp->vp_uint32 = enum_tls_packet_type_store_session->vb_uint32;
+
+	/*
+	 *	Add the session identifier we're trying
+	 *	to store.
+	 */
+	MEM(pair_update_request(&vp, attr_tls_session_id) >= 0);
+	fr_pair_value_memdup_buffer_shallow(vp, fr_tls_cache_id(vp, sess), true);
+
+	/*
+	 *	How long the session has to live
+	 */
+	MEM(pair_update_request(&vp, attr_tls_session_ttl) >= 0);
+	vp->vp_time_delta = fr_time_sub(expires, now);
+
+	MEM(pair_update_request(&vp, attr_tls_session_data) >= 0);
+	fr_pair_value_memdup_buffer_shallow(vp, talloc_steal(vp, data), true);
 
 	/*
 	 *	Allocate a child, and set it up to call
 	 *      the TLS virtual server.
 	 */
 	ua = fr_tls_call_push(child, tls_cache_store_result, conf, tls_session);
-	if (ua < 0) goto error;
+	if (ua < 0) {
+		talloc_free(child);
+		tls_cache_store_state_reset(NULL, tls_cache);
+		return UNLANG_ACTION_FAIL;
+	}
 
 	return ua;
 }
@@ -696,7 +802,17 @@ unlang_action_t fr_tls_cache_pending_push(request_t *request, fr_tls_session_t *
 			}
 		}
 
-		return tls_cache_clear_push(request, conf, tls_session);
+		if (conf->cache.store) {
+			fr_tls_store_remove(conf->cache.store,
+					    tls_cache->clear.id, talloc_array_length(tls_cache->clear.id));
+		}
+
+		if (conf->virtual_server) return tls_cache_clear_push(request, conf, tls_session);
+
+		/*
+		 *	Sessions are only held in memory.
+		 */
+		tls_cache_clear_state_reset(request, tls_cache);
 	}
 
 	if (tls_cache->store.state == FR_TLS_CACHE_STORE_REQUESTED) {
@@ -771,10 +887,12 @@ static SSL_SESSION *tls_cache_load_cb(SSL *ssl,
 				      int key_len, int *copy)
 {
 	fr_tls_session_t	*tls_session;
+	fr_tls_conf_t		*conf;
 	fr_tls_cache_t		*tls_cache;
 	request_t		*request;
 
 	tls_session = fr_tls_session(ssl);
+	conf = fr_tls_session_conf(tls_session->ssl);
 	request = fr_tls_session_request(tls_session->ssl);
 	tls_cache = tls_session->cache;
 
@@ -807,6 +925,25 @@ again:
 	case FR_TLS_CACHE_LOAD_INIT:
 		fr_assert(!tls_cache->load.id);
 
+		/*
+		 *	Check the in-memory store first, so that
+		 *	resumption doesn't require a round trip
+		 *	through the virtual server.
+		 */
+		if (conf->cache.store) {
+			tls_cache->load.sess = tls_cache_memory_find(request, tls_session, conf->cache.store,
+								     key, key_len);
+			if (tls_cache->load.sess) {
+				tls_cache->load.state = FR_TLS_CACHE_LOAD_RETRIEVED;
+				goto again;
+			}
+
+			/*
+			 *	Sessions are only held in memory.
+			 */
+			if (!conf->virtual_server) return NULL;
+		}
+
 		tls_cache->load.state = FR_TLS_CACHE_LOAD_REQUESTED;
 		MEM(tls_cache->load.id = talloc_typed_memdup(tls_cache, (uint8_t const *)key, key_len));
 
@@ -881,6 +1018,12 @@ again:
 			return NULL;
 		}
 
+		/*
+		 *	Without a virtual server there's nothing
+		 *	to re-validate the certificate with.
+		 */
+		if (!conf->virtual_server) goto resume;
+
 		/*
 		 *	This sets the validation state of the tls_session
 		 *	so that when we call ASYNC_pause_job(), and execution
@@ -922,6 +1065,8 @@ again:
 			RDEBUG2("Certificate re-validation failed, denying session resumption via session-id");
 			goto verify_error;
 		}
+
+	resume:
 		sess = tls_cache->load.sess;
 
 		/*
@@ -1408,6 +1553,15 @@ int fr_tls_cache_ctx_init(SSL_CTX *ctx, fr_tls_cache_conf_t const *cache_conf)
 
 		if (!(cache_conf->mode & FR_TLS_CACHE_STATEFUL)) tls_cache_disable_statefull_resumption(ctx);
 
+		/*
+		 *	Keys are rotated, and looked up for each
+		 *	ticket by the key callback.
+		 */
+		if (cache_conf->ticket_keys) {
+			if (fr_tls_ticket_keys_ctx_init(ctx) < 0) return -1;
+			goto ticket_cb;
+		}
+
 		/*
 		 *	If keys is NULL, then OpenSSL returns the expected
 		 *	key length, which may be different across different
@@ -1480,6 +1634,7 @@ int fr_tls_cache_ctx_init(SSL_CTX *ctx, fr_tls_cache_conf_t const *cache_conf)
 		HEXDUMP3(key_buff, key_len, NULL);
 		talloc_free(key_buff);
 
+	ticket_cb:
 		/*
 		 *	These callbacks embed and extract the
 		 *	session-state list from the session-ticket.
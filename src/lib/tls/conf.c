@@ -81,6 +81,12 @@ static fr_table_num_sorted_t const verify_mode_table[] = {
 static size_t verify_mode_table_len = NUM_ELEMENTS(verify_mode_table);
 
 static conf_parser_t tls_cache_config[] = {
+	/*
+	 *	Must be parsed before mode, so we know whether
+	 *	stateful resumption is possible without a
+	 *	virtual server.
+	 */
+	{ FR_CONF_OFFSET("cache_size", fr_tls_cache_conf_t, cache_size), .dflt = "0" },
 	{ FR_CONF_OFFSET("mode", fr_tls_cache_conf_t, mode),
 			 .func = tls_conf_parse_cache_mode,
 			 .uctx = &(cf_table_parse_ctx_t){
@@ -96,6 +102,8 @@ static conf_parser_t tls_cache_config[] = {
 	{ FR_CONF_OFFSET("require_perfect_forward_secrecy", fr_tls_cache_conf_t, require_pfs), .dflt = "no" },
 
 	{ FR_CONF_OFFSET("session_ticket_key", fr_tls_cache_conf_t, session_ticket_key) },
+	{ FR_CONF_OFFSET_FLAGS("session_ticket_key_file", CONF_FLAG_FILE_INPUT | CONF_FLAG_FILE_EXISTS, fr_tls_cache_conf_t, session_ticket_key_file) },
+	{ FR_CONF_OFFSET("session_ticket_key_rotation", fr_tls_cache_conf_t, session_ticket_key_rotation), .dflt = "0" },
 
 	/*
 	 *	Deprecated
@@ -260,8 +268,13 @@ static int tls_conf_parse_cache_mode(TALLOC_CTX *ctx, void *out, void *parent, C
 		break;
 
 	case FR_TLS_CACHE_STATEFUL:
+		/*
+		 *	Sessions are only held in memory.
+		 */
+		if (!conf->virtual_server && conf->cache.cache_size) goto check_version;
+
 		if (!conf->virtual_server) {
-			cf_log_err(ci, "A virtual_server must be set when cache.mode = \"stateful\"");
+			cf_log_err(ci, "A virtual_server or cache_size must be set when cache.mode = \"stateful\"");
 		error:
 			return -1;
 		}
@@ -284,6 +297,7 @@ static int tls_conf_parse_cache_mode(TALLOC_CTX *ctx, void *out, void *parent, C
 			goto error;
 		}
 
+	check_version:
 		if (conf->tls_min_version >= (float)1.3) {
 			cf_log_err(ci, "cache.mode = \"stateful\" is not supported with tls_min_version >= 1.3");
 			goto error;
@@ -291,6 +305,8 @@ static int tls_conf_parse_cache_mode(TALLOC_CTX *ctx, void *out, void *parent, C
 		break;
 
 	case FR_TLS_CACHE_AUTO:
+		if (!conf->virtual_server && conf->cache.cache_size) break;
+
 		if (!conf->virtual_server) {
 			WARN("A virtual_server must be provided for stateful caching. "
 			     "cache.mode = \"auto\" rewritten to cache.mode = \"stateless\"");
@@ -460,6 +476,83 @@ fr_tls_conf_t *fr_tls_conf_alloc(TALLOC_CTX *ctx)
 	return conf;
 }
 
+/** Read the session ticket key from a file
+ *
+ * The file contents are used verbatim, so binary keys are supported.
+ */
+static int tls_conf_session_ticket_key_load(fr_tls_conf_t *conf)
+{
+	FILE	*fp;
+	uint8_t	buff[1024];
+	size_t	len;
+
+	fp = fopen(conf->cache.session_ticket_key_file, "r");
+	if (!fp) {
+		ERROR("Failed opening session_ticket_key_file \"%s\": %s",
+		      conf->cache.session_ticket_key_file, fr_syserror(errno));
+		return -1;
+	}
+	len = fread(buff, 1, sizeof(buff), fp);
+	if (ferror(fp)) {
+		ERROR("Failed reading session_ticket_key_file \"%s\": %s",
+		      conf->cache.session_ticket_key_file, fr_syserror(errno));
+		fclose(fp);
+		return -1;
+	}
+	fclose(fp);
+
+	if (len < 32) {
+		ERROR("session_ticket_key_file \"%s\" must contain at least 32 bytes, got %zu bytes",
+		      conf->cache.session_ticket_key_file, len);
+		return -1;
+	}
+
+	talloc_const_free(conf->cache.session_ticket_key);
+	MEM(conf->cache.session_ticket_key = talloc_memdup(conf, buff, len));
+	OPENSSL_cleanse(buff, sizeof(buff));
+
+	return 0;
+}
+
+/** Allocate structures shared by all workers for session resumption
+ *
+ */
+static int tls_conf_cache_init(fr_tls_conf_t *conf)
+{
+	if (conf->cache.mode & FR_TLS_CACHE_STATEFUL) {
+		if (conf->cache.cache_size) {
+			conf->cache.store = fr_tls_store_alloc(conf, conf->cache.cache_size);
+			if (!conf->cache.store) return -1;
+		}
+	}
+
+	if (conf->cache.mode & FR_TLS_CACHE_STATELESS) {
+		if (conf->cache.session_ticket_key_file && (tls_conf_session_ticket_key_load(conf) < 0)) return -1;
+
+		if (fr_time_delta_ispos(conf->cache.session_ticket_key_rotation)) {
+			FR_TIME_DELTA_BOUND_CHECK("session.session_ticket_key_rotation",
+						  conf->cache.session_ticket_key_rotation, >=, fr_time_delta_from_sec(60));
+
+			if (fr_time_delta_gt(conf->cache.lifetime,
+					     fr_time_delta_mul(conf->cache.session_ticket_key_rotation,
+							       FR_TLS_TICKET_KEYS_MAX - 2))) {
+				WARN("session.lifetime is longer than %u session_ticket_key_rotation periods.  "
+				     "Session tickets will expire earlier than session.lifetime",
+				     FR_TLS_TICKET_KEYS_MAX - 2);
+			}
+
+			conf->cache.ticket_keys = fr_tls_ticket_keys_alloc(conf,
+									   conf->cache.session_ticket_key,
+									   talloc_array_length(conf->cache.session_ticket_key),
+									   conf->cache.session_ticket_key_rotation,
+									   conf->cache.lifetime);
+			if (!conf->cache.ticket_keys) return -1;
+		}
+	}
+
+	return 0;
+}
+
 fr_tls_conf_t *fr_tls_conf_parse_server(CONF_SECTION *cs)
 {
 	fr_tls_conf_t *conf;
@@ -480,9 +573,7 @@ fr_tls_conf_t *fr_tls_conf_parse_server(CONF_SECTION *cs)
 
 	if ((cf_section_parse(conf, conf, cs) < 0) ||
 	    (cf_section_parse_pass2(conf, cs) < 0)) {
-#ifdef __APPLE__
 	error:
-#endif
 		talloc_free(conf);
 		return NULL;
 	}
@@ -494,6 +585,8 @@ fr_tls_conf_t *fr_tls_conf_parse_server(CONF_SECTION *cs)
 
 	FR_INTEGER_BOUND_CHECK("padding", conf->padding_block_size, <=, SSL3_RT_MAX_PLAIN_LENGTH);
 
+	if (tls_conf_cache_init(conf) < 0) goto error;
+
 #ifdef __APPLE__
 	if (conf_cert_admin_password(conf) < 0) goto error;
 #endif
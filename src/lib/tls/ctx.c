@@ -342,6 +342,26 @@ static int tls_ctx_load_cert_chain(SSL_CTX *ctx, fr_tls_chain_conf_t *chain, boo
 		return -1;
 	}
 
+	/*
+	 *	If private key offloading is enabled, replace
+	 *	the key with one whose operations are performed
+	 *	by the crypto threads.
+	 */
+	{
+		EVP_PKEY *offload;
+
+		offload = fr_tls_pkey_wrap(SSL_CTX_get0_privatekey(ctx));
+		if (offload) {
+			if (SSL_CTX_use_PrivateKey(ctx, offload) != 1) {
+				EVP_PKEY_free(offload);
+				fr_tls_log(NULL, "Failed setting offloaded private key");
+				return -1;
+			}
+			EVP_PKEY_free(offload);
+			DEBUG3("Private key operations will be offloaded to crypto threads");
+		}
+	}
+
 	/*
 	 *	Loop over the certificates checking validity periods.
 	 *	SSL_CTX_build_cert_chain does this too, but we can
@@ -0,0 +1,1026 @@
+/*
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+/**
+ * $Id$
+ *
+ * @file tls/pkey.c
+ * @brief Offload private key operations to a pool of crypto threads.
+ *
+ * Signing (and RSA decryption for RSA key exchange) with the server's private
+ * key is the most expensive part of a TLS handshake.  Normally libssl performs
+ * these operations synchronously inside SSL_read(), on the worker thread.
+ *
+ * When offloading is enabled, server keys are copied into a small OpenSSL provider
+ * which lives in its own library context.  The provider's signature and asymmetric
+ * cipher implementations hand the operation to a crypto thread, and pause the
+ * OpenSSL async job the handshake is running in.  SSL_read() then returns
+ * SSL_ERROR_WANT_ASYNC, and tls_session_async_handshake_cont() yields the request.
+ *
+ * When the crypto thread is done, it signals the worker's event loop, which marks
+ * the request as runnable.  The handshake is resumed by calling SSL_read() again,
+ * which resumes the paused job, and the result is returned to libssl.
+ *
+ * Keys in the provider can't be exported with their private components, which
+ * means OpenSSL always falls back to using our implementations for them.
+ * All other operations are delegated to a copy of the key held by the default
+ * provider.
+ *
+ * @copyright 2024 The FreeRADIUS server project
+ */
+#ifdef WITH_TLS
+#define LOG_PREFIX "tls"
+
+#include <freeradius-devel/server/base.h>
+#include <freeradius-devel/unlang/interpret.h>
+#include <freeradius-devel/util/debug.h>
+#include <freeradius-devel/util/dlist.h>
+#include <freeradius-devel/util/syserror.h>
+
+#include <openssl/async.h>
+#include <openssl/core_dispatch.h>
+#include <openssl/core_names.h>
+#include <openssl/params.h>
+#include <openssl/provider.h>
+
+#include <pthread.h>
+
+#include "base.h"
+#include "log.h"
+
+#define PKEY_PROVIDER_NAME	"freeradius-pkey"
+
+/** Type of private key operation
+ *
+ */
+typedef enum {
+	PKEY_OP_SIGN = 0,				//!< Sign a digest.
+	PKEY_OP_DECRYPT					//!< Decrypt a message.
+} fr_tls_pkey_op_type_t;
+
+/** Per worker thread state
+ *
+ */
+typedef struct {
+	fr_event_list_t		*el;			//!< Worker's event list.
+	fr_event_user_t		*ev;			//!< Triggered by crypto threads when operations complete.
+
+	pthread_mutex_t		mutex;			//!< Protects the fields below.
+	pthread_cond_t		cond;			//!< Signalled when inflight reaches zero.
+	fr_dlist_head_t		complete;		//!< Operations completed by crypto threads.
+	unsigned int		inflight;		//!< Operations submitted by this worker, not yet
+							///< completed by a crypto thread.
+} fr_tls_pkey_thread_t;
+
+/** A private key operation
+ *
+ * Allocated with malloc, as it may be freed by either the worker or a crypto thread.
+ */
+struct fr_tls_pkey_op_s {
+	fr_dlist_t		entry;			//!< Entry in the pool queue, or the worker's
+							///< list of completed operations.
+	fr_tls_pkey_op_type_t	type;			//!< What we're doing.
+	EVP_PKEY_CTX		*pctx;			//!< Copy of the context to perform the operation with.
+
+	uint8_t			*in;			//!< Copy of the data to sign or decrypt.
+	size_t			inlen;			//!< Length of in.
+	uint8_t			*out;			//!< Where the crypto thread writes the result.
+	size_t			outlen;			//!< Size of out, then length of the result.
+	int			ret;			//!< Value returned by EVP_PKEY_sign or EVP_PKEY_decrypt.
+
+	fr_tls_pkey_thread_t	*thread;		//!< Worker which submitted the operation.
+	request_t		*request;		//!< Request to resume.  May be NULL.
+	bool			completed;		//!< Crypto thread has performed the operation.
+							///< Protected by thread->mutex.
+	bool			abandoned;		//!< Worker is no longer interested in the result.
+							///< Protected by thread->mutex.
+	bool			done;			//!< Completion has been processed by the worker.
+							///< Only accessed by the worker.
+};
+
+/** Crypto thread pool
+ *
+ */
+static struct {
+	pthread_mutex_t		mutex;			//!< Protects queue and stop.
+	pthread_cond_t		cond;			//!< Signalled when operations are queued.
+	fr_dlist_head_t		queue;			//!< Operations waiting for a crypto thread.
+	bool			stop;			//!< Tells crypto threads to exit.
+
+	pthread_t		*threads;		//!< Crypto threads.
+	unsigned int		num_threads;		//!< Number of crypto threads.
+} pkey_pool = {
+	.mutex = PTHREAD_MUTEX_INITIALIZER,
+	.cond = PTHREAD_COND_INITIALIZER
+};
+
+static OSSL_LIB_CTX			*pkey_libctx;		//!< Library context containing our provider.
+static OSSL_PROVIDER			*pkey_provider;		//!< Offload provider.
+
+static _Thread_local fr_tls_pkey_thread_t	*pkey_thread;		//!< This worker's state.
+static _Thread_local fr_tls_session_t		*pkey_tls_session;	//!< Session whose handshake is running.
+static _Thread_local request_t			*pkey_request;		//!< Request the handshake is running for.
+
+/** Perform an operation on the calling thread
+ *
+ */
+static inline int pkey_op_exec(fr_tls_pkey_op_type_t type, EVP_PKEY_CTX *pctx,
+			       uint8_t *out, size_t *outlen, uint8_t const *in, size_t inlen)
+{
+	switch (type) {
+	case PKEY_OP_SIGN:
+		return EVP_PKEY_sign(pctx, out, outlen, in, inlen);
+
+	case PKEY_OP_DECRYPT:
+		return EVP_PKEY_decrypt(pctx, out, outlen, in, inlen);
+	}
+
+	return 0;
+}
+
+static void pkey_op_free(fr_tls_pkey_op_t *op)
+{
+	EVP_PKEY_CTX_free(op->pctx);
+	free(op->in);
+	free(op->out);
+	free(op);
+}
+
+/** Crypto thread main loop
+ *
+ */
+static void *pkey_pool_thread(UNUSED void *arg)
+{
+	fr_tls_pkey_op_t	*op;
+	fr_tls_pkey_thread_t	*thread;
+
+	pthread_mutex_lock(&pkey_pool.mutex);
+	for (;;) {
+		while (!pkey_pool.stop && (fr_dlist_num_elements(&pkey_pool.queue) == 0)) {
+			pthread_cond_wait(&pkey_pool.cond, &pkey_pool.mutex);
+		}
+		if (pkey_pool.stop) break;
+
+		op = fr_dlist_head(&pkey_pool.queue);
+		fr_dlist_remove(&pkey_pool.queue, op);
+		pthread_mutex_unlock(&pkey_pool.mutex);
+
+		op->ret = pkey_op_exec(op->type, op->pctx, op->out, &op->outlen, op->in, op->inlen);
+
+		/*
+		 *	Hand the result back to the worker
+		 */
+		thread = op->thread;
+		pthread_mutex_lock(&thread->mutex);
+		op->completed = true;
+		if (op->abandoned) {
+			pkey_op_free(op);
+		} else {
+			fr_dlist_insert_tail(&thread->complete, op);
+			if (fr_event_user_trigger(thread->el, thread->ev) < 0) {
+				PERROR("Failed signalling worker");
+			}
+		}
+		if (--thread->inflight == 0) pthread_cond_signal(&thread->cond);
+		pthread_mutex_unlock(&thread->mutex);
+
+		pthread_mutex_lock(&pkey_pool.mutex);
+	}
+	pthread_mutex_unlock(&pkey_pool.mutex);
+
+	return NULL;
+}
+
+/** Process operations completed by the crypto threads
+ *
+ * Runs in the worker's event loop.
+ */
+static void _pkey_thread_complete(UNUSED fr_event_list_t *el, void *uctx)
+{
+	fr_tls_pkey_thread_t	*thread = talloc_get_type_abort(uctx, fr_tls_pkey_thread_t);
+	fr_dlist_head_t		complete;
+	fr_tls_pkey_op_t	*op;
+
+	fr_dlist_init(&complete, fr_tls_pkey_op_t, entry);
+
+	pthread_mutex_lock(&thread->mutex);
+	fr_dlist_move(&complete, &thread->complete);
+	pthread_mutex_unlock(&thread->mutex);
+
+	while ((op = fr_dlist_pop_head(&complete))) {
+		op->done = true;
+		if (op->request) unlang_interpret_mark_runnable(op->request);
+	}
+}
+
+/** Submit an operation to the crypto threads, and pause the current async job until it completes
+ *
+ * If we're not running in an async job, or not in a part of the handshake
+ * which can be paused, the operation is performed synchronously.
+ *
+ * @return
+ *	- 1 on success.
+ *	- <= 0 on failure.
+ */
+static int pkey_op_run(fr_tls_pkey_op_type_t type, EVP_PKEY_CTX *pctx,
+		       uint8_t *out, size_t *outlen, size_t outsize, uint8_t const *in, size_t inlen)
+{
+	fr_tls_pkey_thread_t	*thread = pkey_thread;
+	fr_tls_session_t	*tls_session = pkey_tls_session;
+	request_t		*request = pkey_request;
+	fr_tls_pkey_op_t	*op;
+	int			ret;
+
+	if (!thread || !tls_session || !tls_session->can_pause || !ASYNC_get_current_job()) {
+	sync:
+		*outlen = outsize;
+		return pkey_op_exec(type, pctx, out, outlen, in, inlen);
+	}
+
+	op = calloc(1, sizeof(*op));
+	if (!op) goto sync;
+
+	op->type = type;
+	op->pctx = EVP_PKEY_CTX_dup(pctx);
+	op->in = malloc(inlen);
+	op->inlen = inlen;
+	op->out = malloc(outsize);
+	op->outlen = outsize;
+	op->thread = thread;
+	op->request = request;
+	if (!op->pctx || !op->in || !op->out) {
+		pkey_op_free(op);
+		goto sync;
+	}
+	memcpy(op->in, in, inlen);
+
+	pthread_mutex_lock(&thread->mutex);
+	thread->inflight++;
+	pthread_mutex_unlock(&thread->mutex);
+
+	pthread_mutex_lock(&pkey_pool.mutex);
+	fr_dlist_insert_tail(&pkey_pool.queue, op);
+	pthread_cond_signal(&pkey_pool.cond);
+	pthread_mutex_unlock(&pkey_pool.mutex);
+
+	tls_session->pkey_op = op;
+
+	/*
+	 *	Jumps back to SSL_read() in session.c, which
+	 *	yields the request until we're marked runnable.
+	 */
+	for (;;) {
+		ASYNC_pause_job();
+
+		if (op->done) break;
+
+		/*
+		 *	Request was cancelled before the operation
+		 *	completed, and the handshake is being run to
+		 *	completion so the session can be freed.
+		 *	Leave the crypto thread to clean up, and
+		 *	fail the operation.
+		 */
+		if (!tls_session->can_pause || (request && unlang_request_is_cancelled(request))) {
+			tls_session->pkey_op = NULL;
+
+			pthread_mutex_lock(&thread->mutex);
+			if (op->completed) {
+				fr_dlist_remove(&thread->complete, op);
+				pkey_op_free(op);
+			} else {
+				op->abandoned = true;
+			}
+			pthread_mutex_unlock(&thread->mutex);
+
+			return 0;
+		}
+	}
+
+	tls_session->pkey_op = NULL;
+
+	ret = op->ret;
+	if (ret > 0) {
+		memcpy(out, op->out, op->outlen);
+		*outlen = op->outlen;
+	}
+	pkey_op_free(op);
+
+	return ret;
+}
+
+/** Keys held by the provider
+ *
+ * Every key is a wrapper around a key held by the default provider.
+ */
+typedef struct {
+	char const		*name;			//!< Key type, as known by the default provider.
+	EVP_PKEY		*pkey;			//!< Key in the default provider.
+	int			selection;		//!< Components the key was imported with.
+} pkey_keydata_t;
+
+/** Signature and asymmetric cipher contexts
+ *
+ */
+typedef struct {
+	pkey_keydata_t		*key;			//!< Key the operation is being performed with.
+	EVP_PKEY_CTX		*pctx;			//!< Context for the default provider's key.
+	EVP_MD_CTX		*mdctx;			//!< Digest context for digest sign operations.
+} pkey_op_ctx_t;
+
+static void *pkey_keymgmt_new(char const *name)
+{
+	pkey_keydata_t *kd;
+
+	kd = OPENSSL_zalloc(sizeof(*kd));
+	if (!kd) return NULL;
+	kd->name = name;
+
+	return kd;
+}
+
+static void *pkey_keymgmt_rsa_new(UNUSED void *provctx)
+{
+	return pkey_keymgmt_new("RSA");
+}
+
+static void *pkey_keymgmt_ec_new(UNUSED void *provctx)
+{
+	return pkey_keymgmt_new("EC");
+}
+
+static void pkey_keymgmt_free(void *keydata)
+{
+	pkey_keydata_t *kd = keydata;
+
+	if (!kd) return;
+	EVP_PKEY_free(kd->pkey);
+	OPENSSL_free(kd);
+}
+
+static int pkey_keymgmt_has(void const *keydata, int selection)
+{
+	pkey_keydata_t const *kd = keydata;
+
+	if (!kd || !kd->pkey) return 0;
+
+	selection &= OSSL_KEYMGMT_SELECT_ALL;
+
+	return (kd->selection & selection) == selection;
+}
+
+static int pkey_keymgmt_match(void const *keydata1, void const *keydata2, UNUSED int selection)
+{
+	pkey_keydata_t const *a = keydata1, *b = keydata2;
+
+	if (!a->pkey || !b->pkey) return 0;
+
+	return EVP_PKEY_eq(a->pkey, b->pkey) == 1;
+}
+
+/** Build a key in the default provider from the imported parameters
+ *
+ */
+static int pkey_keymgmt_import(void *keydata, int selection, OSSL_PARAM const params[])
+{
+	pkey_keydata_t	*kd = keydata;
+	EVP_PKEY_CTX	*ctx;
+	EVP_PKEY	*pkey = NULL;
+	int		ret = 0;
+
+	ctx = EVP_PKEY_CTX_new_from_name(NULL, kd->name, NULL);
+	if (!ctx) return 0;
+
+	if ((EVP_PKEY_fromdata_init(ctx) == 1) &&
+	    (EVP_PKEY_fromdata(ctx, &pkey, selection, UNCONST(OSSL_PARAM *, params)) == 1)) {
+		EVP_PKEY_free(kd->pkey);
+		kd->pkey = pkey;
+		kd->selection = selection;
+		if (!OSSL_PARAM_locate_const(params, OSSL_PKEY_PARAM_PRIV_KEY) &&
+		    !OSSL_PARAM_locate_const(params, OSSL_PKEY_PARAM_RSA_D)) {
+			kd->selection &= ~OSSL_KEYMGMT_SELECT_PRIVATE_KEY;
+		}
+		ret = 1;
+	}
+	EVP_PKEY_CTX_free(ctx);
+
+	return ret;
+}
+
+/** Export the public components of a key
+ *
+ * Refusing to export private keys is what makes OpenSSL use our
+ * signature and asymmetric cipher implementations.
+ */
+static int pkey_keymgmt_export(void *keydata, int selection, OSSL_CALLBACK *param_cb, void *cbarg)
+{
+	pkey_keydata_t	*kd = keydata;
+	OSSL_PARAM	*params = NULL;
+	int		ret;
+
+	if (!kd->pkey || (selection & OSSL_KEYMGMT_SELECT_PRIVATE_KEY)) return 0;
+
+	if (EVP_PKEY_todata(kd->pkey, selection, &params) != 1) return 0;
+	ret = param_cb(params, cbarg);
+	OSSL_PARAM_free(params);
+
+	return ret;
+}
+
+static OSSL_PARAM const *pkey_keymgmt_types(char const *name, int selection, bool import)
+{
+	EVP_PKEY_CTX		*ctx;
+	OSSL_PARAM const	*types = NULL;
+
+	if (!import) selection &= ~OSSL_KEYMGMT_SELECT_PRIVATE_KEY;
+
+	/*
+	 *	The returned parameters are static in the
+	 *	default provider, so outlive the context.
+	 */
+	ctx = EVP_PKEY_CTX_new_from_name(NULL, name, NULL);
+	if (!ctx) return NULL;
+	types = EVP_PKEY_fromdata_settable(ctx, selection);
+	EVP_PKEY_CTX_free(ctx);
+
+	return types;
+}
+
+static OSSL_PARAM const *pkey_keymgmt_rsa_import_types(int selection)
+{
+	return pkey_keymgmt_types("RSA", selection, true);
+}
+
+static OSSL_PARAM const *pkey_keymgmt_rsa_export_types(int selection)
+{
+	return pkey_keymgmt_types("RSA", selection, false);
+}
+
+static OSSL_PARAM const *pkey_keymgmt_ec_import_types(int selection)
+{
+	return pkey_keymgmt_types("EC", selection, true);
+}
+
+static OSSL_PARAM const *pkey_keymgmt_ec_export_types(int selection)
+{
+	return pkey_keymgmt_types("EC", selection, false);
+}
+
+static int pkey_keymgmt_get_params(void *keydata, OSSL_PARAM params[])
+{
+	pkey_keydata_t *kd = keydata;
+
+	if (!kd->pkey) return 0;
+
+	return EVP_PKEY_get_params(kd->pkey, params);
+}
+
+static OSSL_PARAM const *pkey_keymgmt_gettable_params(UNUSED void *provctx)
+{
+	static OSSL_PARAM const gettable[] = {
+		OSSL_PARAM_int(OSSL_PKEY_PARAM_BITS, NULL),
+		OSSL_PARAM_int(OSSL_PKEY_PARAM_SECURITY_BITS, NULL),
+		OSSL_PARAM_int(OSSL_PKEY_PARAM_MAX_SIZE, NULL),
+		OSSL_PARAM_utf8_string(OSSL_PKEY_PARAM_DEFAULT_DIGEST, NULL, 0),
+		OSSL_PARAM_utf8_string(OSSL_PKEY_PARAM_MANDATORY_DIGEST, NULL, 0),
+		OSSL_PARAM_utf8_string(OSSL_PKEY_PARAM_GROUP_NAME, NULL, 0),
+		OSSL_PARAM_octet_string(OSSL_PKEY_PARAM_ENCODED_PUBLIC_KEY, NULL, 0),
+		OSSL_PARAM_END
+	};
+
+	return gettable;
+}
+
+static char const *pkey_keymgmt_rsa_query_operation_name(UNUSED int operation_id)
+{
+	return "RSA";
+}
+
+static char const *pkey_keymgmt_ec_query_operation_name(int operation_id)
+{
+	switch (operation_id) {
+	case OSSL_OP_SIGNATURE:
+		return "ECDSA";
+
+	default:
+		return "EC";
+	}
+}
+
+#define PKEY_KEYMGMT_FUNCTIONS(_type) \
+	{ OSSL_FUNC_KEYMGMT_NEW, (void (*)(void))pkey_keymgmt_##_type##_new }, \
+	{ OSSL_FUNC_KEYMGMT_FREE, (void (*)(void))pkey_keymgmt_free }, \
+	{ OSSL_FUNC_KEYMGMT_HAS, (void (*)(void))pkey_keymgmt_has }, \
+	{ OSSL_FUNC_KEYMGMT_MATCH, (void (*)(void))pkey_keymgmt_match }, \
+	{ OSSL_FUNC_KEYMGMT_IMPORT, (void (*)(void))pkey_keymgmt_import }, \
+	{ OSSL_FUNC_KEYMGMT_IMPORT_TYPES, (void (*)(void))pkey_keymgmt_##_type##_import_types }, \
+	{ OSSL_FUNC_KEYMGMT_EXPORT, (void (*)(void))pkey_keymgmt_export }, \
+	{ OSSL_FUNC_KEYMGMT_EXPORT_TYPES, (void (*)(void))pkey_keymgmt_##_type##_export_types }, \
+	{ OSSL_FUNC_KEYMGMT_GET_PARAMS, (void (*)(void))pkey_keymgmt_get_params }, \
+	{ OSSL_FUNC_KEYMGMT_GETTABLE_PARAMS, (void (*)(void))pkey_keymgmt_gettable_params }, \
+	{ OSSL_FUNC_KEYMGMT_QUERY_OPERATION_NAME, (void (*)(void))pkey_keymgmt_##_type##_query_operation_name }, \
+	{ 0, NULL }
+
+static OSSL_DISPATCH const pkey_keymgmt_rsa[] = { PKEY_KEYMGMT_FUNCTIONS(rsa) };
+static OSSL_DISPATCH const pkey_keymgmt_ec[] = { PKEY_KEYMGMT_FUNCTIONS(ec) };
+
+static void *pkey_ctx_new(UNUSED void *provctx, UNUSED char const *propq)
+{
+	return OPENSSL_zalloc(sizeof(pkey_op_ctx_t));
+}
+
+static void *pkey_asym_ctx_new(void *provctx)
+{
+	return pkey_ctx_new(provctx, NULL);
+}
+
+static void pkey_ctx_free(void *ctx)
+{
+	pkey_op_ctx_t *oc = ctx;
+
+	if (!oc) return;
+	EVP_PKEY_CTX_free(oc->pctx);
+	EVP_MD_CTX_free(oc->mdctx);
+	OPENSSL_free(oc);
+}
+
+static void *pkey_ctx_dup(void *ctx)
+{
+	pkey_op_ctx_t *oc = ctx, *dup;
+
+	dup = OPENSSL_zalloc(sizeof(*dup));
+	if (!dup) return NULL;
+
+	dup->key = oc->key;
+	if (oc->pctx && !(dup->pctx = EVP_PKEY_CTX_dup(oc->pctx))) goto error;
+	if (oc->mdctx) {
+		dup->mdctx = EVP_MD_CTX_new();
+		if (!dup->mdctx || (EVP_MD_CTX_copy_ex(dup->mdctx, oc->mdctx) != 1)) goto error;
+	}
+
+	return dup;
+
+error:
+	pkey_ctx_free(dup);
+	return NULL;
+}
+
+static int pkey_ctx_set_params(void *ctx, OSSL_PARAM const params[])
+{
+	pkey_op_ctx_t *oc = ctx;
+
+	if (!params) return 1;
+	if (!oc->pctx) return 0;
+
+	return EVP_PKEY_CTX_set_params(oc->pctx, params);
+}
+
+static int pkey_ctx_get_params(void *ctx, OSSL_PARAM params[])
+{
+	pkey_op_ctx_t *oc = ctx;
+
+	if (!oc->pctx) return 0;
+
+	return EVP_PKEY_CTX_get_params(oc->pctx, params);
+}
+
+static OSSL_PARAM const *pkey_ctx_settable_params(void *ctx, UNUSED void *provctx)
+{
+	pkey_op_ctx_t *oc = ctx;
+
+	if (!oc || !oc->pctx) return NULL;
+
+	return EVP_PKEY_CTX_settable_params(oc->pctx);
+}
+
+static OSSL_PARAM const *pkey_ctx_gettable_params(void *ctx, UNUSED void *provctx)
+{
+	pkey_op_ctx_t *oc = ctx;
+
+	if (!oc || !oc->pctx) return NULL;
+
+	return EVP_PKEY_CTX_gettable_params(oc->pctx);
+}
+
+/** Initialise a context for the wrapped key
+ *
+ */
+static int pkey_ctx_init(pkey_op_ctx_t *oc, void *provkey, fr_tls_pkey_op_type_t type, OSSL_PARAM const params[])
+{
+	pkey_keydata_t *kd = provkey;
+
+	if (!kd || !kd->pkey) return 0;
+
+	EVP_PKEY_CTX_free(oc->pctx);
+	oc->key = kd;
+	oc->pctx = EVP_PKEY_CTX_new_from_pkey(NULL, kd->pkey, NULL);
+	if (!oc->pctx) return 0;
+
+	switch (type) {
+	case PKEY_OP_SIGN:
+		if (EVP_PKEY_sign_init_ex(oc->pctx, params) != 1) return 0;
+		break;
+
+	case PKEY_OP_DECRYPT:
+		if (EVP_PKEY_decrypt_init_ex(oc->pctx, params) != 1) return 0;
+		break;
+	}
+
+	return 1;
+}
+
+static int pkey_sign_init(void *ctx, void *provkey, OSSL_PARAM const params[])
+{
+	return pkey_ctx_init(ctx, provkey, PKEY_OP_SIGN, params);
+}
+
+static int pkey_sign(void *ctx, unsigned char *sig, size_t *siglen, size_t sigsize,
+		     unsigned char const *tbs, size_t tbslen)
+{
+	pkey_op_ctx_t *oc = ctx;
+
+	if (!sig) return EVP_PKEY_sign(oc->pctx, NULL, siglen, tbs, tbslen);
+
+	return pkey_op_run(PKEY_OP_SIGN, oc->pctx, sig, siglen, sigsize, tbs, tbslen);
+}
+
+static int pkey_digest_sign_init(void *ctx, char const *mdname, void *provkey, OSSL_PARAM const params[])
+{
+	pkey_op_ctx_t	*oc = ctx;
+	pkey_keydata_t	*kd = provkey;
+	EVP_MD		*md;
+	char		dflt[64];
+	OSSL_PARAM	md_params[2];
+	int		ret;
+
+	if (!pkey_ctx_init(oc, provkey, PKEY_OP_SIGN, NULL)) return 0;
+
+	if (!mdname || !*mdname) {
+		if (EVP_PKEY_get_default_digest_name(kd->pkey, dflt, sizeof(dflt)) <= 0) return 0;
+		mdname = dflt;
+	}
+
+	md_params[0] = OSSL_PARAM_construct_utf8_string(OSSL_SIGNATURE_PARAM_DIGEST, UNCONST(char *, mdname), 0);
+	md_params[1] = OSSL_PARAM_construct_end();
+	if (EVP_PKEY_CTX_set_params(oc->pctx, md_params) != 1) return 0;
+
+	md = EVP_MD_fetch(NULL, mdname, NULL);
+	if (!md) return 0;
+
+	if (!oc->mdctx) oc->mdctx = EVP_MD_CTX_new();
+	ret = oc->mdctx && (EVP_DigestInit_ex2(oc->mdctx, md, NULL) == 1);
+	EVP_MD_free(md);
+	if (!ret) return 0;
+
+	return pkey_ctx_set_params(oc, params);
+}
+
+static int pkey_digest_sign_update(void *ctx, unsigned char const *data, size_t datalen)
+{
+	pkey_op_ctx_t *oc = ctx;
+
+	if (!oc->mdctx) return 0;
+
+	return EVP_DigestUpdate(oc->mdctx, data, datalen);
+}
+
+static int pkey_digest_sign_final(void *ctx, unsigned char *sig, size_t *siglen, size_t sigsize)
+{
+	pkey_op_ctx_t	*oc = ctx;
+	uint8_t		digest[EVP_MAX_MD_SIZE];
+	unsigned int	digest_len;
+	int		size;
+
+	if (!oc->mdctx) return 0;
+
+	if (!sig) {
+		size = EVP_PKEY_get_size(oc->key->pkey);
+		if (size <= 0) return 0;
+		*siglen = size;
+		return 1;
+	}
+
+	if (EVP_DigestFinal_ex(oc->mdctx, digest, &digest_len) != 1) return 0;
+
+	return pkey_op_run(PKEY_OP_SIGN, oc->pctx, sig, siglen, sigsize, digest, digest_len);
+}
+
+static OSSL_DISPATCH const pkey_signature[] = {
+	{ OSSL_FUNC_SIGNATURE_NEWCTX, (void (*)(void))pkey_ctx_new },
+	{ OSSL_FUNC_SIGNATURE_FREECTX, (void (*)(void))pkey_ctx_free },
+	{ OSSL_FUNC_SIGNATURE_DUPCTX, (void (*)(void))pkey_ctx_dup },
+	{ OSSL_FUNC_SIGNATURE_SIGN_INIT, (void (*)(void))pkey_sign_init },
+	{ OSSL_FUNC_SIGNATURE_SIGN, (void (*)(void))pkey_sign },
+	{ OSSL_FUNC_SIGNATURE_DIGEST_SIGN_INIT, (void (*)(void))pkey_digest_sign_init },
+	{ OSSL_FUNC_SIGNATURE_DIGEST_SIGN_UPDATE, (void (*)(void))pkey_digest_sign_update },
+	{ OSSL_FUNC_SIGNATURE_DIGEST_SIGN_FINAL, (void (*)(void))pkey_digest_sign_final },
+	{ OSSL_FUNC_SIGNATURE_GET_CTX_PARAMS, (void (*)(void))pkey_ctx_get_params },
+	{ OSSL_FUNC_SIGNATURE_GETTABLE_CTX_PARAMS, (void (*)(void))pkey_ctx_gettable_params },
+	{ OSSL_FUNC_SIGNATURE_SET_CTX_PARAMS, (void (*)(void))pkey_ctx_set_params },
+	{ OSSL_FUNC_SIGNATURE_SETTABLE_CTX_PARAMS, (void (*)(void))pkey_ctx_settable_params },
+	{ 0, NULL }
+};
+
+static int pkey_decrypt_init(void *ctx, void *provkey, OSSL_PARAM const params[])
+{
+	return pkey_ctx_init(ctx, provkey, PKEY_OP_DECRYPT, params);
+}
+
+static int pkey_decrypt(void *ctx, unsigned char *out, size_t *outlen, size_t outsize,
+			unsigned char const *in, size_t inlen)
+{
+	pkey_op_ctx_t *oc = ctx;
+
+	if (!out) return EVP_PKEY_decrypt(oc->pctx, NULL, outlen, in, inlen);
+
+	return pkey_op_run(PKEY_OP_DECRYPT, oc->pctx, out, outlen, outsize, in, inlen);
+}
+
+static OSSL_DISPATCH const pkey_asym_cipher[] = {
+	{ OSSL_FUNC_ASYM_CIPHER_NEWCTX, (void (*)(void))pkey_asym_ctx_new },
+	{ OSSL_FUNC_ASYM_CIPHER_FREECTX, (void (*)(void))pkey_ctx_free },
+	{ OSSL_FUNC_ASYM_CIPHER_DUPCTX, (void (*)(void))pkey_ctx_dup },
+	{ OSSL_FUNC_ASYM_CIPHER_DECRYPT_INIT, (void (*)(void))pkey_decrypt_init },
+	{ OSSL_FUNC_ASYM_CIPHER_DECRYPT, (void (*)(void))pkey_decrypt },
+	{ OSSL_FUNC_ASYM_CIPHER_GET_CTX_PARAMS, (void (*)(void))pkey_ctx_get_params },
+	{ OSSL_FUNC_ASYM_CIPHER_GETTABLE_CTX_PARAMS, (void (*)(void))pkey_ctx_gettable_params },
+	{ OSSL_FUNC_ASYM_CIPHER_SET_CTX_PARAMS, (void (*)(void))pkey_ctx_set_params },
+	{ OSSL_FUNC_ASYM_CIPHER_SETTABLE_CTX_PARAMS, (void (*)(void))pkey_ctx_settable_params },
+	{ 0, NULL }
+};
+
+/*
+ *	Names must include the aliases libssl uses to identify key types.
+ */
+static OSSL_ALGORITHM const pkey_keymgmt_algs[] = {
+	{ "RSA:rsaEncryption:1.2.840.113549.1.1.1", "", pkey_keymgmt_rsa, NULL },
+	{ "EC:id-ecPublicKey:1.2.840.10045.2.1", "", pkey_keymgmt_ec, NULL },
+	{ NULL, NULL, NULL, NULL }
+};
+
+static OSSL_ALGORITHM const pkey_signature_algs[] = {
+	{ "RSA:rsaEncryption:1.2.840.113549.1.1.1", "", pkey_signature, NULL },
+	{ "ECDSA", "", pkey_signature, NULL },
+	{ NULL, NULL, NULL, NULL }
+};
+
+static OSSL_ALGORITHM const pkey_asym_cipher_algs[] = {
+	{ "RSA:rsaEncryption:1.2.840.113549.1.1.1", "", pkey_asym_cipher, NULL },
+	{ NULL, NULL, NULL, NULL }
+};
+
+static OSSL_ALGORITHM const *pkey_provider_query(UNUSED void *provctx, int operation_id, int *no_cache)
+{
+	*no_cache = 0;
+
+	switch (operation_id) {
+	case OSSL_OP_KEYMGMT:
+		return pkey_keymgmt_algs;
+
+	case OSSL_OP_SIGNATURE:
+		return pkey_signature_algs;
+
+	case OSSL_OP_ASYM_CIPHER:
+		return pkey_asym_cipher_algs;
+
+	default:
+		return NULL;
+	}
+}
+
+static OSSL_DISPATCH const pkey_provider_dispatch[] = {
+	{ OSSL_FUNC_PROVIDER_QUERY_OPERATION, (void (*)(void))pkey_provider_query },
+	{ 0, NULL }
+};
+
+static int pkey_provider_init(UNUSED OSSL_CORE_HANDLE const *handle, UNUSED OSSL_DISPATCH const *in,
+			      OSSL_DISPATCH const **out, void **provctx)
+{
+	*out = pkey_provider_dispatch;
+	*provctx = NULL;
+
+	return 1;
+}
+
+/** Copy a private key into the offload provider
+ *
+ * Keys of types the provider doesn't support are not copied.
+ *
+ * @param[in] pkey	to copy.
+ * @return
+ *	- A new key which performs private key operations on a crypto thread.
+ *	  Must be freed with EVP_PKEY_free.
+ *	- NULL if offloading is disabled, or the key type isn't supported.
+ */
+EVP_PKEY *fr_tls_pkey_wrap(EVP_PKEY *pkey)
+{
+	EVP_PKEY_CTX	*ctx;
+	EVP_PKEY	*out = NULL;
+	OSSL_PARAM	*params = NULL;
+	char const	*name;
+
+	if (!pkey_libctx) return NULL;
+
+	if (EVP_PKEY_is_a(pkey, "RSA")) {
+		name = "RSA";
+	} else if (EVP_PKEY_is_a(pkey, "EC")) {
+		name = "EC";
+	} else {
+		return NULL;
+	}
+
+	if (EVP_PKEY_todata(pkey, EVP_PKEY_KEYPAIR, &params) != 1) return NULL;
+
+	ctx = EVP_PKEY_CTX_new_from_name(pkey_libctx, name, NULL);
+	if (ctx && (EVP_PKEY_fromdata_init(ctx) == 1)) {
+		if (EVP_PKEY_fromdata(ctx, &out, EVP_PKEY_KEYPAIR, params) != 1) out = NULL;
+	}
+	EVP_PKEY_CTX_free(ctx);
+	OSSL_PARAM_free(params);
+
+	return out;
+}
+
+/** Mark the start of a section of the handshake where key operations can be offloaded
+ *
+ * @param[in] tls_session	whose handshake is being continued.
+ * @param[in] request		the handshake is running for.  Marked as runnable
+ *				when an offloaded operation completes.
+ */
+void fr_tls_pkey_session_enter(fr_tls_session_t *tls_session, request_t *request)
+{
+	pkey_tls_session = tls_session;
+	pkey_request = request;
+}
+
+/** Mark the end of a section of the handshake where key operations can be offloaded
+ *
+ */
+void fr_tls_pkey_session_leave(void)
+{
+	pkey_tls_session = NULL;
+	pkey_request = NULL;
+}
+
+/** Whether the session is waiting for a crypto thread to complete an operation
+ *
+ * @param[in] tls_session	to check.
+ * @return
+ *	- true if the request should yield until the operation completes.
+ *	- false if no operation is pending.
+ */
+bool fr_tls_pkey_op_pending(fr_tls_session_t *tls_session)
+{
+	return tls_session->pkey_op && !tls_session->pkey_op->done;
+}
+
+/** Wait for outstanding operations, so crypto threads don't reference freed memory
+ *
+ */
+static int _pkey_thread_free(fr_tls_pkey_thread_t *thread)
+{
+	fr_tls_pkey_op_t *op;
+
+	pthread_mutex_lock(&thread->mutex);
+	while (thread->inflight > 0) pthread_cond_wait(&thread->cond, &thread->mutex);
+	pthread_mutex_unlock(&thread->mutex);
+
+	/*
+	 *	Anything completed but not processed
+	 *	belongs to requests which are gone.
+	 */
+	while ((op = fr_dlist_pop_head(&thread->complete))) pkey_op_free(op);
+
+	pthread_mutex_destroy(&thread->mutex);
+	pthread_cond_destroy(&thread->cond);
+
+	if (pkey_thread == thread) pkey_thread = NULL;
+
+	return 0;
+}
+
+/** Setup a worker to receive the results of offloaded operations
+ *
+ * @param[in] ctx	to allocate thread state in.  Should be freed when the worker exits.
+ * @param[in] el	the worker's event list.
+ * @return
+ *	- 0 on success (or if offloading is disabled).
+ *	- -1 on failure.
+ */
+int fr_tls_pkey_thread_init(TALLOC_CTX *ctx, fr_event_list_t *el)
+{
+	fr_tls_pkey_thread_t *thread;
+
+	if ((pkey_pool.num_threads == 0) || pkey_thread) return 0;
+
+	MEM(thread = talloc_zero(ctx, fr_tls_pkey_thread_t));
+	thread->el = el;
+	pthread_mutex_init(&thread->mutex, NULL);
+	pthread_cond_init(&thread->cond, NULL);
+	fr_dlist_init(&thread->complete, fr_tls_pkey_op_t, entry);
+	talloc_set_destructor(thread, _pkey_thread_free);
+
+	if (fr_event_user_insert(thread, el, &thread->ev, false, _pkey_thread_complete, thread) < 0) {
+		PERROR("Failed registering private key offload event");
+		talloc_free(thread);
+		return -1;
+	}
+
+	pkey_thread = thread;
+
+	return 0;
+}
+
+/** Start the crypto threads, and load the offload provider
+ *
+ * Must be called before any TLS contexts are created, so that their keys
+ * can be copied into the provider.
+ *
+ * @param[in] num_threads	to start.  If 0, private key operations
+ *				are performed on the worker threads.
+ * @return
+ *	- 0 on success.
+ *	- -1 on failure.
+ */
+int fr_tls_pkey_pool_start(unsigned int num_threads)
+{
+	unsigned int	i;
+	int		ret;
+
+	if ((num_threads == 0) || pkey_libctx) return 0;
+
+	pkey_libctx = OSSL_LIB_CTX_new();
+	if (!pkey_libctx) {
+		fr_tls_log(NULL, "Failed allocating library context for private key offload");
+		return -1;
+	}
+
+	if ((OSSL_PROVIDER_add_builtin(pkey_libctx, PKEY_PROVIDER_NAME, pkey_provider_init) != 1) ||
+	    !(pkey_provider = OSSL_PROVIDER_load(pkey_libctx, PKEY_PROVIDER_NAME))) {
+		fr_tls_log(NULL, "Failed loading private key offload provider");
+	error:
+		fr_tls_pkey_pool_stop();
+		return -1;
+	}
+
+	fr_dlist_init(&pkey_pool.queue, fr_tls_pkey_op_t, entry);
+	pkey_pool.stop = false;
+
+	MEM(pkey_pool.threads = talloc_zero_array(NULL, pthread_t, num_threads));
+	for (i = 0; i < num_threads; i++) {
+		ret = pthread_create(&pkey_pool.threads[i], NULL, pkey_pool_thread, NULL);
+		if (ret != 0) {
+			ERROR("Failed creating private key offload thread: %s", fr_syserror(ret));
+			goto error;
+		}
+		pkey_pool.num_threads++;
+	}
+
+	DEBUG2("Started %u private key offload threads", num_threads);
+
+	return 0;
+}
+
+/** Stop the crypto threads
+ *
+ * Any operations still queued are never performed.
+ */
+void fr_tls_pkey_pool_stop(void)
+{
+	unsigned int i;
+
+	if (pkey_pool.threads) {
+		pthread_mutex_lock(&pkey_pool.mutex);
+		pkey_pool.stop = true;
+		pthread_cond_broadcast(&pkey_pool.cond);
+		pthread_mutex_unlock(&pkey_pool.mutex);
+
+		for (i = 0; i < pkey_pool.num_threads; i++) pthread_join(pkey_pool.threads[i], NULL);
+		TALLOC_FREE(pkey_pool.threads);
+		pkey_pool.num_threads = 0;
+	}
+
+	if (pkey_provider) {
+		OSSL_PROVIDER_unload(pkey_provider);
+		pkey_provider = NULL;
+	}
+
+	if (pkey_libctx) {
+		OSSL_LIB_CTX_free(pkey_libctx);
+		pkey_libctx = NULL;
+	}
+}
+#endif /* WITH_TLS */
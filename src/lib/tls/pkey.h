@@ -0,0 +1,61 @@
+#pragma once
+/*
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+#ifdef WITH_TLS
+/**
+ * $Id$
+ *
+ * @file lib/tls/pkey.h
+ * @brief Offload private key operations to a pool of crypto threads.
+ *
+ * @copyright 2024 The FreeRADIUS server project
+ */
+RCSIDH(pkey_h, "$Id$")
+
+#include "openssl_user_macros.h"
+
+#include <openssl/evp.h>
+
+#include <freeradius-devel/server/request.h>
+#include <freeradius-devel/util/event.h>
+
+/** A private key operation being performed by a crypto thread
+ *
+ */
+typedef struct fr_tls_pkey_op_s fr_tls_pkey_op_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int		fr_tls_pkey_pool_start(unsigned int num_threads);
+
+void		fr_tls_pkey_pool_stop(void);
+
+int		fr_tls_pkey_thread_init(TALLOC_CTX *ctx, fr_event_list_t *el);
+
+EVP_PKEY	*fr_tls_pkey_wrap(EVP_PKEY *pkey);
+
+void		fr_tls_pkey_session_enter(fr_tls_session_t *tls_session, request_t *request);
+
+void		fr_tls_pkey_session_leave(void);
+
+bool		fr_tls_pkey_op_pending(fr_tls_session_t *tls_session);
+
+#ifdef __cplusplus
+}
+#endif
+#endif /* WITH_TLS */
@@ -0,0 +1,251 @@
+/*
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+/** Tests for private key offload
+ *
+ * @file src/lib/tls/pkey_tests.c
+ *
+ * @copyright 2024 The FreeRADIUS server project
+ */
+#include <freeradius-devel/util/acutest.h>
+#include <freeradius-devel/util/acutest_helpers.h>
+
+#include <freeradius-devel/tls/base.h>
+#include <freeradius-devel/util/event.h>
+
+#include <openssl/async.h>
+#include <openssl/ec.h>
+#include <openssl/rsa.h>
+
+static uint8_t const	tbs[] = "The quick brown fox jumps over the lazy dog";
+
+/** Arguments for a signing operation run inside an async job
+ *
+ */
+typedef struct {
+	EVP_PKEY		*pkey;		//!< Key to sign with.
+	uint8_t			*sig;		//!< Where to write the signature.
+	size_t			*siglen;	//!< In: size of sig.  Out: length of the signature.
+} pkey_test_sign_t;
+
+static int pkey_test_sign(EVP_PKEY *pkey, uint8_t *sig, size_t *siglen)
+{
+	EVP_MD_CTX	*mdctx;
+	int		ret;
+
+	mdctx = EVP_MD_CTX_new();
+	if (!mdctx) return 0;
+
+	ret = (EVP_DigestSignInit(mdctx, NULL, EVP_sha256(), NULL, pkey) == 1) &&
+	      (EVP_DigestSign(mdctx, sig, siglen, tbs, sizeof(tbs)) == 1);
+	EVP_MD_CTX_free(mdctx);
+
+	return ret;
+}
+
+static int pkey_test_verify(EVP_PKEY *pkey, uint8_t const *sig, size_t siglen)
+{
+	EVP_MD_CTX	*mdctx;
+	int		ret;
+
+	mdctx = EVP_MD_CTX_new();
+	if (!mdctx) return 0;
+
+	ret = (EVP_DigestVerifyInit(mdctx, NULL, EVP_sha256(), NULL, pkey) == 1) &&
+	      (EVP_DigestVerify(mdctx, sig, siglen, tbs, sizeof(tbs)) == 1);
+	EVP_MD_CTX_free(mdctx);
+
+	return ret;
+}
+
+static int _pkey_test_sign_job(void *arg)
+{
+	pkey_test_sign_t *args = *(pkey_test_sign_t **)arg;
+
+	return pkey_test_sign(args->pkey, args->sig, args->siglen);
+}
+
+static EVP_PKEY *pkey_test_key(char const *type)
+{
+	if (strcmp(type, "RSA") == 0) return EVP_RSA_gen(2048);
+
+	return EVP_EC_gen("P-256");
+}
+
+static void pkey_test_setup(void)
+{
+	TEST_CHECK(fr_tls_pkey_pool_start(2) == 0);
+}
+
+/** Sign outside of an async job, which must be done on the calling thread
+ *
+ */
+static void pkey_test_sync(char const *type)
+{
+	EVP_PKEY		*pkey, *offload;
+	uint8_t			sig[1024];
+	size_t			siglen = sizeof(sig);
+	fr_tls_session_t	*tls_session;
+	pkey_test_sign_t	args = { .sig = sig, .siglen = &siglen }, *args_p = &args;
+	ASYNC_JOB		*job = NULL;
+	ASYNC_WAIT_CTX		*wait_ctx;
+	int			ret = 0;
+
+	pkey_test_setup();
+
+	pkey = pkey_test_key(type);
+	TEST_ASSERT(pkey != NULL);
+
+	offload = fr_tls_pkey_wrap(pkey);
+	TEST_CHECK(offload != NULL);
+	TEST_MSG("Failed wrapping %s key", type);
+	TEST_ASSERT(offload != NULL);
+
+	/*
+	 *	No worker state, and no session.
+	 */
+	TEST_CASE("Sign with no async job");
+	TEST_CHECK(pkey_test_sign(offload, sig, &siglen) == 1);
+	TEST_CHECK(pkey_test_verify(pkey, sig, siglen) == 1);
+
+	/*
+	 *	In an async job, but in a part of the handshake
+	 *	which can't be paused.  The job must run to
+	 *	completion without yielding.
+	 */
+	TEST_CASE("Sign in an async job which can't pause");
+	tls_session = talloc_zero(NULL, fr_tls_session_t);
+	tls_session->can_pause = false;
+	fr_tls_pkey_session_enter(tls_session, NULL);
+
+	wait_ctx = ASYNC_WAIT_CTX_new();
+	args.pkey = offload;
+	siglen = sizeof(sig);
+	TEST_CHECK(ASYNC_start_job(&job, wait_ctx, &ret, _pkey_test_sign_job, &args_p, sizeof(args_p)) == ASYNC_FINISH);
+	TEST_CHECK(ret == 1);
+	TEST_CHECK(!fr_tls_pkey_op_pending(tls_session));
+	TEST_CHECK(pkey_test_verify(pkey, sig, siglen) == 1);
+
+	fr_tls_pkey_session_leave();
+	ASYNC_WAIT_CTX_free(wait_ctx);
+	talloc_free(tls_session);
+
+	EVP_PKEY_free(offload);
+	EVP_PKEY_free(pkey);
+
+	fr_tls_pkey_pool_stop();
+}
+
+/** Sign in an async job which can pause, so the operation goes to a crypto thread
+ *
+ */
+static void pkey_test_offload(char const *type)
+{
+	TALLOC_CTX		*ctx;
+	fr_event_list_t		*el;
+	EVP_PKEY		*pkey, *offload;
+	uint8_t			sig[1024];
+	size_t			siglen = sizeof(sig);
+	fr_tls_session_t	*tls_session;
+	pkey_test_sign_t	args = { .sig = sig, .siglen = &siglen }, *args_p = &args;
+	ASYNC_JOB		*job = NULL;
+	ASYNC_WAIT_CTX		*wait_ctx;
+	int			ret = 0, i;
+
+	pkey_test_setup();
+
+	ctx = talloc_init_const("pkey_test");
+	el = fr_event_list_alloc(ctx, NULL, NULL);
+	TEST_ASSERT(el != NULL);
+	TEST_CHECK(fr_tls_pkey_thread_init(ctx, el) == 0);
+
+	pkey = pkey_test_key(type);
+	TEST_ASSERT(pkey != NULL);
+
+	offload = fr_tls_pkey_wrap(pkey);
+	TEST_ASSERT(offload != NULL);
+
+	tls_session = talloc_zero(ctx, fr_tls_session_t);
+	tls_session->can_pause = true;
+	fr_tls_pkey_session_enter(tls_session, NULL);
+
+	wait_ctx = ASYNC_WAIT_CTX_new();
+	args.pkey = offload;
+
+	/*
+	 *	The job must pause waiting for the crypto
+	 *	thread, and be resumable once the worker's
+	 *	event loop has processed the completion.
+	 */
+	TEST_CASE("Job pauses while the operation is offloaded");
+	TEST_CHECK(ASYNC_start_job(&job, wait_ctx, &ret, _pkey_test_sign_job, &args_p, sizeof(args_p)) == ASYNC_PAUSE);
+	TEST_CHECK(tls_session->pkey_op != NULL);
+
+	TEST_CASE("Completion is delivered via the worker's event list");
+	for (i = 0; (i < 100) && fr_tls_pkey_op_pending(tls_session); i++) {
+		if (fr_event_corral(el, fr_time(), true) > 0) fr_event_service(el);
+	}
+	TEST_CHECK(!fr_tls_pkey_op_pending(tls_session));
+	TEST_MSG("Crypto thread didn't complete the operation");
+
+	TEST_CASE("Job completes with a valid signature");
+	TEST_CHECK(ASYNC_start_job(&job, wait_ctx, &ret, _pkey_test_sign_job, &args_p, sizeof(args_p)) == ASYNC_FINISH);
+	TEST_CHECK(ret == 1);
+	TEST_CHECK(tls_session->pkey_op == NULL);
+	TEST_CHECK(pkey_test_verify(pkey, sig, siglen) == 1);
+
+	fr_tls_pkey_session_leave();
+	ASYNC_WAIT_CTX_free(wait_ctx);
+
+	EVP_PKEY_free(offload);
+	EVP_PKEY_free(pkey);
+
+	/*
+	 *	Waits for anything still in flight
+	 */
+	talloc_free(ctx);
+
+	fr_tls_pkey_pool_stop();
+}
+
+static void test_sync_rsa(void)
+{
+	pkey_test_sync("RSA");
+}
+
+static void test_sync_ec(void)
+{
+	pkey_test_sync("EC");
+}
+
+static void test_offload_rsa(void)
+{
+	pkey_test_offload("RSA");
+}
+
+static void test_offload_ec(void)
+{
+	pkey_test_offload("EC");
+}
+
+TEST_LIST = {
+	{ "sync_rsa",		test_sync_rsa },
+	{ "sync_ec",		test_sync_ec },
+	{ "offload_rsa",	test_offload_rsa },
+	{ "offload_ec",		test_offload_ec },
+
+	{ NULL }
+};
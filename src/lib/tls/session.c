@@ -1361,8 +1361,10 @@ static unlang_action_t tls_session_async_handshake_cont(rlm_rcode_t *p_result, i
 	 *	been called before this function.
 	 */
 	tls_session->can_pause = true;
+	fr_tls_pkey_session_enter(tls_session, request);
 	tls_session->last_ret = SSL_read(tls_session->ssl, tls_session->clean_out.data + tls_session->clean_out.used,
 					 sizeof(tls_session->clean_out.data) - tls_session->clean_out.used);
+	fr_tls_pkey_session_leave();
 	tls_session->can_pause = false;
 	if (tls_session->last_ret > 0) {
 		tls_session->clean_out.used += tls_session->last_ret;
@@ -1424,7 +1426,7 @@ DIAG_ON(DIAG_UNKNOWN_PRAGMAS)
 	 *	asynchronously.
 	 */
 	switch (err = SSL_get_error(tls_session->ssl, tls_session->last_ret)) {
-	case SSL_ERROR_WANT_ASYNC:	/* Certification validation or cache loads */
+	case SSL_ERROR_WANT_ASYNC:	/* Certification validation, cache loads or private key operations */
 	{
 		unlang_action_t ua;
 
@@ -1456,6 +1458,14 @@ DIAG_ON(DIAG_UNKNOWN_PRAGMAS)
 			break;
 		}
 
+		/*
+		 *	Private key operations are performed by
+		 *	crypto threads, and other callbacks may be
+		 *	waiting on I/O.  We'll be marked runnable
+		 *	when the operation completes.
+		 */
+		if (fr_tls_pkey_op_pending(tls_session) || tls_session->async_wait) return UNLANG_ACTION_YIELD;
+
 		/*
 		 *	Next service any pending certificate
 		 *	validation actions.
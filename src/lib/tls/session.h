@@ -37,6 +37,7 @@ typedef struct fr_tls_session_s fr_tls_session_t;
 #include "cache.h"
 #include "conf.h"
 #include "index.h"
+#include "pkey.h"
 #include "verify.h"
 
 #ifdef __cplusplus
@@ -138,6 +139,10 @@ struct fr_tls_session_s {
 	bool			client_cert_ok;			//!< whether or not the client certificate was validated
 	bool			can_pause;			//!< If true, it's ok to pause the request
 								///< using the OpenSSL async API.
+	fr_tls_pkey_op_t	*pkey_op;			//!< Private key operation being performed
+								///< by a crypto thread.
+	bool			async_wait;			//!< Paused waiting for an event which will mark
+								///< the request as runnable.
 
 	uint8_t			alerts_sent;
 	bool			pending_alert;
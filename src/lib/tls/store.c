@@ -0,0 +1,276 @@
+/*
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+/**
+ * $Id$
+ *
+ * @file tls/store.c
+ * @brief In-memory session store shared between worker threads.
+ *
+ * Serialised SSL_SESSIONs are keyed on their session ID.  The store is
+ * split into shards, each with its own mutex, tree and LRU list, so that
+ * workers resuming different sessions rarely contend on the same lock.
+ * Session IDs are random, so hashing them spreads entries evenly.
+ *
+ * Each shard holds at most max_entries / shards sessions.  When a shard is
+ * full the least recently used session is evicted.  Expired sessions are
+ * removed when they're next looked up, or when they reach the head of the
+ * LRU list.
+ *
+ * @copyright 2024 The FreeRADIUS server project
+ */
+RCSID("$Id$")
+USES_APPLE_DEPRECATED_API	/* OpenSSL API has been deprecated by Apple */
+
+#ifdef WITH_TLS
+#define LOG_PREFIX "tls"
+
+#include <freeradius-devel/util/debug.h>
+#include <freeradius-devel/util/dlist.h>
+#include <freeradius-devel/util/hash.h>
+#include <freeradius-devel/util/math.h>
+#include <freeradius-devel/util/rb.h>
+
+#include <openssl/ssl.h>
+#include <pthread.h>
+
+#include "store.h"
+
+#define FR_TLS_STORE_SHARDS	16		//!< Must be a power of 2.
+
+typedef struct {
+	pthread_mutex_t		mutex;			//!< Protects everything below.
+	fr_rb_tree_t		*tree;			//!< Sessions keyed on ID.
+	fr_dlist_head_t		lru;			//!< Least recently used at the head.
+} fr_tls_store_shard_t;
+
+struct fr_tls_store_s {
+	uint32_t		max_entries;		//!< Per shard.
+	fr_tls_store_shard_t	shard[FR_TLS_STORE_SHARDS];
+};
+
+typedef struct {
+	fr_rb_node_t		node;			//!< Entry in the shard's tree.
+	fr_dlist_t		entry;			//!< Entry in the shard's LRU list.
+
+	uint8_t			id[SSL_MAX_SSL_SESSION_ID_LENGTH];	//!< Session ID.
+	size_t			id_len;			//!< Length of the session ID.
+
+	uint8_t			*data;			//!< DER encoded SSL_SESSION.
+	fr_time_t		expires;		//!< When the session can no longer be resumed.
+} fr_tls_store_entry_t;
+
+static int8_t tls_store_entry_cmp(void const *one, void const *two)
+{
+	fr_tls_store_entry_t const *a = one, *b = two;
+	int ret;
+
+	ret = CMP(a->id_len, b->id_len);
+	if (ret != 0) return ret;
+
+	ret = memcmp(a->id, b->id, a->id_len);
+	return CMP(ret, 0);
+}
+
+static inline CC_HINT(always_inline)
+fr_tls_store_shard_t *tls_store_shard(fr_tls_store_t *store, uint8_t const *id, size_t id_len)
+{
+	return &store->shard[fr_hash(id, id_len) & (FR_TLS_STORE_SHARDS - 1)];
+}
+
+/** Remove an entry from a shard
+ *
+ * Must be called with the shard's mutex held.
+ */
+static inline CC_HINT(always_inline)
+void tls_store_entry_remove(fr_tls_store_shard_t *shard, fr_tls_store_entry_t *entry)
+{
+	fr_dlist_remove(&shard->lru, entry);
+	fr_rb_delete(shard->tree, entry);
+	talloc_free(entry);
+}
+
+static int _tls_store_free(fr_tls_store_t *store)
+{
+	size_t i;
+
+	for (i = 0; i < NUM_ELEMENTS(store->shard); i++) pthread_mutex_destroy(&store->shard[i].mutex);
+
+	return 0;
+}
+
+/** Allocate a session store
+ *
+ * @param[in] ctx		to allocate the store in.
+ * @param[in] max_entries	Maximum number of sessions to store.
+ * @return
+ *	- A new store.
+ *	- NULL on error.
+ */
+fr_tls_store_t *fr_tls_store_alloc(TALLOC_CTX *ctx, uint32_t max_entries)
+{
+	fr_tls_store_t	*store;
+	size_t		i;
+
+	MEM(store = talloc_zero(ctx, fr_tls_store_t));
+	store->max_entries = ROUND_UP_DIV(max_entries, FR_TLS_STORE_SHARDS);
+
+	for (i = 0; i < NUM_ELEMENTS(store->shard); i++) {
+		fr_tls_store_shard_t *shard = &store->shard[i];
+
+		shard->tree = fr_rb_inline_talloc_alloc(store, fr_tls_store_entry_t, node, tls_store_entry_cmp, NULL);
+		if (!shard->tree) {
+			talloc_free(store);
+			return NULL;
+		}
+		fr_dlist_talloc_init(&shard->lru, fr_tls_store_entry_t, entry);
+		pthread_mutex_init(&shard->mutex, NULL);
+	}
+	talloc_set_destructor(store, _tls_store_free);
+
+	return store;
+}
+
+/** Add a session to the store, replacing any existing session with the same ID
+ *
+ * @param[in] store		to add the session to.
+ * @param[in] id		Session ID.
+ * @param[in] id_len		Length of the session ID.
+ * @param[in] data		DER encoded SSL_SESSION.  Will be copied.
+ * @param[in] data_len		Length of the encoded session.
+ * @param[in] expires		When the session can no longer be resumed.
+ * @return
+ *	- 0 on success.
+ *	- -1 if the session ID is too long.
+ */
+int fr_tls_store_insert(fr_tls_store_t *store, uint8_t const *id, size_t id_len,
+			uint8_t const *data, size_t data_len, fr_time_t expires)
+{
+	fr_tls_store_shard_t	*shard;
+	fr_tls_store_entry_t	find, *entry, *head;
+	fr_time_t		now = fr_time();
+
+	if (unlikely(id_len > sizeof(find.id))) {
+		fr_strerror_printf("Session ID too long, expected <= %zu bytes, got %zu bytes",
+				   sizeof(find.id), id_len);
+		return -1;
+	}
+
+	memcpy(find.id, id, id_len);
+	find.id_len = id_len;
+
+	shard = tls_store_shard(store, id, id_len);
+
+	pthread_mutex_lock(&shard->mutex);
+	entry = fr_rb_find(shard->tree, &find);
+	if (entry) tls_store_entry_remove(shard, entry);
+
+	/*
+	 *	Make space, preferring expired sessions.
+	 */
+	while ((head = fr_dlist_head(&shard->lru)) &&
+	       ((fr_dlist_num_elements(&shard->lru) >= store->max_entries) || fr_time_lteq(head->expires, now))) {
+		tls_store_entry_remove(shard, head);
+	}
+
+	MEM(entry = talloc_zero(shard->tree, fr_tls_store_entry_t));
+	memcpy(entry->id, id, id_len);
+	entry->id_len = id_len;
+	MEM(entry->data = talloc_memdup(entry, data, data_len));
+	entry->expires = expires;
+
+	fr_rb_insert(shard->tree, entry);
+	fr_dlist_insert_tail(&shard->lru, entry);
+	pthread_mutex_unlock(&shard->mutex);
+
+	return 0;
+}
+
+/** Retrieve a copy of a session from the store
+ *
+ * @param[in] ctx		to allocate the copy in.
+ * @param[out] out		Where to write the DER encoded SSL_SESSION.
+ * @param[in] store		to search in.
+ * @param[in] id		Session ID.
+ * @param[in] id_len		Length of the session ID.
+ * @return
+ *	- >0 the length of the encoded session.
+ *	- 0 if no valid session was found.
+ */
+ssize_t fr_tls_store_find(TALLOC_CTX *ctx, uint8_t **out,
+			  fr_tls_store_t *store, uint8_t const *id, size_t id_len)
+{
+	fr_tls_store_shard_t	*shard;
+	fr_tls_store_entry_t	find, *entry;
+	ssize_t			len = 0;
+
+	*out = NULL;
+
+	if (unlikely(id_len > sizeof(find.id))) return 0;
+
+	memcpy(find.id, id, id_len);
+	find.id_len = id_len;
+
+	shard = tls_store_shard(store, id, id_len);
+
+	pthread_mutex_lock(&shard->mutex);
+	entry = fr_rb_find(shard->tree, &find);
+	if (!entry) goto done;
+
+	if (fr_time_lteq(entry->expires, fr_time())) {
+		tls_store_entry_remove(shard, entry);
+		goto done;
+	}
+
+	/*
+	 *	Move to the tail of the LRU list.
+	 */
+	fr_dlist_remove(&shard->lru, entry);
+	fr_dlist_insert_tail(&shard->lru, entry);
+
+	len = talloc_array_length(entry->data);
+	MEM(*out = talloc_memdup(ctx, entry->data, len));
+
+done:
+	pthread_mutex_unlock(&shard->mutex);
+
+	return len;
+}
+
+/** Remove a session from the store
+ *
+ * @param[in] store		to remove the session from.
+ * @param[in] id		Session ID.
+ * @param[in] id_len		Length of the session ID.
+ */
+void fr_tls_store_remove(fr_tls_store_t *store, uint8_t const *id, size_t id_len)
+{
+	fr_tls_store_shard_t	*shard;
+	fr_tls_store_entry_t	find, *entry;
+
+	if (unlikely(id_len > sizeof(find.id))) return;
+
+	memcpy(find.id, id, id_len);
+	find.id_len = id_len;
+
+	shard = tls_store_shard(store, id, id_len);
+
+	pthread_mutex_lock(&shard->mutex);
+	entry = fr_rb_find(shard->tree, &find);
+	if (entry) tls_store_entry_remove(shard, entry);
+	pthread_mutex_unlock(&shard->mutex);
+}
+#endif /* WITH_TLS */
@@ -0,0 +1,50 @@
+#pragma once
+/*
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+#ifdef WITH_TLS
+/**
+ * $Id$
+ *
+ * @file lib/tls/store.h
+ * @brief In-memory session store shared between worker threads.
+ *
+ * @copyright 2024 The FreeRADIUS server project
+ */
+RCSIDH(store_h, "$Id$")
+
+#include <freeradius-devel/util/talloc.h>
+#include <freeradius-devel/util/time.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct fr_tls_store_s fr_tls_store_t;
+
+fr_tls_store_t	*fr_tls_store_alloc(TALLOC_CTX *ctx, uint32_t max_entries);
+
+int		fr_tls_store_insert(fr_tls_store_t *store, uint8_t const *id, size_t id_len,
+				    uint8_t const *data, size_t data_len, fr_time_t expires);
+
+ssize_t		fr_tls_store_find(TALLOC_CTX *ctx, uint8_t **out,
+				  fr_tls_store_t *store, uint8_t const *id, size_t id_len);
+
+void		fr_tls_store_remove(fr_tls_store_t *store, uint8_t const *id, size_t id_len);
+
+#ifdef __cplusplus
+}
+#endif
+#endif /* WITH_TLS */
@@ -0,0 +1,183 @@
+#include <freeradius-devel/util/acutest.h>
+#include <freeradius-devel/util/acutest_helpers.h>
+
+/*
+ *	Gives access to the shards, so we can pick session
+ *	IDs which land in the same one.
+ */
+#include "store.c"
+
+#define STORE_TEST_PER_SHARD	2
+
+static uint8_t const data_a[] = "session a";
+static uint8_t const data_b[] = "session b";
+static uint8_t const data_c[] = "session c";
+
+/** Find session IDs which all hash to the same shard
+ *
+ */
+static void store_test_ids(fr_tls_store_t *store, uint8_t ids[][4], size_t num)
+{
+	fr_tls_store_shard_t	*shard = NULL;
+	uint32_t		i;
+	size_t			found = 0;
+
+	for (i = 0; found < num; i++) {
+		uint8_t id[4];
+
+		memcpy(id, &i, sizeof(id));
+		if (!shard) {
+			shard = tls_store_shard(store, id, sizeof(id));
+		} else if (tls_store_shard(store, id, sizeof(id)) != shard) {
+			continue;
+		}
+		memcpy(ids[found++], id, sizeof(id));
+	}
+}
+
+static fr_tls_store_t *store_test_alloc(TALLOC_CTX *ctx)
+{
+	fr_tls_store_t *store;
+
+	fr_time_start();
+
+	store = fr_tls_store_alloc(ctx, STORE_TEST_PER_SHARD * FR_TLS_STORE_SHARDS);
+	TEST_CHECK(store != NULL);
+	TEST_CHECK(store && (store->max_entries == STORE_TEST_PER_SHARD));
+
+	return store;
+}
+
+static bool store_test_found(fr_tls_store_t *store, uint8_t const *id, uint8_t const *data, size_t data_len)
+{
+	uint8_t	*out;
+	ssize_t	slen;
+	bool	ret;
+
+	slen = fr_tls_store_find(NULL, &out, store, id, 4);
+	if (slen <= 0) return false;
+
+	ret = ((size_t)slen == data_len) && (memcmp(out, data, data_len) == 0);
+	talloc_free(out);
+
+	return ret;
+}
+
+static void test_store_find(void)
+{
+	TALLOC_CTX		*ctx = talloc_init_const("store_test");
+	fr_tls_store_t		*store = store_test_alloc(ctx);
+	uint8_t			ids[2][4];
+	fr_time_t		expires = fr_time_add(fr_time(), fr_time_delta_from_sec(60));
+
+	store_test_ids(store, ids, NUM_ELEMENTS(ids));
+
+	TEST_CASE("Missing session isn't found");
+	TEST_CHECK(!store_test_found(store, ids[0], data_a, sizeof(data_a)));
+
+	TEST_CASE("Inserted session is found");
+	TEST_CHECK(fr_tls_store_insert(store, ids[0], 4, data_a, sizeof(data_a), expires) == 0);
+	TEST_CHECK(store_test_found(store, ids[0], data_a, sizeof(data_a)));
+	TEST_CHECK(!store_test_found(store, ids[1], data_a, sizeof(data_a)));
+
+	TEST_CASE("Inserting with the same ID replaces the session");
+	TEST_CHECK(fr_tls_store_insert(store, ids[0], 4, data_b, sizeof(data_b), expires) == 0);
+	TEST_CHECK(store_test_found(store, ids[0], data_b, sizeof(data_b)));
+	TEST_CHECK(fr_dlist_num_elements(&tls_store_shard(store, ids[0], 4)->lru) == 1);
+
+	TEST_CASE("Removed session isn't found");
+	fr_tls_store_remove(store, ids[0], 4);
+	TEST_CHECK(!store_test_found(store, ids[0], data_b, sizeof(data_b)));
+
+	TEST_CASE("Overlong session IDs are rejected");
+	{
+		uint8_t long_id[SSL_MAX_SSL_SESSION_ID_LENGTH + 1] = { 0 };
+
+		TEST_CHECK(fr_tls_store_insert(store, long_id, sizeof(long_id), data_a, sizeof(data_a), expires) < 0);
+	}
+
+	talloc_free(ctx);
+}
+
+static void test_store_lru(void)
+{
+	TALLOC_CTX		*ctx = talloc_init_const("store_test");
+	fr_tls_store_t		*store = store_test_alloc(ctx);
+	uint8_t			ids[3][4];
+	fr_time_t		expires = fr_time_add(fr_time(), fr_time_delta_from_sec(60));
+
+	store_test_ids(store, ids, NUM_ELEMENTS(ids));
+
+	TEST_CHECK(fr_tls_store_insert(store, ids[0], 4, data_a, sizeof(data_a), expires) == 0);
+	TEST_CHECK(fr_tls_store_insert(store, ids[1], 4, data_b, sizeof(data_b), expires) == 0);
+
+	/*
+	 *	Finding a makes b the least recently used.
+	 */
+	TEST_CASE("Full shard evicts the least recently used session");
+	TEST_CHECK(store_test_found(store, ids[0], data_a, sizeof(data_a)));
+	TEST_CHECK(fr_tls_store_insert(store, ids[2], 4, data_c, sizeof(data_c), expires) == 0);
+
+	TEST_CHECK(store_test_found(store, ids[0], data_a, sizeof(data_a)));
+	TEST_CHECK(!store_test_found(store, ids[1], data_b, sizeof(data_b)));
+	TEST_CHECK(store_test_found(store, ids[2], data_c, sizeof(data_c)));
+	TEST_CHECK(fr_dlist_num_elements(&tls_store_shard(store, ids[0], 4)->lru) == STORE_TEST_PER_SHARD);
+
+	/*
+	 *	Finding a again makes c the least recently used.
+	 */
+	TEST_CASE("Eviction follows the most recent lookups");
+	TEST_CHECK(store_test_found(store, ids[0], data_a, sizeof(data_a)));
+	TEST_CHECK(fr_tls_store_insert(store, ids[1], 4, data_b, sizeof(data_b), expires) == 0);
+	TEST_CHECK(store_test_found(store, ids[0], data_a, sizeof(data_a)));
+	TEST_CHECK(store_test_found(store, ids[1], data_b, sizeof(data_b)));
+	TEST_CHECK(!store_test_found(store, ids[2], data_c, sizeof(data_c)));
+
+	talloc_free(ctx);
+}
+
+static void test_store_expiry(void)
+{
+	TALLOC_CTX		*ctx = talloc_init_const("store_test");
+	fr_tls_store_t		*store = store_test_alloc(ctx);
+	fr_tls_store_shard_t	*shard;
+	uint8_t			ids[3][4];
+	fr_time_t		now = fr_time();
+	fr_time_t		expired = fr_time_sub(now, fr_time_delta_from_sec(1));
+	fr_time_t		expires = fr_time_add(now, fr_time_delta_from_sec(60));
+
+	store_test_ids(store, ids, NUM_ELEMENTS(ids));
+	shard = tls_store_shard(store, ids[0], 4);
+
+	TEST_CASE("Expired session isn't returned, and is removed");
+	TEST_CHECK(fr_tls_store_insert(store, ids[0], 4, data_a, sizeof(data_a), expired) == 0);
+	TEST_CHECK(fr_dlist_num_elements(&shard->lru) == 1);
+	TEST_CHECK(!store_test_found(store, ids[0], data_a, sizeof(data_a)));
+	TEST_CHECK(fr_dlist_num_elements(&shard->lru) == 0);
+
+	/*
+	 *	The expired session is at the head of the
+	 *	LRU list, so inserting b evicts it, even
+	 *	though the shard isn't full.  Inserting c
+	 *	then fills the shard without evicting b.
+	 */
+	TEST_CASE("Insert evicts expired sessions before live ones");
+	TEST_CHECK(fr_tls_store_insert(store, ids[0], 4, data_a, sizeof(data_a), expired) == 0);
+	TEST_CHECK(fr_tls_store_insert(store, ids[1], 4, data_b, sizeof(data_b), expires) == 0);
+	TEST_CHECK(fr_dlist_num_elements(&shard->lru) == 1);
+
+	TEST_CHECK(fr_tls_store_insert(store, ids[2], 4, data_c, sizeof(data_c), expires) == 0);
+	TEST_CHECK(store_test_found(store, ids[1], data_b, sizeof(data_b)));
+	TEST_CHECK(store_test_found(store, ids[2], data_c, sizeof(data_c)));
+	TEST_CHECK(fr_dlist_num_elements(&shard->lru) == 2);
+
+	talloc_free(ctx);
+}
+
+TEST_LIST = {
+	{ "store_find",		test_store_find },
+	{ "store_lru",		test_store_lru },
+	{ "store_expiry",	test_store_expiry },
+
+	{ NULL }
+};
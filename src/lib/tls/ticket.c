@@ -0,0 +1,321 @@
+/*
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+/**
+ * $Id$
+ *
+ * @file tls/ticket.c
+ * @brief Rotating session-ticket keys.
+ *
+ * Time is divided into epochs of `rotation` seconds, counted from the unix
+ * epoch.  The keys for each epoch are derived from a shared secret using
+ * HKDF, with the epoch number as part of the label.  Servers sharing the
+ * secret, and with roughly synchronised clocks, therefore derive the same
+ * keys and can decrypt each other's tickets, without any coordination.
+ *
+ * Tickets are encrypted with the key for the current epoch.  Keys for
+ * previous epochs are kept for as long as tickets issued under them may
+ * still be resumed, and tickets decrypted with them are renewed.  The key
+ * for the next epoch is also accepted, in case a server's clock is ahead
+ * of ours.
+ *
+ * @copyright 2024 The FreeRADIUS server project
+ */
+RCSID("$Id$")
+USES_APPLE_DEPRECATED_API	/* OpenSSL API has been deprecated by Apple */
+
+#ifdef WITH_TLS
+#define LOG_PREFIX "tls"
+
+#include <freeradius-devel/util/debug.h>
+#include <freeradius-devel/util/math.h>
+#include <freeradius-devel/util/nbo.h>
+
+#include <openssl/core_names.h>
+#include <openssl/kdf.h>
+#include <openssl/rand.h>
+#include <pthread.h>
+
+#include "base.h"
+#include "log.h"
+#include "strerror.h"
+#include "ticket.h"
+
+#define TICKET_KEY_CURRENT	1		//!< Index of the key we encrypt with.  keys[0] is for
+						///< the next epoch, and is only used for decryption.
+
+typedef struct {
+	uint8_t			name[16];		//!< Sent in the clear, identifies the key.
+	uint8_t			aes_key[32];		//!< AES-256-CBC key.
+	uint8_t			hmac_key[32];		//!< HMAC-SHA256 key.
+} fr_tls_ticket_key_t;
+
+struct fr_tls_ticket_keys_s {
+	pthread_rwlock_t	lock;			//!< Protects epoch and keys.
+	uint8_t			*secret;		//!< Input to the KDF.
+	int64_t			rotation;		//!< Length of an epoch in seconds.
+	int64_t			epoch;			//!< Epoch keys were last derived for.
+	uint32_t		num_keys;		//!< Number of keys in the ring.
+	fr_tls_ticket_key_t	*keys;			//!< Newest first.  keys[n] is for epoch (epoch + 1 - n).
+};
+
+static inline CC_HINT(always_inline)
+int64_t tls_ticket_keys_epoch(fr_tls_ticket_keys_t const *keys)
+{
+	return fr_unix_time_to_sec(fr_time_to_unix_time(fr_time())) / keys->rotation;
+}
+
+/** Derive the key for a given epoch
+ *
+ */
+static int tls_ticket_key_derive(fr_tls_ticket_key_t *out, fr_tls_ticket_keys_t const *keys, int64_t epoch)
+{
+	EVP_PKEY_CTX	*pkey_ctx;
+	uint8_t		info[sizeof("freeradius-session-ticket-epoch") - 1 + sizeof(uint64_t)];
+	size_t		len = sizeof(*out);
+
+	memcpy(info, "freeradius-session-ticket-epoch", sizeof("freeradius-session-ticket-epoch") - 1);
+	fr_nbo_from_uint64(info + sizeof("freeradius-session-ticket-epoch") - 1, (uint64_t)epoch);
+
+	pkey_ctx = EVP_PKEY_CTX_new_id(EVP_PKEY_HKDF, NULL);
+	if (unlikely(!pkey_ctx) ||
+	    unlikely(EVP_PKEY_derive_init(pkey_ctx) != 1) ||
+	    unlikely(EVP_PKEY_CTX_set_hkdf_md(pkey_ctx, UNCONST(struct evp_md_st *, EVP_sha256())) != 1) ||
+	    unlikely(EVP_PKEY_CTX_set1_hkdf_key(pkey_ctx, keys->secret, talloc_array_length(keys->secret)) != 1) ||
+	    unlikely(EVP_PKEY_CTX_add1_hkdf_info(pkey_ctx, info, sizeof(info)) != 1) ||
+	    unlikely(EVP_PKEY_derive(pkey_ctx, (uint8_t *)out, &len) != 1)) {
+		fr_tls_strerror_printf(NULL);
+		PERROR("Failed deriving session ticket key");
+		if (pkey_ctx) EVP_PKEY_CTX_free(pkey_ctx);
+		return -1;
+	}
+	EVP_PKEY_CTX_free(pkey_ctx);
+
+	return 0;
+}
+
+/** Bring the key ring up to date with the current epoch
+ *
+ * Must be called with the write lock held.
+ */
+static int tls_ticket_keys_update(fr_tls_ticket_keys_t *keys, int64_t epoch)
+{
+	int64_t	shift, i;
+
+	/*
+	 *	We've not derived any keys yet, or all the
+	 *	keys have expired.  Derive the whole ring.
+	 */
+	if ((keys->epoch == INT64_MIN) || ((epoch - keys->epoch) > keys->num_keys)) {
+		shift = keys->num_keys;
+	} else {
+		shift = epoch - keys->epoch;
+	}
+
+	memmove(keys->keys + shift, keys->keys, (keys->num_keys - shift) * sizeof(keys->keys[0]));
+
+	for (i = 0; i < shift; i++) {
+		if (tls_ticket_key_derive(&keys->keys[i], keys, epoch + 1 - i) < 0) {
+			keys->epoch = INT64_MIN;	/* Force a full rederive next time */
+			return -1;
+		}
+	}
+	keys->epoch = epoch;
+
+	DEBUG3("Rotated session-ticket keys, now using epoch %" PRId64, epoch);
+
+	return 0;
+}
+
+/** Take the read lock, rotating keys first if the epoch has changed
+ *
+ */
+static int tls_ticket_keys_rdlock(fr_tls_ticket_keys_t *keys)
+{
+	int64_t epoch = tls_ticket_keys_epoch(keys);
+
+	/*
+	 *	Another thread may have rotated to a later
+	 *	epoch while we were calculating ours, which
+	 *	is fine.  Only ever rotate forwards.
+	 */
+	for (;;) {
+		pthread_rwlock_rdlock(&keys->lock);
+		if (keys->epoch >= epoch) return 0;
+		pthread_rwlock_unlock(&keys->lock);
+
+		pthread_rwlock_wrlock(&keys->lock);
+		if ((keys->epoch < epoch) && (tls_ticket_keys_update(keys, epoch) < 0)) {
+			pthread_rwlock_unlock(&keys->lock);
+			return -1;
+		}
+		pthread_rwlock_unlock(&keys->lock);
+	}
+}
+
+/** Set the HMAC key and digest used to authenticate the ticket
+ *
+ */
+static inline CC_HINT(always_inline)
+int tls_ticket_key_mac_init(EVP_MAC_CTX *hctx, fr_tls_ticket_key_t *key)
+{
+	OSSL_PARAM params[3];
+
+	params[0] = OSSL_PARAM_construct_octet_string(OSSL_MAC_PARAM_KEY, key->hmac_key, sizeof(key->hmac_key));
+	params[1] = OSSL_PARAM_construct_utf8_string(OSSL_MAC_PARAM_DIGEST, UNCONST(char *, "sha256"), 0);
+	params[2] = OSSL_PARAM_construct_end();
+
+	return EVP_MAC_CTX_set_params(hctx, params);
+}
+
+/** Encrypt or decrypt a session ticket
+ *
+ * @return
+ *	- -1 on error, the handshake fails.
+ *	- 0 if we don't have the key for the ticket, a full handshake is performed.
+ *	- 1 if the ticket was decrypted, or we're ready to encrypt a new ticket.
+ *	- 2 if the ticket was decrypted, but a new one should be issued.
+ */
+static int tls_ticket_key_cb(SSL *ssl, unsigned char key_name[16], unsigned char iv[EVP_MAX_IV_LENGTH],
+			     EVP_CIPHER_CTX *cctx, EVP_MAC_CTX *hctx, int enc)
+{
+	fr_tls_ticket_keys_t	*keys = fr_tls_session_conf(ssl)->cache.ticket_keys;
+	fr_tls_ticket_key_t	key;
+	uint32_t		i;
+	int			ret = -1;
+
+	if (tls_ticket_keys_rdlock(keys) < 0) return -1;
+
+	if (enc) {
+		key = keys->keys[TICKET_KEY_CURRENT];
+		pthread_rwlock_unlock(&keys->lock);
+
+		memcpy(key_name, key.name, sizeof(key.name));
+		if (RAND_bytes(iv, EVP_CIPHER_get_iv_length(EVP_aes_256_cbc())) != 1) goto error;
+		if (EVP_EncryptInit_ex(cctx, EVP_aes_256_cbc(), NULL, key.aes_key, iv) != 1) goto error;
+		if (tls_ticket_key_mac_init(hctx, &key) != 1) goto error;
+
+		ret = 1;
+		goto done;
+	}
+
+	for (i = 0; i < keys->num_keys; i++) {
+		if (memcmp(key_name, keys->keys[i].name, sizeof(keys->keys[i].name)) == 0) break;
+	}
+	if (i == keys->num_keys) {
+		pthread_rwlock_unlock(&keys->lock);
+		DEBUG3("Session ticket encrypted with unknown or expired key");
+		return 0;
+	}
+	key = keys->keys[i];
+	pthread_rwlock_unlock(&keys->lock);
+
+	if (tls_ticket_key_mac_init(hctx, &key) != 1) goto error;
+	if (EVP_DecryptInit_ex(cctx, EVP_aes_256_cbc(), NULL, key.aes_key, iv) != 1) goto error;
+
+	/*
+	 *	Re-issue tickets encrypted with old keys,
+	 *	so clients pick up the current key.
+	 */
+	ret = (i > TICKET_KEY_CURRENT) ? 2 : 1;
+	goto done;
+
+error:
+	fr_tls_strerror_printf(NULL);
+	PERROR("Failed initialising session ticket %s", enc ? "encryption" : "decryption");
+
+done:
+	OPENSSL_cleanse(&key, sizeof(key));
+
+	return ret;
+}
+
+static int _tls_ticket_keys_free(fr_tls_ticket_keys_t *keys)
+{
+	OPENSSL_cleanse(keys->keys, keys->num_keys * sizeof(keys->keys[0]));
+	OPENSSL_cleanse(keys->secret, talloc_array_length(keys->secret));
+	pthread_rwlock_destroy(&keys->lock);
+
+	return 0;
+}
+
+/** Allocate a ring of rotating session-ticket keys
+ *
+ * @param[in] ctx		to allocate the ring in.
+ * @param[in] secret		Input to the KDF.  Servers using the same secret
+ *				generate the same keys.
+ * @param[in] secret_len	Length of the secret.
+ * @param[in] rotation		How often a new key is used to encrypt tickets.
+ * @param[in] lifetime		How long a ticket can be resumed for.  Determines
+ *				how many previous keys are kept.
+ * @return
+ *	- A new ring of keys.
+ *	- NULL on error.
+ */
+fr_tls_ticket_keys_t *fr_tls_ticket_keys_alloc(TALLOC_CTX *ctx, uint8_t const *secret, size_t secret_len,
+					       fr_time_delta_t rotation, fr_time_delta_t lifetime)
+{
+	fr_tls_ticket_keys_t	*keys;
+	int64_t			num_keys;
+
+	fr_assert(fr_time_delta_to_sec(rotation) > 0);
+
+	/*
+	 *	Next, current, and enough previous keys to
+	 *	cover the lifetime of a ticket.
+	 */
+	num_keys = ROUND_UP_DIV(fr_time_delta_to_sec(lifetime), fr_time_delta_to_sec(rotation)) + 2;
+	if (num_keys > FR_TLS_TICKET_KEYS_MAX) num_keys = FR_TLS_TICKET_KEYS_MAX;
+
+	MEM(keys = talloc_zero(ctx, fr_tls_ticket_keys_t));
+	MEM(keys->secret = talloc_memdup(keys, secret, secret_len));
+	MEM(keys->keys = talloc_zero_array(keys, fr_tls_ticket_key_t, num_keys));
+	keys->num_keys = num_keys;
+	keys->rotation = fr_time_delta_to_sec(rotation);
+	keys->epoch = INT64_MIN;
+	pthread_rwlock_init(&keys->lock, NULL);
+	talloc_set_destructor(keys, _tls_ticket_keys_free);
+
+	/*
+	 *	Derive the initial keys now, so
+	 *	misconfigurations are caught on startup.
+	 */
+	if (tls_ticket_keys_update(keys, tls_ticket_keys_epoch(keys)) < 0) {
+		talloc_free(keys);
+		return NULL;
+	}
+
+	return keys;
+}
+
+/** Encrypt session tickets with rotating keys
+ *
+ * @param[in] ctx	to set the ticket key callback for.
+ * @return
+ *	- 0 on success.
+ *	- -1 on failure.
+ */
+int fr_tls_ticket_keys_ctx_init(SSL_CTX *ctx)
+{
+	if (unlikely(SSL_CTX_set_tlsext_ticket_key_evp_cb(ctx, tls_ticket_key_cb) != 1)) {
+		fr_tls_strerror_printf(NULL);
+		PERROR("Failed setting session ticket key callback");
+		return -1;
+	}
+
+	return 0;
+}
+#endif /* WITH_TLS */
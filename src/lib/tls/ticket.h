@@ -0,0 +1,51 @@
+#pragma once
+/*
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+#ifdef WITH_TLS
+/**
+ * $Id$
+ *
+ * @file lib/tls/ticket.h
+ * @brief Rotating session-ticket keys.
+ *
+ * @copyright 2024 The FreeRADIUS server project
+ */
+RCSIDH(ticket_h, "$Id$")
+
+#include "openssl_user_macros.h"
+
+#include <openssl/ssl.h>
+
+#include <freeradius-devel/util/talloc.h>
+#include <freeradius-devel/util/time.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define FR_TLS_TICKET_KEYS_MAX	64		//!< Maximum number of keys we'll accept tickets from.
+
+typedef struct fr_tls_ticket_keys_s fr_tls_ticket_keys_t;
+
+fr_tls_ticket_keys_t	*fr_tls_ticket_keys_alloc(TALLOC_CTX *ctx, uint8_t const *secret, size_t secret_len,
+						  fr_time_delta_t rotation, fr_time_delta_t lifetime);
+
+int			fr_tls_ticket_keys_ctx_init(SSL_CTX *ctx);
+
+#ifdef __cplusplus
+}
+#endif
+#endif /* WITH_TLS */
@@ -0,0 +1,200 @@
+#include <freeradius-devel/util/acutest.h>
+#include <freeradius-devel/util/acutest_helpers.h>
+
+/*
+ *	Gives access to the key ring, and lets us rotate
+ *	it without waiting for the clock.
+ */
+#include "ticket.c"
+
+static uint8_t const	secret[] = "session ticket test secret";
+
+#define ROTATION	fr_time_delta_from_sec(3600)
+#define LIFETIME	fr_time_delta_from_sec(7200)
+
+static fr_tls_ticket_keys_t *ticket_test_alloc(TALLOC_CTX *ctx, uint8_t const *s, size_t s_len)
+{
+	fr_tls_ticket_keys_t *keys;
+
+	fr_time_start();
+
+	keys = fr_tls_ticket_keys_alloc(ctx, s, s_len, ROTATION, LIFETIME);
+	TEST_ASSERT(keys != NULL);
+
+	return keys;
+}
+
+/** Index of the key for an epoch in the ring, or -1 if tickets from that epoch are no longer accepted
+ *
+ */
+static int ticket_test_find(fr_tls_ticket_keys_t *keys, int64_t epoch)
+{
+	fr_tls_ticket_key_t	key;
+	uint32_t		i;
+
+	if (tls_ticket_key_derive(&key, keys, epoch) < 0) return -2;
+
+	for (i = 0; i < keys->num_keys; i++) {
+		if (memcmp(&keys->keys[i], &key, sizeof(key)) == 0) return i;
+	}
+
+	return -1;
+}
+
+static void test_ticket_ring_size(void)
+{
+	TALLOC_CTX		*ctx = talloc_init_const("ticket_test");
+	fr_tls_ticket_keys_t	*keys;
+
+	fr_time_start();
+
+	TEST_CASE("Next, current, and enough previous keys to cover the lifetime");
+	keys = fr_tls_ticket_keys_alloc(ctx, secret, sizeof(secret), ROTATION, LIFETIME);
+	TEST_ASSERT(keys != NULL);
+	TEST_CHECK(keys->num_keys == 4);
+	TEST_MSG("Expected 4 keys, got %u", keys->num_keys);
+
+	TEST_CASE("Partial epochs round up");
+	keys = fr_tls_ticket_keys_alloc(ctx, secret, sizeof(secret), ROTATION, fr_time_delta_from_sec(3601));
+	TEST_ASSERT(keys != NULL);
+	TEST_CHECK(keys->num_keys == 4);
+
+	TEST_CASE("Zero lifetime keeps next and current");
+	keys = fr_tls_ticket_keys_alloc(ctx, secret, sizeof(secret), ROTATION, fr_time_delta_wrap(0));
+	TEST_ASSERT(keys != NULL);
+	TEST_CHECK(keys->num_keys == 2);
+
+	TEST_CASE("Ring size is capped");
+	keys = fr_tls_ticket_keys_alloc(ctx, secret, sizeof(secret), ROTATION, fr_time_delta_from_sec(3600 * 1000));
+	TEST_ASSERT(keys != NULL);
+	TEST_CHECK(keys->num_keys == FR_TLS_TICKET_KEYS_MAX);
+
+	talloc_free(ctx);
+}
+
+static void test_ticket_derive(void)
+{
+	TALLOC_CTX		*ctx = talloc_init_const("ticket_test");
+	fr_tls_ticket_keys_t	*a, *b, *c;
+	uint8_t			other[] = "another secret";
+
+	a = ticket_test_alloc(ctx, secret, sizeof(secret));
+	b = ticket_test_alloc(ctx, secret, sizeof(secret));
+	c = ticket_test_alloc(ctx, other, sizeof(other));
+
+	TEST_CASE("Ring is derived for the current epoch");
+	TEST_CHECK(a->epoch == tls_ticket_keys_epoch(a));
+	TEST_CHECK(ticket_test_find(a, a->epoch + 1) == 0);
+	TEST_CHECK(ticket_test_find(a, a->epoch) == TICKET_KEY_CURRENT);
+	TEST_CHECK(ticket_test_find(a, a->epoch - 1) == 2);
+	TEST_CHECK(ticket_test_find(a, a->epoch - 2) == 3);
+
+	/*
+	 *	Skip the comparison if the clock ticked over
+	 *	into a new epoch between the allocations.
+	 */
+	TEST_CASE("Servers sharing a secret derive the same keys");
+	if (a->epoch == b->epoch) {
+		TEST_CHECK(memcmp(a->keys, b->keys, a->num_keys * sizeof(a->keys[0])) == 0);
+	}
+
+	TEST_CASE("Different secrets derive different keys");
+	TEST_CHECK(memcmp(a->keys[TICKET_KEY_CURRENT].name, c->keys[TICKET_KEY_CURRENT].name,
+			  sizeof(a->keys[0].name)) != 0);
+
+	TEST_CASE("Epochs derive different keys");
+	TEST_CHECK(memcmp(a->keys[0].name, a->keys[1].name, sizeof(a->keys[0].name)) != 0);
+
+	talloc_free(ctx);
+}
+
+static void test_ticket_rotation(void)
+{
+	TALLOC_CTX		*ctx = talloc_init_const("ticket_test");
+	fr_tls_ticket_keys_t	*keys;
+	fr_tls_ticket_key_t	old[4];
+	int64_t			epoch;
+	uint32_t		i;
+
+	keys = ticket_test_alloc(ctx, secret, sizeof(secret));
+	TEST_ASSERT(keys->num_keys == NUM_ELEMENTS(old));
+	epoch = keys->epoch;
+	memcpy(old, keys->keys, sizeof(old));
+
+	TEST_CASE("Rotating by one epoch shifts the ring");
+	TEST_CHECK(tls_ticket_keys_update(keys, epoch + 1) == 0);
+	TEST_CHECK(keys->epoch == epoch + 1);
+	for (i = 1; i < keys->num_keys; i++) {
+		TEST_CHECK(memcmp(&keys->keys[i], &old[i - 1], sizeof(old[0])) == 0);
+		TEST_MSG("keys[%u] doesn't match the previous keys[%u]", i, i - 1);
+	}
+	TEST_CHECK(ticket_test_find(keys, epoch + 2) == 0);
+
+	/*
+	 *	Tickets are encrypted with the current key,
+	 *	and must be accepted until the lifetime has
+	 *	passed.  The ring holds 2 previous epochs.
+	 */
+	TEST_CASE("Tickets are accepted for the lifetime of the ticket");
+	TEST_CHECK(ticket_test_find(keys, epoch) == 2);
+	TEST_CHECK(tls_ticket_keys_update(keys, epoch + 2) == 0);
+	TEST_CHECK(ticket_test_find(keys, epoch) == 3);
+
+	TEST_CASE("Tickets are rejected once the lifetime has passed");
+	TEST_CHECK(tls_ticket_keys_update(keys, epoch + 3) == 0);
+	TEST_CHECK(ticket_test_find(keys, epoch) == -1);
+	TEST_CHECK(ticket_test_find(keys, epoch + 1) == 3);
+
+	TEST_CASE("Rotating past the whole ring rederives it");
+	TEST_CHECK(tls_ticket_keys_update(keys, epoch + 100) == 0);
+	TEST_CHECK(keys->epoch == epoch + 100);
+	for (i = 0; i < keys->num_keys; i++) {
+		TEST_CHECK(ticket_test_find(keys, epoch + 100 + 1 - i) == (int)i);
+		TEST_MSG("keys[%u] isn't the key for epoch %" PRId64, i, epoch + 100 + 1 - i);
+	}
+
+	talloc_free(ctx);
+}
+
+static void test_ticket_rdlock(void)
+{
+	TALLOC_CTX		*ctx = talloc_init_const("ticket_test");
+	fr_tls_ticket_keys_t	*keys;
+	int64_t			epoch;
+
+	keys = ticket_test_alloc(ctx, secret, sizeof(secret));
+
+	/*
+	 *	Pretend the ring was last used two epochs ago.
+	 */
+	TEST_CASE("Taking the lock brings a stale ring up to date");
+	epoch = tls_ticket_keys_epoch(keys);
+	keys->epoch = INT64_MIN;
+	TEST_CHECK(tls_ticket_keys_update(keys, epoch - 2) == 0);
+	TEST_CHECK(tls_ticket_keys_rdlock(keys) == 0);
+	pthread_rwlock_unlock(&keys->lock);
+	TEST_CHECK(keys->epoch >= epoch);
+	TEST_CHECK(ticket_test_find(keys, keys->epoch) == TICKET_KEY_CURRENT);
+	TEST_CHECK(ticket_test_find(keys, keys->epoch - 2) == 3);
+
+	/*
+	 *	Another server, or thread, may have rotated
+	 *	ahead of our clock.  We never go backwards.
+	 */
+	TEST_CASE("Taking the lock never rotates backwards");
+	TEST_CHECK(tls_ticket_keys_update(keys, epoch + 10) == 0);
+	TEST_CHECK(tls_ticket_keys_rdlock(keys) == 0);
+	pthread_rwlock_unlock(&keys->lock);
+	TEST_CHECK(keys->epoch == epoch + 10);
+
+	talloc_free(ctx);
+}
+
+TEST_LIST = {
+	{ "ticket_ring_size",	test_ticket_ring_size },
+	{ "ticket_derive",	test_ticket_derive },
+	{ "ticket_rotation",	test_ticket_rotation },
+	{ "ticket_rdlock",	test_ticket_rdlock },
+
+	{ NULL }
+};
@@ -0,0 +1,11 @@
+ifneq ($(OPENSSL_LIBS),)
+TARGET		:= ticket_tests$(E)
+endif
+
+SOURCES		:= ticket_tests.c
+
+TGT_LDLIBS	:= $(LIBS) $(OPENSSL_LIBS) $(GPERFTOOLS_LIBS)
+TGT_LDFLAGS	:= $(LDFLAGS) $(GPERFTOOLS_LDFLAGS)
+TGT_PREREQS	:= libfreeradius-tls$(L) libfreeradius-util$(L) libfreeradius-server$(L) libfreeradius-unlang$(L)
+
+TGT_INSTALLDIR	:=
@@ -3808,6 +3808,15 @@ static unlang_t *compile_load_balance_subsection(unlang_t *parent, unlang_compil
 		if (strcmp(cf_section_name1(cf_item_to_section(cf_parent(cs))), "modules") == 0) name2 = NULL;
 	}
 
+	/*
+	 *	"latency" isn't a key, it chooses the child with
+	 *	the lowest expected response time.
+	 */
+	if (name2 && (cf_section_name2_quote(cs) == T_BARE_WORD) && (strcmp(name2, "latency") == 0)) {
+		unlang_group_to_load_balance(g)->latency = true;
+		name2 = NULL;
+	}
+
 	if (name2) {
 		fr_token_t type;
 		ssize_t slen;
@@ -97,6 +97,9 @@ struct unlang_frame_state_edit_s {
 	edit_map_t		first;
 };
 
+static_assert(sizeof(unlang_frame_state_edit_t) <= UNLANG_FRAME_STATE_RECYCLE_SIZE,
+	      "Edit state no longer fits in a recycled frame state slot");
+
 #define MAP_INFO cf_filename(map->ci), cf_lineno(map->ci)
 
 static fr_pair_t *edit_list_pair_build(fr_pair_t *parent, fr_dcursor_t *cursor, fr_dict_attr_t const *da, void *uctx);
@@ -1570,7 +1573,7 @@ static unlang_action_t process_edit(rlm_rcode_t *p_result, request_t *request, u
 				if (state->success) *state->success = false;
 
 				if (state->ours) fr_edit_list_abort(state->el);
-				TALLOC_FREE(frame->state);
+				frame_state_free(frame);
 				repeatable_clear(frame);
 				*p_result = RLM_MODULE_FAIL;
 
@@ -437,7 +437,7 @@ unlang_frame_action_t result_calculate(request_t *request, unlang_stack_frame_t
 		}
 		REXDENT();
 
-		talloc_free(frame->state);
+		frame_state_free(frame);
 		unlang_frame_perf_cleanup(frame);
 		frame_state_init(stack, frame);
 		return UNLANG_FRAME_ACTION_RETRY;
@@ -1059,8 +1059,14 @@ void *unlang_interpret_stack_alloc(TALLOC_CTX *ctx)
 	 *
 	 *	This number is pretty arbitrary, but it seems
 	 *	like too low level to make into a tuneable.
+	 *
+	 *	The pool also holds the first few recycled state
+	 *	slots, so they don't push everything else out of
+	 *	the pool.
 	 */
-	MEM(stack = talloc_zero_pooled_object(ctx, unlang_stack_t, UNLANG_STACK_MAX, 128));	/* 128 bytes per state */
+	MEM(stack = talloc_zero_pooled_object(ctx, unlang_stack_t,
+					      UNLANG_STACK_MAX + UNLANG_FRAME_STATE_RECYCLE_POOLED,
+					      128 + (UNLANG_FRAME_STATE_RECYCLE_POOLED * UNLANG_FRAME_STATE_RECYCLE_SIZE)));
 	stack->result = RLM_MODULE_NOT_SET;
 
 	return stack;
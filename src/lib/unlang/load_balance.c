@@ -30,6 +30,110 @@
 
 #define unlang_redundant_load_balance unlang_load_balance
 
+/*
+ *	Weight given to each new response time sample, as 1/2^N.
+ *	The same as TCP's smoothed RTT.
+ */
+#define LOAD_BALANCE_RTT_SHIFT	3
+
+/** Record that a child is being run
+ *
+ */
+static inline CC_HINT(always_inline)
+void load_balance_child_start(unlang_frame_state_redundant_t *redundant, uint32_t num)
+{
+	if (!redundant->thread) return;
+
+	redundant->running = &redundant->thread->child[num];
+	redundant->running->active++;
+	redundant->start = fr_time();
+}
+
+/** Record that a child has finished, and how long it took
+ *
+ * Failures aren't treated specially.  A child which times out
+ * will have taken a long time, and so will be chosen less often.
+ */
+static inline CC_HINT(always_inline)
+void load_balance_child_done(unlang_frame_state_redundant_t *redundant)
+{
+	unlang_load_balance_child_t	*running = redundant->running;
+	fr_time_delta_t			rtt;
+
+	if (!running) return;
+
+	redundant->running = NULL;
+	running->active--;
+
+	rtt = fr_time_sub(fr_time(), redundant->start);
+	if (!fr_time_delta_ispos(running->rtt)) {
+		running->rtt = rtt;
+		return;
+	}
+
+	running->rtt = fr_time_delta_add(running->rtt,
+					 fr_time_delta_wrap((fr_time_delta_unwrap(rtt) - fr_time_delta_unwrap(running->rtt)) >>
+							    LOAD_BALANCE_RTT_SHIFT));
+}
+
+/** How long we expect a request to take if it's sent to this child
+ *
+ * Children which haven't been used yet score zero, so they're tried.
+ */
+static inline CC_HINT(always_inline)
+int64_t load_balance_child_score(unlang_load_balance_child_t const *child)
+{
+	return fr_time_delta_unwrap(child->rtt) * (child->active + 1);
+}
+
+/** Pick a child using the "power of two choices"
+ *
+ * Two children are chosen at random, and the one with the lowest
+ * expected response time is used.  This avoids all requests going
+ * to whichever child looked fastest the last time it was used.
+ */
+static uint32_t load_balance_choose_latency(unlang_thread_load_balance_t *thread, uint32_t num_children)
+{
+	uint32_t	a, b;
+	int64_t		score_a, score_b;
+
+	if (num_children == 1) return 0;
+
+	a = fr_rand() % num_children;
+	b = fr_rand() % (num_children - 1);
+	if (b >= a) b++;
+
+	score_a = load_balance_child_score(&thread->child[a]);
+	score_b = load_balance_child_score(&thread->child[b]);
+
+	if (score_a != score_b) return (score_a < score_b) ? a : b;
+
+	return (thread->child[a].active <= thread->child[b].active) ? a : b;
+}
+
+/** Cancel the statistics for the running child
+ *
+ */
+static void unlang_load_balance_signal(UNUSED request_t *request, unlang_stack_frame_t *frame, fr_signal_t action)
+{
+	unlang_frame_state_redundant_t	*redundant = talloc_get_type_abort(frame->state, unlang_frame_state_redundant_t);
+
+	if ((action != FR_SIGNAL_CANCEL) || !redundant->running) return;
+
+	redundant->running->active--;
+	redundant->running = NULL;
+}
+
+static unlang_action_t unlang_load_balance_done(UNUSED rlm_rcode_t *p_result, UNUSED request_t *request,
+						unlang_stack_frame_t *frame)
+{
+	unlang_frame_state_redundant_t	*redundant = talloc_get_type_abort(frame->state, unlang_frame_state_redundant_t);
+
+	load_balance_child_done(redundant);
+
+	return UNLANG_ACTION_CALCULATE_RESULT;
+}
+
 static unlang_action_t unlang_load_balance_next(rlm_rcode_t *p_result, request_t *request,
 						unlang_stack_frame_t *frame)
 {
@@ -47,8 +151,11 @@ static unlang_action_t unlang_load_balance_next(rlm_rcode_t *p_result, request_t
 	 */
 	if (!redundant->child) {
 		redundant->child = redundant->found;
+		redundant->child_num = redundant->found_num;
 
 	} else {
+		load_balance_child_done(redundant);
+
 		/*
 		 *	child is NULL on the first pass.  But if it's
 		 *	back to the found one, then we're done.
@@ -85,6 +192,7 @@ static unlang_action_t unlang_load_balance_next(rlm_rcode_t *p_result, request_t
 		*p_result = RLM_MODULE_FAIL;
 		return UNLANG_ACTION_STOP_PROCESSING;
 	}
+	load_balance_child_start(redundant, redundant->child_num);
 
 	/*
 	 *	Now that we've pushed this child, make the next call
@@ -97,7 +205,11 @@ static unlang_action_t unlang_load_balance_next(rlm_rcode_t *p_result, request_t
 	 *	structure.
 	 */
 	redundant->child = redundant->child->next;
-	if (!redundant->child) redundant->child = g->children;
+	redundant->child_num++;
+	if (!redundant->child) {
+		redundant->child = g->children;
+		redundant->child_num = 0;
+	}
 
 	repeatable_set(frame);
 
@@ -124,7 +236,26 @@ static unlang_action_t unlang_load_balance(rlm_rcode_t *p_result, request_t *req
 	redundant = talloc_get_type_abort(frame->state,
 					  unlang_frame_state_redundant_t);
 
-	if (gext && gext->vpt) {
+	if (gext->latency) {
+		/*
+		 *	Virtual modules don't have thread-specific
+		 *	instance data, so we can't track their
+		 *	children.
+		 */
+		redundant->thread = unlang_thread_instance(frame->instruction);
+		if (!redundant->thread) goto randomly_choose;
+
+		redundant->found_num = load_balance_choose_latency(redundant->thread, g->num_children);
+
+		for (redundant->found = g->children, count = 0;
+		     count < redundant->found_num;
+		     redundant->found = redundant->found->next, count++);
+
+		RDEBUG3("load-balance chose child %u, average response time %pVs, %u active",
+			redundant->found_num, fr_box_time_delta(redundant->thread->child[redundant->found_num].rtt),
+			redundant->thread->child[redundant->found_num].active);
+
+	} else if (gext->vpt) {
 		uint32_t hash, start;
 		ssize_t slen;
 		char const *p = NULL;
@@ -231,6 +362,14 @@ static unlang_action_t unlang_load_balance(rlm_rcode_t *p_result, request_t *req
 			*p_result = RLM_MODULE_FAIL;
 			return UNLANG_ACTION_STOP_PROCESSING;
 		}
+
+		/*
+		 *	Come back to record how long the child took.
+		 */
+		if (redundant->thread) {
+			load_balance_child_start(redundant, redundant->found_num);
+			frame_repeat(frame, unlang_load_balance_done);
+		}
 		return UNLANG_ACTION_PUSHED_CHILD;
 	}
 
@@ -245,25 +384,48 @@ static unlang_action_t unlang_load_balance(rlm_rcode_t *p_result, request_t *req
 	return unlang_load_balance_next(p_result, request, frame);
 }
 
+static int unlang_load_balance_thread_instantiate(unlang_t const *instruction, void *thread_inst)
+{
+	unlang_group_t			*g = unlang_generic_to_group(instruction);
+	unlang_load_balance_t		*gext = unlang_group_to_load_balance(g);
+	unlang_thread_load_balance_t	*thread = thread_inst;
+
+	if (!gext->latency) return 0;
+
+	MEM(thread->child = talloc_zero_array(thread, unlang_load_balance_child_t, g->num_children));
+
+	return 0;
+}
+
 void unlang_load_balance_init(void)
 {
 	unlang_register(UNLANG_TYPE_LOAD_BALANCE,
 			   &(unlang_op_t){
 				.name = "load-balance group",
 				.interpret = unlang_load_balance,
+				.signal = unlang_load_balance_signal,
 				.rcode_set = true,
 				.debug_braces = true,
 			        .frame_state_size = sizeof(unlang_frame_state_redundant_t),
 				.frame_state_type = "unlang_frame_state_redundant_t",
+
+				.thread_instantiate = unlang_load_balance_thread_instantiate,
+				.thread_inst_size = sizeof(unlang_thread_load_balance_t),
+				.thread_inst_type = "unlang_thread_load_balance_t",
 			   });
 
 	unlang_register(UNLANG_TYPE_REDUNDANT_LOAD_BALANCE,
 			   &(unlang_op_t){
 				.name = "redundant-load-balance group",
 				.interpret = unlang_redundant_load_balance,
+				.signal = unlang_load_balance_signal,
 				.rcode_set = true,
 				.debug_braces = true,
 			        .frame_state_size = sizeof(unlang_frame_state_redundant_t),
 				.frame_state_type = "unlang_frame_state_redundant_t",
+
+				.thread_instantiate = unlang_load_balance_thread_instantiate,
+				.thread_inst_size = sizeof(unlang_thread_load_balance_t),
+				.thread_inst_type = "unlang_thread_load_balance_t",
 			   });
 }
@@ -32,14 +32,37 @@ extern "C" {
 typedef struct {
 	unlang_group_t	group;
 	tmpl_t		*vpt;
+	bool		latency;	//!< Choose children by response time and load.
 } unlang_load_balance_t;
 
+/** Per-thread statistics for one child of a latency load-balance section
+ *
+ */
+typedef struct {
+	uint32_t		active;		//!< Requests currently running the child.
+	fr_time_delta_t		rtt;		//!< Moving average of how long the child takes.
+} unlang_load_balance_child_t;
+
+/** Per-thread data for a load-balance section
+ *
+ */
+typedef struct {
+	unlang_load_balance_child_t	*child;	//!< Indexed by child number.  NULL unless
+						///< the section is choosing by latency.
+} unlang_thread_load_balance_t;
+
 /** State of a redundant operation
  *
  */
 typedef struct {
 	unlang_t 		*child;
 	unlang_t		*found;
+
+	unlang_thread_load_balance_t	*thread;	//!< NULL unless choosing by latency.
+	uint32_t		child_num;	//!< Number of child, found_num on the first pass.
+	uint32_t		found_num;	//!< Number of found.
+	unlang_load_balance_child_t	*running;	//!< Statistics for the child being run.
+	fr_time_t		start;		//!< When the running child was pushed.
 } unlang_frame_state_redundant_t;
 
 /** Cast a group structure to the load_balance keyword extension
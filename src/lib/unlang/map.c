@@ -94,7 +94,7 @@ static unlang_action_t list_mod_apply(rlm_rcode_t *p_result, request_t *request)
 
 		ret = map_list_mod_apply(request, vlm);
 		if (!fr_cond_assert(ret == 0)) {
-			TALLOC_FREE(frame->state);
+			frame_state_free(frame);
 
 			*p_result = RLM_MODULE_FAIL;
 			return UNLANG_ACTION_CALCULATE_RESULT;
@@ -164,7 +164,7 @@ static unlang_action_t list_mod_create(rlm_rcode_t *p_result, request_t *request
 			case TMPL_TYPE_XLAT_UNRESOLVED:
 				fr_assert(0);
 			error:
-				TALLOC_FREE(frame->state);
+				frame_state_free(frame);
 				repeatable_clear(frame);
 				*p_result = RLM_MODULE_FAIL;
 
@@ -303,6 +303,8 @@ struct unlang_stack_frame_s {
 								///< frame lower in the stack to determine if the
 								///< result stored in the lower stack frame should
 	uint8_t			uflags;				//!< Unwind markers
+	bool			state_recycled;			//!< state is the stack's slot for this depth
+								///< and must not be freed.
 #ifdef WITH_PERF
 	fr_time_tracking_t	tracking;			//!< track this instance of this instruction
 #endif
@@ -320,6 +322,8 @@ typedef struct {
 	uint8_t			unwind;				//!< Unwind to this frame if it exists.
 								///< This is used for break and return.
 	unlang_stack_frame_t	frame[UNLANG_STACK_MAX];	//!< The stack...
+	void			*state_slot[UNLANG_STACK_MAX];	//!< Reusable state for each frame, see
+								///< #UNLANG_FRAME_STATE_RECYCLE_SIZE.
 } unlang_stack_t;
 
 /** Different operations the interpreter can execute
@@ -397,6 +401,47 @@ static inline int stack_depth_current(request_t *request)
 	return stack->depth;
 }
 
+/** Largest frame state which is recycled instead of being allocated per instruction
+ *
+ * Most instructions in a typical policy (conditions, edits, calls to modules)
+ * need a small amount of state whilst they run.  Allocating and freeing it for
+ * every instruction dominates the cost of executing simple sections, so each
+ * stack frame keeps one slot of this size which is zeroed and reused by each
+ * instruction executed at that depth.
+ *
+ * Anything the instruction parents off its state is still freed when the
+ * instruction completes.
+ *
+ * Sized to fit the state of edits, module calls and xlats.  The first few
+ * slots come from the stack's pool, see unlang_interpret_stack_alloc().
+ */
+#define UNLANG_FRAME_STATE_RECYCLE_SIZE	384
+
+/** How many recycled state slots the stack's pool has room for
+ *
+ * Slots are only allocated for depths at which small state is actually used.
+ * Slots beyond these come from the heap, once per request rather than once
+ * per instruction.
+ */
+#define UNLANG_FRAME_STATE_RECYCLE_POOLED	4
+
+/** Get the reusable state slot for a frame, allocating it on first use
+ *
+ */
+static inline void *frame_state_recycle(unlang_stack_t *stack, unlang_stack_frame_t *frame,
+					size_t size, char const *name)
+{
+	void **slot = &stack->state_slot[frame - stack->frame];
+
+	if (!*slot) MEM(*slot = talloc_size(stack, UNLANG_FRAME_STATE_RECYCLE_SIZE));
+
+	memset(*slot, 0, size);
+	talloc_set_name_const(*slot, name);
+	frame->state_recycled = true;
+
+	return *slot;
+}
+
 static inline void frame_state_init(unlang_stack_t *stack, unlang_stack_frame_t *frame)
 {
 	unlang_t const	*instruction = frame->instruction;
@@ -430,6 +475,11 @@ static inline void frame_state_init(unlang_stack_t *stack, unlang_stack_frame_t
 					       op->frame_state_pool_size +
 					       ((20 + 68 + 15) * op->frame_state_pool_objects))); /* from samba talloc.c */
 		talloc_set_name_const(frame->state, name);
+	/*
+	 *	Small object, reuse the frame's slot
+	 */
+	} else if (op->frame_state_size && (op->frame_state_size <= UNLANG_FRAME_STATE_RECYCLE_SIZE)) {
+		frame->state = frame_state_recycle(stack, frame, op->frame_state_size, name);
 	/*
 	 *	Object
 	 */
@@ -442,6 +492,23 @@ static inline void frame_state_init(unlang_stack_t *stack, unlang_stack_frame_t
 	 */
 }
 
+/** Free the state of the current instruction
+ *
+ * Recycled state is left allocated for the next instruction at this depth.
+ */
+static inline void frame_state_free(unlang_stack_frame_t *frame)
+{
+	if (!frame->state) return;
+
+	talloc_free_children(frame->state); /* *(ev->parent) = NULL in event.c */
+	if (frame->state_recycled) {
+		frame->state = NULL;
+		frame->state_recycled = false;
+		return;
+	}
+	TALLOC_FREE(frame->state);
+}
+
 /** Cleanup any lingering frame state
  *
  */
@@ -453,10 +520,7 @@ static inline void frame_cleanup(unlang_stack_frame_t *frame)
 	 *	Don't clear top_frame flag, bad things happen...
 	 */
 	frame->uflags &= UNWIND_FLAG_TOP_FRAME;
-	if (frame->state) {
-		talloc_free_children(frame->state); /* *(ev->parent) = NULL in event.c */
-		TALLOC_FREE(frame->state);
-	}
+	frame_state_free(frame);
 }
 
 /** Advance to the next sibling instruction
@@ -226,9 +226,10 @@ static int unlang_xlat_push_internal(TALLOC_CTX *ctx, bool *p_success, fr_value_
 	frame = &stack->frame[stack->depth];
 
 	/*
-	 *	Allocate its state, and setup a cursor for the xlat nodes
+	 *	The state was allocated (or recycled) when the
+	 *	frame was pushed.  Setup a cursor for the xlat nodes.
 	 */
-	MEM(frame->state = state = talloc_zero(stack, unlang_frame_state_xlat_t));
+	state = talloc_get_type_abort(frame->state, unlang_frame_state_xlat_t);
 	state->head = xlat;
 	state->exp = node;
 	state->success = p_success;
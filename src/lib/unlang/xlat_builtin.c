@@ -2771,6 +2771,53 @@ static xlat_action_t xlat_func_regex(TALLOC_CTX *ctx, fr_dcursor_t *out,
 	}
 	}
 }
+
+static xlat_arg_parser_t const xlat_func_regex_cache_stats_args[] = {
+	{ .required = true, .concat = true, .type = FR_TYPE_STRING },
+	XLAT_ARG_PARSER_TERMINATOR
+};
+
+/** Return a counter from this thread's cache of runtime compiled patterns
+ *
+ * Example:
+@verbatim
+%regex.cache_stats(hits) == 12
+@endverbatim
+ *
+ * @ingroup xlat_functions
+ */
+static xlat_action_t xlat_func_regex_cache_stats(TALLOC_CTX *ctx, fr_dcursor_t *out,
+						 UNUSED xlat_ctx_t const *xctx,
+						 request_t *request, fr_value_box_list_t *args)
+{
+	fr_regex_cache_stats_t	stats;
+	fr_value_box_t		*name, *vb;
+
+	XLAT_ARGS(args, &name);
+
+	regex_cache_stats(&stats);
+
+	MEM(vb = fr_value_box_alloc(ctx, FR_TYPE_UINT64, NULL));
+
+	if (strcmp(name->vb_strvalue, "hits") == 0) {
+		vb->vb_uint64 = stats.hits;
+	} else if (strcmp(name->vb_strvalue, "misses") == 0) {
+		vb->vb_uint64 = stats.misses;
+	} else if (strcmp(name->vb_strvalue, "evictions") == 0) {
+		vb->vb_uint64 = stats.evictions;
+	} else if (strcmp(name->vb_strvalue, "entries") == 0) {
+		vb->vb_uint64 = stats.entries;
+	} else {
+		REDEBUG("Unknown regex cache statistic \"%s\", expected one of hits, misses, evictions or entries",
+			name->vb_strvalue);
+		talloc_free(vb);
+		return XLAT_ACTION_FAIL;
+	}
+
+	fr_dcursor_append(out, vb);
+
+	return XLAT_ACTION_DONE;
+}
 #endif
 
 static xlat_arg_parser_t const xlat_func_sha_arg[] = {
@@ -4157,6 +4204,14 @@ do { \
 #if defined(HAVE_REGEX_PCRE) || defined(HAVE_REGEX_PCRE2)
 	if (unlikely((xlat = xlat_func_register(xlat_ctx, "regex", xlat_func_regex, FR_TYPE_STRING)) == NULL)) return -1;
 	xlat_func_flags_set(xlat, XLAT_FUNC_FLAG_INTERNAL);
+
+	/*
+	 *	Not pure, the counters change as patterns are used.
+	 */
+	if (unlikely((xlat = xlat_func_register(xlat_ctx, "regex.cache_stats",
+						xlat_func_regex_cache_stats, FR_TYPE_UINT64)) == NULL)) return -1;
+	xlat_func_args_set(xlat, xlat_func_regex_cache_stats_args);
+	xlat_func_flags_set(xlat, XLAT_FUNC_FLAG_INTERNAL);
 #endif
 	XLAT_REGISTER_PURE("sha1", xlat_func_sha1, FR_TYPE_OCTETS, xlat_func_sha_arg);
 
@@ -384,14 +384,224 @@ static xlat_arg_parser_t const binary_cmp_xlat_args[] = {
 	XLAT_ARG_PARSER_TERMINATOR
 };
 
+/** A comparison which has been specialised at instantiation time
+ *
+ * When the LHS is a reference to a leaf attribute and the RHS is a literal
+ * of the same type, e.g. `NAS-Port == 5`, we don't need to expand either
+ * side into value-box lists.  The arguments are removed from the call, and
+ * the attribute values are compared directly against the literal.
+ */
+typedef struct {
+	xlat_exp_head_t		*args;		//!< Original arguments, only used for printing.
+	tmpl_t const		*vpt;		//!< Attribute on the LHS.
+	fr_value_box_t const	*rhs;		//!< Literal on the RHS, of the same type as the attribute.
+} xlat_cmp_inst_t;
+
+static fr_slen_t xlat_expr_print_cmp(fr_sbuff_t *out, xlat_exp_t const *node, void *instance, fr_sbuff_escape_rules_t const *e_rules)
+{
+	size_t		at_in = fr_sbuff_used_total(out);
+	xlat_cmp_inst_t	*inst = instance;
+	xlat_exp_head_t	*args = (inst && inst->args) ? inst->args : node->call.args;
+	xlat_exp_t	*child = xlat_exp_head(args);
+
+	fr_assert(child != NULL);
+
+	FR_SBUFF_IN_CHAR_RETURN(out, '(');
+	xlat_print_node(out, args, child, e_rules, 0); /* prints a space after the first argument */
+
+	FR_SBUFF_IN_STRCPY_RETURN(out, fr_tokens[node->call.func->token]);
+	FR_SBUFF_IN_CHAR_RETURN(out, ' ');
+
+	child = xlat_exp_next(args, child);
+	fr_assert(child != NULL);
+
+	xlat_print_node(out, args, child, e_rules, 0);
+
+	FR_SBUFF_IN_CHAR_RETURN(out, ')');
+
+	return fr_sbuff_used_total(out) - at_in;
+}
+
+/** See if a comparison can be specialised
+ *
+ * Anything which doesn't match is left alone, and goes through the
+ * generic list comparison at run time.
+ */
+static int xlat_instantiate_cmp(xlat_inst_ctx_t const *xctx)
+{
+	xlat_cmp_inst_t		*inst = talloc_get_type_abort(xctx->inst, xlat_cmp_inst_t);
+	xlat_exp_head_t		*args = xctx->ex->call.args;
+	xlat_exp_t		*arg1, *arg2, *a, *b;
+	fr_value_box_t const	*rhs;
+	fr_dict_attr_t const	*da;
+
+	arg1 = xlat_exp_head(args);
+	if (!arg1) return 0;
+
+	arg2 = xlat_exp_next(args, arg1);
+	if (!arg2) return 0;
+
+	fr_assert(arg1->type == XLAT_GROUP);
+	fr_assert(arg2->type == XLAT_GROUP);
+
+	a = xlat_exp_head(arg1->group);
+	b = xlat_exp_head(arg2->group);
+	if (!a || !b || xlat_exp_next(arg1->group, a) || xlat_exp_next(arg2->group, b)) return 0;
+
+	/*
+	 *	The LHS must be a single leaf attribute, which
+	 *	tmpl_eval_pair() would return uncast.
+	 */
+	if ((a->type != XLAT_TMPL) || a->flags.needs_resolving || !tmpl_is_attr(a->vpt)) return 0;
+	if (tmpl_rules_cast(a->vpt) != FR_TYPE_NULL) return 0;
+	if (tmpl_attr_tail_num(a->vpt) == NUM_COUNT) return 0;
+
+	da = tmpl_attr_tail_da(a->vpt);
+	if (!da || !fr_type_is_leaf(da->type)) return 0;
+
+	/*
+	 *	The RHS must be a literal which already has the
+	 *	same type as the attribute, so that the comparison
+	 *	doesn't need any casts.
+	 */
+	switch (b->type) {
+	case XLAT_BOX:
+		rhs = &b->data;
+		break;
+
+	case XLAT_TMPL:
+		if (b->flags.needs_resolving || !tmpl_is_data(b->vpt)) return 0;
+		if (tmpl_rules_cast(b->vpt) != FR_TYPE_NULL) return 0;
+		rhs = tmpl_value(b->vpt);
+		break;
+
+	default:
+		return 0;
+	}
+	if (rhs->type != da->type) return 0;
+
+	/*
+	 *	Move the arguments out of the call so that they're
+	 *	not expanded.
+	 */
+	MEM(inst->args = xlat_exp_head_alloc(inst));
+	(void) fr_dlist_remove(&args->dlist, arg1);
+	(void) fr_dlist_remove(&args->dlist, arg2);
+	xlat_exp_insert_tail(inst->args, talloc_steal(inst->args, arg1));
+	xlat_exp_insert_tail(inst->args, talloc_steal(inst->args, arg2));
+
+	inst->vpt = a->vpt;
+	inst->rhs = rhs;
+
+	return 0;
+}
+
+static inline CC_HINT(always_inline) bool xlat_cmp_box_empty(fr_value_box_t const *vb)
+{
+	return ((vb->type == FR_TYPE_STRING) || (vb->type == FR_TYPE_OCTETS)) && (vb->vb_length == 0);
+}
+
+/** Compare attribute values directly against a literal
+ *
+ * This mirrors fr_value_calc_list_cmp(), as both sides are known to have
+ * the same type.
+ */
+static xlat_action_t xlat_cmp_typed(TALLOC_CTX *ctx, fr_dcursor_t *out,
+				    request_t *request, xlat_cmp_inst_t const *inst, fr_token_t op)
+{
+	fr_value_box_t		*dst;
+	fr_pair_t		*vp;
+	fr_dcursor_t		cursor;
+	tmpl_dcursor_ctx_t	cc;
+	bool			invert = false, a_empty = true, b_empty;
+	bool			all = (tmpl_attr_tail_num(inst->vpt) == NUM_ALL);
+	fr_token_t		token = op, cmp = op;
+	int			rcode;
+
+	/*
+	 *	The types are always the same, so === and !== are
+	 *	just == and !=.
+	 */
+	switch (op) {
+	case T_OP_NE:
+		invert = true;
+		op = cmp = T_OP_CMP_EQ;
+		break;
+
+	case T_OP_CMP_EQ_TYPE:
+		cmp = T_OP_CMP_EQ;
+		break;
+
+	case T_OP_CMP_NE_TYPE:
+		cmp = T_OP_NE;
+		break;
+
+	default:
+		break;
+	}
+
+	b_empty = xlat_cmp_box_empty(inst->rhs);
+
+	MEM(dst = fr_value_box_alloc(ctx, FR_TYPE_BOOL, attr_expr_bool_enum));
+
+	for (vp = tmpl_dcursor_init(NULL, NULL, &cc, &cursor, request, inst->vpt);
+	     vp;
+	     vp = all ? fr_dcursor_next(&cursor) : NULL) {
+		if (!xlat_cmp_box_empty(&vp->data)) a_empty = false;
+
+		rcode = fr_value_box_cmp_op(cmp, &vp->data, inst->rhs);
+		if (rcode < 0) {
+			tmpl_dcursor_clear(&cc);
+			talloc_free(dst);
+			return XLAT_ACTION_FAIL;
+		}
+
+		if (rcode > 0) {
+			dst->vb_bool = !invert;
+			goto done;
+		}
+	}
+
+	/*
+	 *	{} == '' is true, see fr_value_calc_list_cmp().
+	 */
+	if (a_empty && b_empty) {
+		switch (op) {
+		case T_OP_CMP_EQ:
+		case T_OP_LE:
+		case T_OP_GE:
+			invert = !invert;
+			break;
+
+		default:
+			break;
+		}
+	}
+	dst->vb_bool = invert;
+
+done:
+	tmpl_dcursor_clear(&cc);
+
+	RDEBUG3("%s %s %pV --> %s", inst->vpt->name, fr_tokens[token], inst->rhs, dst->vb_bool ? "true" : "false");
+
+	fr_dcursor_append(out, dst);
+	return XLAT_ACTION_DONE;
+}
+
 static xlat_action_t xlat_cmp_op(TALLOC_CTX *ctx, fr_dcursor_t *out,
-				 UNUSED xlat_ctx_t const *xctx,
-				 UNUSED request_t *request, fr_value_box_list_t *in,
+				 xlat_ctx_t const *xctx,
+				 request_t *request, fr_value_box_list_t *in,
 				 fr_token_t op)
 {
 	int rcode;
 	fr_value_box_t	*dst, *a, *b;
 
+	if (xctx->inst) {
+		xlat_cmp_inst_t const *inst = talloc_get_type_abort_const(xctx->inst, xlat_cmp_inst_t);
+
+		if (inst->vpt) return xlat_cmp_typed(ctx, out, request, inst, op);
+	}
+
 	/*
 	 *	Each argument is a FR_TYPE_GROUP, with one or more elements in a list.
 	 */
@@ -710,8 +920,8 @@ static xlat_action_t xlat_regex_resume(TALLOC_CTX *ctx, fr_dcursor_t *out,
 
 	fr_assert(inst->regex == NULL);
 
-	slen = regex_compile(rctx, &preg, fr_sbuff_start(agg), fr_sbuff_used(agg),
-			     tmpl_regex_flags(inst->xlat->vpt), true, true); /* flags, allow subcaptures, at runtime */
+	slen = regex_compile_cached(rctx, &preg, fr_sbuff_start(agg), fr_sbuff_used(agg),
+				    tmpl_regex_flags(inst->xlat->vpt), true); /* flags, allow subcaptures */
 	if (slen <= 0) return XLAT_ACTION_FAIL;
 
 	return xlat_regex_match(ctx, request, in, &preg, out, inst->op);
@@ -1831,8 +2041,9 @@ do { \
 	if (unlikely((xlat = xlat_func_register(NULL, "cmp_" STRINGIFY(_name), xlat_func_cmp_ ## _name, FR_TYPE_BOOL)) == NULL)) return -1; \
 	xlat_func_args_set(xlat, binary_cmp_xlat_args); \
 	xlat_func_flags_set(xlat, XLAT_FUNC_FLAG_PURE | XLAT_FUNC_FLAG_INTERNAL); \
-	xlat_func_print_set(xlat, xlat_expr_print_binary); \
+	xlat_func_print_set(xlat, xlat_expr_print_cmp); \
 	xlat_func_resolve_set(xlat, xlat_expr_resolve_binary); \
+	xlat_func_instantiate_set(xlat, xlat_instantiate_cmp, xlat_cmp_inst_t, NULL, NULL); \
 	xlat->token = _op; \
 } while (0)
 
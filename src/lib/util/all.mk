@@ -15,9 +15,11 @@ SUBMAKEFILES := \
 	pair_nested_tests.mk \
 	pair_tests.mk \
 	rb_tests.mk \
+	regex_tests.mk \
 	sbuff_tests.mk \
 	size_tests.mk \
 	slab_tests.mk \
 	strerror_tests.mk \
-	time_tests.mk
+	time_tests.mk \
+	timer_wheel_tests.mk
 
@@ -37,6 +37,7 @@ RCSID("$Id$")
 #include <freeradius-devel/util/strerror.h>
 #include <freeradius-devel/util/syserror.h>
 #include <freeradius-devel/util/table.h>
+#include <freeradius-devel/util/timer_wheel.h>
 #include <freeradius-devel/util/token.h>
 #include <freeradius-devel/util/atexit.h>
 
@@ -111,6 +112,7 @@ struct fr_event_timer {
 							///< event.
 
 	fr_lst_index_t		lst_id;	     	  	//!< Where to store opaque lst data.
+	fr_timer_wheel_entry_t	wheel_entry;		//!< Where we are in the timer wheel, if there is one.
 	fr_dlist_t		entry;			//!< List of deferred timer events.
 
 	fr_event_list_t		*el;			//!< Event list containing this timer.
@@ -410,6 +412,7 @@ typedef struct {
  */
 struct fr_event_list {
 	fr_lst_t		*times;			//!< of timer events to be executed.
+	fr_timer_wheel_t	*wheel;			//!< if set, timer events are kept here instead.
 	fr_rb_tree_t		*fds;			//!< Tree used to track FDs with filters in kqueue.
 
 	int			will_exit;		//!< Will exit on next call to fr_event_corral.
@@ -614,6 +617,8 @@ uint64_t fr_event_list_num_timers(fr_event_list_t *el)
 {
 	if (unlikely(!el)) return -1;
 
+	if (el->wheel) return fr_timer_wheel_num_elements(el->wheel);
+
 	return fr_lst_num_elements(el->times);
 }
 
@@ -1386,6 +1391,56 @@ int fr_event_fd_unarmour(fr_event_list_t *el, int fd, fr_event_filter_t filter,
 }
 #endif
 
+static void event_timer_wheel_fire(fr_timer_wheel_t *tw, fr_time_t now, void *uctx);
+
+/** Add a timer event to whichever structure the event list keeps them in
+ *
+ */
+static inline CC_HINT(always_inline) int event_timer_insert(fr_event_list_t *el, fr_event_timer_t *ev)
+{
+	if (el->wheel) {
+		fr_timer_wheel_entry_init(&ev->wheel_entry, event_timer_wheel_fire, ev);
+		fr_timer_wheel_insert(el->wheel, &ev->wheel_entry, ev->when);
+		return 0;
+	}
+
+	return fr_lst_insert(el->times, ev);
+}
+
+/** Remove a timer event from whichever structure the event list keeps them in
+ *
+ * Timers in the wheel are removed from it just before they fire, so we
+ * can't tell whether one was ever there.
+ */
+static inline CC_HINT(always_inline) int event_timer_extract(fr_event_list_t *el, fr_event_timer_t *ev)
+{
+	if (el->wheel) {
+		fr_timer_wheel_delete(el->wheel, &ev->wheel_entry);
+		return 0;
+	}
+
+	return fr_lst_extract(el->times, ev);
+}
+
+/** When the next timer event is due
+ *
+ * @return
+ *	- 0 if there are no timer events.
+ *	- when the next timer event is due.  For the timer wheel, this is
+ *	  the start of the tick it's in, which may be a little later.
+ */
+static inline CC_HINT(always_inline) fr_time_t event_timer_next(fr_event_list_t *el)
+{
+	fr_event_timer_t *ev;
+
+	if (el->wheel) return fr_timer_wheel_next(el->wheel);
+
+	ev = fr_lst_peek(el->times);
+	if (!ev) return fr_time_wrap(0);
+
+	return ev->when;
+}
+
 /** Remove an event from the event loop
  *
  * @param[in] ev	to free.
@@ -1401,7 +1456,7 @@ static int _event_timer_free(fr_event_timer_t *ev)
 	if (fr_dlist_entry_in_list(&ev->entry)) {
 		(void) fr_dlist_remove(&el->ev_to_add, ev);
 	} else {
-		int		ret = fr_lst_extract(el->times, ev);
+		int		ret = event_timer_extract(el, ev);
 		char const	*err_file;
 		int		err_line;
 
@@ -1524,7 +1579,7 @@ int _fr_event_timer_at(NDEBUG_LOCATION_ARGS
 			char const	*err_file;
 			int		err_line;
 
-			ret = fr_lst_extract(el->times, ev);
+			ret = event_timer_extract(el, ev);
 
 #ifndef NDEBUG
 			err_file = ev->file;
@@ -1562,7 +1617,7 @@ int _fr_event_timer_at(NDEBUG_LOCATION_ARGS
 		 *	multiple times.
 		 */
 		if (!fr_dlist_entry_in_list(&ev->entry)) fr_dlist_insert_head(&el->ev_to_add, ev);
-	} else if (unlikely(fr_lst_insert(el->times, ev) < 0)) {
+	} else if (unlikely(event_timer_insert(el, ev) < 0)) {
 		fr_strerror_const_push("Failed inserting event");
 		talloc_set_destructor(ev, NULL);
 		*ev_p = NULL;
@@ -2368,6 +2423,18 @@ int fr_event_timer_run(fr_event_list_t *el, fr_time_t *when)
 
 	if (unlikely(!el)) return 0;
 
+	/*
+	 *	The wheel runs all of the timers which are due in one
+	 *	go.  The next call sees that there's nothing left to
+	 *	do, and tells the caller when to come back.
+	 */
+	if (el->wheel) {
+		if (fr_timer_wheel_run(el->wheel, *when) > 0) return 1;
+
+		*when = fr_timer_wheel_next(el->wheel);
+		return 0;
+	}
+
 	if (fr_lst_num_elements(el->times) == 0) {
 		*when = fr_time_wrap(0);
 		return 0;
@@ -2402,6 +2469,27 @@ int fr_event_timer_run(fr_event_list_t *el, fr_time_t *when)
 	return 1;
 }
 
+/** Run a timer event from the timer wheel
+ *
+ * The wheel has already removed it, we free it, as fr_event_timer_run() does.
+ */
+static void event_timer_wheel_fire(UNUSED fr_timer_wheel_t *tw, fr_time_t now, void *ev_uctx)
+{
+	fr_event_timer_t	*ev = ev_uctx;
+	fr_event_list_t		*el = ev->el;
+	fr_event_timer_cb_t	callback;
+	void			*uctx;
+
+	callback = ev->callback;
+	memcpy(&uctx, &ev->uctx, sizeof(uctx));
+
+	fr_assert(*ev->parent == ev);
+
+	fr_event_timer_delete(ev->parent);
+
+	callback(el, now, uctx);
+}
+
 /** Gather outstanding timer and file descriptor events
  *
  * @param[in] el	to process events for.
@@ -2418,7 +2506,7 @@ int fr_event_corral(fr_event_list_t *el, fr_time_t now, bool wait)
 	fr_event_pre_t		*pre;
 	int			num_fd_events;
 	bool			timer_event_ready = false;
-	fr_event_timer_t	*ev;
+	fr_time_t		next;
 
 	el->num_fd_events = 0;
 
@@ -2442,13 +2530,13 @@ int fr_event_corral(fr_event_list_t *el, fr_time_t now, bool wait)
 	 *	events are in the past.  Or, we wait for a future
 	 *	timer event.
 	 */
-	ev = fr_lst_peek(el->times);
-	if (ev) {
-		if (fr_time_lteq(ev->when, el->now)) {
+	next = event_timer_next(el);
+	if (fr_time_gt(next, fr_time_wrap(0))) {
+		if (fr_time_lteq(next, el->now)) {
 			timer_event_ready = true;
 
 		} else if (wait) {
-			when = fr_time_sub(ev->when, el->now);
+			when = fr_time_sub(next, el->now);
 
 		} /* else we're not waiting, leave "when == 0" */
 
@@ -2691,7 +2779,7 @@ void fr_event_service(fr_event_list_t *el)
 	 *	Run all of the timer events.  Note that these can add
 	 *	new timers!
 	 */
-	if (fr_lst_num_elements(el->times) > 0) {
+	if (fr_event_list_num_timers(el) > 0) {
 		el->in_handler = true;
 
 		do {
@@ -2717,7 +2805,7 @@ void fr_event_service(fr_event_list_t *el)
 	 */
 	while ((ev = fr_dlist_head(&el->ev_to_add)) != NULL) {
 		(void)fr_dlist_remove(&el->ev_to_add, ev);
-		if (unlikely(fr_lst_insert(el->times, ev) < 0)) {
+		if (unlikely(event_timer_insert(el, ev) < 0)) {
 			talloc_free(ev);
 			fr_assert_msg(0, "failed inserting lst event: %s", fr_strerror());	/* Die in debug builds */
 		}
@@ -2795,6 +2883,17 @@ static int _event_list_free(fr_event_list_t *el)
 {
 	fr_event_timer_t const *ev;
 
+	if (el->wheel) {
+		fr_timer_wheel_iter_t	iter;
+		fr_timer_wheel_entry_t	*entry, *next;
+
+		for (entry = fr_timer_wheel_iter_init(el->wheel, &iter); entry; entry = next) {
+			next = fr_timer_wheel_iter_next(el->wheel, &iter);
+			ev = entry->uctx;
+			fr_event_timer_delete(&ev);
+		}
+	}
+
 	while ((ev = fr_lst_peek(el->times)) != NULL) fr_event_timer_delete(&ev);
 
 	fr_event_list_reap_signal(el, fr_time_delta_wrap(0), SIGKILL);
@@ -2973,12 +3072,43 @@ void fr_event_list_set_time_func(fr_event_list_t *el, fr_event_time_source_t fun
 	el->time = func;
 }
 
+/** Keep timer events in a timer wheel, instead of a heap
+ *
+ * Inserting, deleting, and running a timer is O(1), which helps event lists
+ * with many timers which are mostly deleted before they fire.  The cost is
+ * that timers fire up to one tick late.
+ *
+ * Timers already in the event list are moved to the wheel.
+ *
+ * @param[in] el	to change.
+ * @param[in] tick	resolution of the timers.
+ * @return
+ *	- 0 on success.
+ *	- -1 on failure.
+ */
+int fr_event_list_set_timer_wheel(fr_event_list_t *el, fr_time_delta_t tick)
+{
+	fr_event_timer_t *ev;
+
+	if (unlikely(el->wheel != NULL)) {
+		fr_strerror_const("Event list already uses a timer wheel");
+		return -1;
+	}
+
+	el->wheel = fr_timer_wheel_alloc(el, tick, el->time());
+	if (unlikely(!el->wheel)) return -1;
+
+	while ((ev = fr_lst_pop(el->times)) != NULL) (void) event_timer_insert(el, ev);
+
+	return 0;
+}
+
 /** Return whether the event loop has any active events
  *
  */
 bool fr_event_list_empty(fr_event_list_t *el)
 {
-	return !fr_lst_num_elements(el->times) && !fr_rb_num_elements(el->fds);
+	return !fr_event_list_num_timers(el) && !fr_rb_num_elements(el->fds);
 }
 
 #ifdef WITH_EVENT_DEBUG
@@ -3018,12 +3148,37 @@ static int8_t event_timer_location_cmp(void const *one, void const *two)
 }
 
 
+typedef struct {
+	fr_lst_iter_t		lst;
+	fr_timer_wheel_iter_t	wheel;
+} event_timer_iter_t;
+
+static fr_event_timer_t *event_timer_iter_init(fr_event_list_t *el, event_timer_iter_t *iter)
+{
+	fr_timer_wheel_entry_t *entry;
+
+	if (!el->wheel) return fr_lst_iter_init(el->times, &iter->lst);
+
+	entry = fr_timer_wheel_iter_init(el->wheel, &iter->wheel);
+	return entry ? entry->uctx : NULL;
+}
+
+static fr_event_timer_t *event_timer_iter_next(fr_event_list_t *el, event_timer_iter_t *iter)
+{
+	fr_timer_wheel_entry_t *entry;
+
+	if (!el->wheel) return fr_lst_iter_next(el->times, &iter->lst);
+
+	entry = fr_timer_wheel_iter_next(el->wheel, &iter->wheel);
+	return entry ? entry->uctx : NULL;
+}
+
 /** Print out information about the number of events in the event loop
  *
  */
 void fr_event_report(fr_event_list_t *el, fr_time_t now, void *uctx)
 {
-	fr_lst_iter_t		iter;
+	event_timer_iter_t	iter;
 	fr_event_timer_t const	*ev;
 	size_t			i;
 
@@ -3049,9 +3204,9 @@ void fr_event_report(fr_event_list_t *el, fr_time_t now, void *uctx)
 	 *	Show which events are due, when they're due,
 	 *	and where they were allocated
 	 */
-	for (ev = fr_lst_iter_init(el->times, &iter);
+	for (ev = event_timer_iter_init(el, &iter);
 	     ev != NULL;
-	     ev = fr_lst_iter_next(el->times, &iter)) {
+	     ev = event_timer_iter_next(el, &iter)) {
 		fr_time_delta_t diff = fr_time_sub(ev->when, now);
 
 		for (i = 0; i < NUM_ELEMENTS(decades); i++) {
@@ -3115,7 +3270,7 @@ void fr_event_report(fr_event_list_t *el, fr_time_t now, void *uctx)
 #ifndef NDEBUG
 void fr_event_timer_dump(fr_event_list_t *el)
 {
-	fr_lst_iter_t		iter;
+	event_timer_iter_t	iter;
 	fr_event_timer_t 	*ev;
 	fr_time_t		now;
 
@@ -3123,9 +3278,9 @@ void fr_event_timer_dump(fr_event_list_t *el)
 
 	EVENT_DEBUG("Time is now %"PRId64"", fr_time_unwrap(now));
 
-	for (ev = fr_lst_iter_init(el->times, &iter);
+	for (ev = event_timer_iter_init(el, &iter);
 	     ev;
-	     ev = fr_lst_iter_next(el->times, &iter)) {
+	     ev = event_timer_iter_next(el, &iter)) {
 		(void)talloc_get_type_abort(ev, fr_event_timer_t);
 		EVENT_DEBUG("%s[%u]: %p time=%" PRId64 " (%c), callback=%p",
 			    ev->file, ev->line, ev, fr_time_unwrap(ev->when),
@@ -88,6 +88,7 @@ SOURCES		:= \
 		   table.c \
 		   talloc.c \
 		   time.c \
+		   timer_wheel.c \
 		   timeval.c \
 		   token.c \
 		   trie.c \
@@ -640,8 +640,13 @@ static inline CC_HINT(nonnull) void _fr_lst_extract(fr_lst_t *lst,  stack_index_
 	} else if (cmp > 0) {
 		bucket_delete(lst, stack_index - 1, data);
 	} else {
+		/*
+		 *	data may not be the pivot, just equal to it, so it
+		 *	could be on either side.  Flattening merges both
+		 *	sides into the bucket of the enclosing (sub)tree.
+		 */
 		lst_flatten(lst, stack_index);
-		bucket_delete(lst, stack_index, data);
+		bucket_delete(lst, stack_index - 1, data);
 	}
 }
 
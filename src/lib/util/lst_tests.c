@@ -367,6 +367,79 @@ static void lst_cycle(void)
 	free(values);
 }
 
+/*
+ *	Extracting an element which compares equal to a pivot, but isn't
+ *	the pivot, used to corrupt the LST.  The element can be on either
+ *	side of the pivot.  It was deleted from the bucket of the pivot's
+ *	subtree, instead of from the bucket the subtree was flattened
+ *	into.  Timers which are re-armed for the same time do this all
+ *	the time.
+ */
+#define LST_EQUAL_SIZE	(1000)
+static void lst_extract_equal(void)
+{
+	fr_lst_t	*lst;
+	lst_thing	*values, *min;
+	unsigned int	i, j, key;
+
+	lst = fr_lst_alloc(NULL, lst_cmp, lst_thing, idx, 0);
+	values = calloc(LST_EQUAL_SIZE, sizeof(lst_thing));
+
+	/*
+	 *	With every key the same, the peek makes one of them
+	 *	the pivot, and every other element is equal to it.
+	 */
+	TEST_CASE("Extracting elements equal to the pivot");
+	for (i = 0; i < LST_EQUAL_SIZE; i++) TEST_CHECK(fr_lst_insert(lst, &values[i]) >= 0);
+
+	min = fr_lst_peek(lst);
+	TEST_ASSERT(min != NULL);
+
+	for (i = 0; i < LST_EQUAL_SIZE; i++) {
+		if (&values[i] == min) continue;
+
+		TEST_CHECK(fr_lst_extract(lst, &values[i]) >= 0);
+		FR_LST_VERIFY(lst);
+		TEST_CHECK(!fr_lst_contains(lst, &values[i]));
+		TEST_MSG("element %u extracted, but still in the LST", i);
+	}
+	TEST_CHECK(fr_lst_num_elements(lst) == 1);
+	TEST_CHECK(fr_lst_pop(lst) == min);
+
+	TEST_CASE("Re-arming elements equal to the pivot");
+	for (i = 0; i < LST_EQUAL_SIZE; i++) {
+		values[i].data = i / 10;
+		TEST_CHECK(fr_lst_insert(lst, &values[i]) >= 0);
+	}
+
+	/*
+	 *	Move everything with the lowest key to the back.  The
+	 *	peek partitions the LST, so one of them is a pivot, and
+	 *	the others compare equal to it.
+	 */
+	for (i = 0; i < LST_EQUAL_SIZE; i++) {
+		min = fr_lst_peek(lst);
+		if (!TEST_CHECK(min != NULL)) break;
+
+		key = min->data;
+		for (j = 0; j < LST_EQUAL_SIZE; j++) {
+			TEST_CHECK(values[j].data >= key);
+			TEST_MSG("peek returned %u, but %u is in the LST", key, values[j].data);
+
+			if (values[j].data != key) continue;
+
+			TEST_CHECK(fr_lst_extract(lst, &values[j]) >= 0);
+			FR_LST_VERIFY(lst);
+			values[j].data = key + (LST_EQUAL_SIZE / 10);
+			TEST_CHECK(fr_lst_insert(lst, &values[j]) >= 0);
+		}
+	}
+	TEST_CHECK(fr_lst_num_elements(lst) == LST_EQUAL_SIZE);
+
+	talloc_free(lst);
+	free(values);
+}
+
 static void lst_iter(void)
 {
 	fr_lst_t	*lst;
@@ -573,6 +646,7 @@ TEST_LIST = {
 	{ "lst_stress_realloc",	lst_stress_realloc	},
 	{ "lst_burn_in",	lst_burn_in		},
 	{ "lst_cycle",		lst_cycle		},
+	{ "lst_extract_equal",	lst_extract_equal },
 	{ "lst_iter",		lst_iter },
 	{ "queue_cmp_10",	queue_cmp_10 },
 	{ "queue_cmp_50",	queue_cmp_50 },
@@ -27,6 +27,8 @@ RCSID("$Id$")
 
 #include <freeradius-devel/util/regex.h>
 #include <freeradius-devel/util/atexit.h>
+#include <freeradius-devel/util/dlist.h>
+#include <freeradius-devel/util/rb.h>
 
 #if defined(HAVE_REGEX_PCRE) || (defined(HAVE_REGEX_PCRE2) && defined(PCRE2_CONFIG_JIT))
 #ifndef FR_PCRE_JIT_STACK_MIN
@@ -49,6 +51,27 @@ RCSID("$Id$")
  *	libpcre2.
  */
 
+#ifndef FR_REGEX_CACHE_MAX
+#  define FR_REGEX_CACHE_MAX		256	//!< Maximum number of runtime patterns cached per thread.
+#endif
+#define FR_REGEX_CACHE_PATTERN_MAX	1024	//!< Longer patterns are never cached.
+#define FR_REGEX_CACHE_JIT_USES		2	//!< JIT cached patterns once they've been used this many times.
+
+/** A runtime pattern in the per-thread cache
+ *
+ */
+typedef struct {
+	fr_rb_node_t		node;		//!< Entry in the cache tree.
+	fr_dlist_t		entry;		//!< Entry in the LRU list.
+
+	uint32_t		cflags;		//!< Flags the pattern was compiled with.
+	uint8_t			*pattern;	//!< Copy of the pattern.
+	size_t			len;		//!< Length of the pattern.
+
+	regex_t			*preg;		//!< The compiled pattern.
+	unsigned int		uses;		//!< How many times the pattern has been used.
+} fr_regex_cache_entry_t;
+
 /** Thread local storage for PCRE2
  *
  * Not all this storage is thread local, but it simplifies cleanup if
@@ -60,10 +83,15 @@ typedef struct {
 	pcre2_general_context	*gcontext;	//!< General context.
 	pcre2_compile_context	*ccontext;	//!< Compile context.
 	pcre2_match_context	*mcontext;	//!< Match context.
+	pcre2_match_data	*match_data;	//!< Used when the caller doesn't want match data.
 #ifdef PCRE2_CONFIG_JIT
 	pcre2_jit_stack		*jit_stack;	//!< Jit stack for executing jit'd patterns.
 	bool			do_jit;		//!< Whether we have runtime JIT support.
 #endif
+
+	fr_rb_tree_t		*cache;		//!< Runtime patterns, keyed on pattern and flags.
+	fr_dlist_head_t		cache_lru;	//!< Least recently used at the head.
+	fr_regex_cache_stats_t	cache_stats;	//!< How well the cache is doing.
 } fr_pcre2_tls_t;
 
 /** Thread local storage for pcre2
@@ -97,6 +125,13 @@ static void _pcre2_talloc_free(void *to_free, UNUSED void *uctx)
  */
 static int _pcre2_tls_free(fr_pcre2_tls_t *tls)
 {
+	/*
+	 *	Cached patterns still referenced by
+	 *	captures are reparented.
+	 */
+	TALLOC_FREE(tls->cache);
+
+	if (tls->match_data) pcre2_match_data_free(tls->match_data);
 	if (tls->gcontext) pcre2_general_context_free(tls->gcontext);
 	if (tls->ccontext) pcre2_compile_context_free(tls->ccontext);
 	if (tls->mcontext) pcre2_match_context_free(tls->mcontext);
@@ -112,6 +147,21 @@ static int _pcre2_tls_free_on_exit(void *arg)
 	return talloc_free(arg);
 }
 
+static int8_t regex_cache_entry_cmp(void const *one, void const *two)
+{
+	fr_regex_cache_entry_t const *a = one, *b = two;
+	int ret;
+
+	ret = CMP(a->cflags, b->cflags);
+	if (ret != 0) return ret;
+
+	ret = CMP(a->len, b->len);
+	if (ret != 0) return ret;
+
+	ret = memcmp(a->pattern, b->pattern, a->len);
+	return CMP(ret, 0);
+}
+
 /** Thread local init for pcre2
  *
  */
@@ -146,6 +196,24 @@ static int fr_pcre2_tls_init(void)
 		goto error;
 	}
 
+	/*
+	 *	Only needs space for the whole match,
+	 *	pcre2_match returns 0 if there are more
+	 *	groups, which is still a match.
+	 */
+	tls->match_data = pcre2_match_data_create(1, tls->gcontext);
+	if (!tls->match_data) {
+		fr_strerror_const("Failed allocating match data");
+		goto error;
+	}
+
+	tls->cache = fr_rb_inline_talloc_alloc(tls, fr_regex_cache_entry_t, node, regex_cache_entry_cmp, NULL);
+	if (!tls->cache) {
+		fr_strerror_const("Failed allocating regex cache");
+		goto error;
+	}
+	fr_dlist_talloc_init(&tls->cache_lru, fr_regex_cache_entry_t, entry);
+
 #ifdef PCRE2_CONFIG_JIT
 	pcre2_config(PCRE2_CONFIG_JIT, &tls->do_jit);
 	if (tls->do_jit) {
@@ -180,6 +248,79 @@ static int _regex_free(regex_t *preg)
 	return 0;
 }
 
+/** Convert our flags to PCRE2 compile options
+ *
+ */
+static inline CC_HINT(always_inline) uint32_t regex_pcre2_cflags(fr_regex_flags_t const *flags, bool subcaptures)
+{
+	uint32_t cflags = 0;
+
+	if (flags) {
+		 /* flags->global implemented by substitution function */
+		if (flags->ignore_case) cflags |= PCRE2_CASELESS;
+		if (flags->multiline) cflags |= PCRE2_MULTILINE;
+		if (flags->dot_all) cflags |= PCRE2_DOTALL;
+		if (flags->unicode) cflags |= PCRE2_UTF;
+		if (flags->extended) cflags |= PCRE2_EXTENDED;
+	}
+
+	if (!subcaptures) cflags |= PCRE2_NO_AUTO_CAPTURE;
+
+	return cflags;
+}
+
+/** Compile a pattern with the given PCRE2 options
+ *
+ */
+static ssize_t regex_pcre2_compile(TALLOC_CTX *ctx, regex_t **out, char const *pattern, size_t len, uint32_t cflags)
+{
+	int		ret;
+	PCRE2_SIZE	offset;
+	regex_t		*preg;
+
+	preg = talloc_zero(ctx, regex_t);
+	talloc_set_destructor(preg, _regex_free);
+
+	preg->compiled = pcre2_compile((PCRE2_SPTR8)pattern, len,
+				       cflags, &ret, &offset, fr_pcre2_tls->ccontext);
+	if (!preg->compiled) {
+		PCRE2_UCHAR errbuff[128];
+
+		pcre2_get_error_message(ret, errbuff, sizeof(errbuff));
+		fr_strerror_printf("%s", (char *)errbuff);
+		talloc_free(preg);
+
+		return -(ssize_t)offset;
+	}
+
+	*out = preg;
+
+	return len;
+}
+
+#ifdef PCRE2_CONFIG_JIT
+/** Run a compiled pattern through the JIT
+ *
+ */
+static int regex_pcre2_jit(regex_t *preg)
+{
+	int ret;
+
+	ret = pcre2_jit_compile(preg->compiled, PCRE2_JIT_COMPLETE);
+	if (ret < 0) {
+		PCRE2_UCHAR errbuff[128];
+
+		pcre2_get_error_message(ret, errbuff, sizeof(errbuff));
+		fr_strerror_printf("Pattern JIT failed: %s", (char *)errbuff);
+
+		return -1;
+	}
+	preg->jitd = true;
+
+	return 0;
+}
+#endif
+
 /** Wrapper around pcre2_compile
  *
  * Allows the rest of the code to do compilations using one function signature.
@@ -203,9 +344,7 @@ static int _regex_free(regex_t *preg)
 ssize_t regex_compile(TALLOC_CTX *ctx, regex_t **out, char const *pattern, size_t len,
 		      fr_regex_flags_t const *flags, bool subcaptures, bool runtime)
 {
-	int		ret;
-	PCRE2_SIZE	offset;
-	uint32_t	cflags = 0;
+	ssize_t		slen;
 	regex_t		*preg;
 
 	/*
@@ -223,65 +362,155 @@ ssize_t regex_compile(TALLOC_CTX *ctx, regex_t **out, char const *pattern, size_
 		return 0;
 	}
 
-	/*
-	 *	Options
-	 */
-	if (flags) {
-		 /* flags->global implemented by substitution function */
-		if (flags->ignore_case) cflags |= PCRE2_CASELESS;
-		if (flags->multiline) cflags |= PCRE2_MULTILINE;
-		if (flags->dot_all) cflags |= PCRE2_DOTALL;
-		if (flags->unicode) cflags |= PCRE2_UTF;
-		if (flags->extended) cflags |= PCRE2_EXTENDED;
+	slen = regex_pcre2_compile(ctx, &preg, pattern, len, regex_pcre2_cflags(flags, subcaptures));
+	if (slen <= 0) return slen;
+
+	if (!runtime) {
+		preg->precompiled = true;
+
+#ifdef PCRE2_CONFIG_JIT
+		/*
+		 *	This is expensive, so only do it for
+		 *	expressions that are going to be
+		 *	evaluated repeatedly.
+		 */
+		if (fr_pcre2_tls->do_jit && (regex_pcre2_jit(preg) < 0)) {
+			talloc_free(preg);
+			return 0;
+		}
+#endif
 	}
 
-	if (!subcaptures) cflags |= PCRE2_NO_AUTO_CAPTURE;
+	*out = preg;
 
-	preg = talloc_zero(ctx, regex_t);
-	talloc_set_destructor(preg, _regex_free);
+	return len;
+}
 
-	preg->compiled = pcre2_compile((PCRE2_SPTR8)pattern, len,
-				       cflags, &ret, &offset, fr_pcre2_tls->ccontext);
-	if (!preg->compiled) {
-		PCRE2_UCHAR errbuff[128];
+/** Compile a runtime pattern, or retrieve it from the per-thread cache
+ *
+ * Patterns built from expansions are often the same from one request to
+ * the next, e.g. when they contain a realm.  Compiling them each time is
+ * expensive, so the last #FR_REGEX_CACHE_MAX patterns are kept for each
+ * thread.  Patterns are run through the JIT once they've been used
+ * #FR_REGEX_CACHE_JIT_USES times, so patterns which are unique to a
+ * request don't pay for the JIT.
+ *
+ * @note The returned pattern is owned by the cache, and must not be freed.
+ *	If it needs to outlive the current evaluation, take a talloc reference.
+ *
+ * @param[in] ctx		to allocate the pattern in if it can't be cached.
+ * @param[out] out		Where to write the compiled pattern.
+ * @param[in] pattern		to compile.
+ * @param[in] len		of pattern.
+ * @param[in] flags		controlling matching. May be NULL.
+ * @param[in] subcaptures	Whether to compile the regular expression to store subcapture
+ *				data.
+ * @return
+ *	- >= 1 on success.
+ *	- <= 0 on error. Negative value is offset of parse error.
+ */
+ssize_t regex_compile_cached(TALLOC_CTX *ctx, regex_t **out, char const *pattern, size_t len,
+			     fr_regex_flags_t const *flags, bool subcaptures)
+{
+	fr_pcre2_tls_t		*tls;
+	fr_regex_cache_entry_t	find, *entry;
+	ssize_t			slen;
 
-		pcre2_get_error_message(ret, errbuff, sizeof(errbuff));
-		fr_strerror_printf("%s", (char *)errbuff);
-		talloc_free(preg);
+	*out = NULL;
 
-		return -(ssize_t)offset;
+	if (unlikely(!fr_pcre2_tls) && (fr_pcre2_tls_init() < 0)) return -1;
+	tls = fr_pcre2_tls;
+
+	if (len > FR_REGEX_CACHE_PATTERN_MAX) return regex_compile(ctx, out, pattern, len, flags, subcaptures, true);
+
+	if (len == 0) {
+		fr_strerror_const("Empty expression");
+		return 0;
 	}
 
-	if (!runtime) {
-		preg->precompiled = true;
+	find = (fr_regex_cache_entry_t) {
+		.cflags = regex_pcre2_cflags(flags, subcaptures),
+		.pattern = UNCONST(uint8_t *, pattern),
+		.len = len
+	};
+
+	entry = fr_rb_find(tls->cache, &find);
+	if (entry) {
+		tls->cache_stats.hits++;
+
+		fr_dlist_remove(&tls->cache_lru, entry);
+		fr_dlist_insert_tail(&tls->cache_lru, entry);
 
 #ifdef PCRE2_CONFIG_JIT
 		/*
-		 *	This is expensive, so only do it for
-		 *	expressions that are going to be
-		 *	evaluated repeatedly.
+		 *	If the JIT fails we just keep using
+		 *	the interpreter.
 		 */
-		if (fr_pcre2_tls->do_jit) {
-			ret = pcre2_jit_compile(preg->compiled, PCRE2_JIT_COMPLETE);
-			if (ret < 0) {
-				PCRE2_UCHAR errbuff[128];
+		if ((++entry->uses == FR_REGEX_CACHE_JIT_USES) && tls->do_jit) (void) regex_pcre2_jit(entry->preg);
+#endif
 
-				pcre2_get_error_message(ret, errbuff, sizeof(errbuff));
-				fr_strerror_printf("Pattern JIT failed: %s", (char *)errbuff);
-				talloc_free(preg);
+		*out = entry->preg;
+		return len;
+	}
 
-				return 0;
-			}
-			preg->jitd = true;
-		}
-#endif
+	tls->cache_stats.misses++;
+
+	/*
+	 *	Make space
+	 */
+	while (fr_dlist_num_elements(&tls->cache_lru) >= FR_REGEX_CACHE_MAX) {
+		entry = fr_dlist_pop_head(&tls->cache_lru);
+		fr_rb_delete(tls->cache, entry);
+		talloc_free(entry);	/* Referenced patterns are reparented */
+
+		tls->cache_stats.evictions++;
 	}
 
-	*out = preg;
+	entry = talloc_zero(tls->cache, fr_regex_cache_entry_t);
+	if (unlikely(!entry)) {
+	oom:
+		fr_strerror_const("Out of memory");
+		return -1;
+	}
+
+	slen = regex_pcre2_compile(entry, &entry->preg, pattern, len, find.cflags);
+	if (slen <= 0) {
+		talloc_free(entry);
+		return slen;
+	}
+	entry->pattern = talloc_memdup(entry, pattern, len);
+	if (unlikely(!entry->pattern)) {
+		talloc_free(entry);
+		goto oom;
+	}
+	entry->preg->cached = true;
+	entry->cflags = find.cflags;
+	entry->len = len;
+	entry->uses = 1;
+
+	fr_rb_insert(tls->cache, entry);
+	fr_dlist_insert_tail(&tls->cache_lru, entry);
+
+	*out = entry->preg;
 
 	return len;
 }
 
+/** Return statistics for the current thread's runtime pattern cache
+ *
+ * @param[out] stats	Where to write the statistics.
+ */
+void regex_cache_stats(fr_regex_cache_stats_t *stats)
+{
+	if (!fr_pcre2_tls) {
+		memset(stats, 0, sizeof(*stats));
+		return;
+	}
+
+	*stats = fr_pcre2_tls->cache_stats;
+	stats->entries = fr_dlist_num_elements(&fr_pcre2_tls->cache_lru);
+}
+
 /** Wrapper around pcre2_exec
  *
  * @param[in] preg	The compiled expression.
@@ -355,15 +584,11 @@ int regex_exec(regex_t *preg, char const *subject, size_t len, fr_regmatch_t *re
 
 	/*
 	 *	If we weren't given match data we
-	 *	need to alloc it else pcre2_match
+	 *	use the thread's, else pcre2_match
 	 *	fails when passed NULL match data.
 	 */
 	if (!regmatch) {
-		match_data = pcre2_match_data_create_from_pattern(preg->compiled, fr_pcre2_tls->gcontext);
-		if (!match_data) {
-			fr_strerror_const("Failed allocating temporary match data");
-			return -1;
-		}
+		match_data = fr_pcre2_tls->match_data;
 	} else {
 		match_data = regmatch->match_data;
 	}
@@ -378,7 +603,6 @@ int regex_exec(regex_t *preg, char const *subject, size_t len, fr_regmatch_t *re
 		ret = pcre2_match(preg->compiled, (PCRE2_SPTR8)subject, len, 0, options,
 				  match_data, fr_pcre2_tls->mcontext);
 	}
-	if (!regmatch) pcre2_match_data_free(match_data);
 	if (ret < 0) {
 		PCRE2_UCHAR	errbuff[128];
 
@@ -1258,6 +1482,27 @@ fr_regmatch_t *regex_match_data_alloc(TALLOC_CTX *ctx, uint32_t count)
  *########################################
  */
 
+#ifndef HAVE_REGEX_PCRE2
+/** Compile a runtime pattern
+ *
+ * Only libpcre2 has a cache of runtime patterns, other libraries
+ * compile the pattern every time.
+ *
+ * @note The returned pattern is allocated in ctx, and must not be freed
+ *	by the caller, for compatibility with the caching implementation.
+ */
+ssize_t regex_compile_cached(TALLOC_CTX *ctx, regex_t **out, char const *pattern, size_t len,
+			     fr_regex_flags_t const *flags, bool subcaptures)
+{
+	return regex_compile(ctx, out, pattern, len, flags, subcaptures, true);
+}
+
+void regex_cache_stats(fr_regex_cache_stats_t *stats)
+{
+	memset(stats, 0, sizeof(*stats));
+}
+#endif
+
 /** Parse a string containing one or more regex flags
  *
  * @param[out] err		May be NULL. If not NULL will be set to:
@@ -1393,7 +1638,7 @@ int fr_regex_cmp_op(fr_token_t op, fr_value_box_t const *a, fr_value_box_t const
 		lhs_len = a->vb_length;
 	}
 
-	if (regex_compile(ctx, &regex, b->vb_strvalue, b->vb_length, NULL, false, true) < 0) {
+	if (regex_compile_cached(ctx, &regex, b->vb_strvalue, b->vb_length, NULL, false) < 0) {
 		talloc_free(ctx);
 		return -1;
 	}
@@ -0,0 +1,203 @@
+/*
+ *   This library is free software; you can redistribute it and/or
+ *   modify it under the terms of the GNU Lesser General Public
+ *   License as published by the Free Software Foundation; either
+ *   version 2.1 of the License, or (at your option) any later version.
+ *
+ *   This library is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ *   Lesser General Public License for more details.
+ *
+ *   You should have received a copy of the GNU Lesser General Public
+ *   License along with this library; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+/** Tests for the runtime regex cache
+ *
+ * @file src/lib/util/regex_tests.c
+ *
+ * @copyright 2024 The FreeRADIUS server project
+ */
+#include <freeradius-devel/util/acutest.h>
+#include <freeradius-devel/util/acutest_helpers.h>
+#include <freeradius-devel/util/regex.h>
+#include <freeradius-devel/util/time.h>
+
+#if defined(HAVE_REGEX) && defined(HAVE_REGEX_PCRE2)
+static char const *realms[] = {
+	"example.com",
+	"example.org",
+	"example.net",
+	"test.example.com",
+	"eduroam.example.edu",
+	"roaming.example.ac.uk",
+	"corp.example.io",
+	"guest.example.co"
+};
+
+static char const *subjects[] = {
+	"bob@example.com",
+	"alice@eduroam.example.edu",
+	"carol@example.org",
+	"dave@nowhere.invalid"
+};
+
+/** Build the sort of pattern a policy matching on realms would expand
+ *
+ */
+static size_t realm_pattern(char *buff, size_t len, char const *realm)
+{
+	return snprintf(buff, len, "^[^@]+@%s$", realm);
+}
+
+static void test_regex_cache_hits(void)
+{
+	fr_regex_cache_stats_t	before, after;
+	regex_t			*one, *two, *other;
+	fr_regex_flags_t	flags = { .ignore_case = 1 };
+
+	regex_cache_stats(&before);
+
+	TEST_CHECK(regex_compile_cached(NULL, &one, "^bob$", 5, NULL, false) == 5);
+	TEST_CHECK(regex_compile_cached(NULL, &two, "^bob$", 5, NULL, false) == 5);
+	TEST_CHECK(one == two);
+	TEST_CHECK(one->cached);
+
+	/*
+	 *	Different flags are a different pattern.
+	 */
+	TEST_CHECK(regex_compile_cached(NULL, &other, "^bob$", 5, &flags, false) == 5);
+	TEST_CHECK(other != one);
+	TEST_CHECK(regex_compile_cached(NULL, &other, "^bob$", 5, NULL, true) == 5);
+	TEST_CHECK(other != one);
+
+	TEST_CHECK(regex_exec(one, "bob", 3, NULL) == 1);
+	TEST_CHECK(regex_exec(one, "BOB", 3, NULL) == 0);
+
+	regex_cache_stats(&after);
+	TEST_CHECK(after.hits - before.hits == 1);
+	TEST_MSG("Expected 1 hit, got %"PRIu64, after.hits - before.hits);
+	TEST_CHECK(after.misses - before.misses == 3);
+	TEST_MSG("Expected 3 misses, got %"PRIu64, after.misses - before.misses);
+}
+
+static void test_regex_cache_errors(void)
+{
+	regex_t *preg;
+
+	TEST_CHECK(regex_compile_cached(NULL, &preg, "", 0, NULL, false) == 0);
+	TEST_CHECK(preg == NULL);
+
+	TEST_CHECK(regex_compile_cached(NULL, &preg, "^(bob", 5, NULL, false) <= 0);
+	TEST_CHECK(preg == NULL);
+
+	/*
+	 *	Errors aren't cached.
+	 */
+	TEST_CHECK(regex_compile_cached(NULL, &preg, "^(bob", 5, NULL, false) <= 0);
+	TEST_CHECK(preg == NULL);
+}
+
+static void test_regex_cache_evict(void)
+{
+	fr_regex_cache_stats_t	before, after;
+	regex_t			*preg, *first;
+	void			*holder;
+	char			buff[64];
+	size_t			len;
+	unsigned int		i;
+
+	regex_cache_stats(&before);
+
+	len = snprintf(buff, sizeof(buff), "^evict-first$");
+	TEST_CHECK(regex_compile_cached(NULL, &first, buff, len, NULL, true) > 0);
+
+	/*
+	 *	Hold a reference, as a capture would.
+	 */
+	holder = talloc_init_const("holder");
+	TEST_CHECK(talloc_reference(holder, first) != NULL);
+
+	for (i = 0; i < 1024; i++) {
+		len = snprintf(buff, sizeof(buff), "^evict-%u$", i);
+		TEST_CHECK(regex_compile_cached(NULL, &preg, buff, len, NULL, true) > 0);
+	}
+
+	regex_cache_stats(&after);
+	TEST_CHECK(after.evictions > before.evictions);
+	TEST_CHECK(after.entries <= 1024);
+
+	/*
+	 *	Still usable after being evicted.
+	 */
+	TEST_CHECK(regex_exec(first, "evict-first", 11, NULL) == 1);
+	talloc_free(holder);
+}
+
+#define REGEX_CMP_CYCLES	(100000)
+
+/** Compare compiling dynamic realm patterns each time against the cache
+ *
+ */
+static void regex_cache_cmp(void)
+{
+	char		buff[128];
+	size_t		len;
+	unsigned int	i;
+	fr_time_t	start, end;
+	regex_t		*preg;
+	uint64_t	matched = 0;
+
+	start = fr_time();
+	for (i = 0; i < REGEX_CMP_CYCLES; i++) {
+		char const *subject = subjects[i % NUM_ELEMENTS(subjects)];
+
+		len = realm_pattern(buff, sizeof(buff), realms[i % NUM_ELEMENTS(realms)]);
+		TEST_CHECK(regex_compile(NULL, &preg, buff, len, NULL, false, true) > 0);
+		matched += (regex_exec(preg, subject, strlen(subject), NULL) == 1);
+		talloc_free(preg);
+	}
+	end = fr_time();
+
+	TEST_MSG_ALWAYS("\ncycles: %u, matched %"PRIu64"\n", REGEX_CMP_CYCLES, matched);
+	TEST_MSG_ALWAYS("compile: %.0f ops/s\n",
+			REGEX_CMP_CYCLES / (fr_time_delta_unwrap(fr_time_sub(end, start)) / (double)NSEC));
+
+	matched = 0;
+	start = fr_time();
+	for (i = 0; i < REGEX_CMP_CYCLES; i++) {
+		char const *subject = subjects[i % NUM_ELEMENTS(subjects)];
+
+		len = realm_pattern(buff, sizeof(buff), realms[i % NUM_ELEMENTS(realms)]);
+		TEST_CHECK(regex_compile_cached(NULL, &preg, buff, len, NULL, false) > 0);
+		matched += (regex_exec(preg, subject, strlen(subject), NULL) == 1);
+	}
+	end = fr_time();
+
+	TEST_MSG_ALWAYS("cycles: %u, matched %"PRIu64"\n", REGEX_CMP_CYCLES, matched);
+	TEST_MSG_ALWAYS("cached: %.0f ops/s\n",
+			REGEX_CMP_CYCLES / (fr_time_delta_unwrap(fr_time_sub(end, start)) / (double)NSEC));
+
+	{
+		fr_regex_cache_stats_t stats;
+
+		regex_cache_stats(&stats);
+		TEST_MSG_ALWAYS("hits: %"PRIu64", misses: %"PRIu64", evictions: %"PRIu64", entries: %u\n",
+				stats.hits, stats.misses, stats.evictions, stats.entries);
+	}
+}
+
+TEST_LIST = {
+	{ "test_regex_cache_hits",	test_regex_cache_hits },
+	{ "test_regex_cache_errors",	test_regex_cache_errors },
+	{ "test_regex_cache_evict",	test_regex_cache_evict },
+	{ "regex_cache_cmp",		regex_cache_cmp },
+	{ NULL }
+};
+#else
+TEST_LIST = {
+	{ NULL }
+};
+#endif
@@ -0,0 +1,380 @@
+/*
+ *   This library is free software; you can redistribute it and/or
+ *   modify it under the terms of the GNU Lesser General Public
+ *   License as published by the Free Software Foundation; either
+ *   version 2.1 of the License, or (at your option) any later version.
+ *
+ *   This library is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ *   Lesser General Public License for more details.
+ *
+ *   You should have received a copy of the GNU Lesser General Public
+ *   License along with this library; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+/** Hierarchical timer wheel
+ *
+ * Time is divided into ticks.  The wheel has four levels of 256 slots.
+ * Level 0 has one slot per tick, level 1 one slot per 256 ticks, and so
+ * on.  Timers are put into the lowest level which can hold them, and are
+ * moved down a level ("cascaded") when the wheel gets to their slot.
+ *
+ * Inserting and deleting a timer is O(1), and needs no memory allocation,
+ * as the timer is embedded in the structure it's for.  The cost is
+ * precision: timers fire on the first tick at or after the time they were
+ * set for, so they're up to one tick late, but never early.
+ *
+ * This is useful where there are many timers, most of which are deleted
+ * or moved before they fire, e.g. protocol keepalives and timeouts.
+ *
+ * @file src/lib/util/timer_wheel.c
+ *
+ * @copyright 2024 The FreeRADIUS server project
+ */
+RCSID("$Id$")
+
+#include <freeradius-devel/util/timer_wheel.h>
+
+#define TW_LEVELS		(4)
+#define TW_BITS			(8)
+#define TW_SLOTS		(1 << TW_BITS)
+#define TW_MASK			(TW_SLOTS - 1)
+
+#define TW_LEVEL_SHIFT(_level)	((_level) * TW_BITS)
+#define TW_MAX_DELTA		((UINT64_C(1) << (TW_LEVELS * TW_BITS)) - 1)
+
+struct fr_timer_wheel_s {
+	fr_time_t		base;				//!< time of tick 0.
+	fr_time_delta_t		tick;				//!< length of a tick.
+
+	uint64_t		now;				//!< the last tick we ran.
+	uint64_t		next;				//!< no timers fire before this tick.
+								///< 0 if it needs to be recalculated.
+	uint32_t		num_elements;
+	uint32_t		level_elements[TW_LEVELS];	//!< number of timers in each level.
+
+	fr_dlist_head_t		slots[TW_LEVELS][TW_SLOTS];
+};
+
+/** Convert a time to a tick, rounding up so that timers never fire early
+ *
+ */
+static inline uint64_t timer_wheel_tick(fr_timer_wheel_t const *tw, fr_time_t when)
+{
+	int64_t delta;
+	int64_t tick = fr_time_delta_unwrap(tw->tick);
+
+	delta = fr_time_delta_unwrap(fr_time_sub(when, tw->base));
+	if (delta <= 0) return 0;
+
+	return (delta + tick - 1) / tick;
+}
+
+#define TW_SLOT_LEVEL(_tw, _slot)	((unsigned int) (((_slot) - &(_tw)->slots[0][0]) >> TW_BITS))
+
+/** Take an entry out of its slot
+ *
+ */
+static inline void timer_wheel_unlink(fr_timer_wheel_t *tw, fr_timer_wheel_entry_t *entry)
+{
+	fr_dlist_remove(entry->slot, entry);
+	tw->level_elements[TW_SLOT_LEVEL(tw, entry->slot)]--;
+	entry->slot = NULL;
+}
+
+/** Put an entry into the right slot for its tick
+ *
+ *  The caller ensures that entry->tick is not before tw->now.
+ */
+static void timer_wheel_place(fr_timer_wheel_t *tw, fr_timer_wheel_entry_t *entry)
+{
+	uint64_t	tick = entry->tick;
+	uint64_t	delta = tick - tw->now;
+	unsigned int	level;
+
+	/*
+	 *	Too far in the future.  Park it in the top level, and
+	 *	it will be moved down as the wheel turns.
+	 */
+	if (delta > TW_MAX_DELTA) {
+		tick = tw->now + TW_MAX_DELTA;
+		delta = TW_MAX_DELTA;
+	}
+
+	for (level = 0; level < (TW_LEVELS - 1); level++) {
+		if (delta < (UINT64_C(1) << TW_LEVEL_SHIFT(level + 1))) break;
+	}
+
+	entry->slot = &tw->slots[level][(tick >> TW_LEVEL_SHIFT(level)) & TW_MASK];
+	fr_dlist_insert_tail(entry->slot, entry);
+	tw->level_elements[level]++;
+}
+
+/** Move the entries in a slot down to the lower levels
+ *
+ */
+static void timer_wheel_cascade(fr_timer_wheel_t *tw, unsigned int level)
+{
+	fr_dlist_head_t		*slot = &tw->slots[level][(tw->now >> TW_LEVEL_SHIFT(level)) & TW_MASK];
+	fr_timer_wheel_entry_t	*entry;
+
+	while ((entry = fr_dlist_head(slot)) != NULL) {
+		timer_wheel_unlink(tw, entry);
+		timer_wheel_place(tw, entry);
+	}
+}
+
+/** Allocate a timer wheel
+ *
+ * @param[in] ctx	to allocate the wheel in.
+ * @param[in] tick	the resolution of the timers.
+ * @param[in] now	the current time.
+ * @return
+ *	- The new timer wheel.
+ *	- NULL on error.
+ */
+fr_timer_wheel_t *fr_timer_wheel_alloc(TALLOC_CTX *ctx, fr_time_delta_t tick, fr_time_t now)
+{
+	fr_timer_wheel_t	*tw;
+	unsigned int		i, j;
+
+	if (!fr_time_delta_ispos(tick)) {
+		fr_strerror_const("Timer wheel tick must be greater than zero");
+		return NULL;
+	}
+
+	tw = talloc_zero(ctx, fr_timer_wheel_t);
+	if (!tw) {
+		fr_strerror_const("Out of memory");
+		return NULL;
+	}
+
+	tw->base = now;
+	tw->tick = tick;
+
+	for (i = 0; i < TW_LEVELS; i++) {
+		for (j = 0; j < TW_SLOTS; j++) fr_dlist_init(&tw->slots[i][j], fr_timer_wheel_entry_t, entry);
+	}
+
+	return tw;
+}
+
+/** Arm a timer, or move it if it's already armed
+ *
+ * @param[in] tw	to insert the timer into.
+ * @param[in] entry	the timer, initialised with fr_timer_wheel_entry_init().
+ * @param[in] when	to fire.  Times in the past fire on the next tick.
+ */
+void fr_timer_wheel_insert(fr_timer_wheel_t *tw, fr_timer_wheel_entry_t *entry, fr_time_t when)
+{
+	if (entry->slot) {
+		timer_wheel_unlink(tw, entry);
+	} else {
+		tw->num_elements++;
+	}
+
+	entry->when = when;
+	entry->tick = timer_wheel_tick(tw, when);
+
+	/*
+	 *	We've already run this tick.
+	 */
+	if (entry->tick <= tw->now) entry->tick = tw->now + 1;
+
+	if (tw->next && (entry->tick < tw->next)) tw->next = entry->tick;
+
+	timer_wheel_place(tw, entry);
+}
+
+/** Disarm a timer
+ *
+ *  Does nothing if the timer isn't armed.
+ */
+void fr_timer_wheel_delete(fr_timer_wheel_t *tw, fr_timer_wheel_entry_t *entry)
+{
+	if (!entry->slot) return;
+
+	timer_wheel_unlink(tw, entry);
+	tw->num_elements--;
+}
+
+/** Fire all of the timers which are due
+ *
+ * @param[in] tw	to run.
+ * @param[in] now	the current time.
+ * @return the number of timers which fired.
+ */
+unsigned int fr_timer_wheel_run(fr_timer_wheel_t *tw, fr_time_t now)
+{
+	uint64_t		target;
+	unsigned int		fired = 0;
+	fr_timer_wheel_entry_t	*entry;
+
+	/*
+	 *	Run every tick which has started.  Timers in that tick
+	 *	were set for a time which has passed.
+	 */
+	if (fr_time_lteq(now, tw->base)) return 0;
+	target = fr_time_delta_unwrap(fr_time_sub(now, tw->base)) / fr_time_delta_unwrap(tw->tick);
+
+	while (tw->now < target) {
+		unsigned int level;
+		fr_dlist_head_t *slot;
+
+		/*
+		 *	Nothing to do, skip ahead.
+		 */
+		if (!tw->num_elements) {
+			tw->now = target;
+			break;
+		}
+
+		/*
+		 *	If the lower levels are empty, nothing can
+		 *	happen until the next level which has timers
+		 *	is cascaded.  Skip to the tick before that.
+		 */
+		for (level = 0; (level < (TW_LEVELS - 1)) && !tw->level_elements[level]; level++);
+		if (level > 0) {
+			uint64_t skip = tw->now | ((UINT64_C(1) << TW_LEVEL_SHIFT(level)) - 1);
+
+			if (skip >= target) {
+				tw->now = target;
+				break;
+			}
+			tw->now = skip;
+		}
+
+		tw->now++;
+
+		for (level = 1; level < TW_LEVELS; level++) {
+			if ((tw->now & ((UINT64_C(1) << TW_LEVEL_SHIFT(level)) - 1)) != 0) break;
+
+			timer_wheel_cascade(tw, level);
+		}
+
+		slot = &tw->slots[0][tw->now & TW_MASK];
+
+		/*
+		 *	Callbacks may insert and delete other timers,
+		 *	so we pop one at a time.
+		 */
+		while ((entry = fr_dlist_head(slot)) != NULL) {
+			timer_wheel_unlink(tw, entry);
+			tw->num_elements--;
+			fired++;
+
+			entry->callback(tw, now, entry->uctx);
+		}
+	}
+
+	tw->next = 0;
+
+	return fired;
+}
+
+/** Find the first tick which may have timers to fire
+ *
+ *  Level 0 has the exact tick.  For the other levels, it's the tick
+ *  where the first slot with timers is cascaded.
+ */
+static uint64_t timer_wheel_next_tick(fr_timer_wheel_t const *tw)
+{
+	uint64_t	next = UINT64_MAX;
+	unsigned int	level, i;
+
+	for (level = 0; level < TW_LEVELS; level++) {
+		uint64_t pos = tw->now >> TW_LEVEL_SHIFT(level);
+
+		if (!tw->level_elements[level]) continue;
+
+		for (i = 1; i <= TW_SLOTS; i++) {
+			if (fr_dlist_num_elements(&tw->slots[level][(pos + i) & TW_MASK]) == 0) continue;
+
+			if (((pos + i) << TW_LEVEL_SHIFT(level)) < next) next = (pos + i) << TW_LEVEL_SHIFT(level);
+			break;
+		}
+	}
+
+	return next;
+}
+
+/** When fr_timer_wheel_run() should next be called
+ *
+ *  This may be earlier than the next timer, but is never later.
+ *
+ * @return
+ *	- The time of the next tick which may have timers to fire.
+ *	- 0 if there are no timers.
+ */
+fr_time_t fr_timer_wheel_next(fr_timer_wheel_t *tw)
+{
+	if (!tw->num_elements) return fr_time_wrap(0);
+
+	if (!tw->next) tw->next = timer_wheel_next_tick(tw);
+
+	return fr_time_add(tw->base, fr_time_delta_wrap(tw->next * fr_time_delta_unwrap(tw->tick)));
+}
+
+/** Start iterating over the armed timers, in no particular order
+ *
+ *  Timers must not be deleted while iterating, other than ones the iterator
+ *  has already moved past.
+ *
+ * @param[in] tw	to iterate over.
+ * @param[out] iter	to initialise.
+ * @return
+ *	- The first timer.
+ *	- NULL if there are no timers.
+ */
+fr_timer_wheel_entry_t *fr_timer_wheel_iter_init(fr_timer_wheel_t *tw, fr_timer_wheel_iter_t *iter)
+{
+	iter->slot = 0;
+	iter->entry = NULL;
+
+	return fr_timer_wheel_iter_next(tw, iter);
+}
+
+/** Get the next armed timer
+ *
+ * @param[in] tw	to iterate over.
+ * @param[in] iter	from fr_timer_wheel_iter_init().
+ * @return
+ *	- The next timer.
+ *	- NULL if there are no more timers.
+ */
+fr_timer_wheel_entry_t *fr_timer_wheel_iter_next(fr_timer_wheel_t *tw, fr_timer_wheel_iter_t *iter)
+{
+	fr_dlist_head_t *slots = &tw->slots[0][0];
+
+	if (iter->entry) {
+		iter->entry = fr_dlist_next(&slots[iter->slot], iter->entry);
+		if (iter->entry) return iter->entry;
+		iter->slot++;
+	}
+
+	for (; iter->slot < (TW_LEVELS * TW_SLOTS); iter->slot++) {
+		iter->entry = fr_dlist_head(&slots[iter->slot]);
+		if (iter->entry) return iter->entry;
+	}
+
+	return NULL;
+}
+
+/** The number of armed timers
+ *
+ */
+uint32_t fr_timer_wheel_num_elements(fr_timer_wheel_t const *tw)
+{
+	return tw->num_elements;
+}
+
+/** The resolution of the timers
+ *
+ */
+fr_time_delta_t fr_timer_wheel_tick(fr_timer_wheel_t const *tw)
+{
+	return tw->tick;
+}
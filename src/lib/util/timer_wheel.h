@@ -0,0 +1,112 @@
+#pragma once
+/*
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+/** Hierarchical timer wheel
+ *
+ * @file src/lib/util/timer_wheel.h
+ *
+ * @copyright 2024 The FreeRADIUS server project
+ */
+RCSIDH(timer_wheel_h, "$Id$")
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <freeradius-devel/build.h>
+#include <freeradius-devel/util/dlist.h>
+#include <freeradius-devel/util/talloc.h>
+#include <freeradius-devel/util/time.h>
+
+typedef struct fr_timer_wheel_s fr_timer_wheel_t;
+
+/** Called when a timer fires
+ *
+ * The entry has been removed from the wheel, and may be inserted again.
+ *
+ * @param[in] tw	the timer wheel.
+ * @param[in] now	the time passed to fr_timer_wheel_run().
+ * @param[in] uctx	from fr_timer_wheel_entry_init().
+ */
+typedef void (*fr_timer_wheel_cb_t)(fr_timer_wheel_t *tw, fr_time_t now, void *uctx);
+
+/** A timer, which is embedded in the structure it's for
+ *
+ * The fields are private to the timer wheel.
+ */
+typedef struct {
+	fr_dlist_t		entry;			//!< in a slot of the wheel.
+	fr_dlist_head_t		*slot;			//!< the slot we're in, or NULL if we're not armed.
+	uint64_t		tick;			//!< the tick we fire on.
+	fr_time_t		when;			//!< when we were asked to fire.
+	fr_timer_wheel_cb_t	callback;
+	void			*uctx;
+} fr_timer_wheel_entry_t;
+
+/** For iterating over the armed timers
+ *
+ */
+typedef struct {
+	unsigned int		slot;
+	fr_timer_wheel_entry_t	*entry;
+} fr_timer_wheel_iter_t;
+
+fr_timer_wheel_t	*fr_timer_wheel_alloc(TALLOC_CTX *ctx, fr_time_delta_t tick, fr_time_t now);
+
+/** Initialise a timer before it's first used
+ *
+ * @param[in] entry	to initialise.
+ * @param[in] callback	to call when the timer fires.
+ * @param[in] uctx	to pass to the callback.
+ */
+static inline void fr_timer_wheel_entry_init(fr_timer_wheel_entry_t *entry, fr_timer_wheel_cb_t callback, void *uctx)
+{
+	*entry = (fr_timer_wheel_entry_t) {
+		.callback = callback,
+		.uctx = uctx,
+	};
+	fr_dlist_entry_init(&entry->entry);
+}
+
+/** Whether a timer is waiting to fire
+ *
+ */
+static inline bool fr_timer_wheel_entry_armed(fr_timer_wheel_entry_t const *entry)
+{
+	return (entry->slot != NULL);
+}
+
+void			fr_timer_wheel_insert(fr_timer_wheel_t *tw, fr_timer_wheel_entry_t *entry,
+					      fr_time_t when) CC_HINT(nonnull);
+
+void			fr_timer_wheel_delete(fr_timer_wheel_t *tw, fr_timer_wheel_entry_t *entry) CC_HINT(nonnull);
+
+unsigned int		fr_timer_wheel_run(fr_timer_wheel_t *tw, fr_time_t now) CC_HINT(nonnull);
+
+fr_time_t		fr_timer_wheel_next(fr_timer_wheel_t *tw) CC_HINT(nonnull);
+
+fr_timer_wheel_entry_t	*fr_timer_wheel_iter_init(fr_timer_wheel_t *tw, fr_timer_wheel_iter_t *iter) CC_HINT(nonnull);
+
+fr_timer_wheel_entry_t	*fr_timer_wheel_iter_next(fr_timer_wheel_t *tw, fr_timer_wheel_iter_t *iter) CC_HINT(nonnull);
+
+uint32_t		fr_timer_wheel_num_elements(fr_timer_wheel_t const *tw) CC_HINT(nonnull);
+
+fr_time_delta_t		fr_timer_wheel_tick(fr_timer_wheel_t const *tw) CC_HINT(nonnull);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,604 @@
+/*
+ *   This library is free software; you can redistribute it and/or
+ *   modify it under the terms of the GNU Lesser General Public
+ *   License as published by the Free Software Foundation; either
+ *   version 2.1 of the License, or (at your option) any later version.
+ *
+ *   This library is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ *   Lesser General Public License for more details.
+ *
+ *   You should have received a copy of the GNU Lesser General Public
+ *   License along with this library; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+/** Tests for the hierarchical timer wheel
+ *
+ * @file src/lib/util/timer_wheel_tests.c
+ *
+ * @copyright 2024 The FreeRADIUS server project
+ */
+#include <freeradius-devel/util/acutest.h>
+#include <freeradius-devel/util/acutest_helpers.h>
+#include <freeradius-devel/util/event.h>
+#include <freeradius-devel/util/lst.h>
+#include <freeradius-devel/util/rand.h>
+#include <freeradius-devel/util/timer_wheel.h>
+
+#define TICK		fr_time_delta_from_msec(1)
+
+typedef struct {
+	fr_timer_wheel_entry_t	ev;
+	fr_time_t		when;		//!< what we asked for.
+	fr_time_t		fired;		//!< when the wheel was run.
+	unsigned int		count;
+} tw_thing_t;
+
+static void tw_fired(UNUSED fr_timer_wheel_t *tw, fr_time_t now, void *uctx)
+{
+	tw_thing_t *thing = uctx;
+
+	thing->fired = now;
+	thing->count++;
+}
+
+/** Run the wheel one tick at a time, up to "end"
+ *
+ */
+static unsigned int tw_run_until(fr_timer_wheel_t *tw, fr_time_t start, fr_time_t end)
+{
+	fr_time_t	now;
+	unsigned int	fired = 0;
+
+	for (now = start; fr_time_lteq(now, end); now = fr_time_add(now, TICK)) {
+		fired += fr_timer_wheel_run(tw, now);
+	}
+
+	return fired;
+}
+
+static void test_timer_wheel_basic(void)
+{
+	fr_timer_wheel_t	*tw;
+	fr_time_t		start = fr_time_wrap(NSEC);
+	tw_thing_t		things[64];
+	unsigned int		i;
+
+	tw = fr_timer_wheel_alloc(NULL, TICK, start);
+	TEST_CHECK(tw != NULL);
+
+	for (i = 0; i < NUM_ELEMENTS(things); i++) {
+		things[i] = (tw_thing_t) { .when = fr_time_add(start, fr_time_delta_from_usec((i * 1777) + 1)) };
+		fr_timer_wheel_entry_init(&things[i].ev, tw_fired, &things[i]);
+		fr_timer_wheel_insert(tw, &things[i].ev, things[i].when);
+		TEST_CHECK(fr_timer_wheel_entry_armed(&things[i].ev));
+	}
+	TEST_CHECK(fr_timer_wheel_num_elements(tw) == NUM_ELEMENTS(things));
+
+	TEST_CHECK(tw_run_until(tw, start, fr_time_add(start, fr_time_delta_from_sec(1))) == NUM_ELEMENTS(things));
+	TEST_CHECK(fr_timer_wheel_num_elements(tw) == 0);
+
+	/*
+	 *	Never early, and never more than one tick late.
+	 */
+	for (i = 0; i < NUM_ELEMENTS(things); i++) {
+		TEST_CHECK(things[i].count == 1);
+		TEST_CHECK(fr_time_gteq(things[i].fired, things[i].when));
+		TEST_CHECK(fr_time_delta_lteq(fr_time_sub(things[i].fired, things[i].when), TICK));
+		TEST_MSG("timer %u fired %"PRId64"ns late", i,
+			 fr_time_delta_unwrap(fr_time_sub(things[i].fired, things[i].when)));
+		TEST_CHECK(!fr_timer_wheel_entry_armed(&things[i].ev));
+	}
+
+	talloc_free(tw);
+}
+
+static void test_timer_wheel_delete(void)
+{
+	fr_timer_wheel_t	*tw;
+	fr_time_t		start = fr_time_wrap(NSEC);
+	tw_thing_t		a, b;
+
+	tw = fr_timer_wheel_alloc(NULL, TICK, start);
+
+	fr_timer_wheel_entry_init(&a.ev, tw_fired, &a);
+	fr_timer_wheel_entry_init(&b.ev, tw_fired, &b);
+	a.count = b.count = 0;
+
+	fr_timer_wheel_insert(tw, &a.ev, fr_time_add(start, fr_time_delta_from_msec(10)));
+	fr_timer_wheel_insert(tw, &b.ev, fr_time_add(start, fr_time_delta_from_msec(10)));
+	fr_timer_wheel_delete(tw, &a.ev);
+	fr_timer_wheel_delete(tw, &a.ev);	/* twice is fine */
+	TEST_CHECK(!fr_timer_wheel_entry_armed(&a.ev));
+	TEST_CHECK(fr_timer_wheel_num_elements(tw) == 1);
+
+	/*
+	 *	Moving a timer which is armed.
+	 */
+	fr_timer_wheel_insert(tw, &b.ev, fr_time_add(start, fr_time_delta_from_msec(20)));
+	TEST_CHECK(fr_timer_wheel_num_elements(tw) == 1);
+
+	TEST_CHECK(tw_run_until(tw, start, fr_time_add(start, fr_time_delta_from_msec(15))) == 0);
+	TEST_CHECK(tw_run_until(tw, start, fr_time_add(start, fr_time_delta_from_msec(25))) == 1);
+	TEST_CHECK(a.count == 0);
+	TEST_CHECK(b.count == 1);
+
+	talloc_free(tw);
+}
+
+/** Timers far enough in the future to go through every level
+ *
+ */
+static void test_timer_wheel_cascade(void)
+{
+	fr_timer_wheel_t	*tw;
+	fr_time_t		start = fr_time_wrap(NSEC), now;
+	tw_thing_t		things[4];
+	fr_time_delta_t		tick = fr_time_delta_from_usec(1);
+	unsigned int		i;
+
+	tw = fr_timer_wheel_alloc(NULL, tick, start);
+
+	for (i = 0; i < NUM_ELEMENTS(things); i++) {
+		things[i] = (tw_thing_t) { .when = fr_time_add(start, fr_time_delta_from_usec((UINT64_C(1) << (8 * (i + 1))) + 3)) };
+		fr_timer_wheel_entry_init(&things[i].ev, tw_fired, &things[i]);
+		fr_timer_wheel_insert(tw, &things[i].ev, things[i].when);
+	}
+
+	/*
+	 *	Jump around, as the event loop would.
+	 */
+	now = start;
+	while (fr_timer_wheel_num_elements(tw) > 0) {
+		fr_time_t next = fr_timer_wheel_next(tw);
+
+		TEST_CHECK(fr_time_gt(next, now));
+		now = next;
+		fr_timer_wheel_run(tw, now);
+	}
+
+	for (i = 0; i < NUM_ELEMENTS(things); i++) {
+		TEST_CHECK(things[i].count == 1);
+		TEST_CHECK(fr_time_gteq(things[i].fired, things[i].when));
+		TEST_CHECK(fr_time_delta_lteq(fr_time_sub(things[i].fired, things[i].when), tick));
+		TEST_MSG("timer %u fired %"PRId64"ns late", i,
+			 fr_time_delta_unwrap(fr_time_sub(things[i].fired, things[i].when)));
+	}
+
+	talloc_free(tw);
+}
+
+static void test_timer_wheel_iter(void)
+{
+	fr_timer_wheel_t	*tw;
+	fr_time_t		start = fr_time_wrap(NSEC);
+	tw_thing_t		things[100];
+	fr_timer_wheel_iter_t	iter;
+	fr_timer_wheel_entry_t	*entry;
+	unsigned int		i, found = 0;
+
+	tw = fr_timer_wheel_alloc(NULL, TICK, start);
+
+	for (i = 0; i < NUM_ELEMENTS(things); i++) {
+		things[i] = (tw_thing_t) { .count = 0 };
+		fr_timer_wheel_entry_init(&things[i].ev, tw_fired, &things[i]);
+		fr_timer_wheel_insert(tw, &things[i].ev, fr_time_add(start, fr_time_delta_from_msec((i * i * i) + 1)));
+	}
+
+	for (entry = fr_timer_wheel_iter_init(tw, &iter);
+	     entry != NULL;
+	     entry = fr_timer_wheel_iter_next(tw, &iter)) {
+		tw_thing_t *thing = entry->uctx;
+
+		TEST_CHECK(thing->count == 0);
+		thing->count++;
+		found++;
+	}
+	TEST_CHECK(found == NUM_ELEMENTS(things));
+	TEST_MSG("Expected %zu timers, found %u", NUM_ELEMENTS(things), found);
+
+	/*
+	 *	Deleting the current entry is fine, if we've already
+	 *	moved on.
+	 */
+	entry = fr_timer_wheel_iter_init(tw, &iter);
+	while (entry) {
+		fr_timer_wheel_entry_t *next = fr_timer_wheel_iter_next(tw, &iter);
+
+		fr_timer_wheel_delete(tw, entry);
+		entry = next;
+	}
+	TEST_CHECK(fr_timer_wheel_num_elements(tw) == 0);
+
+	talloc_free(tw);
+}
+
+/** Random inserts and deletes, with the clock jumping around as it would in the event loop
+ *
+ */
+#define RANDOM_THINGS	(1000)
+static void tw_random_fired(UNUSED fr_timer_wheel_t *tw, fr_time_t now, void *uctx)
+{
+	tw_thing_t *thing = uctx;
+
+	TEST_CHECK(fr_time_gteq(now, thing->when));
+	thing->count++;
+}
+
+static void test_timer_wheel_random(void)
+{
+	fr_timer_wheel_t	*tw;
+	fr_time_t		start = fr_time_wrap(NSEC), now;
+	tw_thing_t		*things;
+	fr_fast_rand_t		rand_ctx = { .a = 0x1234, .b = 0x5678 };
+	unsigned int		i, j, armed = 0;
+
+	tw = fr_timer_wheel_alloc(NULL, TICK, start);
+	things = talloc_zero_array(tw, tw_thing_t, RANDOM_THINGS);
+	for (i = 0; i < RANDOM_THINGS; i++) fr_timer_wheel_entry_init(&things[i].ev, tw_random_fired, &things[i]);
+
+	now = start;
+	for (i = 0; i < 100000; i++) {
+		tw_thing_t	*thing = &things[fr_fast_rand(&rand_ctx) % RANDOM_THINGS];
+		fr_time_t	next;
+
+		switch (fr_fast_rand(&rand_ctx) % 4) {
+		case 0:
+			fr_timer_wheel_delete(tw, &thing->ev);
+			break;
+
+		default:
+			/*
+			 *	Mostly short timers, with the occasional
+			 *	long one.
+			 */
+			thing->when = fr_time_add(now, fr_time_delta_from_usec(fr_fast_rand(&rand_ctx) %
+									       ((i % 100) ? 100000 : 100000000)));
+			fr_timer_wheel_insert(tw, &thing->ev, thing->when);
+			break;
+		}
+
+		next = fr_timer_wheel_next(tw);
+		if (fr_time_eq(next, fr_time_wrap(0)) || (fr_fast_rand(&rand_ctx) % 2)) {
+			now = fr_time_add(now, fr_time_delta_from_usec(fr_fast_rand(&rand_ctx) % 5000));
+		} else {
+			TEST_CHECK(fr_time_gt(next, now));
+			now = next;
+		}
+
+		fr_timer_wheel_run(tw, now);
+
+		if ((i % 1000) != 0) continue;
+
+		/*
+		 *	Nothing is left behind.
+		 */
+		armed = 0;
+		for (j = 0; j < RANDOM_THINGS; j++) {
+			if (!fr_timer_wheel_entry_armed(&things[j].ev)) continue;
+
+			armed++;
+			TEST_CHECK(fr_time_gt(fr_time_add(things[j].when, TICK), now));
+			TEST_MSG("timer %u should have fired %"PRId64"ns ago", j,
+				 fr_time_delta_unwrap(fr_time_sub(now, things[j].when)));
+		}
+		TEST_CHECK(armed == fr_timer_wheel_num_elements(tw));
+	}
+
+	talloc_free(tw);
+}
+
+typedef struct {
+	fr_timer_wheel_entry_t	ev;
+	unsigned int		count;
+	fr_time_delta_t		interval;
+} tw_periodic_t;
+
+static void tw_periodic(fr_timer_wheel_t *tw, fr_time_t now, void *uctx)
+{
+	tw_periodic_t *p = uctx;
+
+	p->count++;
+	fr_timer_wheel_insert(tw, &p->ev, fr_time_add(now, p->interval));
+}
+
+static void test_timer_wheel_reinsert(void)
+{
+	fr_timer_wheel_t	*tw;
+	fr_time_t		start = fr_time_wrap(NSEC);
+	tw_periodic_t		p = { .interval = fr_time_delta_from_msec(50) };
+
+	tw = fr_timer_wheel_alloc(NULL, TICK, start);
+
+	fr_timer_wheel_entry_init(&p.ev, tw_periodic, &p);
+	fr_timer_wheel_insert(tw, &p.ev, fr_time_add(start, p.interval));
+
+	tw_run_until(tw, start, fr_time_add(start, fr_time_delta_from_sec(1)));
+	TEST_CHECK(p.count == 20);
+	TEST_MSG("Expected 20 firings, got %u", p.count);
+	TEST_CHECK(fr_timer_wheel_entry_armed(&p.ev));
+
+	talloc_free(tw);
+}
+
+/*
+ *	A BFD like load.  Each session has a transmit timer which fires
+ *	every 50ms, and a detection timer which is pushed back every
+ *	time a packet is received from the peer, so it never fires.
+ */
+#define SESSIONS	(10000)
+#define INTERVAL_MS	(50)
+#define RUN_MS		(2000)
+
+typedef struct {
+	fr_timer_wheel_entry_t	tx;
+	fr_timer_wheel_entry_t	detect;
+	fr_lst_index_t		tx_idx;
+	fr_lst_index_t		detect_idx;
+	fr_time_t		tx_when;
+	fr_time_t		detect_when;
+	uint64_t		*sent;
+} tw_session_t;
+
+static void tw_session_tx(fr_timer_wheel_t *tw, fr_time_t now, void *uctx)
+{
+	tw_session_t *s = uctx;
+
+	(*s->sent)++;
+	fr_timer_wheel_insert(tw, &s->tx, fr_time_add(now, fr_time_delta_from_msec(INTERVAL_MS)));
+
+	/*
+	 *	The simulated peer answers immediately.
+	 */
+	fr_timer_wheel_insert(tw, &s->detect, fr_time_add(now, fr_time_delta_from_msec(INTERVAL_MS * 3)));
+}
+
+static void tw_session_detect(UNUSED fr_timer_wheel_t *tw, UNUSED fr_time_t now, UNUSED void *uctx)
+{
+	TEST_CHECK(0 == 1);	/* the peer is always up */
+}
+
+static int8_t tw_tx_cmp(void const *one, void const *two)
+{
+	tw_session_t const *a = one, *b = two;
+
+	return fr_time_cmp(a->tx_when, b->tx_when);
+}
+
+static int8_t tw_detect_cmp(void const *one, void const *two)
+{
+	tw_session_t const *a = one, *b = two;
+
+	return fr_time_cmp(a->detect_when, b->detect_when);
+}
+
+/** Compare the same session load on the wheel, and on the LSTs the event loop uses
+ *
+ */
+static void timer_wheel_cmp(void)
+{
+	tw_session_t		*sessions;
+	fr_timer_wheel_t	*tw;
+	fr_lst_t		*tx_lst, *detect_lst;
+	fr_time_t		start = fr_time_wrap(NSEC), now, end;
+	fr_time_t		bench_start, bench_end;
+	uint64_t		sent = 0;
+	unsigned int		i;
+
+	sessions = talloc_zero_array(NULL, tw_session_t, SESSIONS);
+	end = fr_time_add(start, fr_time_delta_from_msec(RUN_MS));
+
+	/*
+	 *	Timer wheel
+	 */
+	tw = fr_timer_wheel_alloc(sessions, TICK, start);
+	for (i = 0; i < SESSIONS; i++) {
+		sessions[i].sent = &sent;
+		fr_timer_wheel_entry_init(&sessions[i].tx, tw_session_tx, &sessions[i]);
+		fr_timer_wheel_entry_init(&sessions[i].detect, tw_session_detect, &sessions[i]);
+		fr_timer_wheel_insert(tw, &sessions[i].tx, fr_time_add(start, fr_time_delta_from_usec(fr_rand() % (INTERVAL_MS * 1000))));
+	}
+
+	bench_start = fr_time();
+	tw_run_until(tw, start, end);
+	bench_end = fr_time();
+
+	TEST_MSG_ALWAYS("\nsessions: %u, interval %ums, simulated %ums, packets %"PRIu64"\n",
+			SESSIONS, INTERVAL_MS, RUN_MS, sent);
+	TEST_MSG_ALWAYS("timer wheel: %.3fs\n",
+			fr_time_delta_unwrap(fr_time_sub(bench_end, bench_start)) / (double)NSEC);
+
+	/*
+	 *	LSTs
+	 */
+	tx_lst = fr_lst_alloc(sessions, tw_tx_cmp, tw_session_t, tx_idx, SESSIONS);
+	detect_lst = fr_lst_alloc(sessions, tw_detect_cmp, tw_session_t, detect_idx, SESSIONS);
+	for (i = 0; i < SESSIONS; i++) {
+		sessions[i].tx_when = fr_time_add(start, fr_time_delta_from_usec(fr_rand() % (INTERVAL_MS * 1000)));
+		TEST_CHECK(fr_lst_insert(tx_lst, &sessions[i]) == 0);
+	}
+
+	sent = 0;
+	bench_start = fr_time();
+	for (now = start; fr_time_lteq(now, end); now = fr_time_add(now, TICK)) {
+		tw_session_t *s;
+
+		while ((s = fr_lst_peek(tx_lst)) && fr_time_lteq(s->tx_when, now)) {
+			(void) fr_lst_pop(tx_lst);
+			sent++;
+
+			s->tx_when = fr_time_add(now, fr_time_delta_from_msec(INTERVAL_MS));
+			(void) fr_lst_insert(tx_lst, s);
+
+			if (fr_lst_entry_inserted(s->detect_idx)) (void) fr_lst_extract(detect_lst, s);
+			s->detect_when = fr_time_add(now, fr_time_delta_from_msec(INTERVAL_MS * 3));
+			(void) fr_lst_insert(detect_lst, s);
+		}
+
+		s = fr_lst_peek(detect_lst);
+		TEST_CHECK(!s || fr_time_gt(s->detect_when, now));
+	}
+	bench_end = fr_time();
+
+	TEST_MSG_ALWAYS("lst: %.3fs, packets %"PRIu64"\n",
+			fr_time_delta_unwrap(fr_time_sub(bench_end, bench_start)) / (double)NSEC, sent);
+
+	talloc_free(sessions);
+}
+
+#define REQUESTS_PER_MS		(20)
+#define REQUEST_RUN_MS		(5000)
+#define REQUEST_REPLY_MS	(4096)		//!< must be a power of 2.
+
+/** A request to a home server, as the event loop sees it
+ *
+ */
+typedef struct {
+	fr_dlist_t		entry;		//!< in the list of replies due on a given ms.
+	fr_event_timer_t const	*timeout;	//!< almost always deleted when the reply arrives.
+	fr_event_timer_t const	*retransmit;	//!< fires for slow home servers.
+	unsigned int		retransmits;
+	uint64_t		*fired;
+} ev_request_t;
+
+static fr_time_t ev_now;
+
+static fr_time_t ev_time(void)
+{
+	return ev_now;
+}
+
+static void ev_request_timeout(UNUSED fr_event_list_t *el, UNUSED fr_time_t now, void *uctx)
+{
+	ev_request_t *request = uctx;
+
+	(*request->fired)++;
+}
+
+static void ev_request_retransmit(fr_event_list_t *el, fr_time_t now, void *uctx)
+{
+	ev_request_t *request = uctx;
+
+	(*request->fired)++;
+	if (++request->retransmits >= 3) return;
+
+	TEST_CHECK(fr_event_timer_at(el, el, &request->retransmit,
+				     fr_time_add(now, fr_time_delta_from_sec(1)), ev_request_retransmit, request) == 0);
+}
+
+/** Replay the same mix of timer inserts, deletes, and expiries through an event list
+ *
+ * @return how long it took.
+ */
+static fr_time_delta_t ev_replay(fr_time_delta_t tick, uint64_t *fired)
+{
+	fr_event_list_t		*el;
+	ev_request_t		*requests;
+	fr_dlist_head_t		*replies;
+	fr_fast_rand_t		rand_ctx = { .a = 0x1234, .b = 0x5678 };
+	fr_time_t		start = fr_time_wrap(NSEC), bench_start;
+	fr_time_delta_t		elapsed;
+	unsigned int		i, ms, num_requests = 0;
+
+	requests = talloc_zero_array(NULL, ev_request_t, REQUESTS_PER_MS * REQUEST_RUN_MS);
+	replies = talloc_array(requests, fr_dlist_head_t, REQUEST_REPLY_MS);
+	for (i = 0; i < REQUEST_REPLY_MS; i++) fr_dlist_init(&replies[i], ev_request_t, entry);
+
+	ev_now = start;
+	el = fr_event_list_alloc(NULL, NULL, NULL);
+	TEST_CHECK(el != NULL);
+	if (!el) return fr_time_delta_wrap(0);
+
+	fr_event_list_set_time_func(el, ev_time);
+	if (fr_time_delta_ispos(tick)) TEST_CHECK(fr_event_list_set_timer_wheel(el, tick) == 0);
+
+	*fired = 0;
+	bench_start = fr_time();
+	for (ms = 0; ms < REQUEST_RUN_MS; ms++) {
+		fr_dlist_head_t	*due = &replies[ms & (REQUEST_REPLY_MS - 1)];
+		ev_request_t	*request;
+		fr_time_t	when;
+
+		ev_now = fr_time_add(start, fr_time_delta_from_msec(ms));
+
+		/*
+		 *	Replies cancel both timers.
+		 */
+		while ((request = fr_dlist_pop_head(due)) != NULL) {
+			fr_event_timer_delete(&request->timeout);
+			fr_event_timer_delete(&request->retransmit);
+		}
+
+		/*
+		 *	New requests.  Most are answered in a few ms,
+		 *	some take long enough to be retransmitted, and
+		 *	a few are never answered.
+		 */
+		for (i = 0; i < REQUESTS_PER_MS; i++) {
+			uint32_t	r = fr_fast_rand(&rand_ctx) % 100;
+			unsigned int	delay;
+
+			request = &requests[num_requests++];
+			request->fired = fired;
+
+			TEST_CHECK(fr_event_timer_in(el, el, &request->timeout, fr_time_delta_from_sec(30),
+						     ev_request_timeout, request) == 0);
+			TEST_CHECK(fr_event_timer_in(el, el, &request->retransmit, fr_time_delta_from_sec(1),
+						     ev_request_retransmit, request) == 0);
+
+			if (r == 0) continue;
+
+			delay = 1 + ((r < 95) ? (fr_fast_rand(&rand_ctx) % 50) :
+				     (fr_fast_rand(&rand_ctx) % (REQUEST_REPLY_MS - 1)));
+			fr_dlist_insert_tail(&replies[(ms + delay) & (REQUEST_REPLY_MS - 1)], request);
+		}
+
+		do {
+			when = ev_now;
+		} while (fr_event_timer_run(el, &when) == 1);
+	}
+	elapsed = fr_time_sub(fr_time(), bench_start);
+
+	talloc_free(el);
+	talloc_free(requests);
+
+	return elapsed;
+}
+
+/** Compare the event list timer backends on a request-like load
+ *
+ */
+static void event_timer_cmp(void)
+{
+	fr_time_delta_t	lst_time, wheel_time;
+	uint64_t	lst_fired, wheel_fired;
+
+	lst_time = ev_replay(fr_time_delta_wrap(0), &lst_fired);
+	wheel_time = ev_replay(TICK, &wheel_fired);
+
+	/*
+	 *	Every timer is on a tick boundary, so the wheel fires
+	 *	them at exactly the same time as the lst.
+	 */
+	TEST_CHECK(lst_fired == wheel_fired);
+	TEST_MSG("lst fired %"PRIu64", wheel fired %"PRIu64, lst_fired, wheel_fired);
+
+	TEST_MSG_ALWAYS("\nrequests: %u, simulated %ums, timers fired %"PRIu64"\n",
+			REQUESTS_PER_MS * REQUEST_RUN_MS, REQUEST_RUN_MS, lst_fired);
+	TEST_MSG_ALWAYS("lst: %.3fs\n", fr_time_delta_unwrap(lst_time) / (double)NSEC);
+	TEST_MSG_ALWAYS("timer wheel: %.3fs\n", fr_time_delta_unwrap(wheel_time) / (double)NSEC);
+}
+
+TEST_LIST = {
+	{ "test_timer_wheel_basic",	test_timer_wheel_basic },
+	{ "test_timer_wheel_delete",	test_timer_wheel_delete },
+	{ "test_timer_wheel_cascade",	test_timer_wheel_cascade },
+	{ "test_timer_wheel_iter",	test_timer_wheel_iter },
+	{ "test_timer_wheel_random",	test_timer_wheel_random },
+	{ "test_timer_wheel_reinsert",	test_timer_wheel_reinsert },
+	{ "timer_wheel_cmp",		timer_wheel_cmp },
+	{ "event_timer_cmp",		event_timer_cmp },
+	{ NULL }
+};
@@ -42,6 +42,7 @@ typedef struct {
 
 	fr_stats_t			stats;			//!< statistics for this socket
 
+	bfd_sched_t			*sched;			//!< timers for all of our peers
 } proto_bfd_udp_thread_t;
 
 typedef struct {
@@ -493,6 +494,12 @@ static void mod_event_list_set(fr_listen_t *li, fr_event_list_t *el, void *nr)
 	fr_rb_iter_inorder_t	iter;
 	bfd_session_t		*peer;
 
+	thread->sched = bfd_sched_alloc(thread, el, thread->sockfd);
+	if (!thread->sched) {
+		ERROR("Failed allocating timers for BFD peers");
+		return;
+	}
+
 	/*
 	 *	Walk over the list of peers, associating them with this listener.
 	 */
@@ -502,6 +509,7 @@ static void mod_event_list_set(fr_listen_t *li, fr_event_list_t *el, void *nr)
 		if (peer->inst != inst) continue;
 
 		peer->el = el;
+		peer->sched = thread->sched;
 		peer->listen = li;
 		peer->nr = (fr_network_t *) nr;
 		peer->sockfd = thread->sockfd;
@@ -47,6 +47,38 @@ static void bfd_start_control(bfd_session_t *session);
 static int bfd_stop_control(bfd_session_t *session);
 static void bfd_set_timeout(bfd_session_t *session, fr_time_t when);
 
+/*
+ *	BFD timers are only ever a few intervals in the future, and
+ *	are almost always moved before they fire.  So the timers for
+ *	all sessions on a listener go into one timer wheel, and the
+ *	event list has only one timer, for the next tick.
+ */
+#define BFD_SCHED_TICK		fr_time_delta_from_msec(1)
+
+/*
+ *	Control packets which are due in the same tick are sent with
+ *	one system call.
+ */
+#define BFD_SCHED_BATCH		(64)
+
+struct bfd_sched_s {
+	fr_event_list_t		*el;
+	fr_timer_wheel_t	*tw;
+	fr_event_timer_t const	*ev;				//!< for when we next run the wheel
+	fr_time_t		next;				//!< when ev fires
+	bool			running;			//!< the wheel is firing timers
+
+	int			sockfd;
+
+	unsigned int		num_pending;			//!< packets waiting to be sent
+	bfd_session_t		*pending[BFD_SCHED_BATCH];	//!< who they're from
+	bfd_packet_t		packets[BFD_SCHED_BATCH];
+#ifdef HAVE_SENDMMSG
+	struct mmsghdr		mmsg[BFD_SCHED_BATCH];
+	struct iovec		iov[BFD_SCHED_BATCH];
+#endif
+};
+
 /*
  *	Wrapper to run a trigger.
  *
@@ -80,6 +112,160 @@ void bfd_session_admin_down(bfd_session_t *session)
 	bfd_trigger(session,  BFD_STATE_CHANGE_ADMIN_DOWN);
 }
 
+/*
+ *	Send all of the packets queued during this tick.
+ */
+static void bfd_sched_flush(bfd_sched_t *sched)
+{
+	unsigned int i = 0;
+
+#ifdef HAVE_SENDMMSG
+	while (i < sched->num_pending) {
+		int sent;
+
+		sent = sendmmsg(sched->sockfd, &sched->mmsg[i], sched->num_pending - i, 0);
+		if (sent > 0) {
+			i += sent;
+			continue;
+		}
+
+		/*
+		 *	The first packet failed.  Mark that peer down,
+		 *	and carry on with the rest.
+		 */
+		ERROR("Failed sending packet: %s", fr_syserror(errno));
+		bfd_session_admin_down(sched->pending[i]);
+		i++;
+	}
+#else
+	for (i = 0; i < sched->num_pending; i++) {
+		bfd_session_t *session = sched->pending[i];
+
+		if (sendto(sched->sockfd, &sched->packets[i], sched->packets[i].length, 0,
+			   (struct sockaddr *) &session->remote_sockaddr, session->remote_salen) < 0) {
+			ERROR("Failed sending packet: %s", fr_syserror(errno));
+			bfd_session_admin_down(session);
+		}
+	}
+#endif
+
+	sched->num_pending = 0;
+}
+
+/*
+ *	Queue a packet to be sent at the end of this tick.
+ *
+ *	The socket is bound to the address in local_sockaddr, so
+ *	there's no need to set the source address as sendfromto() does.
+ */
+static void bfd_sched_queue(bfd_sched_t *sched, bfd_session_t *session, bfd_packet_t const *bfd)
+{
+	unsigned int i;
+
+	if (sched->num_pending == BFD_SCHED_BATCH) bfd_sched_flush(sched);
+
+	i = sched->num_pending++;
+	sched->pending[i] = session;
+	memcpy(&sched->packets[i], bfd, bfd->length);
+
+#ifdef HAVE_SENDMMSG
+	sched->iov[i] = (struct iovec) {
+		.iov_base = &sched->packets[i],
+		.iov_len = bfd->length,
+	};
+	sched->mmsg[i] = (struct mmsghdr) {
+		.msg_hdr = {
+			.msg_name = &session->remote_sockaddr,
+			.msg_namelen = session->remote_salen,
+			.msg_iov = &sched->iov[i],
+			.msg_iovlen = 1,
+		},
+	};
+#endif
+}
+
+static void bfd_sched_arm(bfd_sched_t *sched, fr_time_t when);
+
+/*
+ *	Fire all of the timers which are due, and send the packets
+ *	they queued.
+ */
+static void bfd_sched_run(UNUSED fr_event_list_t *el, fr_time_t now, void *uctx)
+{
+	bfd_sched_t *sched = talloc_get_type_abort(uctx, bfd_sched_t);
+
+	sched->running = true;
+	(void) fr_timer_wheel_run(sched->tw, now);
+	sched->running = false;
+
+	bfd_sched_flush(sched);
+
+	if (fr_timer_wheel_num_elements(sched->tw) > 0) bfd_sched_arm(sched, fr_timer_wheel_next(sched->tw));
+}
+
+/*
+ *	Make sure the wheel runs at or before "when".
+ */
+static void bfd_sched_arm(bfd_sched_t *sched, fr_time_t when)
+{
+	if (sched->ev && fr_time_lteq(sched->next, when)) return;
+
+	sched->next = when;
+	if (fr_event_timer_at(sched, sched->el, &sched->ev, when, bfd_sched_run, sched) < 0) {
+		fr_assert("Failed to insert event" == NULL);
+	}
+}
+
+/*
+ *	Arm one of the timers for a session.
+ */
+static void bfd_sched_insert(bfd_sched_t *sched, fr_timer_wheel_entry_t *entry, fr_time_t when)
+{
+	/*
+	 *	The wheel only moves forward when it's run.  If it's
+	 *	been idle, catch it up, so that it doesn't have to
+	 *	step through all of the ticks it missed.
+	 */
+	if (!sched->running && !fr_timer_wheel_num_elements(sched->tw)) (void) fr_timer_wheel_run(sched->tw, fr_time());
+
+	fr_timer_wheel_insert(sched->tw, entry, when);
+
+	/*
+	 *	bfd_sched_run() re-arms the event when it's done.
+	 */
+	if (sched->running) return;
+
+	if (!sched->ev || fr_time_lt(when, sched->next)) bfd_sched_arm(sched, fr_timer_wheel_next(sched->tw));
+}
+
+/** Allocate the scheduler for the sessions on one listener
+ *
+ * @param[in] ctx	to allocate the scheduler in.
+ * @param[in] el	the event list the listener is in.
+ * @param[in] sockfd	of the listener.
+ * @return
+ *	- The new scheduler.
+ *	- NULL on error.
+ */
+bfd_sched_t *bfd_sched_alloc(TALLOC_CTX *ctx, fr_event_list_t *el, int sockfd)
+{
+	bfd_sched_t *sched;
+
+	sched = talloc_zero(ctx, bfd_sched_t);
+	if (!sched) return NULL;
+
+	sched->tw = fr_timer_wheel_alloc(sched, BFD_SCHED_TICK, fr_time());
+	if (!sched->tw) {
+		talloc_free(sched);
+		return NULL;
+	}
+
+	sched->el = el;
+	sched->sockfd = sockfd;
+
+	return sched;
+}
+
 
 /*
  *	Stop polling for packets.
@@ -105,8 +291,8 @@ static int bfd_stop_poll(bfd_session_t *session)
 	 *	re-set the timers.
 	 */
 	if (!session->remote_demand_mode) {
-		fr_assert(session->ev_timeout != NULL);
-		fr_assert(session->ev_packet != NULL);
+		fr_assert(fr_timer_wheel_entry_armed(&session->ev_timeout));
+		fr_assert(fr_timer_wheel_entry_armed(&session->ev_packet));
 
 		bfd_stop_control(session);
 		bfd_start_control(session);
@@ -745,9 +931,10 @@ static void bfd_send_init(bfd_session_t *session, bfd_packet_t *bfd)
 }
 
 /*
- *	Send one BFD packet.
+ *	Send one BFD packet.  It's queued, and sent along with the
+ *	packets from other sessions at the end of the tick.
  */
-static void bfd_send_packet(UNUSED fr_event_list_t *el, UNUSED fr_time_t now, void *ctx)
+static void bfd_send_packet(UNUSED fr_timer_wheel_t *tw, fr_time_t now, void *ctx)
 {
 	bfd_session_t *session = ctx;
 	bfd_packet_t bfd;
@@ -757,20 +944,15 @@ static void bfd_send_packet(UNUSED fr_event_list_t *el, UNUSED fr_time_t now, vo
 	DEBUG("BFD %s peer %s sending %s",
 	      session->server_name, session->client.shortname, fr_bfd_packet_names[session->session_state]);
 
-	session->last_sent = fr_time();
+	session->last_sent = now;
 
-	if (sendfromto(session->sockfd, &bfd, bfd.length, 0, 0,
-		       (struct sockaddr *) &session->local_sockaddr, session->local_salen,
-		       (struct sockaddr *) &session->remote_sockaddr, session->remote_salen) < 0) {
-		ERROR("Failed sending packet: %s", fr_syserror(errno));
-		bfd_session_admin_down(session);
-	}
+	bfd_sched_queue(session->sched, session, &bfd);
 }
 
 /*
  *	Send one BFD packet.
  */
-static void bfd_unlang_send_packet(UNUSED fr_event_list_t *el, UNUSED fr_time_t now, void *ctx)
+static void bfd_unlang_send_packet(UNUSED fr_timer_wheel_t *tw, UNUSED fr_time_t now, void *ctx)
 {
 	bfd_session_t *session = ctx;
 	bfd_packet_t *bfd;
@@ -807,14 +989,8 @@ static void bfd_start_packets(bfd_session_t *session)
 {
 	uint64_t	interval, base;
 	uint64_t	jitter;
-	fr_event_timer_cb_t cb;
-
-	if (session->ev_packet) return;
 
-	/*
-	 *	Reset the timers.
-	 */
-	fr_event_timer_delete(&session->ev_packet);
+	if (fr_timer_wheel_entry_armed(&session->ev_packet)) return;
 
 	if (fr_time_delta_cmp(session->desired_min_tx_interval, session->remote_min_rx_interval) >= 0) {
 		interval = fr_time_delta_unwrap(session->desired_min_tx_interval);
@@ -851,17 +1027,7 @@ static void bfd_start_packets(bfd_session_t *session)
 	interval = base;
 	interval += jitter;
 
-	if (!session->only_state_changes) {
-		cb = bfd_unlang_send_packet;
-	} else {
-		cb = bfd_send_packet;
-	}
-
-	if (fr_event_timer_in(session, session->el, &session->ev_packet,
-			      fr_time_delta_wrap(interval),
-			      cb, session) < 0) {
-		fr_assert("Failed to insert event" == NULL);
-	}
+	bfd_sched_insert(session->sched, &session->ev_packet, fr_time_add(fr_time(), fr_time_delta_wrap(interval)));
 }
 
 
@@ -937,7 +1103,7 @@ static void bfd_set_desired_min_tx_interval(bfd_session_t *session, fr_time_delt
 /*
  *	We failed to see a packet.
  */
-static void bfd_detection_timeout(UNUSED fr_event_list_t *el, fr_time_t now, void *ctx)
+static void bfd_detection_timeout(UNUSED fr_timer_wheel_t *tw, fr_time_t now, void *ctx)
 {
 	bfd_session_t *session = ctx;
 
@@ -983,24 +1149,17 @@ static void bfd_detection_timeout(UNUSED fr_event_list_t *el, fr_time_t now, voi
  */
 static void bfd_set_timeout(bfd_session_t *session, fr_time_t when)
 {
-	fr_time_t timeout;
 	uint64_t delay;
-	fr_time_delta_t delta;
-
-	fr_event_timer_delete(&session->ev_timeout);
 
 	delay = fr_time_delta_unwrap(session->detection_time);
 	delay *= session->detect_multi;
 
 	delay += fr_time_delta_unwrap(session->detection_time) / 2;
-	delta = fr_time_delta_from_usec(delay);
-
-	timeout = fr_time_add(when, delta);
 
-	if (fr_event_timer_at(session, session->el, &session->ev_timeout,
-			      timeout, bfd_detection_timeout, session) < 0) {
-		fr_assert("Failed to insert event" == NULL);
-	}
+	/*
+	 *	Re-arms the timer if it's already set.
+	 */
+	bfd_sched_insert(session->sched, &session->ev_timeout, fr_time_add(when, fr_time_delta_wrap(delay)));
 }
 
 
@@ -1009,8 +1168,10 @@ static void bfd_set_timeout(bfd_session_t *session, fr_time_t when)
  */
 static int bfd_stop_control(bfd_session_t *session)
 {
-	fr_event_timer_delete(&session->ev_timeout);
-	fr_event_timer_delete(&session->ev_packet);
+	if (!session->sched) return 1;
+
+	fr_timer_wheel_delete(session->sched->tw, &session->ev_timeout);
+	fr_timer_wheel_delete(session->sched->tw, &session->ev_packet);
 	return 1;
 }
 
@@ -1089,6 +1250,11 @@ void bfd_session_start(bfd_session_t *session)
 	DEBUG("Starting BFD for %s", session->client.shortname);
 
 	fr_assert(session->el);
+	fr_assert(session->sched);
+
+	fr_timer_wheel_entry_init(&session->ev_timeout, bfd_detection_timeout, session);
+	fr_timer_wheel_entry_init(&session->ev_packet,
+				  session->only_state_changes ? bfd_send_packet : bfd_unlang_send_packet, session);
 
 	bfd_start_control(session);
 }
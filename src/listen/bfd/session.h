@@ -23,8 +23,15 @@
  *
  * @copyright 2023 Network RADIUS SAS (legal@networkradius.com)
  */
+#include <freeradius-devel/util/timer_wheel.h>
+
 #include "proto_bfd.h"
 
+/** Runs the timers for all of the sessions on one listener
+ *
+ */
+typedef struct bfd_sched_s bfd_sched_t;
+
 typedef struct {
 	fr_client_t			client;			//!< might as well reuse this, others need it
 
@@ -43,6 +50,7 @@ typedef struct {
 
 	int				sockfd;			//!< cached for laziness
 	fr_event_list_t			*el;			//!< event list
+	bfd_sched_t			*sched;			//!< runs our timers
 	fr_network_t			*nr;			//!< network side of things
 
 	struct sockaddr_storage		remote_sockaddr;		//!< cached for laziness
@@ -54,8 +62,8 @@ typedef struct {
 	/*
 	 *	Internal state management
 	 */
-	fr_event_timer_t const	*ev_timeout;			//!< when we time out for not receiving a packet
-	fr_event_timer_t const	*ev_packet;			//!< for when we next send a packet
+	fr_timer_wheel_entry_t	ev_timeout;			//!< when we time out for not receiving a packet
+	fr_timer_wheel_entry_t	ev_packet;			//!< for when we next send a packet
 	fr_time_t	last_recv;				//!< last received packet
 	fr_time_t	next_recv;				//!< when we next expect to receive a packet
 	fr_time_t	last_sent;				//!< the last time we sent a packet
@@ -145,6 +153,8 @@ typedef struct {
 	uint8_t			packet[];
 } bfd_wrapper_t;
 
+bfd_sched_t *bfd_sched_alloc(TALLOC_CTX *ctx, fr_event_list_t *el, int sockfd);
+
 int	bfd_session_init(bfd_session_t *session);
 
 void	bfd_session_start(bfd_session_t *session);
@@ -1 +1 @@
-SUBMAKEFILES := proto_detail.mk proto_detail_file.mk proto_detail_work.mk
+SUBMAKEFILES := proto_detail.mk proto_detail_file.mk proto_detail_work.mk proto_detail_work_tests.mk
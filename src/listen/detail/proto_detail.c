@@ -22,6 +22,7 @@
  * @copyright 2017 Arran Cudbard-Bell (a.cudbardb@freeradius.org)
  * @copyright 2016 Alan DeKok (aland@freeradius.org)
  */
+#include <freeradius-devel/internal/internal.h>
 #include <freeradius-devel/io/application.h>
 #include <freeradius-devel/io/listen.h>
 #include <freeradius-devel/io/schedule.h>
@@ -49,6 +50,12 @@ static int transport_parse(TALLOC_CTX *ctx, void *out, void *parent, CONF_ITEM *
 #define MPRINT(x, ...)
 #endif
 
+static fr_table_num_sorted_t const detail_format_table[] = {
+	{ L("binary"),	FR_DETAIL_FORMAT_BINARY	},
+	{ L("text"),	FR_DETAIL_FORMAT_TEXT	}
+};
+static size_t detail_format_table_len = NUM_ELEMENTS(detail_format_table);
+
 /** How to parse a Detail listen section
  *
  */
@@ -63,6 +70,9 @@ static conf_parser_t const proto_detail_config[] = {
 	 */
 	{ FR_CONF_OFFSET("max_entry_size", proto_detail_t, max_packet_size) } ,
 
+	{ FR_CONF_OFFSET("format", proto_detail_t, format), .dflt = "text",
+	  .func = cf_table_parse_int, .uctx = &(cf_table_parse_ctx_t){ .table = detail_format_table, .len = &detail_format_table_len } },
+
 	/*
 	 *	For performance tweaking.  NOT for normal humans.
 	 */
@@ -211,6 +221,75 @@ static int transport_parse(TALLOC_CTX *ctx, void *out, void *parent, CONF_ITEM *
 	return 0;
 }
 
+/** Decode a binary record
+ *
+ *  The attributes are in the internal encoding, so there's no
+ *  text to parse.
+ */
+static int decode_binary(request_t *request, uint8_t const *data, size_t data_len)
+{
+	fr_detail_binary_hdr_t	hdr;
+	fr_dbuff_t		dbuff;
+	fr_pair_list_t		tmp_list;
+	fr_pair_t		*vp;
+
+	if ((fr_detail_binary_hdr_decode(&hdr, data, data_len) < 0) ||
+	    ((FR_DETAIL_BINARY_HDR_LEN + (size_t) hdr.length) > data_len)) {
+		REDEBUG("Malformed record header");
+		return -1;
+	}
+
+	/*
+	 *	The request is processed by a virtual server which
+	 *	uses the listener's dictionary, so records written
+	 *	for a different protocol can't be processed here.
+	 */
+	if (hdr.proto != fr_dict_root(request->dict)->attr) {
+		REDEBUG("Record was written for protocol %u, but the listener uses %s (%u)",
+			hdr.proto, fr_dict_root(request->dict)->name, fr_dict_root(request->dict)->attr);
+		return -1;
+	}
+
+	fr_pair_list_init(&tmp_list);
+	dbuff = FR_DBUFF_TMP(data + FR_DETAIL_BINARY_HDR_LEN, (size_t) hdr.length);
+
+	if (fr_internal_decode_list_dbuff(request->request_ctx, &tmp_list, fr_dict_root(request->dict),
+					  &dbuff, NULL) < 0) {
+		RPEDEBUG("Failed decoding record");
+		fr_pair_list_free(&tmp_list);
+		return -1;
+	}
+	fr_pair_list_append(&request->request_pairs, &tmp_list);
+
+	/*
+	 *	The original time at which we received the
+	 *	packet.  We need this to properly calculate
+	 *	Acct-Delay-Time.
+	 */
+	vp = fr_pair_afrom_da(request->request_ctx, attr_packet_original_timestamp);
+	if (vp) {
+		vp->vp_date = fr_unix_time_from_sec(hdr.timestamp);
+		fr_pair_append(&request->request_pairs, vp);
+	}
+
+	/*
+	 *	Set the original src/dst ip/port
+	 */
+	vp = fr_pair_find_by_da_nested(&request->request_pairs, NULL, attr_packet_src_ip_address);
+	if (vp) request->packet->socket.inet.src_ipaddr = vp->vp_ip;
+
+	vp = fr_pair_find_by_da_nested(&request->request_pairs, NULL, attr_packet_dst_ip_address);
+	if (vp) request->packet->socket.inet.dst_ipaddr = vp->vp_ip;
+
+	vp = fr_pair_find_by_da_nested(&request->request_pairs, NULL, attr_packet_src_port);
+	if (vp) request->packet->socket.inet.src_port = vp->vp_uint16;
+
+	vp = fr_pair_find_by_da_nested(&request->request_pairs, NULL, attr_packet_dst_port);
+	if (vp) request->packet->socket.inet.dst_port = vp->vp_uint16;
+
+	return 0;
+}
+
 /** Decode the packet, and set the request->process function
  *
  */
@@ -241,6 +320,12 @@ static int mod_decode(void const *instance, request_t *request, uint8_t *const d
 	request->reply->socket.inet.src_ipaddr = request->packet->socket.inet.src_ipaddr;
 	request->reply->socket.inet.dst_ipaddr = request->packet->socket.inet.src_ipaddr;
 
+	if (inst->format == FR_DETAIL_FORMAT_BINARY) {
+		if (decode_binary(request, data, data_len) < 0) return -1;
+
+		return inst->app_io->decode(inst->app_io_instance, request, data, data_len);
+	}
+
 	end = data + data_len;
 
 	MPRINT("HEADER %s", data);
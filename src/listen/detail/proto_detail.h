@@ -26,6 +26,7 @@
 RCSIDH(detail_h, "$Id$")
 
 #include <freeradius-devel/io/application.h>
+#include <freeradius-devel/server/detail.h>
 #include <freeradius-devel/server/module_rlm.h>
 #include <freeradius-devel/util/retry.h>
 #include <freeradius-devel/util/dlist.h>
@@ -58,6 +59,7 @@ typedef struct {
 	fr_dict_attr_t const		*attr_packet_type;
 
 	uint32_t			code;				//!< packet code to use for incoming packets
+	fr_detail_format_t		format;				//!< of the detail files.
 	uint32_t			max_packet_size;		//!< for message ring buffer
 	uint32_t			num_messages;			//!< for message ring buffer
 	uint32_t			priority;			//!< for packet processing, larger == higher
@@ -93,6 +95,7 @@ struct proto_detail_work_s {
 	bool				track_progress;		//!< do we track progress by writing?
 	bool				retransmit;		//!< are we retransmitting on error?
 	bool				immediate;		//!< start reading the detail files immediately
+	bool				replay;			//!< keep many entries in flight, to replay a backlog
 
 	int				mode;			//!< O_RDWR or O_RDONLY
 
@@ -117,6 +120,11 @@ struct proto_detail_work_thread_s {
 
 	char const			*filename_work;		//!< work file name
 	fr_dlist_head_t			list;			//!< for retransmissions
+	fr_dlist_head_t			in_flight;		//!< entries being processed, in file order
+
+	int				progress_fd;		//!< for recording which entries are done
+	char const			*filename_progress;	//!< progress file name
+	ino_t				ino;			//!< of the work file
 
 	uint32_t       			outstanding;		//!< number of currently outstanding records;
 	fr_time_delta_t			lock_interval;		//!< interval between trying the locks.
@@ -25,7 +25,9 @@
 #include <netdb.h>
 #include <freeradius-devel/server/protocol.h>
 #include <freeradius-devel/server/pair.h>
+#include <freeradius-devel/server/main_config.h>
 #include <freeradius-devel/server/main_loop.h>
+#include <freeradius-devel/server/detail.h>
 #include <freeradius-devel/io/application.h>
 #include <freeradius-devel/io/listen.h>
 #include <freeradius-devel/util/syserror.h>
@@ -52,6 +54,7 @@
 typedef struct {
 	proto_detail_work_thread_t	*parent;		//!< talloc_parent is SLOW!
 	fr_time_t			timestamp;		//!< when we read the entry.
+	off_t				header_offset;		//!< where the entry starts in the file.
 	off_t				done_offset;		//!< where we're tracking the status
 
 	int				id;			//!< for retransmission counters
@@ -62,8 +65,27 @@ typedef struct {
 	fr_retry_t			retry;			//!< our retry timers
 	fr_event_timer_t const		*ev;			//!< retransmission timer
 	fr_dlist_t			entry;			//!< for the retransmission list
+	fr_dlist_t			in_flight_entry;	//!< for the list of entries being processed
 } fr_detail_entry_t;
 
+/** What we write to the progress file
+ *
+ *  Entries finish out of order when more than one is outstanding, so
+ *  the "Done" markers in the detail file tell us which entries to
+ *  skip, but not where to start.  The progress file records the
+ *  offset before which every entry has been processed, so that on
+ *  restart we don't have to read the whole file again.
+ */
+typedef struct {
+	uint64_t			ino;			//!< of the work file, so we don't use a stale offset.
+	uint64_t			offset;			//!< every entry before this has been processed.
+} fr_detail_progress_t;
+
+/** Entries in flight per worker thread, when replaying a backlog
+ *
+ */
+#define PROTO_DETAIL_REPLAY_PER_WORKER	(16)
+
 static conf_parser_t limit_config[] = {
 	{ FR_CONF_OFFSET("initial_rtx_time", proto_detail_work_t, retry_config.irt), .dflt = STRINGIFY(2) },
 	{ FR_CONF_OFFSET("max_rtx_time", proto_detail_work_t, retry_config.mrt), .dflt = STRINGIFY(16) },
@@ -88,6 +110,8 @@ static const conf_parser_t file_listen_config[] = {
 
 	{ FR_CONF_OFFSET("retransmit", proto_detail_work_t, retransmit ), .dflt = "yes" },
 
+	{ FR_CONF_OFFSET("replay", proto_detail_work_t, replay ) },
+
 	{ FR_CONF_POINTER("limit", 0, CONF_FLAG_SUBSECTION, NULL), .subcs = (void const *) limit_config },
 	CONF_PARSER_TERMINATOR
 };
@@ -141,6 +165,95 @@ static fr_event_update_t resume_read[] = {
 	{ 0 }
 };
 
+/** Find the next binary record in the buffer
+ *
+ *  Records which have already been processed, or which fail their
+ *  checksum, are skipped.
+ *
+ * @param[in] inst		the detail worker configuration.
+ * @param[in] thread		the detail worker.
+ * @param[in] buffer		holding the data we've read.
+ * @param[in] buffer_len	the size of the buffer.
+ * @param[in] end		of the data in the buffer.
+ * @param[out] leftover		bytes after the record.
+ * @return
+ *	- >0 the length of the record at the start of the buffer.
+ *	- 0 if we need more data.
+ *	- -1 on error.
+ */
+static ssize_t work_frame_binary(proto_detail_work_t const *inst, proto_detail_work_thread_t *thread,
+				 uint8_t *buffer, size_t buffer_len, uint8_t *end, size_t *leftover)
+{
+	fr_detail_binary_hdr_t		hdr;
+	size_t				packet_len;
+
+redo:
+	if ((size_t) (end - buffer) < FR_DETAIL_BINARY_HDR_LEN) goto more;
+
+	if (fr_detail_binary_hdr_decode(&hdr, buffer, end - buffer) < 0) {
+		ERROR("proto_detail (%s): Invalid record header at offset %zu of file %s",
+		      thread->name, (size_t) thread->header_offset, thread->filename_work);
+		return -1;
+	}
+
+	packet_len = FR_DETAIL_BINARY_HDR_LEN + (size_t) hdr.length;
+
+	/*
+	 *	Too big?  We know how long it is, so we can skip it
+	 *	in the file without reading it.
+	 */
+	if ((packet_len > inst->parent->max_packet_size) || (packet_len > buffer_len)) {
+		DEBUG("Ignoring 'too large' entry at offset %zu of %s",
+		      (size_t) thread->header_offset, thread->filename_work);
+		DEBUG("Entry size %zu is greater than allowed maximum %u",
+		      packet_len, inst->parent->max_packet_size);
+
+		thread->header_offset += packet_len;
+		thread->read_offset = thread->header_offset;
+		thread->eof = false;
+		*leftover = 0;
+		return 0;
+	}
+
+	if ((size_t) (end - buffer) < packet_len) goto more;
+
+	if ((hdr.flags & FR_DETAIL_BINARY_FLAG_DONE) == 0) {
+		if (fr_detail_binary_payload_verify(&hdr, buffer + FR_DETAIL_BINARY_HDR_LEN)) {
+			*leftover = (end - buffer) - packet_len;
+			return packet_len;
+		}
+
+		ERROR("proto_detail (%s): Ignoring entry with bad checksum at offset %zu of file %s",
+		      thread->name, (size_t) thread->header_offset, thread->filename_work);
+	}
+
+	MPRINT("Skipping record");
+	thread->header_offset += packet_len;
+	memmove(buffer, buffer + packet_len, (end - buffer) - packet_len);
+	end -= packet_len;
+	goto redo;
+
+more:
+	if (!thread->eof) {
+		*leftover = end - buffer;
+		return 0;
+	}
+
+	/*
+	 *	Someone is still writing the record, or the
+	 *	writer died part way through.  Either way, there's
+	 *	nothing more we can do with this file.
+	 */
+	if (end != buffer) {
+		ERROR("proto_detail (%s): Ignoring truncated entry at offset %zu of file %s",
+		      thread->name, (size_t) thread->header_offset, thread->filename_work);
+	}
+
+	*leftover = 0;
+	thread->closing = true;
+	return 0;
+}
+
 static ssize_t mod_read(fr_listen_t *li, void **packet_ctx, fr_time_t *recv_time_p, uint8_t *buffer, size_t buffer_len, size_t *leftover)
 {
 	proto_detail_work_t const	*inst = talloc_get_type_abort_const(li->app_io_instance, proto_detail_work_t);
@@ -221,11 +334,6 @@ static ssize_t mod_read(fr_listen_t *li, void **packet_ctx, fr_time_t *recv_time
 		thread->leftover = 0;
 	}
 
-	/*
-	 *	Seek to the current read offset.
-	 */
-	(void) lseek(thread->fd, thread->read_offset, SEEK_SET);
-
 	/*
 	 *	There will be "leftover" bytes left over in the buffer
 	 *	from any previous read.  At the start of the file,
@@ -243,7 +351,7 @@ static ssize_t mod_read(fr_listen_t *li, void **packet_ctx, fr_time_t *recv_time
 
 		room = buffer_len - *leftover;
 
-		data_size = read(thread->fd, partial, room);
+		data_size = pread(thread->fd, partial, room, thread->read_offset);
 		if (data_size < 0) {
 			ERROR("proto_detail (%s): Failed reading file %s: %s",
 			      thread->name, thread->filename_work, fr_syserror(errno));
@@ -255,7 +363,7 @@ static ssize_t mod_read(fr_listen_t *li, void **packet_ctx, fr_time_t *recv_time
 		/*
 		 *	Remember the read offset, and whether we got EOF.
 		 */
-		thread->read_offset = lseek(thread->fd, 0, SEEK_CUR);
+		thread->read_offset += data_size;
 
 		/*
 		 *	Only set EOF if there's no more data in the buffer to manage.
@@ -277,6 +385,19 @@ static ssize_t mod_read(fr_listen_t *li, void **packet_ctx, fr_time_t *recv_time
 		end = buffer + *leftover;
 	}
 
+	/*
+	 *	Binary records say how long they are, so there's no
+	 *	need to search for the end of the record.
+	 */
+	if (inst->parent->format == FR_DETAIL_FORMAT_BINARY) {
+		data_size = work_frame_binary(inst, thread, buffer, buffer_len, end, leftover);
+		if (data_size <= 0) return data_size;
+
+		packet_len = data_size;
+		done_offset = thread->header_offset + FR_DETAIL_BINARY_FLAGS_OFFSET;
+		goto track;
+	}
+
 redo:
 	next = NULL;
 	stopped_search = end;
@@ -435,6 +556,7 @@ redo:
 	skip_record:
 		MPRINT("Skipping record");
 		if (next) {
+			thread->header_offset += (next - buffer);
 			memmove(buffer, next, (end - next));
 			data_size = (end - next);
 			*leftover = 0;
@@ -484,17 +606,21 @@ redo:
 	/*
 	 *	Allocate the tracking entry.
 	 */
+track:
 	MEM(track = talloc_zero(thread, fr_detail_entry_t));
 	track->parent = thread;
 	track->timestamp = fr_time();
 	track->id = thread->count++;
 
+	track->header_offset = thread->header_offset;
 	track->done_offset = done_offset;
 	if (inst->retransmit) {
 		MEM(track->packet = talloc_memdup(track, buffer, packet_len));
 		track->packet_len = packet_len;
 	}
 
+	fr_dlist_insert_tail(&thread->in_flight, track);
+
 	/*
 	 *	We've read one more packet.
 	 */
@@ -521,11 +647,6 @@ done:
 	if (!thread->paused && (thread->outstanding >= inst->max_outstanding)) {
 		(void) fr_event_filter_update(thread->el, thread->fd, FR_EVENT_FILTER_IO, pause_read);
 		thread->paused = true;
-
-		/*
-		 *	Back up so that read() knows there's more data.
-		 */
-		if (*leftover) (void) lseek(thread->fd, thread->read_offset - 1, SEEK_SET);
 	}
 
 	/*
@@ -569,6 +690,35 @@ static void work_retransmit(UNUSED fr_event_list_t *el, UNUSED fr_time_t now, vo
 #endif
 }
 
+/** Remove an entry from the in-flight list, and record our progress if it was the oldest one
+ *
+ */
+static void work_progress(proto_detail_work_thread_t *thread, fr_detail_entry_t *track)
+{
+	fr_detail_entry_t	*oldest = fr_dlist_head(&thread->in_flight);
+	fr_detail_progress_t	progress;
+
+	fr_dlist_remove(&thread->in_flight, track);
+
+	if ((thread->progress_fd < 0) || (track != oldest)) return;
+
+	/*
+	 *	Everything before the oldest entry which is still
+	 *	being processed is done.  If there's nothing being
+	 *	processed, everything before the next entry is done.
+	 */
+	oldest = fr_dlist_head(&thread->in_flight);
+
+	progress = (fr_detail_progress_t) {
+		.ino = thread->ino,
+		.offset = oldest ? oldest->header_offset : thread->header_offset
+	};
+
+	if (pwrite(thread->progress_fd, &progress, sizeof(progress), 0) < 0) {
+		ERROR("%s - Failed writing progress file: %s", thread->name, fr_syserror(errno));
+	}
+}
+
 static ssize_t mod_write(fr_listen_t *li, void *packet_ctx, UNUSED fr_time_t request_time,
 			 uint8_t *buffer, size_t buffer_len, UNUSED size_t written)
 {
@@ -626,17 +776,22 @@ static ssize_t mod_write(fr_listen_t *li, void *packet_ctx, UNUSED fr_time_t req
 	} else if (inst->track_progress && (track->done_offset > 0)) {
 	mark_done:
 		/*
-		 *	Seek to the entry, mark it as done, and then seek to
-		 *	the point in the file where we were reading from.
+		 *	Mark the entry as done.  This doesn't change the
+		 *	file offset, so the reader isn't affected.
 		 */
-		(void) lseek(thread->fd, track->done_offset, SEEK_SET);
-		if (write(thread->fd, "Done", 4) < 0) {
+		if (inst->parent->format == FR_DETAIL_FORMAT_BINARY) {
+			static uint8_t const done = FR_DETAIL_BINARY_FLAG_DONE;
+
+			if (pwrite(thread->fd, &done, sizeof(done), track->done_offset) < 0) goto mark_failed;
+
+		} else if (pwrite(thread->fd, "Done", 4, track->done_offset) < 0) {
+		mark_failed:
 			ERROR("%s - Failed marking entry as done: %s", thread->name, fr_syserror(errno));
 		}
-		(void) lseek(thread->fd, thread->read_offset, SEEK_SET);
 	}
 
 free_track:
+	work_progress(thread, track);
 	thread->outstanding--;
 
 	/*
@@ -648,8 +803,8 @@ free_track:
 
 		/*
 		 *	And seek to the start of the file, so that the
-		 *	reader gets activated again.  The reader will
-		 *	lseek() to the read offset, so this seek is fine.
+		 *	reader gets activated again.  The reader uses
+		 *	pread() at the read offset, so this seek is fine.
 		 */
 		(void) lseek(thread->fd, 0, SEEK_SET);
 	}
@@ -672,6 +827,54 @@ free_track:
 	return buffer_len;
 }
 
+/** Open the progress file, and skip any entries it says have been processed
+ *
+ * @param[in] inst	the detail worker configuration.
+ * @param[in] thread	the detail worker.
+ * @param[in] st	of the work file.
+ * @return
+ *	- 0 on success.
+ *	- -1 on failure.
+ */
+static int work_progress_open(proto_detail_work_t const *inst, proto_detail_work_thread_t *thread, struct stat const *st)
+{
+	fr_detail_progress_t	progress;
+	uint8_t			eor[4];
+
+	thread->ino = st->st_ino;
+	thread->filename_progress = talloc_typed_asprintf(thread, "%s.offset", thread->filename_work);
+
+	thread->progress_fd = open(thread->filename_progress, O_RDWR | O_CREAT, 0600);
+	if (thread->progress_fd < 0) {
+		cf_log_err(inst->cs, "Failed opening %s: %s", thread->filename_progress, fr_syserror(errno));
+		return -1;
+	}
+
+	if (pread(thread->progress_fd, &progress, sizeof(progress), 0) != sizeof(progress)) return 0;
+
+	/*
+	 *	The progress file is left over from a different
+	 *	work file, or it's past the end of this one.
+	 */
+	if ((progress.ino != (uint64_t) st->st_ino) ||
+	    (progress.offset < 2) || (progress.offset >= (uint64_t) st->st_size)) return 0;
+
+	/*
+	 *	Only trust offsets which are at the start of an entry.
+	 */
+	if (inst->parent->format == FR_DETAIL_FORMAT_BINARY) {
+		if ((pread(thread->fd, eor, 4, progress.offset) != 4) ||
+		    (memcmp(eor, FR_DETAIL_BINARY_MAGIC, 4) != 0)) return 0;
+
+	} else if ((pread(thread->fd, eor, 2, progress.offset - 2) != 2) ||
+		   (memcmp(eor, "\n\n", 2) != 0)) return 0;
+
+	DEBUG("Skipping to offset %" PRIu64 " of %s", progress.offset, thread->filename_work);
+
+	thread->header_offset = thread->read_offset = progress.offset;
+	return 0;
+}
+
 /** Open a detail listener
  *
  */
@@ -681,6 +884,8 @@ static int mod_open(fr_listen_t *li)
 	proto_detail_work_thread_t	*thread = talloc_get_type_abort(li->thread_instance, proto_detail_work_thread_t);
 
 	fr_dlist_init(&thread->list, fr_detail_entry_t, entry);
+	fr_dlist_init(&thread->in_flight, fr_detail_entry_t, in_flight_entry);
+	thread->progress_fd = -1;
 
 	/*
 	 *	Open the file if we haven't already been given one.
@@ -707,6 +912,8 @@ static int mod_open(fr_listen_t *li)
 		}
 
 		thread->file_size = buf.st_size;
+
+		if (work_progress_open(inst, thread, &buf) < 0) return -1;
 	} else {
 		/*
 		 *	Avoid triggering erroneous EOF.
@@ -756,6 +963,16 @@ static int mod_close_internal(proto_detail_work_thread_t *thread)
 #endif
 	fr_event_fd_delete(thread->el, thread->fd, FR_EVENT_FILTER_IO);
 
+	/*
+	 *	Remove the progress file first.  If we crash before
+	 *	removing the work file, we just read it again.
+	 */
+	if (thread->progress_fd >= 0) {
+		if (thread->outstanding == 0) unlink(thread->filename_progress);
+		close(thread->progress_fd);
+		thread->progress_fd = -1;
+	}
+
 	if (thread->outstanding == 0) unlink(thread->filename_work);
 
 	close(thread->fd);
@@ -867,6 +1084,26 @@ static int mod_instantiate(module_inst_ctx_t const *mctx)
 		FR_TIME_DELTA_BOUND_CHECK("limit.max_rtx_timer", inst->retry_config.mrt, <=, fr_time_delta_from_sec(30));
 	}
 
+	/*
+	 *	When replaying a backlog, read ahead enough entries
+	 *	to keep all of the workers busy.  The window is still
+	 *	bounded by max_outstanding, and the progress file
+	 *	records the oldest unfinished entry, so a restart
+	 *	doesn't lose anything which was in flight.
+	 */
+	if (inst->replay) {
+		CONF_SECTION *limit = cf_section_find(cs, "limit", NULL);
+
+		if (!inst->track_progress) {
+			cf_log_err(cs, "'replay = yes' requires 'track = yes'");
+			return -1;
+		}
+
+		if (!limit || !cf_pair_find(limit, "max_outstanding")) {
+			inst->max_outstanding = PROTO_DETAIL_REPLAY_PER_WORKER * (main_config->max_workers ? main_config->max_workers : 1);
+		}
+	}
+
 	FR_INTEGER_BOUND_CHECK("limit.max_outstanding", inst->max_outstanding, >=, 1);
 
 	client = inst->client = talloc_zero(inst, fr_client_t);
@@ -0,0 +1,328 @@
+#include <freeradius-devel/util/acutest.h>
+#include <freeradius-devel/util/acutest_helpers.h>
+
+/*
+ *	Gives access to the reader, so we can drive it without
+ *	a network thread.
+ */
+#include "proto_detail_work.c"
+
+#include <freeradius-devel/radius/defs.h>
+
+#define WORK_TEST_BUFFER_SIZE	4096
+
+/*
+ *	The second entry has already been processed, so the
+ *	reader skips it.
+ */
+static char const *text_entries[] = {
+	"Tue Sep 13 16:24:27 2011\n\tUser-Name = \"a\"\n\tTimestamp = 1\n\n",
+	"Tue Sep 13 16:24:28 2011\n\tUser-Name = \"b\"\n\tDonestamp = 2\n\n",
+	"Tue Sep 13 16:24:29 2011\n\tUser-Name = \"c\"\n\tTimestamp = 3\n\n",
+	"Tue Sep 13 16:24:30 2011\n\tUser-Name = \"d\"\n\tTimestamp = 4\n\n",
+};
+
+typedef struct {
+	char const			*filename;
+	fr_event_list_t			*el;
+
+	proto_detail_t			parent;
+	proto_detail_work_t		inst;
+
+	proto_detail_work_thread_t	*thread;
+	fr_listen_t			li;
+
+	uint8_t				buffer[WORK_TEST_BUFFER_SIZE];
+	size_t				leftover;
+} work_test_t;
+
+/** Write entries to a new work file, and return the offset of each one
+ *
+ */
+static void work_test_file(work_test_t *wt, uint8_t const **entries, size_t const *lens, off_t *offsets, size_t num)
+{
+	size_t	i;
+	off_t	offset = 0;
+	int	fd;
+
+	fd = open(wt->filename, O_RDWR | O_CREAT | O_TRUNC, 0600);
+	TEST_ASSERT(fd >= 0);
+
+	for (i = 0; i < num; i++) {
+		offsets[i] = offset;
+		TEST_ASSERT(write(fd, entries[i], lens[i]) == (ssize_t) lens[i]);
+		offset += lens[i];
+	}
+	close(fd);
+}
+
+static void work_test_init(TALLOC_CTX *ctx, work_test_t *wt, fr_detail_format_t format)
+{
+	fr_time_start();
+
+	wt->filename = talloc_typed_asprintf(ctx, "/tmp/proto_detail_work_tests.%u.work", (unsigned int) getpid());
+	wt->el = fr_event_list_alloc(ctx, NULL, NULL);
+	TEST_ASSERT(wt->el != NULL);
+
+	wt->parent = (proto_detail_t) {
+		.format = format,
+		.max_packet_size = WORK_TEST_BUFFER_SIZE
+	};
+
+	wt->inst = (proto_detail_work_t) {
+		.parent = &wt->parent,
+		.filename_work = wt->filename,
+		.track_progress = true,
+		.max_outstanding = 16,
+		.mode = O_RDWR
+	};
+}
+
+/** Start a reader, as if the server had just been started
+ *
+ */
+static void work_test_open(TALLOC_CTX *ctx, work_test_t *wt)
+{
+	MEM(wt->thread = talloc_zero(ctx, proto_detail_work_thread_t));
+	wt->thread->inst = &wt->inst;
+	wt->thread->el = wt->el;
+	wt->thread->filename_work = wt->filename;
+	wt->thread->fd = open(wt->filename, O_RDWR);
+	TEST_ASSERT(wt->thread->fd >= 0);
+
+	wt->li = (fr_listen_t) {
+		.app_io_instance = &wt->inst,
+		.thread_instance = wt->thread
+	};
+	wt->leftover = 0;
+
+	TEST_ASSERT(mod_open(&wt->li) == 0);
+}
+
+/** Stop a reader, leaving the work and progress files as they are
+ *
+ */
+static void work_test_close(work_test_t *wt)
+{
+	close(wt->thread->fd);
+	close(wt->thread->progress_fd);
+	TALLOC_FREE(wt->thread);
+}
+
+/** Read the next entry, moving any leftover data to the start of the buffer
+ *
+ */
+static ssize_t work_test_read(work_test_t *wt, fr_detail_entry_t **track)
+{
+	void		*packet_ctx = NULL;
+	fr_time_t	recv_time;
+	ssize_t		slen;
+
+	slen = mod_read(&wt->li, &packet_ctx, &recv_time, wt->buffer, sizeof(wt->buffer), &wt->leftover);
+	if (slen > 0) {
+		memmove(wt->buffer, wt->buffer + slen, wt->leftover);
+		*track = packet_ctx;
+	}
+
+	return slen;
+}
+
+static void work_test_reply(work_test_t *wt, fr_detail_entry_t *track)
+{
+	uint8_t reply = FR_RADIUS_CODE_ACCOUNTING_RESPONSE;
+
+	(void) mod_write(&wt->li, track, fr_time(), &reply, sizeof(reply), 0);
+}
+
+static uint64_t work_test_progress(work_test_t *wt)
+{
+	fr_detail_progress_t	progress;
+	char			*filename = talloc_typed_asprintf(NULL, "%s.offset", wt->filename);
+	int			fd;
+
+	fd = open(filename, O_RDONLY);
+	talloc_free(filename);
+	if (fd < 0) return 0;
+
+	if (read(fd, &progress, sizeof(progress)) != sizeof(progress)) progress.offset = 0;
+	close(fd);
+
+	return progress.offset;
+}
+
+/** Overwrite the offset in the progress file
+ *
+ */
+static void work_test_progress_set(work_test_t *wt, off_t offset)
+{
+	fr_detail_progress_t	progress;
+	char			*filename = talloc_typed_asprintf(NULL, "%s.offset", wt->filename);
+	int			fd;
+
+	fd = open(filename, O_RDWR);
+	talloc_free(filename);
+	TEST_ASSERT(fd >= 0);
+
+	TEST_CHECK(pread(fd, &progress, sizeof(progress), 0) == sizeof(progress));
+	progress.offset = offset;
+	TEST_CHECK(pwrite(fd, &progress, sizeof(progress), 0) == sizeof(progress));
+	close(fd);
+}
+
+static void work_test_cleanup(work_test_t *wt)
+{
+	char *filename = talloc_typed_asprintf(NULL, "%s.offset", wt->filename);
+
+	unlink(filename);
+	unlink(wt->filename);
+	talloc_free(filename);
+}
+
+static void test_text_resume(void)
+{
+	TALLOC_CTX		*ctx = talloc_init_const("work_test");
+	work_test_t		wt = { 0 };
+	uint8_t const		*entries[NUM_ELEMENTS(text_entries)];
+	size_t			lens[NUM_ELEMENTS(text_entries)];
+	off_t			offsets[NUM_ELEMENTS(text_entries)];
+	fr_detail_entry_t	*a = NULL, *c = NULL, *d = NULL;
+	char			marker[4];
+	size_t			i;
+	int			fd;
+
+	for (i = 0; i < NUM_ELEMENTS(text_entries); i++) {
+		entries[i] = (uint8_t const *) text_entries[i];
+		lens[i] = strlen(text_entries[i]);
+	}
+
+	work_test_init(ctx, &wt, FR_DETAIL_FORMAT_TEXT);
+	work_test_file(&wt, entries, lens, offsets, NUM_ELEMENTS(entries));
+	work_test_open(ctx, &wt);
+
+	TEST_CASE("Entries which are already done are skipped");
+	TEST_CHECK(work_test_read(&wt, &a) == (ssize_t) lens[0]);
+	TEST_CHECK(work_test_read(&wt, &c) == (ssize_t) lens[2]);
+	TEST_ASSERT(a && c);
+	TEST_CHECK(c->header_offset == offsets[2]);
+	TEST_MSG("Expected entry at offset %zu, got %zu", (size_t) offsets[2], (size_t) c->header_offset);
+
+	TEST_CASE("Progress isn't recorded while an older entry is in flight");
+	work_test_reply(&wt, c);
+	TEST_CHECK(work_test_progress(&wt) == 0);
+
+	TEST_CASE("Progress is recorded when the oldest entry finishes");
+	work_test_reply(&wt, a);
+	TEST_CHECK(work_test_progress(&wt) == (uint64_t) offsets[3]);
+	TEST_MSG("Expected progress %zu, got %" PRIu64, (size_t) offsets[3], work_test_progress(&wt));
+
+	/*
+	 *	"Done" overwrites the start of "Timestamp".
+	 */
+	TEST_CASE("Entries after a skipped one are marked done in the right place");
+	fd = open(wt.filename, O_RDONLY);
+	TEST_ASSERT(fd >= 0);
+	for (i = 0; i < 3; i++) {
+		char const *p = strstr(text_entries[i], "\tTimestamp");
+
+		if (!p) continue;
+
+		TEST_CHECK(pread(fd, marker, sizeof(marker), offsets[i] + (p - text_entries[i]) + 1) == sizeof(marker));
+		TEST_CHECK(memcmp(marker, "Done", sizeof(marker)) == 0);
+		TEST_MSG("Entry %zu wasn't marked done", i);
+	}
+	close(fd);
+
+	work_test_close(&wt);
+
+	TEST_CASE("Restarted reader resumes from the first unfinished entry");
+	work_test_open(ctx, &wt);
+	TEST_CHECK(wt.thread->header_offset == offsets[3]);
+	TEST_CHECK(work_test_read(&wt, &d) == (ssize_t) lens[3]);
+	TEST_ASSERT(d != NULL);
+	TEST_CHECK(d->header_offset == offsets[3]);
+	TEST_CHECK(memcmp(wt.buffer, "Tue Sep 13 16:24:30 2011", 24) == 0);
+	work_test_close(&wt);
+
+	TEST_CASE("Progress which isn't at the start of an entry is ignored");
+	work_test_progress_set(&wt, offsets[3] + 1);
+	work_test_open(ctx, &wt);
+	TEST_CHECK(wt.thread->header_offset == 0);
+	work_test_close(&wt);
+
+	work_test_cleanup(&wt);
+	talloc_free(ctx);
+}
+
+static void test_binary_resume(void)
+{
+	TALLOC_CTX		*ctx = talloc_init_const("work_test");
+	work_test_t		wt = { 0 };
+	uint8_t			records[4][FR_DETAIL_BINARY_HDR_LEN + 8];
+	uint8_t const		*entries[NUM_ELEMENTS(records)];
+	size_t			lens[NUM_ELEMENTS(records)];
+	off_t			offsets[NUM_ELEMENTS(records)];
+	fr_detail_entry_t	*a = NULL, *c = NULL, *d = NULL;
+	uint8_t			flags;
+	size_t			i;
+	int			fd;
+
+	for (i = 0; i < NUM_ELEMENTS(records); i++) {
+		fr_detail_binary_hdr_t	hdr = {
+			.flags = (i == 1) ? FR_DETAIL_BINARY_FLAG_DONE : 0,
+			.code = FR_RADIUS_CODE_ACCOUNTING_REQUEST,
+			.timestamp = i,
+			.length = 8
+		};
+		uint8_t			*payload = records[i] + FR_DETAIL_BINARY_HDR_LEN;
+
+		memset(payload, 'a' + i, 8);
+		fr_detail_binary_hdr_encode(records[i], &hdr, payload);
+		entries[i] = records[i];
+		lens[i] = sizeof(records[i]);
+	}
+
+	work_test_init(ctx, &wt, FR_DETAIL_FORMAT_BINARY);
+	work_test_file(&wt, entries, lens, offsets, NUM_ELEMENTS(entries));
+	work_test_open(ctx, &wt);
+
+	TEST_CASE("Records which are already done are skipped");
+	TEST_CHECK(work_test_read(&wt, &a) == (ssize_t) lens[0]);
+	TEST_CHECK(work_test_read(&wt, &c) == (ssize_t) lens[2]);
+	TEST_ASSERT(a && c);
+	TEST_CHECK(c->header_offset == offsets[2]);
+
+	TEST_CASE("Progress is recorded past the skipped record");
+	work_test_reply(&wt, c);
+	work_test_reply(&wt, a);
+	TEST_CHECK(work_test_progress(&wt) == (uint64_t) offsets[3]);
+
+	TEST_CASE("Records after a skipped one are marked done in the right place");
+	fd = open(wt.filename, O_RDONLY);
+	TEST_ASSERT(fd >= 0);
+	for (i = 0; i < 3; i++) {
+		TEST_CHECK(pread(fd, &flags, sizeof(flags), offsets[i] + FR_DETAIL_BINARY_FLAGS_OFFSET) == sizeof(flags));
+		TEST_CHECK(flags == FR_DETAIL_BINARY_FLAG_DONE);
+		TEST_MSG("Record %zu wasn't marked done", i);
+	}
+	close(fd);
+
+	work_test_close(&wt);
+
+	TEST_CASE("Restarted reader resumes from the first unfinished record");
+	work_test_open(ctx, &wt);
+	TEST_CHECK(wt.thread->header_offset == offsets[3]);
+	TEST_CHECK(work_test_read(&wt, &d) == (ssize_t) lens[3]);
+	TEST_ASSERT(d != NULL);
+	TEST_CHECK(d->header_offset == offsets[3]);
+	work_test_close(&wt);
+
+	work_test_cleanup(&wt);
+	talloc_free(ctx);
+}
+
+TEST_LIST = {
+	{ "text_resume",	test_text_resume },
+	{ "binary_resume",	test_binary_resume },
+
+	{ NULL }
+};
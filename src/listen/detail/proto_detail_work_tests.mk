@@ -0,0 +1,8 @@
+TARGET		:= proto_detail_work_tests$(E)
+SOURCES		:= proto_detail_work_tests.c
+
+TGT_LDLIBS	:= $(LIBS) $(GPERFTOOLS_LIBS)
+TGT_LDFLAGS	:= $(LDFLAGS) $(GPERFTOOLS_LDFLAGS)
+TGT_PREREQS	:= libfreeradius-util$(L) libfreeradius-server$(L) libfreeradius-io$(L) libfreeradius-unlang$(L)
+
+TGT_INSTALLDIR	:=
@@ -241,6 +241,12 @@ static ssize_t mod_encode(UNUSED void const *instance, request_t *request, uint8
 	}
 
 	reply->id = original->id;
+
+	/*
+	 *	RFC 4035 Section 3.2.2.  The reply cache also relies
+	 *	on this, as CD is part of its key.
+	 */
+	reply->checking_disabled = original->checking_disabled;
 	request->reply->data_len = data_len;
 
 	RHEXDUMP3(buffer, data_len, "proto_dns encode packet");
@@ -30,6 +30,8 @@
 #include <freeradius-devel/util/trie.h>
 #include <freeradius-devel/io/application.h>
 #include <freeradius-devel/io/listen.h>
+#include <freeradius-devel/io/master.h>
+#include <freeradius-devel/io/reply_cache.h>
 #include <freeradius-devel/io/schedule.h>
 #include <freeradius-devel/protocol/dns/freeradius.internal.h>
 #include "proto_dns.h"
@@ -43,6 +45,9 @@ typedef struct {
 	fr_io_address_t			*connection;		//!< for connected sockets.
 
 	fr_stats_t			stats;			//!< statistics for this socket
+
+	fr_io_reply_cache_t		*cache;			//!< replies we can send without a worker.
+	uint8_t				*reply;			//!< buffer for replies from the cache.
 }  proto_dns_udp_thread_t;
 
 typedef struct {
@@ -68,6 +73,10 @@ typedef struct {
 	fr_trie_t			*trie;			//!< for parsed networks
 	fr_ipaddr_t			*allow;			//!< allowed networks for dynamic clients
 	fr_ipaddr_t			*deny;			//!< denied networks for dynamic clients
+
+	fr_io_reply_cache_conf_t	cache;			//!< reply cache limits.
+	fr_time_delta_t			cache_max_ttl;		//!< maximum time to cache a positive reply.
+	fr_time_delta_t			cache_max_negative_ttl;	//!< maximum time to cache NXDOMAIN / NODATA.
 } proto_dns_udp_t;
 
 
@@ -79,6 +88,16 @@ static const conf_parser_t networks_config[] = {
 };
 
 
+static const conf_parser_t cache_config[] = {
+	{ FR_CONF_OFFSET("max_entries", proto_dns_udp_t, cache.max_entries), .dflt = "0" },
+	{ FR_CONF_OFFSET("max_ttl", proto_dns_udp_t, cache_max_ttl), .dflt = "3600" },
+	{ FR_CONF_OFFSET("max_negative_ttl", proto_dns_udp_t, cache_max_negative_ttl), .dflt = "300" },
+	{ FR_CONF_OFFSET("prefetch_hits", proto_dns_udp_t, cache.prefetch_hits), .dflt = "2" },
+
+	CONF_PARSER_TERMINATOR
+};
+
+
 static const conf_parser_t udp_listen_config[] = {
 	{ FR_CONF_OFFSET_TYPE_FLAGS("ipaddr", FR_TYPE_COMBO_IP_ADDR, 0, proto_dns_udp_t, ipaddr) },
 	{ FR_CONF_OFFSET_TYPE_FLAGS("ipv6addr", FR_TYPE_IPV6_ADDR, 0, proto_dns_udp_t, ipaddr) },
@@ -90,6 +109,7 @@ static const conf_parser_t udp_listen_config[] = {
 	{ FR_CONF_OFFSET_IS_SET("recv_buff", FR_TYPE_UINT32, 0, proto_dns_udp_t, recv_buff) },
 
 	{ FR_CONF_POINTER("networks", 0, CONF_FLAG_SUBSECTION, NULL), .subcs = (void const *) networks_config },
+	{ FR_CONF_POINTER("cache", 0, CONF_FLAG_SUBSECTION, NULL), .subcs = (void const *) cache_config },
 
 	{ FR_CONF_OFFSET("max_packet_size", proto_dns_udp_t, max_packet_size), .dflt = "576" } ,
 	{ FR_CONF_OFFSET("max_attributes", proto_dns_udp_t, max_attributes), .dflt = STRINGIFY(DNS_MAX_ATTRIBUTES) } ,
@@ -186,17 +206,14 @@ static ssize_t mod_read(fr_listen_t *li, void **packet_ctx, fr_time_t *recv_time
 	return packet_len;
 }
 
-static ssize_t mod_write(fr_listen_t *li, void *packet_ctx, UNUSED fr_time_t request_time,
-			 uint8_t *buffer, size_t buffer_len, UNUSED size_t written)
+/** Send a reply to the client which sent the query
+ *
+ */
+static ssize_t udp_reply(proto_dns_udp_thread_t *thread, fr_io_track_t *track, uint8_t *buffer, size_t buffer_len)
 {
-//	proto_dns_udp_t const		*inst = talloc_get_type_abort_const(li->app_io_instance, proto_dns_udp_t);
-	proto_dns_udp_thread_t		*thread = talloc_get_type_abort(li->thread_instance, proto_dns_udp_thread_t);
-
-	fr_io_track_t			*track = talloc_get_type_abort(packet_ctx, fr_io_track_t);
 	fr_socket_t			socket;
 
 	int				flags;
-	ssize_t				data_size;
 
 	/*
 	 *	@todo - share a stats interface with the parent?  or
@@ -222,16 +239,81 @@ static ssize_t mod_write(fr_listen_t *li, void *packet_ctx, UNUSED fr_time_t req
 	/*
 	 *	proto_dns takes care of suppressing do-not-respond, etc.
 	 */
-	data_size = udp_send(&socket, flags, buffer, buffer_len);
+	return udp_send(&socket, flags, buffer, buffer_len);
+}
+
+static ssize_t mod_write(fr_listen_t *li, void *packet_ctx, UNUSED fr_time_t request_time,
+			 uint8_t *buffer, size_t buffer_len, UNUSED size_t written)
+{
+	proto_dns_udp_t const		*inst = talloc_get_type_abort_const(li->app_io_instance, proto_dns_udp_t);
+	proto_dns_udp_thread_t		*thread = talloc_get_type_abort(li->thread_instance, proto_dns_udp_thread_t);
+
+	fr_io_track_t			*track = talloc_get_type_abort(packet_ctx, fr_io_track_t);
+	ssize_t				data_size;
+	uint8_t				key[FR_DNS_CACHE_KEY_MAX];
+	ssize_t				key_len;
+
+	data_size = udp_reply(thread, track, buffer, buffer_len);
 
 	/*
 	 *	This socket is dead.  That's an error...
 	 */
 	if (data_size <= 0) return data_size;
 
+	/*
+	 *	Remember the reply, so that the network thread can
+	 *	send it again.
+	 */
+	if (!thread->cache) return data_size;
+
+	key_len = fr_dns_cache_key(key, sizeof(key), buffer, buffer_len);
+	if (key_len <= 0) return data_size;
+
+	if (fr_io_reply_cache_insert(thread->cache, key, key_len, buffer, buffer_len,
+				     fr_dns_cache_lifetime(buffer, buffer_len,
+							   inst->cache_max_ttl, inst->cache_max_negative_ttl),
+				     fr_time()) < 0) {
+		RATE_LIMIT_GLOBAL(PERROR, "Failed caching reply");
+	}
+
 	return data_size;
 }
 
+/** Answer a query from the cache, without sending it to a worker
+ *
+ */
+static ssize_t mod_reply_cached(fr_listen_t *li, void *packet_ctx, uint8_t const *packet, size_t packet_len,
+				uint8_t const **reply)
+{
+	proto_dns_udp_thread_t		*thread = talloc_get_type_abort(li->thread_instance, proto_dns_udp_thread_t);
+	fr_io_track_t			*track = talloc_get_type_abort(packet_ctx, fr_io_track_t);
+	uint8_t				key[FR_DNS_CACHE_KEY_MAX];
+	ssize_t				key_len, reply_len;
+	uint8_t const			*cached;
+	size_t				cached_len;
+	fr_time_delta_t			age;
+
+	if (!thread->cache) return 0;
+
+	key_len = fr_dns_cache_key(key, sizeof(key), packet, packet_len);
+	if (key_len <= 0) return 0;
+
+	cached = fr_io_reply_cache_find(thread->cache, &cached_len, &age, key, key_len, fr_time());
+	if (!cached) return 0;
+
+	reply_len = fr_dns_cache_reply(thread->reply, talloc_array_length(thread->reply),
+				       cached, cached_len, age, packet, packet_len);
+	if (reply_len <= 0) return 0;
+
+	DEBUG2("Sending cached reply ID %04x length %d %s", fr_nbo_to_uint16(thread->reply),
+	       (int) reply_len, thread->name);
+
+	if (udp_reply(thread, track, thread->reply, reply_len) <= 0) return -1;
+
+	*reply = thread->reply;
+	return reply_len;
+}
+
 
 static int mod_connection_set(fr_listen_t *li, fr_io_address_t *connection)
 {
@@ -307,6 +389,28 @@ static int mod_open(fr_listen_t *li)
 					     NULL, 0,
 					     &inst->ipaddr, inst->port,
 					     inst->interface);
+
+	/*
+	 *	Each listener has its own cache, which is only used
+	 *	by the network thread the listener is in.  So there's
+	 *	no locking.
+	 */
+	if (inst->cache.max_entries) {
+		thread->cache = fr_io_reply_cache_alloc(thread, &inst->cache);
+		if (!thread->cache) {
+			PERROR("Failed allocating reply cache");
+			close(sockfd);
+			goto error;
+		}
+
+		thread->reply = talloc_array(thread, uint8_t, inst->max_packet_size);
+		if (!thread->reply) {
+			ERROR("Failed allocating reply buffer");
+			close(sockfd);
+			goto error;
+		}
+	}
+
 	return 0;
 }
 
@@ -378,6 +482,14 @@ static int mod_instantiate(module_inst_ctx_t const *mctx)
 	FR_INTEGER_BOUND_CHECK("max_packet_size", inst->max_packet_size, >=, 64);
 	FR_INTEGER_BOUND_CHECK("max_packet_size", inst->max_packet_size, <=, 65536);
 
+	if (inst->cache.max_entries) {
+		FR_INTEGER_BOUND_CHECK("cache.max_entries", inst->cache.max_entries, <=, (1 << 24));
+		FR_TIME_DELTA_BOUND_CHECK("cache.max_ttl", inst->cache_max_ttl, >=, fr_time_delta_from_sec(1));
+		FR_TIME_DELTA_BOUND_CHECK("cache.max_ttl", inst->cache_max_ttl, <=, fr_time_delta_from_sec(86400));
+		FR_TIME_DELTA_BOUND_CHECK("cache.max_negative_ttl", inst->cache_max_negative_ttl, <=,
+					  fr_time_delta_from_sec(86400));
+	}
+
 	/*
 	 *	Parse and create the trie for dynamic clients, even if
 	 *	there's no dynamic clients.
@@ -463,4 +575,5 @@ fr_app_io_t proto_dns_udp = {
 	.network_get		= mod_network_get,
 	.client_find		= mod_client_find,
 	.get_name      		= mod_name,
+	.reply_cached		= mod_reply_cached,
 };
@@ -6,4 +6,4 @@ endif
 
 SOURCES		:= proto_dns_udp.c
 
-TGT_PREREQS	:= libfreeradius-dns$(L)
+TGT_PREREQS	:= libfreeradius-dns$(L) libfreeradius-io$(L)
@@ -439,6 +439,27 @@ int ldap_sync_entry_send(sync_state_t *sync, uint8_t const uuid[SYNC_UUID_LENGTH
 
 	pcode = sync_packet_code_table[op];
 
+	/*
+	 *	Any cached LDAP searches which may include
+	 *	this entry are now stale.
+	 */
+	if (op != SYNC_OP_PRESENT) {
+		if (orig_dn && (orig_dn->bv_len > 0)) {
+			/*
+			 *	Renames move every object below the
+			 *	entry, so invalidate everything.
+			 */
+			fr_ldap_cache_invalidate_all();
+		} else if (msg) {
+			char *entry_dn = ldap_get_dn(sync->conn->handle, msg);
+
+			fr_ldap_cache_invalidate_dn(entry_dn);
+			if (entry_dn) ldap_memfree(entry_dn);
+		} else {
+			fr_ldap_cache_invalidate_all();
+		}
+	}
+
 	fr_pair_list_append_by_da(sync_packet_ctx, vp, pairs, attr_packet_type, (uint32_t)pcode, false);
 	if (!vp) goto error;
 
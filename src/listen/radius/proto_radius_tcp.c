@@ -100,73 +100,41 @@ static const conf_parser_t tcp_listen_config[] = {
 };
 
 
+/** Get the length of a RADIUS packet from its header
+ *
+ */
+static ssize_t radius_tcp_length(uint8_t const *buffer, UNUSED size_t buffer_len)
+{
+	return fr_nbo_to_uint16(buffer + 2);
+}
+
 static ssize_t mod_read(fr_listen_t *li, UNUSED void **packet_ctx, fr_time_t *recv_time_p, uint8_t *buffer, size_t buffer_len, size_t *leftover)
 {
 	proto_radius_tcp_t const       	*inst = talloc_get_type_abort_const(li->app_io_instance, proto_radius_tcp_t);
 	proto_radius_tcp_thread_t	*thread = talloc_get_type_abort(li->thread_instance, proto_radius_tcp_thread_t);
 	ssize_t				data_size;
-	size_t				packet_len, in_buffer;
+	size_t				packet_len;
 	decode_fail_t			reason;
 
-	/*
-	 *	We may have read multiple packets in the previous read.  In which case the buffer may already
-	 *	have packets remaining.  In that case, we can return packets directly from the buffer, and
-	 *	skip the read().
-	 */
-	if (*leftover >= RADIUS_HEADER_LENGTH) {
-		packet_len = fr_nbo_to_uint16(buffer + 2);
-
-		if (packet_len <= *leftover) {
-			data_size = 0;
-			goto have_packet;
-		}
-
-		/*
-		 *	Else we don't have a full packet, try to read more data from the network.
-		 */
-	}
-
-	/*
-	 *      Read data into the buffer.
-	 */
-	data_size = read(thread->sockfd, buffer + *leftover, buffer_len - *leftover);
-	if (data_size < 0) {
-		switch (errno) {
-#if defined(EWOULDBLOCK) && (EWOULDBLOCK != EAGAIN)
-		case EWOULDBLOCK:
-#endif
-		case EAGAIN:
-			/*
-			 *	We didn't read any data; leave the buffers alone.
-			 *
-			 *	i.e. if we had a partial packet in the buffer and we didn't read any data,
-			 *	then the partial packet is still left in the buffer.
-			 */
-			return 0;
-
-		default:
-			break;
-		}
-
-		PDEBUG2("proto_radius_tcp got read error (%zd) - %s", data_size, fr_syserror(errno));
-		return data_size;
-	}
-
 	/*
 	 *	Note that we return ERROR for all bad packets, as
 	 *	there's no point in reading RADIUS packets from a TCP
 	 *	connection which isn't sending us RADIUS packets.
 	 */
-
-	/*
-	 *	TCP read of zero means the socket is dead.
-	 */
-	if (!data_size) {
-		DEBUG2("proto_radius_tcp - other side closed the socket.");
+	data_size = fr_app_io_stream_read(thread->sockfd, buffer, buffer_len, leftover,
+					  RADIUS_HEADER_LENGTH, radius_tcp_length);
+	if (data_size == -2) {
+		DEBUG2("proto_radius_tcp - other side closed the socket %s", thread->name);
+		return -1;
+	}
+	if (data_size < 0) {
+		PERROR("proto_radius_tcp - Closing %s", thread->name);
 		return -1;
 	}
+	if (!data_size) return 0;
+
+	packet_len = data_size;
 
-have_packet:
 	/*
 	 *	We MUST always start with a known RADIUS packet.
 	 */
@@ -176,36 +144,6 @@ have_packet:
 		return -1;
 	}
 
-	in_buffer = data_size + *leftover;
-
-	/*
-	 *	Not enough for one packet.  Tell the caller that we need to read more.
-	 */
-	if (in_buffer < RADIUS_HEADER_LENGTH) {
-		*leftover = in_buffer;
-		return 0;
-	}
-
-	/*
-	 *	Figure out how large the RADIUS packet is.
-	 */
-	packet_len = fr_nbo_to_uint16(buffer + 2);
-
-	/*
-	 *	We don't have a complete RADIUS packet.  Tell the
-	 *	caller that we need to read more.
-	 */
-	if (in_buffer < packet_len) {
-		*leftover = in_buffer;
-		return 0;
-	}
-
-	/*
-	 *	We've read at least one packet.  Tell the caller that
-	 *	there's more data available, and return only one packet.
-	 */
-	*leftover = in_buffer - packet_len;
-
 	/*
 	 *      If it's not a RADIUS packet, ignore it.
 	 */
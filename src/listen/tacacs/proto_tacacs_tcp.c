@@ -127,105 +127,33 @@ static ssize_t mod_read(fr_listen_t *li, UNUSED void **packet_ctx, fr_time_t *re
 			uint8_t *buffer, size_t buffer_len, size_t *leftover)
 {
 	proto_tacacs_tcp_thread_t	*thread = talloc_get_type_abort(li->thread_instance, proto_tacacs_tcp_thread_t);
-	ssize_t				data_size, packet_len;
-	size_t				in_buffer;
-
-	/*
-	 *	We may have read multiple packets in the previous read.  In which case the buffer may already
-	 *	have packets remaining.  In that case, we can return packets directly from the buffer, and
-	 *	skip the read().
-	 */
-	if (*leftover >= FR_HEADER_LENGTH) {
-		packet_len = fr_tacacs_length(buffer, *leftover);
-		if (packet_len < 0) goto invalid;
-
-		if (packet_len <= ((ssize_t) *leftover)) {
-			data_size = 0;
-			goto have_packet;
-		}
-
-		/*
-		 *	Else we don't have a full packet, try to read more data from the network.
-		 */
-	}
-
-	/*
-	 *      Read data into the buffer.
-	 */
-	data_size = read(thread->sockfd, buffer + (*leftover), buffer_len - (*leftover));
-	if (data_size < 0) {
-		switch (errno) {
-#if defined(EWOULDBLOCK) && (EWOULDBLOCK != EAGAIN)
-		case EWOULDBLOCK:
-#endif
-		case EAGAIN:
-			/*
-			 *	We didn't read any data leave the buffers alone.
-			 *
-			 *	i.e. if we had a partial packet in the buffer and we didn't read any data,
-			 *	then the partial packet is still left in the buffer.
-			 */
-			return 0;
-
-		default:
-			break;
-		}
-
-		ERROR("proto_tacacs_tcp got read error (%zd) - %s", data_size, fr_syserror(errno));
-		return data_size;
-	}
+	ssize_t				packet_len;
 
 	/*
 	 *	Note that we return ERROR for all bad packets, as
 	 *	there's no point in reading TACACS+ packets from a TCP
 	 *	connection which isn't sending us TACACS+ packets.
 	 */
-
-	/*
-	 *	TCP read of zero means the socket is dead.
-	 */
-	if (!data_size) {
-		DEBUG2("proto_tacacs_tcp - other side closed the socket.");
+	packet_len = fr_app_io_stream_read(thread->sockfd, buffer, buffer_len, leftover,
+					   FR_HEADER_LENGTH, fr_tacacs_length);
+	if (packet_len == -2) {
+		DEBUG2("proto_tacacs_tcp - other side closed the socket %s", thread->name);
 		return -1;
 	}
-
-have_packet:
-	/*
-	 *	Represents all the data we've read since we last
-	 *	decoded a complete packet.
-	 */
-	in_buffer = *leftover + data_size;
-
-	/*
-	 *	Figure out how big the complete TACACS packet should be.
-	 *	If we don't have enough data it'll likely come
-	 *	through in the next fragment.
-	 */
-	packet_len = fr_tacacs_length(buffer, in_buffer);
 	if (packet_len < 0) {
-	invalid:
-		PERROR("Invalid TACACS packet");
-		return -1;	/* Malformed, close the socket */
+		PERROR("proto_tacacs_tcp - Closing %s", thread->name);
+		return -1;
 	}
 
 	/*
 	 *	We don't have a complete TACACS+ packet.  Tell the
-	 *	caller that we need to read more, but record
-	 *	how much we read in leftover.
+	 *	caller that we need to read more.
 	 */
-	if (in_buffer < (size_t) packet_len) {
-		DEBUG3("proto_tacacs_tcp - Received packet fragment of %zu bytes (%zu bytes now pending)",
-		       packet_len, *leftover);
-		*leftover = in_buffer;
+	if (!packet_len) {
+		DEBUG3("proto_tacacs_tcp - %zu bytes pending", *leftover);
 		return 0;
 	}
 
-	/*
-	 *	We've read at least one packet.  Tell the caller that
-	 *	there's more data available, and return only one packet.
-	 */
-	*leftover = in_buffer - packet_len;
-
 	*recv_time_p = fr_time();
 	thread->stats.total_requests++;
 
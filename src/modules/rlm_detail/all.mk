@@ -3,4 +3,5 @@ TARGETNAME	:= rlm_detail
 TARGET		:= $(TARGETNAME)$(L)
 SOURCES		:= $(TARGETNAME).c
 
+TGT_PREREQS	:= libfreeradius-internal$(L)
 LOG_ID_LIB	= 11
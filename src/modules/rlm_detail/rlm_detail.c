@@ -23,8 +23,10 @@
  */
 RCSID("$Id$")
 
+#include <freeradius-devel/internal/internal.h>
 #include <freeradius-devel/server/base.h>
 #include <freeradius-devel/server/cf_util.h>
+#include <freeradius-devel/server/detail.h>
 #include <freeradius-devel/server/exfile.h>
 #include <freeradius-devel/server/module_rlm.h>
 #include <freeradius-devel/util/debug.h>
@@ -57,6 +59,8 @@ typedef struct {
 
 	bool		escape;		//!< do filename escaping, yes / no
 
+	fr_detail_format_t format;	//!< text or binary.
+
 	exfile_t    	*ef;		//!< Log file handler
 } rlm_detail_t;
 
@@ -70,12 +74,20 @@ typedef struct {
 int detail_group_parse(UNUSED TALLOC_CTX *ctx, void *out, void *parent,
 		       CONF_ITEM *ci, conf_parser_t const *rule);
 
+static fr_table_num_sorted_t const detail_format_table[] = {
+	{ L("binary"),	FR_DETAIL_FORMAT_BINARY	},
+	{ L("text"),	FR_DETAIL_FORMAT_TEXT	}
+};
+static size_t detail_format_table_len = NUM_ELEMENTS(detail_format_table);
+
 static const conf_parser_t module_config[] = {
 	{ FR_CONF_OFFSET("permissions", rlm_detail_t, perm), .dflt = "0600" },
 	{ FR_CONF_OFFSET_IS_SET("group", FR_TYPE_VOID, 0, rlm_detail_t, group), .func = detail_group_parse },
 	{ FR_CONF_OFFSET("locking", rlm_detail_t, locking), .dflt = "no" },
 	{ FR_CONF_OFFSET("escape_filenames", rlm_detail_t, escape), .dflt = "no" },
 	{ FR_CONF_OFFSET("log_packet_header", rlm_detail_t, log_srcdst), .dflt = "no" },
+	{ FR_CONF_OFFSET("format", rlm_detail_t, format), .dflt = "text",
+	  .func = cf_table_parse_int, .uctx = &(cf_table_parse_ctx_t){ .table = detail_format_table, .len = &detail_format_table_len } },
 	CONF_PARSER_TERMINATOR
 };
 
@@ -317,6 +329,114 @@ static int detail_write(FILE *out, rlm_detail_t const *inst, request_t *request,
 	return 0;
 }
 
+/** Write a single binary detail entry to a file descriptor
+ *
+ * The record is built in memory, and written in one go, so readers
+ * never see a partial record unless the disk fills up.
+ *
+ * @note Suppression only applies to top level attributes.
+ *
+ * @param[in] fd Where to write entry.
+ * @param[in] inst Instance of rlm_detail.
+ * @param[in] request The current request.
+ * @param[in] packet associated with the request (request, reply...).
+ * @param[in] list of pairs to write.
+ * @param[in] compat Write out entry in compatibility mode.
+ * @param[in] ht Hash table containing attributes to be suppressed in the output.
+ */
+static int detail_write_binary(int fd, rlm_detail_t const *inst, request_t *request,
+			       fr_packet_t *packet, fr_pair_list_t *list, bool compat, fr_hash_table_t *ht)
+{
+	fr_dbuff_t		*dbuff;
+	fr_dcursor_t		cursor;
+	fr_pair_t		*vp;
+	fr_detail_binary_hdr_t	hdr;
+	uint8_t			*start;
+	size_t			len;
+
+	if (fr_pair_list_empty(list)) {
+		RWDEBUG("Skipping empty packet");
+		return 0;
+	}
+
+	FR_DBUFF_TALLOC_THREAD_LOCAL(&dbuff, 1024, SIZE_MAX);
+
+	if (fr_dbuff_advance(dbuff, FR_DETAIL_BINARY_HDR_LEN) < 0) {
+	oom:
+		RERROR("Failed encoding detail entry: %s", fr_strerror());
+		return -1;
+	}
+
+	/*
+	 *	Put these at the top, as with the text format.
+	 */
+	if (inst->log_srcdst) {
+		fr_pair_list_t		srcdst;
+		fr_dict_attr_t const	**da, *srcdst_da[] = { attr_net_src_address, attr_net_dst_address,
+							       attr_net_src_port, attr_net_dst_port, NULL };
+		ssize_t			slen;
+
+		fr_pair_list_init(&srcdst);
+		for (da = srcdst_da; *da; da++) {
+			vp = fr_pair_find_by_da_nested(&request->control_pairs, NULL, *da);
+			if (!vp) continue;
+
+			MEM(vp = fr_pair_copy(request, vp));
+			fr_pair_append(&srcdst, vp);
+		}
+
+		slen = fr_internal_encode_list(dbuff, &srcdst, NULL);
+		fr_pair_list_free(&srcdst);
+		if (slen < 0) goto oom;
+	}
+
+	for (vp = fr_pair_dcursor_init(&cursor, list);
+	     vp;
+	     vp = fr_dcursor_current(&cursor)) {
+		if ((ht && fr_hash_table_find(ht, vp->da)) ||
+		    (!inst->log_srcdst && (vp->da == attr_net)) ||
+		    (compat && (vp->da == attr_user_password))) {
+			fr_dcursor_next(&cursor);
+			continue;
+		}
+
+		if (fr_internal_encode_pair(dbuff, &cursor, NULL) < 0) goto oom;
+	}
+
+	start = fr_dbuff_start(dbuff);
+	len = fr_dbuff_used(dbuff);
+
+	hdr = (fr_detail_binary_hdr_t) {
+		.proto = fr_dict_root(request->dict)->attr,
+		.code = packet->code,
+		.timestamp = fr_time_to_sec(request->packet->timestamp),
+		.length = len - FR_DETAIL_BINARY_HDR_LEN
+	};
+	fr_detail_binary_hdr_encode(start, &hdr, start + FR_DETAIL_BINARY_HDR_LEN);
+
+	/*
+	 *	We hold the exfile lock until the file is closed,
+	 *	so finishing a short write can't interleave with
+	 *	another writer.
+	 */
+	while (len > 0) {
+		ssize_t slen;
+
+		slen = write(fd, start, len);
+		if (slen < 0) {
+			if (errno == EINTR) continue;
+
+			RERROR("Failed writing to detail file: %s", fr_syserror(errno));
+			return -1;
+		}
+
+		start += slen;
+		len -= slen;
+	}
+
+	return 0;
+}
+
 /*
  *	Do detail, compatible with old accounting
  */
@@ -347,6 +467,13 @@ static unlang_action_t CC_HINT(nonnull) detail_do(rlm_rcode_t *p_result, module_
 		}
 	}
 
+	if (inst->format == FR_DETAIL_FORMAT_BINARY) {
+		if (detail_write_binary(outfd, inst, request, packet, list, compat, env->ht) < 0) goto fail;
+
+		exfile_close(inst->ef, outfd);
+		RETURN_MODULE_OK;
+	}
+
 	dupfd = dup(outfd);
 	if (dupfd < 0) {
 		RERROR("Failed to dup() file descriptor for detail file");
@@ -1,6 +1 @@
-TARGETNAME	:= rlm_isc_dhcp
-
-TARGET		:= $(TARGETNAME)$(L)
-SOURCES		:= $(TARGETNAME).c
-
-LOG_ID_LIB	= 23
+SUBMAKEFILES := rlm_isc_dhcp.mk rlm_isc_dhcp_tests.mk
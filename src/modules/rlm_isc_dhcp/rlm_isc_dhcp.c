@@ -30,6 +30,17 @@ RCSID("$Id$")
 #include <freeradius-devel/util/debug.h>
 
 #include <freeradius-devel/server/map_proc.h>
+#include <freeradius-devel/io/schedule.h>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#ifdef HAVE_STDATOMIC_H
+#  include <stdatomic.h>
+#else
+#  include <freeradius-devel/util/stdatomic.h>
+#endif
 
 static fr_dict_t const *dict_dhcpv4;
 
@@ -66,17 +77,35 @@ typedef struct rlm_isc_dhcp_info_s rlm_isc_dhcp_info_t;
 #define YES_SEMICOLON	(1)
 #define MAYBE_SEMICOLON (2)
 
-/*
- *	Define a structure for our module configuration.
+/** A file we read, so that we can tell when it changes
  *
- *	These variables do not need to be in a structure, but it's
- *	a lot cleaner to do so, and a pointer to the structure can
- *	be used as the instance handle.
  */
 typedef struct {
 	char const		*filename;
-	bool			debug;
-	bool			pedantic;
+	int64_t			mtime;			//!< in nanoseconds.
+	uint64_t		size;
+	uint64_t		inode;
+} rlm_isc_dhcp_source_t;
+
+/** An "option NAME code NUMBER = TYPE" definition
+ *
+ *	These are added to the dictionary, and don't appear in the
+ *	tree.  So we remember them for the index.
+ */
+typedef struct {
+	char const		*name;
+	unsigned int		attr;
+	fr_type_t		type;
+	bool			array;
+} rlm_isc_dhcp_define_t;
+
+/** Everything we read from the configuration files
+ *
+ *	Reloads build a new one of these, and swap it in as a whole.
+ *	So a lookup sees either the old configuration, or the new
+ *	one, but never a mix of the two.
+ */
+typedef struct {
 	rlm_isc_dhcp_info_t	*head;
 
 	/*
@@ -89,6 +118,52 @@ typedef struct {
 	 */
 	fr_hash_table_t		*hosts_by_ether;       	//!< by MAC address
 	fr_hash_table_t		*hosts_by_uid;		//!< by client identifier
+
+	rlm_isc_dhcp_source_t	*sources;		//!< files we read, talloc array.
+	rlm_isc_dhcp_define_t	*defines;		//!< option definitions, talloc array.
+
+	bool			reload;			//!< we're running, so the dictionary can't be changed.
+} rlm_isc_dhcp_db_t;
+
+typedef _Atomic(rlm_isc_dhcp_db_t *) rlm_isc_dhcp_db_ptr_t;
+
+/** The current configuration, and the workers which are using it
+ *
+ *	Workers count themselves in one of the two "readers" counters
+ *	while they use the configuration.  After a reload swaps in a new
+ *	configuration, the reload thread flips "phase" twice, each time
+ *	waiting for the counter it flipped away from to drain.  Anyone
+ *	who could have seen the old configuration has then finished with
+ *	it, and it can be freed.
+ */
+typedef struct {
+	rlm_isc_dhcp_db_ptr_t	db;			//!< the current configuration.
+
+	atomic_uint		phase;			//!< which readers counter new lookups use.
+	atomic_uint		readers[2];		//!< lookups in progress, by phase.
+
+	pthread_t		thread;			//!< which checks for changes.
+	pthread_mutex_t		mutex;
+	pthread_cond_t		cond;			//!< so we can wake the thread up to exit.
+	bool			running;
+	bool			stop;
+} rlm_isc_dhcp_mutable_t;
+
+/*
+ *	Define a structure for our module configuration.
+ *
+ *	These variables do not need to be in a structure, but it's
+ *	a lot cleaner to do so, and a pointer to the structure can
+ *	be used as the instance handle.
+ */
+typedef struct {
+	char const		*filename;
+	char const		*index;
+	fr_time_delta_t		reload_interval;
+	bool			debug;
+	bool			pedantic;
+
+	rlm_isc_dhcp_mutable_t	*mutable;
 } rlm_isc_dhcp_t;
 
 /*
@@ -96,6 +171,8 @@ typedef struct {
  */
 static const conf_parser_t module_config[] = {
 	{ FR_CONF_OFFSET_FLAGS("filename", CONF_FLAG_FILE_INPUT | CONF_FLAG_REQUIRED | CONF_FLAG_NOT_EMPTY, rlm_isc_dhcp_t, filename) },
+	{ FR_CONF_OFFSET_FLAGS("index", CONF_FLAG_FILE_OUTPUT, rlm_isc_dhcp_t, index) },
+	{ FR_CONF_OFFSET("reload_interval", rlm_isc_dhcp_t, reload_interval) },
 	{ FR_CONF_OFFSET("debug", rlm_isc_dhcp_t, debug) },
 	{ FR_CONF_OFFSET("pedantic", rlm_isc_dhcp_t, pedantic) },
 	CONF_PARSER_TERMINATOR
@@ -122,7 +199,8 @@ static const conf_parser_t module_config[] = {
  *
  */
 typedef struct {
-	rlm_isc_dhcp_t	*inst;		//!< module instance
+	rlm_isc_dhcp_t const *inst;	//!< module instance
+	rlm_isc_dhcp_db_t *db;		//!< what we're reading into
 	FILE		*fp;
 	char const	*filename;
 	int		lineno;
@@ -199,7 +277,8 @@ struct rlm_isc_dhcp_info_s {
 	rlm_isc_dhcp_info_t	**last;		//!< pointer to last child
 };
 
-static int read_file(rlm_isc_dhcp_t *inst, rlm_isc_dhcp_info_t *parent, char const *filename);
+static int read_file(rlm_isc_dhcp_t const *inst, rlm_isc_dhcp_db_t *db,
+		     rlm_isc_dhcp_info_t *parent, char const *filename);
 static int parse_section(rlm_isc_dhcp_tokenizer_t *state, rlm_isc_dhcp_info_t *info);
 
 static char const *spaces = "                                                                                ";
@@ -746,7 +825,7 @@ static int parse_include(rlm_isc_dhcp_tokenizer_t *state, rlm_isc_dhcp_info_t *i
 	 *	Note that we read the included file into the PARENT's
 	 *	list.  i.e. as if the file was included in-place.
 	 */
-	ret = read_file(state->inst, info->parent, name);
+	ret = read_file(state->inst, state->db, info->parent, name);
 	if (ret < 0) return ret;
 
 	/*
@@ -844,6 +923,74 @@ static fr_type_t isc2fr_type(rlm_isc_dhcp_tokenizer_t *state)
 }
 
 
+/** Add an option definition to the dictionary, and remember it
+ *
+ *	This is used both when parsing, and when loading the index.
+ */
+static int define_add(rlm_isc_dhcp_db_t *db, char const *name, unsigned int attr, fr_type_t type,
+		      fr_dict_attr_flags_t const *flags)
+{
+	size_t num;
+	fr_dict_attr_t const *da, *named, *root;
+
+	root = fr_dict_root(dict_dhcpv4);
+
+	/*
+	 *	Now that we've parsed everything, look up the name.
+	 *	We forbid conflicts, but silently allow duplicates.
+	 */
+	named = fr_dict_attr_by_name(NULL, root, name);
+	if (named &&
+	    ((named->attr != attr) || (named->type != type))) {
+		fr_strerror_printf("cannot add different code / type for a pre-existing name '%s'", name);
+		return -1;
+	}
+
+	/*
+	 *	And look it up by code, too.
+	 *
+	 *	We allow multiple attributes of the same code / type,
+	 *	but with different names.
+	 */
+	da = fr_dict_attr_child_by_num(root, attr);
+	if (da && (da->type != type)) {
+		fr_strerror_printf("cannot add different type for a pre-existing code %u", attr);
+		return -1;
+	}
+
+	/*
+	 *	The dictionary is shared with the worker threads, so
+	 *	once we're running, we can only re-read definitions
+	 *	which we already have.
+	 */
+	if (!named) {
+		if (db->reload) {
+			fr_strerror_printf("cannot define new option '%s' when reloading - restart the server instead",
+					   name);
+			return -1;
+		}
+
+		/*
+		 *	Add it in.  Note that this function adds it by name
+		 *	and by code.  So we don't *necessarily* have to do the
+		 *	name/code checks above.  But doing so allows us to
+		 *	have better error messages.
+		 */
+		if (fr_dict_attr_add(fr_dict_unconst(dict_dhcpv4), root, name, attr, type, flags) < 0) return -1;
+	}
+
+	num = talloc_array_length(db->defines);
+	MEM(db->defines = talloc_realloc(db, db->defines, rlm_isc_dhcp_define_t, num + 1));
+	db->defines[num] = (rlm_isc_dhcp_define_t) {
+		.name = talloc_typed_strdup(db->defines, name),
+		.attr = attr,
+		.type = type,
+		.array = flags->array
+	};
+
+	return 0;
+}
+
 /** option new-name code new-code = definition ;
  *
  *	"new-name" can also be SPACE.NAME
@@ -855,7 +1002,6 @@ static int parse_option_definition(rlm_isc_dhcp_info_t *parent, rlm_isc_dhcp_tok
 	int ret;
 	char *p;
 	fr_type_t type;
-	fr_dict_attr_t const *da, *root;
 	fr_value_box_t box;
 	fr_dict_attr_flags_t flags;
 
@@ -867,7 +1013,7 @@ static int parse_option_definition(rlm_isc_dhcp_info_t *parent, rlm_isc_dhcp_tok
 		return -1;
 	}
 
-	if (parent != state->inst->head) {
+	if (parent != state->db->head) {
 		fr_strerror_const("option definitions cannot be scoped");
 		goto error;
 	}
@@ -953,37 +1099,7 @@ static int parse_option_definition(rlm_isc_dhcp_info_t *parent, rlm_isc_dhcp_tok
 	type = isc2fr_type(state);
 	if (fr_type_is_null(type)) goto error;
 
-	/*
-	 *	Now that we've parsed everything, look up the name.
-	 *	We forbid conflicts, but silently allow duplicates.
-	 */
-	da = fr_dict_attr_by_name(NULL, fr_dict_root(dict_dhcpv4), name);
-	if (da &&
-	    ((da->attr != box.vb_uint32) || (da->type != type))) {
-		fr_strerror_printf("cannot add different code / type for a pre-existing name '%s'", name);
-		goto error;
-	}
-
-	/*
-	 *	And look it up by code, too.
-	 *
-	 *	We allow multiple attributes of the same code / type,
-	 *	but with different names.
-	 */
-	root = fr_dict_root(dict_dhcpv4);
-	da = fr_dict_attr_child_by_num(root, box.vb_uint32);
-	if (da && (da->type != type)) {
-		fr_strerror_printf("cannot add different type for a pre-existing code %d", box.vb_uint32);
-		goto error;
-	}
-
-	/*
-	 *	Add it in.  Note that this function adds it by name
-	 *	and by code.  So we don't *necessarily* have to do the
-	 *	name/code checks above.  But doing so allows us to
-	 *	have better error messages.
-	 */
-	ret = fr_dict_attr_add(fr_dict_unconst(dict_dhcpv4), root, name, box.vb_uint32, type, &flags);
+	ret = define_add(state->db, name, box.vb_uint32, type, &flags);
 	talloc_free(name);
 	if (ret < 0) return ret;
 
@@ -1366,12 +1482,12 @@ static int match_keyword(rlm_isc_dhcp_info_t *parent, rlm_isc_dhcp_tokenizer_t *
 	return 1;
 }
 
-/** host NAME { ... }
+/** Add a host to the global hashes, and to its parents hashes
  *
  *	Hosts are global, and are keyed by MAC `hardware ethernet`, and by
  *	`client-identifier`.
  */
-static int parse_host(rlm_isc_dhcp_tokenizer_t *state, rlm_isc_dhcp_info_t *info)
+static int host_index(rlm_isc_dhcp_db_t *db, rlm_isc_dhcp_info_t *info)
 {
 	isc_host_ether_t *my_ether, *old_ether;
 	isc_host_uid_t *my_uid, *old_uid;
@@ -1412,7 +1528,7 @@ static int parse_host(rlm_isc_dhcp_tokenizer_t *state, rlm_isc_dhcp_info_t *info
 	/*
 	 *	We can't have duplicate ethernet addresses for hosts.
 	 */
-	old_ether = fr_hash_table_find(state->inst->hosts_by_ether, my_ether);
+	old_ether = fr_hash_table_find(db->hosts_by_ether, my_ether);
 	if (old_ether) {
 		fr_strerror_printf("'host %s' and 'host %s' contain duplicate 'hardware ethernet' fields",
 				   info->argv[0]->vb_strvalue, old_ether->host->argv[0]->vb_strvalue);
@@ -1429,7 +1545,7 @@ static int parse_host(rlm_isc_dhcp_tokenizer_t *state, rlm_isc_dhcp_info_t *info
 		my_uid->client = &vp->data;
 		my_uid->host = info;
 
-		old_uid = fr_hash_table_find(state->inst->hosts_by_uid, my_uid);
+		old_uid = fr_hash_table_find(db->hosts_by_uid, my_uid);
 		if (old_uid) {
 			fr_strerror_printf("'host %s' and 'host %s' contain duplicate 'option client-identifier' fields",
 					   info->argv[0]->vb_strvalue, old_uid->host->argv[0]->vb_strvalue);
@@ -1442,7 +1558,7 @@ static int parse_host(rlm_isc_dhcp_tokenizer_t *state, rlm_isc_dhcp_info_t *info
 	/*
 	 *	Insert into the ether hashes.
 	 */
-	if (!fr_hash_table_insert(state->inst->hosts_by_ether, my_ether)) {
+	if (!fr_hash_table_insert(db->hosts_by_ether, my_ether)) {
 		fr_strerror_printf("Failed inserting 'host %s' into hash table",
 				   info->argv[0]->vb_strvalue);
 		talloc_free(my_ether);
@@ -1451,7 +1567,7 @@ static int parse_host(rlm_isc_dhcp_tokenizer_t *state, rlm_isc_dhcp_info_t *info
 	}
 
 	if (my_uid) {
-		if (!fr_hash_table_insert(state->inst->hosts_by_uid, my_uid)) {
+		if (!fr_hash_table_insert(db->hosts_by_uid, my_uid)) {
 			fr_strerror_printf("Failed inserting 'host %s' into hash table",
 					   info->argv[0]->vb_strvalue);
 			talloc_free(my_uid);
@@ -1464,7 +1580,7 @@ static int parse_host(rlm_isc_dhcp_tokenizer_t *state, rlm_isc_dhcp_info_t *info
 	 *
 	 *	It typically should tho...
 	 */
-	if (!info->parent) return 2;
+	if (!info->parent) return 0;
 
 	parent = info->parent;
 
@@ -1506,6 +1622,16 @@ static int parse_host(rlm_isc_dhcp_tokenizer_t *state, rlm_isc_dhcp_info_t *info
 		}
 	}
 
+	return 0;
+}
+
+/** host NAME { ... }
+ *
+ */
+static int parse_host(rlm_isc_dhcp_tokenizer_t *state, rlm_isc_dhcp_info_t *info)
+{
+	if (host_index(state->db, info) < 0) return -1;
+
 	IDEBUG("%.*s host %s { ... }", state->braces, spaces, info->argv[0]->vb_strvalue);
 
 	/*
@@ -1520,10 +1646,10 @@ static int parse_host(rlm_isc_dhcp_tokenizer_t *state, rlm_isc_dhcp_info_t *info
  */
 #define vb_ipv4addr vb_ip.addr.v4.s_addr
 
-/** subnet IPADDR netmask MASK { ... }
+/** Add a subnet to its parents trie
  *
  */
-static int parse_subnet(rlm_isc_dhcp_tokenizer_t *state, rlm_isc_dhcp_info_t *info)
+static int subnet_index(rlm_isc_dhcp_info_t *info)
 {
 	rlm_isc_dhcp_info_t *parent;
 	int ret, bits;
@@ -1594,6 +1720,16 @@ static int parse_subnet(rlm_isc_dhcp_tokenizer_t *state, rlm_isc_dhcp_info_t *in
 	 *	he's doing, and don't add one.
 	 */
 
+	return 0;
+}
+
+/** subnet IPADDR netmask MASK { ... }
+ *
+ */
+static int parse_subnet(rlm_isc_dhcp_tokenizer_t *state, rlm_isc_dhcp_info_t *info)
+{
+	if (subnet_index(info) < 0) return -1;
+
 	IDEBUG("%.*s subnet %pV netmask %pV { ... }", state->braces, spaces, info->argv[0], info->argv[1]);
 
 	/*
@@ -1739,7 +1875,7 @@ static int parse_next_server(UNUSED rlm_isc_dhcp_tokenizer_t *state, rlm_isc_dhc
 /** Apply fixed IPs
  *
  */
-static int apply_fixed_ip(rlm_isc_dhcp_t const *inst, request_t *request)
+static int apply_fixed_ip(rlm_isc_dhcp_db_t const *db, request_t *request)
 {
 	int ret;
 	rlm_isc_dhcp_info_t *host, *info;
@@ -1752,7 +1888,7 @@ static int apply_fixed_ip(rlm_isc_dhcp_t const *inst, request_t *request)
 	yiaddr = fr_pair_find_by_da(&request->reply_pairs, NULL, attr_your_ip_address);
 	if (yiaddr) return 0;
 
-	host = get_host(request, inst->hosts_by_ether, inst->hosts_by_uid);
+	host = get_host(request, db->hosts_by_ether, db->hosts_by_uid);
 	if (!host) return 0;
 
 	/*
@@ -2097,13 +2233,87 @@ static int parse_section(rlm_isc_dhcp_tokenizer_t *state, rlm_isc_dhcp_info_t *i
 	return entries;
 }
 
+/** The modification time of a file, in nanoseconds
+ *
+ *	Files may be changed more than once a second, so seconds aren't
+ *	enough to tell when they have changed.
+ */
+static int64_t stat_mtime(struct stat const *st)
+{
+#ifdef __APPLE__
+	return fr_time_delta_unwrap(fr_time_delta_from_timespec(&st->st_mtimespec));
+#else
+	return fr_time_delta_unwrap(fr_time_delta_from_timespec(&st->st_mtim));
+#endif
+}
+
+/** Remember a file we read, so that we can tell when it changes
+ *
+ */
+static void source_add(rlm_isc_dhcp_db_t *db, char const *filename, int64_t mtime, uint64_t size, uint64_t inode)
+{
+	size_t num = talloc_array_length(db->sources);
+
+	MEM(db->sources = talloc_realloc(db, db->sources, rlm_isc_dhcp_source_t, num + 1));
+	db->sources[num] = (rlm_isc_dhcp_source_t) {
+		.filename = talloc_typed_strdup(db->sources, filename),
+		.mtime = mtime,
+		.size = size,
+		.inode = inode
+	};
+}
+
+/** See if any of the files we read have changed since we read them
+ *
+ */
+static bool sources_changed(rlm_isc_dhcp_db_t const *db)
+{
+	size_t i;
+	struct stat st;
+
+	for (i = 0; i < talloc_array_length(db->sources); i++) {
+		rlm_isc_dhcp_source_t const *source = &db->sources[i];
+
+		if (stat(source->filename, &st) < 0) return true;
+
+		if ((stat_mtime(&st) != source->mtime) ||
+		    ((uint64_t) st.st_size != source->size) ||
+		    ((uint64_t) st.st_ino != source->inode)) return true;
+	}
+
+	return false;
+}
+
+/** Update the times of the files we read
+ *
+ *	So that a broken configuration is only complained about once,
+ *	and not every time we check it.
+ */
+static void sources_update(rlm_isc_dhcp_db_t *db)
+{
+	size_t i;
+	struct stat st;
+
+	for (i = 0; i < talloc_array_length(db->sources); i++) {
+		rlm_isc_dhcp_source_t *source = &db->sources[i];
+
+		if (stat(source->filename, &st) < 0) continue;
+
+		source->mtime = stat_mtime(&st);
+		source->size = st.st_size;
+		source->inode = st.st_ino;
+	}
+}
+
 /** Open a file and read it into a parent.
  *
  */
-static int read_file(rlm_isc_dhcp_t *inst, rlm_isc_dhcp_info_t *parent, char const *filename)
+static int read_file(rlm_isc_dhcp_t const *inst, rlm_isc_dhcp_db_t *db,
+		     rlm_isc_dhcp_info_t *parent, char const *filename)
 {
 	int ret;
 	FILE *fp;
+	struct stat st;
 	rlm_isc_dhcp_tokenizer_t state;
 	rlm_isc_dhcp_info_t **last = parent->last;
 	char buffer[8192];
@@ -2120,8 +2330,16 @@ static int read_file(rlm_isc_dhcp_t *inst, rlm_isc_dhcp_info_t *parent, char con
 		return -1;
 	}
 
+	if (fstat(fileno(fp), &st) < 0) {
+		fr_strerror_printf("Error reading filename %s: %s", filename, fr_syserror(errno));
+		fclose(fp);
+		return -1;
+	}
+	source_add(db, filename, stat_mtime(&st), st.st_size, st.st_ino);
+
 	memset(&state, 0, sizeof(state));
 	state.inst = inst;
+	state.db = db;
 	state.fp = fp;
 	state.filename = filename;
 	state.buffer = buffer;
@@ -2172,33 +2390,820 @@ static int read_file(rlm_isc_dhcp_t *inst, rlm_isc_dhcp_info_t *parent, char con
 	return 1;
 }
 
-static int mod_instantiate(module_inst_ctx_t const *mctx)
+/*
+ *	The index is a pre-parsed copy of the configuration files, so
+ *	that large configurations don't need to be tokenized on every
+ *	start.  It has a header, then the files it was built from, the
+ *	option definitions, and then the tree of commands.  All numbers
+ *	are in network byte order.  Times are in nanoseconds.
+ *
+ *	header:		"FRid" version(1) reserved(3) commands(4) checksum(4)
+ *	sources:	count(4) { name-len(2) name mtime(8) size(8) inode(8) } ...
+ *	defines:	count(4) { name-len(2) name attr(4) type(1) array(1) } ...
+ *	node:		cmd(2) argc(1) { type(1) len(2) value } ...
+ *			options(2) { attr(4) type(1) len(2) value } ...
+ *			children(4) { node } ...
+ *
+ *	"commands" is a hash of the command table, as nodes refer to
+ *	commands by their index in it.  The checksum covers everything
+ *	after the header.  The top node has cmd 0xffff, and no
+ *	arguments.
+ */
+#define ISC_INDEX_MAGIC		"FRid"
+#define ISC_INDEX_VERSION	(2)
+#define ISC_INDEX_HDR_LEN	(16)
+#define ISC_INDEX_ROOT		(0xffff)
+
+static uint32_t index_commands_hash(void)
 {
-	rlm_isc_dhcp_t		*inst = talloc_get_type_abort(mctx->mi->data, rlm_isc_dhcp_t);
-	CONF_SECTION		*conf = mctx->mi->conf;
+	size_t i;
+	uint32_t hash = 0;
+
+	for (i = 0; i < NUM_ELEMENTS(commands); i++) {
+		hash = fr_hash_update(commands[i].name, strlen(commands[i].name) + 1, hash);
+	}
+
+	return hash;
+}
+
+typedef int (*info_child_t)(rlm_isc_dhcp_info_t *child, void *uctx);
+
+typedef struct {
+	info_child_t		func;
+	void			*uctx;
+} info_walk_t;
+
+static int _info_subnet_walk(UNUSED uint8_t const *key, UNUSED size_t keylen, void *data, void *uctx)
+{
+	info_walk_t *walk = uctx;
+
+	return walk->func(data, walk->uctx);
+}
+
+/** Call a function for every child of a section, including the hosts and subnets
+ *
+ */
+static int info_children(rlm_isc_dhcp_info_t *info, info_child_t func, void *uctx)
+{
+	rlm_isc_dhcp_info_t *child;
+
+	for (child = info->child; child != NULL; child = child->next) {
+		if (func(child, uctx) < 0) return -1;
+	}
+
+	if (info->hosts_by_ether) {
+		fr_hash_iter_t iter;
+		isc_host_ether_t *ether;
+
+		for (ether = fr_hash_table_iter_init(info->hosts_by_ether, &iter);
+		     ether != NULL;
+		     ether = fr_hash_table_iter_next(info->hosts_by_ether, &iter)) {
+			if (func(ether->host, uctx) < 0) return -1;
+		}
+	}
+
+	if (info->subnets) {
+		info_walk_t walk = { .func = func, .uctx = uctx };
+
+		if (fr_trie_walk(info->subnets, &walk, _info_subnet_walk) < 0) return -1;
+	}
+
+	return 0;
+}
+
+static int _info_count(UNUSED rlm_isc_dhcp_info_t *child, void *uctx)
+{
+	uint32_t *count = uctx;
+
+	(*count)++;
+	return 0;
+}
+
+/** Fill in all of the hash buckets
+ *
+ *	Hash tables fill in buckets lazily on lookup, which isn't safe
+ *	when multiple threads share them.
+ */
+static int _info_fill(rlm_isc_dhcp_info_t *info, UNUSED void *uctx)
+{
+	if (info->hosts_by_ether) fr_hash_table_fill(info->hosts_by_ether);
+	if (info->hosts_by_uid) fr_hash_table_fill(info->hosts_by_uid);
+
+	return info_children(info, _info_fill, NULL);
+}
+
+static ssize_t index_value_write(fr_dbuff_t *dbuff, fr_value_box_t const *box)
+{
+	size_t len = fr_value_box_network_length(box);
+	ssize_t slen;
+
+	if (len > UINT16_MAX) {
+		fr_strerror_printf("value of type %s is too long", fr_type_to_str(box->type));
+		return -1;
+	}
+
+	FR_DBUFF_IN_RETURN(dbuff, (uint8_t) box->type);
+	FR_DBUFF_IN_RETURN(dbuff, (uint16_t) len);
+
+	slen = fr_value_box_to_network(dbuff, box);
+	if (slen < 0) return slen;
+
+	if ((size_t) slen != len) {
+		fr_strerror_printf("cannot save value of type %s", fr_type_to_str(box->type));
+		return -1;
+	}
+
+	return 0;
+}
+
+static int _index_node_write(rlm_isc_dhcp_info_t *info, void *uctx)
+{
+	fr_dbuff_t		*dbuff = uctx;
+	fr_dict_attr_t const	*root = fr_dict_root(dict_dhcpv4);
+	uint32_t		num;
+	int			i;
+
+	FR_DBUFF_IN_RETURN(dbuff, (uint16_t) (info->cmd ? (info->cmd - commands) : ISC_INDEX_ROOT));
+
+	FR_DBUFF_IN_RETURN(dbuff, (uint8_t) info->argc);
+	for (i = 0; i < info->argc; i++) {
+		if (index_value_write(dbuff, info->argv[i]) < 0) return -1;
+	}
+
+	num = fr_pair_list_num_elements(&info->options);
+	if (num > UINT16_MAX) {
+		fr_strerror_const("too many options");
+		return -1;
+	}
+
+	FR_DBUFF_IN_RETURN(dbuff, (uint16_t) num);
+	fr_pair_list_foreach(&info->options, vp) {
+		if (vp->da->parent != root) {
+			fr_strerror_printf("cannot save option %s", vp->da->name);
+			return -1;
+		}
+
+		FR_DBUFF_IN_RETURN(dbuff, (uint32_t) vp->da->attr);
+		if (index_value_write(dbuff, &vp->data) < 0) return -1;
+	}
+
+	num = 0;
+	(void) info_children(info, _info_count, &num);
+	FR_DBUFF_IN_RETURN(dbuff, num);
+
+	return info_children(info, _index_node_write, dbuff);
+}
+
+/** Write the index, replacing any existing one
+ *
+ */
+static int index_write(rlm_isc_dhcp_t const *inst, rlm_isc_dhcp_db_t *db)
+{
+	fr_dbuff_t		dbuff;
+	fr_dbuff_uctx_talloc_t	tctx;
+	uint8_t			*buff;
+	size_t			len, i;
+	char			*tmp = NULL;
+	int			fd = -1, ret = -1;
+
+	if (!fr_dbuff_init_talloc(NULL, &dbuff, &tctx, 65536, SIZE_MAX)) return -1;
+
+	if ((fr_dbuff_in_memcpy(&dbuff, (uint8_t const *) ISC_INDEX_MAGIC, 4) < 0) ||
+	    (fr_dbuff_in_bytes(&dbuff, ISC_INDEX_VERSION, 0x00, 0x00, 0x00) < 0) ||
+	    (fr_dbuff_in(&dbuff, index_commands_hash()) < 0) ||
+	    (fr_dbuff_in(&dbuff, (uint32_t) 0) < 0)) goto error;
+
+	if (fr_dbuff_in(&dbuff, (uint32_t) talloc_array_length(db->sources)) < 0) goto error;
+	for (i = 0; i < talloc_array_length(db->sources); i++) {
+		rlm_isc_dhcp_source_t const *source = &db->sources[i];
+
+		len = strlen(source->filename);
+		if ((len > UINT16_MAX) ||
+		    (fr_dbuff_in(&dbuff, (uint16_t) len) < 0) ||
+		    (fr_dbuff_in_memcpy(&dbuff, (uint8_t const *) source->filename, len) < 0) ||
+		    (fr_dbuff_in(&dbuff, (uint64_t) source->mtime) < 0) ||
+		    (fr_dbuff_in(&dbuff, source->size) < 0) ||
+		    (fr_dbuff_in(&dbuff, source->inode) < 0)) goto error;
+	}
+
+	if (fr_dbuff_in(&dbuff, (uint32_t) talloc_array_length(db->defines)) < 0) goto error;
+	for (i = 0; i < talloc_array_length(db->defines); i++) {
+		rlm_isc_dhcp_define_t const *define = &db->defines[i];
+
+		len = strlen(define->name);
+		if ((len > UINT16_MAX) ||
+		    (fr_dbuff_in(&dbuff, (uint16_t) len) < 0) ||
+		    (fr_dbuff_in_memcpy(&dbuff, (uint8_t const *) define->name, len) < 0) ||
+		    (fr_dbuff_in(&dbuff, (uint32_t) define->attr) < 0) ||
+		    (fr_dbuff_in_bytes(&dbuff, (uint8_t) define->type, (uint8_t) define->array) < 0)) goto error;
+	}
+
+	if (_index_node_write(db->head, &dbuff) < 0) goto error;
+
+	buff = fr_dbuff_start(&dbuff);
+	len = fr_dbuff_used(&dbuff);
+	fr_nbo_from_uint32(buff + 12, fr_hash(buff + ISC_INDEX_HDR_LEN, len - ISC_INDEX_HDR_LEN));
+
+	/*
+	 *	Write to a temporary file, and rename it over the old
+	 *	index.  So a server which is starting never sees half
+	 *	an index.
+	 */
+	MEM(tmp = talloc_asprintf(NULL, "%s.XXXXXX", inst->index));
+	fd = mkstemp(tmp);
+	if (fd < 0) {
+		fr_strerror_printf("Failed creating %s: %s", tmp, fr_syserror(errno));
+		goto error;
+	}
+
+	while (len > 0) {
+		ssize_t slen;
+
+		slen = write(fd, buff, len);
+		if (slen < 0) {
+			if (errno == EINTR) continue;
+
+			fr_strerror_printf("Failed writing %s: %s", tmp, fr_syserror(errno));
+			goto error;
+		}
+
+		buff += slen;
+		len -= slen;
+	}
+
+	if (close(fd) < 0) {
+		fd = -1;
+		fr_strerror_printf("Failed writing %s: %s", tmp, fr_syserror(errno));
+		goto error;
+	}
+	fd = -1;
+
+	if (rename(tmp, inst->index) < 0) {
+		fr_strerror_printf("Failed renaming %s to %s: %s", tmp, inst->index, fr_syserror(errno));
+		goto error;
+	}
+
+	ret = 0;
+
+error:
+	if (fd >= 0) close(fd);
+	if ((ret < 0) && tmp) unlink(tmp);
+	talloc_free(tmp);
+	talloc_free(fr_dbuff_buff(&dbuff));
+
+	return ret;
+}
+
+static ssize_t index_value_read(TALLOC_CTX *ctx, fr_value_box_t *box, fr_dict_attr_t const *da, fr_dbuff_t *in)
+{
+	uint8_t		type;
+	uint16_t	len;
+	ssize_t		slen;
+
+	FR_DBUFF_OUT_RETURN(&type, in);
+	FR_DBUFF_OUT_RETURN(&len, in);
+
+	if ((type > FR_TYPE_MAX) || !fr_type_is_leaf(type)) {
+		fr_strerror_printf("invalid data type %u", type);
+		return -1;
+	}
+
+	if (da && (da->type != type)) {
+		fr_strerror_printf("option %s has changed type", da->name);
+		return -1;
+	}
+
+	slen = fr_value_box_from_network(ctx, box, type, da, in, len, false);
+	if (slen < 0) return slen;
+
+	if (slen != len) {
+		fr_strerror_printf("invalid value of type %s", fr_type_to_str(type));
+		return -1;
+	}
+
+	return 0;
+}
+
+static ssize_t index_node_read(rlm_isc_dhcp_db_t *db, rlm_isc_dhcp_info_t *parent, fr_dbuff_t *in);
+
+/** Read the options and children of a node
+ *
+ */
+static ssize_t index_body_read(rlm_isc_dhcp_db_t *db, rlm_isc_dhcp_info_t *info, fr_dbuff_t *in)
+{
+	fr_dict_attr_t const	*root = fr_dict_root(dict_dhcpv4);
+	uint16_t		num_options;
+	uint32_t		num_children, i;
+
+	FR_DBUFF_OUT_RETURN(&num_options, in);
+	for (i = 0; i < num_options; i++) {
+		uint32_t		attr;
+		fr_dict_attr_t const	*da;
+		fr_pair_t		*vp;
+
+		FR_DBUFF_OUT_RETURN(&attr, in);
+
+		da = fr_dict_attr_child_by_num(root, attr);
+		if (!da) {
+			fr_strerror_printf("unknown option %u", attr);
+			return -1;
+		}
+
+		MEM(vp = fr_pair_afrom_da(info, da));
+		if (index_value_read(vp, &vp->data, da, in) < 0) return -1;
+
+		fr_pair_append(&info->options, vp);
+	}
+
+	FR_DBUFF_OUT_RETURN(&num_children, in);
+	for (i = 0; i < num_children; i++) {
+		if (index_node_read(db, info, in) < 0) return -1;
+	}
+
+	return 0;
+}
+
+/** Read one node, and link it into its parent
+ *
+ *	This does the same work as match_keyword(), but without any
+ *	of the tokenizing.
+ */
+static ssize_t index_node_read(rlm_isc_dhcp_db_t *db, rlm_isc_dhcp_info_t *parent, fr_dbuff_t *in)
+{
+	uint16_t		cmd;
+	uint8_t			argc;
+	int			i;
 	rlm_isc_dhcp_info_t	*info;
-	int			ret;
 
-	MEM(inst->head = info = talloc_zero(inst, rlm_isc_dhcp_info_t));
+	FR_DBUFF_OUT_RETURN(&cmd, in);
+	if (cmd >= NUM_ELEMENTS(commands)) {
+		fr_strerror_printf("invalid command %u", cmd);
+		return -1;
+	}
+
+	MEM(info = talloc_zero(parent, rlm_isc_dhcp_info_t));
 	fr_pair_list_init(&info->options);
+	info->parent = parent;
+	info->cmd = &commands[cmd];
 	info->last = &(info->child);
 
-	inst->hosts_by_ether = fr_hash_table_alloc(inst, host_ether_hash, host_ether_cmp, NULL);
-	if (!inst->hosts_by_ether) return -1;
+	FR_DBUFF_OUT_RETURN(&argc, in);
+	if (argc > info->cmd->max_argc) {
+		fr_strerror_printf("too many arguments for command '%s'", info->cmd->name);
+		return -1;
+	}
 
-	inst->hosts_by_uid = fr_hash_table_alloc(inst, host_uid_hash, host_uid_cmp, NULL);
-	if (!inst->hosts_by_uid) return -1;
+	if (info->cmd->max_argc) {
+		MEM(info->argv = talloc_zero_array(info, fr_value_box_t *, info->cmd->max_argc));
+	}
 
-	ret = read_file(inst, info, inst->filename);
-	if (ret < 0) {
+	for (i = 0; i < argc; i++) {
+		MEM(info->argv[i] = talloc_zero(info, fr_value_box_t));
+		if (index_value_read(info, info->argv[i], NULL, in) < 0) return -1;
+		info->argc++;
+	}
+
+	if (index_body_read(db, info, in) < 0) return -1;
+
+	switch (info->cmd->type) {
+	case ISC_HOST:
+		if (info->argc < 1) goto missing;
+		return host_index(db, info);
+
+	case ISC_SUBNET:
+		if (info->argc < 2) {
+		missing:
+			fr_strerror_printf("missing arguments for command '%s'", info->cmd->name);
+			return -1;
+		}
+		return subnet_index(info);
+
+	default:
+		break;
+	}
+
+	*(parent->last) = info;
+	parent->last = &(info->next);
+
+	return 0;
+}
+
+/** Read the configuration from the index
+ *
+ * @param[in] inst	of the module.
+ * @param[in] db	to read the configuration into.
+ * @return
+ *	- 1 if the index was read.
+ *	- 0 if the index is missing or out of date.  fr_strerror() says why.
+ *	- -1 if the file isn't an index.
+ */
+static int index_read(rlm_isc_dhcp_t const *inst, rlm_isc_dhcp_db_t *db)
+{
+	int		fd, ret = 0;
+	struct stat	st;
+	uint8_t const	*p;
+	fr_dbuff_t	in;
+	uint32_t	commands_hash, checksum, num, i;
+
+	fd = open(inst->index, O_RDONLY);
+	if (fd < 0) {
+		fr_strerror_printf("Failed opening %s: %s", inst->index, fr_syserror(errno));
+		return 0;
+	}
+
+	if (fstat(fd, &st) < 0) {
+		fr_strerror_printf("Failed reading %s: %s", inst->index, fr_syserror(errno));
+		close(fd);
+		return 0;
+	}
+
+	if (st.st_size < ISC_INDEX_HDR_LEN) {
+		fr_strerror_printf("%s is empty", inst->index);
+		close(fd);
+		return 0;
+	}
+
+	p = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (p == MAP_FAILED) {
+		fr_strerror_printf("Failed mapping %s: %s", inst->index, fr_syserror(errno));
+		return 0;
+	}
+
+	/*
+	 *	Don't overwrite things which aren't ours.
+	 */
+	if (memcmp(p, ISC_INDEX_MAGIC, 4) != 0) {
+		fr_strerror_printf("%s exists, and is not an index", inst->index);
+		ret = -1;
+		goto done;
+	}
+
+	if (p[4] != ISC_INDEX_VERSION) {
+		fr_strerror_printf("%s has an unknown version", inst->index);
+		goto done;
+	}
+
+	commands_hash = fr_nbo_to_uint32(p + 8);
+	checksum = fr_nbo_to_uint32(p + 12);
+
+	if (commands_hash != index_commands_hash()) {
+		fr_strerror_printf("%s was written by a different version of the module", inst->index);
+		goto done;
+	}
+
+	if (fr_hash(p + ISC_INDEX_HDR_LEN, st.st_size - ISC_INDEX_HDR_LEN) != checksum) {
+		fr_strerror_printf("%s is corrupt", inst->index);
+		goto done;
+	}
+
+	fr_dbuff_init(&in, p + ISC_INDEX_HDR_LEN, st.st_size - ISC_INDEX_HDR_LEN);
+
+	/*
+	 *	Check that the files the index was built from haven't
+	 *	changed.
+	 */
+	if (fr_dbuff_out(&num, &in) < 0) goto truncated;
+	for (i = 0; i < num; i++) {
+		uint16_t	len;
+		char		*filename;
+		uint64_t	mtime, size, inode;
+
+		if (fr_dbuff_out(&len, &in) < 0) goto truncated;
+		if (fr_dbuff_remaining(&in) < len) goto truncated;
+
+		MEM(filename = talloc_bstrndup(NULL, (char const *) fr_dbuff_current(&in), len));
+		fr_dbuff_advance(&in, len);
+
+		if ((fr_dbuff_out(&mtime, &in) < 0) ||
+		    (fr_dbuff_out(&size, &in) < 0) ||
+		    (fr_dbuff_out(&inode, &in) < 0)) {
+			talloc_free(filename);
+			goto truncated;
+		}
+
+		source_add(db, filename, (int64_t) mtime, size, inode);
+		talloc_free(filename);
+	}
+
+	if (!num || (strcmp(db->sources[0].filename, inst->filename) != 0)) {
+		fr_strerror_printf("%s was built from a different file", inst->index);
+		goto done;
+	}
+
+	if (sources_changed(db)) {
+		fr_strerror_printf("%s is older than the files it was built from", inst->index);
+		goto done;
+	}
+
+	if (fr_dbuff_out(&num, &in) < 0) goto truncated;
+	for (i = 0; i < num; i++) {
+		uint16_t		len;
+		uint32_t		attr;
+		uint8_t			type, array;
+		char			*name;
+		fr_dict_attr_flags_t	flags = {};
+
+		if (fr_dbuff_out(&len, &in) < 0) goto truncated;
+		if (fr_dbuff_remaining(&in) < len) goto truncated;
+
+		MEM(name = talloc_bstrndup(NULL, (char const *) fr_dbuff_current(&in), len));
+		fr_dbuff_advance(&in, len);
+
+		if ((fr_dbuff_out(&attr, &in) < 0) ||
+		    (fr_dbuff_out(&type, &in) < 0) ||
+		    (fr_dbuff_out(&array, &in) < 0)) {
+			talloc_free(name);
+			goto truncated;
+		}
+
+		flags.array = (array != 0);
+
+		if (define_add(db, name, attr, type, &flags) < 0) {
+			talloc_free(name);
+			goto done;
+		}
+		talloc_free(name);
+	}
+
+	/*
+	 *	And finally the tree.
+	 */
+	{
+		uint16_t	cmd;
+		uint8_t		argc;
+
+		if ((fr_dbuff_out(&cmd, &in) < 0) ||
+		    (fr_dbuff_out(&argc, &in) < 0)) goto truncated;
+
+		if ((cmd != ISC_INDEX_ROOT) || argc) {
+			fr_strerror_printf("%s is corrupt", inst->index);
+			goto done;
+		}
+	}
+
+	if (index_body_read(db, db->head, &in) < 0) goto done;
+
+	if (fr_dbuff_remaining(&in) > 0) {
+		fr_strerror_printf("%s has trailing data", inst->index);
+		goto done;
+	}
+
+	ret = 1;
+
+done:
+	munmap(UNCONST(uint8_t *, p), st.st_size);
+	return ret;
+
+truncated:
+	fr_strerror_printf("%s is truncated", inst->index);
+	goto done;
+}
+
+/** Allocate an empty configuration
+ *
+ */
+static rlm_isc_dhcp_db_t *db_alloc(TALLOC_CTX *ctx, bool reload)
+{
+	rlm_isc_dhcp_db_t	*db;
+	rlm_isc_dhcp_info_t	*info;
+
+	MEM(db = talloc_zero(ctx, rlm_isc_dhcp_db_t));
+	db->reload = reload;
+
+	MEM(db->head = info = talloc_zero(db, rlm_isc_dhcp_info_t));
+	fr_pair_list_init(&info->options);
+	info->last = &(info->child);
+
+	db->hosts_by_ether = fr_hash_table_alloc(db, host_ether_hash, host_ether_cmp, NULL);
+	if (!db->hosts_by_ether) goto error;
+
+	db->hosts_by_uid = fr_hash_table_alloc(db, host_uid_hash, host_uid_cmp, NULL);
+	if (!db->hosts_by_uid) {
+	error:
+		talloc_free(db);
+		return NULL;
+	}
+
+	return db;
+}
+
+/** Read the configuration, from the index if it's up to date, otherwise from the files
+ *
+ * @param[in] inst	of the module.
+ * @param[in] ctx	to allocate the configuration in.
+ * @param[in] reload	whether we're running, and the dictionary can't be changed.
+ * @return
+ *	- The new configuration.
+ *	- NULL on error.
+ */
+static rlm_isc_dhcp_db_t *db_load(rlm_isc_dhcp_t const *inst, TALLOC_CTX *ctx, bool reload)
+{
+	int			ret;
+	fr_time_t		start = fr_time();
+	char const		*from = inst->filename;
+	rlm_isc_dhcp_db_t	*db;
+
+	db = db_alloc(ctx, reload);
+	if (!db) return NULL;
+
+	if (inst->index) {
+		ret = index_read(inst, db);
+		if (ret < 0) goto error;
+
+		if (ret > 0) {
+			from = inst->index;
+			goto done;
+		}
+
+		DEBUG("Not using index - %s", fr_strerror());
+
+		/*
+		 *	Throw away anything we read from the stale index.
+		 */
+		talloc_free(db);
+		db = db_alloc(ctx, reload);
+		if (!db) return NULL;
+	}
+
+	ret = read_file(inst, db, db->head, inst->filename);
+	if (ret < 0) goto error;
+
+	if (ret == 0) WARN("No configuration read from %s", inst->filename);
+
+	if (inst->index && (index_write(inst, db) < 0)) {
+		WARN("Failed writing index %s - %s", inst->index, fr_strerror());
+	}
+
+done:
+	fr_hash_table_fill(db->hosts_by_ether);
+	fr_hash_table_fill(db->hosts_by_uid);
+	(void) _info_fill(db->head, NULL);
+
+	INFO("Loaded %u hosts from %s in %pV seconds",
+	     fr_hash_table_num_elements(db->hosts_by_ether), from,
+	     fr_box_time_delta(fr_time_sub(fr_time(), start)));
+
+	return db;
+
+error:
+	talloc_free(db);
+	return NULL;
+}
+
+/** Get the current configuration, and mark it as being used
+ *
+ *	The caller MUST call db_release() with the returned phase once
+ *	it's done with the configuration.
+ */
+static rlm_isc_dhcp_db_t *db_acquire(rlm_isc_dhcp_mutable_t *mutable, unsigned int *phase)
+{
+	*phase = atomic_load_explicit(&mutable->phase, memory_order_seq_cst) & 0x01;
+	atomic_fetch_add_explicit(&mutable->readers[*phase], 1, memory_order_seq_cst);
+
+	return atomic_load_explicit(&mutable->db, memory_order_seq_cst);
+}
+
+static void db_release(rlm_isc_dhcp_mutable_t *mutable, unsigned int phase)
+{
+	atomic_fetch_sub_explicit(&mutable->readers[phase], 1, memory_order_release);
+}
+
+/** Wait until no worker can still be using a configuration which has been swapped out
+ *
+ *	A worker which read the phase before a flip may not have counted
+ *	itself yet.  If it counts itself after we see the counter at
+ *	zero, it will read the new configuration.  But it's then counted
+ *	under the old phase, and the next flip will wait for it.  Two
+ *	flips therefore catch everyone who started before the swap.
+ */
+static void db_synchronize(rlm_isc_dhcp_mutable_t *mutable)
+{
+	int i;
+
+	for (i = 0; i < 2; i++) {
+		unsigned int phase = atomic_fetch_add_explicit(&mutable->phase, 1, memory_order_seq_cst) & 0x01;
+
+		/*
+		 *	Module calls don't yield while they use the
+		 *	configuration, so this doesn't take long.
+		 */
+		while (atomic_load_explicit(&mutable->readers[phase], memory_order_seq_cst) > 0) {
+			struct timespec ts = { .tv_sec = 0, .tv_nsec = 1000000 };
+
+			nanosleep(&ts, NULL);
+		}
+	}
+}
+
+/** Check for changes to the configuration files, and reload them
+ *
+ *	The new configuration is built off to the side, and swapped in
+ *	with one atomic store.  So lookups in the workers never take a
+ *	lock, and never see a half-built configuration.
+ *
+ *	The old configuration is freed once every worker which could
+ *	have been using it has finished.  See db_synchronize().
+ */
+static void *db_reload_thread(void *arg)
+{
+	rlm_isc_dhcp_t const	*inst = talloc_get_type_abort_const(arg, rlm_isc_dhcp_t);
+	rlm_isc_dhcp_mutable_t	*mutable = inst->mutable;
+	sigset_t		sigmask;
+
+	/*
+	 *	Signals are for the main thread.
+	 */
+	sigfillset(&sigmask);
+	pthread_sigmask(SIG_BLOCK, &sigmask, NULL);
+
+	pthread_mutex_lock(&mutable->mutex);
+	while (!mutable->stop) {
+		struct timespec		when = fr_time_to_timespec(fr_time_add(fr_time(), inst->reload_interval));
+		rlm_isc_dhcp_db_t	*db, *old;
+
+		pthread_cond_timedwait(&mutable->cond, &mutable->mutex, &when);
+		if (mutable->stop) break;
+
+		old = atomic_load_explicit(&mutable->db, memory_order_relaxed);
+		if (!sources_changed(old)) continue;
+
+		pthread_mutex_unlock(&mutable->mutex);
+		db = db_load(inst, mutable, true);
+		pthread_mutex_lock(&mutable->mutex);
+
+		if (!db) {
+			PERROR("Failed reloading %s, continuing with the previous configuration", inst->filename);
+			sources_update(old);
+			continue;
+		}
+
+		atomic_store_explicit(&mutable->db, db, memory_order_seq_cst);
+
+		pthread_mutex_unlock(&mutable->mutex);
+		db_synchronize(mutable);
+		talloc_free(old);
+		pthread_mutex_lock(&mutable->mutex);
+	}
+	pthread_mutex_unlock(&mutable->mutex);
+
+	return NULL;
+}
+
+static int mod_detach(module_detach_ctx_t const *mctx)
+{
+	rlm_isc_dhcp_t		*inst = talloc_get_type_abort(mctx->mi->data, rlm_isc_dhcp_t);
+	rlm_isc_dhcp_mutable_t	*mutable = inst->mutable;
+
+	if (!mutable) return 0;
+
+	if (mutable->running) {
+		pthread_mutex_lock(&mutable->mutex);
+		mutable->stop = true;
+		pthread_cond_signal(&mutable->cond);
+		pthread_mutex_unlock(&mutable->mutex);
+
+		pthread_join(mutable->thread, NULL);
+	}
+
+	pthread_cond_destroy(&mutable->cond);
+	pthread_mutex_destroy(&mutable->mutex);
+
+	talloc_free(mutable);
+	return 0;
+}
+
+static int mod_instantiate(module_inst_ctx_t const *mctx)
+{
+	rlm_isc_dhcp_t		*inst = talloc_get_type_abort(mctx->mi->data, rlm_isc_dhcp_t);
+	CONF_SECTION		*conf = mctx->mi->conf;
+	rlm_isc_dhcp_mutable_t	*mutable;
+	rlm_isc_dhcp_db_t	*db;
+
+	/*
+	 *	The instance data is read-only once we're running, and
+	 *	reloads need to change the configuration.
+	 */
+	MEM(inst->mutable = mutable = talloc_zero(NULL, rlm_isc_dhcp_mutable_t));
+	pthread_mutex_init(&mutable->mutex, NULL);
+	pthread_cond_init(&mutable->cond, NULL);
+
+	db = db_load(inst, mutable, false);
+	if (!db) {
 		cf_log_err(conf, "%s", fr_strerror());
 		return -1;
 	}
+	atomic_store_explicit(&mutable->db, db, memory_order_release);
 
-	if (ret == 0) {
-		cf_log_warn(conf, "No configuration read from %s", inst->filename);
-		return 0;
+	if (!fr_time_delta_ispos(inst->reload_interval)) return 0;
+
+	FR_TIME_DELTA_BOUND_CHECK("reload_interval", inst->reload_interval, >=, fr_time_delta_from_sec(1));
+
+	if (fr_schedule_pthread_create(&mutable->thread, db_reload_thread, inst) < 0) {
+		cf_log_perr(conf, "Failed starting reload thread");
+		return -1;
 	}
+	mutable->running = true;
 
 	return 0;
 }
@@ -2206,9 +3211,13 @@ static int mod_instantiate(module_inst_ctx_t const *mctx)
 static unlang_action_t CC_HINT(nonnull) mod_authorize(rlm_rcode_t *p_result, module_ctx_t const *mctx, request_t *request)
 {
 	rlm_isc_dhcp_t const	*inst = talloc_get_type_abort_const(mctx->mi->data, rlm_isc_dhcp_t);
+	rlm_isc_dhcp_db_t	*db;
+	unsigned int		phase;
 	int			ret;
 
-	ret = apply_fixed_ip(inst, request);
+	db = db_acquire(inst->mutable, &phase);
+	ret = apply_fixed_ip(db, request);
+	db_release(inst->mutable, phase);
 	if (ret < 0) RETURN_MODULE_FAIL;
 	if (ret == 0) RETURN_MODULE_NOOP;
 
@@ -2220,9 +3229,13 @@ static unlang_action_t CC_HINT(nonnull) mod_authorize(rlm_rcode_t *p_result, mod
 static unlang_action_t CC_HINT(nonnull) mod_post_auth(rlm_rcode_t *p_result, module_ctx_t const *mctx, request_t *request)
 {
 	rlm_isc_dhcp_t const	*inst = talloc_get_type_abort_const(mctx->mi->data, rlm_isc_dhcp_t);
+	rlm_isc_dhcp_db_t	*db;
+	unsigned int		phase;
 	int			ret;
 
-	ret = apply(inst, request, inst->head);
+	db = db_acquire(inst->mutable, &phase);
+	ret = apply(inst, request, db->head);
+	db_release(inst->mutable, phase);
 	if (ret < 0) RETURN_MODULE_FAIL;
 	if (ret == 0) RETURN_MODULE_NOOP;
 
@@ -2238,7 +3251,8 @@ module_rlm_t rlm_isc_dhcp = {
 		.name		= "isc_dhcp",
 		.inst_size	= sizeof(rlm_isc_dhcp_t),
 		.config		= module_config,
-		.instantiate	= mod_instantiate
+		.instantiate	= mod_instantiate,
+		.detach		= mod_detach
 	},
 	.method_group = {
 		.bindings = (module_method_binding_t[]){
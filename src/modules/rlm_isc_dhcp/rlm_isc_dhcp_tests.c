@@ -0,0 +1,436 @@
+/** Tests for the rlm_isc_dhcp index
+ *
+ * @file src/modules/rlm_isc_dhcp/rlm_isc_dhcp_tests.c
+ *
+ * @copyright 2024 The FreeRADIUS server project
+ */
+static void test_init(void);
+#  define TEST_INIT  test_init()
+
+#include <freeradius-devel/util/acutest.h>
+#include <freeradius-devel/util/acutest_helpers.h>
+
+/*
+ *	Gives access to the parser, and the index reader and writer.
+ */
+#include "rlm_isc_dhcp.c"
+
+#include <dirent.h>
+#include <sys/time.h>
+
+#ifndef ISC_DHCP_BENCH_HOSTS
+#  define ISC_DHCP_BENCH_HOSTS	(20000)
+#endif
+
+static TALLOC_CTX	*autofree;
+static char		test_dir[64];
+
+/** Global initialisation
+ */
+static void test_init(void)
+{
+	autofree = talloc_autofree_context();
+	if (!autofree) {
+	error:
+		fr_perror("rlm_isc_dhcp_tests");
+		fr_exit_now(EXIT_FAILURE);
+	}
+
+	if (!fr_dict_global_ctx_init(autofree, false, "share/dictionary")) goto error;
+	if (fr_dict_autoload(rlm_isc_dhcp_dict) < 0) goto error;
+	if (fr_dict_attr_autoload(rlm_isc_dhcp_dict_attr) < 0) goto error;
+
+	fr_time_start();
+}
+
+/** Create a directory for the files a test writes
+ *
+ */
+static void test_dir_alloc(void)
+{
+	strlcpy(test_dir, "/tmp/isc_dhcp_tests.XXXXXX", sizeof(test_dir));
+	TEST_ASSERT(mkdtemp(test_dir) != NULL);
+}
+
+static void test_dir_free(void)
+{
+	DIR		*dir;
+	struct dirent	*dp;
+	char		path[PATH_MAX];
+
+	dir = opendir(test_dir);
+	TEST_ASSERT(dir != NULL);
+
+	while ((dp = readdir(dir)) != NULL) {
+		if (dp->d_name[0] == '.') continue;
+
+		snprintf(path, sizeof(path), "%s/%s", test_dir, dp->d_name);
+		unlink(path);
+	}
+	closedir(dir);
+
+	TEST_CHECK(rmdir(test_dir) == 0);
+}
+
+static char *test_path(TALLOC_CTX *ctx, char const *name)
+{
+	char *path;
+
+	MEM(path = talloc_asprintf(ctx, "%s/%s", test_dir, name));
+
+	return path;
+}
+
+static void test_file_write(char const *path, char const *data, size_t len)
+{
+	FILE *fp;
+
+	fp = fopen(path, "w");
+	TEST_ASSERT(fp != NULL);
+	TEST_ASSERT(fwrite(data, 1, len, fp) == len);
+	TEST_ASSERT(fclose(fp) == 0);
+}
+
+static uint8_t *test_file_read(TALLOC_CTX *ctx, char const *path)
+{
+	struct stat	st;
+	uint8_t		*data;
+	FILE		*fp;
+
+	TEST_ASSERT(stat(path, &st) == 0);
+	MEM(data = talloc_array(ctx, uint8_t, st.st_size));
+
+	fp = fopen(path, "r");
+	TEST_ASSERT(fp != NULL);
+	TEST_ASSERT(fread(data, 1, st.st_size, fp) == (size_t) st.st_size);
+	fclose(fp);
+
+	return data;
+}
+
+/** Move a file's modification time, as if it had been edited
+ *
+ */
+static void test_file_touch(char const *path)
+{
+	struct stat	st;
+	struct timeval	tv[2];
+
+	TEST_ASSERT(stat(path, &st) == 0);
+
+	tv[0] = (struct timeval) { .tv_sec = st.st_atime };
+	tv[1] = (struct timeval) { .tv_sec = st.st_mtime + 10 };
+	TEST_ASSERT(utimes(path, tv) == 0);
+}
+
+static char const test_conf[] =
+	"option site-number code 224 = string;\n"
+	"option Time-Offset 3600;\n"
+	"\n"
+	"subnet 192.0.2.0 netmask 255.255.255.0 {\n"
+	"	option Router-Address 192.0.2.1;\n"
+	"	option Domain-Name-Server 192.0.2.53, 192.0.2.54;\n"
+	"\n"
+	"	host alpha {\n"
+	"		hardware ethernet 00:01:02:03:04:05;\n"
+	"		fixed-address 192.0.2.10;\n"
+	"		option Client-Identifier 0x01000102030405;\n"
+	"	}\n"
+	"}\n"
+	"\n"
+	"subnet 198.51.100.0 netmask 255.255.255.0 {\n"
+	"	option Router-Address 198.51.100.1;\n"
+	"	option site-number 0x2a;\n"
+	"}\n"
+	"\n"
+	"group {\n"
+	"	next-server 192.0.2.2;\n"
+	"	include \"hosts.conf\";\n"
+	"}\n";
+
+static char const test_hosts[] =
+	"host beta {\n"
+	"	hardware ethernet 00:01:02:03:04:06;\n"
+	"	fixed-address 198.51.100.20;\n"
+	"	filename \"beta.cfg\";\n"
+	"}\n"
+	"\n"
+	"host gamma {\n"
+	"	hardware ethernet 00:01:02:03:04:07;\n"
+	"	fixed-address 203.0.113.30;\n"
+	"	option Time-Offset 7200;\n"
+	"}\n";
+
+/** Set up an instance which reads the test configuration
+ *
+ */
+static rlm_isc_dhcp_t *test_inst_alloc(TALLOC_CTX *ctx)
+{
+	rlm_isc_dhcp_t *inst;
+
+	MEM(inst = talloc_zero(ctx, rlm_isc_dhcp_t));
+	inst->filename = test_path(inst, "dhcpd.conf");
+	inst->index = test_path(inst, "dhcpd.index");
+
+	test_file_write(inst->filename, test_conf, sizeof(test_conf) - 1);
+	test_file_write(test_path(inst, "hosts.conf"), test_hosts, sizeof(test_hosts) - 1);
+
+	return inst;
+}
+
+static int _test_info_collect(rlm_isc_dhcp_info_t *child, void *uctx)
+{
+	rlm_isc_dhcp_info_t ***children = uctx;
+	size_t num = talloc_array_length(*children);
+
+	MEM(*children = talloc_realloc(NULL, *children, rlm_isc_dhcp_info_t *, num + 1));
+	(*children)[num] = child;
+
+	return 0;
+}
+
+/** Compare two trees, returning the path of the first difference
+ *
+ */
+static bool test_info_cmp(rlm_isc_dhcp_info_t *a, rlm_isc_dhcp_info_t *b, char const **where)
+{
+	rlm_isc_dhcp_info_t	**a_children = NULL, **b_children = NULL;
+	fr_pair_t		*a_vp, *b_vp;
+	size_t			i;
+	bool			ret = false;
+
+	*where = a->cmd ? a->cmd->name : "top";
+
+	if ((a->cmd != b->cmd) || (a->argc != b->argc)) return false;
+
+	for (i = 0; i < (size_t) a->argc; i++) {
+		if (fr_value_box_cmp(a->argv[i], b->argv[i]) != 0) return false;
+	}
+
+	if (fr_pair_list_num_elements(&a->options) != fr_pair_list_num_elements(&b->options)) return false;
+
+	for (a_vp = fr_pair_list_head(&a->options), b_vp = fr_pair_list_head(&b->options);
+	     a_vp != NULL;
+	     a_vp = fr_pair_list_next(&a->options, a_vp), b_vp = fr_pair_list_next(&b->options, b_vp)) {
+		if ((a_vp->da != b_vp->da) || (fr_value_box_cmp(&a_vp->data, &b_vp->data) != 0)) return false;
+	}
+
+	if (((a->hosts_by_ether == NULL) != (b->hosts_by_ether == NULL)) ||
+	    ((a->hosts_by_uid == NULL) != (b->hosts_by_uid == NULL)) ||
+	    ((a->subnets == NULL) != (b->subnets == NULL))) return false;
+
+	(void) info_children(a, _test_info_collect, &a_children);
+	(void) info_children(b, _test_info_collect, &b_children);
+
+	if (talloc_array_length(a_children) != talloc_array_length(b_children)) goto done;
+
+	for (i = 0; i < talloc_array_length(a_children); i++) {
+		if (!test_info_cmp(a_children[i], b_children[i], where)) goto done;
+	}
+
+	ret = true;
+
+done:
+	talloc_free(a_children);
+	talloc_free(b_children);
+
+	return ret;
+}
+
+static rlm_isc_dhcp_info_t *test_host_by_ether(rlm_isc_dhcp_db_t *db, uint8_t const ether[6])
+{
+	isc_host_ether_t my_ether, *found;
+
+	memcpy(my_ether.ether, ether, sizeof(my_ether.ether));
+
+	found = fr_hash_table_find(db->hosts_by_ether, &my_ether);
+	if (!found) return NULL;
+
+	return found->host;
+}
+
+static void test_index_reload(void)
+{
+	TALLOC_CTX		*ctx = talloc_init_const("isc_dhcp_test");
+	rlm_isc_dhcp_t		*inst;
+	rlm_isc_dhcp_db_t	*parsed, *loaded;
+	rlm_isc_dhcp_info_t	*host;
+	char const		*where = NULL;
+	char			*copy;
+	uint8_t const		beta[6] = { 0x00, 0x01, 0x02, 0x03, 0x04, 0x06 };
+	size_t			i;
+
+	test_dir_alloc();
+	inst = test_inst_alloc(ctx);
+
+	TEST_CASE("Parsing the files writes an index");
+	parsed = db_load(inst, ctx, false);
+	TEST_ASSERT(parsed != NULL);
+	TEST_CHECK(access(inst->index, R_OK) == 0);
+	TEST_CHECK(talloc_array_length(parsed->sources) == 2);
+	TEST_CHECK(fr_hash_table_num_elements(parsed->hosts_by_ether) == 3);
+	TEST_CHECK(fr_hash_table_num_elements(parsed->hosts_by_uid) == 1);
+
+	TEST_CASE("The index is used when the files haven't changed");
+	loaded = db_alloc(ctx, false);
+	TEST_ASSERT(loaded != NULL);
+	TEST_CHECK(index_read(inst, loaded) == 1);
+	TEST_MSG("index_read failed - %s", fr_strerror());
+
+	TEST_CASE("The tree read from the index is the same as the one parsed from the files");
+	TEST_CHECK(test_info_cmp(parsed->head, loaded->head, &where));
+	TEST_MSG("Trees differ at '%s'", where);
+
+	TEST_CHECK(fr_hash_table_num_elements(loaded->hosts_by_ether) == 3);
+	TEST_CHECK(fr_hash_table_num_elements(loaded->hosts_by_uid) == 1);
+
+	TEST_CHECK(talloc_array_length(loaded->sources) == talloc_array_length(parsed->sources));
+	for (i = 0; i < talloc_array_length(loaded->sources); i++) {
+		TEST_CHECK(strcmp(loaded->sources[i].filename, parsed->sources[i].filename) == 0);
+		TEST_CHECK(loaded->sources[i].mtime == parsed->sources[i].mtime);
+		TEST_CHECK(loaded->sources[i].inode == parsed->sources[i].inode);
+	}
+
+	TEST_CHECK(talloc_array_length(loaded->defines) == 1);
+	TEST_CHECK(loaded->defines && (strcmp(loaded->defines[0].name, "site-number") == 0));
+
+	TEST_CASE("Hosts from included files can be found");
+	host = test_host_by_ether(loaded, beta);
+	TEST_ASSERT(host != NULL);
+	TEST_CHECK(strcmp(host->argv[0]->vb_strvalue, "beta") == 0);
+	TEST_CHECK(host->parent && (host->parent->cmd->type == ISC_GROUP));
+
+	TEST_CASE("Writing the loaded tree gives the same index");
+	copy = test_path(ctx, "dhcpd.index2");
+	inst->index = copy;
+	TEST_CHECK(index_write(inst, loaded) == 0);
+	inst->index = test_path(ctx, "dhcpd.index");
+	{
+		struct stat a, b;
+
+		TEST_ASSERT(stat(inst->index, &a) == 0);
+		TEST_ASSERT(stat(copy, &b) == 0);
+		TEST_CHECK((a.st_size == b.st_size) &&
+			   (memcmp(test_file_read(ctx, inst->index), test_file_read(ctx, copy), a.st_size) == 0));
+	}
+	talloc_free(ctx);
+	test_dir_free();
+}
+
+static void test_index_stale(void)
+{
+	TALLOC_CTX		*ctx = talloc_init_const("isc_dhcp_test");
+	rlm_isc_dhcp_t		*inst;
+	rlm_isc_dhcp_db_t	*db;
+	uint8_t			*data;
+	struct stat		st;
+
+	test_dir_alloc();
+	inst = test_inst_alloc(ctx);
+
+	TEST_ASSERT(db_load(inst, ctx, false) != NULL);
+
+	TEST_CASE("The index isn't used once an included file changes");
+	test_file_touch(test_path(ctx, "hosts.conf"));
+	db = db_alloc(ctx, false);
+	TEST_CHECK(index_read(inst, db) == 0);
+
+	TEST_CASE("Loading again rebuilds it");
+	TEST_ASSERT(db_load(inst, ctx, false) != NULL);
+	db = db_alloc(ctx, false);
+	TEST_CHECK(index_read(inst, db) == 1);
+
+	TEST_CASE("A corrupt index isn't used");
+	TEST_ASSERT(stat(inst->index, &st) == 0);
+	data = test_file_read(ctx, inst->index);
+	data[st.st_size - 1] ^= 0xff;
+	test_file_write(inst->index, (char const *) data, st.st_size);
+	db = db_alloc(ctx, false);
+	TEST_CHECK(index_read(inst, db) == 0);
+
+	TEST_CASE("A file which isn't an index is never overwritten");
+	test_file_write(inst->index, test_hosts, sizeof(test_hosts) - 1);
+	TEST_CHECK(db_load(inst, ctx, false) == NULL);
+	data = test_file_read(ctx, inst->index);
+	TEST_CHECK(memcmp(data, test_hosts, sizeof(test_hosts) - 1) == 0);
+
+	talloc_free(ctx);
+	test_dir_free();
+}
+
+/** Compare loading a large configuration from the files and from the index
+ *
+ */
+static void test_index_bench(void)
+{
+	TALLOC_CTX		*ctx = talloc_init_const("isc_dhcp_test");
+	rlm_isc_dhcp_t		*inst;
+	rlm_isc_dhcp_db_t	*db;
+	char const		*index_file;
+	FILE			*fp;
+	unsigned int		i;
+	fr_time_t		start;
+	fr_time_delta_t		parse, load;
+
+	test_dir_alloc();
+
+	MEM(inst = talloc_zero(ctx, rlm_isc_dhcp_t));
+	inst->filename = test_path(inst, "bench.conf");
+	index_file = test_path(inst, "bench.index");
+
+	fp = fopen(inst->filename, "w");
+	TEST_ASSERT(fp != NULL);
+	for (i = 0; i < ISC_DHCP_BENCH_HOSTS; i++) {
+		if ((i % 250) == 0) {
+			if (i) fprintf(fp, "}\n");
+			fprintf(fp, "subnet 10.%u.%u.0 netmask 255.255.255.0 {\n"
+				"\toption Router-Address 10.%u.%u.1;\n",
+				(i / 250) >> 8, (i / 250) & 0xff, (i / 250) >> 8, (i / 250) & 0xff);
+		}
+
+		fprintf(fp, "\thost h%u {\n"
+			"\t\thardware ethernet 02:00:00:%02x:%02x:%02x;\n"
+			"\t\tfixed-address 10.%u.%u.%u;\n"
+			"\t}\n",
+			i, (i >> 16) & 0xff, (i >> 8) & 0xff, i & 0xff,
+			(i / 250) >> 8, (i / 250) & 0xff, (i % 250) + 2);
+	}
+	fprintf(fp, "}\n");
+	TEST_ASSERT(fclose(fp) == 0);
+
+	start = fr_time();
+	db = db_load(inst, ctx, false);
+	parse = fr_time_sub(fr_time(), start);
+	TEST_ASSERT(db != NULL);
+	TEST_CHECK(fr_hash_table_num_elements(db->hosts_by_ether) == ISC_DHCP_BENCH_HOSTS);
+	talloc_free(db);
+
+	/*
+	 *	The first load with an index parses the files, and
+	 *	writes it.  Only the second reads it.
+	 */
+	inst->index = index_file;
+	TEST_ASSERT((db = db_load(inst, ctx, false)) != NULL);
+	talloc_free(db);
+
+	start = fr_time();
+	db = db_load(inst, ctx, false);
+	load = fr_time_sub(fr_time(), start);
+	TEST_ASSERT(db != NULL);
+	TEST_CHECK(fr_hash_table_num_elements(db->hosts_by_ether) == ISC_DHCP_BENCH_HOSTS);
+
+	TEST_MSG_ALWAYS("\nhosts: %u\n", ISC_DHCP_BENCH_HOSTS);
+	TEST_MSG_ALWAYS("parse: %.3f ms\n", fr_time_delta_unwrap(parse) / (double)NSEC * 1000);
+	TEST_MSG_ALWAYS("index: %.3f ms\n", fr_time_delta_unwrap(load) / (double)NSEC * 1000);
+
+	talloc_free(ctx);
+	test_dir_free();
+}
+
+TEST_LIST = {
+	{ "isc_dhcp_index_reload",	test_index_reload },
+	{ "isc_dhcp_index_stale",	test_index_stale },
+	{ "isc_dhcp_index_bench",	test_index_bench },
+
+	{ NULL }
+};
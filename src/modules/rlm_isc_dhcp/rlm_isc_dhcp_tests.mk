@@ -0,0 +1,8 @@
+TARGET		:= rlm_isc_dhcp_tests$(E)
+SOURCES		:= rlm_isc_dhcp_tests.c
+
+TGT_LDLIBS	:= $(LIBS) $(GPERFTOOLS_LIBS)
+TGT_LDFLAGS	:= $(LDFLAGS) $(GPERFTOOLS_LDFLAGS)
+TGT_PREREQS	:= libfreeradius-util$(L) libfreeradius-io$(L) libfreeradius-server$(L)
+
+TGT_INSTALLDIR	:=
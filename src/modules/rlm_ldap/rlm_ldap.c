@@ -133,6 +133,15 @@ static conf_parser_t group_config[] = {
 	CONF_PARSER_TERMINATOR
 };
 
+/*
+ *	Search result cache configuration
+ */
+static conf_parser_t search_cache_config[] = {
+	{ FR_CONF_OFFSET("size", rlm_ldap_t, search_cache.size), .dflt = "0" },
+	{ FR_CONF_OFFSET("lifetime", rlm_ldap_t, search_cache.lifetime), .dflt = "30" },
+	CONF_PARSER_TERMINATOR
+};
+
 /*
  *	Reference for accounting updates
  */
@@ -175,6 +184,8 @@ static const conf_parser_t module_config[] = {
 
 	{ FR_CONF_POINTER("profile", 0, CONF_FLAG_SUBSECTION, NULL), .subcs = (void const *) profile_config },
 
+	{ FR_CONF_POINTER("search_cache", 0, CONF_FLAG_SUBSECTION, NULL), .subcs = (void const *) search_cache_config },
+
 	{ FR_CONF_OFFSET_SUBSECTION("pool", 0, rlm_ldap_t, trunk_conf, trunk_config ) },
 
 	{ FR_CONF_OFFSET_SUBSECTION("bind_pool", 0, rlm_ldap_t, bind_trunk_conf, trunk_config ) },
@@ -2399,6 +2410,10 @@ static int mod_thread_instantiate(module_thread_inst_ctx_t const *mctx)
 	t->bind_trunk_conf = &inst->bind_trunk_conf;
 	t->el = mctx->el;
 
+	if (inst->search_cache.size > 0) {
+		t->cache = fr_ldap_cache_alloc(t, inst->search_cache.size, inst->search_cache.lifetime);
+	}
+
 	/*
 	 *	Launch trunk for module default connection
 	 */
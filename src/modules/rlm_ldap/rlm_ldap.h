@@ -124,6 +124,15 @@ typedef struct {
 							//!< to perform additional authorisation checks.
 #endif
 
+	/*
+	 *	Search result caching
+	 */
+	struct {
+		uint32_t	size;			//!< Maximum number of cached searches per thread.
+							///< 0 disables the cache.
+		fr_time_delta_t	lifetime;		//!< How long search results are cached for.
+	} search_cache;
+
 	fr_ldap_config_t handle_config;			//!< Connection configuration instance.
 	trunk_conf_t	trunk_conf;			//!< Trunk configuration
 	trunk_conf_t	bind_trunk_conf;		//!< Trunk configuration for trunk used for bind auths
@@ -0,0 +1,3 @@
+SUBMAKEFILES := \
+	libfreeradius-ocsp.mk \
+	cache_tests.mk
@@ -0,0 +1,339 @@
+/*
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+/**
+ * $Id$
+ *
+ * @file rlm_ocsp/cache.c
+ * @brief Shared cache of OCSP responses.
+ *
+ * Responses are keyed on the DER encoding of the OCSP CertID, i.e. the hashes
+ * of the issuer's name and key, and the serial number of the certificate.
+ * The cache is shared between all worker threads, and protected by a mutex.
+ *
+ * Entries expire at the response's nextUpdate time, capped to a configurable
+ * maximum.  Responses without a nextUpdate time are never cached.
+ *
+ * While a response is being fetched, other requests for the same certificate
+ * wait for the fetch to complete instead of querying the responder themselves.
+ * Waiters may be in other threads, so they're woken by triggering a user event
+ * in their thread's event list.  They receive a copy of the response even if
+ * it wasn't cacheable.
+ *
+ * @copyright 2024 The FreeRADIUS server project
+ */
+RCSID("$Id$")
+
+#ifdef WITH_TLS
+#define LOG_PREFIX "tls - ocsp"
+
+#include <freeradius-devel/server/base.h>
+#include <freeradius-devel/unlang/interpret.h>
+#include <freeradius-devel/util/debug.h>
+#include <freeradius-devel/util/rb.h>
+
+#include <pthread.h>
+
+#include "cache.h"
+
+struct fr_tls_ocsp_cache_s {
+	pthread_mutex_t		mutex;			//!< Protects everything below.
+	fr_rb_tree_t		*tree;			//!< Entries keyed on CertID.
+	fr_dlist_head_t		lru;			//!< Valid entries, least recently used at the head.
+	uint32_t		max_entries;		//!< Maximum number of valid entries.
+	fr_time_delta_t		max_ttl;		//!< Maximum time a response is cached for.
+};
+
+typedef struct {
+	fr_rb_node_t		node;			//!< Entry in the tree of responses.
+	fr_dlist_t		entry;			//!< Entry in the LRU list.
+
+	uint8_t			*key;			//!< DER encoded CertID.
+	size_t			key_len;		//!< Length of the CertID.
+
+	bool			fetching;		//!< A request is fetching the response.
+	fr_dlist_head_t		waiters;		//!< Requests waiting for the fetch to complete.
+
+	uint8_t			*resp;			//!< DER encoded response.
+	size_t			resp_len;		//!< Length of the response.
+	fr_time_t		expires;		//!< When the response must be refreshed.
+} fr_tls_ocsp_cache_entry_t;
+
+static int8_t ocsp_cache_entry_cmp(void const *one, void const *two)
+{
+	fr_tls_ocsp_cache_entry_t const *a = one, *b = two;
+	int ret;
+
+	ret = CMP(a->key_len, b->key_len);
+	if (ret != 0) return ret;
+
+	ret = memcmp(a->key, b->key, a->key_len);
+	return CMP(ret, 0);
+}
+
+/** Remove an entry from the cache
+ *
+ * Must be called with the mutex held.
+ */
+static void ocsp_cache_entry_remove(fr_tls_ocsp_cache_t *cache, fr_tls_ocsp_cache_entry_t *entry)
+{
+	fr_assert(fr_dlist_num_elements(&entry->waiters) == 0);
+
+	if (fr_dlist_entry_in_list(&entry->entry)) fr_dlist_remove(&cache->lru, entry);
+	fr_rb_delete(cache->tree, entry);
+	talloc_free(entry);
+}
+
+static int _ocsp_cache_free(fr_tls_ocsp_cache_t *cache)
+{
+	pthread_mutex_destroy(&cache->mutex);
+
+	return 0;
+}
+
+/** Allocate a response cache
+ *
+ * @param[in] ctx		to allocate the cache in.
+ * @param[in] max_entries	Maximum number of responses to cache.
+ * @param[in] max_ttl		Maximum time to cache a response for.
+ * @return
+ *	- A new cache.
+ *	- NULL on error.
+ */
+fr_tls_ocsp_cache_t *fr_tls_ocsp_cache_alloc(TALLOC_CTX *ctx, uint32_t max_entries, fr_time_delta_t max_ttl)
+{
+	fr_tls_ocsp_cache_t *cache;
+
+	MEM(cache = talloc_zero(ctx, fr_tls_ocsp_cache_t));
+	cache->tree = fr_rb_inline_talloc_alloc(cache, fr_tls_ocsp_cache_entry_t, node, ocsp_cache_entry_cmp, NULL);
+	if (!cache->tree) {
+		talloc_free(cache);
+		return NULL;
+	}
+	fr_dlist_talloc_init(&cache->lru, fr_tls_ocsp_cache_entry_t, entry);
+	cache->max_entries = max_entries;
+	cache->max_ttl = max_ttl;
+	pthread_mutex_init(&cache->mutex, NULL);
+	talloc_set_destructor(cache, _ocsp_cache_free);
+
+	return cache;
+}
+
+/** Stop waiting, and free any response we were given
+ *
+ */
+static int _ocsp_cache_waiter_free(fr_tls_ocsp_cache_waiter_t *waiter)
+{
+	fr_tls_ocsp_cache_t *cache = waiter->cache;
+
+	if (cache) {
+		pthread_mutex_lock(&cache->mutex);
+		if (fr_dlist_entry_in_list(&waiter->entry)) fr_dlist_entry_unlink(&waiter->entry);
+		pthread_mutex_unlock(&cache->mutex);
+	}
+
+	/*
+	 *	Frees the event, so any pending
+	 *	trigger is discarded.
+	 */
+	TALLOC_FREE(waiter->ev);
+	free(waiter->resp);
+
+	return 0;
+}
+
+/** Runs in the waiter's thread when the fetch completes
+ *
+ */
+static void _ocsp_cache_waiter_signal(UNUSED fr_event_list_t *el, void *uctx)
+{
+	fr_tls_ocsp_cache_waiter_t *waiter = talloc_get_type_abort(uctx, fr_tls_ocsp_cache_waiter_t);
+
+	waiter->done = true;
+	unlang_interpret_mark_runnable(waiter->request);
+}
+
+/** Allocate a structure to wait for another request's fetch to complete
+ *
+ * @param[in] ctx	to allocate the waiter in.  Usually the request.
+ * @param[in] request	to mark as runnable when the fetch completes.
+ * @return
+ *	- A new waiter.
+ *	- NULL on error.
+ */
+fr_tls_ocsp_cache_waiter_t *fr_tls_ocsp_cache_waiter_alloc(TALLOC_CTX *ctx, request_t *request)
+{
+	fr_tls_ocsp_cache_waiter_t *waiter;
+
+	MEM(waiter = talloc_zero(ctx, fr_tls_ocsp_cache_waiter_t));
+	waiter->request = request;
+	waiter->el = unlang_interpret_event_list(request);
+	fr_dlist_entry_init(&waiter->entry);
+	talloc_set_destructor(waiter, _ocsp_cache_waiter_free);
+
+	if (fr_event_user_insert(waiter, waiter->el, &waiter->ev, false, _ocsp_cache_waiter_signal, waiter) < 0) {
+		RPERROR("Failed registering OCSP cache event");
+		talloc_free(waiter);
+		return NULL;
+	}
+
+	return waiter;
+}
+
+/** Lookup a response in the cache
+ *
+ * @param[in] ctx		to allocate the response in.
+ * @param[out] resp		Where to write the DER encoded response, on a hit.
+ * @param[out] resp_len		Length of the response.
+ * @param[in] cache		to search in.
+ * @param[in] key		DER encoded CertID of the certificate.
+ * @param[in] key_len		Length of the CertID.
+ * @param[in] waiter		to add to the entry if another request is fetching
+ *				the response.  May be NULL if the caller can't wait,
+ *				in which case it's told to fetch the response itself.
+ * @return
+ *	- FR_TLS_OCSP_CACHE_HIT if a valid response was found.
+ *	- FR_TLS_OCSP_CACHE_WAIT if another request is fetching the response.
+ *	- FR_TLS_OCSP_CACHE_FETCH if the caller should fetch the response.
+ *	- FR_TLS_OCSP_CACHE_MISS if the caller should fetch the response, but
+ *	  another request is already doing so.
+ */
+fr_tls_ocsp_cache_rcode_t fr_tls_ocsp_cache_lookup(TALLOC_CTX *ctx, uint8_t **resp, size_t *resp_len,
+						    fr_tls_ocsp_cache_t *cache, uint8_t const *key, size_t key_len,
+						    fr_tls_ocsp_cache_waiter_t *waiter)
+{
+	fr_tls_ocsp_cache_entry_t	*entry;
+	fr_tls_ocsp_cache_rcode_t	rcode;
+
+	pthread_mutex_lock(&cache->mutex);
+	entry = fr_rb_find(cache->tree, &(fr_tls_ocsp_cache_entry_t){ .key = UNCONST(uint8_t *, key), .key_len = key_len });
+	if (entry && !entry->fetching && fr_time_lteq(entry->expires, fr_time())) {
+		ocsp_cache_entry_remove(cache, entry);
+		entry = NULL;
+	}
+
+	if (!entry) {
+		MEM(entry = talloc_zero(cache, fr_tls_ocsp_cache_entry_t));
+		MEM(entry->key = talloc_memdup(entry, key, key_len));
+		entry->key_len = key_len;
+		fr_dlist_entry_init(&entry->entry);
+		fr_dlist_init(&entry->waiters, fr_tls_ocsp_cache_waiter_t, entry);
+		entry->fetching = true;
+		fr_rb_insert(cache->tree, entry);
+
+		rcode = FR_TLS_OCSP_CACHE_FETCH;
+		goto done;
+	}
+
+	if (entry->fetching) {
+		if (!waiter) {
+			rcode = FR_TLS_OCSP_CACHE_MISS;
+			goto done;
+		}
+
+		waiter->cache = cache;
+		waiter->done = false;
+		fr_dlist_insert_tail(&entry->waiters, waiter);
+
+		rcode = FR_TLS_OCSP_CACHE_WAIT;
+		goto done;
+	}
+
+	MEM(*resp = talloc_memdup(ctx, entry->resp, entry->resp_len));
+	*resp_len = entry->resp_len;
+
+	fr_dlist_remove(&cache->lru, entry);
+	fr_dlist_insert_tail(&cache->lru, entry);
+
+	rcode = FR_TLS_OCSP_CACHE_HIT;
+
+done:
+	pthread_mutex_unlock(&cache->mutex);
+
+	return rcode;
+}
+
+/** Record the result of a fetch, and wake any requests waiting for it
+ *
+ * @param[in] cache		the fetch was for.
+ * @param[in] key		DER encoded CertID of the certificate.
+ * @param[in] key_len		Length of the CertID.
+ * @param[in] resp		DER encoded response.  NULL if the fetch failed.
+ * @param[in] resp_len		Length of the response.
+ * @param[in] expires		When the response must be refreshed.  If this is not
+ *				in the future, the response is given to the waiters,
+ *				but not cached.
+ */
+void fr_tls_ocsp_cache_complete(fr_tls_ocsp_cache_t *cache,
+				uint8_t const *key, size_t key_len,
+				uint8_t const *resp, size_t resp_len, fr_time_t expires)
+{
+	fr_tls_ocsp_cache_entry_t	*entry;
+	fr_tls_ocsp_cache_waiter_t	*waiter;
+
+	pthread_mutex_lock(&cache->mutex);
+	entry = fr_rb_find(cache->tree, &(fr_tls_ocsp_cache_entry_t){ .key = UNCONST(uint8_t *, key), .key_len = key_len });
+	if (!entry || !entry->fetching) {
+		pthread_mutex_unlock(&cache->mutex);
+		return;
+	}
+
+	while ((waiter = fr_dlist_pop_head(&entry->waiters))) {
+		if (resp) {
+			waiter->resp = malloc(resp_len);
+			if (waiter->resp) {
+				memcpy(waiter->resp, resp, resp_len);
+				waiter->resp_len = resp_len;
+			}
+		}
+		if (fr_event_user_trigger(waiter->el, waiter->ev) < 0) PERROR("Failed waking OCSP cache waiter");
+	}
+
+	if (!resp || fr_time_lteq(expires, fr_time()) || (cache->max_entries == 0)) {
+		ocsp_cache_entry_remove(cache, entry);
+		pthread_mutex_unlock(&cache->mutex);
+		return;
+	}
+
+	MEM(entry->resp = talloc_memdup(entry, resp, resp_len));
+	entry->resp_len = resp_len;
+	entry->expires = expires;
+	entry->fetching = false;
+	fr_dlist_insert_tail(&cache->lru, entry);
+
+	/*
+	 *	Evict the least recently used
+	 *	responses.
+	 */
+	while (fr_dlist_num_elements(&cache->lru) > cache->max_entries) {
+		ocsp_cache_entry_remove(cache, fr_dlist_head(&cache->lru));
+	}
+	pthread_mutex_unlock(&cache->mutex);
+}
+
+/** Calculate when a response should expire
+ *
+ * @param[in] cache		the response will be stored in.
+ * @param[in] next_update	from the response.
+ * @return When the response should be refreshed.
+ */
+fr_time_t fr_tls_ocsp_cache_expires(fr_tls_ocsp_cache_t *cache, fr_time_t next_update)
+{
+	fr_time_t max = fr_time_add(fr_time(), cache->max_ttl);
+
+	return fr_time_lt(next_update, max) ? next_update : max;
+}
+#endif /* WITH_TLS */
@@ -0,0 +1,89 @@
+#pragma once
+/*
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+/**
+ * $Id$
+ *
+ * @file rlm_ocsp/cache.h
+ * @brief Shared cache of OCSP responses.
+ *
+ * @copyright 2024 The FreeRADIUS server project
+ */
+RCSIDH(ocsp_cache_h, "$Id$")
+
+#include <freeradius-devel/server/request.h>
+#include <freeradius-devel/util/dlist.h>
+#include <freeradius-devel/util/event.h>
+#include <freeradius-devel/util/time.h>
+
+typedef struct fr_tls_ocsp_cache_s fr_tls_ocsp_cache_t;
+
+/** Result of looking up a response in the cache
+ *
+ */
+typedef enum {
+	FR_TLS_OCSP_CACHE_HIT = 0,			//!< A valid response was found.
+	FR_TLS_OCSP_CACHE_WAIT,				//!< Another request is fetching the response.
+							///< The waiter will be signalled when it completes.
+	FR_TLS_OCSP_CACHE_FETCH,			//!< The caller must fetch the response, and call
+							///< #fr_tls_ocsp_cache_complete when done.
+	FR_TLS_OCSP_CACHE_MISS				//!< Another request is fetching the response, but
+							///< the caller can't wait.  The caller must fetch
+							///< the response, and not complete the entry.
+} fr_tls_ocsp_cache_rcode_t;
+
+/** A request waiting for another request to fetch a response
+ *
+ * Allocated with #fr_tls_ocsp_cache_waiter_alloc.  Freeing the waiter
+ * stops it waiting.
+ */
+typedef struct {
+	fr_dlist_t		entry;			//!< Entry in the list of waiters.
+	fr_event_user_t		*ev;			//!< Triggered when the fetch completes.
+	fr_event_list_t		*el;			//!< Event list of the waiting request.
+	request_t		*request;		//!< Request to mark as runnable.
+
+	fr_tls_ocsp_cache_t	*cache;			//!< Cache we're waiting on.  NULL if not waiting.
+	bool			done;			//!< Fetch completed.  Only accessed by the waiting thread.
+
+	uint8_t			*resp;			//!< DER encoded response.  NULL if the fetch failed.
+							///< Allocated with malloc as it's written by the
+							///< thread which performed the fetch.
+	size_t			resp_len;		//!< Length of the response.
+} fr_tls_ocsp_cache_waiter_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+fr_tls_ocsp_cache_t		*fr_tls_ocsp_cache_alloc(TALLOC_CTX *ctx, uint32_t max_entries, fr_time_delta_t max_ttl);
+
+fr_tls_ocsp_cache_waiter_t	*fr_tls_ocsp_cache_waiter_alloc(TALLOC_CTX *ctx, request_t *request);
+
+fr_tls_ocsp_cache_rcode_t	fr_tls_ocsp_cache_lookup(TALLOC_CTX *ctx, uint8_t **resp, size_t *resp_len,
+							 fr_tls_ocsp_cache_t *cache, uint8_t const *key, size_t key_len,
+							 fr_tls_ocsp_cache_waiter_t *waiter);
+
+void				fr_tls_ocsp_cache_complete(fr_tls_ocsp_cache_t *cache,
+							   uint8_t const *key, size_t key_len,
+							   uint8_t const *resp, size_t resp_len, fr_time_t expires);
+
+fr_time_t			fr_tls_ocsp_cache_expires(fr_tls_ocsp_cache_t *cache, fr_time_t next_update);
+
+#ifdef __cplusplus
+}
+#endif
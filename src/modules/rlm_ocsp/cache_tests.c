@@ -0,0 +1,232 @@
+#include <freeradius-devel/util/acutest.h>
+#include <freeradius-devel/util/acutest_helpers.h>
+
+/*
+ *	Gives access to the waiter destructor, so waiters
+ *	can be created without a request.
+ */
+#include "cache.c"
+
+#define TTL		fr_time_delta_from_sec(60)
+
+static uint8_t const	key_a[] = "certid a";
+static uint8_t const	key_b[] = "certid b";
+static uint8_t const	key_c[] = "certid c";
+
+static uint8_t const	resp_a[] = "response a";
+static uint8_t const	resp_b[] = "response b";
+static uint8_t const	resp_c[] = "response c";
+
+static fr_tls_ocsp_cache_t *test_cache_alloc(TALLOC_CTX *ctx, uint32_t max_entries)
+{
+	fr_tls_ocsp_cache_t *cache;
+
+	fr_time_start();
+
+	cache = fr_tls_ocsp_cache_alloc(ctx, max_entries, TTL);
+	TEST_ASSERT(cache != NULL);
+
+	return cache;
+}
+
+static fr_time_t test_expires(void)
+{
+	return fr_time_add(fr_time(), TTL);
+}
+
+/** Lookup a key, checking the response if it's a hit
+ *
+ */
+static fr_tls_ocsp_cache_rcode_t test_lookup(fr_tls_ocsp_cache_t *cache, uint8_t const *key,
+					     uint8_t const *expected, fr_tls_ocsp_cache_waiter_t *waiter)
+{
+	fr_tls_ocsp_cache_rcode_t	rcode;
+	uint8_t				*resp = NULL;
+	size_t				resp_len = 0;
+
+	rcode = fr_tls_ocsp_cache_lookup(NULL, &resp, &resp_len, cache, key, sizeof(key_a), waiter);
+	if (rcode != FR_TLS_OCSP_CACHE_HIT) {
+		TEST_CHECK(resp == NULL);
+		return rcode;
+	}
+
+	TEST_CHECK(resp_len == sizeof(resp_a));
+	TEST_CHECK(expected && (memcmp(resp, expected, resp_len) == 0));
+	talloc_free(resp);
+
+	return rcode;
+}
+
+static void test_complete(fr_tls_ocsp_cache_t *cache, uint8_t const *key, uint8_t const *resp, fr_time_t expires)
+{
+	fr_tls_ocsp_cache_complete(cache, key, sizeof(key_a), resp, resp ? sizeof(resp_a) : 0, expires);
+}
+
+/** Signalled in place of marking the request runnable
+ *
+ */
+static void test_waiter_signal(UNUSED fr_event_list_t *el, void *uctx)
+{
+	fr_tls_ocsp_cache_waiter_t *waiter = talloc_get_type_abort(uctx, fr_tls_ocsp_cache_waiter_t);
+
+	waiter->done = true;
+}
+
+static fr_tls_ocsp_cache_waiter_t *test_waiter_alloc(TALLOC_CTX *ctx, fr_event_list_t *el)
+{
+	fr_tls_ocsp_cache_waiter_t *waiter;
+
+	MEM(waiter = talloc_zero(ctx, fr_tls_ocsp_cache_waiter_t));
+	waiter->el = el;
+	fr_dlist_entry_init(&waiter->entry);
+	talloc_set_destructor(waiter, _ocsp_cache_waiter_free);
+
+	TEST_ASSERT(fr_event_user_insert(waiter, el, &waiter->ev, false, test_waiter_signal, waiter) == 0);
+
+	return waiter;
+}
+
+/** Run any events which have been triggered
+ *
+ */
+static void test_events_service(fr_event_list_t *el)
+{
+	TEST_CHECK(fr_event_corral(el, fr_time(), false) >= 0);
+	fr_event_service(el);
+}
+
+static void test_ocsp_cache_hit(void)
+{
+	TALLOC_CTX		*ctx = talloc_init_const("ocsp_cache_test");
+	fr_tls_ocsp_cache_t	*cache;
+
+	cache = test_cache_alloc(ctx, 16);
+
+	TEST_CASE("The first lookup fetches the response");
+	TEST_CHECK(test_lookup(cache, key_a, NULL, NULL) == FR_TLS_OCSP_CACHE_FETCH);
+	test_complete(cache, key_a, resp_a, test_expires());
+
+	TEST_CASE("Later lookups are answered from the cache");
+	TEST_CHECK(test_lookup(cache, key_a, resp_a, NULL) == FR_TLS_OCSP_CACHE_HIT);
+	TEST_CHECK(test_lookup(cache, key_a, resp_a, NULL) == FR_TLS_OCSP_CACHE_HIT);
+
+	TEST_CASE("Other certificates aren't");
+	TEST_CHECK(test_lookup(cache, key_b, NULL, NULL) == FR_TLS_OCSP_CACHE_FETCH);
+
+	TEST_CASE("Responses which have already expired aren't cached");
+	test_complete(cache, key_b, resp_b, fr_time());
+	TEST_CHECK(test_lookup(cache, key_b, NULL, NULL) == FR_TLS_OCSP_CACHE_FETCH);
+
+	TEST_CASE("Failed fetches aren't cached");
+	test_complete(cache, key_b, NULL, test_expires());
+	TEST_CHECK(test_lookup(cache, key_b, NULL, NULL) == FR_TLS_OCSP_CACHE_FETCH);
+	test_complete(cache, key_b, resp_b, test_expires());
+	TEST_CHECK(test_lookup(cache, key_b, resp_b, NULL) == FR_TLS_OCSP_CACHE_HIT);
+
+	TEST_CASE("Responses are refreshed once they expire");
+	pthread_mutex_lock(&cache->mutex);
+	((fr_tls_ocsp_cache_entry_t *)fr_dlist_head(&cache->lru))->expires = fr_time();
+	pthread_mutex_unlock(&cache->mutex);
+	TEST_CHECK(test_lookup(cache, key_a, NULL, NULL) == FR_TLS_OCSP_CACHE_FETCH);
+
+	talloc_free(ctx);
+}
+
+static void test_ocsp_cache_lru(void)
+{
+	TALLOC_CTX		*ctx = talloc_init_const("ocsp_cache_test");
+	fr_tls_ocsp_cache_t	*cache;
+
+	cache = test_cache_alloc(ctx, 2);
+
+	test_lookup(cache, key_a, NULL, NULL);
+	test_complete(cache, key_a, resp_a, test_expires());
+	test_lookup(cache, key_b, NULL, NULL);
+	test_complete(cache, key_b, resp_b, test_expires());
+
+	/*
+	 *	"a" was cached first, but has been used since.
+	 */
+	TEST_CASE("The least recently used response is evicted when the cache is full");
+	TEST_CHECK(test_lookup(cache, key_a, resp_a, NULL) == FR_TLS_OCSP_CACHE_HIT);
+	test_lookup(cache, key_c, NULL, NULL);
+	test_complete(cache, key_c, resp_c, test_expires());
+
+	TEST_CHECK(test_lookup(cache, key_a, resp_a, NULL) == FR_TLS_OCSP_CACHE_HIT);
+	TEST_CHECK(test_lookup(cache, key_c, resp_c, NULL) == FR_TLS_OCSP_CACHE_HIT);
+	TEST_CHECK(test_lookup(cache, key_b, NULL, NULL) == FR_TLS_OCSP_CACHE_FETCH);
+
+	TEST_CASE("A disabled cache stores nothing");
+	cache = test_cache_alloc(ctx, 0);
+	test_lookup(cache, key_a, NULL, NULL);
+	test_complete(cache, key_a, resp_a, test_expires());
+	TEST_CHECK(test_lookup(cache, key_a, NULL, NULL) == FR_TLS_OCSP_CACHE_FETCH);
+
+	talloc_free(ctx);
+}
+
+static void test_ocsp_cache_coalesce(void)
+{
+	TALLOC_CTX			*ctx = talloc_init_const("ocsp_cache_test");
+	fr_tls_ocsp_cache_t		*cache;
+	fr_event_list_t			*el;
+	fr_tls_ocsp_cache_waiter_t	*first, *second, *gone;
+
+	cache = test_cache_alloc(ctx, 16);
+	el = fr_event_list_alloc(ctx, NULL, NULL);
+	TEST_ASSERT(el != NULL);
+
+	first = test_waiter_alloc(ctx, el);
+	second = test_waiter_alloc(ctx, el);
+	gone = test_waiter_alloc(ctx, el);
+
+	TEST_CASE("Only the first request fetches the response");
+	TEST_CHECK(test_lookup(cache, key_a, NULL, NULL) == FR_TLS_OCSP_CACHE_FETCH);
+	TEST_CHECK(test_lookup(cache, key_a, NULL, first) == FR_TLS_OCSP_CACHE_WAIT);
+	TEST_CHECK(test_lookup(cache, key_a, NULL, second) == FR_TLS_OCSP_CACHE_WAIT);
+	TEST_CHECK(test_lookup(cache, key_a, NULL, gone) == FR_TLS_OCSP_CACHE_WAIT);
+
+	TEST_CASE("Requests which can't wait fetch it themselves");
+	TEST_CHECK(test_lookup(cache, key_a, NULL, NULL) == FR_TLS_OCSP_CACHE_MISS);
+
+	TEST_CASE("Waiters which are freed stop waiting");
+	talloc_free(gone);
+
+	TEST_CASE("Waiters are woken with a copy of the response when the fetch completes");
+	test_events_service(el);
+	TEST_CHECK(!first->done && !second->done);
+	test_complete(cache, key_a, resp_a, test_expires());
+	test_events_service(el);
+
+	TEST_CHECK(first->done && second->done);
+	TEST_CHECK(first->resp && (first->resp_len == sizeof(resp_a)) &&
+		   (memcmp(first->resp, resp_a, first->resp_len) == 0));
+	TEST_CHECK(second->resp && (second->resp_len == sizeof(resp_a)) &&
+		   (memcmp(second->resp, resp_a, second->resp_len) == 0));
+	TEST_CHECK(first->resp != second->resp);
+
+	TEST_CASE("The response is cached for later requests");
+	TEST_CHECK(test_lookup(cache, key_a, resp_a, first) == FR_TLS_OCSP_CACHE_HIT);
+
+	TEST_CASE("Waiters are woken without a response when the fetch fails");
+	talloc_free(first);
+	first = test_waiter_alloc(ctx, el);
+	TEST_CHECK(test_lookup(cache, key_b, NULL, NULL) == FR_TLS_OCSP_CACHE_FETCH);
+	TEST_CHECK(test_lookup(cache, key_b, NULL, first) == FR_TLS_OCSP_CACHE_WAIT);
+	test_complete(cache, key_b, NULL, test_expires());
+	test_events_service(el);
+
+	TEST_CHECK(first->done);
+	TEST_CHECK(first->resp == NULL);
+	TEST_CHECK(test_lookup(cache, key_b, NULL, NULL) == FR_TLS_OCSP_CACHE_FETCH);
+
+	talloc_free(ctx);
+}
+
+TEST_LIST = {
+	{ "ocsp_cache_hit",		test_ocsp_cache_hit },
+	{ "ocsp_cache_lru",		test_ocsp_cache_lru },
+	{ "ocsp_cache_coalesce",	test_ocsp_cache_coalesce },
+
+	{ NULL }
+};
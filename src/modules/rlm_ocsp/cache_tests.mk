@@ -0,0 +1,11 @@
+ifneq ($(OPENSSL_LIBS),)
+TARGET		:= ocsp_cache_tests$(E)
+endif
+
+SOURCES		:= cache_tests.c
+
+TGT_LDLIBS	:= $(LIBS) $(OPENSSL_LIBS) $(GPERFTOOLS_LIBS)
+TGT_LDFLAGS	:= $(LDFLAGS) $(GPERFTOOLS_LDFLAGS)
+TGT_PREREQS	:= libfreeradius-unlang$(L) libfreeradius-server$(L) libfreeradius-util$(L)
+
+TGT_INSTALLDIR	:=
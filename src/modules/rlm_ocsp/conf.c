@@ -1,15 +1,23 @@
+/* fr_tls_conf_t members */
+#ifdef HAVE_OPENSSL_OCSP_H
+	fr_tls_ocsp_conf_t	ocsp;			//!< Configuration for validating client certificates
+							//!< with ocsp.
+	fr_tls_ocsp_conf_t	staple;			//!< Configuration for validating server certificates
+							//!< with ocsp.
+#endif
+
 #ifdef HAVE_OPENSSL_OCSP_H
 static conf_parser_t ocsp_config[] = {
 	{ FR_CONF_OFFSET("enable", fr_tls_ocsp_conf_t, enable), .dflt = "no" },
 
-	{ FR_CONF_OFFSET("virtual_server", fr_tls_ocsp_conf_t, cache_server) },
-
 	{ FR_CONF_OFFSET("override_cert_url", fr_tls_ocsp_conf_t, override_url), .dflt = "no" },
 	{ FR_CONF_OFFSET("url", fr_tls_ocsp_conf_t, url) },
-	{ FR_CONF_OFFSET("use_nonce", fr_tls_ocsp_conf_t, use_nonce), .dflt = "yes" },
-	{ FR_CONF_OFFSET("timeout", fr_tls_ocsp_conf_t, timeout), .dflt = "yes" },
+	{ FR_CONF_OFFSET("use_nonce", fr_tls_ocsp_conf_t, use_nonce), .dflt = "no" },
+	{ FR_CONF_OFFSET("timeout", fr_tls_ocsp_conf_t, timeout), .dflt = "0" },
 	{ FR_CONF_OFFSET("softfail", fr_tls_ocsp_conf_t, softfail), .dflt = "no" },
 	{ FR_CONF_OFFSET("verifycert", fr_tls_ocsp_conf_t, verifycert), .dflt = "yes" },
+	{ FR_CONF_OFFSET("cache_size", fr_tls_ocsp_conf_t, cache_size), .dflt = "1024" },
+	{ FR_CONF_OFFSET("cache_max_ttl", fr_tls_ocsp_conf_t, cache_max_ttl), .dflt = "3600" },
 
 	CONF_PARSER_TERMINATOR
 };
@@ -21,32 +29,6 @@ static conf_parser_t ocsp_config[] = {
 	{ FR_CONF_OFFSET_SUBSCTION("staple", 0, fr_tls_conf_t, staple, ocsp_config) },
 #endif
 
-#ifdef HAVE_OPENSSL_OCSP_H
-	if (conf->ocsp.cache_server) {
-		virtual_server_t const *vs;
-
-		vs = virtual_server_find(conf->ocsp.cache_server);
-		if (!vs) {
-			ERROR("No such virtual server '%s'", conf->ocsp.cache_server);
-			goto error;
-		}
-
-		if (fr_tls_ocsp_state_cache_compile(&conf->ocsp.cache, vs->server_cs) < 0) goto error;
-	}
-
-	if (conf->staple.cache_server) {
-		virtual_server_t const *vs;
-
-		vs = virtual_server_find(conf->staple.cache_server);
-		if (!vs) {
-			ERROR("No such virtual server '%s'", conf->staple.cache_server);
-			goto error;
-		}
-
-		if (fr_tls_ocsp_staple_cache_compile(&conf->staple.cache, vs->server_cs) < 0) goto error;
-	}
-#endif
-
 #ifdef HAVE_OPENSSL_OCSP_H
 	/*
 	 *	@fixme:  This is all pretty terrible.
@@ -67,6 +49,22 @@ static conf_parser_t ocsp_config[] = {
 		conf->staple.store = conf_ocsp_revocation_store(conf);
 		if (conf->staple.store == NULL) goto error;
 	}
+
+	/*
+	 *	Responses shared between requests checking
+	 *	the same certificate.
+	 */
+	if (conf->ocsp.enable && conf->ocsp.cache_size) {
+		conf->ocsp.response_cache = fr_tls_ocsp_cache_alloc(conf, conf->ocsp.cache_size,
+								    conf->ocsp.cache_max_ttl);
+		if (!conf->ocsp.response_cache) goto error;
+	}
+
+	if (conf->staple.enable && conf->staple.cache_size) {
+		conf->staple.response_cache = fr_tls_ocsp_cache_alloc(conf, conf->staple.cache_size,
+								      conf->staple.cache_max_ttl);
+		if (!conf->staple.response_cache) goto error;
+	}
 #endif /*HAVE_OPENSSL_OCSP_H*/
 
 
@@ -0,0 +1,18 @@
+#
+#  Not a module.  The OCSP checks are called from the TLS code, so
+#  they're built as a library for it to link against.
+#
+TARGETNAME	:= libfreeradius-ocsp
+
+ifneq ($(OPENSSL_LIBS),)
+TARGET		:= $(TARGETNAME)$(L)
+endif
+
+SOURCES		:= \
+	cache.c \
+	ocsp.c
+
+TGT_PREREQS	:= libfreeradius-tls$(L) libfreeradius-unlang$(L) libfreeradius-server$(L) libfreeradius-util$(L)
+
+TGT_LDLIBS	:= $(LIBS) $(OPENSSL_LIBS) $(GPERFTOOLS_LIBS)
+TGT_LDFLAGS	:= $(OPENSSL_FLAGS) $(GPERFTOOLS_LDFLAGS)
@@ -26,24 +26,47 @@ RCSID("$Id$")
 USES_APPLE_DEPRECATED_API	/* OpenSSL API has been deprecated by Apple */
 
 #ifdef WITH_TLS
-#undef HAVE_OPENSSL_OCSP_H
 #ifdef HAVE_OPENSSL_OCSP_H
 #define LOG_PREFIX "tls - ocsp"
 
-#include <freeradius-devel/server/module_rlm.h>
+#include <freeradius-devel/server/base.h>
 #include <freeradius-devel/server/pair.h>
 #include <freeradius-devel/util/debug.h>
 
 #include <freeradius-devel/util/misc.h>
 
-#include <freeradius-devel/unlang/compile.h>
+#include <freeradius-devel/unlang/interpret.h>
 
 #include <freeradius-devel/tls/openssl_user_macros.h>
 #include <openssl/ocsp.h>
 
-#include "attrs.h"
-#include "base.h"
-#include "log.h"
+#include <openssl/async.h>
+
+#include <freeradius-devel/tls/base.h>
+#include <freeradius-devel/tls/log.h>
+#include <freeradius-devel/tls/utils.h>
+
+#include "ocsp.h"
+
+static fr_dict_t const *dict_freeradius;
+
+extern fr_dict_autoload_t ocsp_dict[];
+fr_dict_autoload_t ocsp_dict[] = {
+	{ .out = &dict_freeradius, .proto = "freeradius" },
+	{ NULL }
+};
+
+static fr_dict_attr_t const *attr_tls_ocsp_cert_valid;
+static fr_dict_attr_t const *attr_tls_ocsp_next_update;
+static fr_dict_attr_t const *attr_tls_ocsp_response;
+
+extern fr_dict_attr_autoload_t ocsp_dict_attr[];
+fr_dict_attr_autoload_t ocsp_dict_attr[] = {
+	{ .out = &attr_tls_ocsp_cert_valid, .name = "TLS-OCSP-Cert-Valid", .type = FR_TYPE_UINT32, .dict = &dict_freeradius },
+	{ .out = &attr_tls_ocsp_next_update, .name = "TLS-OCSP-Next-Update", .type = FR_TYPE_UINT32, .dict = &dict_freeradius },
+	{ .out = &attr_tls_ocsp_response, .name = "TLS-OCSP-Response", .type = FR_TYPE_OCTETS, .dict = &dict_freeradius },
+	{ NULL }
+};
 
 /** Rcodes returned by the OCSP check function
  */
@@ -142,7 +165,7 @@ static int ocsp_staple_from_pair(request_t *request, SSL *ssl, fr_pair_t *vp)
 static int ocsp_staple_to_pair(fr_pair_t **out, request_t *request, OCSP_RESPONSE *resp)
 {
 	fr_pair_t	*vp;
-	size_t		len;
+	int		len;
 	uint8_t		*p;
 
 	if (!resp) {
@@ -185,7 +208,7 @@ DIAG_OFF(used-but-marked-unused)	/* fix spurious warnings for sk macros */
 int fr_tls_ocsp_staple_cb(SSL *ssl, void *data)
 {
 	fr_tls_ocsp_conf_t	*conf = data;	/* Alloced as part of fr_tls_conf_t (not talloced) */
-	request_t		*request = fr_tls_session_request(tls_session);
+	request_t		*request = fr_tls_session_request(ssl);
 
 	X509			*cert;
 	X509			*issuer_cert;
@@ -206,14 +229,11 @@ int fr_tls_ocsp_staple_cb(SSL *ssl, void *data)
 		return conf->softfail ? SSL_TLSEXT_ERR_NOACK : SSL_TLSEXT_ERR_ALERT_FATAL;
 	}
 
-	server_store = SSL_CTX_get_cert_store(SSL_get_SSL_CTX(ssl));
-	if (!server_store) {
+	if (!SSL_CTX_get_cert_store(SSL_get_SSL_CTX(ssl))) {
 		fr_tls_log(request, "Failed retrieving SSL session cert store");
 		goto error;
 	}
 
-	if (SSL_get0_chain_certs(ssl, &our_chain) == 0) {
-
 	/*
 	 *	Ignore the return code for older versions of
 	 *	OpenSSL.
@@ -222,7 +242,6 @@ int fr_tls_ocsp_staple_cb(SSL *ssl, void *data)
 	 */
 	(void)SSL_get0_chain_certs(ssl, &our_chain);
 	if (!our_chain) {
-#endif
 		fr_tls_log(request, "Failed retrieving chain certificates from current SSL session");
 		goto error;
 	}
@@ -335,6 +354,322 @@ int fr_tls_ocsp_staple_cb(SSL *ssl, void *data)
 DIAG_ON(used-but-marked-unused)
 DIAG_ON(DIAG_UNKNOWN_PRAGMAS)
 
+/** State of a request to an OCSP responder
+ *
+ */
+typedef struct {
+	request_t		*request;		//!< Request the response is being fetched for.
+	fr_event_list_t		*el;			//!< Event list the socket is registered with.
+	fr_event_timer_t const	*ev;			//!< Timeout for the request.
+
+	BIO			*conn;			//!< Connection to the responder.
+	int			fd;			//!< Socket of the connection, -1 if not registered.
+	OSSL_HTTP_REQ_CTX	*ctx;			//!< HTTP request state.
+
+	OCSP_RESPONSE		*resp;			//!< Response received from the responder.
+	int			rc;			//!< Last value returned by OSSL_HTTP_REQ_CTX_nbio_d2i.
+	bool			timeout;		//!< Request timed out.
+	bool			done;			//!< Request completed (successfully or not).
+} ocsp_fetch_t;
+
+/** Whether we're running in an async job that can be paused
+ *
+ */
+static inline bool ocsp_can_pause(SSL *ssl)
+{
+	return ASYNC_get_current_job() && fr_tls_session(ssl)->can_pause;
+}
+
+/** Pause the current async job until an event marks the request as runnable
+ *
+ * SSL_read() returns SSL_ERROR_WANT_ASYNC, and the request yields
+ * until it's resumed.
+ *
+ * @param[in] request	the handshake is running for.
+ * @param[in] ssl	session to pause.
+ * @param[in] done	Set when the event has occurred.
+ * @return
+ *	- 0 when done has been set.
+ *	- -1 if the request was cancelled.
+ */
+static int ocsp_async_wait(request_t *request, SSL *ssl, bool const *done)
+{
+	fr_tls_session_t *tls_session = fr_tls_session(ssl);
+
+	while (!*done) {
+		tls_session->async_wait = true;
+		ASYNC_pause_job();
+		tls_session->async_wait = false;
+
+		if (!tls_session->can_pause || unlang_request_is_cancelled(request)) return -1;
+	}
+
+	return 0;
+}
+
+/** Progress the HTTP request without blocking
+ *
+ * @return
+ *	- 1 if the response has been received.
+ *	- 0 on error.
+ *	- -1 if we need to wait for the socket.
+ */
+static inline int ocsp_fetch_nbio(ocsp_fetch_t *fetch)
+{
+	return OSSL_HTTP_REQ_CTX_nbio_d2i(fetch->ctx, (ASN1_VALUE **)&fetch->resp, ASN1_ITEM_rptr(OCSP_RESPONSE));
+}
+
+static void ocsp_fetch_finish(ocsp_fetch_t *fetch)
+{
+	if (fetch->fd >= 0) {
+		(void) fr_event_fd_delete(fetch->el, fetch->fd, FR_EVENT_FILTER_IO);
+		fetch->fd = -1;
+	}
+	if (fetch->ev) fr_event_timer_delete(&fetch->ev);
+
+	fetch->done = true;
+	unlang_interpret_mark_runnable(fetch->request);
+}
+
+static void _ocsp_fetch_io(UNUSED fr_event_list_t *el, int fd, UNUSED int flags, void *uctx);
+
+/** Register interest in the socket events the HTTP request needs to progress
+ *
+ */
+static int ocsp_fetch_io_register(ocsp_fetch_t *fetch)
+{
+	return fr_event_fd_insert(fetch, NULL, fetch->el, fetch->fd,
+				  BIO_should_write(fetch->conn) ? NULL : _ocsp_fetch_io,
+				  BIO_should_write(fetch->conn) ? _ocsp_fetch_io : NULL,
+				  NULL, fetch);
+}
+
+static void _ocsp_fetch_io(UNUSED fr_event_list_t *el, UNUSED int fd, UNUSED int flags, void *uctx)
+{
+	ocsp_fetch_t *fetch = talloc_get_type_abort(uctx, ocsp_fetch_t);
+
+	fetch->rc = ocsp_fetch_nbio(fetch);
+	if ((fetch->rc == -1) && BIO_should_retry(fetch->conn)) {
+		if (ocsp_fetch_io_register(fetch) == 0) return;
+		fetch->rc = 0;
+	}
+
+	ocsp_fetch_finish(fetch);
+}
+
+static void _ocsp_fetch_timeout(UNUSED fr_event_list_t *el, UNUSED fr_time_t now, void *uctx)
+{
+	ocsp_fetch_t *fetch = talloc_get_type_abort(uctx, ocsp_fetch_t);
+
+	fetch->ev = NULL;
+	fetch->timeout = true;
+	ocsp_fetch_finish(fetch);
+}
+
+static int _ocsp_fetch_free(ocsp_fetch_t *fetch)
+{
+	if (fetch->fd >= 0) (void) fr_event_fd_delete(fetch->el, fetch->fd, FR_EVENT_FILTER_IO);
+	OSSL_HTTP_REQ_CTX_free(fetch->ctx);
+	BIO_free_all(fetch->conn);
+	OCSP_RESPONSE_free(fetch->resp);
+
+	return 0;
+}
+
+/** Send an OCSP request to a responder, and wait for the response
+ *
+ * If we're in a part of the handshake which can be paused, the socket is
+ * serviced by the request's event loop, and the request yields until the
+ * response is received.  Otherwise we block until the response is received,
+ * or the timeout expires.
+ *
+ * @param[in] request	the response is being fetched for.
+ * @param[in] ssl	session being validated.
+ * @param[in] conf	OCSP configuration.
+ * @param[in] req	OCSP request to send.
+ * @param[in] host	of the responder.
+ * @param[in] port	of the responder.
+ * @param[in] path	to send the request to.
+ * @return
+ *	- The response.
+ *	- NULL on error.
+ */
+static OCSP_RESPONSE *ocsp_fetch(request_t *request, SSL *ssl, fr_tls_ocsp_conf_t *conf, OCSP_REQUEST *req,
+				 char const *host, char const *port, char const *path)
+{
+	ocsp_fetch_t	*fetch;
+	OCSP_RESPONSE	*resp = NULL;
+	char		host_header[1024];
+
+	/* Check host and port length are sane, then create Host: HTTP header */
+	if ((strlen(host) + strlen(port) + 2) > sizeof(host_header)) {
+		RWDEBUG("Host and port too long");
+		return NULL;
+	}
+	snprintf(host_header, sizeof(host_header), "%s:%s", host, port);
+
+	MEM(fetch = talloc_zero(request, ocsp_fetch_t));
+	fetch->request = request;
+	fetch->el = unlang_interpret_event_list(request);
+	fetch->fd = -1;
+	talloc_set_destructor(fetch, _ocsp_fetch_free);
+
+	/* Setup BIO socket to OCSP responder */
+	fetch->conn = BIO_new_connect(host);
+	if (!fetch->conn) {
+		REDEBUG("Couldn't create connection to OCSP responder");
+		goto finish;
+	}
+	BIO_set_conn_port(fetch->conn, port);
+	BIO_set_nbio(fetch->conn, 1);
+
+	if ((BIO_do_connect(fetch->conn) <= 0) && !BIO_should_retry(fetch->conn)) {
+		REDEBUG("Couldn't connect to OCSP responder");
+		goto finish;
+	}
+
+	fetch->ctx = OCSP_sendreq_new(fetch->conn, path, NULL, -1);
+	if (!fetch->ctx) {
+		REDEBUG("Couldn't create OCSP request");
+		goto finish;
+	}
+
+	if (!OSSL_HTTP_REQ_CTX_add1_header(fetch->ctx, "Host", host_header)) {
+		REDEBUG("Couldn't set Host header");
+		goto finish;
+	}
+
+	if (!OSSL_HTTP_REQ_CTX_set1_req(fetch->ctx, "application/ocsp-request",
+					ASN1_ITEM_rptr(OCSP_REQUEST), (ASN1_VALUE const *)req)) {
+		REDEBUG("Couldn't add data to OCSP request");
+		goto finish;
+	}
+
+	fetch->rc = ocsp_fetch_nbio(fetch);
+	if ((fetch->rc != -1) || !BIO_should_retry(fetch->conn)) goto done;
+
+	/*
+	 *	Can't pause, so block until the response
+	 *	arrives, or we run out of time.
+	 */
+	if (!fetch->el || !ocsp_can_pause(ssl)) {
+		time_t max_time = conf->timeout ? time(NULL) + conf->timeout : 0;
+
+		do {
+			if (BIO_wait(fetch->conn, max_time, 100) <= 0) {
+				fetch->timeout = true;
+				break;
+			}
+			fetch->rc = ocsp_fetch_nbio(fetch);
+		} while ((fetch->rc == -1) && BIO_should_retry(fetch->conn));
+		goto done;
+	}
+
+	/*
+	 *	Let the event loop service the socket, and
+	 *	yield the request until the response arrives.
+	 */
+	if (BIO_get_fd(fetch->conn, &fetch->fd) < 0) {
+		REDEBUG("Couldn't get OCSP responder socket");
+		fetch->fd = -1;
+		goto finish;
+	}
+
+	if (ocsp_fetch_io_register(fetch) < 0) {
+		RPEDEBUG("Failed inserting OCSP responder socket into event loop");
+		fetch->fd = -1;
+		goto finish;
+	}
+
+	if (conf->timeout &&
+	    (fr_event_timer_in(fetch, fetch->el, &fetch->ev, fr_time_delta_from_sec(conf->timeout),
+			       _ocsp_fetch_timeout, fetch) < 0)) {
+		RPEDEBUG("Failed inserting OCSP request timeout");
+		goto finish;
+	}
+
+	RDEBUG3("Yielding until OCSP response is received");
+	if (ocsp_async_wait(request, ssl, &fetch->done) < 0) {
+		REDEBUG("Cancelled waiting for OCSP response");
+		goto finish;
+	}
+
+done:
+	if (fetch->timeout) {
+		REDEBUG("Response timed out");
+	} else if (fetch->rc != 1) {
+		REDEBUG("Couldn't get OCSP response");
+	} else {
+		resp = fetch->resp;
+		fetch->resp = NULL;
+	}
+
+finish:
+	talloc_free(fetch);
+
+	return resp;
+}
+
+/** Find a response in the shared cache, or wait for another request to fetch it
+ *
+ * @param[out] out	Where to write the response.
+ * @param[out] leader	Set to true if we're responsible for fetching the response,
+ *			and calling #fr_tls_ocsp_cache_complete.
+ * @param[in] request	the response is needed for.
+ * @param[in] ssl	session being validated.
+ * @param[in] cache	to search in.
+ * @param[in] key	DER encoded CertID.
+ * @param[in] key_len	Length of the CertID.
+ * @return
+ *	- 1 if a response was found.
+ *	- 0 if the caller should fetch the response.
+ *	- -1 if no response is available.
+ */
+static int ocsp_response_cache_find(OCSP_RESPONSE **out, bool *leader, request_t *request, SSL *ssl,
+				    fr_tls_ocsp_cache_t *cache, uint8_t const *key, size_t key_len)
+{
+	fr_tls_ocsp_cache_waiter_t	*waiter = NULL;
+	uint8_t				*der = NULL;
+	size_t				der_len = 0;
+	uint8_t const			*p;
+
+	*out = NULL;
+	*leader = false;
+
+	if (ocsp_can_pause(ssl)) waiter = fr_tls_ocsp_cache_waiter_alloc(request, request);
+
+	switch (fr_tls_ocsp_cache_lookup(request, &der, &der_len, cache, key, key_len, waiter)) {
+	case FR_TLS_OCSP_CACHE_HIT:
+		RDEBUG2("Using cached OCSP response");
+		p = der;
+		*out = d2i_OCSP_RESPONSE(NULL, &p, der_len);
+		talloc_free(der);
+		break;
+
+	case FR_TLS_OCSP_CACHE_FETCH:
+		*leader = true;
+		FALL_THROUGH;
+
+	case FR_TLS_OCSP_CACHE_MISS:
+		talloc_free(waiter);
+		return 0;
+
+	case FR_TLS_OCSP_CACHE_WAIT:
+		RDEBUG2("Waiting for in-progress OCSP request for the same certificate");
+		if (ocsp_async_wait(request, ssl, &waiter->done) < 0) break;
+		if (!waiter->resp) {
+			REDEBUG("In-progress OCSP request failed");
+			break;
+		}
+		p = waiter->resp;
+		*out = d2i_OCSP_RESPONSE(NULL, &p, waiter->resp_len);
+		break;
+	}
+	talloc_free(waiter);
+
+	return *out ? 1 : -1;
+}
+
 /** Sends a OCSP request to a defined OCSP responder
  *
  */
@@ -349,44 +684,20 @@ int fr_tls_ocsp_check(request_t *request, SSL *ssl,
 	char		*host = NULL;
 	char		*port = NULL;
 	char		*path = NULL;
-	char		host_header[1024];
 	int		use_ssl = -1;
 	long		this_fudge = OCSP_MAX_VALIDITY_PERIOD, this_max_age = -1;
-	BIO		*conn = NULL, *ssl_log = NULL;
+	BIO		*log_bio;
 	ocsp_status_t   ocsp_status = OCSP_STATUS_FAILED;
-	ocsp_status_t	status;
+	int		resp_status, status;
 	ASN1_GENERALIZEDTIME *rev, *this_update, *next_update;
 	int		reason;
-	OCSP_REQ_CTX	*ctx;
-	int		rc;
-
-	fr_time_t	start;
-	fr_pair_t	*vp;
-
-	if (conf->cache_server) {
-		rlm_rcode_t rcode;
 
-		fr_tls_cache_process(&rcode, request, conf->cache.load);
-		switch (rcode) {
-		case RLM_MODULE_REJECT:
-			REDEBUG("Told to force OCSP validation failure from cached response");
-			return OCSP_STATUS_FAILED;
-
-		case RLM_MODULE_OK:
-		case RLM_MODULE_UPDATED:
-		/*
-		 *	These are fine for OCSP too, we don't *expect* to always
-		 *	have a cached OCSP status.
-		 */
-		case RLM_MODULE_NOTFOUND:
-		case RLM_MODULE_NOOP:
-			break;
+	uint8_t		*cache_key = NULL;
+	int		cache_key_len = 0;
+	bool		cache_leader = false;
+	fr_time_t	cache_expires = fr_time_wrap(0);
 
-		default:
-			RWDEBUG("Failed retrieving cached OCSP status");
-			break;
-		}
-	}
+	fr_pair_t	*vp;
 
 	/*
 	 *	Allow us to cache the OCSP verified state externally
@@ -432,16 +743,6 @@ int fr_tls_ocsp_check(request_t *request, SSL *ssl,
 		goto skipped;
 	}
 
-	/*
-	 *	Setup logging for this OCSP operation
-	 */
-	ssl_log = BIO_new(BIO_s_mem());
-	if (!ssl_log) {
-		REDEBUG("Failed creating log queue");
-		ocsp_status = OCSP_STATUS_SKIPPED;
-		goto finish;
-	}
-
 	/*
 	 *	Create OCSP Request
 	 */
@@ -450,6 +751,29 @@ int fr_tls_ocsp_check(request_t *request, SSL *ssl,
 	OCSP_request_add0_id(req, certid);
 	if (conf->use_nonce) OCSP_request_add1_nonce(req, NULL, 8);
 
+	/*
+	 *	Responses are shared between requests for the
+	 *	same certificate, unless they include a nonce
+	 *	specific to one request.
+	 */
+	if (conf->response_cache && !conf->use_nonce) {
+		cache_key_len = i2d_OCSP_CERTID(certid, &cache_key);
+		if (cache_key_len > 0) {
+			switch (ocsp_response_cache_find(&resp, &cache_leader, request, ssl, conf->response_cache,
+							 cache_key, cache_key_len)) {
+			case 1:
+				goto check_response;
+
+			case 0:
+				break;
+
+			default:
+				ocsp_status = OCSP_STATUS_SKIPPED;
+				goto finish;
+			}
+		}
+	}
+
 	/*
 	 *	Send OCSP Request and get OCSP Response
 	 */
@@ -491,89 +815,39 @@ int fr_tls_ocsp_check(request_t *request, SSL *ssl,
 
 	RDEBUG2("Using responder URL \"http://%s:%s%s\"", host, port, path);
 
-	/* Check host and port length are sane, then create Host: HTTP header */
-	if ((strlen(host) + strlen(port) + 2) > sizeof(host_header)) {
-		RWDEBUG("Host and port too long");
-		goto skipped;
-	}
-	snprintf(host_header, sizeof(host_header), "%s:%s", host, port);
-
-	/* Setup BIO socket to OCSP responder */
-	conn = BIO_new_connect(host);
-	BIO_set_conn_port(conn, port);
-
-	if (conf->timeout) BIO_set_nbio(conn, 1);
-
-	rc = BIO_do_connect(conn);
-	if ((rc <= 0) && ((!conf->timeout) || !BIO_should_retry(conn))) {
-		REDEBUG("Couldn't connect to OCSP responder");
-		ocsp_status = OCSP_STATUS_SKIPPED;
-		goto finish;
-	}
-
-	ctx = OCSP_sendreq_new(conn, path, NULL, -1);
-	if (!ctx) {
-		REDEBUG("Couldn't create OCSP request");
-		ocsp_status = OCSP_STATUS_SKIPPED;
-		goto finish;
-	}
-
-	if (!OCSP_REQ_CTX_add1_header(ctx, "Host", host_header)) {
-		REDEBUG("Couldn't set Host header");
-		ocsp_status = OCSP_STATUS_SKIPPED;
-		goto finish;
-	}
-
-	if (!OCSP_REQ_CTX_set1_req(ctx, req)) {
-		REDEBUG("Couldn't add data to OCSP request");
-		ocsp_status = OCSP_STATUS_SKIPPED;
-		goto finish;
-	}
-
-	start = fr_time();
-	do {
-		rc = OCSP_sendreq_nbio(&resp, ctx);
-		if (conf->timeout) {
-			if (conf->timeout > (fr_time() - start)) break;
-		}
-	} while ((rc == -1) && BIO_should_retry(conn));
-
-	if (conf->timeout && (rc == -1) && BIO_should_retry(conn)) {
-		REDEBUG("Response timed out");
-		ocsp_status = OCSP_STATUS_SKIPPED;
-		goto finish;
-	}
-
-	OCSP_REQ_CTX_free(ctx);
-
-	if (rc == 0) {
-		REDEBUG("Couldn't get OCSP response");
-		FR_OPENSSL_DRAIN_ERROR_QUEUE(REDEBUG, "", ssl_log);
+	resp = ocsp_fetch(request, ssl, conf, req, host, port, path);
+	if (!resp) {
+		fr_tls_log(request, "Failed fetching OCSP response");
 		ocsp_status = OCSP_STATUS_SKIPPED;
 		goto finish;
 	}
 
+check_response:
 	/* Verify OCSP response status */
-	status = OCSP_response_status(resp);
-	if (status != OCSP_RESPONSE_STATUS_SUCCESSFUL) {
-		REDEBUG("Response status: %s", OCSP_response_status_str(status));
+	resp_status = OCSP_response_status(resp);
+	if (resp_status != OCSP_RESPONSE_STATUS_SUCCESSFUL) {
+		REDEBUG("Response status: %s", OCSP_response_status_str(resp_status));
 		goto finish;
 	}
 	bresp = OCSP_response_get1_basic(resp);
+	if (!bresp) {
+		REDEBUG("Response doesn't contain a basic response");
+		goto finish;
+	}
 	if (conf->use_nonce && OCSP_check_nonce(req, bresp) != 1) {
 		REDEBUG("Response has wrong nonce value");
 		goto finish;
 	}
-       
+
 	if (conf->verifycert) {
 		if (OCSP_basic_verify(bresp, NULL, store, 0) != 1){
-			REDEBUG("Couldn't verify OCSP basic response");
+			fr_tls_log(request, "Couldn't verify OCSP basic response");
 			goto finish;
 		}
-        }
+	}
 
 	/*	Verify OCSP cert status */
-	if (!OCSP_resp_find_status(bresp, certid, (int *)&status, &reason, &rev, &this_update, &next_update)) {
+	if (!OCSP_resp_find_status(bresp, certid, &status, &reason, &rev, &this_update, &next_update)) {
 		REDEBUG("No Status found");
 		goto finish;
 	}
@@ -592,29 +866,28 @@ int fr_tls_ocsp_check(request_t *request, SSL *ssl,
 		 *	We want this to show up in the global log
 		 *	so someone will fix it...
 		 */
-		RATE_LIMIT_GLOBAL(RERROR, "Delta +/- between OCSP response time and our time is greater than %li "
-				  "seconds.  Check servers are synchronised to a common time source",
-				  this_fudge);
-		FR_OPENSSL_DRAIN_ERROR_QUEUE(REDEBUG, "", ssl_log);
+		RATE_LIMIT_GLOBAL_ROPTIONAL(RERROR, ERROR,
+					    "Delta +/- between OCSP response time and our time is greater than %li "
+					    "seconds.  Check servers are synchronised to a common time source",
+					    this_fudge);
+		fr_tls_log(request, "OCSP response validity check failed");
 		goto finish;
 	}
 
-	/*
-	 *	Print any messages we may have accumulated
-	 */
-	FR_OPENSSL_DRAIN_ERROR_QUEUE(RDEBUG2, "", ssl_log);
-	if (RDEBUG_ENABLED) {
+	if (RDEBUG_ENABLED2) {
 		RDEBUG2("OCSP response valid from:");
-		ASN1_GENERALIZEDTIME_print(ssl_log, this_update);
 		RINDENT();
-		FR_OPENSSL_DRAIN_LOG_QUEUE(RDEBUG2, "", ssl_log);
+		log_bio = fr_tls_request_log_bio(request, L_DBG, L_DBG_LVL_2);
+		ASN1_GENERALIZEDTIME_print(log_bio, this_update);
+		BIO_puts(log_bio, "\n");
 		REXDENT();
 
 		if (next_update) {
 			RDEBUG2("New information available at:");
-			ASN1_GENERALIZEDTIME_print(ssl_log, next_update);
 			RINDENT();
-			FR_OPENSSL_DRAIN_LOG_QUEUE(RDEBUG2, "", ssl_log);
+			log_bio = fr_tls_request_log_bio(request, L_DBG, L_DBG_LVL_2);
+			ASN1_GENERALIZEDTIME_print(log_bio, next_update);
+			BIO_puts(log_bio, "\n");
 			REXDENT();
 		}
 	}
@@ -638,6 +911,12 @@ int fr_tls_ocsp_check(request_t *request, SSL *ssl,
 			ocsp_status = OCSP_STATUS_SKIPPED;
 			goto finish;
 		}
+		/*
+		 *	The response is valid, it can be shared
+		 *	with other requests until it needs refreshing.
+		 */
+		if (cache_leader) cache_expires = fr_tls_ocsp_cache_expires(conf->response_cache, fr_time_from_sec(next));
+
 		if (fr_time_to_sec(now) < next){
 			RDEBUG2("Adding OCSP TTL attribute");
 
@@ -664,15 +943,12 @@ int fr_tls_ocsp_check(request_t *request, SSL *ssl,
 		REDEBUG("Cert status: %s", OCSP_cert_status_str(status));
 		if (reason != -1) REDEBUG("Reason: %s", OCSP_crl_reason_str(reason));
 
-		/*
-		 *	Print any messages we may have accumulated
-		 */
-		FR_OPENSSL_DRAIN_LOG_QUEUE(RDEBUG, "", ssl_log);
-		if (RDEBUG_ENABLED2) {
+		if (rev && RDEBUG_ENABLED2) {
 			RDEBUG2("Revocation time:");
-			ASN1_GENERALIZEDTIME_print(ssl_log, rev);
 			RINDENT();
-			FR_OPENSSL_DRAIN_LOG_QUEUE(RDEBUG2, "", ssl_log);
+			log_bio = fr_tls_request_log_bio(request, L_DBG, L_DBG_LVL_2);
+			ASN1_GENERALIZEDTIME_print(log_bio, rev);
+			BIO_puts(log_bio, "\n");
 			REXDENT();
 		}
 		break;
@@ -694,7 +970,10 @@ finish:
 			 *	Set the stapled response for the current
 			 *	SSL session.
 			 */
-			if (ocsp_staple_from_pair(request, ssl, vp) < 0) return -1;
+			if (ocsp_staple_from_pair(request, ssl, vp) < 0) {
+				ocsp_status = OCSP_STATUS_FAILED;
+				break;
+			}
 			vp = NULL;	/* It's in the request, don't need to free it! */
 		}
 
@@ -706,7 +985,6 @@ finish:
 
 	case OCSP_STATUS_SKIPPED:
 	skipped:
-		FR_OPENSSL_DRAIN_ERROR_QUEUE(RWDEBUG, "", ssl_log);
 		MEM(pair_update_request(&vp, attr_tls_ocsp_cert_valid) >= 0);
 		vp->vp_uint32 = 2;	/* skipped */
 		if (conf->softfail) {
@@ -726,27 +1004,27 @@ finish:
 		break;
 
 	default:
-		FR_OPENSSL_DRAIN_ERROR_QUEUE(REDEBUG, "", ssl_log);
+		fr_tls_log(request, "OCSP check failed");
 		MEM(pair_update_request(&vp, attr_tls_ocsp_cert_valid) >= 0);
 		vp->vp_uint32 = 0;	/* no */
 		REDEBUG("Failed to validate certificate");
 		break;
 	}
 
-	if (conf->cache_server) {
-		rlm_rcode_t rcode;
-
-		fr_tls_cache_process(&rcode, request, conf->cache.store);
-		switch (rcode) {
-		case RLM_MODULE_OK:
-		case RLM_MODULE_UPDATED:
-			break;
+	/*
+	 *	Give the response to any requests waiting
+	 *	for it, and cache it if it's valid.
+	 */
+	if (cache_leader) {
+		uint8_t	*der = NULL;
+		int	der_len = resp ? i2d_OCSP_RESPONSE(resp, &der) : 0;
 
-		default:
-			RWDEBUG("Failed writing cached OCSP status");
-			break;
-		}
+		fr_tls_ocsp_cache_complete(conf->response_cache, cache_key, cache_key_len,
+					   (der_len > 0) ? der : NULL, (der_len > 0) ? der_len : 0, cache_expires);
+		OPENSSL_free(der);
 	}
+	OPENSSL_free(cache_key);
+
 	/* Free OCSP Stuff */
 	OCSP_REQUEST_free(req);
 	OCSP_BASICRESP_free(bresp);
@@ -754,77 +1032,35 @@ finish:
 	OPENSSL_free(host);
 	OPENSSL_free(port);
 	OPENSSL_free(path);
-	BIO_free_all(conn);
-	BIO_free(ssl_log);
 
 	return ocsp_status;
 }
 
-#define CACHE_SECTION(_out, _verb, _name) \
-do { \
-	CONF_SECTION *_tmp; \
-	_tmp = cf_section_find(server_cs, _verb, _name); \
-	if (_tmp) { \
-		if (unlang_compile(_tmp, MOD_AUTHORIZE, NULL, NULL) < 0) return -1; \
-		found = true; \
-	} \
-	if (actions) _out = _tmp; \
-} while (0)
-
-/** Pre-compile unlang cache actions and store pointers to them
+/** Resolve the attributes used to control and report on OCSP checks
  *
- * @param[out] actions		Structure to hold pointers to actions.
- * @param[in] server_cs		to lookup actions for.
  * @return
- *	- -1 on failure.
  *	- 0 on success.
+ *	- -1 on failure.
  */
-int fr_tls_ocsp_state_cache_compile(fr_tls_cache_t *actions, CONF_SECTION *server_cs)
+int fr_tls_ocsp_dict_init(void)
 {
-	bool found = false;
-
-	if (!fr_cond_assert(server_cs)) return -1;
-
-	CACHE_SECTION(actions->load, "load", "ocsp-state");
-	CACHE_SECTION(actions->store, "store", "ocsp-state");
+	if (fr_dict_autoload(ocsp_dict) < 0) {
+		PERROR("Failed initialising protocol library");
+		return -1;
+	}
 
-	/*
-	 *	Warn if we couldn't find any actions.
-	 */
-	if (!found) {
-		cf_log_warn(server_cs, "No ocsp-state cache actions found in virtual server \"%s\"",
-			    cf_section_name2(server_cs));
+	if (fr_dict_attr_autoload(ocsp_dict_attr) < 0) {
+		PERROR("Failed resolving attributes");
+		fr_dict_autofree(ocsp_dict);
+		return -1;
 	}
 
 	return 0;
 }
 
-/** Pre-compile unlang cache actions and store pointers to them
- *
- * @param[out] actions		Structure to hold pointers to actions.
- * @param[in] server_cs		to lookup actions for.
- * @return
- *	- -1 on failure.
- *	- 0 on success.
- */
-int fr_tls_ocsp_staple_cache_compile(fr_tls_cache_t *actions, CONF_SECTION *server_cs)
+void fr_tls_ocsp_dict_free(void)
 {
-	bool found = false;
-
-	if (!fr_cond_assert(server_cs)) return -1;
-
-	CACHE_SECTION(actions->load, "load", "ocsp-staple");
-	CACHE_SECTION(actions->store, "store", "ocsp-staple");
-
-	/*
-	 *	Warn if we couldn't find any actions.
-	 */
-	if (!found) {
-		cf_log_warn(server_cs, "No ocsp-staple cache actions found in virtual server \"%s\"",
-			    cf_section_name2(server_cs));
-	}
-
-	return 0;
+	fr_dict_autofree(ocsp_dict);
 }
 #endif /* HAVE_OPENSSL_OCSP_H */
 #endif /* WITH_TLS */
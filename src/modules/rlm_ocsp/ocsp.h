@@ -1,9 +1,46 @@
+#pragma once
+/*
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+/**
+ * $Id$
+ *
+ * @file rlm_ocsp/ocsp.h
+ * @brief Validate client certificates using an OCSP service.
+ *
+ * @copyright 2006-2016 The FreeRADIUS server project
+ */
+RCSIDH(ocsp_h, "$Id$")
+
+#include <freeradius-devel/tls/openssl_user_macros.h>
+#include <freeradius-devel/server/request.h>
+
+#include <openssl/ssl.h>
+
+#include "cache.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 /** OCSP Configuration
  *
  */
 typedef struct {
 	bool		enable;				//!< Enable OCSP checks
-	char const	*cache_server;			//!< Virtual server to restore retrieved OCSP status.
 	bool		override_url;			//!< Always use the configured OCSP URL even if the
 							//!< certificate contains one.
 	char const	*url;
@@ -13,27 +50,21 @@ typedef struct {
 	bool		softfail;
 	bool		verifycert;
 
-
-	fr_tls_cache_t	cache;				//!< Cached cache section pointers.  Means we don't have
-							///< to look them up at runtime.
+	uint32_t	cache_size;			//!< Maximum number of responses to share between requests.
+	fr_time_delta_t	cache_max_ttl;			//!< Maximum time a response is shared for.
+	fr_tls_ocsp_cache_t *response_cache;		//!< Responses shared between requests.
 } fr_tls_ocsp_conf_t;
 
-#ifdef HAVE_OPENSSL_OCSP_H
-	fr_tls_ocsp_conf_t	ocsp;			//!< Configuration for validating client certificates
-							//!< with ocsp.
-	fr_tls_ocsp_conf_t	staple;			//!< Configuration for validating server certificates
-							//!< with ocsp.
-#endif
-
-/*
- *	tls/ocsp.c
- */
 int		fr_tls_ocsp_staple_cb(SSL *ssl, void *data);
 
 int		fr_tls_ocsp_check(request_t *request, SSL *ssl,
 			       X509_STORE *store, X509 *issuer_cert, X509 *client_cert,
 			       fr_tls_ocsp_conf_t *conf, bool staple_response);
 
-int		fr_tls_ocsp_state_cache_compile(fr_tls_cache_t *sections, CONF_SECTION *server_cs);
+int		fr_tls_ocsp_dict_init(void);
 
-int		fr_tls_ocsp_staple_cache_compile(fr_tls_cache_t *sections, CONF_SECTION *server_cs);
+void		fr_tls_ocsp_dict_free(void);
+
+#ifdef __cplusplus
+}
+#endif
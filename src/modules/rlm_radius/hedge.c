@@ -0,0 +1,67 @@
+/*
+ *   This program is is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or (at
+ *   your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+/**
+ * $Id$
+ * @file rlm_radius/hedge.c
+ * @brief Response times used to decide when to send a duplicate request
+ *
+ * Samples are either the response time of a request which was only sent
+ * once, or, if there was no reply, how long we waited before retransmitting
+ * or giving up.  Leaving out requests which timed out would make the
+ * percentile look faster than the home server really is.
+ *
+ * @copyright 2024 The FreeRADIUS server project
+ */
+RCSID("$Id$")
+
+#include <freeradius-devel/util/misc.h>
+
+#include "hedge.h"
+
+static int rtt_cmp(void const *one, void const *two)
+{
+	fr_time_delta_t const *a = one, *b = two;
+
+	return CMP(fr_time_delta_unwrap(*a), fr_time_delta_unwrap(*b));
+}
+
+/** Record a response time
+ *
+ * Each time a quarter of the samples have been replaced, the delay
+ * is recalculated.
+ *
+ * @param[in] hg		to record the sample in.
+ * @param[in] percentile	of response times to wait before sending a
+ *				duplicate.  If 0, hedging is disabled, and
+ *				the delay isn't calculated.
+ * @param[in] rtt		response time, or how long we waited for a reply.
+ */
+void radius_hedge_sample(radius_hedge_t *hg, uint32_t percentile, fr_time_delta_t rtt)
+{
+	fr_time_delta_t	sorted[RADIUS_HEDGE_SAMPLES];
+	size_t		num;
+
+	hg->rtt[hg->rtt_count++ % RADIUS_HEDGE_SAMPLES] = rtt;
+
+	if (!percentile || ((hg->rtt_count % (RADIUS_HEDGE_SAMPLES / 4)) != 0)) return;
+
+	num = (hg->rtt_count < RADIUS_HEDGE_SAMPLES) ? hg->rtt_count : RADIUS_HEDGE_SAMPLES;
+	memcpy(sorted, hg->rtt, num * sizeof(sorted[0]));
+	qsort(sorted, num, sizeof(sorted[0]), rtt_cmp);
+
+	hg->delay = sorted[(num * percentile) / 100];
+}
@@ -0,0 +1,37 @@
+#pragma once
+/*
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+/*
+ * $Id$
+ *
+ * @file hedge.h
+ * @brief Response times used to decide when to send a duplicate request
+ *
+ * @copyright 2024 The FreeRADIUS server project
+ */
+#include <freeradius-devel/util/time.h>
+
+#define RADIUS_HEDGE_SAMPLES	64		//!< How many response times we keep.
+
+typedef struct {
+	fr_time_delta_t		rtt[RADIUS_HEDGE_SAMPLES];	//!< Most recent response times, as a ring.
+	uint64_t		rtt_count;			//!< How many response times we've recorded.
+	fr_time_delta_t		delay;				//!< How long to wait for a reply before sending
+								///< a duplicate.  Zero until we have enough samples.
+} radius_hedge_t;
+
+void	radius_hedge_sample(radius_hedge_t *hg, uint32_t percentile, fr_time_delta_t rtt) CC_HINT(nonnull);
@@ -0,0 +1,96 @@
+/** Tests for the hedged request delay
+ *
+ * @file src/modules/rlm_radius/hedge_tests.c
+ *
+ * @copyright 2024 The FreeRADIUS server project
+ */
+#include <freeradius-devel/util/acutest.h>
+#include <freeradius-devel/util/acutest_helpers.h>
+
+#include "hedge.c"
+
+#define MS(_x)	fr_time_delta_from_msec(_x)
+
+/** The delay isn't set until a quarter of the ring has been filled
+ *
+ */
+static void test_hedge_warmup(void)
+{
+	radius_hedge_t	hg = { .rtt_count = 0 };
+	size_t		i;
+
+	for (i = 0; i < (RADIUS_HEDGE_SAMPLES / 4) - 1; i++) {
+		radius_hedge_sample(&hg, 90, MS(10));
+		TEST_CHECK(!fr_time_delta_ispos(hg.delay));
+	}
+
+	radius_hedge_sample(&hg, 90, MS(10));
+	TEST_CHECK(fr_time_delta_eq(hg.delay, MS(10)));
+}
+
+/** With hedging disabled, samples are recorded but no delay is calculated
+ *
+ */
+static void test_hedge_disabled(void)
+{
+	radius_hedge_t	hg = { .rtt_count = 0 };
+	size_t		i;
+
+	for (i = 0; i < RADIUS_HEDGE_SAMPLES; i++) radius_hedge_sample(&hg, 0, MS(10));
+
+	TEST_CHECK(hg.rtt_count == RADIUS_HEDGE_SAMPLES);
+	TEST_CHECK(!fr_time_delta_ispos(hg.delay));
+}
+
+/** The delay is the requested percentile of the samples
+ *
+ */
+static void test_hedge_percentile(void)
+{
+	radius_hedge_t	hg = { .rtt_count = 0 };
+	size_t		i;
+
+	/*
+	 *	1..64ms, in reverse, so sorting matters.
+	 */
+	for (i = 0; i < RADIUS_HEDGE_SAMPLES; i++) radius_hedge_sample(&hg, 50, MS(RADIUS_HEDGE_SAMPLES - i));
+	TEST_CHECK(fr_time_delta_eq(hg.delay, MS(33)));
+	TEST_MSG("Expected 33ms, got %" PRId64 "ms", fr_time_delta_to_msec(hg.delay));
+
+	for (i = 0; i < RADIUS_HEDGE_SAMPLES; i++) radius_hedge_sample(&hg, 95, MS(RADIUS_HEDGE_SAMPLES - i));
+	TEST_CHECK(fr_time_delta_eq(hg.delay, MS(61)));
+	TEST_MSG("Expected 61ms, got %" PRId64 "ms", fr_time_delta_to_msec(hg.delay));
+}
+
+/** Requests which timed out are recorded at their timeout, and push the delay up
+ *
+ * If only replies were recorded, a home server which answers 90% of
+ * requests in 10ms and never answers the rest would get a 95th
+ * percentile of 10ms, and we'd duplicate every slow request almost
+ * immediately.
+ */
+static void test_hedge_timeouts(void)
+{
+	radius_hedge_t	hg = { .rtt_count = 0 };
+	size_t		i;
+
+	for (i = 0; i < RADIUS_HEDGE_SAMPLES; i++) {
+		radius_hedge_sample(&hg, 95, ((i % 10) == 0) ? MS(2000) : MS(10));
+	}
+	TEST_CHECK(fr_time_delta_eq(hg.delay, MS(2000)));
+	TEST_MSG("Expected 2000ms, got %" PRId64 "ms", fr_time_delta_to_msec(hg.delay));
+
+	TEST_CASE("Old samples age out of the ring");
+	for (i = 0; i < RADIUS_HEDGE_SAMPLES; i++) radius_hedge_sample(&hg, 95, MS(10));
+	TEST_CHECK(fr_time_delta_eq(hg.delay, MS(10)));
+	TEST_MSG("Expected 10ms, got %" PRId64 "ms", fr_time_delta_to_msec(hg.delay));
+}
+
+TEST_LIST = {
+	{ "hedge_warmup",	test_hedge_warmup },
+	{ "hedge_disabled",	test_hedge_disabled },
+	{ "hedge_percentile",	test_hedge_percentile },
+	{ "hedge_timeouts",	test_hedge_timeouts },
+
+	{ NULL }
+};
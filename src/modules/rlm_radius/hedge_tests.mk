@@ -0,0 +1,8 @@
+TARGET		:= hedge_tests$(E)
+SOURCES		:= hedge_tests.c
+
+TGT_LDLIBS	:= $(LIBS) $(GPERFTOOLS_LIBS)
+TGT_LDFLAGS	:= $(LDFLAGS) $(GPERFTOOLS_LDFLAGS)
+TGT_PREREQS	:= libfreeradius-util$(L)
+
+TGT_INSTALLDIR	:=
@@ -59,6 +59,7 @@ static conf_parser_t auth_config[] = {
 	{ FR_CONF_OFFSET("max_rtx_time", rlm_radius_t, retry[FR_RADIUS_CODE_ACCESS_REQUEST].mrt), .dflt = STRINGIFY(16) },
 	{ FR_CONF_OFFSET("max_rtx_count", rlm_radius_t, retry[FR_RADIUS_CODE_ACCESS_REQUEST].mrc), .dflt = STRINGIFY(5) },
 	{ FR_CONF_OFFSET("max_rtx_duration", rlm_radius_t, retry[FR_RADIUS_CODE_ACCESS_REQUEST].mrd), .dflt = STRINGIFY(30) },
+	{ FR_CONF_OFFSET("hedge", rlm_radius_t, hedge[FR_RADIUS_CODE_ACCESS_REQUEST]), .dflt = "no" },
 	CONF_PARSER_TERMINATOR
 };
 
@@ -67,6 +68,7 @@ static conf_parser_t acct_config[] = {
 	{ FR_CONF_OFFSET("max_rtx_time", rlm_radius_t, retry[FR_RADIUS_CODE_ACCOUNTING_REQUEST].mrt), .dflt = STRINGIFY(5) },
 	{ FR_CONF_OFFSET("max_rtx_count", rlm_radius_t, retry[FR_RADIUS_CODE_ACCOUNTING_REQUEST].mrc), .dflt = STRINGIFY(1) },
 	{ FR_CONF_OFFSET("max_rtx_duration", rlm_radius_t, retry[FR_RADIUS_CODE_ACCOUNTING_REQUEST].mrd), .dflt = STRINGIFY(30) },
+	{ FR_CONF_OFFSET("hedge", rlm_radius_t, hedge[FR_RADIUS_CODE_ACCOUNTING_REQUEST]), .dflt = "no" },
 	CONF_PARSER_TERMINATOR
 };
 
@@ -83,6 +85,7 @@ static conf_parser_t coa_config[] = {
 	{ FR_CONF_OFFSET("max_rtx_time", rlm_radius_t, retry[FR_RADIUS_CODE_COA_REQUEST].mrt), .dflt = STRINGIFY(16) },
 	{ FR_CONF_OFFSET("max_rtx_count", rlm_radius_t, retry[FR_RADIUS_CODE_COA_REQUEST].mrc), .dflt = STRINGIFY(5) },
 	{ FR_CONF_OFFSET("max_rtx_duration", rlm_radius_t, retry[FR_RADIUS_CODE_COA_REQUEST].mrd), .dflt = STRINGIFY(30) },
+	{ FR_CONF_OFFSET("hedge", rlm_radius_t, hedge[FR_RADIUS_CODE_COA_REQUEST]), .dflt = "no" },
 	CONF_PARSER_TERMINATOR
 };
 
@@ -91,6 +94,7 @@ static conf_parser_t disconnect_config[] = {
 	{ FR_CONF_OFFSET("max_rtx_time", rlm_radius_t, retry[FR_RADIUS_CODE_DISCONNECT_REQUEST].mrt), .dflt = STRINGIFY(16) },
 	{ FR_CONF_OFFSET("max_rtx_count", rlm_radius_t, retry[FR_RADIUS_CODE_DISCONNECT_REQUEST].mrc), .dflt = STRINGIFY(5) },
 	{ FR_CONF_OFFSET("max_rtx_duration", rlm_radius_t, retry[FR_RADIUS_CODE_DISCONNECT_REQUEST].mrd), .dflt = STRINGIFY(30) },
+	{ FR_CONF_OFFSET("hedge", rlm_radius_t, hedge[FR_RADIUS_CODE_DISCONNECT_REQUEST]), .dflt = "no" },
 	CONF_PARSER_TERMINATOR
 };
 
@@ -126,6 +130,8 @@ static conf_parser_t const module_config[] = {
 
 	{ FR_CONF_OFFSET("revive_interval", rlm_radius_t, revive_interval) },
 
+	{ FR_CONF_OFFSET("hedge_percentile", rlm_radius_t, hedge_percentile), .dflt = "0" },
+
 	{ FR_CONF_OFFSET_SUBSECTION("pool", 0, rlm_radius_t, trunk_conf, trunk_config ) },
 
 	CONF_PARSER_TERMINATOR
@@ -480,6 +486,11 @@ static int mod_instantiate(module_inst_ctx_t const *mctx)
 	FR_TIME_DELTA_BOUND_CHECK("zombie_period", inst->zombie_period, >=, fr_time_delta_from_sec(1));
 	FR_TIME_DELTA_BOUND_CHECK("zombie_period", inst->zombie_period, <=, fr_time_delta_from_sec(120));
 
+	if (inst->hedge_percentile) {
+		FR_INTEGER_BOUND_CHECK("hedge_percentile", inst->hedge_percentile, >=, 50);
+		FR_INTEGER_BOUND_CHECK("hedge_percentile", inst->hedge_percentile, <=, 99);
+	}
+
 	if (!inst->status_check) {
 		FR_TIME_DELTA_BOUND_CHECK("revive_interval", inst->revive_interval, >=, fr_time_delta_from_sec(10));
 		FR_TIME_DELTA_BOUND_CHECK("revive_interval", inst->revive_interval, <=, fr_time_delta_from_sec(3600));
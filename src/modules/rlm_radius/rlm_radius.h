@@ -69,6 +69,10 @@ struct rlm_radius_s {
 	bool			allowed[FR_RADIUS_CODE_MAX];
 	fr_retry_config_t      	retry[FR_RADIUS_CODE_MAX];
 
+	uint32_t		hedge_percentile;	//!< Send a duplicate request if there's no reply within
+							///< this percentile of recent response times.  0 disables.
+	bool			hedge[FR_RADIUS_CODE_MAX];	//!< Which packet types may be duplicated.
+
 	trunk_conf_t		trunk_conf;		//!< trunk configuration
 };
 
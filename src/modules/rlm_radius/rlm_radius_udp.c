@@ -36,6 +36,7 @@ RCSID("$Id$")
 #include <sys/socket.h>
 
 #include "rlm_radius.h"
+#include "hedge.h"
 #include "track.h"
 
 /*
@@ -64,6 +65,8 @@ typedef struct {
 
 	uint32_t		max_packet_size;	//!< Maximum packet size.
 	uint16_t		max_send_coalesce;	//!< Maximum number of packets to coalesce into one mmsg call.
+	uint16_t		num_sockets;		//!< How many sockets, each with its own source port
+							///< and ID space, each connection uses.
 
 	bool			recv_buff_is_set;	//!< Whether we were provided with a recv_buf
 	bool			send_buff_is_set;	//!< Whether we were provided with a send_buf
@@ -80,18 +83,43 @@ typedef struct {
 	rlm_radius_udp_t const	*inst;			//!< our instance
 
 	trunk_t			*trunk;			//!< trunk handler
+
+	radius_hedge_t		hedge;			//!< Response times, for deciding when to send
+							///< a duplicate request.
 } udp_thread_t;
 
 typedef struct {
 	trunk_request_t	*treq;
+	trunk_request_t		*hedge;			//!< Duplicate of treq, sent if it was slow.
+	udp_thread_t		*thread;		//!< To send the duplicate with.
+	fr_event_timer_t const	*hedge_ev;		//!< When to send the duplicate.
+	bool			done;			//!< A reply or failure has been recorded, and the
+							///< request is runnable.
 	rlm_rcode_t		rcode;			//!< from the transport
 } udp_result_t;
 
 typedef struct udp_request_s udp_request_t;
 
+/** One of the sockets making up a connection
+ *
+ * Each socket has its own source port, and so its own RADIUS ID space.
+ */
+typedef struct {
+	int			fd;			//!< File descriptor.
+	uint16_t		src_port;		//!< Source port specific to this socket.
+
+	radius_track_t		*tt;			//!< RADIUS ID tracking structure.
+
+	bool			readable;		//!< Set when the event loop says there's data to read.
+
+	uint16_t		queued;			//!< Packets coalesced for this socket in the current mux.
+	uint16_t		offset;			//!< Where this socket's packets start in the coalesced array.
+} udp_socket_t;
+
 typedef struct {
 	struct iovec		out;			//!< Describes buffer to send.
 	trunk_request_t	*treq;				//!< Used for signalling.
+	udp_socket_t		*sock;			//!< Socket to send the packet on.
 } udp_coalesced_t;
 
 /** Track the handle, which is tightly correlated with the FD
@@ -101,10 +129,17 @@ typedef struct {
 	char const     		*name;			//!< From IP PORT to IP PORT.
 	char const		*module_name;		//!< the module that opened the connection
 
-	int			fd;			//!< File descriptor.
+	int			fd;			//!< File descriptor of the first socket.  Used for
+							///< status checks before the connection is open.
+
+	udp_socket_t		*socket;		//!< Sockets making up this connection.
+	uint16_t		num_sockets;		//!< How many sockets there are.
+	uint16_t		next_socket;		//!< Socket to try first when allocating an ID.
 
 	struct mmsghdr		*mmsgvec;		//!< Vector of inbound/outbound packets.
 	udp_coalesced_t		*coalesced;		//!< Outbound coalesced requests.
+	udp_coalesced_t		*unsorted;		//!< Outbound coalesced requests, before they're
+							///< grouped by socket.
 
 	size_t			send_buff_actual;	//!< What we believe the maximum SO_SNDBUF size to be.
 							///< We don't try and encode more packet data than this
@@ -122,13 +157,9 @@ typedef struct {
 							//!< to be the actual IP address packets will be
 							//!< sent on.  This is why we can't use the inst
 							//!< src_ipaddr field.
-	uint16_t		src_port;		//!< Source port specific to this connection.
-
 	uint8_t			*buffer;		//!< Receive buffer.
 	size_t			buflen;			//!< Receive buffer length.
 
-	radius_track_t		*tt;			//!< RADIUS ID tracking structure.
-
 	fr_time_t		mrs_time;		//!< Most recent sent time which had a reply.
 	fr_time_t		last_reply;		//!< When we last received a reply.
 	fr_time_t		first_sent;		//!< first time we sent a packet since going idle
@@ -165,6 +196,7 @@ struct udp_request_s {
 	size_t			packet_len;		//!< Length of the packet.
 
 	radius_track_entry_t	*rr;			//!< ID tracking, resend count, etc.
+	udp_socket_t		*sock;			//!< Socket the ID was allocated from.
 	fr_event_timer_t const	*ev;			//!< timer for retransmissions
 	fr_retry_t		retry;			//!< retransmission timers
 };
@@ -185,6 +217,7 @@ static const conf_parser_t module_config[] = {
 
 	{ FR_CONF_OFFSET("max_packet_size", rlm_radius_udp_t, max_packet_size), .dflt = "4096" },
 	{ FR_CONF_OFFSET("max_send_coalesce", rlm_radius_udp_t, max_send_coalesce), .dflt = "1024" },
+	{ FR_CONF_OFFSET("num_sockets", rlm_radius_udp_t, num_sockets), .dflt = "1" },
 
 	{ FR_CONF_OFFSET_TYPE_FLAGS("src_ipaddr", FR_TYPE_COMBO_IP_ADDR, 0, rlm_radius_udp_t, src_ipaddr) },
 	{ FR_CONF_OFFSET_TYPE_FLAGS("src_ipv4addr", FR_TYPE_IPV4_ADDR, 0, rlm_radius_udp_t, src_ipaddr) },
@@ -210,6 +243,7 @@ static fr_dict_attr_t const *attr_nas_identifier;
 static fr_dict_attr_t const *attr_original_packet_code;
 static fr_dict_attr_t const *attr_proxy_state;
 static fr_dict_attr_t const *attr_response_length;
+static fr_dict_attr_t const *attr_state;
 static fr_dict_attr_t const *attr_user_password;
 static fr_dict_attr_t const *attr_packet_type;
 
@@ -224,6 +258,7 @@ fr_dict_attr_autoload_t rlm_radius_udp_dict_attr[] = {
 	{ .out = &attr_original_packet_code, .name = "Extended-Attribute-1.Original-Packet-Code", .type = FR_TYPE_UINT32, .dict = &dict_radius},
 	{ .out = &attr_proxy_state, .name = "Proxy-State", .type = FR_TYPE_OCTETS, .dict = &dict_radius},
 	{ .out = &attr_response_length, .name = "Extended-Attribute-1.Response-Length", .type = FR_TYPE_UINT32, .dict = &dict_radius },
+	{ .out = &attr_state, .name = "State", .type = FR_TYPE_OCTETS, .dict = &dict_radius},
 	{ .out = &attr_user_password, .name = "User-Password", .type = FR_TYPE_STRING, .dict = &dict_radius},
 	{ .out = &attr_packet_type, .name = "Packet-Type", .type = FR_TYPE_UINT32, .dict = &dict_radius },
 	{ NULL }
@@ -298,6 +333,7 @@ static void udp_request_reset(udp_request_t *u)
 	 *	if this is part of a pre-trunk status check.
 	 */
 	if (u->rr) radius_track_entry_release(&u->rr);
+	u->sock = NULL;
 }
 
 /** Reset a status_check packet, ready to reuse
@@ -680,90 +716,58 @@ static void conn_writable_status_check(fr_event_list_t *el, UNUSED int fd, UNUSE
  */
 static int _udp_handle_free(udp_handle_t *h)
 {
-	fr_assert(h->fd >= 0);
+	uint16_t i;
 
 	if (h->status_u) fr_event_timer_delete(&h->status_u->ev);
 
-	fr_event_fd_delete(h->thread->el, h->fd, FR_EVENT_FILTER_IO);
+	for (i = 0; i < h->num_sockets; i++) {
+		udp_socket_t *sock = &h->socket[i];
 
-	if (shutdown(h->fd, SHUT_RDWR) < 0) {
-		DEBUG3("%s - Failed shutting down connection %s: %s",
-		       h->module_name, h->name, fr_syserror(errno));
-	}
+		if (sock->fd < 0) continue;
 
-	if (close(h->fd) < 0) {
-		DEBUG3("%s - Failed closing connection %s: %s",
-		       h->module_name, h->name, fr_syserror(errno));
+		fr_event_fd_delete(h->thread->el, sock->fd, FR_EVENT_FILTER_IO);
+
+		if (shutdown(sock->fd, SHUT_RDWR) < 0) {
+			DEBUG3("%s - Failed shutting down connection %s: %s",
+			       h->module_name, h->name, fr_syserror(errno));
+		}
+
+		if (close(sock->fd) < 0) {
+			DEBUG3("%s - Failed closing connection %s: %s",
+			       h->module_name, h->name, fr_syserror(errno));
+		}
+
+		sock->fd = -1;
 	}
 
 	h->fd = -1;
 
-	DEBUG("%s - Connection closed - %s", h->module_name, h->name);
+	if (h->name) DEBUG("%s - Connection closed - %s", h->module_name, h->name);
 
 	return 0;
 }
 
-/** Initialise a new outbound connection
+/** Open one of the sockets making up a connection
  *
- * @param[out] h_out	Where to write the new file descriptor.
- * @param[in] conn	to initialise.
- * @param[in] uctx	A #udp_thread_t
+ * @param[in] h		the socket belongs to.
+ * @param[in] sock	to open.
+ * @return
+ *	- 0 on success.
+ *	- -1 on failure.
  */
-CC_NO_UBSAN(function) /* UBSAN: false positive - public vs private connection_t trips --fsanitize=function*/
-static connection_state_t conn_init(void **h_out, connection_t *conn, void *uctx)
+static int udp_socket_open(udp_handle_t *h, udp_socket_t *sock)
 {
-	int			fd;
-	udp_handle_t		*h;
-	udp_thread_t		*thread = talloc_get_type_abort(uctx, udp_thread_t);
-	uint16_t		i;
-
-	MEM(h = talloc_zero(conn, udp_handle_t));
-	h->thread = thread;
-	h->inst = thread->inst;
-	h->module_name = h->inst->parent->name;
-	h->src_ipaddr = h->inst->src_ipaddr;
-	h->src_port = 0;
-	h->max_packet_size = h->inst->max_packet_size;
-	h->last_idle = fr_time();
-
-	/*
-	 *	mmsgvec is pre-populated with pointers
-	 *	to the iovec structs in coalesced, so we
-	 *	just need to setup the iovec, and pass how
-	 *      many messages we want to send to sendmmsg.
-	 */
-	h->mmsgvec = talloc_zero_array(h, struct mmsghdr, h->inst->max_send_coalesce);
-	h->coalesced = talloc_zero_array(h, udp_coalesced_t, h->inst->max_send_coalesce);
-	for (i = 0; i < h->inst->max_send_coalesce; i++) {
-		h->mmsgvec[i].msg_hdr.msg_iov = &h->coalesced[i].out;
-		h->mmsgvec[i].msg_hdr.msg_iovlen = 1;
-	}
+	int fd;
 
-	MEM(h->buffer = talloc_array(h, uint8_t, h->max_packet_size));
-	h->buflen = h->max_packet_size;
+	sock->src_port = 0;
 
-	if (!h->inst->replicate) MEM(h->tt = radius_track_alloc(h));
-
-	/*
-	 *	Open the outgoing socket.
-	 */
-	fd = fr_socket_client_udp(h->inst->interface, &h->src_ipaddr, &h->src_port,
+	fd = fr_socket_client_udp(h->inst->interface, &h->src_ipaddr, &sock->src_port,
 				  &h->inst->dst_ipaddr, h->inst->dst_port, true);
 	if (fd < 0) {
 		PERROR("%s - Failed opening socket", h->module_name);
-	fail:
-		talloc_free(h);
-		return CONNECTION_STATE_FAILED;
+		return -1;
 	}
-
-	/*
-	 *	Set the connection name.
-	 */
-	h->name = fr_asprintf(h, "proto udp local %pV port %u remote %pV port %u",
-			      fr_box_ipaddr(h->src_ipaddr), h->src_port,
-			      fr_box_ipaddr(h->inst->dst_ipaddr), h->inst->dst_port);
-
-	talloc_set_destructor(h, _udp_handle_free);
+	sock->fd = fd;
 
 #ifdef SO_RCVBUF
 	if (h->inst->recv_buff_is_set) {
@@ -789,6 +793,13 @@ static connection_state_t conn_init(void **h_out, connection_t *conn, void *uctx
 			}
 		}
 
+		/*
+		 *	All the sockets are configured the same
+		 *	way, so the first one tells us what the
+		 *	buffer size is.
+		 */
+		if (h->send_buff_actual) return 0;
+
 		if (getsockopt(fd, SOL_SOCKET, SO_SNDBUF, &opt, &socklen) < 0) {
 			WARN("%s - Failed getting 'SO_SNDBUF', write performance may be sub-optimal: %s",
 			     h->module_name, fr_syserror(errno));
@@ -817,6 +828,8 @@ static connection_state_t conn_init(void **h_out, connection_t *conn, void *uctx
 		}
 	}
 #else
+	if (h->send_buff_actual) return 0;
+
 	h->send_buff_actual = h->inst->send_buff_is_set ?
 			      h->inst_send_buff : h->max_packet_size * h->inst->max_send_coalesce;
 
@@ -825,7 +838,84 @@ static connection_state_t conn_init(void **h_out, connection_t *conn, void *uctx
 	WARN("%s - Max coalesced outbound data will be %zu bytes", h->module_name, h->inst->send_buff_actual);
 #endif
 
-	h->fd = fd;
+	return 0;
+}
+
+/** Initialise a new outbound connection
+ *
+ * @param[out] h_out	Where to write the new file descriptor.
+ * @param[in] conn	to initialise.
+ * @param[in] uctx	A #udp_thread_t
+ */
+CC_NO_UBSAN(function) /* UBSAN: false positive - public vs private connection_t trips --fsanitize=function*/
+static connection_state_t conn_init(void **h_out, connection_t *conn, void *uctx)
+{
+	udp_handle_t		*h;
+	udp_thread_t		*thread = talloc_get_type_abort(uctx, udp_thread_t);
+	uint16_t		i;
+
+	MEM(h = talloc_zero(conn, udp_handle_t));
+	h->thread = thread;
+	h->inst = thread->inst;
+	h->module_name = h->inst->parent->name;
+	h->src_ipaddr = h->inst->src_ipaddr;
+	h->max_packet_size = h->inst->max_packet_size;
+	h->last_idle = fr_time();
+
+	/*
+	 *	mmsgvec is pre-populated with pointers
+	 *	to the iovec structs in coalesced, so we
+	 *	just need to setup the iovec, and pass how
+	 *      many messages we want to send to sendmmsg.
+	 */
+	h->mmsgvec = talloc_zero_array(h, struct mmsghdr, h->inst->max_send_coalesce);
+	h->coalesced = talloc_zero_array(h, udp_coalesced_t, h->inst->max_send_coalesce);
+	for (i = 0; i < h->inst->max_send_coalesce; i++) {
+		h->mmsgvec[i].msg_hdr.msg_iov = &h->coalesced[i].out;
+		h->mmsgvec[i].msg_hdr.msg_iovlen = 1;
+	}
+
+	MEM(h->buffer = talloc_array(h, uint8_t, h->max_packet_size));
+	h->buflen = h->max_packet_size;
+
+	/*
+	 *	Each socket has its own source port, and so its
+	 *	own ID space.  Packets for different sockets have
+	 *	to be grouped before they're passed to sendmmsg.
+	 */
+	h->num_sockets = h->inst->num_sockets;
+	MEM(h->socket = talloc_zero_array(h, udp_socket_t, h->num_sockets));
+	if (h->num_sockets > 1) MEM(h->unsorted = talloc_zero_array(h, udp_coalesced_t, h->inst->max_send_coalesce));
+
+	for (i = 0; i < h->num_sockets; i++) h->socket[i].fd = -1;
+	h->fd = -1;
+	talloc_set_destructor(h, _udp_handle_free);
+
+	/*
+	 *	Open the outgoing sockets.
+	 */
+	for (i = 0; i < h->num_sockets; i++) {
+		udp_socket_t *sock = &h->socket[i];
+
+		if (udp_socket_open(h, sock) < 0) goto fail;
+
+		if (!h->inst->replicate) MEM(sock->tt = radius_track_alloc(h));
+	}
+
+	/*
+	 *	Set the connection name.
+	 */
+	if (h->num_sockets == 1) {
+		h->name = fr_asprintf(h, "proto udp local %pV port %u remote %pV port %u",
+				      fr_box_ipaddr(h->src_ipaddr), h->socket[0].src_port,
+				      fr_box_ipaddr(h->inst->dst_ipaddr), h->inst->dst_port);
+	} else {
+		h->name = fr_asprintf(h, "proto udp local %pV port %u (+%u sockets) remote %pV port %u",
+				      fr_box_ipaddr(h->src_ipaddr), h->socket[0].src_port, h->num_sockets - 1,
+				      fr_box_ipaddr(h->inst->dst_ipaddr), h->inst->dst_port);
+	}
+
+	h->fd = h->socket[0].fd;
 
 	/*
 	 *	If we're doing status checks, then we want at least
@@ -853,7 +943,7 @@ static connection_state_t conn_init(void **h_out, connection_t *conn, void *uctx
 	 *	as open as soon as it becomes writable.
 	 */
 	} else {
-		connection_signal_on_fd(conn, fd);
+		connection_signal_on_fd(conn, h->fd);
 	}
 
 	*h_out = h;
@@ -863,6 +953,10 @@ static connection_state_t conn_init(void **h_out, connection_t *conn, void *uctx
 	// which connections / home servers are fast / slow.
 
 	return CONNECTION_STATE_CONNECTING;
+
+fail:
+	talloc_free(h);
+	return CONNECTION_STATE_FAILED;
 }
 
 /** Shutdown/close a file descriptor
@@ -870,18 +964,22 @@ static connection_state_t conn_init(void **h_out, connection_t *conn, void *uctx
  */
 static void conn_close(UNUSED fr_event_list_t *el, void *handle, UNUSED void *uctx)
 {
-	udp_handle_t *h = talloc_get_type_abort(handle, udp_handle_t);
+	udp_handle_t	*h = talloc_get_type_abort(handle, udp_handle_t);
+	uint16_t	i;
 
 	/*
 	 *	There's tracking entries still allocated
 	 *	this is bad, they should have all been
 	 *	released.
 	 */
-	if (h->tt && (h->tt->num_requests != 0)) {
+	for (i = 0; i < h->num_sockets; i++) {
+		radius_track_t *tt = h->socket[i].tt;
+
+		if (!tt || (tt->num_requests == 0)) continue;
 #ifndef NDEBUG
-		radius_track_state_log(&default_log, L_ERR, __FILE__, __LINE__, h->tt, udp_tracking_entry_log);
+		radius_track_state_log(&default_log, L_ERR, __FILE__, __LINE__, tt, udp_tracking_entry_log);
 #endif
-		fr_assert_fail("%u tracking entries still allocated at conn close", h->tt->num_requests);
+		fr_assert_fail("%u tracking entries still allocated at conn close", tt->num_requests);
 	}
 
 	DEBUG4("Freeing rlm_radius_udp handle %p", handle);
@@ -995,6 +1093,44 @@ static void conn_error(UNUSED fr_event_list_t *el, UNUSED int fd, UNUSED int fla
 	connection_signal_reconnect(conn, CONNECTION_FAILED);
 }
 
+/** Record which socket is readable, then let the trunk call the demuxer
+ *
+ */
+static void conn_readable(fr_event_list_t *el, int fd, int flags, void *uctx)
+{
+	trunk_connection_t	*tconn = talloc_get_type_abort(uctx, trunk_connection_t);
+	udp_handle_t		*h = talloc_get_type_abort(tconn->conn->h, udp_handle_t);
+	uint16_t		i;
+
+	for (i = 0; i < h->num_sockets; i++) {
+		if (h->socket[i].fd != fd) continue;
+
+		h->socket[i].readable = true;
+		break;
+	}
+
+	trunk_connection_callback_readable(el, fd, flags, tconn);
+}
+
+/** Register for I/O events on all of a connection's sockets
+ *
+ */
+static int conn_fd_insert(trunk_connection_t *tconn, udp_handle_t *h, fr_event_list_t *el,
+			  fr_event_fd_cb_t read_fn, fr_event_fd_cb_t write_fn)
+{
+	uint16_t i;
+
+	for (i = 0; i < h->num_sockets; i++) {
+		if (fr_event_fd_insert(h, NULL, el, h->socket[i].fd,
+				       read_fn,
+				       write_fn,
+				       conn_error,
+				       tconn) < 0) return -1;
+	}
+
+	return 0;
+}
+
 CC_NO_UBSAN(function) /* UBSAN: false positive - public vs private connection_t trips --fsanitize=function*/
 static void thread_conn_notify(trunk_connection_t *tconn, connection_t *conn,
 			       fr_event_list_t *el,
@@ -1017,7 +1153,7 @@ static void thread_conn_notify(trunk_connection_t *tconn, connection_t *conn,
 		break;
 
 	case TRUNK_CONN_EVENT_READ:
-		read_fn = trunk_connection_callback_readable;
+		read_fn = conn_readable;
 		break;
 
 	case TRUNK_CONN_EVENT_WRITE:
@@ -1025,17 +1161,13 @@ static void thread_conn_notify(trunk_connection_t *tconn, connection_t *conn,
 		break;
 
 	case TRUNK_CONN_EVENT_BOTH:
-		read_fn = trunk_connection_callback_readable;
+		read_fn = conn_readable;
 		write_fn = trunk_connection_callback_writable;
 		break;
 
 	}
 
-	if (fr_event_fd_insert(h, NULL, el, h->fd,
-			       read_fn,
-			       write_fn,
-			       conn_error,
-			       tconn) < 0) {
+	if (conn_fd_insert(tconn, h, el, read_fn, write_fn) < 0) {
 		PERROR("%s - Failed inserting FD event", h->module_name);
 
 		/*
@@ -1074,11 +1206,7 @@ static void thread_conn_notify_replicate(trunk_connection_t *tconn, connection_t
 		break;
 	}
 
-	if (fr_event_fd_insert(h, NULL, el, h->fd,
-			       read_fn,
-			       write_fn,
-			       conn_error,
-			       tconn) < 0) {
+	if (conn_fd_insert(tconn, h, el, read_fn, write_fn) < 0) {
 		PERROR("%s - Failed inserting FD event", h->module_name);
 
 		/*
@@ -1447,6 +1575,19 @@ static bool check_for_zombie(fr_event_list_t *el, trunk_connection_t *tconn, fr_
 	return true;
 }
 
+/** Record the response time of a request, or how long we waited for one
+ *
+ * Replies to retransmitted packets can't be matched to a transmission,
+ * so only the first wait for a reply is recorded.
+ */
+static inline CC_HINT(always_inline)
+void udp_rtt_sample(udp_thread_t *t, udp_request_t *u, fr_time_t now)
+{
+	if (u->retry.count != 1) return;
+
+	radius_hedge_sample(&t->hedge, t->inst->parent->hedge_percentile, fr_time_sub(now, u->retry.start));
+}
+
 /** Handle timeouts when a request is being sent synchronously
  *
  */
@@ -1456,18 +1597,27 @@ static void request_timeout(fr_event_list_t *el, fr_time_t now, void *uctx)
 	udp_request_t		*u = talloc_get_type_abort(treq->preq, udp_request_t);
 	udp_result_t		*r = talloc_get_type_abort(treq->rctx, udp_result_t);
 	trunk_connection_t	*tconn = treq->tconn;
+	fr_time_t		last_sent;
 
 	fr_assert(treq->state == TRUNK_REQUEST_STATE_SENT);		/* No other states should be timing out */
 	fr_assert(treq->preq);						/* Must still have a protocol request */
 	fr_assert(u->rr);
 	fr_assert(tconn);
 
-	r->rcode = RLM_MODULE_FAIL;
-	trunk_request_signal_complete(treq);
+	udp_rtt_sample(r->thread, u, now);
 
 	fr_assert(!u->status_check);
 
-	check_for_zombie(el, tconn, now, u->retry.start);
+	/*
+	 *	Only this copy has failed.  If this is a hedged
+	 *	request, the other copy may still get a reply.
+	 *
+	 *	The trunk frees u, so get the time it was sent first.
+	 */
+	last_sent = u->retry.start;
+	trunk_request_signal_fail(treq);
+
+	check_for_zombie(el, tconn, now, last_sent);
 }
 
 /** Handle retries when a request is being sent asynchronously
@@ -1480,6 +1630,7 @@ static void request_retry(fr_event_list_t *el, fr_time_t now, void *uctx)
 	udp_result_t		*r = talloc_get_type_abort(treq->rctx, udp_result_t);
 	request_t		*request = treq->request;
 	trunk_connection_t	*tconn = treq->tconn;
+	fr_time_t		last_sent;
 
 	fr_assert(treq->state == TRUNK_REQUEST_STATE_SENT);		/* No other states should be timing out */
 	fr_assert(treq->preq);						/* Must still have a protocol request */
@@ -1488,6 +1639,13 @@ static void request_retry(fr_event_list_t *el, fr_time_t now, void *uctx)
 
 	fr_assert(!u->status_check);
 
+	/*
+	 *	No reply within the retransmission timer.  Record
+	 *	the wait, otherwise slow requests would never
+	 *	count towards the hedge delay.
+	 */
+	udp_rtt_sample(r->thread, u, now);
+
 	switch (fr_retry_next(&u->retry, now)) {
 	/*
 	 *	Queue the request for retransmission.
@@ -1512,10 +1670,14 @@ static void request_retry(fr_event_list_t *el, fr_time_t now, void *uctx)
 		break;
 	}
 
-	r->rcode = RLM_MODULE_FAIL;
-	trunk_request_signal_complete(treq);
+	/*
+	 *	As with request_timeout(), release only
+	 *	this copy of the request.
+	 */
+	last_sent = u->retry.start;
+	trunk_request_signal_fail(treq);
 
-	check_for_zombie(el, tconn, now, u->retry.start);
+	check_for_zombie(el, tconn, now, last_sent);
 }
 
 static void status_check_retry(UNUSED fr_event_list_t *el, fr_time_t now, void *uctx)
@@ -1573,49 +1735,207 @@ static void status_check_retry(UNUSED fr_event_list_t *el, fr_time_t now, void *
         trunk_connection_signal_reconnect(tconn, CONNECTION_FAILED);
 }
 
-CC_NO_UBSAN(function) /* UBSAN: false positive - public vs private connection_t trips --fsanitize=function*/
-static void request_mux(fr_event_list_t *el,
-			trunk_connection_t *tconn, connection_t *conn, UNUSED void *uctx)
+/** Send a group of coalesced packets over one socket
+ *
+ * @param[in] el	to insert retransmission timers in.
+ * @param[in] tconn	the packets are being sent on.
+ * @param[in] h		the socket belongs to.
+ * @param[in] sock	to send the packets on.
+ * @param[in] start	of the packets in the coalesced array.
+ * @param[in] count	How many packets to send.
+ * @return
+ *	- 0 if the packets were sent or requeued.
+ *	- -1 if the connection has been signalled to reconnect.
+ */
+static int request_mux_send(fr_event_list_t *el, trunk_connection_t *tconn, udp_handle_t *h,
+			    udp_socket_t *sock, uint16_t start, uint16_t count)
 {
-	udp_handle_t		*h = talloc_get_type_abort(conn->h, udp_handle_t);
 	rlm_radius_udp_t const	*inst = h->inst;
 	int			sent;
-	uint16_t		i, queued;
-	size_t			total_len = 0;
+	uint16_t		i;
 
 	/*
-	 *	Encode multiple packets in preparation
-	 *      for transmission with sendmmsg.
+	 *	Send the coalesced datagrams
 	 */
-	for (i = 0, queued = 0; (i < inst->max_send_coalesce) && (total_len < h->send_buff_actual); i++) {
-		trunk_request_t	*treq;
+	sent = sendmmsg(sock->fd, &h->mmsgvec[start], count, 0);
+	if (sent < 0) {		/* Error means no messages were sent */
+		sent = 0;
+
+		/*
+		 *	Temporary conditions
+		 */
+		switch (errno) {
+#if defined(EWOULDBLOCK) && (EWOULDBLOCK != EAGAIN)
+		case EWOULDBLOCK:	/* No outbound packet buffers, maybe? */
+#endif
+		case EAGAIN:		/* No outbound packet buffers, maybe? */
+		case EINTR:		/* Interrupted by signal */
+		case ENOBUFS:		/* No outbound packet buffers, maybe? */
+		case ENOMEM:		/* malloc failure in kernel? */
+			WARN("%s - Failed sending data over connection %s: %s",
+			     h->module_name, h->name, fr_syserror(errno));
+			break;
+
+		/*
+		 *	Fatal, request specific conditions
+		 *
+		 *	sendmmsg will only return an error condition if the
+		 *	first packet being sent errors.
+		 *
+		 *	When we get request specific errors, we need to fail
+		 *	the first request in the set, and move the rest of
+		 *	the packets back to the pending state.
+		 */
+		case EMSGSIZE:		/* Packet size exceeds max size allowed on socket */
+			ERROR("%s - Failed sending data over connection %s: %s",
+			      h->module_name, h->name, fr_syserror(errno));
+			trunk_request_signal_fail(h->coalesced[start].treq);
+			sent = 1;
+			break;
+
+		/*
+		 *	Will re-queue any 'sent' requests, so we don't
+		 *	have to do any cleanup.
+		 */
+		default:
+			ERROR("%s - Failed sending data over connection %s: %s",
+			      h->module_name, h->name, fr_syserror(errno));
+			trunk_connection_signal_reconnect(tconn, CONNECTION_FAILED);
+			return -1;
+		}
+	}
+
+	/*
+	 *	For all messages that were actually sent by sendmmsg
+	 *	start the request timer.
+	 */
+	for (i = start; i < start + sent; i++) {
+		trunk_request_t	*treq = h->coalesced[i].treq;
 		udp_request_t		*u;
 		request_t		*request;
-
- 		if (unlikely(trunk_connection_pop_request(&treq, tconn) < 0)) return;
+		char const		*action;
 
 		/*
-		 *	No more requests to send
+		 *	It's UDP so there should never be partial writes
 		 */
-		if (!treq) break;
+		fr_assert((size_t)h->mmsgvec[i].msg_len == h->mmsgvec[i].msg_hdr.msg_iov->iov_len);
 
- 		fr_assert((treq->state == TRUNK_REQUEST_STATE_PENDING) ||
-			   (treq->state == TRUNK_REQUEST_STATE_PARTIAL));
+		fr_assert(treq->state == TRUNK_REQUEST_STATE_SENT);
 
 		request = treq->request;
 		u = talloc_get_type_abort(treq->preq, udp_request_t);
 
 		/*
-		 *	Start retransmissions from when the socket is writable.
+		 *	Tell the admin what's going on
 		 */
-		if (fr_time_eq(u->retry.start, fr_time_wrap(0))) {
-			fr_retry_init(&u->retry, fr_time(), &h->inst->parent->retry[u->code]);
-			fr_assert(fr_time_delta_ispos(u->retry.rt));
-			fr_assert(fr_time_gt(u->retry.next, fr_time_wrap(0)));
-		}
-
-		/*
-		 *	No previous packet, OR can't retransmit the
+		if (u->retry.count == 1) {
+			action = inst->parent->originate ? "Originated" : "Proxied";
+			h->last_sent = u->retry.start;
+			if (fr_time_lteq(h->first_sent, h->last_idle)) h->first_sent = h->last_sent;
+
+		} else {
+			action = "Retransmitted";
+		}
+
+		if (u->status_check) {
+			RDEBUG("%s status check.  Expecting response within %pVs", action,
+			       fr_box_time_delta(u->retry.rt));
+
+			if (fr_event_timer_at(u, el, &u->ev, u->retry.next, status_check_retry, treq) < 0) {
+				RERROR("Failed inserting retransmit timeout for connection");
+				trunk_request_signal_fail(treq);
+				continue;
+			}
+
+		} else if (!inst->parent->synchronous) {
+			RDEBUG("%s request.  Expecting response within %pVs", action,
+			       fr_box_time_delta(u->retry.rt));
+
+			if (fr_event_timer_at(u, el, &u->ev, u->retry.next, request_retry, treq) < 0) {
+				RERROR("Failed inserting retransmit timeout for connection");
+				trunk_request_signal_fail(treq);
+				continue;
+			}
+
+		} else if (u->retry.count == 1) {
+			if (fr_event_timer_at(u, el, &u->ev,
+					      fr_time_add(u->retry.start, h->inst->parent->response_window),
+					      request_timeout, treq) < 0) {
+				RERROR("Failed inserting timeout for connection");
+				trunk_request_signal_fail(treq);
+				continue;
+			}
+
+			/*
+			 *	If the packet doesn't get a response,
+			 *	then udp_request_free() will notice, and run conn_zombie()
+			 */
+			RDEBUG("%s request.  Relying on NAS to perform more retransmissions", action);
+		}
+	}
+
+	/*
+	 *	Requests that weren't sent get re-enqueued
+	 *
+	 *	The cancel logic runs as per-normal and cleans up
+	 *	the request ready for sending again...
+	 */
+	for (i = start + sent; i < start + count; i++) trunk_request_requeue(h->coalesced[i].treq);
+
+	return 0;
+}
+
+CC_NO_UBSAN(function) /* UBSAN: false positive - public vs private connection_t trips --fsanitize=function*/
+static void request_mux(fr_event_list_t *el,
+			trunk_connection_t *tconn, connection_t *conn, UNUSED void *uctx)
+{
+	udp_handle_t		*h = talloc_get_type_abort(conn->h, udp_handle_t);
+	rlm_radius_udp_t const	*inst = h->inst;
+	udp_coalesced_t		*batch;
+	uint16_t		i, queued;
+	size_t			total_len = 0;
+
+	/*
+	 *	With multiple sockets the packets are grouped
+	 *	by socket after they've been encoded.  Otherwise
+	 *	they can go straight into the coalesced array.
+	 */
+	batch = (h->num_sockets > 1) ? h->unsorted : h->coalesced;
+	for (i = 0; i < h->num_sockets; i++) h->socket[i].queued = 0;
+
+	/*
+	 *	Encode multiple packets in preparation
+	 *      for transmission with sendmmsg.
+	 */
+	for (i = 0, queued = 0; (i < inst->max_send_coalesce) && (total_len < h->send_buff_actual); i++) {
+		trunk_request_t	*treq;
+		udp_request_t		*u;
+		request_t		*request;
+
+ 		if (unlikely(trunk_connection_pop_request(&treq, tconn) < 0)) return;
+
+		/*
+		 *	No more requests to send
+		 */
+		if (!treq) break;
+
+ 		fr_assert((treq->state == TRUNK_REQUEST_STATE_PENDING) ||
+			   (treq->state == TRUNK_REQUEST_STATE_PARTIAL));
+
+		request = treq->request;
+		u = talloc_get_type_abort(treq->preq, udp_request_t);
+
+		/*
+		 *	Start retransmissions from when the socket is writable.
+		 */
+		if (fr_time_eq(u->retry.start, fr_time_wrap(0))) {
+			fr_retry_init(&u->retry, fr_time(), &h->inst->parent->retry[u->code]);
+			fr_assert(fr_time_delta_ispos(u->retry.rt));
+			fr_assert(fr_time_gt(u->retry.next, fr_time_wrap(0)));
+		}
+
+		/*
+		 *	No previous packet, OR can't retransmit the
 		 *	existing one.  Oh well.
 		 *
 		 *	Note that if we can't retransmit the previous
@@ -1625,14 +1945,28 @@ static void request_mux(fr_event_list_t *el,
 		 *	the REQUEUE signal was received.
 		 */
 		if (!u->packet) {
+			uint16_t j;
+
 			fr_assert(!u->rr);
 
-			if (unlikely(radius_track_entry_reserve(&u->rr, treq, h->tt, request, u->code, treq) < 0)) {
+			/*
+			 *	Spread the IDs over the sockets.  If one
+			 *	socket has run out of IDs, try the others.
+			 */
+			for (j = 0; j < h->num_sockets; j++) {
+				u->sock = &h->socket[h->next_socket];
+				if (++h->next_socket == h->num_sockets) h->next_socket = 0;
+
+				if (radius_track_entry_reserve(&u->rr, treq, u->sock->tt, request, u->code, treq) == 0) break;
+			}
+
+			if (unlikely(!u->rr)) {
 #ifndef NDEBUG
 				radius_track_state_log(&default_log, L_ERR, __FILE__, __LINE__,
-						       h->tt, udp_tracking_entry_log);
+						       u->sock->tt, udp_tracking_entry_log);
 #endif
 				fr_assert_fail("Tracking entry allocation failed: %s", fr_strerror());
+				u->sock = NULL;
 				trunk_request_signal_fail(treq);
 				continue;
 			}
@@ -1671,9 +2005,11 @@ static void request_mux(fr_event_list_t *el,
 		 *	We store the treq so we can place it back in
 		 *      the pending state if the sendmmsg call fails.
 		 */
-		h->coalesced[queued].treq = treq;
-		h->coalesced[queued].out.iov_base = u->packet;
-		h->coalesced[queued].out.iov_len = u->packet_len;
+		batch[queued].treq = treq;
+		batch[queued].sock = u->sock;
+		batch[queued].out.iov_base = u->packet;
+		batch[queued].out.iov_len = u->packet_len;
+		u->sock->queued++;
 
 		/*
 		 *	Record how much data we have in total.
@@ -1702,132 +2038,35 @@ static void request_mux(fr_event_list_t *el,
 	(void)talloc_get_type_abort(h, udp_handle_t);
 
 	/*
-	 *	Send the coalesced datagrams
+	 *	Group the packets by socket, keeping them in the
+	 *	order they were dequeued.  Each group is then
+	 *	sent with one sendmmsg call.
 	 */
-	sent = sendmmsg(h->fd, h->mmsgvec, queued, 0);
-	if (sent < 0) {		/* Error means no messages were sent */
-		sent = 0;
-
-		/*
-		 *	Temporary conditions
-		 */
-		switch (errno) {
-#if defined(EWOULDBLOCK) && (EWOULDBLOCK != EAGAIN)
-		case EWOULDBLOCK:	/* No outbound packet buffers, maybe? */
-#endif
-		case EAGAIN:		/* No outbound packet buffers, maybe? */
-		case EINTR:		/* Interrupted by signal */
-		case ENOBUFS:		/* No outbound packet buffers, maybe? */
-		case ENOMEM:		/* malloc failure in kernel? */
-			WARN("%s - Failed sending data over connection %s: %s",
-			     h->module_name, h->name, fr_syserror(errno));
-			break;
-
-		/*
-		 *	Fatal, request specific conditions
-		 *
-		 *	sendmmsg will only return an error condition if the
-		 *	first packet being sent errors.
-		 *
-		 *	When we get request specific errors, we need to fail
-		 *	the first request in the set, and move the rest of
-		 *	the packets back to the pending state.
-		 */
-		case EMSGSIZE:		/* Packet size exceeds max size allowed on socket */
-			ERROR("%s - Failed sending data over connection %s: %s",
-			      h->module_name, h->name, fr_syserror(errno));
-			trunk_request_signal_fail(h->coalesced[0].treq);
-			sent = 1;
-			break;
+	if (h->num_sockets > 1) {
+		uint16_t end = 0;
 
-		/*
-		 *	Will re-queue any 'sent' requests, so we don't
-		 *	have to do any cleanup.
-		 */
-		default:
-			ERROR("%s - Failed sending data over connection %s: %s",
-			      h->module_name, h->name, fr_syserror(errno));
-			trunk_connection_signal_reconnect(tconn, CONNECTION_FAILED);
-			return;
+		for (i = 0; i < h->num_sockets; i++) {
+			end += h->socket[i].queued;
+			h->socket[i].offset = end;
 		}
-	}
-
-	/*
-	 *	For all messages that were actually sent by sendmmsg
-	 *	start the request timer.
-	 */
-	for (i = 0; i < sent; i++) {
-		trunk_request_t	*treq = h->coalesced[i].treq;
-		udp_request_t		*u;
-		request_t		*request;
-		char const		*action;
-
-		/*
-		 *	It's UDP so there should never be partial writes
-		 */
-		fr_assert((size_t)h->mmsgvec[i].msg_len == h->mmsgvec[i].msg_hdr.msg_iov->iov_len);
-
-		fr_assert(treq->state == TRUNK_REQUEST_STATE_SENT);
-
-		request = treq->request;
-		u = talloc_get_type_abort(treq->preq, udp_request_t);
 
-		/*
-		 *	Tell the admin what's going on
-		 */
-		if (u->retry.count == 1) {
-			action = inst->parent->originate ? "Originated" : "Proxied";
-			h->last_sent = u->retry.start;
-			if (fr_time_lteq(h->first_sent, h->last_idle)) h->first_sent = h->last_sent;
+		for (i = queued; i > 0; i--) {
+			udp_coalesced_t *c = &h->unsorted[i - 1];
 
-		} else {
-			action = "Retransmitted";
+			h->coalesced[--c->sock->offset] = *c;
 		}
+	} else {
+		h->socket[0].offset = 0;
+	}
 
-		if (u->status_check) {
-			RDEBUG("%s status check.  Expecting response within %pVs", action,
-			       fr_box_time_delta(u->retry.rt));
-
-			if (fr_event_timer_at(u, el, &u->ev, u->retry.next, status_check_retry, treq) < 0) {
-				RERROR("Failed inserting retransmit timeout for connection");
-				trunk_request_signal_fail(treq);
-				continue;
-			}
-
-		} else if (!inst->parent->synchronous) {
-			RDEBUG("%s request.  Expecting response within %pVs", action,
-			       fr_box_time_delta(u->retry.rt));
-
-			if (fr_event_timer_at(u, el, &u->ev, u->retry.next, request_retry, treq) < 0) {
-				RERROR("Failed inserting retransmit timeout for connection");
-				trunk_request_signal_fail(treq);
-				continue;
-			}
+	for (i = 0; i < h->num_sockets; i++) {
+		udp_socket_t	*sock = &h->socket[i];
+		uint16_t	count = sock->queued;
 
-		} else if (u->retry.count == 1) {
-			if (fr_event_timer_at(u, el, &u->ev,
-					      fr_time_add(u->retry.start, h->inst->parent->response_window),
-					      request_timeout, treq) < 0) {
-				RERROR("Failed inserting timeout for connection");
-				trunk_request_signal_fail(treq);
-				continue;
-			}
+		if (count == 0) continue;
 
-			/*
-			 *	If the packet doesn't get a response,
-			 *	then udp_request_free() will notice, and run conn_zombie()
-			 */
-			RDEBUG("%s request.  Relying on NAS to perform more retransmissions", action);
-		}
+		if (request_mux_send(el, tconn, h, sock, sock->offset, count) < 0) return;
 	}
-
-	/*
-	 *	Requests that weren't sent get re-enqueued
-	 *
-	 *	The cancel logic runs as per-normal and cleans up
-	 *	the request ready for sending again...
-	 */
-	for (i = sent; i < queued; i++) trunk_request_requeue(h->coalesced[i].treq);
 }
 
 CC_NO_UBSAN(function) /* UBSAN: false positive - public vs private connection_t trips --fsanitize=function*/
@@ -2140,13 +2379,14 @@ static void status_check_reply(trunk_request_t *treq, fr_time_t now)
 	trunk_connection_signal_active(treq->tconn);
 }
 
-CC_NO_UBSAN(function) /* UBSAN: false positive - public vs private connection_t trips --fsanitize=function*/
-static void request_demux(UNUSED fr_event_list_t *el, trunk_connection_t *tconn, connection_t *conn, UNUSED void *uctx)
+/** Read and process all the replies waiting on one socket
+ *
+ * @return
+ *	- 0 if the socket was drained.
+ *	- -1 if the connection has been signalled to reconnect.
+ */
+static int request_demux_socket(trunk_connection_t *tconn, udp_handle_t *h, udp_socket_t *sock)
 {
-	udp_handle_t		*h = talloc_get_type_abort(conn->h, udp_handle_t);
-
-	DEBUG3("%s - Reading data for connection %s", h->module_name, h->name);
-
 	while (true) {
 		ssize_t			slen;
 
@@ -2167,16 +2407,16 @@ static void request_demux(UNUSED fr_event_list_t *el, trunk_connection_t *tconn,
 		 *	saves a round through the event loop.  If we're not
 		 *	busy, a few extra system calls don't matter.
 		 */
-		slen = read(h->fd, h->buffer, h->buflen);
-		if (slen == 0) return;
+		slen = read(sock->fd, h->buffer, h->buflen);
+		if (slen == 0) return 0;
 
 		if (slen < 0) {
-			if ((errno == EAGAIN) || (errno == EWOULDBLOCK)) return;
+			if ((errno == EAGAIN) || (errno == EWOULDBLOCK)) return 0;
 
 			ERROR("%s - Failed reading response from socket: %s",
 			      h->module_name, fr_syserror(errno));
 			trunk_connection_signal_reconnect(tconn, CONNECTION_FAILED);
-			return;
+			return -1;
 		}
 
 		if (slen < RADIUS_HEADER_LENGTH) {
@@ -2189,7 +2429,7 @@ static void request_demux(UNUSED fr_event_list_t *el, trunk_connection_t *tconn,
 		 *	Note that we don't care about packet codes.  All
 		 *	packet codes share the same ID space.
 		 */
-		rr = radius_track_entry_find(h->tt, h->buffer[1], NULL);
+		rr = radius_track_entry_find(sock->tt, h->buffer[1], NULL);
 		if (!rr) {
 			WARN("%s - Ignoring reply with ID %i that arrived too late",
 			     h->module_name, h->buffer[1]);
@@ -2202,6 +2442,16 @@ static void request_demux(UNUSED fr_event_list_t *el, trunk_connection_t *tconn,
 		u = talloc_get_type_abort(treq->preq, udp_request_t);
 		r = talloc_get_type_abort(treq->rctx, udp_result_t);
 
+		/*
+		 *	The other copy of a hedged request has
+		 *	already had a reply.  Don't touch the
+		 *	request, just release the ID.
+		 */
+		if (r->done) {
+			trunk_request_signal_complete(treq);
+			continue;
+		}
+
 		/*
 		 *	Validate and decode the incoming packet
 		 */
@@ -2237,6 +2487,8 @@ static void request_demux(UNUSED fr_event_list_t *el, trunk_connection_t *tconn,
 			continue;
 		}
 
+		udp_rtt_sample(h->thread, u, now);
+
 		/*
 		 *	Handle any state changes, etc. needed by receiving a
 		 *	Protocol-Error reply packet.
@@ -2302,6 +2554,29 @@ static void request_demux(UNUSED fr_event_list_t *el, trunk_connection_t *tconn,
 	}
 }
 
+CC_NO_UBSAN(function) /* UBSAN: false positive - public vs private connection_t trips --fsanitize=function*/
+static void request_demux(UNUSED fr_event_list_t *el, trunk_connection_t *tconn, connection_t *conn, UNUSED void *uctx)
+{
+	udp_handle_t		*h = talloc_get_type_abort(conn->h, udp_handle_t);
+	uint16_t		i;
+
+	DEBUG3("%s - Reading data for connection %s", h->module_name, h->name);
+
+	/*
+	 *	Only read from the sockets the event loop told us
+	 *	about.  With many sockets most of them will have
+	 *	nothing waiting.
+	 */
+	for (i = 0; i < h->num_sockets; i++) {
+		udp_socket_t *sock = &h->socket[i];
+
+		if (!sock->readable) continue;
+		sock->readable = false;
+
+		if (request_demux_socket(tconn, h, sock) < 0) return;
+	}
+}
+
 /** Remove the request from any tracking structures
  *
  * Frees encoded packets if the request is being moved to a new connection
@@ -2342,6 +2617,7 @@ static void request_conn_release(connection_t *conn, void *preq_to_reset, UNUSED
 {
 	udp_request_t		*u = talloc_get_type_abort(preq_to_reset, udp_request_t);
 	udp_handle_t		*h = talloc_get_type_abort(conn->h, udp_handle_t);
+	uint16_t		i;
 
 	if (u->ev) (void)fr_event_timer_delete(&u->ev);
 	if (u->packet) udp_request_reset(u);
@@ -2352,7 +2628,10 @@ static void request_conn_release(connection_t *conn, void *preq_to_reset, UNUSED
 	 *	If there are no outstanding tracking entries
 	 *	allocated then the connection is "idle".
 	 */
-	if (!h->tt || (h->tt->num_requests == 0)) h->last_idle = fr_time();
+	for (i = 0; i < h->num_sockets; i++) {
+		if (h->socket[i].tt && (h->socket[i].tt->num_requests > 0)) return;
+	}
+	h->last_idle = fr_time();
 }
 
 /** Clear out anything associated with the handle from the request
@@ -2370,6 +2649,39 @@ static void request_conn_release_replicate(UNUSED connection_t *conn, void *preq
 /** Write out a canned failure
  *
  */
+/** Forget about a treq which has completed or failed
+ *
+ */
+static inline CC_HINT(always_inline)
+void udp_result_release(udp_result_t *r, udp_request_t *u)
+{
+	if (r->treq && (r->treq->preq == u)) {
+		r->treq = NULL;
+	} else if (r->hedge && (r->hedge->preq == u)) {
+		r->hedge = NULL;
+	}
+}
+
+/** Cancel any copies of the request which are still outstanding
+ *
+ * This is the losing copy of a hedged request, or every copy if the
+ * request itself is being cancelled.
+ */
+static void udp_result_cancel(udp_result_t *r)
+{
+	if (r->hedge_ev) (void) fr_event_timer_delete(&r->hedge_ev);
+
+	if (r->treq) {
+		trunk_request_signal_cancel(r->treq);
+		r->treq = NULL;
+	}
+
+	if (r->hedge) {
+		trunk_request_signal_cancel(r->hedge);
+		r->hedge = NULL;
+	}
+}
+
 static void request_fail(request_t *request, void *preq, void *rctx,
 			 NDEBUG_UNUSED trunk_request_state_t state, UNUSED void *uctx)
 {
@@ -2382,8 +2694,16 @@ static void request_fail(request_t *request, void *preq, void *rctx,
 
 	if (u->status_check) return;
 
+	udp_result_release(r, u);
+
+	/*
+	 *	The other copy of a hedged request may
+	 *	still get a reply.
+	 */
+	if (r->done || r->treq || r->hedge) return;
+
 	r->rcode = RLM_MODULE_FAIL;
-	r->treq = NULL;
+	r->done = true;
 
 	unlang_interpret_mark_runnable(request);
 }
@@ -2400,7 +2720,10 @@ static void request_complete(request_t *request, void *preq, void *rctx, UNUSED
 
 	if (u->status_check) return;
 
-	r->treq = NULL;
+	udp_result_release(r, u);
+
+	if (r->done) return;
+	r->done = true;
 
 	unlang_interpret_mark_runnable(request);
 }
@@ -2430,6 +2753,7 @@ static unlang_action_t mod_resume(rlm_rcode_t *p_result, module_ctx_t const *mct
 	udp_result_t	*r = talloc_get_type_abort(mctx->rctx, udp_result_t);
 	rlm_rcode_t	rcode = r->rcode;
 
+	udp_result_cancel(r);
 	talloc_free(r);
 
 	RETURN_MODULE_RCODE(rcode);
@@ -2450,7 +2774,7 @@ static void mod_signal(module_ctx_t const *mctx, UNUSED request_t *request, fr_s
 	 *	unlang_request_is_scheduled will return false
 	 *	(don't use it).
 	 */
-	if (!r->treq) {
+	if (!r->treq && !r->hedge) {
 		talloc_free(r);
 		return;
 	}
@@ -2461,8 +2785,7 @@ static void mod_signal(module_ctx_t const *mctx, UNUSED request_t *request, fr_s
 	 *	trunk so it can clean up the treq.
 	 */
 	case FR_SIGNAL_CANCEL:
-		trunk_request_signal_cancel(r->treq);
-		r->treq = NULL;
+		udp_result_cancel(r);
 		talloc_free(r);		/* Should be freed soon anyway, but better to be explicit */
 		return;
 
@@ -2476,7 +2799,7 @@ static void mod_signal(module_ctx_t const *mctx, UNUSED request_t *request, fr_s
 		 *	If we're not synchronous, then rely on
 		 *	request_retry() to do the retransmissions.
 		 */
-		if (!t->inst->parent->synchronous) return;
+		if (!t->inst->parent->synchronous || r->done) return;
 
 		/*
 		 *	We are synchronous, retransmit the current
@@ -2486,7 +2809,7 @@ static void mod_signal(module_ctx_t const *mctx, UNUSED request_t *request, fr_s
 		 *	connection is dead, then a callback will move
 		 *	this request to a new connection.
 		 */
-		trunk_request_requeue(r->treq);
+		if (r->treq) trunk_request_requeue(r->treq);
 		return;
 
 	default:
@@ -2526,6 +2849,72 @@ static int _udp_request_free(udp_request_t *u)
 	return 0;
 }
 
+/** Allocate the protocol specific part of a trunk request
+ *
+ */
+static udp_request_t *udp_request_alloc(trunk_request_t *treq, rlm_radius_udp_t const *inst, request_t *request)
+{
+	udp_request_t *u;
+
+	/*
+	 *	Can't use compound literal - const issues.
+	 */
+	MEM(u = talloc_zero(treq, udp_request_t));
+	u->code = request->packet->code;
+	u->synchronous = inst->parent->synchronous;
+	u->priority = request->async->priority;
+	u->recv_time = request->async->recv_time;
+	fr_pair_list_init(&u->extra);
+
+	return u;
+}
+
+/** No reply yet, send a duplicate of the request over another connection
+ *
+ * Whichever copy gets a reply first is used, and the other one is
+ * cancelled when the request resumes.
+ */
+static void request_hedge(UNUSED fr_event_list_t *el, UNUSED fr_time_t now, void *uctx)
+{
+	udp_result_t		*r = talloc_get_type_abort(uctx, udp_result_t);
+	trunk_request_t		*treq;
+	udp_request_t		*u, *hedge_u;
+	request_t		*request;
+
+	if (r->done || !r->treq || r->hedge) return;
+
+	/*
+	 *	Still waiting to be sent, a duplicate won't
+	 *	get there any faster.
+	 */
+	if (r->treq->state != TRUNK_REQUEST_STATE_SENT) return;
+
+	request = r->treq->request;
+	u = talloc_get_type_abort(r->treq->preq, udp_request_t);
+
+	treq = trunk_request_alloc(r->thread->trunk, request);
+	if (!treq) return;
+
+	hedge_u = udp_request_alloc(treq, r->thread->inst, request);
+	hedge_u->require_message_authenticator = u->require_message_authenticator;
+
+	switch (trunk_request_enqueue(&treq, r->thread->trunk, request, hedge_u, r)) {
+	case TRUNK_ENQUEUE_OK:
+	case TRUNK_ENQUEUE_IN_BACKLOG:
+		break;
+
+	default:
+		RDEBUG2("Unable to queue duplicate request");
+		trunk_request_free(&treq);
+		return;
+	}
+
+	RDEBUG2("No reply to ID %d, sending a duplicate request", u->id);
+
+	r->hedge = treq;
+	talloc_set_destructor(hedge_u, _udp_request_free);
+}
+
 static unlang_action_t mod_enqueue(rlm_rcode_t *p_result, void **rctx_out, void *instance, void *thread, request_t *request)
 {
 	rlm_radius_udp_t		*inst = talloc_get_type_abort(instance, rlm_radius_udp_t);
@@ -2550,17 +2939,10 @@ static unlang_action_t mod_enqueue(rlm_rcode_t *p_result, void **rctx_out, void
 	talloc_set_destructor(r, _udp_result_free);
 #endif
 
-	/*
-	 *	Can't use compound literal - const issues.
-	 */
-	MEM(u = talloc_zero(treq, udp_request_t));
-	u->code = request->packet->code;
-	u->synchronous = inst->parent->synchronous;
-	u->priority = request->async->priority;
-	u->recv_time = request->async->recv_time;
-	fr_pair_list_init(&u->extra);
+	u = udp_request_alloc(treq, inst, request);
 
 	r->rcode = RLM_MODULE_FAIL;
+	r->thread = t;
 
 	/*
 	 *	Make sure that we print out the actual encoded value
@@ -2603,6 +2985,24 @@ static unlang_action_t mod_enqueue(rlm_rcode_t *p_result, void **rctx_out, void
 
 	talloc_set_destructor(u, _udp_request_free);
 
+	/*
+	 *	If there's no reply within the usual time, send
+	 *	a duplicate.  Only some packet types are safe to
+	 *	send twice.
+	 *
+	 *	Packets which continue a multi-round exchange are
+	 *	never duplicated.  The home server would see two
+	 *	different packets for the same session state, and
+	 *	may advance it twice, or reject one of them.
+	 */
+	if (fr_time_delta_ispos(t->hedge.delay) && inst->parent->hedge[u->code] && !inst->replicate &&
+	    !fr_pair_find_by_da(&request->request_pairs, NULL, attr_state) &&
+	    !fr_pair_find_by_da(&request->request_pairs, NULL, attr_eap_message)) {
+		if (fr_event_timer_in(r, t->el, &r->hedge_ev, t->hedge.delay, request_hedge, r) < 0) {
+			RWDEBUG("Failed inserting hedge timer");
+		}
+	}
+
 	*rctx_out = r;
 
 	return UNLANG_ACTION_YIELD;
@@ -2745,7 +3145,26 @@ static int mod_instantiate(module_inst_ctx_t const *mctx)
 		FR_INTEGER_BOUND_CHECK("send_buff", inst->send_buff, <=, (1 << 30));
 	}
 
+	FR_INTEGER_BOUND_CHECK("num_sockets", inst->num_sockets, >=, 1);
+	FR_INTEGER_BOUND_CHECK("num_sockets", inst->num_sockets, <=, 64);
+
+	/*
+	 *	Replicated packets don't use IDs, so there's
+	 *	nothing to gain from more sockets.
+	 */
+	if (inst->replicate && (inst->num_sockets > 1)) {
+		cf_log_warn(conf, "Ignoring 'num_sockets = %u' as we're replicating", inst->num_sockets);
+		inst->num_sockets = 1;
+	}
+
 	memcpy(&inst->trunk_conf, &inst->parent->trunk_conf, sizeof(inst->trunk_conf));
+
+	/*
+	 *	The per-connection limits are per ID space,
+	 *	and each socket has its own.
+	 */
+	inst->trunk_conf.max_req_per_conn *= inst->num_sockets;
+	inst->trunk_conf.target_req_per_conn *= inst->num_sockets;
 	inst->trunk_conf.req_pool_headers = 4;	/* One for the request, one for the buffer, one for the tracking binding, one for Proxy-State VP */
 	inst->trunk_conf.req_pool_size = sizeof(udp_request_t) + inst->max_packet_size + sizeof(radius_track_entry_t ***) + sizeof(fr_pair_t) + 20;
 
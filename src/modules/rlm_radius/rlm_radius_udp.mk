@@ -1,6 +1,6 @@
 TARGETNAME	:= rlm_radius_udp
 TARGET		:= $(TARGETNAME)$(L)
 
-SOURCES		:= rlm_radius_udp.c track.c
+SOURCES		:= rlm_radius_udp.c hedge.c track.c
 
 TGT_PREREQS	:= libfreeradius-radius$(L)
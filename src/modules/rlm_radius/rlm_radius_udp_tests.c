@@ -0,0 +1,243 @@
+/** Tests for the result shared by the copies of a hedged request
+ *
+ * @file src/modules/rlm_radius/rlm_radius_udp_tests.c
+ *
+ * @copyright 2024 The FreeRADIUS server project
+ */
+#include <freeradius-devel/util/acutest.h>
+#include <freeradius-devel/util/acutest_helpers.h>
+
+#include <freeradius-devel/server/trunk.h>
+#include <freeradius-devel/unlang/interpret.h>
+
+/*
+ *	There's no trunk or interpreter.  The trunk signals
+ *	call the module's callbacks directly, and we count
+ *	how many times the request is made runnable.
+ */
+static unsigned int test_runnable;
+
+static void test_mark_runnable(UNUSED request_t *request)
+{
+	test_runnable++;
+}
+
+static void test_signal_fail(trunk_request_t *treq);
+static void test_signal_complete(trunk_request_t *treq);
+
+#define unlang_interpret_mark_runnable	test_mark_runnable
+#define trunk_request_signal_fail	test_signal_fail
+#define trunk_request_signal_complete	test_signal_complete
+
+#include "rlm_radius_udp.c"
+
+static radius_track_entry_t	test_rr;
+
+/** Release the copy, as the trunk does before calling the module
+ *
+ */
+static void test_treq_release(trunk_request_t *treq)
+{
+	udp_request_t *u = talloc_get_type_abort(treq->preq, udp_request_t);
+
+	u->rr = NULL;
+}
+
+static void test_treq_free(trunk_request_t *treq)
+{
+	request_free(treq->request, treq->preq, NULL);
+	talloc_free(treq);
+}
+
+static void test_signal_fail(trunk_request_t *treq)
+{
+	test_treq_release(treq);
+	request_fail(treq->request, treq->preq, treq->rctx, treq->state, NULL);
+	test_treq_free(treq);
+}
+
+static void test_signal_complete(trunk_request_t *treq)
+{
+	test_treq_release(treq);
+	request_complete(treq->request, treq->preq, treq->rctx, NULL);
+	test_treq_free(treq);
+}
+
+typedef struct {
+	rlm_radius_t		parent;
+	rlm_radius_udp_t	inst;
+	udp_thread_t		thread;
+	udp_handle_t		*h;
+	connection_t		conn;
+	trunk_connection_t	tconn;
+} test_env_t;
+
+static test_env_t *test_env_alloc(TALLOC_CTX *ctx)
+{
+	test_env_t *env;
+
+	fr_time_start();
+
+	MEM(env = talloc_zero(ctx, test_env_t));
+	env->parent.hedge_percentile = 95;
+	env->inst.parent = &env->parent;
+	env->thread.inst = &env->inst;
+
+	/*
+	 *	Stops check_for_zombie() from queueing
+	 *	a status check.
+	 */
+	MEM(env->h = talloc_zero(env, udp_handle_t));
+	env->h->inst = &env->inst;
+	env->h->status_checking = true;
+
+	memcpy(&env->conn, &(connection_t){ .h = env->h }, sizeof(env->conn));
+	memcpy(&env->tconn, &(trunk_connection_t){ .conn = &env->conn }, sizeof(env->tconn));
+
+	return env;
+}
+
+/** Allocate a copy of the request which has been sent, and is waiting for a reply
+ *
+ */
+static trunk_request_t *test_copy_alloc(test_env_t *env, udp_result_t *r)
+{
+	trunk_request_t	*treq;
+	udp_request_t	*u;
+
+	MEM(u = talloc_zero(env, udp_request_t));
+	fr_pair_list_init(&u->extra);
+	u->rr = &test_rr;
+	u->retry.count = 1;
+	u->retry.start = fr_time();
+
+	MEM(treq = talloc_zero(env, trunk_request_t));
+	memcpy(treq, &(trunk_request_t){
+			.state = TRUNK_REQUEST_STATE_SENT,
+			.tconn = &env->tconn,
+			.preq = u,
+			.rctx = r
+		}, sizeof(*treq));
+
+	return treq;
+}
+
+static udp_result_t *test_result_alloc(test_env_t *env)
+{
+	udp_result_t *r;
+
+	MEM(r = talloc_zero(env, udp_result_t));
+	r->thread = &env->thread;
+	r->rcode = RLM_MODULE_NOT_SET;
+	r->treq = test_copy_alloc(env, r);
+	r->hedge = test_copy_alloc(env, r);
+
+	test_runnable = 0;
+
+	return r;
+}
+
+/** As request_demux() does when a reply arrives
+ *
+ */
+static void test_reply(udp_result_t *r, trunk_request_t *treq)
+{
+	if (!r->done) r->rcode = RLM_MODULE_OK;
+	trunk_request_signal_complete(treq);
+}
+
+static void test_hedge_primary_dropped(void)
+{
+	TALLOC_CTX	*ctx = talloc_init_const("udp_test");
+	test_env_t	*env = test_env_alloc(ctx);
+	udp_result_t	*r = test_result_alloc(env);
+	trunk_request_t	*hedge = r->hedge;
+
+	TEST_CASE("The primary timing out doesn't finish the request");
+	request_timeout(NULL, fr_time(), r->treq);
+	TEST_CHECK(r->treq == NULL);
+	TEST_CHECK(r->hedge == hedge);
+	TEST_CHECK(!r->done);
+	TEST_CHECK(test_runnable == 0);
+	TEST_MSG("Expected the request to wait for the hedge");
+
+	TEST_CASE("The timeout counts towards the hedge delay");
+	TEST_CHECK(env->thread.hedge.rtt_count == 1);
+
+	TEST_CASE("The hedge's reply is used");
+	test_reply(r, hedge);
+	TEST_CHECK(r->hedge == NULL);
+	TEST_CHECK(r->done);
+	TEST_CHECK(r->rcode == RLM_MODULE_OK);
+	TEST_CHECK(test_runnable == 1);
+
+	talloc_free(ctx);
+}
+
+static void test_hedge_hedge_dropped(void)
+{
+	TALLOC_CTX	*ctx = talloc_init_const("udp_test");
+	test_env_t	*env = test_env_alloc(ctx);
+	udp_result_t	*r = test_result_alloc(env);
+
+	TEST_CASE("The hedge timing out doesn't finish the request");
+	request_timeout(NULL, fr_time(), r->hedge);
+	TEST_CHECK(r->hedge == NULL);
+	TEST_CHECK(!r->done);
+	TEST_CHECK(test_runnable == 0);
+
+	TEST_CASE("The primary's reply is used");
+	test_reply(r, r->treq);
+	TEST_CHECK(r->done);
+	TEST_CHECK(r->rcode == RLM_MODULE_OK);
+	TEST_CHECK(test_runnable == 1);
+
+	talloc_free(ctx);
+}
+
+static void test_hedge_both_dropped(void)
+{
+	TALLOC_CTX	*ctx = talloc_init_const("udp_test");
+	test_env_t	*env = test_env_alloc(ctx);
+	udp_result_t	*r = test_result_alloc(env);
+
+	TEST_CASE("The request fails once both copies have timed out");
+	request_timeout(NULL, fr_time(), r->treq);
+	TEST_CHECK(test_runnable == 0);
+	request_timeout(NULL, fr_time(), r->hedge);
+	TEST_CHECK(r->done);
+	TEST_CHECK(r->rcode == RLM_MODULE_FAIL);
+	TEST_CHECK(test_runnable == 1);
+
+	talloc_free(ctx);
+}
+
+static void test_hedge_late_reply(void)
+{
+	TALLOC_CTX	*ctx = talloc_init_const("udp_test");
+	test_env_t	*env = test_env_alloc(ctx);
+	udp_result_t	*r = test_result_alloc(env);
+	trunk_request_t	*primary = r->treq;
+
+	TEST_CASE("The first reply wins");
+	test_reply(r, r->hedge);
+	TEST_CHECK(r->done);
+	TEST_CHECK(test_runnable == 1);
+
+	TEST_CASE("A reply to the other copy only releases it");
+	test_reply(r, primary);
+	TEST_CHECK(r->treq == NULL);
+	TEST_CHECK(r->rcode == RLM_MODULE_OK);
+	TEST_CHECK(test_runnable == 1);
+
+	talloc_free(ctx);
+}
+
+TEST_LIST = {
+	{ "hedge_primary_dropped",	test_hedge_primary_dropped },
+	{ "hedge_hedge_dropped",	test_hedge_hedge_dropped },
+	{ "hedge_both_dropped",		test_hedge_both_dropped },
+	{ "hedge_late_reply",		test_hedge_late_reply },
+
+	{ NULL }
+};
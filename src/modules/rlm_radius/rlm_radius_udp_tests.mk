@@ -0,0 +1,8 @@
+TARGET		:= rlm_radius_udp_tests$(E)
+SOURCES		:= rlm_radius_udp_tests.c hedge.c track.c
+
+TGT_LDLIBS	:= $(LIBS) $(GPERFTOOLS_LIBS)
+TGT_LDFLAGS	:= $(LDFLAGS) $(GPERFTOOLS_LDFLAGS)
+TGT_PREREQS	:= libfreeradius-util$(L) libfreeradius-radius$(L) libfreeradius-io$(L) libfreeradius-server$(L) libfreeradius-unlang$(L)
+
+TGT_INSTALLDIR	:=
@@ -24,7 +24,6 @@
 RCSID("$Id$")
 
 #include <freeradius-devel/server/base.h>
-#include <freeradius-devel/util/rb.h>
 #include <freeradius-devel/io/application.h>
 #include <freeradius-devel/util/dlist.h>
 #include <freeradius-devel/util/debug.h>
@@ -32,6 +31,8 @@ RCSID("$Id$")
 #include "track.h"
 #include "rlm_radius.h"
 
+FR_SLAB_FUNCS(radius_track, radius_track_entry_t)
+
 /** Create an radius_track_t
  *
  * @param ctx the talloc ctx
@@ -63,17 +64,43 @@ radius_track_t *radius_track_alloc(TALLOC_CTX *ctx)
 }
 
 
-/** Compare two radius_track_entry_t
+/** Return the bucket an entry with the given Request Authenticator lives in
+ *
+ * Request Authenticators are either random, or the output of MD5, so
+ * any byte of them is a good enough hash.
+ */
+static inline CC_HINT(always_inline)
+radius_track_entry_t **radius_track_bucket(radius_track_t *tt, uint8_t id, uint8_t const *vector)
+{
+	return &tt->bucket[id][vector[RADIUS_AUTH_VECTOR_LENGTH - 1] & (RADIUS_TRACK_BUCKETS - 1)];
+}
+
+/** Add an entry to the head of its authenticator bucket
  *
  */
-static int8_t te_cmp(void const *one, void const *two)
+static inline CC_HINT(always_inline)
+void radius_track_bucket_insert(radius_track_t *tt, radius_track_entry_t *te)
 {
-	radius_track_entry_t const *a = one;
-	radius_track_entry_t const *b = two;
-	int ret;
+	radius_track_entry_t **head = radius_track_bucket(tt, te->id, te->vector);
 
-	ret = memcmp(a->vector, b->vector, sizeof(a->vector));
-	return CMP(ret, 0);
+	te->next = *head;
+	if (te->next) te->next->prev_p = &te->next;
+	te->prev_p = head;
+	*head = te;
+}
+
+/** Remove an entry from its authenticator bucket, if it's in one
+ *
+ */
+static inline CC_HINT(always_inline)
+void radius_track_bucket_remove(radius_track_entry_t *te)
+{
+	if (!te->prev_p) return;
+
+	*te->prev_p = te->next;
+	if (te->next) te->next->prev_p = te->prev_p;
+	te->next = NULL;
+	te->prev_p = NULL;
 }
 
 /** Ensures the entry is released when the ctx passed to radius_track_entry_reserve is freed
@@ -117,26 +144,9 @@ int radius_track_entry_reserve(
 
 	if (!fr_cond_assert_msg(!*te_out, "Expected tracking entry to be NULL")) return -1;
 
-retry:
-	te = fr_dlist_head(&tt->free_list);
+	te = fr_dlist_pop_head(&tt->free_list);
 	if (te) {
 		fr_assert(te->request == NULL);
-
-		/*
-		 *	Mark it as used, and remove it from the free list.
-		 */
-		fr_dlist_remove(&tt->free_list, te);
-
-		/*
-		 *	We've transitioned from "use it", to "oops,
-		 *	don't use it".  Ensure that we only return IDs
-		 *	which are in the static array.
-		 */
-		if (!tt->use_authenticator && (te != &tt->id[te->id])) {
-			talloc_free(te);
-			goto retry;
-		}
-
 		goto done;
 	}
 
@@ -150,27 +160,23 @@ retry:
 	}
 
 	/*
-	 *	Get a new ID.  It's value doesn't matter at this
-	 *	point.
-	 */
-	tt->next_id++;
-	tt->next_id &= 0xff;
-
-	/*
-	 *	If needed, allocate a subtree.
+	 *	Every ID is in use, so get an entry from the slab.
+	 *	Entries are told apart by the Request Authenticator,
+	 *	so the ID's value doesn't matter at this point.
 	 */
-	if (!tt->subtree[tt->next_id]) {
-		MEM(tt->subtree[tt->next_id] = fr_rb_inline_talloc_alloc(tt, radius_track_entry_t, node,
-									 te_cmp, NULL));
+	te = radius_track_slab_reserve(tt->slab);
+	if (!te) {
+		fr_strerror_const("No free entries");
+		return -1;
 	}
 
-	/*
-	 *	Allocate a new one, and insert it into the appropriate subtree.
-	 */
-	te = talloc_zero(tt, radius_track_entry_t);
+	tt->next_id++;
+	tt->next_id &= 0xff;
 	te->id = tt->next_id;
 
 done:
+	te->next = NULL;
+	te->prev_p = NULL;
 	te->tt = tt;
 	te->request = request;
 	te->uctx = uctx;
@@ -236,47 +242,21 @@ int radius_track_entry_release(
 	tt->num_requests--;
 
 	/*
-	 *	We're freeing a static ID, just go do that...
-	 */
-	if (te == &tt->id[te->id]) {
-		/*
-		 *	This entry MAY be in a subtree.  If so, delete
-		 *	it.
-		 */
-		if (tt->subtree[te->id]) (void) fr_rb_delete(tt->subtree[te->id], te);
-
-		goto done;
-	}
-
-	/*
-	 *	At this point, it MUST be talloc'd.
-	 */
-	(void) talloc_get_type_abort(te, radius_track_entry_t);
-
-	/*
-	 *	Delete it from the tracking subtree.
+	 *	Must be done before the entry goes back on
+	 *	the free list, as that overwrites the vector.
 	 */
-	fr_assert(tt->subtree[te->id] != NULL);
-	(void) fr_rb_delete(tt->subtree[te->id], te);
+	radius_track_bucket_remove(te);
 
 	/*
-	 *	Try to free memory if the system gets idle.  If the
-	 *	system is busy, we will try to keep entries in the
-	 *	free list.  If the system becomes completely idle, we
-	 *	will clear the free list.
+	 *	Entries from the static array go back on the
+	 *	free list, everything else goes back to the slab.
 	 */
-	if (fr_dlist_num_elements(&tt->free_list) > tt->num_requests) {
-		talloc_free(te);
-		*te_to_free = NULL;
-		return 0;
+	if (te == &tt->id[te->id]) {
+		fr_dlist_insert_tail(&tt->free_list, te);
+	} else {
+		radius_track_slab_release(te);
 	}
 
-	/*
-	 *	Otherwise put it back on the free list.
-	 */
-done:
-	fr_dlist_insert_tail(&tt->free_list, te);
-
 	*te_to_free = NULL;
 
 	return 0;
@@ -299,7 +279,7 @@ int radius_track_entry_update(radius_track_entry_t *te, uint8_t const *vector)
 	/*
 	 *	The authentication vector may have changed.
 	 */
-	if (tt->subtree[te->id]) (void) fr_rb_delete(tt->subtree[te->id], te);
+	radius_track_bucket_remove(te);
 
 	memcpy(te->vector, vector, sizeof(te->vector));
 
@@ -315,13 +295,13 @@ int radius_track_entry_update(radius_track_entry_t *te, uint8_t const *vector)
 	}
 
 	/*
-	 *	Insert it into the tree of authenticators
+	 *	Insert it into the authenticator buckets
 	 *
 	 *	We do this even if it was allocated from the static
 	 *	array.  That way if the server responds with
 	 *	Original-Request-Authenticator, we can easily find it.
 	 */
-	if (!fr_rb_insert(tt->subtree[te->id], te)) return -1;
+	radius_track_bucket_insert(tt, te);
 
 	return 0;
 }
@@ -337,7 +317,7 @@ int radius_track_entry_update(radius_track_entry_t *te, uint8_t const *vector)
  */
 radius_track_entry_t *radius_track_entry_find(radius_track_t *tt, uint8_t packet_id, uint8_t const *vector)
 {
-	radius_track_entry_t my_te, *te;
+	radius_track_entry_t *te;
 
 	(void) talloc_get_type_abort(tt, radius_track_t);
 
@@ -360,11 +340,12 @@ radius_track_entry_t *radius_track_entry_find(radius_track_t *tt, uint8_t packet
 	}
 
 	/*
-	 *	The entry MAY be in the subtree!
+	 *	The entry MAY be in the buckets!  There are
+	 *	usually only a few entries in each.
 	 */
-	memcpy(&my_te.vector, vector, sizeof(my_te.vector));
-
-	te = fr_rb_find(tt->subtree[packet_id], &my_te);
+	for (te = *radius_track_bucket(tt, packet_id, vector); te; te = te->next) {
+		if (memcmp(te->vector, vector, sizeof(te->vector)) == 0) break;
+	}
 
 	/*
 	 *	Not found, the packet MAY have been allocated in the
@@ -393,7 +374,6 @@ radius_track_entry_t *radius_track_entry_find(radius_track_t *tt, uint8_t packet
 		return te;
 	}
 
-	(void) talloc_get_type_abort(te, radius_track_entry_t);
 	fr_assert(te->request != NULL);
 
 	return te;
@@ -410,6 +390,23 @@ void radius_track_use_authenticator(radius_track_t *tt, bool flag)
 	(void) talloc_get_type_abort(tt, radius_track_t);
 
 	tt->use_authenticator = flag;
+
+	if (!flag || tt->bucket) return;
+
+	/*
+	 *	Slabs cover, on average, one outstanding request
+	 *	per ID per bucket.  This isn't a limit, past it
+	 *	entries are allocated individually, and freed
+	 *	when released.
+	 */
+	MEM(tt->bucket = talloc_zero_array(tt, radius_track_bucket_t, UINT8_MAX + 1));
+	MEM(tt->slab = radius_track_slab_list_alloc(tt, NULL,
+						    &(fr_slab_config_t){
+							.elements_per_slab = UINT8_MAX + 1,
+							.max_elements = (UINT8_MAX + 1) * (RADIUS_TRACK_BUCKETS - 1),
+							.at_max_fail = false
+						    },
+						    NULL, NULL, NULL, false, true));
 }
 
 #ifndef NDEBUG
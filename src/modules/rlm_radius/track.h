@@ -26,6 +26,9 @@
 
 #include "rlm_radius.h"
 #include <freeradius-devel/util/dlist.h>
+#include <freeradius-devel/util/slab.h>
+
+#define RADIUS_TRACK_BUCKETS	8		//!< Request Authenticator buckets per ID.  Must be a power of 2.
 
 typedef struct radius_track_entry_s radius_track_entry_t;
 typedef struct radius_track_s radius_track_t;
@@ -34,7 +37,8 @@ typedef struct radius_track_s radius_track_t;
  *
  */
 struct radius_track_entry_s {
-	fr_rb_node_t	node;			//!< Entry in the tracking tree.
+	radius_track_entry_t *next;		//!< Next entry in the same authenticator bucket.
+	radius_track_entry_t **prev_p;		//!< What points to us.  NULL if we're not in a bucket.
 
 	radius_track_t	*tt;
 
@@ -61,17 +65,28 @@ struct radius_track_entry_s {
 #endif
 };
 
+FR_SLAB_TYPES(radius_track, radius_track_entry_t)
+
+typedef radius_track_entry_t *radius_track_bucket_t[RADIUS_TRACK_BUCKETS];
+
 struct radius_track_s {
 	unsigned int	num_requests;  		//!< number of requests in the allocation
 
-	fr_dlist_head_t	free_list;     		//!< so we allocate by least recently used
+	fr_dlist_head_t	free_list;     		//!< Entries from the static array, so we allocate
+						///< by least recently used.
 
 	bool		use_authenticator;	//!< whether to use the request authenticator as an ID
 	int		next_id;		//!< next ID to allocate
 
 	radius_track_entry_t	id[UINT8_MAX + 1];	//!< which ID was used
 
-	fr_rb_tree_t	*subtree[UINT8_MAX + 1];	//!< for Original-Request-Authenticator
+	radius_track_bucket_t	*bucket;	//!< Entries indexed by ID then by a hash of the
+						///< Request Authenticator, for when the server
+						///< supports Original-Request-Authenticator.
+						///< Allocated when use_authenticator is first set.
+
+	radius_track_slab_list_t *slab;		//!< Entries used once all the IDs in the static
+						///< array are in use.
 
 #ifndef NDEBUG
 	uint64_t	operation;		//!< Incremented each alloc and de-alloc
@@ -0,0 +1,274 @@
+/** Tests for RADIUS client packet tracking
+ *
+ * @file src/modules/rlm_radius/track_tests.c
+ *
+ * @copyright 2024 The FreeRADIUS server project
+ */
+#include <freeradius-devel/util/acutest.h>
+#include <freeradius-devel/util/acutest_helpers.h>
+#include <freeradius-devel/util/rand.h>
+#include <freeradius-devel/util/rb.h>
+#include <freeradius-devel/util/time.h>
+
+/*
+ *	Gives the tests access to the internals
+ *	of radius_track_t.
+ */
+#include "track.c"
+
+/*
+ *	The tracker only stores the request pointer.
+ */
+static request_t *test_request = (request_t *)&test_request;
+
+static void populate_vector(uint8_t vector[static RADIUS_AUTH_VECTOR_LENGTH])
+{
+	size_t i;
+
+	for (i = 0; i < RADIUS_AUTH_VECTOR_LENGTH; i += sizeof(uint32_t)) {
+		uint32_t r = fr_rand();
+
+		memcpy(vector + i, &r, sizeof(r));
+	}
+}
+
+/** Without the Request Authenticator we're limited to 256 outstanding packets
+ *
+ */
+static void test_track_static(void)
+{
+	radius_track_t		*tt;
+	radius_track_entry_t	*te[UINT8_MAX + 2] = { NULL };
+	size_t			i;
+
+	tt = radius_track_alloc(NULL);
+	TEST_ASSERT(tt != NULL);
+
+	for (i = 0; i <= UINT8_MAX; i++) {
+		TEST_CHECK(radius_track_entry_reserve(&te[i], NULL, tt, test_request, FR_RADIUS_CODE_ACCESS_REQUEST, NULL) == 0);
+		TEST_CHECK(te[i] == &tt->id[te[i]->id]);
+	}
+	TEST_CHECK(radius_track_entry_reserve(&te[i], NULL, tt, test_request, FR_RADIUS_CODE_ACCESS_REQUEST, NULL) < 0);
+	TEST_CHECK(tt->num_requests == UINT8_MAX + 1);
+
+	for (i = 0; i <= UINT8_MAX; i++) {
+		TEST_CHECK(radius_track_entry_find(tt, te[i]->id, NULL) == te[i]);
+	}
+
+	for (i = 0; i <= UINT8_MAX; i++) {
+		uint8_t id = te[i]->id;
+
+		TEST_CHECK(radius_track_entry_release(&te[i]) == 0);
+		TEST_CHECK(te[i] == NULL);
+		TEST_CHECK(radius_track_entry_find(tt, id, NULL) == NULL);
+	}
+	TEST_CHECK(tt->num_requests == 0);
+
+	talloc_free(tt);
+}
+
+#define TRACK_AUTH_COUNT	((UINT8_MAX + 1) * RADIUS_TRACK_BUCKETS)
+
+/** With the Request Authenticator entries are found by ID and vector
+ *
+ */
+static void test_track_authenticator(void)
+{
+	radius_track_t		*tt;
+	radius_track_entry_t	*te[TRACK_AUTH_COUNT + 1] = { NULL };
+	uint8_t			vector[TRACK_AUTH_COUNT][RADIUS_AUTH_VECTOR_LENGTH];
+	uint8_t			other[RADIUS_AUTH_VECTOR_LENGTH];
+	size_t			i;
+
+	tt = radius_track_alloc(NULL);
+	TEST_ASSERT(tt != NULL);
+	radius_track_use_authenticator(tt, true);
+
+	for (i = 0; i < TRACK_AUTH_COUNT; i++) {
+		TEST_CHECK(radius_track_entry_reserve(&te[i], NULL, tt, test_request, FR_RADIUS_CODE_ACCESS_REQUEST, NULL) == 0);
+		TEST_MSG("failed reserving entry %zu - %s", i, fr_strerror());
+		populate_vector(vector[i]);
+		TEST_CHECK(radius_track_entry_update(te[i], vector[i]) == 0);
+	}
+	TEST_CHECK(tt->num_requests == TRACK_AUTH_COUNT);
+
+	/*
+	 *	The slabs are full, but that's not a limit on
+	 *	the number of outstanding requests.
+	 */
+	TEST_CHECK(radius_track_slab_num_elements_used(tt->slab) == (UINT8_MAX + 1) * (RADIUS_TRACK_BUCKETS - 1));
+	TEST_CHECK(radius_track_entry_reserve(&te[i], NULL, tt, test_request, FR_RADIUS_CODE_ACCESS_REQUEST, NULL) == 0);
+	TEST_MSG("failed reserving entry past the slab limit - %s", fr_strerror());
+	TEST_CHECK(tt->num_requests == TRACK_AUTH_COUNT + 1);
+	TEST_CHECK(radius_track_slab_num_elements_used(tt->slab) == (UINT8_MAX + 1) * (RADIUS_TRACK_BUCKETS - 1));
+	TEST_CHECK(radius_track_entry_release(&te[i]) == 0);
+	TEST_CHECK(tt->num_requests == TRACK_AUTH_COUNT);
+
+	for (i = 0; i < TRACK_AUTH_COUNT; i++) {
+		TEST_CHECK(radius_track_entry_find(tt, te[i]->id, vector[i]) == te[i]);
+		TEST_MSG("failed finding entry %zu", i);
+	}
+
+	/*
+	 *	Vectors which weren't sent don't match.
+	 */
+	populate_vector(other);
+	TEST_CHECK(radius_track_entry_find(tt, te[0]->id, other) == NULL);
+
+	/*
+	 *	Changing the vector moves the entry.
+	 */
+	TEST_CHECK(radius_track_entry_update(te[0], other) == 0);
+	TEST_CHECK(radius_track_entry_find(tt, te[0]->id, other) == te[0]);
+	TEST_CHECK(radius_track_entry_find(tt, te[0]->id, vector[0]) == NULL);
+	memcpy(vector[0], other, sizeof(other));
+
+	/*
+	 *	Release every other entry, the rest must
+	 *	still be found.
+	 */
+	for (i = 0; i < TRACK_AUTH_COUNT; i += 2) {
+		uint8_t id = te[i]->id;
+
+		TEST_CHECK(radius_track_entry_release(&te[i]) == 0);
+		TEST_CHECK(radius_track_entry_find(tt, id, vector[i]) == NULL);
+	}
+	for (i = 1; i < TRACK_AUTH_COUNT; i += 2) {
+		TEST_CHECK(radius_track_entry_find(tt, te[i]->id, vector[i]) == te[i]);
+		TEST_CHECK(radius_track_entry_release(&te[i]) == 0);
+	}
+	TEST_CHECK(tt->num_requests == 0);
+	TEST_CHECK(radius_track_slab_num_elements_used(tt->slab) == 0);
+
+	talloc_free(tt);
+}
+
+/*
+ *	The previous tracker, a tree per ID of talloced
+ *	entries, for comparison.
+ */
+typedef struct {
+	fr_rb_node_t	node;
+	uint8_t		id;
+	uint8_t		vector[RADIUS_AUTH_VECTOR_LENGTH];
+} tree_entry_t;
+
+static int8_t tree_entry_cmp(void const *one, void const *two)
+{
+	tree_entry_t const *a = one, *b = two;
+	int ret;
+
+	ret = memcmp(a->vector, b->vector, sizeof(a->vector));
+	return CMP(ret, 0);
+}
+
+#define TRACK_CMP_CYCLES	(1000000)
+
+typedef uint8_t track_vector_t[RADIUS_AUTH_VECTOR_LENGTH];
+
+/** Compare the cost of a reserve, update, find, release cycle
+ *
+ * @param[in] outstanding	Number of requests in flight.
+ */
+static void track_cmp(unsigned int outstanding)
+{
+	track_vector_t	*vector;
+	unsigned int	i, slot;
+
+	vector = talloc_array(NULL, track_vector_t, TRACK_CMP_CYCLES);
+	for (i = 0; i < TRACK_CMP_CYCLES; i++) populate_vector(vector[i]);
+
+	{
+		fr_rb_tree_t	*subtree[UINT8_MAX + 1];
+		tree_entry_t	**te, find;
+		fr_time_t	start, end;
+		uint8_t		next_id = 0;
+
+		for (i = 0; i <= UINT8_MAX; i++) {
+			subtree[i] = fr_rb_inline_talloc_alloc(NULL, tree_entry_t, node, tree_entry_cmp, NULL);
+		}
+		te = talloc_zero_array(NULL, tree_entry_t *, outstanding);
+
+		start = fr_time();
+		for (i = 0; i < TRACK_CMP_CYCLES; i++) {
+			slot = i % outstanding;
+
+			if (te[slot]) {
+				memcpy(find.vector, te[slot]->vector, sizeof(find.vector));
+				TEST_CHECK(fr_rb_find(subtree[te[slot]->id], &find) == te[slot]);
+				fr_rb_delete(subtree[te[slot]->id], te[slot]);
+				talloc_free(te[slot]);
+			}
+
+			te[slot] = talloc_zero(NULL, tree_entry_t);
+			te[slot]->id = next_id++;
+			memcpy(te[slot]->vector, vector[i], sizeof(te[slot]->vector));
+			fr_rb_insert(subtree[te[slot]->id], te[slot]);
+		}
+		end = fr_time();
+
+		TEST_MSG_ALWAYS("\noutstanding: %u\n", outstanding);
+		TEST_MSG_ALWAYS("tree: %"PRIu64" μs\n", fr_time_delta_unwrap(fr_time_sub(end, start)) / 1000);
+
+		for (i = 0; i < outstanding; i++) talloc_free(te[i]);
+		for (i = 0; i <= UINT8_MAX; i++) talloc_free(subtree[i]);
+		talloc_free(te);
+	}
+
+	{
+		radius_track_t		*tt;
+		radius_track_entry_t	**te;
+		fr_time_t		start, end;
+
+		tt = radius_track_alloc(NULL);
+		radius_track_use_authenticator(tt, true);
+		te = talloc_zero_array(NULL, radius_track_entry_t *, outstanding);
+
+		start = fr_time();
+		for (i = 0; i < TRACK_CMP_CYCLES; i++) {
+			slot = i % outstanding;
+
+			if (te[slot]) {
+				TEST_CHECK(radius_track_entry_find(tt, te[slot]->id, te[slot]->vector) == te[slot]);
+				radius_track_entry_release(&te[slot]);
+			}
+
+			TEST_CHECK(radius_track_entry_reserve(&te[slot], NULL, tt, test_request,
+							      FR_RADIUS_CODE_ACCESS_REQUEST, NULL) == 0);
+			radius_track_entry_update(te[slot], vector[i]);
+		}
+		end = fr_time();
+
+		TEST_MSG_ALWAYS("table: %"PRIu64" μs\n", fr_time_delta_unwrap(fr_time_sub(end, start)) / 1000);
+
+		for (i = 0; i < outstanding; i++) radius_track_entry_release(&te[i]);
+		talloc_free(te);
+		talloc_free(tt);
+	}
+
+	talloc_free(vector);
+}
+
+static void track_cmp_256(void)
+{
+	track_cmp(256);
+}
+
+static void track_cmp_1024(void)
+{
+	track_cmp(1024);
+}
+
+static void track_cmp_2048(void)
+{
+	track_cmp(2048);
+}
+
+TEST_LIST = {
+	{ "test_track_static",		test_track_static },
+	{ "test_track_authenticator",	test_track_authenticator },
+	{ "track_cmp_256",		track_cmp_256 },
+	{ "track_cmp_1024",		track_cmp_1024 },
+	{ "track_cmp_2048",		track_cmp_2048 },
+	{ NULL }
+};
@@ -0,0 +1,8 @@
+TARGET		:= track_tests$(E)
+SOURCES		:= track_tests.c
+
+TGT_LDLIBS	:= $(LIBS) $(GPERFTOOLS_LIBS)
+TGT_LDFLAGS	:= $(LDFLAGS) $(GPERFTOOLS_LDFLAGS)
+TGT_PREREQS	:= libfreeradius-util$(L) libfreeradius-radius$(L) libfreeradius-server$(L)
+
+TGT_INSTALLDIR	:=
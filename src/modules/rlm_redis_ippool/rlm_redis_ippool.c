@@ -55,6 +55,85 @@ RCSID("$Id$")
 
 #include "redis_ippool.h"
 
+#include <unistd.h>
+
+/** Lease reservoir configuration
+ *
+ */
+typedef struct {
+	uint32_t		size;		//!< How many leases to claim from a pool in one go.
+						//!< 0 disables the reservoir.
+
+	fr_time_delta_t		hold_time;	//!< How long claimed leases are held in Redis before
+						//!< they're returned to the pool.
+
+	bool			check_owner;	//!< Check whether the owner already has a lease before
+						//!< using the reservoir.
+} ippool_reservoir_conf_t;
+
+/** What happened to a lease handed out from a reservoir
+ *
+ */
+typedef enum {
+	IPPOOL_RESERVOIR_LEASE_PENDING = 0,	//!< Waiting to be committed.
+	IPPOOL_RESERVOIR_LEASE_COMMITTED,	//!< Recorded against its owner in Redis.
+	IPPOOL_RESERVOIR_LEASE_LOST,		//!< The hold lapsed, and another server allocated it.
+	IPPOOL_RESERVOIR_LEASE_FAILED		//!< The commit failed, so the lease's state is unknown.
+} ippool_reservoir_lease_state_t;
+
+/** A lease claimed from a pool, held in a reservoir
+ *
+ */
+typedef struct {
+	fr_dlist_t		entry;		//!< Entry in the reservoir's free, pending or committing list.
+
+	char			*ip;		//!< Pool member, as returned by Redis.
+	char			*range;		//!< Range identifier.  May be NULL.
+	fr_time_t		held_until;	//!< When the hold on the lease in Redis lapses.
+
+	char			*owner;		//!< Owner the lease was handed out to.
+	char			*gateway;	//!< Gateway of the owner.
+	uint32_t		expires;	//!< When the handed out lease expires (seconds since epoch).
+
+	bool			committed;	//!< Set by ippool_reservoir_commit() if Redis recorded the owner.
+	ippool_reservoir_lease_state_t	state;	//!< Set by ippool_reservoir_commit_done().
+} ippool_reservoir_lease_t;
+
+/** Leases claimed from a single pool
+ *
+ */
+typedef struct {
+	fr_rb_node_t		node;		//!< Entry in the tree of reservoirs.
+
+	char			*pool_name;	//!< Pool the leases were claimed from.
+	size_t			pool_name_len;	//!< Length of the pool name.
+
+	fr_dlist_head_t		free;		//!< Leases which can be handed out.
+	fr_dlist_head_t		pending;	//!< Leases handed out, but not yet committed.
+	fr_dlist_head_t		committing;	//!< Leases being committed.  Not modified until
+						///< the commit completes.
+
+	bool			filling;	//!< A worker is claiming more leases from the pool.
+} ippool_reservoir_t;
+
+/** Reservoirs shared by all threads using a module instance
+ *
+ * Leases handed out by one thread may be renewed or released by another,
+ * so the reservoirs are per-instance, and all access is serialised.
+ */
+typedef struct {
+	pthread_mutex_t		mutex;		//!< Protects the tree, and the reservoirs in it.
+						///< Never held while waiting for Redis.
+
+	pthread_cond_t		cond;		//!< Signalled when a commit or fill completes.
+
+	fr_rb_tree_t		*tree;		//!< Reservoirs, one per pool name.
+
+	char			*id;		//!< Written as the device of leases claimed for
+						///< the reservoirs, so they're visible to
+						///< rlm_redis_ippool_tool.
+} ippool_reservoirs_t;
+
 /** rlm_redis module instance
  *
  */
@@ -75,9 +154,21 @@ typedef struct {
 	bool			copy_on_update; //!< Copy the address provided by ip_address to the
 						//!< allocated_address_attr if updates are successful.
 
+	ippool_reservoir_conf_t	reservoir;	//!< Local lease reservoir configuration.
+
+	ippool_reservoirs_t	*reservoirs;	//!< Leases claimed from pools.  NULL if the
+						///< reservoir is disabled.
+
 	fr_redis_cluster_t	*cluster;	//!< Redis cluster.
 } rlm_redis_ippool_t;
 
+static conf_parser_t reservoir_config[] = {
+	{ FR_CONF_OFFSET("size", ippool_reservoir_conf_t, size), .dflt = "0" },
+	{ FR_CONF_OFFSET("hold_time", ippool_reservoir_conf_t, hold_time), .dflt = "30" },
+	{ FR_CONF_OFFSET("check_owner", ippool_reservoir_conf_t, check_owner), .dflt = "no" },
+	CONF_PARSER_TERMINATOR
+};
+
 static conf_parser_t redis_config[] = {
 	REDIS_COMMON_CONFIG,
 	CONF_PARSER_TERMINATOR
@@ -94,6 +185,8 @@ static conf_parser_t module_config[] = {
 	{ FR_CONF_OFFSET("ipv4_integer", rlm_redis_ippool_t, ipv4_integer) },
 	{ FR_CONF_OFFSET("copy_on_update", rlm_redis_ippool_t, copy_on_update), .dflt = "yes", .quote = T_BARE_WORD },
 
+	{ FR_CONF_OFFSET_SUBSECTION("reservoir", 0, rlm_redis_ippool_t, reservoir, reservoir_config) },
+
 	/*
 	 *	Split out to allow conversion to universal ippool module with
 	 *	minimum of config changes.
@@ -455,6 +548,135 @@ static char lua_release_cmd[] =
 	"}";										/* 25 */
 static char lua_release_digest[(SHA1_DIGEST_LENGTH * 2) + 1];
 
+/** Lua script for claiming a block of leases for a reservoir
+ *
+ * - KEYS[1] The pool name.
+ * - ARGV[1] Wall time (seconds since epoch).
+ * - ARGV[2] Hold time (seconds).
+ * - ARGV[3] Reservoir identifier.
+ * - ARGV[4] Maximum number of leases to claim.
+ *
+ * The reservoir identifier is recorded as the device of each claimed
+ * lease, so they show up as allocated to the reservoir.
+ *
+ * Returns @verbatim array { <rcode>[, <ip>, <range>]... } @endverbatim
+ * - IPPOOL_RCODE_SUCCESS leases claimed.
+ * - IPPOOL_RCODE_POOL_EMPTY no free leases in pool.
+ */
+static char lua_reserve_cmd[] =
+	"local ips" EOL									/* 1 */
+	"local ret" EOL									/* 2 */
+
+	"local pool_key" EOL								/* 3 */
+	"local address_key" EOL								/* 4 */
+
+	/*
+	 *	Get the addresses which expired the longest time ago.
+	 *	Static leases have the static bit set, so are never
+	 *	less than the current time.
+	 */
+	"pool_key = '{' .. KEYS[1] .. '}:"IPPOOL_POOL_KEY"'" EOL			/* 5 */
+	"ips = redis.call('ZRANGEBYSCORE', pool_key, '-inf', '(' .. ARGV[1], 'LIMIT', 0, ARGV[4])" EOL	/* 6 */
+	"if #ips == 0 then" EOL								/* 7 */
+	"  return {" STRINGIFY(_IPPOOL_RCODE_POOL_EMPTY) "}" EOL			/* 8 */
+	"end" EOL									/* 9 */
+
+	"ret = {" STRINGIFY(_IPPOOL_RCODE_SUCCESS) "}" EOL				/* 10 */
+	"for _, ip in ipairs(ips) do" EOL						/* 11 */
+	"  address_key = '{' .. KEYS[1] .. '}:"IPPOOL_ADDRESS_KEY":' .. ip" EOL		/* 12 */
+	"  redis.call('ZADD', pool_key, 'XX', ARGV[1] + ARGV[2], ip)" EOL		/* 13 */
+	"  redis.call('HSET', address_key, 'device', ARGV[3])" EOL			/* 14 */
+	"  ret[#ret + 1] = ip" EOL							/* 15 */
+	"  ret[#ret + 1] = redis.call('HGET', address_key, 'range')" EOL		/* 16 */
+	"end" EOL									/* 17 */
+	"return ret" EOL;								/* 18 */
+static char lua_reserve_digest[(SHA1_DIGEST_LENGTH * 2) + 1];
+
+/** Lua script for committing leases handed out from a reservoir
+ *
+ * - KEYS[1] The pool name.
+ * - ARGV[1] Wall time (seconds since epoch).
+ * - ARGV[2] Reservoir identifier.
+ * - ARGV[3] Leases, as a sequence of <len>:<value> encoded
+ *   ip, owner, gateway and expiry (seconds since epoch) fields.
+ *
+ * Leases which are no longer held by the reservoir are skipped.
+ * The check and the update are atomic, so a lease is never given
+ * to two owners.
+ *
+ * Returns @verbatim array { <rcode>[, <committed>]... } @endverbatim
+ * - IPPOOL_RCODE_SUCCESS, then 1 for each lease committed, and 0 for each
+ *   lease skipped, in the order they were passed in.
+ */
+static char lua_commit_cmd[] =
+	"local pos = 1" EOL								/* 1 */
+	"local ret = {" STRINGIFY(_IPPOOL_RCODE_SUCCESS) "}" EOL			/* 2 */
+
+	"local pool_key" EOL								/* 3 */
+	"local address_key" EOL								/* 4 */
+	"local owner_key" EOL								/* 5 */
+
+	"local function field()" EOL							/* 6 */
+	"  local sep = string.find(ARGV[3], ':', pos, true)" EOL			/* 7 */
+	"  local len = tonumber(string.sub(ARGV[3], pos, sep - 1))" EOL			/* 8 */
+	"  pos = sep + len + 1" EOL							/* 9 */
+	"  return string.sub(ARGV[3], sep + 1, sep + len)" EOL				/* 10 */
+	"end" EOL									/* 11 */
+
+	"pool_key = '{' .. KEYS[1] .. '}:"IPPOOL_POOL_KEY"'" EOL			/* 12 */
+	"while pos <= #ARGV[3] do" EOL							/* 13 */
+	"  local ip = field()" EOL							/* 14 */
+	"  local owner = field()" EOL							/* 15 */
+	"  local gateway = field()" EOL							/* 16 */
+	"  local expires = tonumber(field())" EOL					/* 17 */
+	"  address_key = '{' .. KEYS[1] .. '}:"IPPOOL_ADDRESS_KEY":' .. ip" EOL		/* 18 */
+	"  if redis.call('HGET', address_key, 'device') == ARGV[2] then" EOL		/* 19 */
+	"    redis.call('ZADD', pool_key, 'XX', expires, ip)" EOL			/* 20 */
+	"    redis.call('HMSET', address_key, 'device', owner, 'gateway', gateway)" EOL	/* 21 */
+	"    redis.call('HINCRBY', address_key, 'counter', 1)" EOL			/* 22 */
+	"    owner_key = '{' .. KEYS[1] .. '}:"IPPOOL_OWNER_KEY":' .. owner" EOL	/* 23 */
+	"    redis.call('SET', owner_key, ip, 'EX', math.max(expires - ARGV[1], 1))" EOL	/* 24 */
+	"    ret[#ret + 1] = 1" EOL							/* 25 */
+	"  else" EOL									/* 26 */
+	"    ret[#ret + 1] = 0" EOL							/* 27 */
+	"  end" EOL									/* 28 */
+	"end" EOL									/* 29 */
+	"return ret" EOL;								/* 30 */
+static char lua_commit_digest[(SHA1_DIGEST_LENGTH * 2) + 1];
+
+/** Lua script for returning unused leases from a reservoir to the pool
+ *
+ * - KEYS[1] The pool name.
+ * - ARGV[1] Wall time (seconds since epoch).
+ * - ARGV[2] Reservoir identifier.
+ * - ARGV[3] Addresses to return, as a sequence of <len>:<value> encoded fields.
+ *
+ * Leases which are no longer held by the reservoir are left alone.
+ *
+ * Returns @verbatim array { <rcode> } @endverbatim
+ * - IPPOOL_RCODE_SUCCESS leases returned.
+ */
+static char lua_return_cmd[] =
+	"local pos = 1" EOL								/* 1 */
+
+	"local pool_key" EOL								/* 2 */
+	"local address_key" EOL								/* 3 */
+
+	"pool_key = '{' .. KEYS[1] .. '}:"IPPOOL_POOL_KEY"'" EOL			/* 4 */
+	"while pos <= #ARGV[3] do" EOL							/* 5 */
+	"  local sep = string.find(ARGV[3], ':', pos, true)" EOL			/* 6 */
+	"  local len = tonumber(string.sub(ARGV[3], pos, sep - 1))" EOL			/* 7 */
+	"  local ip = string.sub(ARGV[3], sep + 1, sep + len)" EOL			/* 8 */
+	"  pos = sep + len + 1" EOL							/* 9 */
+	"  address_key = '{' .. KEYS[1] .. '}:"IPPOOL_ADDRESS_KEY":' .. ip" EOL		/* 10 */
+	"  if redis.call('HGET', address_key, 'device') == ARGV[2] then" EOL		/* 11 */
+	"    redis.call('ZADD', pool_key, 'XX', ARGV[1] - 1, ip)" EOL			/* 12 */
+	"    redis.call('HDEL', address_key, 'device')" EOL				/* 13 */
+	"  end" EOL									/* 14 */
+	"end" EOL									/* 15 */
+	"return { " STRINGIFY(_IPPOOL_RCODE_SUCCESS) " }" EOL;				/* 16 */
+static char lua_return_digest[(SHA1_DIGEST_LENGTH * 2) + 1];
+
 /** Check the requisite number of slaves replicated the lease info
  *
  * @param request The current request.
@@ -469,12 +691,12 @@ static inline int ippool_wait_check(request_t *request, uint32_t wait_num, redis
 	if (!wait_num) return 0;
 
 	if (reply->type != REDIS_REPLY_INTEGER) {
-		REDEBUG("WAIT result is wrong type, expected integer got %s",
+		ROPTIONAL(REDEBUG, ERROR, "WAIT result is wrong type, expected integer got %s",
 			fr_table_str_by_value(redis_reply_types, reply->type, "<UNKNOWN>"));
 		return -1;
 	}
 	if (reply->integer < wait_num) {
-		REDEBUG("Too few slaves acknowledged allocation, needed %i, got %lli",
+		ROPTIONAL(REDEBUG, ERROR, "Too few slaves acknowledged allocation, needed %i, got %lli",
 			wait_num, reply->integer);
 		return -1;
 	}
@@ -543,7 +765,7 @@ static void ippool_action_print(request_t *request, ippool_action_t action,
  * @note All replies will be freed on error.
  *
  * @param[out] out		Where to write Redis reply object resulting from the command.
- * @param[in] request		The current request.
+ * @param[in] request		The current request.  May be NULL.
  * @param[in] cluster		configuration.
  * @param[in] key		to use to determine the cluster node.
  * @param[in] key_len		length of the key.
@@ -585,7 +807,7 @@ static fr_redis_rcode_t ippool_script(redisReply **out, request_t *request, fr_r
 	     s_ret = fr_redis_cluster_state_next(&state, &conn, cluster, request, status, &replies[0])) {
 	     	va_list	copy;
 
-	     	RDEBUG3("Calling script 0x%s", digest);
+	     	ROPTIONAL(RDEBUG3, DEBUG3, "Calling script 0x%s", digest);
 	     	va_copy(copy, ap);	/* copy or segv */
 		redisvAppendCommand(conn->handle, cmd, copy);
 		va_end(copy);
@@ -609,7 +831,7 @@ static fr_redis_rcode_t ippool_script(redisReply **out, request_t *request, fr_r
 		 *	we have to send the Lua script up to the node
 		 *	so it can be cached.
 		 */
-	     	RDEBUG3("Loading script 0x%s", digest);
+	     	ROPTIONAL(RDEBUG3, DEBUG3, "Loading script 0x%s", digest);
 		redisAppendCommand(conn->handle, "MULTI");
 		redisAppendCommand(conn->handle, "SCRIPT LOAD %s", script);
 	     	va_copy(copy, ap);	/* copy or segv */
@@ -626,12 +848,12 @@ static fr_redis_rcode_t ippool_script(redisReply **out, request_t *request, fr_r
 						     replies, NUM_ELEMENTS(replies),
 						     conn);
 		if (status == REDIS_RCODE_SUCCESS) {
-			if (RDEBUG_ENABLED3) for (i = 0; i < reply_cnt; i++) {
+			if (request && RDEBUG_ENABLED3) for (i = 0; i < reply_cnt; i++) {
 				fr_redis_reply_print(L_DBG_LVL_3, replies[i], request, i);
 			}
 
 			if (replies[3]->type != REDIS_REPLY_ARRAY) {
-				RERROR("Bad response to EXEC, expected array got %s",
+				ROPTIONAL(RERROR, ERROR, "Bad response to EXEC, expected array got %s",
 				       fr_table_str_by_value(redis_reply_types, replies[3]->type, "<UNKNOWN>"));
 			error:
 				fr_redis_pipeline_free(replies, reply_cnt);
@@ -639,17 +861,17 @@ static fr_redis_rcode_t ippool_script(redisReply **out, request_t *request, fr_r
 				goto finish;
 			}
 			if (replies[3]->elements != 2) {
-				RERROR("Bad response to EXEC, expected 2 result elements, got %zu",
+				ROPTIONAL(RERROR, ERROR, "Bad response to EXEC, expected 2 result elements, got %zu",
 				       replies[3]->elements);
 				goto error;
 			}
 			if (replies[3]->element[0]->type != REDIS_REPLY_STRING) {
-				RERROR("Bad response to SCRIPT LOAD, expected string got %s",
+				ROPTIONAL(RERROR, ERROR, "Bad response to SCRIPT LOAD, expected string got %s",
 				       fr_table_str_by_value(redis_reply_types, replies[3]->element[0]->type, "<UNKNOWN>"));
 				goto error;
 			}
 			if (strcmp(replies[3]->element[0]->str, digest) != 0) {
-				RWDEBUG("Incorrect SHA1 from SCRIPT LOAD, expected %s, got %s",
+				ROPTIONAL(RWDEBUG, WARN, "Incorrect SHA1 from SCRIPT LOAD, expected %s, got %s",
 					digest, replies[3]->element[0]->str);
 				goto error;
 			}
@@ -1087,6 +1309,610 @@ finish:
 	return ret;
 }
 
+static int8_t ippool_reservoir_cmp(void const *one, void const *two)
+{
+	ippool_reservoir_t const	*a = one, *b = two;
+	int8_t				ret;
+
+	ret = CMP(a->pool_name_len, b->pool_name_len);
+	if (ret != 0) return ret;
+
+	return CMP(memcmp(a->pool_name, b->pool_name, a->pool_name_len), 0);
+}
+
+/** Find the reservoir for a pool, creating it if it doesn't exist
+ *
+ * @note Must be called with the reservoirs mutex held.
+ */
+static ippool_reservoir_t *ippool_reservoir_find(ippool_reservoirs_t *reservoirs, fr_value_box_t const *pool_name)
+{
+	ippool_reservoir_t	*res, find = {
+					.pool_name = UNCONST(char *, pool_name->vb_strvalue),
+					.pool_name_len = pool_name->vb_length
+				};
+
+	res = fr_rb_find(reservoirs->tree, &find);
+	if (res) return res;
+
+	MEM(res = talloc_zero(reservoirs->tree, ippool_reservoir_t));
+	MEM(res->pool_name = talloc_memdup(res, pool_name->vb_strvalue, pool_name->vb_length));
+	res->pool_name_len = pool_name->vb_length;
+	fr_dlist_talloc_init(&res->free, ippool_reservoir_lease_t, entry);
+	fr_dlist_talloc_init(&res->pending, ippool_reservoir_lease_t, entry);
+	fr_dlist_talloc_init(&res->committing, ippool_reservoir_lease_t, entry);
+	fr_rb_insert(reservoirs->tree, res);
+
+	return res;
+}
+
+/** Append a <len>:<value> encoded field to a script argument
+ *
+ */
+static inline int ippool_field_pack(fr_sbuff_t *sbuff, char const *in, size_t inlen)
+{
+	if (fr_sbuff_in_sprintf(sbuff, "%zu:", inlen) < 0) return -1;
+	if (fr_sbuff_in_bstrncpy(sbuff, in, inlen) < 0) return -1;
+	return 0;
+}
+
+/** Find the lease handed out to an owner
+ *
+ * @note Must be called with the reservoirs mutex held.
+ */
+static ippool_reservoir_lease_t *ippool_reservoir_lease_find(fr_dlist_head_t *list, fr_value_box_t const *owner)
+{
+	fr_dlist_foreach(list, ippool_reservoir_lease_t, lease) {
+		if ((talloc_array_length(lease->owner) - 1 == owner->vb_length) &&
+		    (memcmp(lease->owner, owner->vb_strvalue, owner->vb_length) == 0)) return lease;
+	}
+
+	return NULL;
+}
+
+/** Take the pending leases of a reservoir, so they can be committed without the mutex held
+ *
+ * Only one commit per reservoir may be in progress.  Leases being committed
+ * aren't modified, except by ippool_reservoir_commit(), until
+ * ippool_reservoir_commit_done() is called.
+ *
+ * @note Must be called with the reservoirs mutex held.
+ *
+ * @return
+ *	- true if the caller must call ippool_reservoir_commit(), then ippool_reservoir_commit_done().
+ *	- false if there's nothing to commit, or another commit is in progress.
+ */
+static bool ippool_reservoir_commit_start(ippool_reservoir_t *res)
+{
+	if (fr_dlist_empty(&res->pending) || !fr_dlist_empty(&res->committing)) return false;
+
+	fr_dlist_move(&res->committing, &res->pending);
+
+	return true;
+}
+
+/** Record the owners of the leases being committed in Redis
+ *
+ * @note Must be called without the reservoirs mutex held.
+ *
+ * @param[in] request	The current request.  May be NULL.
+ * @param[in] inst	Module instance.
+ * @param[in] res	Reservoir to commit.
+ * @return
+ *	- 0 on success.
+ *	- -1 on failure.
+ */
+static int ippool_reservoir_commit(request_t *request, rlm_redis_ippool_t const *inst, ippool_reservoir_t *res)
+{
+	struct timeval		now;
+	fr_sbuff_t		sbuff;
+	fr_sbuff_uctx_talloc_t	tctx;
+	redisReply		*reply = NULL;
+	fr_redis_rcode_t	status;
+	size_t			i;
+	unsigned int		lost = 0;
+	int			ret = -1;
+
+	now = fr_time_to_timeval(fr_time());
+
+	/*
+	 *	Not parented by the reservoir, as other threads
+	 *	may be allocating leases in it.
+	 */
+	if (!fr_sbuff_init_talloc(NULL, &sbuff, &tctx, 256, SIZE_MAX)) return -1;
+
+	fr_dlist_foreach(&res->committing, ippool_reservoir_lease_t, lease) {
+		char	expires[sizeof("4294967295")];
+		size_t	len;
+
+		len = snprintf(expires, sizeof(expires), "%u", lease->expires);
+		if ((ippool_field_pack(&sbuff, lease->ip, talloc_array_length(lease->ip) - 1) < 0) ||
+		    (ippool_field_pack(&sbuff, lease->owner, talloc_array_length(lease->owner) - 1) < 0) ||
+		    (ippool_field_pack(&sbuff, lease->gateway, talloc_array_length(lease->gateway) - 1) < 0) ||
+		    (ippool_field_pack(&sbuff, expires, len) < 0)) goto finish;
+	}
+
+	ROPTIONAL(RDEBUG2, DEBUG2, "Committing %u reservoir lease(s) in pool \"%pV\"",
+		  fr_dlist_num_elements(&res->committing), fr_box_strvalue_len(res->pool_name, res->pool_name_len));
+
+	status = ippool_script(&reply, request, inst->cluster,
+			       (uint8_t const *)res->pool_name, res->pool_name_len,
+			       inst->wait_num, inst->wait_timeout,
+			       lua_commit_digest, lua_commit_cmd,
+			       "EVALSHA %s 1 %b %u %b %b",
+			       lua_commit_digest,
+			       (uint8_t const *)res->pool_name, res->pool_name_len,
+			       (unsigned int)now.tv_sec,
+			       inst->reservoirs->id, talloc_array_length(inst->reservoirs->id) - 1,
+			       fr_sbuff_start(&sbuff), fr_sbuff_used(&sbuff));
+	if (status != REDIS_RCODE_SUCCESS) goto finish;
+
+	if ((reply->type != REDIS_REPLY_ARRAY) || (reply->elements != (fr_dlist_num_elements(&res->committing) + 1)) ||
+	    (reply->element[0]->type != REDIS_REPLY_INTEGER)) {
+		ROPTIONAL(REDEBUG, ERROR, "Unexpected result committing reservoir leases");
+		goto finish;
+	}
+
+	i = 1;
+	fr_dlist_foreach(&res->committing, ippool_reservoir_lease_t, lease) {
+		if (reply->element[i]->type != REDIS_REPLY_INTEGER) {
+			ROPTIONAL(REDEBUG, ERROR, "Unexpected result committing reservoir leases");
+			goto finish;
+		}
+		lease->committed = (reply->element[i++]->integer == 1);
+		if (!lease->committed) lost++;
+	}
+
+	/*
+	 *	Another server took these leases after our hold on
+	 *	them lapsed.  They won't be handed out.
+	 */
+	if (lost > 0) {
+		ROPTIONAL(RWARN, WARN, "%u lease(s) in pool \"%pV\" were no longer held by the reservoir, "
+			  "hold_time may be too short", lost,
+			  fr_box_strvalue_len(res->pool_name, res->pool_name_len));
+	}
+	ret = 0;
+
+finish:
+	if (ret < 0) {
+		ROPTIONAL(REDEBUG, ERROR, "Failed committing reservoir leases in pool \"%pV\"",
+			  fr_box_strvalue_len(res->pool_name, res->pool_name_len));
+	}
+	talloc_free(fr_sbuff_buff(&sbuff));
+	fr_redis_reply_free(&reply);
+
+	return ret;
+}
+
+/** Finish committing leases, and wake anyone waiting for the commit
+ *
+ * The leases are removed from the reservoir, and the workers which handed
+ * them out check their state.  Only committed leases may be given to
+ * their owners.
+ *
+ * @note Must be called with the reservoirs mutex held.
+ *
+ * @param[in] reservoirs	the reservoir belongs to.
+ * @param[in] res		the leases were committed in.
+ * @param[in] ret		from ippool_reservoir_commit().
+ */
+static void ippool_reservoir_commit_done(ippool_reservoirs_t *reservoirs, ippool_reservoir_t *res, int ret)
+{
+	fr_dlist_foreach_safe(&res->committing, ippool_reservoir_lease_t, lease) {
+		fr_dlist_remove(&res->committing, lease);
+
+		if (ret < 0) {
+			lease->state = IPPOOL_RESERVOIR_LEASE_FAILED;
+		} else {
+			lease->state = lease->committed ? IPPOOL_RESERVOIR_LEASE_COMMITTED : IPPOOL_RESERVOIR_LEASE_LOST;
+		}
+	}}
+
+	pthread_cond_broadcast(&reservoirs->cond);
+}
+
+/** Return the unused leases in a reservoir to their pool
+ *
+ * @note Must be called with the reservoirs mutex held.
+ */
+static void ippool_reservoir_return(request_t *request, rlm_redis_ippool_t const *inst, ippool_reservoir_t *res)
+{
+	struct timeval		now;
+	fr_time_t		now_mono = fr_time();
+	fr_sbuff_t		sbuff;
+	fr_sbuff_uctx_talloc_t	tctx;
+	redisReply		*reply = NULL;
+
+	if (fr_dlist_empty(&res->free)) return;
+
+	now = fr_time_to_timeval(now_mono);
+
+	if (!fr_sbuff_init_talloc(res, &sbuff, &tctx, 256, SIZE_MAX)) return;
+
+	/*
+	 *	Leases where the hold has lapsed have already
+	 *	gone back to the pool.
+	 */
+	fr_dlist_foreach(&res->free, ippool_reservoir_lease_t, lease) {
+		if (!fr_time_gt(lease->held_until, now_mono)) continue;
+		if (ippool_field_pack(&sbuff, lease->ip, talloc_array_length(lease->ip) - 1) < 0) goto finish;
+	}
+	if (fr_sbuff_used(&sbuff) == 0) goto finish;
+
+	if (ippool_script(&reply, request, inst->cluster,
+			  (uint8_t const *)res->pool_name, res->pool_name_len,
+			  inst->wait_num, inst->wait_timeout,
+			  lua_return_digest, lua_return_cmd,
+			  "EVALSHA %s 1 %b %u %b %b",
+			  lua_return_digest,
+			  (uint8_t const *)res->pool_name, res->pool_name_len,
+			  (unsigned int)now.tv_sec,
+			  inst->reservoirs->id, talloc_array_length(inst->reservoirs->id) - 1,
+			  fr_sbuff_start(&sbuff), fr_sbuff_used(&sbuff)) != REDIS_RCODE_SUCCESS) {
+		ROPTIONAL(RWARN, WARN, "Failed returning reservoir leases to pool \"%pV\", they will be "
+			  "returned when their hold lapses", fr_box_strvalue_len(res->pool_name, res->pool_name_len));
+	}
+
+finish:
+	fr_dlist_talloc_free(&res->free);
+	talloc_free(fr_sbuff_buff(&sbuff));
+	fr_redis_reply_free(&reply);
+}
+
+/** Claim a block of free leases from a pool
+ *
+ * @note Must be called without the reservoirs mutex held.
+ *
+ * @param[in] ctx	to allocate the leases in.
+ * @param[out] out	where to add the claimed leases.
+ * @param[in] request	The current request.
+ * @param[in] inst	Module instance.
+ * @param[in] res	Reservoir the leases are for.
+ */
+static ippool_rcode_t ippool_reservoir_fill(TALLOC_CTX *ctx, fr_dlist_head_t *out,
+					    request_t *request, rlm_redis_ippool_t const *inst, ippool_reservoir_t *res)
+{
+	struct timeval		now;
+	fr_time_t		now_mono = fr_time();
+	redisReply		*reply = NULL;
+	fr_redis_rcode_t	status;
+	ippool_rcode_t		ret = IPPOOL_RCODE_FAIL;
+	size_t			i;
+
+	now = fr_time_to_timeval(now_mono);
+
+	RDEBUG2("Claiming up to %u leases from pool \"%pV\"", inst->reservoir.size,
+		fr_box_strvalue_len(res->pool_name, res->pool_name_len));
+
+	status = ippool_script(&reply, request, inst->cluster,
+			       (uint8_t const *)res->pool_name, res->pool_name_len,
+			       inst->wait_num, inst->wait_timeout,
+			       lua_reserve_digest, lua_reserve_cmd,
+			       "EVALSHA %s 1 %b %u %u %b %u",
+			       lua_reserve_digest,
+			       (uint8_t const *)res->pool_name, res->pool_name_len,
+			       (unsigned int)now.tv_sec,
+			       (unsigned int)fr_time_delta_to_sec(inst->reservoir.hold_time),
+			       inst->reservoirs->id, talloc_array_length(inst->reservoirs->id) - 1,
+			       inst->reservoir.size);
+	if (status != REDIS_RCODE_SUCCESS) goto finish;
+
+	if ((reply->type != REDIS_REPLY_ARRAY) || (reply->elements == 0) ||
+	    (reply->element[0]->type != REDIS_REPLY_INTEGER)) {
+		REDEBUG("Unexpected result claiming reservoir leases");
+		goto finish;
+	}
+
+	ret = reply->element[0]->integer;
+	if (ret < 0) goto finish;
+
+	for (i = 1; (i + 1) < reply->elements; i += 2) {
+		ippool_reservoir_lease_t	*lease;
+
+		if (reply->element[i]->type != REDIS_REPLY_STRING) {
+			REDEBUG("Server returned unexpected type \"%s\" for IP element (result[%zu])",
+				fr_table_str_by_value(redis_reply_types, reply->element[i]->type, "<UNKNOWN>"), i);
+			continue;
+		}
+
+		MEM(lease = talloc_zero(ctx, ippool_reservoir_lease_t));
+		MEM(lease->ip = talloc_bstrndup(lease, reply->element[i]->str, reply->element[i]->len));
+		if (reply->element[i + 1]->type == REDIS_REPLY_STRING) {
+			MEM(lease->range = talloc_bstrndup(lease, reply->element[i + 1]->str,
+							   reply->element[i + 1]->len));
+		}
+		lease->held_until = fr_time_add(now_mono, inst->reservoir.hold_time);
+		fr_dlist_insert_tail(out, lease);
+	}
+
+	RDEBUG2("Claimed %u leases from pool \"%pV\"", fr_dlist_num_elements(out),
+		fr_box_strvalue_len(res->pool_name, res->pool_name_len));
+
+finish:
+	fr_redis_reply_free(&reply);
+	return ret;
+}
+
+/** Wait for any lease being handed out to an owner from the reservoir to be committed
+ *
+ * Must be called before updating or releasing a lease, as until the lease is
+ * committed, Redis still believes the reservoir owns it.  The worker handing
+ * out the lease commits it.
+ */
+static void ippool_reservoir_wait(rlm_redis_ippool_t const *inst,
+				  fr_value_box_t const *pool_name, fr_value_box_t const *owner)
+{
+	ippool_reservoirs_t	*reservoirs = inst->reservoirs;
+	ippool_reservoir_t	*res, find = {
+					.pool_name = UNCONST(char *, pool_name->vb_strvalue),
+					.pool_name_len = pool_name->vb_length
+				};
+
+	pthread_mutex_lock(&reservoirs->mutex);
+	res = fr_rb_find(reservoirs->tree, &find);
+	while (res && (ippool_reservoir_lease_find(&res->pending, owner) ||
+		       ippool_reservoir_lease_find(&res->committing, owner))) {
+		pthread_cond_wait(&reservoirs->cond, &reservoirs->mutex);
+	}
+	pthread_mutex_unlock(&reservoirs->mutex);
+}
+
+/** Check whether the owner already has a lease in the pool
+ *
+ * @return
+ *	- 1 if the owner has a lease.
+ *	- 0 if the owner has no lease.
+ *	- -1 on error.
+ */
+static int ippool_owner_exists(request_t *request, rlm_redis_ippool_t const *inst,
+			       fr_value_box_t const *pool_name, fr_value_box_t const *owner)
+{
+	fr_redis_conn_t			*conn;
+	fr_redis_cluster_state_t	state;
+	fr_redis_rcode_t		status, s_ret;
+	redisReply			*reply = NULL;
+	int				ret;
+
+	for (s_ret = fr_redis_cluster_state_init(&state, &conn, inst->cluster, request,
+						 (uint8_t const *)pool_name->vb_strvalue, pool_name->vb_length, false);
+	     s_ret == REDIS_RCODE_TRY_AGAIN;	/* Continue */
+	     s_ret = fr_redis_cluster_state_next(&state, &conn, inst->cluster, request, status, &reply)) {
+		reply = redisCommand(conn->handle, "EXISTS {%b}:"IPPOOL_OWNER_KEY":%b",
+				     pool_name->vb_strvalue, pool_name->vb_length,
+				     owner->vb_strvalue, owner->vb_length);
+		status = fr_redis_command_status(conn, reply);
+	}
+	if (s_ret != REDIS_RCODE_SUCCESS) {
+		RERROR("Failed checking for existing lease");
+		fr_redis_reply_free(&reply);
+		return -1;
+	}
+
+	if (!fr_cond_assert(reply)) return -1;
+
+	if (reply->type != REDIS_REPLY_INTEGER) {
+		REDEBUG("Bad result type, expected integer, got %s",
+			fr_table_str_by_value(redis_reply_types, reply->type, "<UNKNOWN>"));
+		fr_redis_reply_free(&reply);
+		return -1;
+	}
+	ret = (reply->integer > 0);
+	fr_redis_reply_free(&reply);
+
+	return ret;
+}
+
+/** Allocate a lease from the local reservoir, claiming more from the pool if required
+ *
+ * The reservoirs mutex is never held while waiting for Redis.  Commits and
+ * fills are done with it released, and other workers needing the same
+ * reservoir wait for them to finish.
+ *
+ * A lease is only given to its owner once it has been committed.  Leases
+ * handed out by other workers at the same time are committed together, so
+ * there is at most one commit per reservoir in progress.
+ */
+static ippool_rcode_t redis_ippool_reservoir_allocate(rlm_redis_ippool_t const *inst, request_t *request,
+						      redis_ippool_alloc_call_env_t *env, uint32_t lease_time)
+{
+	ippool_reservoirs_t		*reservoirs = inst->reservoirs;
+	ippool_reservoir_t		*res;
+	ippool_reservoir_lease_t	*lease = NULL;
+	fr_time_t			now = fr_time();
+	ippool_rcode_t			ret = IPPOOL_RCODE_SUCCESS;
+	bool				filled = false, waited = false;
+	tmpl_t				ip_rhs;
+	map_t				ip_map = {
+						.lhs = env->allocated_address_attr,
+						.op = T_OP_SET,
+						.rhs = &ip_rhs
+					};
+
+	/*
+	 *	Owners with an existing lease go through the normal
+	 *	allocation script, so they get the same address back.
+	 */
+	if (inst->reservoir.check_owner) {
+		switch (ippool_owner_exists(request, inst, &env->pool_name, &env->owner)) {
+		case 1:
+			RDEBUG2("Owner has an existing lease, bypassing the reservoir");
+			return redis_ippool_allocate(inst, request, env, lease_time);
+
+		case 0:
+			break;
+
+		default:
+			return IPPOOL_RCODE_FAIL;
+		}
+	}
+
+	pthread_mutex_lock(&reservoirs->mutex);
+	res = ippool_reservoir_find(reservoirs, &env->pool_name);
+
+	/*
+	 *	Retransmissions while another worker is handing out
+	 *	a lease to the same owner wait for it to be committed,
+	 *	then get it from Redis.
+	 */
+	while (ippool_reservoir_lease_find(&res->pending, &env->owner) ||
+	       ippool_reservoir_lease_find(&res->committing, &env->owner)) {
+		pthread_cond_wait(&reservoirs->cond, &reservoirs->mutex);
+		waited = true;
+	}
+
+	if (waited) {
+		pthread_mutex_unlock(&reservoirs->mutex);
+
+		RDEBUG2("Owner's lease from the reservoir has been committed, bypassing the reservoir");
+		return redis_ippool_allocate(inst, request, env, lease_time);
+	}
+
+again:
+	while (!lease) {
+		lease = fr_dlist_pop_head(&res->free);
+		if (!lease) {
+			fr_dlist_head_t	claimed;
+			TALLOC_CTX	*claimed_ctx;
+
+			/*
+			 *	Only one worker claims more leases
+			 *	from a pool at a time.
+			 */
+			if (res->filling) {
+				pthread_cond_wait(&reservoirs->cond, &reservoirs->mutex);
+				continue;
+			}
+
+			if (filled) {
+				ret = IPPOOL_RCODE_POOL_EMPTY;
+				goto finish;
+			}
+
+			res->filling = true;
+			pthread_mutex_unlock(&reservoirs->mutex);
+
+			MEM(claimed_ctx = talloc_new(NULL));
+			fr_dlist_talloc_init(&claimed, ippool_reservoir_lease_t, entry);
+			ret = ippool_reservoir_fill(claimed_ctx, &claimed, request, inst, res);
+
+			pthread_mutex_lock(&reservoirs->mutex);
+			fr_dlist_foreach(&claimed, ippool_reservoir_lease_t, claimed_lease) {
+				talloc_steal(res, claimed_lease);
+			}
+			fr_dlist_move(&res->free, &claimed);
+			talloc_free(claimed_ctx);
+			res->filling = false;
+			pthread_cond_broadcast(&reservoirs->cond);
+
+			if (ret < 0) goto finish;
+			filled = true;
+			continue;
+		}
+
+		if (fr_time_gt(lease->held_until, now)) break;
+
+		RDEBUG3("Hold on %s has lapsed, discarding it", lease->ip);
+		TALLOC_FREE(lease);
+	}
+
+	talloc_free(lease->owner);
+	MEM(lease->owner = talloc_memdup(lease, env->owner.vb_strvalue, env->owner.vb_length + 1));
+	talloc_free(lease->gateway);
+	MEM(lease->gateway = talloc_memdup(lease, env->gateway_id.vb_strvalue, env->gateway_id.vb_length + 1));
+	lease->expires = fr_time_to_sec(now) + lease_time;
+	lease->committed = false;
+	lease->state = IPPOOL_RESERVOIR_LEASE_PENDING;
+	fr_dlist_insert_tail(&res->pending, lease);
+
+	/*
+	 *	Commit our lease, along with any others which are
+	 *	pending.  If another worker is already committing,
+	 *	wait for it, as it may have taken our lease.
+	 */
+	while (lease->state == IPPOOL_RESERVOIR_LEASE_PENDING) {
+		int commit_ret;
+
+		if (!ippool_reservoir_commit_start(res)) {
+			pthread_cond_wait(&reservoirs->cond, &reservoirs->mutex);
+			continue;
+		}
+
+		pthread_mutex_unlock(&reservoirs->mutex);
+		commit_ret = ippool_reservoir_commit(request, inst, res);
+		pthread_mutex_lock(&reservoirs->mutex);
+		ippool_reservoir_commit_done(reservoirs, res, commit_ret);
+	}
+
+	switch (lease->state) {
+	case IPPOOL_RESERVOIR_LEASE_COMMITTED:
+		break;
+
+	/*
+	 *	The check and the commit are atomic in Redis, so
+	 *	nobody else has been told about this lease.  Try
+	 *	another.
+	 */
+	case IPPOOL_RESERVOIR_LEASE_LOST:
+		RWDEBUG("%s was allocated by another server before it could be committed", lease->ip);
+		TALLOC_FREE(lease);
+		goto again;
+
+	/*
+	 *	We don't know whether Redis recorded the owner,
+	 *	so the address can't be given out.
+	 */
+	default:
+		REDEBUG("Failed committing %s, not allocating it", lease->ip);
+		TALLOC_FREE(lease);
+		ret = IPPOOL_RCODE_FAIL;
+		goto finish;
+	}
+
+	/*
+	 *	The lease is in Redis now, so failures here leave
+	 *	it to expire.
+	 */
+	tmpl_init_shallow(&ip_rhs, TMPL_TYPE_DATA, T_BARE_WORD, "", 0, NULL);
+	fr_value_box_bstrndup_shallow(&ip_map.rhs->data.literal, NULL, lease->ip, talloc_array_length(lease->ip) - 1, false);
+	if (map_to_request(request, &ip_map, map_to_vp, NULL) < 0) {
+		ret = IPPOOL_RCODE_FAIL;
+		goto finish;
+	}
+
+	if (lease->range) {
+		tmpl_t	range_rhs;
+		map_t	range_map = { .lhs = env->range_attr, .op = T_OP_SET, .rhs = &range_rhs };
+
+		tmpl_init_shallow(&range_rhs, TMPL_TYPE_DATA, T_DOUBLE_QUOTED_STRING, "", 0, NULL);
+		fr_value_box_bstrndup_shallow(&range_map.rhs->data.literal, NULL,
+					      lease->range, talloc_array_length(lease->range) - 1, true);
+		if (map_to_request(request, &range_map, map_to_vp, NULL) < 0) {
+			ret = IPPOOL_RCODE_FAIL;
+			goto finish;
+		}
+	}
+
+	if (env->expiry_attr) {
+		tmpl_t	expiry_rhs;
+		map_t	expiry_map = { .lhs = env->expiry_attr, .op = T_OP_SET, .rhs = &expiry_rhs };
+
+		tmpl_init_shallow(&expiry_rhs, TMPL_TYPE_DATA, T_DOUBLE_QUOTED_STRING, "", 0, NULL);
+		fr_value_box(&expiry_map.rhs->data.literal, lease_time, true);
+		if (map_to_request(request, &expiry_map, map_to_vp, NULL) < 0) {
+			ret = IPPOOL_RCODE_FAIL;
+			goto finish;
+		}
+	}
+
+	RDEBUG2("Allocated %s from the reservoir, %u leases remaining", lease->ip, fr_dlist_num_elements(&res->free));
+
+finish:
+	talloc_free(lease);
+	pthread_mutex_unlock(&reservoirs->mutex);
+
+	return ret;
+}
+
 #define CHECK_POOL_NAME \
 	if (env->pool_name.vb_length > IPPOOL_MAX_KEY_PREFIX_SIZE) { \
 		REDEBUG("Pool name too long.  Expected %u bytes, got %ld bytes", \
@@ -1103,6 +1929,7 @@ static unlang_action_t CC_HINT(nonnull) mod_alloc(rlm_rcode_t *p_result, module_
 	rlm_redis_ippool_t const	*inst = talloc_get_type_abort_const(mctx->mi->data, rlm_redis_ippool_t);
 	redis_ippool_alloc_call_env_t	*env = talloc_get_type_abort(mctx->env_data, redis_ippool_alloc_call_env_t);
 	uint32_t			lease_time;
+	ippool_rcode_t			ret;
 
 	CHECK_POOL_NAME
 
@@ -1114,7 +1941,13 @@ static unlang_action_t CC_HINT(nonnull) mod_alloc(rlm_rcode_t *p_result, module_
 			env->offer_time.vb_uint32 : env->lease_time.vb_uint32;
 	ippool_action_print(request, POOL_ACTION_ALLOCATE, L_DBG_LVL_2, &env->pool_name, NULL,
 			    &env->owner, &env->gateway_id, lease_time);
-	switch (redis_ippool_allocate(inst, request, env, lease_time)) {
+	if (inst->reservoirs) {
+		ret = redis_ippool_reservoir_allocate(inst, request, env, lease_time);
+	} else {
+		ret = redis_ippool_allocate(inst, request, env, lease_time);
+	}
+
+	switch (ret) {
 	case IPPOOL_RCODE_SUCCESS:
 		RDEBUG2("IP address lease allocated");
 		RETURN_MODULE_UPDATED;
@@ -1137,6 +1970,9 @@ static unlang_action_t CC_HINT(nonnull) mod_update(rlm_rcode_t *p_result, module
 
 	ippool_action_print(request, POOL_ACTION_UPDATE, L_DBG_LVL_2, &env->pool_name,
 			    &env->requested_address, &env->owner, &env->gateway_id, env->lease_time.vb_uint32);
+
+	if (inst->reservoirs) ippool_reservoir_wait(inst, &env->pool_name, &env->owner);
+
 	switch (redis_ippool_update(inst, request, env,
 				    &env->requested_address.datum.ip, &env->owner,
 				    &env->gateway_id,
@@ -1199,6 +2035,9 @@ static unlang_action_t CC_HINT(nonnull) mod_release(rlm_rcode_t *p_result, modul
 
 	ippool_action_print(request, POOL_ACTION_RELEASE, L_DBG_LVL_2, &env->pool_name,
 			    &env->requested_address, &env->owner, &env->gateway_id, 0);
+
+	if (inst->reservoirs) ippool_reservoir_wait(inst, &env->pool_name, &env->owner);
+
 	switch (redis_ippool_release(inst, request, &env->pool_name, &env->requested_address.datum.ip, &env->owner)) {
 	case IPPOOL_RCODE_SUCCESS:
 		RDEBUG2("IP address \"%pV\" released", &env->requested_address);
@@ -1269,8 +2108,76 @@ static int mod_instantiate(module_inst_ctx_t const *mctx)
 		fr_sha1_update(&sha1_ctx, (uint8_t const *)lua_release_cmd, sizeof(lua_release_cmd) - 1);
 		fr_sha1_final(digest, &sha1_ctx);
 		fr_base16_encode(&FR_SBUFF_OUT(lua_release_digest, sizeof(lua_release_digest)), &FR_DBUFF_TMP(digest, sizeof(digest)));
+
+		fr_sha1_init(&sha1_ctx);
+		fr_sha1_update(&sha1_ctx, (uint8_t const *)lua_reserve_cmd, sizeof(lua_reserve_cmd) - 1);
+		fr_sha1_final(digest, &sha1_ctx);
+		fr_base16_encode(&FR_SBUFF_OUT(lua_reserve_digest, sizeof(lua_reserve_digest)), &FR_DBUFF_TMP(digest, sizeof(digest)));
+
+		fr_sha1_init(&sha1_ctx);
+		fr_sha1_update(&sha1_ctx, (uint8_t const *)lua_commit_cmd, sizeof(lua_commit_cmd) - 1);
+		fr_sha1_final(digest, &sha1_ctx);
+		fr_base16_encode(&FR_SBUFF_OUT(lua_commit_digest, sizeof(lua_commit_digest)), &FR_DBUFF_TMP(digest, sizeof(digest)));
+
+		fr_sha1_init(&sha1_ctx);
+		fr_sha1_update(&sha1_ctx, (uint8_t const *)lua_return_cmd, sizeof(lua_return_cmd) - 1);
+		fr_sha1_final(digest, &sha1_ctx);
+		fr_base16_encode(&FR_SBUFF_OUT(lua_return_digest, sizeof(lua_return_digest)), &FR_DBUFF_TMP(digest, sizeof(digest)));
 	}
 
+	if (inst->reservoir.size > 0) {
+		CONF_SECTION	*res_cs = cf_section_find(mctx->mi->conf, "reservoir", NULL);
+		char		hostname[256];
+
+		if (!fr_time_delta_ispos(inst->reservoir.hold_time)) {
+			cf_log_err(res_cs, "'hold_time' must be greater than 0");
+			return -1;
+		}
+
+		if (gethostname(hostname, sizeof(hostname)) < 0) strlcpy(hostname, "unknown", sizeof(hostname));
+		hostname[sizeof(hostname) - 1] = '\0';
+
+		MEM(inst->reservoirs = talloc_zero(inst, ippool_reservoirs_t));
+		pthread_mutex_init(&inst->reservoirs->mutex, NULL);
+		pthread_cond_init(&inst->reservoirs->cond, NULL);
+		MEM(inst->reservoirs->tree = fr_rb_inline_talloc_alloc(inst->reservoirs, ippool_reservoir_t, node,
+								       ippool_reservoir_cmp, NULL));
+
+		/*
+		 *	Unique per server instance, so a restarted server
+		 *	doesn't try and commit leases it no longer holds.
+		 */
+		MEM(inst->reservoirs->id = talloc_typed_asprintf(inst->reservoirs, "reservoir:%s:%u:%08x",
+								 hostname, (unsigned int)getpid(), fr_rand()));
+	}
+
+	return 0;
+}
+
+/** Return the leases in the reservoirs to their pools
+ *
+ */
+static int mod_detach(module_detach_ctx_t const *mctx)
+{
+	rlm_redis_ippool_t	*inst = talloc_get_type_abort(mctx->mi->data, rlm_redis_ippool_t);
+	ippool_reservoirs_t	*reservoirs = inst->reservoirs;
+
+	if (!reservoirs) return 0;
+
+	/*
+	 *	The workers have all exited, so there's no need
+	 *	to release the mutex while talking to Redis.
+	 */
+	pthread_mutex_lock(&reservoirs->mutex);
+	fr_rb_inorder_foreach(reservoirs->tree, ippool_reservoir_t, res) {
+		ippool_reservoir_return(NULL, inst, res);
+	}}
+	pthread_mutex_unlock(&reservoirs->mutex);
+
+	pthread_cond_destroy(&reservoirs->cond);
+	pthread_mutex_destroy(&reservoirs->mutex);
+	TALLOC_FREE(inst->reservoirs);
+
 	return 0;
 }
 
@@ -1289,7 +2196,8 @@ module_rlm_t rlm_redis_ippool = {
 		.inst_size	= sizeof(rlm_redis_ippool_t),
 		.config		= module_config,
 		.onload		= mod_load,
-		.instantiate	= mod_instantiate
+		.instantiate	= mod_instantiate,
+		.detach		= mod_detach
 	},
 	.method_group = {
 		.bindings = (module_method_binding_t[]){
@@ -75,6 +75,10 @@ typedef struct {
 	connection_t	*conn;			//!< Generic connection structure for this connection.
 	int		fd;			//!< fd for this connection's I/O events.
 	fr_sql_query_t	*query_ctx;		//!< Current query running on this connection.
+	bool		*prepared;		//!< Statements prepared on this connection, indexed
+						///< by statement id.
+	bool		preparing;		//!< Waiting for the current query's statement
+						///< to be prepared.
 } rlm_sql_postgres_conn_t;
 
 static conf_parser_t driver_config[] = {
@@ -367,10 +371,67 @@ static connection_t *sql_trunk_connection_alloc(trunk_connection_t *tconn, fr_ev
 
 TRUNK_NOTIFY_FUNC(sql_trunk_connection_notify, rlm_sql_postgres_conn_t)
 
+/** Write the name of a prepared statement
+ *
+ */
+static inline void sql_prepared_name(char *out, size_t outlen, fr_sql_prepared_t const *prepared)
+{
+	snprintf(out, outlen, "fr_stmt_%u", prepared->id);
+}
+
+/** Record that a statement has been prepared on a connection
+ *
+ */
+static void sql_prepared_add(rlm_sql_postgres_conn_t *sql_conn, fr_sql_prepared_t const *prepared)
+{
+	size_t	len = talloc_array_length(sql_conn->prepared);
+
+	if (prepared->id >= len) {
+		MEM(sql_conn->prepared = talloc_realloc(sql_conn, sql_conn->prepared, bool, prepared->id + 1));
+		memset(sql_conn->prepared + len, 0, sizeof(bool) * ((prepared->id + 1) - len));
+	}
+	sql_conn->prepared[prepared->id] = true;
+}
+
+/** Send a prepared statement, preparing it first if this connection hasn't seen it before
+ *
+ * @return
+ *	- 0 on success.
+ *	- -1 on failure.
+ */
+static int sql_prepared_send(rlm_sql_thread_t *thread, rlm_sql_postgres_conn_t *sql_conn, fr_sql_query_t *query_ctx)
+{
+	fr_sql_prepared_t const	*prepared = query_ctx->prepared;
+	request_t		*request = query_ctx->request;
+	char			name[32];
+
+	sql_prepared_name(name, sizeof(name), prepared);
+
+	if ((prepared->id < talloc_array_length(sql_conn->prepared)) && sql_conn->prepared[prepared->id]) {
+		thread->prepared_hits++;
+		ROPTIONAL(RDEBUG2, DEBUG2, "Executing prepared statement %s: %s", name, prepared->shape);
+		if (!PQsendQueryPrepared(sql_conn->db, name, prepared->num_params, query_ctx->params, NULL, NULL, 0)) return -1;
+		return 0;
+	}
+
+	/*
+	 *	Parameter types are left unspecified, so they're
+	 *	inferred from context just like the string
+	 *	literals they replaced.
+	 */
+	thread->prepared_misses++;
+	ROPTIONAL(RDEBUG2, DEBUG2, "Preparing statement %s: %s", name, prepared->shape);
+	if (!PQsendPrepare(sql_conn->db, name, prepared->shape, prepared->num_params, NULL)) return -1;
+	sql_conn->preparing = true;
+
+	return 0;
+}
+
 CC_NO_UBSAN(function) /* UBSAN: false positive - public vs private connection_t trips --fsanitize=function*/
 static void sql_trunk_request_mux(UNUSED fr_event_list_t *el, trunk_connection_t *tconn,
-				  connection_t *conn, UNUSED void *uctx)
+				  connection_t *conn, void *uctx)
 {
+	rlm_sql_thread_t	*thread = talloc_get_type_abort(uctx, rlm_sql_thread_t);
 	rlm_sql_postgres_conn_t	*sql_conn = talloc_get_type_abort(conn->h, rlm_sql_postgres_conn_t);
 	request_t		*request;
 	trunk_request_t		*treq;
@@ -385,8 +446,12 @@ static void sql_trunk_request_mux(UNUSED fr_event_list_t *el, trunk_connection_t
 
 	switch (query_ctx->status) {
 	case SQL_QUERY_PREPARED:
-		ROPTIONAL(RDEBUG2, DEBUG2, "Executing query: %s", query_ctx->query_str);
-		err = PQsendQuery(sql_conn->db, query_ctx->query_str);
+		if (query_ctx->prepared) {
+			err = (sql_prepared_send(thread, sql_conn, query_ctx) == 0);
+		} else {
+			ROPTIONAL(RDEBUG2, DEBUG2, "Executing query: %s", query_ctx->query_str);
+			err = PQsendQuery(sql_conn->db, query_ctx->query_str);
+		}
 		query_ctx->tconn = tconn;
 		if (!err) {
 			ROPTIONAL(RERROR, ERROR, "Failed to send query: %s", PQerrorMessage(sql_conn->db));
@@ -429,6 +494,57 @@ static void sql_trunk_request_demux(UNUSED fr_event_list_t *el, UNUSED trunk_con
 		}
 		if (PQisBusy(sql_conn->db)) return;
 
+		/*
+		 *	The statement has been prepared, now send it
+		 *	with the query's parameters.
+		 */
+		if (sql_conn->preparing) {
+			char		name[32];
+			char const	*error_code;
+
+			sql_conn->preparing = false;
+
+			tmp_result = PQgetResult(sql_conn->db);
+			status = tmp_result ? PQresultStatus(tmp_result) : PGRES_FATAL_ERROR;
+			error_code = tmp_result ? PQresultErrorField(tmp_result, PG_DIAG_SQLSTATE) : NULL;
+
+			/*
+			 *	42P05 is "duplicate_prepared_statement", which can
+			 *	happen if a previous preparation was cancelled.
+			 */
+			if ((status != PGRES_COMMAND_OK) && !(error_code && (strcmp(error_code, "42P05") == 0))) {
+				ROPTIONAL(RERROR, ERROR, "Failed preparing statement: %s", PQerrorMessage(sql_conn->db));
+				query_ctx->rcode = tmp_result ? sql_classify_error(inst, status, tmp_result) : RLM_SQL_RECONNECT;
+				if (query_ctx->rcode == RLM_SQL_OK) query_ctx->rcode = RLM_SQL_ERROR;
+
+				/*
+				 *	The server refused the statement itself, so
+				 *	preparing it again won't help.  Have the
+				 *	query run as text instead.
+				 */
+				if (query_ctx->rcode != RLM_SQL_RECONNECT) query_ctx->prepare_failed = true;
+				query_ctx->status = SQL_QUERY_RETURNED;
+				if (tmp_result) PQclear(tmp_result);
+				while ((tmp_result = PQgetResult(sql_conn->db)) != NULL) PQclear(tmp_result);
+				break;
+			}
+			if (tmp_result) PQclear(tmp_result);
+			while ((tmp_result = PQgetResult(sql_conn->db)) != NULL) PQclear(tmp_result);
+
+			sql_prepared_add(sql_conn, query_ctx->prepared);
+			sql_prepared_name(name, sizeof(name), query_ctx->prepared);
+
+			ROPTIONAL(RDEBUG2, DEBUG2, "Executing prepared statement %s: %s", name, query_ctx->prepared->shape);
+			if (!PQsendQueryPrepared(sql_conn->db, name, query_ctx->prepared->num_params, query_ctx->params,
+						 NULL, NULL, 0)) {
+				ROPTIONAL(RERROR, ERROR, "Failed to send query: %s", PQerrorMessage(sql_conn->db));
+				query_ctx->rcode = RLM_SQL_ERROR;
+				query_ctx->status = SQL_QUERY_RETURNED;
+				break;
+			}
+			return;
+		}
+
 		query_ctx->status = SQL_QUERY_RETURNED;
 
 		sql_conn->result = PQgetResult(sql_conn->db);
@@ -543,6 +659,12 @@ static void sql_request_cancel_mux(UNUSED fr_event_list_t *el, trunk_connection_
 		while ((tmp_result = PQgetResult(sql_conn->db)) != NULL)
 			PQclear(tmp_result);
 
+		/*
+		 *	We don't know if the statement was prepared, the
+		 *	next attempt to prepare it will tell us.
+		 */
+		sql_conn->preparing = false;
+
 	complete:
 		trunk_request_signal_cancel_complete(treq);
 	}
@@ -684,6 +806,11 @@ static int sql_affected_rows(fr_sql_query_t *query_ctx, UNUSED rlm_sql_config_t
 	return conn->affected_rows;
 }
 
+static fr_slen_t sql_placeholder(fr_sbuff_t *out, unsigned int num)
+{
+	return fr_sbuff_in_sprintf(out, "$%u", num);
+}
+
 static size_t sql_escape_func(request_t *request, char *out, size_t outlen, char const *in, void *arg)
 {
 	size_t			inlen, ret;
@@ -879,6 +1006,7 @@ rlm_sql_driver_t rlm_sql_postgresql = {
 	.sql_escape_func		= sql_escape_func,
 	.sql_escape_arg_alloc		= sql_escape_arg_alloc,
 	.sql_escape_arg_free		= sql_escape_arg_free,
+	.sql_placeholder		= sql_placeholder,
 	.uses_trunks			= true,
 	.trunk_io_funcs = {
 		.connection_alloc	= sql_trunk_connection_alloc,
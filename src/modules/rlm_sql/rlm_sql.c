@@ -66,6 +66,7 @@ static const conf_parser_t module_config[] = {
 	{ FR_CONF_OFFSET("cache_groups", rlm_sql_config_t, cache_groups) },
 	{ FR_CONF_OFFSET("read_profiles", rlm_sql_config_t, read_profiles), .dflt = "yes" },
 	{ FR_CONF_OFFSET("open_query", rlm_sql_config_t, connect_query) },
+	{ FR_CONF_OFFSET("prepared_statements", rlm_sql_config_t, prepared_statements), .dflt = "no" },
 
 	{ FR_CONF_OFFSET("safe_characters", rlm_sql_config_t, allowed_chars), .dflt = "@abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789.-_: /" },
 
@@ -202,6 +203,8 @@ typedef struct {
 	fr_value_box_t		user;		//!< Expansion of sql_user_name.
 	fr_value_box_t		filename;	//!< File name to write SQL logs to.
 	tmpl_t			**query;	//!< Array of tmpls for list of queries to run.
+	fr_sql_prepared_t	**prepared;	//!< Array of prepared statements, one per query.
+						///< Entries are NULL where the query can't be prepared.
 } sql_redundant_call_env_t;
 
 static const call_env_method_t accounting_method_env = {
@@ -235,6 +238,9 @@ typedef struct {
 	size_t				query_no;	//!< Current query number.
 	fr_value_box_list_t		query;		//!< Where expanded query tmpl will be written.
 	fr_value_box_t			*query_vb;	//!< Current query string.
+	fr_sql_prepared_t const		*prepared;	//!< Prepared statement for the current query.
+	fr_value_box_list_t		*params;	//!< Where expanded prepared statement parameters
+							///< will be written.
 	fr_sql_query_t			*query_ctx;	//!< Query context for current query.
 } sql_redundant_ctx_t;
 
@@ -443,6 +449,46 @@ static xlat_action_t sql_escape_xlat(UNUSED TALLOC_CTX *ctx, fr_dcursor_t *out,
 	return XLAT_ACTION_DONE;
 }
 
+static xlat_arg_parser_t const sql_prepared_stats_xlat_args[] = {
+	{ .required = true, .single = true, .type = FR_TYPE_STRING },
+	XLAT_ARG_PARSER_TERMINATOR
+};
+
+/** Return how often this thread found a prepared statement on its connection
+ *
+ * "hits" are queries run using a statement already prepared on the connection,
+ * "misses" are queries which had to prepare the statement first.
+ *
+ * Example:
+@verbatim
+%sql.prepared_stats('hits')
+@endverbatim
+ *
+ * @ingroup xlat_functions
+ */
+static xlat_action_t sql_prepared_stats_xlat(TALLOC_CTX *ctx, fr_dcursor_t *out, xlat_ctx_t const *xctx,
+					     request_t *request, fr_value_box_list_t *in)
+{
+	rlm_sql_thread_t	*thread = talloc_get_type_abort(xctx->mctx->thread, rlm_sql_thread_t);
+	fr_value_box_t		*arg = fr_value_box_list_head(in);
+	fr_value_box_t		*vb;
+
+	MEM(vb = fr_value_box_alloc(ctx, FR_TYPE_UINT64, NULL));
+
+	if (strcmp(arg->vb_strvalue, "hits") == 0) {
+		vb->vb_uint64 = thread->prepared_hits;
+	} else if (strcmp(arg->vb_strvalue, "misses") == 0) {
+		vb->vb_uint64 = thread->prepared_misses;
+	} else {
+		REDEBUG("Unknown statistic \"%s\", expected \"hits\" or \"misses\"", arg->vb_strvalue);
+		talloc_free(vb);
+		return XLAT_ACTION_FAIL;
+	}
+
+	fr_dcursor_append(out, vb);
+	return XLAT_ACTION_DONE;
+}
+
 static xlat_action_t sql_xlat_query_resume(TALLOC_CTX *ctx, fr_dcursor_t *out, xlat_ctx_t const *xctx,
 					   request_t *request, UNUSED fr_value_box_list_t *in)
 {
@@ -1725,6 +1771,107 @@ static int sql_redundant_ctx_free(sql_redundant_ctx_t *to_free)
 
 static unlang_action_t mod_sql_redundant_resume(rlm_rcode_t *p_result, UNUSED int *priority, request_t *request, void *uctx);
 
+/** Push the expansion of the current query in a redundant list of queries
+ *
+ * If the query has a prepared statement, only the statement's parameters are expanded.
+ *
+ * @param[in] request		Current request.
+ * @param[in] redundant_ctx	Current redundant sql context.
+ * @return
+ *	- 0 on success.
+ *	- -1 on failure.
+ */
+static int sql_redundant_query_push(request_t *request, sql_redundant_ctx_t *redundant_ctx)
+{
+	sql_redundant_call_env_t	*call_env = redundant_ctx->call_env;
+	fr_sql_prepared_t const		*prepared = NULL;
+	unsigned int			i;
+
+	/*
+	 *	Logging queries needs the complete query string.
+	 */
+	if (call_env->prepared && !((call_env->filename.type == FR_TYPE_STRING) && (call_env->filename.vb_length > 0))) {
+		prepared = call_env->prepared[redundant_ctx->query_no];
+	}
+
+	/*
+	 *	The database wouldn't prepare the statement
+	 *	last time, don't ask it again.
+	 */
+	if (prepared && atomic_load_explicit(&prepared->unpreparable, memory_order_relaxed)) prepared = NULL;
+
+	redundant_ctx->prepared = prepared;
+	if (!prepared) {
+		return unlang_tmpl_push(redundant_ctx, &redundant_ctx->query, request,
+					call_env->query[redundant_ctx->query_no], NULL);
+	}
+
+	TALLOC_FREE(redundant_ctx->params);
+	MEM(redundant_ctx->params = talloc_array(redundant_ctx, fr_value_box_list_t, prepared->num_params));
+
+	/*
+	 *	Frames are popped in the reverse order they're
+	 *	pushed, so push the last parameter first.
+	 */
+	for (i = prepared->num_params; i > 0; i--) {
+		fr_value_box_list_init(&redundant_ctx->params[i - 1]);
+		if (unlang_tmpl_push(redundant_ctx->params, &redundant_ctx->params[i - 1], request,
+				     prepared->params[i - 1], NULL) < 0) return -1;
+	}
+
+	return 0;
+}
+
+/** Allocate a query context for a prepared statement from expanded parameters
+ *
+ * @param[in] request		Current request.
+ * @param[in] redundant_ctx	Current redundant sql context.
+ * @return
+ *	- A new query context.
+ *	- NULL if the parameters couldn't be converted to strings.
+ */
+static fr_sql_query_t *sql_redundant_prepared_alloc(request_t *request, sql_redundant_ctx_t *redundant_ctx)
+{
+	fr_sql_prepared_t const	*prepared = redundant_ctx->prepared;
+	rlm_sql_t const		*inst = redundant_ctx->inst;
+	fr_sql_query_t		*query_ctx;
+	char const		**params;
+	unsigned int		i;
+
+	MEM(query_ctx = fr_sql_query_alloc(redundant_ctx, inst, request, redundant_ctx->handle, redundant_ctx->trunk,
+					   prepared->shape, SQL_QUERY_OTHER));
+	MEM(params = talloc_array(query_ctx, char const *, prepared->num_params));
+
+	for (i = 0; i < prepared->num_params; i++) {
+		fr_value_box_t	*vb = fr_value_box_list_head(&redundant_ctx->params[i]);
+
+		/*
+		 *	Missing attributes are the same as an empty
+		 *	string literal, or NULL if the expansion
+		 *	would have fallen back to it.
+		 */
+		if (!vb) {
+			params[i] = prepared->nullable[i] ? NULL : "";
+			RDEBUG3("$%u = %s", i + 1, params[i] ? "\"\"" : "NULL");
+			continue;
+		}
+
+		if (fr_value_box_list_concat_in_place(vb, vb, &redundant_ctx->params[i], FR_TYPE_STRING,
+						      FR_VALUE_BOX_LIST_FREE, true, SIZE_MAX) < 0) {
+			RPEDEBUG("Failed concatenating parameter %u", i + 1);
+			talloc_free(query_ctx);
+			return NULL;
+		}
+		params[i] = vb->vb_strvalue;
+		RDEBUG3("$%u = \"%pV\"", i + 1, vb);
+	}
+
+	query_ctx->prepared = prepared;
+	query_ctx->params = params;
+
+	return query_ctx;
+}
+
 /** Resume function called after executing an SQL query in a redundant list of queries.
  *
  * @param p_result	Result of current module call.
@@ -1740,7 +1887,24 @@ static unlang_action_t mod_sql_redundant_query_resume(rlm_rcode_t *p_result, UNU
 	rlm_sql_t const			*inst = redundant_ctx->inst;
 	fr_sql_query_t			*query_ctx = redundant_ctx->query_ctx;
 	int				numaffected = 0;
-	tmpl_t				*next_query;
+
+	/*
+	 *	The statement couldn't be prepared, so run
+	 *	the same query again as text.  Later requests
+	 *	go straight to the text query.
+	 */
+	if (query_ctx->prepare_failed) {
+		fr_sql_prepared_t *prepared = call_env->prepared[redundant_ctx->query_no];
+
+		RWARN("Statement could not be prepared, running query as text");
+		atomic_store_explicit(&prepared->unpreparable, true, memory_order_relaxed);
+
+		TALLOC_FREE(redundant_ctx->query_ctx);
+		if (unlang_function_repeat_set(request, mod_sql_redundant_resume) < 0) RETURN_MODULE_FAIL;
+		if (sql_redundant_query_push(request, redundant_ctx) < 0) RETURN_MODULE_FAIL;
+
+		return UNLANG_ACTION_PUSHED_CHILD;
+	}
 
 	RDEBUG2("SQL query returned: %s", fr_table_str_by_value(sql_rcode_description_table, query_ctx->rcode, "<INVALID>"));
 
@@ -1797,9 +1961,8 @@ next:
 	talloc_free(query_ctx);
 	redundant_ctx->query_no++;
 	if (redundant_ctx->query_no >= talloc_array_length(call_env->query)) RETURN_MODULE_NOOP;
-	next_query = *(tmpl_t **)((uint8_t *)call_env->query + sizeof(void *) * redundant_ctx->query_no);
 	if (unlang_function_repeat_set(request, mod_sql_redundant_resume) < 0) RETURN_MODULE_FAIL;
-	if (unlang_tmpl_push(redundant_ctx, &redundant_ctx->query, request, next_query, NULL) < 0) RETURN_MODULE_FAIL;
+	if (sql_redundant_query_push(request, redundant_ctx) < 0) RETURN_MODULE_FAIL;
 
 	RDEBUG2("Trying next query...");
 
@@ -1821,6 +1984,12 @@ static unlang_action_t mod_sql_redundant_resume(rlm_rcode_t *p_result, UNUSED in
 	sql_redundant_call_env_t	*call_env = redundant_ctx->call_env;
 	rlm_sql_t const			*inst = redundant_ctx->inst;
 
+	if (redundant_ctx->prepared) {
+		redundant_ctx->query_ctx = sql_redundant_prepared_alloc(request, redundant_ctx);
+		if (!redundant_ctx->query_ctx) RETURN_MODULE_FAIL;
+		goto run;
+	}
+
 	redundant_ctx->query_vb = fr_value_box_list_pop_head(&redundant_ctx->query);
 	if (!redundant_ctx->query_vb) RETURN_MODULE_FAIL;
 
@@ -1832,6 +2001,7 @@ static unlang_action_t mod_sql_redundant_resume(rlm_rcode_t *p_result, UNUSED in
 							  redundant_ctx->handle, redundant_ctx->trunk,
 							  redundant_ctx->query_vb->vb_strvalue, SQL_QUERY_OTHER));
 
+run:
 	if (unlang_function_repeat_set(request, mod_sql_redundant_query_resume) < 0) RETURN_MODULE_FAIL;
 
 	return unlang_function_push(request, inst->query, NULL, NULL, 0, UNLANG_SUB_FRAME, redundant_ctx->query_ctx);
@@ -1881,7 +2051,7 @@ static unlang_action_t CC_HINT(nonnull) mod_sql_redundant(rlm_rcode_t *p_result,
 				 UNLANG_SUB_FRAME, redundant_ctx) < 0) RETURN_MODULE_FAIL;
 
 	fr_value_box_list_init(&redundant_ctx->query);
-	if (unlang_tmpl_push(redundant_ctx, &redundant_ctx->query, request, *call_env->query, NULL) < 0) RETURN_MODULE_FAIL;
+	if (sql_redundant_query_push(request, redundant_ctx) < 0) RETURN_MODULE_FAIL;
 
 	return UNLANG_ACTION_PUSHED_CHILD;
 }
@@ -2034,8 +2204,36 @@ static int query_call_env_parse(TALLOC_CTX *ctx, call_env_parsed_head_t *out, tm
 			goto error;
 		}
 
-		call_env_parsed_set_multi_index(parsed_env, count, multi_index++);
+		call_env_parsed_set_multi_index(parsed_env, count, multi_index);
 		call_env_parsed_set_data(parsed_env, parsed_tmpl);
+
+		/*
+		 *	Where possible, split the query into a statement and its
+		 *	parameters, so the driver can prepare it once per connection.
+		 */
+		if (inst->config.prepared_statements) {
+			fr_sql_prepared_t	*prepared = NULL;
+
+			MEM(parsed_env = call_env_parsed_add(ctx, out,
+							     &(call_env_parser_t){
+								FR_CALL_ENV_PARSE_ONLY_OFFSET("query", FR_TYPE_VOID, CALL_ENV_FLAG_MULTI,
+											      sql_redundant_call_env_t, prepared)
+							     }));
+
+			if (cf_pair_value_quote(to_parse) == T_DOUBLE_QUOTED_STRING) {
+				prepared = fr_sql_prepared_alloc(parsed_env, inst, cf_pair_value(to_parse),
+								 talloc_array_length(cf_pair_value(to_parse)) - 1, t_rules);
+			}
+			if (prepared) {
+				cf_log_debug(to_parse, "Query will be run as a prepared statement: %s", prepared->shape);
+			} else {
+				cf_log_debug(to_parse, "Query cannot be run as a prepared statement");
+			}
+
+			call_env_parsed_set_multi_index(parsed_env, count, multi_index);
+			call_env_parsed_set_data(parsed_env, prepared);
+		}
+		multi_index++;
 	}
 
 	return 0;
@@ -2296,6 +2494,10 @@ static int mod_bootstrap(module_inst_ctx_t const *mctx)
 	xlat_func_flags_set(xlat, XLAT_FUNC_FLAG_PURE);
 	xlat_func_safe_for_set(xlat, SQL_SAFE_FOR);
 
+	if (unlikely(!(xlat = module_rlm_xlat_register(boot, mctx, "prepared_stats", sql_prepared_stats_xlat,
+							FR_TYPE_UINT64)))) return -1;
+	xlat_func_args_set(xlat, sql_prepared_stats_xlat_args);
+
 	if (unlikely(!(xlat = module_rlm_xlat_register(boot, mctx, "safe", xlat_transparent, FR_TYPE_STRING)))) return -1;
 	sql_xlat_arg = talloc_zero_array(xlat, xlat_arg_parser_t, 2);
 	sql_xlat_arg[0] = (xlat_arg_parser_t){
@@ -2347,6 +2549,11 @@ static int mod_thread_detach(module_thread_inst_ctx_t const *mctx)
 
 	if (inst->driver->sql_escape_arg_free) inst->driver->sql_escape_arg_free(t->sql_escape_arg);
 
+	if (t->prepared_hits || t->prepared_misses) {
+		DEBUG2("Prepared statement cache hits %" PRIu64 ", misses %" PRIu64,
+		       t->prepared_hits, t->prepared_misses);
+	}
+
 	return 0;
 }
 
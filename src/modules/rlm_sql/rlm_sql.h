@@ -34,6 +34,12 @@ RCSIDH(rlm_sql_h, "$Id$")
 #include <freeradius-devel/server/trunk.h>
 #include <freeradius-devel/unlang/function.h>
 
+#ifdef HAVE_STDATOMIC_H
+#  include <stdatomic.h>
+#else
+#  include <freeradius-devel/util/stdatomic.h>
+#endif
+
 #define FR_ITEM_CHECK 0
 #define FR_ITEM_REPLY 1
 
@@ -96,6 +102,9 @@ typedef struct {
 	char const		*connect_query;			//!< Query executed after establishing
 								//!< new connection.
 
+	bool			prepared_statements;		//!< Run parameterised queries as prepared statements
+								///< if the driver supports them.
+
 	trunk_conf_t		trunk_conf;			//!< Configuration for trunk connections.
 } rlm_sql_config_t;
 
@@ -108,6 +117,8 @@ typedef struct {
 	trunk_t		*trunk;				//!< Trunk connection for this thread.
 	rlm_sql_t const		*inst;				//!< Module instance data.
 	void			*sql_escape_arg;		//!< Thread specific argument to be passed to escape function.
+	uint64_t		prepared_hits;			//!< Prepared statements found on the connection.
+	uint64_t		prepared_misses;		//!< Prepared statements which had to be prepared first.
 } rlm_sql_thread_t;
 
 typedef struct {
@@ -133,6 +144,24 @@ typedef enum {
 	SQL_QUERY_RESULTS_FETCHED				//!< Results fetched from the server.
 } fr_sql_query_status_t;
 
+/** A query split into a fixed statement and the expansions bound into it
+ *
+ * Produced at instantiation time for queries where every expansion is a complete
+ * quoted SQL string literal.  The statement is prepared once per connection, and
+ * the expansions are bound as parameters, so they never need escaping.
+ */
+typedef struct {
+	unsigned int		id;				//!< Unique identifier, used as an index into
+								///< per-connection statement caches.
+	char const		*shape;				//!< Statement text with driver specific placeholders.
+	tmpl_t			**params;			//!< Expansions to bind to each placeholder.
+	bool			*nullable;			//!< Parameters bound as SQL NULL when their
+								///< expansion produces no value.
+	unsigned int		num_params;			//!< How many placeholders the statement has.
+	atomic_bool		unpreparable;			//!< The database refused to prepare the statement,
+								///< so the query is run as text instead.
+} fr_sql_prepared_t;
+
 typedef struct {
 	rlm_sql_t const		*inst;				//!< Module instance for this query.
 	request_t		*request;			//!< Request this query relates to.
@@ -141,6 +170,10 @@ typedef struct {
 	trunk_connection_t	*tconn;				//!< Trunk connection this query is being run on.
 	trunk_request_t	*treq;				//!< Trunk request for this query.
 	char const		*query_str;			//!< Query string to run.
+	fr_sql_prepared_t const	*prepared;			//!< Prepared statement to execute instead of query_str.
+	char const		**params;			//!< Values to bind to the prepared statement.
+								///< NULL entries are bound as SQL NULL.
+	bool			prepare_failed;			//!< The driver couldn't prepare the statement.
 	fr_sql_query_type_t	type;				//!< Type of query.
 	fr_sql_query_status_t	status;				//!< Status of the query.
 	sql_rcode_t		rcode;				//!< Result code.
@@ -228,6 +261,19 @@ typedef struct {
 	void		*(*sql_escape_arg_alloc)(TALLOC_CTX *ctx, fr_event_list_t *el, void *uctx);
 	void		(*sql_escape_arg_free)(void *uctx);
 
+	/** Write the placeholder for a bound parameter
+	 *
+	 * Drivers which provide this callback must be able to execute any query
+	 * which has fr_sql_query_t.prepared set.
+	 *
+	 * @param[out] out	Where to write the placeholder.
+	 * @param[in] num	Parameter number, starting at 1.
+	 * @return
+	 *	- >0 the number of bytes written.
+	 *	- <=0 on error.
+	 */
+	fr_slen_t	(*sql_placeholder)(fr_sbuff_t *out, unsigned int num);
+
 	bool			uses_trunks;		//!< Transitional flag for drivers which use trunks.
 	trunk_io_funcs_t	trunk_io_funcs;		//!< Trunk callback functions for this driver.
 } rlm_sql_driver_t;
@@ -265,6 +311,8 @@ unlang_action_t rlm_sql_trunk_query(rlm_rcode_t *p_result, UNUSED int *priority,
 unlang_action_t rlm_sql_fetch_row(rlm_rcode_t *p_result, UNUSED int *priority, request_t *request, void *uctx);
 void		rlm_sql_print_error(rlm_sql_t const *inst, request_t *request, fr_sql_query_t *query_ctx, bool force_debug);
 fr_sql_query_t *fr_sql_query_alloc(TALLOC_CTX *ctx, rlm_sql_t const *inst, request_t *request, rlm_sql_handle_t *handle, trunk_t *trunk, char const *query_str, fr_sql_query_type_t type);
+fr_sql_prepared_t *fr_sql_prepared_alloc(TALLOC_CTX *ctx, rlm_sql_t const *inst, char const *in, size_t inlen,
+					 tmpl_rules_t const *t_rules);
 
 /*
  *	sql_state.c
@@ -427,6 +427,264 @@ fr_sql_query_t *fr_sql_query_alloc(TALLOC_CTX *ctx, rlm_sql_t const *inst, reque
 	return query;
 }
 
+/** Find the end of an expansion
+ *
+ * @param[in] p		Pointing to the '%' which starts the expansion.
+ * @param[in] end	of the input.
+ * @return
+ *	- Length of the expansion, including the '%'.
+ *	- 0 if this is not an expansion we understand.
+ */
+static size_t sql_expansion_len(char const *p, char const *end)
+{
+	char const	*q = p + 1;
+	int		depth = 0;
+
+	/*
+	 *	%{...} or %func(...)
+	 */
+	if ((q < end) && (*q != '{')) {
+		while ((q < end) && (isalnum((uint8_t)*q) || (*q == '.') || (*q == '_') || (*q == '-'))) q++;
+		if ((q == end) || (*q != '(')) return 0;
+	}
+
+	while (q < end) {
+		switch (*q) {
+		case '{':
+		case '(':
+			depth++;
+			break;
+
+		case '}':
+		case ')':
+			if (--depth == 0) return (q + 1) - p;
+			break;
+
+		case '"':
+		case '\'':
+		{
+			char quote = *q++;
+
+			while ((q < end) && (*q != quote)) {
+				if ((*q == '\\') && ((q + 1) < end)) q++;
+				q++;
+			}
+			if (q == end) return 0;
+		}
+			break;
+
+		default:
+			break;
+		}
+		q++;
+	}
+
+	return 0;
+}
+
+/** Find where an expansion falls back to the SQL keyword NULL
+ *
+ * Queries use `%{&Acct-Session-Time || 'NULL'}` outside of SQL strings so that
+ * missing attributes are written as NULL.  Binding the string "NULL" would be
+ * wrong, so the fallback is removed, and the parameter is bound as an SQL NULL
+ * when the rest of the expansion produces no value.
+ *
+ * @param[in] in	Expansion to check.
+ * @param[in] inlen	Length of the expansion.
+ * @return
+ *	- The length of the expansion's contents before the fallback.
+ *	- 0 if the expansion doesn't fall back to NULL.
+ */
+static size_t sql_expansion_null_fallback(char const *in, size_t inlen)
+{
+	char const	*start = in + 2, *q = in + inlen - 1;
+
+	if ((inlen < 4) || (in[1] != '{') || (*q != '}')) return 0;
+
+	while ((q > start) && isspace((uint8_t)q[-1])) q--;
+	if (((q - start) < 6) || (strncasecmp(q - 6, "'NULL'", 6) != 0)) return 0;
+	q -= 6;
+
+	while ((q > start) && isspace((uint8_t)q[-1])) q--;
+	if (((q - start) < 2) || (q[-1] != '|') || (q[-2] != '|')) return 0;
+	q -= 2;
+
+	while ((q > start) && isspace((uint8_t)q[-1])) q--;
+
+	return q - start;
+}
+
+/** Add a parameter to a prepared statement
+ *
+ * @param[in] prepared	to add the parameter to.
+ * @param[in] inst	of rlm_sql.
+ * @param[out] shape	to write the placeholder to.
+ * @param[in] in	Expansion to parse.
+ * @param[in] inlen	Length of the expansion.
+ * @param[in] nullable	Whether the parameter is bound as SQL NULL when it has no value.
+ * @param[in] t_rules	to use when parsing the expansion.
+ * @return
+ *	- 0 on success.
+ *	- -1 on failure.
+ */
+static int sql_prepared_param_add(fr_sql_prepared_t *prepared, rlm_sql_t const *inst, fr_sbuff_t *shape,
+				  char const *in, size_t inlen, bool nullable, tmpl_rules_t const *t_rules)
+{
+	tmpl_t	*vpt;
+
+	if (tmpl_afrom_substr(prepared, &vpt, &FR_SBUFF_IN(in, inlen),
+			      T_DOUBLE_QUOTED_STRING, NULL, t_rules) <= 0) return -1;
+	if (tmpl_needs_resolving(vpt) &&
+	    (tmpl_resolve(vpt, &(tmpl_res_rules_t){ .dict_def = t_rules->attr.dict_def }) < 0)) return -1;
+
+	MEM(prepared->params = talloc_realloc(prepared, prepared->params, tmpl_t *, prepared->num_params + 1));
+	MEM(prepared->nullable = talloc_realloc(prepared, prepared->nullable, bool, prepared->num_params + 1));
+	prepared->nullable[prepared->num_params] = nullable;
+	prepared->params[prepared->num_params++] = vpt;
+
+	if (inst->driver->sql_placeholder(shape, prepared->num_params) <= 0) return -1;
+
+	return 0;
+}
+
+/** Split a query into a statement shape and a list of parameters
+ *
+ * Each expansion in the query is replaced with one of the driver's placeholders,
+ * and is parsed (without SQL escaping) so that its value can be bound when the
+ * query is run.  Where an expansion is the entire contents of a quoted SQL string,
+ * i.e. `'%{User-Name}'`, the quotes are replaced too.
+ *
+ * Expansions of the form `%{... || 'NULL'}` are bound as SQL NULL when they
+ * have no value, instead of as the string "NULL".
+ *
+ * Queries where expansions form part of a larger SQL string, or where the
+ * structure of the query can't be determined, are run as normal text queries.
+ *
+ * @note Expansions outside of SQL strings must produce values, not SQL syntax.
+ *
+ * @param[in] ctx	to allocate the prepared statement in.
+ * @param[in] inst	of rlm_sql.
+ * @param[in] in	Unprocessed query string from the configuration.
+ * @param[in] inlen	Length of the query string.
+ * @param[in] t_rules	to use when parsing parameter expansions.
+ * @return
+ *	- A new prepared statement.
+ *	- NULL if the query can't be run as a prepared statement.
+ */
+fr_sql_prepared_t *fr_sql_prepared_alloc(TALLOC_CTX *ctx, rlm_sql_t const *inst, char const *in, size_t inlen,
+					 tmpl_rules_t const *t_rules)
+{
+	static unsigned int	prepared_id;
+
+	fr_sql_prepared_t	*prepared;
+	fr_sbuff_t		shape;
+	fr_sbuff_uctx_talloc_t	tctx;
+	char const		*p = in, *end = in + inlen;
+	tmpl_rules_t		our_rules = *t_rules;
+
+	if (!inst->driver->sql_placeholder || !inst->driver->uses_trunks) return NULL;
+
+	/*
+	 *	Parameters are bound, not interpolated, so
+	 *	they must not be escaped.
+	 */
+	our_rules.escape = (tmpl_escape_t){ 0 };
+	our_rules.literals_safe_for = 0;
+
+	MEM(prepared = talloc_zero(ctx, fr_sql_prepared_t));
+	MEM(prepared->params = talloc_array(prepared, tmpl_t *, 0));
+	MEM(prepared->nullable = talloc_array(prepared, bool, 0));
+	if (!fr_sbuff_init_talloc(prepared, &shape, &tctx, inlen, SIZE_MAX)) {
+	error:
+		talloc_free(prepared);
+		return NULL;
+	}
+
+	while (p < end) {
+		char const	*q;
+		size_t		len;
+
+		switch (*p) {
+		/*
+		 *	Config strings may contain escapes which
+		 *	the tmpl parser would normally process.
+		 */
+		case '\\':
+			goto error;
+
+		/*
+		 *	Expansion outside of a string literal.
+		 */
+		case '%':
+		{
+			size_t	fallback;
+
+			len = sql_expansion_len(p, end);
+			if (!len) goto error;
+
+			fallback = sql_expansion_null_fallback(p, len);
+			if (fallback) {
+				char	*expr;
+				int	ret;
+
+				MEM(expr = talloc_asprintf(NULL, "%%{%.*s}", (int)fallback, p + 2));
+				ret = sql_prepared_param_add(prepared, inst, &shape, expr, talloc_strlen(expr),
+							     true, &our_rules);
+				talloc_free(expr);
+				if (ret < 0) goto error;
+			} else if (sql_prepared_param_add(prepared, inst, &shape, p, len, false, &our_rules) < 0) {
+				goto error;
+			}
+			p += len;
+		}
+			continue;
+
+		case '\'':
+			/*
+			 *	Plain string literal - copy it verbatim.
+			 */
+			if (((p + 1) >= end) || (p[1] != '%')) {
+				q = p + 1;
+				while ((q < end) && (*q != '\'')) {
+					if ((*q == '%') || (*q == '\\')) goto error;
+					q++;
+				}
+				if (q == end) goto error;
+				if (fr_sbuff_in_bstrncpy(&shape, p, (q + 1) - p) < 0) goto error;
+				p = q + 1;
+				continue;
+			}
+
+			/*
+			 *	The entire literal must be one expansion.
+			 */
+			len = sql_expansion_len(p + 1, end);
+			if (!len || ((p + 1 + len) >= end) || (p[1 + len] != '\'')) goto error;
+
+			if (sql_prepared_param_add(prepared, inst, &shape, p + 1, len, false, &our_rules) < 0) goto error;
+			p += len + 2;
+			continue;
+
+		default:
+			if (fr_sbuff_in_char(&shape, *p) <= 0) goto error;
+			p++;
+			continue;
+		}
+	}
+
+	/*
+	 *	Nothing to bind, the query is better off
+	 *	being run as-is.
+	 */
+	if (!prepared->num_params) goto error;
+
+	if (fr_sbuff_trim_talloc(&shape, SIZE_MAX) < 0) goto error;
+	prepared->shape = fr_sbuff_start(&shape);
+	prepared->id = prepared_id++;
+
+	return prepared;
+}
+
 /** Call the driver's sql_query method, reconnecting if necessary.
  *
  * @note Caller must call ``(inst->driver->sql_finish_query)(handle, &inst->config);``
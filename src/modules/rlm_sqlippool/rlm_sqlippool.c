@@ -53,6 +53,8 @@ typedef struct {
 	tmpl_t		*allocated_address_attr;	//!< Attribute to populate with allocated IP.
 	fr_value_box_t	allocated_address;		//!< Existing value for allocated IP.
 	fr_value_box_t	begin;				//!< SQL query to begin transaction.
+	tmpl_t		*atomic;			//!< tmpl to expand as a single query which finds and allocates
+							///< an IP.  Replaces all the other allocation queries.
 	tmpl_t		*existing;			//!< tmpl to expand as query for finding the existing IP.
 	tmpl_t		*requested;			//!< tmpl to expand as query for finding the requested IP.
 	tmpl_t		*find;				//!< tmpl to expand as query for finding an unused IP.
@@ -72,6 +74,8 @@ typedef struct {
  */
 typedef enum {
 	IPPOOL_ALLOC_BEGIN_RUN,			//!< Run the "begin" query
+	IPPOOL_ALLOC_ATOMIC,			//!< Expanding the "atomic" query
+	IPPOOL_ALLOC_ATOMIC_RUN,		//!< Run the "atomic" query
 	IPPOOL_ALLOC_EXISTING,			//!< Expanding the "existing" query
 	IPPOOL_ALLOC_EXISTING_RUN,		//!< Run the "existing" query
 	IPPOOL_ALLOC_REQUESTED,			//!< Expanding the "requested" query
@@ -176,7 +180,7 @@ static int sqlippool_result_process(char *out, int outlen, fr_sql_query_t *query
 	}
 
 	if (!row[0]) {
-		REDEBUG("The first column of the result was NULL");
+		RDEBUG2("The first column of the result was NULL");
 		goto finish;
 	}
 
@@ -194,6 +198,20 @@ finish:
 	return retval;
 }
 
+/** Check whether a query has been configured
+ *
+ */
+static bool sqlippool_query_set(CONF_SECTION *conf, char const *name)
+{
+	CONF_PAIR	*cp = cf_pair_find(conf, name);
+	char const	*value;
+
+	if (!cp) return false;
+
+	value = cf_pair_value(cp);
+	return value && (value[0] != '\0');
+}
+
 /*
  *	Do any per-module initialization that is separate to each
  *	configured instance of the module.  e.g. set up connections
@@ -227,6 +245,16 @@ static int mod_instantiate(module_inst_ctx_t const *mctx)
 		return -1;
 	}
 
+	/*
+	 *	Without one of these there's no way to allocate
+	 *	an address, so don't wait for the first request
+	 *	to find out.
+	 */
+	if (!sqlippool_query_set(conf, "alloc_atomic") && !sqlippool_query_set(conf, "alloc_find")) {
+		cf_log_err(conf, "Either alloc_atomic or alloc_find must be set");
+		return -1;
+	}
+
 	return 0;
 }
 
@@ -307,6 +335,23 @@ static unlang_action_t mod_alloc_resume(rlm_rcode_t *p_result, UNUSED int *prior
 		}
 		goto expand_requested;
 
+	case IPPOOL_ALLOC_ATOMIC:
+		SUBMIT_QUERY(query->vb_strvalue, IPPOOL_ALLOC_ATOMIC_RUN, SQL_QUERY_SELECT, select);
+
+	case IPPOOL_ALLOC_ATOMIC_RUN:
+		TALLOC_FREE(alloc_ctx->query);
+		if (query_ctx->rcode != RLM_SQL_OK) goto error;
+
+		allocation_len = sqlippool_result_process(allocation, sizeof(allocation), query_ctx);
+		sql->driver->sql_finish_select_query(query_ctx, &query_ctx->inst->config);
+
+		if (allocation_len > 0) goto make_pair;
+
+		/*
+		 *	There's no transaction to commit, go straight to the pool check.
+		 */
+		goto check_pool;
+
 	case IPPOOL_ALLOC_EXISTING:
 		if (query && query->vb_length) SUBMIT_QUERY(query->vb_strvalue, IPPOOL_ALLOC_EXISTING_RUN, SQL_QUERY_SELECT, select);
 		goto expand_requested;
@@ -376,6 +421,7 @@ static unlang_action_t mod_alloc_resume(rlm_rcode_t *p_result, UNUSED int *prior
 		if ((env->commit.type == FR_TYPE_STRING) &&
 		    env->commit.vb_length) sql->driver->sql_finish_query(query_ctx, &query_ctx->inst->config);
 
+	check_pool:
 		/*
 		 *  Should we perform pool-check?
 		 */
@@ -418,9 +464,10 @@ static unlang_action_t mod_alloc_resume(rlm_rcode_t *p_result, UNUSED int *prior
 		alloc_ctx->rcode = RLM_MODULE_UPDATED;
 
 		/*
-		 *	If we have an update query expand it
+		 *	If we have an update query expand it.  The "atomic"
+		 *	query has already updated the lease.
 		 */
-		if (env->update) {
+		if (env->update && !env->atomic) {
 			alloc_ctx->status = IPPOOL_ALLOC_UPDATE;
 			REPEAT_MOD_ALLOC_RESUME;
 			if (unlang_tmpl_push(alloc_ctx, &alloc_ctx->values, request, env->update, NULL) < 0) goto error;
@@ -476,7 +523,7 @@ static unlang_action_t mod_alloc_resume(rlm_rcode_t *p_result, UNUSED int *prior
 		sql->driver->sql_finish_query(query_ctx, &query_ctx->inst->config);
 
 	finish:
-		if ((env->commit.type == FR_TYPE_STRING) &&
+		if (!env->atomic && (env->commit.type == FR_TYPE_STRING) &&
 		    env->commit.vb_length) SUBMIT_QUERY(env->commit.vb_strvalue, IPPOOL_ALLOC_COMMIT_RUN, SQL_QUERY_OTHER, query);
 
 		FALL_THROUGH;
@@ -528,6 +575,8 @@ static unlang_action_t CC_HINT(nonnull) mod_alloc(rlm_rcode_t *p_result, module_
 		RETURN_MODULE_NOOP;
 	}
 
+	fr_assert(env->atomic || env->find);	/* Checked in mod_instantiate */
+
 	RESERVE_CONNECTION(handle, inst->sql, request);
 	if (!sql->sql_escape_arg && !thread->sql_escape_arg && handle)
 		request_data_add(request, (void *)sql_escape_uctx_alloc, 0, handle, false, false, false);
@@ -555,6 +604,19 @@ static unlang_action_t CC_HINT(nonnull) mod_alloc(rlm_rcode_t *p_result, module_
 		RETURN_MODULE_FAIL;
 	}
 
+	/*
+	 *	A single query (usually a stored procedure) does the whole
+	 *	allocation, so there's no transaction to begin.
+	 */
+	if (env->atomic) {
+		alloc_ctx->status = IPPOOL_ALLOC_ATOMIC;
+		if (unlang_tmpl_push(alloc_ctx, &alloc_ctx->values, request, env->atomic, NULL) < 0) {
+			talloc_free(alloc_ctx);
+			RETURN_MODULE_FAIL;
+		}
+		return UNLANG_ACTION_PUSHED_CHILD;
+	}
+
 	if ((env->begin.type == FR_TYPE_STRING) && env->begin.vb_length) {
 		alloc_ctx->query_ctx->query_str = env->begin.vb_strvalue;
 		return unlang_function_push(request, sql->query, NULL, NULL, 0, UNLANG_SUB_FRAME, alloc_ctx->query_ctx);
@@ -742,11 +804,13 @@ static const call_env_method_t sqlippool_alloc_method_env = {
 		{ FR_CALL_ENV_OFFSET("alloc_begin", FR_TYPE_STRING, CALL_ENV_FLAG_CONCAT | CALL_ENV_FLAG_NULLABLE,
 				     ippool_alloc_call_env_t, begin), QUERY_ESCAPE,
 				     .pair.dflt = "START TRANSACTION", .pair.dflt_quote = T_SINGLE_QUOTED_STRING },
+		{ FR_CALL_ENV_PARSE_ONLY_OFFSET("alloc_atomic", FR_TYPE_STRING, CALL_ENV_FLAG_PARSE_ONLY,
+						ippool_alloc_call_env_t, atomic), QUERY_ESCAPE },
 		{ FR_CALL_ENV_PARSE_ONLY_OFFSET("alloc_existing", FR_TYPE_STRING, CALL_ENV_FLAG_PARSE_ONLY,
 						ippool_alloc_call_env_t, existing), QUERY_ESCAPE },
 		{ FR_CALL_ENV_PARSE_ONLY_OFFSET("alloc_requested", FR_TYPE_STRING, CALL_ENV_FLAG_PARSE_ONLY,
 						ippool_alloc_call_env_t, requested), QUERY_ESCAPE },
-		{ FR_CALL_ENV_PARSE_ONLY_OFFSET("alloc_find", FR_TYPE_STRING, CALL_ENV_FLAG_PARSE_ONLY | CALL_ENV_FLAG_REQUIRED,
+		{ FR_CALL_ENV_PARSE_ONLY_OFFSET("alloc_find", FR_TYPE_STRING, CALL_ENV_FLAG_PARSE_ONLY,
 						ippool_alloc_call_env_t, find), QUERY_ESCAPE },
 		{ FR_CALL_ENV_PARSE_ONLY_OFFSET("alloc_update", FR_TYPE_STRING, CALL_ENV_FLAG_PARSE_ONLY,
 						ippool_alloc_call_env_t, update), QUERY_ESCAPE },
@@ -5,7 +5,7 @@
 #
 TARGET		:= libfreeradius-dns$(L)
 
-SOURCES		:= base.c decode.c encode.c
+SOURCES		:= base.c cache.c decode.c encode.c
 
 SRC_CFLAGS	:= -I$(top_builddir)/src -DNO_ASSERT
 TGT_LDLIBS	:= $(PCAP_LIBS)
@@ -0,0 +1,379 @@
+/*
+ *   This library is free software; you can redistribute it and/or
+ *   modify it under the terms of the GNU Lesser General Public
+ *   License as published by the Free Software Foundation; either
+ *   version 2.1 of the License, or (at your option) any later version.
+ *
+ *   This library is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ *   Lesser General Public License for more details.
+ *
+ *   You should have received a copy of the GNU Lesser General Public
+ *   License along with this library; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+/**
+ * $Id$
+ *
+ * @file protocols/dns/cache.c
+ * @brief Functions for re-using encoded DNS replies.
+ *
+ * Replies are cached as the packets we sent, keyed by the question.  When
+ * the same question is asked again, the cached packet is copied, and the
+ * ID, the RD bit, the case of the question name, and the TTLs are patched
+ * in place.  There's no decoding or encoding, so a hit is cheap enough to
+ * be answered from the network thread.
+ *
+ * @copyright 2024 The FreeRADIUS server project
+ */
+RCSID("$Id$")
+
+#include <freeradius-devel/util/nbo.h>
+
+#include "dns.h"
+
+#define DNS_TYPE_SOA		(6)
+#define DNS_TYPE_OPT		(41)
+
+#define DNS_OPT_COOKIE		(10)
+#define DNS_OPT_FLAG_DO		(0x8000)	//!< in the low 16 bits of the OPT "TTL".
+
+#define DNS_RCODE_NOERROR	(0)
+#define DNS_RCODE_NXDOMAIN	(3)
+
+#define DNS_MAX_UDP		(512)		//!< largest reply we can send to a client without EDNS.
+
+/** Iterate over the resource records which follow the question
+ *
+ */
+typedef struct {
+	uint8_t const		*packet;
+	uint8_t const		*p;
+	uint8_t const		*end;
+
+	unsigned int		num;			//!< index of the current RR.
+	unsigned int		count;			//!< total number of RRs.
+	unsigned int		ancount;
+	unsigned int		nscount;
+
+	uint16_t		type;
+	uint32_t		ttl;
+	size_t			ttl_offset;		//!< where the TTL is in the packet.
+	uint8_t const		*rdata;
+	uint16_t		rdlen;
+} dns_rr_iter_t;
+
+/** Skip over a name, which may be compressed
+ *
+ */
+static uint8_t const *dns_name_skip(uint8_t const *p, uint8_t const *end)
+{
+	while (p < end) {
+		if (*p == 0) return p + 1;
+
+		if ((*p & 0xc0) == 0xc0) return ((p + 2) <= end) ? p + 2 : NULL;
+
+		if ((*p & 0xc0) != 0) return NULL;
+
+		p += *p + 1;
+	}
+
+	return NULL;
+}
+
+static int dns_rr_iter_init(dns_rr_iter_t *iter, uint8_t const *packet, size_t packet_len)
+{
+	uint8_t const *p;
+
+	p = dns_name_skip(packet + DNS_HDR_LEN, packet + packet_len);
+	if (!p || ((p + 4) > (packet + packet_len))) return -1;
+
+	*iter = (dns_rr_iter_t) {
+		.packet = packet,
+		.p = p + 4,
+		.end = packet + packet_len,
+		.ancount = fr_nbo_to_uint16(packet + 6),
+		.nscount = fr_nbo_to_uint16(packet + 8),
+	};
+	iter->count = iter->ancount + iter->nscount + fr_nbo_to_uint16(packet + 10);
+
+	return 0;
+}
+
+/** Move to the next RR
+ *
+ * @return
+ *	- 1 if there's an RR.
+ *	- 0 if all RRs have been seen, and they fill the packet exactly.
+ *	- -1 if the packet is malformed.
+ */
+static int dns_rr_next(dns_rr_iter_t *iter)
+{
+	uint8_t const *p;
+
+	if (iter->num == iter->count) return (iter->p == iter->end) ? 0 : -1;
+
+	p = dns_name_skip(iter->p, iter->end);
+	if (!p || ((p + 10) > iter->end)) return -1;
+
+	iter->type = fr_nbo_to_uint16(p);
+	iter->ttl = fr_nbo_to_uint32(p + 4);
+	iter->ttl_offset = (p + 4) - iter->packet;
+	iter->rdlen = fr_nbo_to_uint16(p + 8);
+	iter->rdata = p + 10;
+
+	if ((iter->rdata + iter->rdlen) > iter->end) return -1;
+
+	iter->p = iter->rdata + iter->rdlen;
+	iter->num++;
+
+	return 1;
+}
+
+/** Find the OPT RR, if there is one
+ *
+ * @return
+ *	- 1 if there's an OPT, and iter points to it.
+ *	- 0 if there's no OPT.
+ *	- -1 if the packet is malformed.
+ */
+static int dns_opt_find(dns_rr_iter_t *iter, uint8_t const *packet, size_t packet_len)
+{
+	int ret;
+
+	if (dns_rr_iter_init(iter, packet, packet_len) < 0) return -1;
+
+	while ((ret = dns_rr_next(iter)) > 0) {
+		if (iter->type == DNS_TYPE_OPT) return 1;
+	}
+
+	return ret;
+}
+
+/** See if the OPT RR carries a particular option
+ *
+ */
+static bool dns_opt_has_option(dns_rr_iter_t const *iter, uint16_t code)
+{
+	uint8_t const *p = iter->rdata, *end = iter->rdata + iter->rdlen;
+
+	while ((p + 4) <= end) {
+		if (fr_nbo_to_uint16(p) == code) return true;
+
+		p += 4 + fr_nbo_to_uint16(p + 2);
+	}
+
+	return false;
+}
+
+/** Build the cache key from the question of a query or a reply
+ *
+ *  The key is the question name in lowercase, followed by the type and
+ *  the class.  The question name must be uncompressed, which it always
+ *  is in practice, as there's nothing in front of it to point to.
+ *
+ *  The last octet of the key records whether there's an OPT RR, and
+ *  the DO and CD bits.  A reply built for a client with DNSSEC, or
+ *  without validation, is then only re-used for clients which asked
+ *  for the same thing.  The server copies CD from the query to the
+ *  reply, as RFC 4035 requires.  A reply which doesn't echo the OPT
+ *  or the DO bit of its query is only re-used for queries which look
+ *  like the reply, i.e. without EDNS, or without DNSSEC.
+ *
+ * @param[out] out		where the key is written.
+ * @param[in] outlen		size of the output buffer.  Should be FR_DNS_CACHE_KEY_MAX.
+ * @param[in] packet		to read the question from.
+ * @param[in] packet_len	length of the packet.
+ * @return
+ *	- >0 the length of the key.
+ *	- 0 if the packet can't be answered from a cache.
+ */
+ssize_t fr_dns_cache_key(uint8_t *out, size_t outlen, uint8_t const *packet, size_t packet_len)
+{
+	fr_dns_packet_t const	*hdr = (fr_dns_packet_t const *) packet;
+	dns_rr_iter_t		iter;
+	uint8_t const		*p, *end;
+	uint8_t			*q = out;
+	size_t			i;
+
+	if (packet_len <= DNS_HDR_LEN) return 0;
+
+	if ((hdr->opcode != FR_DNS_QUERY) || (fr_nbo_to_uint16(packet + 4) != 1)) return 0;
+
+	p = packet + DNS_HDR_LEN;
+	end = packet + packet_len;
+
+	while (p < end) {
+		size_t label_len = *p;
+
+		if (label_len == 0) break;
+
+		if ((label_len & 0xc0) != 0) return 0;
+
+		if ((p + 1 + label_len) >= end) return 0;
+		if (((size_t) (q - out) + 1 + label_len + 1 + 4) > outlen) return 0;
+
+		*(q++) = *(p++);
+		for (i = 0; i < label_len; i++) *(q++) = tolower(*(p++));
+	}
+
+	if ((p + 1 + 4) > end) return 0;
+	if (((size_t) (q - out) + 1 + 4 + 1) > outlen) return 0;
+
+	*(q++) = *(p++);	/* trailing zero */
+	memcpy(q, p, 4);	/* qtype, qclass */
+	q += 4;
+
+	*q = hdr->checking_disabled ? FR_DNS_CACHE_KEY_CD : 0;
+
+	switch (dns_opt_find(&iter, packet, packet_len)) {
+	case 1:
+		*q |= FR_DNS_CACHE_KEY_OPT;
+		if ((iter.ttl & DNS_OPT_FLAG_DO) != 0) *q |= FR_DNS_CACHE_KEY_DO;
+		break;
+
+	case 0:
+		break;
+
+	default:
+		return 0;
+	}
+
+	return (q + 1) - out;
+}
+
+/** How long a reply can be re-used for
+ *
+ *  Positive answers can be re-used for the lowest TTL in the packet,
+ *  and negative ones (NXDOMAIN, or NOERROR with no answers) for the SOA
+ *  TTL or minimum, as in RFC 2308.  Negative answers without an SOA,
+ *  truncated replies, and errors can't be re-used.  Neither can replies
+ *  with a DNS COOKIE, as the server cookie is for one client.
+ *
+ * @param[in] packet		the reply, as sent.
+ * @param[in] packet_len	length of the reply.
+ * @param[in] max_ttl		cap for positive answers.
+ * @param[in] max_negative_ttl	cap for negative answers.
+ * @return
+ *	- >0 how long the reply can be re-used for.
+ *	- 0 if the reply can't be re-used.
+ */
+fr_time_delta_t fr_dns_cache_lifetime(uint8_t const *packet, size_t packet_len,
+				      fr_time_delta_t max_ttl, fr_time_delta_t max_negative_ttl)
+{
+	fr_dns_packet_t const	*hdr = (fr_dns_packet_t const *) packet;
+	dns_rr_iter_t		iter;
+	uint32_t		min_ttl = UINT32_MAX, soa_ttl = 0;
+	bool			has_soa = false;
+	fr_time_delta_t		lifetime;
+	int			ret;
+
+	if ((packet_len <= DNS_HDR_LEN) || (packet_len > 65535)) return fr_time_delta_wrap(0);
+
+	if (!hdr->query || (hdr->opcode != FR_DNS_QUERY) || hdr->truncated) return fr_time_delta_wrap(0);
+
+	if ((hdr->rcode != DNS_RCODE_NOERROR) && (hdr->rcode != DNS_RCODE_NXDOMAIN)) return fr_time_delta_wrap(0);
+
+	if (fr_nbo_to_uint16(packet + 4) != 1) return fr_time_delta_wrap(0);
+
+	if (dns_rr_iter_init(&iter, packet, packet_len) < 0) return fr_time_delta_wrap(0);
+
+	while ((ret = dns_rr_next(&iter)) > 0) {
+		/*
+		 *	The OPT "TTL" is flags, and doesn't expire.
+		 */
+		if (iter.type == DNS_TYPE_OPT) {
+			if (dns_opt_has_option(&iter, DNS_OPT_COOKIE)) return fr_time_delta_wrap(0);
+			continue;
+		}
+
+		if (iter.ttl < min_ttl) min_ttl = iter.ttl;
+
+		/*
+		 *	The last field of an SOA in the authority
+		 *	section is the negative TTL.
+		 */
+		if ((iter.type == DNS_TYPE_SOA) && (iter.num > iter.ancount) &&
+		    (iter.num <= (iter.ancount + iter.nscount)) && (iter.rdlen >= 22)) {
+			uint32_t minimum = fr_nbo_to_uint32(iter.rdata + iter.rdlen - 4);
+
+			soa_ttl = (iter.ttl < minimum) ? iter.ttl : minimum;
+			has_soa = true;
+		}
+	}
+	if (ret < 0) return fr_time_delta_wrap(0);
+
+	if ((hdr->rcode == DNS_RCODE_NXDOMAIN) || (iter.ancount == 0)) {
+		if (!has_soa) return fr_time_delta_wrap(0);
+
+		lifetime = fr_time_delta_from_sec(soa_ttl);
+		if (fr_time_delta_gt(lifetime, max_negative_ttl)) lifetime = max_negative_ttl;
+	} else {
+		lifetime = fr_time_delta_from_sec(min_ttl);
+		if (fr_time_delta_gt(lifetime, max_ttl)) lifetime = max_ttl;
+	}
+
+	return lifetime;
+}
+
+/** Make a reply to a query from a cached reply to the same question
+ *
+ * @param[out] out		where the reply is written.
+ * @param[in] outlen		size of the output buffer.
+ * @param[in] cached		the cached reply.
+ * @param[in] cached_len	length of the cached reply.
+ * @param[in] age		how long the reply has been cached.  The TTLs are reduced by this much.
+ * @param[in] query		the query.  It must have the same key as the cached reply.
+ * @param[in] query_len		length of the query.
+ * @return
+ *	- >0 the length of the reply in out.
+ *	- 0 if the cached reply can't be used for this query.
+ */
+ssize_t fr_dns_cache_reply(uint8_t *out, size_t outlen, uint8_t const *cached, size_t cached_len,
+			   fr_time_delta_t age, uint8_t const *query, size_t query_len)
+{
+	dns_rr_iter_t	iter;
+	uint8_t const	*qname_end;
+	int64_t		seconds;
+	int		ret;
+
+	/*
+	 *	A client without EDNS can't take a large reply over UDP.
+	 *	Let the server send it a truncated one.
+	 */
+	if ((cached_len > DNS_MAX_UDP) && (fr_nbo_to_uint16(query + 10) == 0)) return 0;
+
+	if (cached_len > outlen) return 0;
+
+	qname_end = dns_name_skip(query + DNS_HDR_LEN, query + query_len);
+	if (!qname_end) return 0;
+
+	memcpy(out, cached, cached_len);
+
+	out[0] = query[0];	/* ID */
+	out[1] = query[1];
+	out[2] = (out[2] & ~0x01) | (query[2] & 0x01); /* RD */
+
+	/*
+	 *	Resolvers may randomize the case of the name, and
+	 *	check that we echo it back.  The name is the same
+	 *	length, as the key is the same.
+	 */
+	memcpy(out + DNS_HDR_LEN, query + DNS_HDR_LEN, qname_end - (query + DNS_HDR_LEN));
+
+	seconds = fr_time_delta_to_sec(age);
+	if (seconds <= 0) return cached_len;
+
+	if (dns_rr_iter_init(&iter, out, cached_len) < 0) return 0;
+
+	while ((ret = dns_rr_next(&iter)) > 0) {
+		if (iter.type == DNS_TYPE_OPT) continue;
+
+		fr_nbo_from_uint32(out + iter.ttl_offset, (iter.ttl > seconds) ? iter.ttl - seconds : 0);
+	}
+	if (ret < 0) return 0;
+
+	return cached_len;
+}
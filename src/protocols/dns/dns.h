@@ -153,6 +153,23 @@ ssize_t	fr_dns_decode(TALLOC_CTX *ctx, fr_pair_list_t *out,
 
 ssize_t fr_dns_encode(fr_dbuff_t *dbuff, fr_pair_list_t *vps, fr_dns_ctx_t *encode_ctx);
 
+/*
+ *	cache.c
+ */
+#define FR_DNS_CACHE_KEY_MAX	(255 + 4 + 1)	//!< qname + qtype + qclass + flags
+
+#define FR_DNS_CACHE_KEY_OPT	(0x01)		//!< the packet has an OPT RR.
+#define FR_DNS_CACHE_KEY_DO	(0x02)		//!< the DO bit is set in the OPT RR.
+#define FR_DNS_CACHE_KEY_CD	(0x04)		//!< the CD bit is set in the header.
+
+ssize_t		fr_dns_cache_key(uint8_t *out, size_t outlen, uint8_t const *packet, size_t packet_len) CC_HINT(nonnull);
+
+fr_time_delta_t	fr_dns_cache_lifetime(uint8_t const *packet, size_t packet_len,
+				      fr_time_delta_t max_ttl, fr_time_delta_t max_negative_ttl) CC_HINT(nonnull);
+
+ssize_t		fr_dns_cache_reply(uint8_t *out, size_t outlen, uint8_t const *cached, size_t cached_len,
+				   fr_time_delta_t age, uint8_t const *query, size_t query_len) CC_HINT(nonnull);
+
 #ifdef __cplusplus
 }
 #endif
@@ -55,6 +55,7 @@ test: \
 		test.modules	\
 		test.radiusd-c	\
 		test.radclient	\
+		test.radsec	\
 		test.detail	\
 		test.radsniff	\
 		test.auth	\
@@ -15,11 +15,15 @@ $(eval $(call TEST_BOOTSTRAP))
 # 	so we copy it manually to the output directory (always), and then
 #	put the server logs into the output file.
 #
-$(OUTPUT)/%: $(DIR)/% $(addprefix ${BUILD_DIR}/lib/,proto_detail.la proto_detail_file.la proto_detail_work.la)
+#	The server also writes each entry to a binary detail file,
+#	which is then read back with config/binary.conf.
+#
+$(OUTPUT)/%: $(DIR)/% $(addprefix ${BUILD_DIR}/lib/,proto_detail.la proto_detail_file.la proto_detail_work.la rlm_detail.la)
 	$(eval DIR := $(dir $<))
 	${Q}echo "DETAIL $(notdir $<)"
 	${Q}cp $< $(dir $@)/detail.txt
-	${Q}rm -f $(dir $@)/processed
+	${Q}rm -f $(dir $@)/processed $(dir $@)/roundtrip
+	${Q}rm -rf $(dir $@)/binary
 	${Q}if ! $(TEST_BIN)/radiusd -d $(DIR)/config -D ${top_srcdir}/share/dictionary -X > $@.log; then \
 		tail $@.log; \
 		echo "cp $< $(dir $@)/detail.txt; $(TEST_BIN)/radiusd -d $(DIR)/config -D ${top_srcdir}/share/dictionary -X "; \
@@ -30,6 +34,16 @@ $(OUTPUT)/%: $(DIR)/% $(addprefix ${BUILD_DIR}/lib/,proto_detail.la proto_detail
 		echo "Processing $< failed to produce expected output $(dir $@)/processed"; \
 		exit 1; \
 	fi
+	${Q}if ! $(TEST_BIN)/radiusd -d $(DIR)/config -n binary -D ${top_srcdir}/share/dictionary -X > $@.binary.log; then \
+		tail $@.binary.log; \
+		echo "$(TEST_BIN)/radiusd -d $(DIR)/config -n binary -D ${top_srcdir}/share/dictionary -X "; \
+		exit 1; \
+	fi
+	${Q}if [ ! -e $(dir $@)/roundtrip ] ; then \
+		tail $@.binary.log; \
+		echo "Reading the binary detail file written from $< failed to produce expected output $(dir $@)/roundtrip"; \
+		exit 1; \
+	fi
 	${Q}touch $@
 
 .NO_PARALLEL: $(TEST)
@@ -67,7 +67,7 @@ ifeq "$(PACKAGE_TEST)" ""
 #
 #  Ensure that we run
 #
-$(OUTPUT)/${1}.ok:  $(patsubst %,rlm_eap_%.la,$(subst -,_,${1}))
+$(OUTPUT)/${1}.ok:  $(filter $(EAP_TARGETS),$(patsubst %,rlm_eap_%.la,$(subst -,_,${1})))
 endif
 
 endef
@@ -78,6 +78,11 @@ ifeq "$(PACKAGE_TEST)" ""
 #  The EAP-MSCHAPv2 module calls MSCHAP to do the dirty work.
 #
 $(OUTPUT)/mschapv2.ok: rlm_mschap.la
+
+#
+#  EAP-TLS, with private key operations performed by crypto threads.
+#
+$(OUTPUT)/tls-pkey-offload.ok: rlm_eap_tls.la
 endif
 
 #
@@ -91,9 +96,11 @@ $(OUTPUT)/${1}:
 endef
 
 #
-#  Setup rules to spawn a different RADIUSD instance for each EAP type
+#  Setup rules to spawn a different RADIUSD instance for each EAP type,
+#  and for each test which needs its own server configuration.
 #
-$(foreach TEST,$(addprefix test., $(subst _,-,$(EAP_TYPES))),$(eval $(call RADIUSD_SERVICE,servers,$(OUTPUT)/$(TEST)))$(eval $(call ADD_TEST_EAP_OUTPUT,$(TEST))))
+EAPOL_SERVERS := $(sort $(subst _,-,$(EAP_TYPES)) $(patsubst $(DIR)/%.conf,%,$(EAPOL_TEST_FILES)))
+$(foreach TEST,$(addprefix test., $(EAPOL_SERVERS)),$(eval $(call RADIUSD_SERVICE,servers,$(OUTPUT)/$(TEST)))$(eval $(call ADD_TEST_EAP_OUTPUT,$(TEST))))
 
 #  Reset
 TEST := test.eap
@@ -180,6 +180,28 @@ $(OUTPUT)/%: $(DIR)/% $(TEST_BIN_DIR)/unit_test_module | $(KEYWORD_RADDB) $(KEYW
 $(TEST):
 	@touch $(BUILD_DIR)/tests/$@
 
+#
+#  Time the comparisons in cmp-bench, which are specialised when the
+#  server starts, against the same comparisons through the generic path.
+#  Not part of "make test".
+#
+#	make test.keywords.bench KEYWORD_BENCH_COUNT=1000000
+#
+#  Comparisons per second include the cost of creating the request,
+#  so they're a lower bound.
+#
+KEYWORD_BENCH_COUNT ?= 100000
+
+.PHONY: test.keywords.bench
+test.keywords.bench: $(TEST_BIN_DIR)/unit_test_module | $(KEYWORD_RADDB) $(KEYWORD_LIBS) build.raddb
+	${Q}for x in cmp-bench cmp-bench-generic; do \
+		n=$$(grep -c '^if ' src/tests/keywords/$$x); \
+		KEYWORD=$$x $(TEST_BIN)/unit_test_module -c $(KEYWORD_BENCH_COUNT) -D share/dictionary -d src/tests/keywords/ \
+			-i src/tests/keywords/default-input.attrs -S require_enum_prefix=yes | \
+		sed -n 's/.*(\([0-9]*\) ns per request).*/\1/p' | \
+		awk -v name=$$x -v n=$$n '{ printf "%-20s %8d ns per request, %12.0f comparisons/s\n", name, $$1, (n * 1000000000) / $$1 }'; \
+	done
+
 $(TEST).help:
 	@echo make $(TEST_KEYWORDS_HELP)
 
@@ -17,6 +17,11 @@ $(eval $(call TEST_BOOTSTRAP))
 include src/tests/radiusd.mk
 $(eval $(call RADIUSD_SERVICE,radiusd,$(OUTPUT)))
 
+#
+#	09_cache relies on the search made when 01_add is processed
+#
+$(OUTPUT)/09_cache.ldif: $(OUTPUT)/01_add.ldif
+
 $(TEST).trigger_clear:
 	${Q}rm -f $(BUILD_DIR)/tests/ldap_sync/rfc4533/sync_started
 
@@ -0,0 +1,62 @@
+#
+#	Tests for the RADIUS/TLS listener.
+#
+#	The client is "openssl s_client", which sends a pre-built
+#	RADIUS packet (hex encoded in the input file), and we check
+#	the code of the reply.
+#
+RADSEC_OPENSSL := $(shell which openssl 2> /dev/null)
+
+ifneq "$(and $(OPENSSL_LIBS),$(RADSEC_OPENSSL))" ""
+#
+#	Test name
+#
+TEST  := test.radsec
+FILES := $(subst $(DIR)/,,$(wildcard $(DIR)/*.txt))
+
+$(eval $(call TEST_BOOTSTRAP))
+
+#
+#  Generic rules to start / stop the radius service.
+#
+CLIENT := radclient
+include src/tests/radiusd.mk
+$(eval $(call RADIUSD_SERVICE,radiusd,$(OUTPUT)))
+
+#
+#	Send each packet over a TLS connection, using the test
+#	certificate as the client certificate.  The server closes
+#	the connection once it's idle, which is when s_client exits.
+#
+$(OUTPUT)/%: $(DIR)/% $(BUILD_DIR)/lib/local/proto_radius_tls.la | $(TEST).radiusd_kill $(TEST).radiusd_start
+	$(eval CERTS    := $(dir $<)certs)
+	$(eval EXPECTED := $(patsubst %.txt,%.out,$<))
+	$(eval FOUND    := $(patsubst %.txt,%.out,$@))
+	$(eval S_CLIENT := $(RADSEC_OPENSSL) s_client -quiet -connect 127.0.0.1:$(radsec_port) -cert $(CERTS)/server.pem -key $(CERTS)/server.key -CAfile $(CERTS)/server.pem)
+	${Q}echo "RADSEC-TEST INPUT=$(notdir $<)"
+	${Q}[ -f $(dir $@)/radiusd.pid ] || exit 1
+	${Q}grep -v '^#' $< | perl -ne 'chomp; print pack("H*", $$_)' | \
+		timeout 10 $(S_CLIENT) 2> $(FOUND).log | head -c 1 | od -An -tu1 | tr -d ' ' > $(FOUND)
+	${Q}if ! cmp -s $(FOUND) $(EXPECTED); then \
+		echo "RADSEC FAILED $@"; \
+		echo "RADIUSD:  $(RADIUSD_RUN)"; \
+		echo "S_CLIENT: $(S_CLIENT)"; \
+		echo "Expected reply code $$(cat $(EXPECTED)), got '$$(cat $(FOUND))'"; \
+		cat $(FOUND).log; \
+		rm -f $(BUILD_DIR)/tests/test.radsec; \
+		$(MAKE) --no-print-directory test.radsec.radiusd_kill; \
+		exit 1; \
+	fi
+	${Q}touch $@
+
+.NO_PARALLEL: $(TEST)
+$(TEST):
+	${Q}$(MAKE) --no-print-directory $@.radiusd_stop
+	@touch $(BUILD_DIR)/tests/$@
+
+else
+.PHONY: test.radsec
+test.radsec:
+	${Q}echo "WARNING: 'test.radsec' requires OpenSSL, and the 'openssl' command line tool"
+	${Q}echo "Skipping 'test.radsec'"
+endif